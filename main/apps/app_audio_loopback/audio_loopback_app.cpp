@@ -4,32 +4,92 @@
 #include <mooncake.h>
 #include <mooncake_log.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstdio>
 #include <cstdint>
 #include <cstring>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/task.h"
-#include "freertos/ringbuf.h"
 
-#include <driver/i2s_std.h>
-#include <esp_err.h>
+#include <esp_cpu.h>
+#include <esp_timer.h>
+
+#include "utils/audio/pcm.h"
+#include "utils/audio/audio_mixer.h"
+#include "utils/fs/io_service.h"
 
 namespace {
 
 static const std::string kTag = "AudioLoopback";
 
-constexpr uint8_t kEs8311Addr = 0x18;
-
-constexpr i2s_port_t kI2SPort = I2S_NUM_1;
-constexpr gpio_num_t kI2SBclk = GPIO_NUM_41;
-constexpr gpio_num_t kI2SWs   = GPIO_NUM_43;
-constexpr gpio_num_t kI2SDout = GPIO_NUM_42;
-constexpr gpio_num_t kI2SDin  = GPIO_NUM_46;
-
 constexpr uint32_t kSampleRate = 16000;
 constexpr size_t kChunkFrames = 128;
+// The mic comes in at the mixer rate and is resampled to kSampleRate, from at most this many times faster
+constexpr size_t kMaxCaptureRatio = 3;
+
+// One chunk on each side plus one for wake up jitter, below that the mixer pulls the buffer dry
+constexpr uint32_t kMinDelaySamples = 3 * kChunkFrames;
+constexpr uint32_t kStatsIntervalMs = 500;
+
+// 4095 chips (256 ms) at about -15 dBFS, loud enough to stand out of room noise without straining the speaker
+constexpr int kCalOrder = 12;
+constexpr int16_t kCalAmplitude = 6000;
+// Longest round trip searched, DMA and codec take well under this
+constexpr uint32_t kCalMaxLagMs = 200;
+
+// Recordings go to rec_NNNN.wav in here. Four slots hold 2s of 16kHz mono PCM (8s as ADPCM) for the card to stall
+constexpr const char* kRecordDir = "/recordings";
+constexpr size_t kRecSlots = 4;
+
+constexpr int kPresetCount = 4;
+
+struct Preset_t {
+    const char* name;
+    dsp::EffectsChain::Config_t config;
+};
+
+Preset_t makePreset(int index)
+{
+    Preset_t preset = {"Off", {}};
+    auto& c = preset.config;
+    switch (index) {
+        case 1:
+            // Speech: rumble out, a little presence, steady level, feedback caught
+            preset.name = "Voice";
+            c.eq[0] = {dsp::Band::HighPass, 120.0f, 0.707f, 0.0f};
+            c.eq[1] = {dsp::Band::Peaking, 3000.0f, 1.0f, 3.0f};
+            c.gate_on = true;
+            c.comp_on = true;
+            c.limit_on = true;
+            c.howl_on = true;
+            break;
+        case 2:
+            preset.name = "Warm";
+            c.eq[0] = {dsp::Band::HighPass, 80.0f, 0.707f, 0.0f};
+            c.eq[1] = {dsp::Band::LowShelf, 250.0f, 0.707f, 3.0f};
+            c.eq[2] = {dsp::Band::HighShelf, 5000.0f, 0.707f, -4.0f};
+            c.comp.threshold_db = -20.0f;
+            c.comp.ratio = 2.0f;
+            c.comp.makeup_db = 3.0f;
+            c.comp_on = true;
+            c.limit_on = true;
+            c.howl_on = true;
+            break;
+        case 3:
+            // Everything as recorded, only protected against feedback and clipping
+            preset.name = "Safe";
+            c.limit_on = true;
+            c.howl_on = true;
+            break;
+        default:
+            break;
+    }
+    return preset;
+}
 
 }  // namespace
 
@@ -41,22 +101,24 @@ AudioLoopbackApp::AudioLoopbackApp()
 void AudioLoopbackApp::onOpen()
 {
     mclog::tagInfo(kTag, "onOpen");
-    _prev_volume = GetHAL().speaker.getVolume();
-    _prev_volume_valid = true;
-
     _volume.store(0);
     _delay_ms.store(0);
     _loopback_enabled.store(false);
+    _cal_failed = false;
     _needs_redraw = true;
 
-    GetHAL().speaker.stop();
-    GetHAL().speaker.end();
-    GetHAL().mic.end();
-
-    const bool ok = initLoopbackEngine();
-    mclog::tagInfo(kTag, "initLoopbackEngine: {}", ok);
+    // Plays and records through the mixer, whatever else sounds keeps going, Music ducked under the Voice stream
+    const bool ok = GetHAL().mixer.isRunning() && GetHAL().mixer.sampleRate() <= kSampleRate * kMaxCaptureRatio;
+    if (!ok) {
+        mclog::tagError(kTag, "mixer not running at up to {} Hz", kSampleRate * kMaxCaptureRatio);
+    }
+    // Vector and scalar kernels disagreeing would show up as a quiet glitch, not a crash, so check them up front
+    if (!pcm::selfTest()) {
+        mclog::tagError(kTag, "pcm kernels self test failed");
+    }
 
     hookKeyboard();
+    hookSdCard();
     if (ok) {
         startLoopbackTask();
     }
@@ -72,59 +134,87 @@ void AudioLoopbackApp::loopbackTaskMain(void* arg)
     }
 
     mclog::tagInfo(kTag, "loopback read task start");
-    uint8_t last_vol = 0xFF;
-    static int16_t buf[kChunkFrames * 2];
-    auto* rb = static_cast<RingbufHandle_t>(app->_ring_buffer_handle);
+    alignas(pcm::kAlign) static int16_t buf[kChunkFrames * kMaxCaptureRatio * 2];
+    alignas(pcm::kAlign) static int16_t wide[kChunkFrames * kMaxCaptureRatio];
+    // A chunk of input makes kChunkFrames, one more when the resampler's position carries over
+    alignas(pcm::kAlign) static int16_t raw[kChunkFrames + 1];
+    alignas(pcm::kAlign) static int16_t mono[kChunkFrames + 1];
+    const size_t chunk_in = kChunkFrames * GetHAL().mixer.sampleRate() / kSampleRate;
+    static dsp::EffectsChain::Config_t fx_config;
+    uint32_t fx_cycles = 0;
 
     while (app->_task_running.load()) {
-        auto* rx = static_cast<i2s_chan_handle_t>(app->_i2s_rx_handle);
-        if (rx == nullptr || rb == nullptr) {
-            vTaskDelay(10 / portTICK_PERIOD_MS);
-            continue;
+        if (xQueueReceive(static_cast<QueueHandle_t>(app->_fx_queue), &fx_config, 0) == pdTRUE) {
+            app->_effects.configure(fx_config);
         }
 
-        size_t bytes_read = 0;
-        esp_err_t rr = i2s_channel_read(rx, buf, sizeof(buf), &bytes_read, 100 / portTICK_PERIOD_MS);
-        if (rr != ESP_OK || bytes_read == 0) {
+        const size_t got = GetHAL().micRead(buf, chunk_in, 100);
+        if (got == 0) {
+            continue;
+        }
+        // Filtered below the loopback's Nyquist frequency on the way down, nothing folds into the speech band
+        pcm::stereoToMono(wide, buf, got);
+        const size_t frames = app->_capture_src.convert(wide, got, raw);
+        if (frames == 0) {
             continue;
         }
 
         const bool enabled = app->_loopback_enabled.load();
         const uint8_t vol = app->_volume.load();
         const bool audible = enabled && vol > 0;
-        const uint8_t dac_vol = audible ? 0xBF : 0;
-        constexpr uint32_t kMaxDigitalGainQ8 = 64u * 256u;
-        const uint32_t gain_q8 = audible ? (static_cast<uint32_t>(vol) * kMaxDigitalGainQ8) / 255u : 0u;
-
-        if (dac_vol != last_vol) {
-            last_vol = dac_vol;
-            bool ok = M5.In_I2C.writeRegister8(kEs8311Addr, 0x32, dac_vol, 400000);
-            if (!ok) {
-                mclog::tagWarn(kTag, "i2c write fail: ES8311 reg 0x32");
-            }
+        const CalState cal = app->_cal_state.load(std::memory_order_acquire);
+        constexpr float kMaxDigitalGain = 64.0f;
+        if (cal == CalState::Armed) {
+            app->_cal_state.store(CalState::Ready, std::memory_order_release);
         }
 
-        const size_t frames = bytes_read / (sizeof(int16_t) * 2);
-        if (!audible || frames == 0) {
-            std::memset(buf, 0, frames * sizeof(int16_t) * 2);
-        } else {
+        // Recorded before gain and effects, what the mic picked up
+        const RecState rec = app->_rec_state.load(std::memory_order_acquire);
+        if (rec == RecState::Recording) {
+            app->_recorder.push(raw, frames);
+        } else if (rec == RecState::Stopping) {
+            app->_recorder.finish();
+            app->_rec_state.store(RecState::Flushing, std::memory_order_release);
+        }
+
+        // The raw mic, without gain or mute, from the stream position the mixer started the sequence at
+        if (cal == CalState::Playing) {
+            auto& capture = app->_cal_capture;
+            const uint32_t start = app->_cal_start.load(std::memory_order_relaxed);
+            const uint32_t first = static_cast<uint32_t>(app->_jitter.written());
             for (size_t i = 0; i < frames; ++i) {
-                const int32_t l = buf[i * 2];
-                const int32_t r = buf[i * 2 + 1];
-                int32_t s = (l + r) / 2;
-                int32_t y = (s * static_cast<int32_t>(gain_q8)) >> 8;
-                if (y > 32767) y = 32767;
-                if (y < -32768) y = -32768;
-                const int16_t out = static_cast<int16_t>(y);
-                buf[i * 2] = out;
-                buf[i * 2 + 1] = out;
+                const int32_t at = static_cast<int32_t>(first + i - start);
+                if (at < 0) {
+                    continue;
+                }
+                if (static_cast<size_t>(at) >= capture.size()) {
+                    break;
+                }
+                capture[at] = raw[i];
+                app->_cal_captured = at + 1;
+            }
+            if (app->_cal_captured == capture.size()) {
+                app->_cal_state.store(CalState::Captured, std::memory_order_release);
             }
         }
-
-        if (xRingbufferSend(rb, buf, bytes_read, 0) != pdTRUE) {
-            // buffer full, maybe drop or overwrite? 
-            // For now just drop to keep latest data flow
+        // Both channels carry the same signal, only the mono mix goes through the jitter buffer. Muted while
+        // calibrating, the sequence must not come back out of the loop
+        if (!audible || cal != CalState::Idle || frames == 0) {
+            std::memset(mono, 0, frames * sizeof(int16_t));
+        } else {
+            pcm::gain(mono, raw, frames, pcm::makeGain(vol * kMaxDigitalGain / 255.0f));
+
+            // Cost is bounded by the preset, not the signal, the average shows how much of the budget it takes
+            const uint32_t start = esp_cpu_get_cycle_count();
+            app->_effects.process(mono, frames);
+            const uint32_t cycles = (esp_cpu_get_cycle_count() - start) / frames;
+            fx_cycles = fx_cycles == 0 ? cycles : fx_cycles + (static_cast<int32_t>(cycles - fx_cycles) >> 4);
+            app->_fx_cycles.store(fx_cycles, std::memory_order_relaxed);
+            app->_fx_notches.store(static_cast<uint8_t>(app->_effects.howl().notchCount()), std::memory_order_relaxed);
         }
+
+        // A full buffer only happens if the mixer stalls, the overrun is counted in the stats
+        app->_jitter.push(mono, frames, esp_timer_get_time());
     }
 
     mclog::tagInfo(kTag, "loopback read task stop");
@@ -132,64 +222,193 @@ void AudioLoopbackApp::loopbackTaskMain(void* arg)
     vTaskDelete(nullptr);
 }
 
-void AudioLoopbackApp::writeTaskMain(void* arg)
+void AudioLoopbackApp::pullOutput(int16_t* out, size_t frames, void* ctx)
+{
+    auto* app = static_cast<AudioLoopbackApp*>(ctx);
+
+    // Called by the mixer task for exactly what its next block needs. The delay set is from mic to speaker, the
+    // measured round trip through the mixer, DMA and codec is already part of it
+    const int64_t now = esp_timer_get_time();
+    const int32_t delay = app->_delay_ms.load() * static_cast<int32_t>(kSampleRate / 1000);
+    const int32_t target = delay - app->_round_trip.load();
+    app->_jitter.setTarget(static_cast<uint32_t>(std::max(target, static_cast<int32_t>(kMinDelaySamples))));
+    app->_jitter.pull(out, frames, now);
+
+    CalState cal = app->_cal_state.load(std::memory_order_acquire);
+    if (cal == CalState::Ready) {
+        // A loopback pull right now would play what was captured up to here, so the round trip counts from the
+        // same point the jitter buffer delay counts to
+        const double position = app->_jitter.capturePosition(now);
+        const double start = std::ceil(position);
+        app->_cal_offset = static_cast<float>(start - position);
+        app->_cal_start.store(static_cast<uint32_t>(static_cast<uint64_t>(start)), std::memory_order_relaxed);
+        app->_cal_played = 0;
+        app->_cal_state.store(CalState::Playing, std::memory_order_release);
+        cal = CalState::Playing;
+    }
+    if (cal == CalState::Playing) {
+        const auto& mls = app->_cal_mls;
+        for (size_t i = 0; i < frames; ++i, ++app->_cal_played) {
+            const bool chip = app->_cal_played < mls.size();
+            out[i] = chip ? static_cast<int16_t>(mls[app->_cal_played] * kCalAmplitude) : 0;
+        }
+    }
+}
+
+void AudioLoopbackApp::calibrateTaskMain(void* arg)
 {
     auto* app = static_cast<AudioLoopbackApp*>(arg);
-    if (app == nullptr) {
-        vTaskDelete(nullptr);
+
+    const int64_t start_us = esp_timer_get_time();
+    latency::correlate(app->_cal_mls.data(), app->_cal_mls.size(), app->_cal_capture.data(), app->_cal_corr.size(),
+                       app->_cal_corr.data());
+    app->_cal_us = esp_timer_get_time() - start_us;
+    app->_cal_peak = latency::findPeak(app->_cal_corr.data(), app->_cal_corr.size());
+
+    app->_cal_state.store(app->_cal_peak.found ? CalState::Done : CalState::Failed, std::memory_order_release);
+    vTaskDelete(nullptr);
+}
+
+void AudioLoopbackApp::startCalibration()
+{
+    if (_task_handle == nullptr || _cal_state.load() != CalState::Idle) {
         return;
     }
 
-    mclog::tagInfo(kTag, "loopback write task start");
-    auto* rb = static_cast<RingbufHandle_t>(app->_ring_buffer_handle);
-    static const uint8_t zeros[512] = {0}; 
+    const size_t lags = kSampleRate * kCalMaxLagMs / 1000;
+    _cal_mls = latency::makeMls(kCalOrder);
+    _cal_capture.assign(_cal_mls.size() + lags - 1, 0);
+    _cal_corr.assign(lags, 0);
+    _cal_captured = 0;
+    _cal_failed = false;
+    _needs_redraw = true;
+    _cal_state.store(CalState::Armed, std::memory_order_release);
+}
 
-    while (app->_task_running.load()) {
-        auto* tx = static_cast<i2s_chan_handle_t>(app->_i2s_tx_handle);
-        if (tx == nullptr || rb == nullptr) {
-            vTaskDelay(10 / portTICK_PERIOD_MS);
-            continue;
+void AudioLoopbackApp::updateCalibration()
+{
+    const CalState state = _cal_state.load(std::memory_order_acquire);
+    if (state == CalState::Captured) {
+        // About 13M multiply-adds, on the other core and below the audio tasks
+        _cal_state.store(CalState::Correlating);
+        BaseType_t ok = xTaskCreatePinnedToCore(
+            AudioLoopbackApp::calibrateTaskMain, "loop_cal", 4096, this, 1, nullptr, 0);
+        if (ok != pdPASS) {
+            mclog::tagError(kTag, "create calibrate task failed");
+            _cal_state.store(CalState::Failed);
         }
+        return;
+    }
+    if (state != CalState::Done && state != CalState::Failed) {
+        return;
+    }
 
-        const int delay_ms = app->_delay_ms.load();
-        const size_t target_delay_bytes = delay_ms * 64; // 16kHz * 4 bytes/sample * ms
-        const size_t total_size = 80 * 1024;
-        const size_t free_size = xRingbufferGetCurFreeSize(rb);
-        const size_t used_size = total_size - free_size;
+    if (state == CalState::Done) {
+        const float round_trip = _cal_offset + _cal_peak.lag;
+        _round_trip.store(static_cast<int32_t>(std::lround(round_trip)));
+        _round_trip_ms = round_trip * 1000.0f / kSampleRate;
+        mclog::tagInfo(kTag, "round trip {:.2f} ms, peak ratio {:.1f}, correlation took {} us", _round_trip_ms,
+                       _cal_peak.ratio, _cal_us);
+    } else {
+        mclog::tagWarn(kTag, "calibration found no echo, peak ratio {:.1f}", _cal_peak.ratio);
+    }
+    _cal_failed = state == CalState::Failed;
 
-        // If buffer has less data than target delay, write silence to wait
-        if (used_size < target_delay_bytes) {
-            size_t bytes_written = 0;
-            i2s_channel_write(tx, zeros, sizeof(zeros), &bytes_written, 100 / portTICK_PERIOD_MS);
-            continue;
-        }
+    std::vector<int8_t>().swap(_cal_mls);
+    std::vector<int16_t>().swap(_cal_capture);
+    std::vector<int32_t>().swap(_cal_corr);
+    _cal_state.store(CalState::Idle);
+    _needs_redraw = true;
+}
+
+void AudioLoopbackApp::startRecording()
+{
+    if (_rec_state.load() != RecState::Idle || _task_handle == nullptr || _rec_name_request != 0) {
+        return;
+    }
+    if (!GetHAL().isSdCardMounted()) {
+        mclog::tagWarn(kTag, "record: no SD card");
+        return;
+    }
 
-        // If buffer has too much data (lag > target + 100ms), drop data to catch up
-        if (used_size > target_delay_bytes + 6400) {
-            size_t size = 0;
-            void* data = xRingbufferReceive(rb, &size, 0);
-            if (data) {
-                vRingbufferReturnItem(rb, data);
+    // The folder and a free name are looked for on the IoService worker, the recording starts once it has one
+    const std::string dir = std::string(GetHAL().getSdCardMountPoint()) + kRecordDir;
+    _rec_name_request = GetIoService().newFileName(
+        dir, "rec_%04d.wav", IoService::Priority::Normal, [this](IoService::Result_t& result) {
+            _rec_name_request = 0;
+            if (!result.ok) {
+                mclog::tagError(kTag, "record: no free name in {}: {}", result.path, result.error);
+                return;
             }
-            continue;
-        }
+            beginRecording(result.path);
+        });
+}
 
-        size_t size = 0;
-        void* data = xRingbufferReceive(rb, &size, 100 / portTICK_PERIOD_MS);
-        if (data != nullptr && size > 0) {
-            size_t bytes_written = 0;
-            i2s_channel_write(tx, data, size, &bytes_written, 100 / portTICK_PERIOD_MS);
-            vRingbufferReturnItem(rb, data);
-        }
+void AudioLoopbackApp::beginRecording(const std::string& path)
+{
+    if (_rec_state.load() != RecState::Idle || _task_handle == nullptr) {
+        return;
     }
 
-    mclog::tagInfo(kTag, "loopback write task stop");
-    app->_write_task_handle = nullptr;
-    vTaskDelete(nullptr);
+    WavRecorder::Config_t config;
+    config.path = path;
+    config.sample_rate = kSampleRate;
+    config.channels = 1;
+    config.codec = _rec_adpcm ? WavRecorder::Codec::ImaAdpcm : WavRecorder::Codec::Pcm16;
+    config.slots = kRecSlots;
+    if (!_recorder.start(config)) {
+        mclog::tagError(kTag, "record: start failed: {}", _recorder.stats().error);
+        return;
+    }
+    _rec_path = path;
+    _rec_state.store(RecState::Recording, std::memory_order_release);
+    mclog::tagInfo(kTag, "recording to {} ({} slots)", path, _recorder.stats().slots);
+    _needs_redraw = true;
+}
+
+void AudioLoopbackApp::stopRecording()
+{
+    RecState expected = RecState::Recording;
+    if (_rec_state.compare_exchange_strong(expected, RecState::Stopping)) {
+        _needs_redraw = true;
+    }
+}
+
+void AudioLoopbackApp::updateRecording()
+{
+    if (_rec_state.load(std::memory_order_acquire) != RecState::Flushing || _recorder.busy()) {
+        return;
+    }
+    const auto stats = _recorder.stats();
+    mclog::tagInfo(kTag, "recorded {}: {} frames, {} dropped, {} writes, max write {} us, free slots {}, error {}",
+                   _rec_path, stats.frames, stats.dropped, stats.writes, stats.max_write_us, stats.min_free,
+                   stats.error);
+    _rec_state.store(RecState::Idle);
+    _needs_redraw = true;
 }
 
 void AudioLoopbackApp::onRunning()
 {
+    updateCalibration();
+    updateRecording();
+
+    const uint32_t now = GetHAL().millis();
+    if (now - _last_stats_ms >= kStatsIntervalMs) {
+        _last_stats_ms = now;
+        const auto stats = _jitter.stats();
+        if (stats.delay != _shown_stats.delay || stats.rate_ppm != _shown_stats.rate_ppm ||
+            stats.underruns != _shown_stats.underruns || stats.overruns != _shown_stats.overruns) {
+            _needs_redraw = true;
+        }
+        if (_fx_cycles.load() != _shown_fx_cycles || _fx_notches.load() != _shown_fx_notches) {
+            _needs_redraw = true;
+        }
+        const auto rec = _recorder.stats();
+        if (rec.frames / kSampleRate != _shown_rec.frames / kSampleRate || rec.dropped != _shown_rec.dropped ||
+            rec.max_write_us != _shown_rec.max_write_us || rec.error != _shown_rec.error) {
+            _needs_redraw = true;
+        }
+    }
     if (_needs_redraw) {
         _needs_redraw = false;
         draw();
@@ -201,14 +420,7 @@ void AudioLoopbackApp::onClose()
     mclog::tagInfo(kTag, "onClose");
     stopLoopbackTask();
     unhookKeyboard();
-    deinitLoopbackEngine();
-
-    if (_prev_volume_valid) {
-        GetHAL().speaker.begin();
-        GetHAL().speaker.setVolume(_prev_volume);
-    } else {
-        GetHAL().speaker.begin();
-    }
+    unhookSdCard();
 }
 
 void AudioLoopbackApp::startLoopbackTask()
@@ -217,16 +429,51 @@ void AudioLoopbackApp::startLoopbackTask()
         return;
     }
 
-    // 80KB ring buffer (approx 1250ms at 16kHz stereo 16bit)
-    _ring_buffer_handle = xRingbufferCreate(80 * 1024, RINGBUF_TYPE_BYTEBUF);
-    if (_ring_buffer_handle == nullptr) {
-        mclog::tagError(kTag, "create ring buffer failed");
+    // Mono, room for kMaxDelayMs plus a third for the chunks in flight (64KB at 16kHz)
+    if (!_jitter.init(kSampleRate * kMaxDelayMs / 1000 * 4 / 3, kSampleRate)) {
+        mclog::tagError(kTag, "create jitter buffer failed");
+        return;
+    }
+
+    // The chain starts with the selected preset, later changes overwrite whatever the read task hasn't taken yet
+    _effects.init(kSampleRate);
+    _fx_queue = xQueueCreate(1, sizeof(dsp::EffectsChain::Config_t));
+    if (_fx_queue == nullptr) {
+        mclog::tagError(kTag, "create effects queue failed");
+        _jitter.deinit();
+        return;
+    }
+    selectPreset(_preset);
+
+    // The mic's chunk at most, the read task converts one per read
+    const uint32_t mixer_rate = GetHAL().mixer.sampleRate();
+    if (!_capture_src.init(mixer_rate, kSampleRate, 1, Resampler::Quality::Medium, kChunkFrames * kMaxCaptureRatio)) {
+        mclog::tagError(kTag, "create capture resampler failed");
+        _jitter.deinit();
+        vQueueDelete(static_cast<QueueHandle_t>(_fx_queue));
+        _fx_queue = nullptr;
+        return;
+    }
+
+    // Mono at the loopback rate, the mixer converts it. The loopback has its own volume, the master one stays out
+    AudioMixer::StreamConfig_t stream;
+    stream.role = AudioMixer::Role::Voice;
+    stream.sample_rate = kSampleRate;
+    stream.channels = 1;
+    stream.master = false;
+    stream.pull = AudioLoopbackApp::pullOutput;
+    stream.ctx = this;
+    _stream = GetHAL().mixer.open(stream);
+    if (_stream < 0) {
+        mclog::tagError(kTag, "open mixer stream failed");
+        _capture_src.deinit();
+        _jitter.deinit();
+        vQueueDelete(static_cast<QueueHandle_t>(_fx_queue));
+        _fx_queue = nullptr;
         return;
     }
 
     _task_running.store(true);
-    
-    // Create Read Task (Producer)
     TaskHandle_t read_handle = nullptr;
     BaseType_t ok_read = xTaskCreatePinnedToCore(
         AudioLoopbackApp::loopbackTaskMain,
@@ -240,228 +487,62 @@ void AudioLoopbackApp::startLoopbackTask()
     if (ok_read != pdPASS) {
         mclog::tagError(kTag, "create read task failed");
         _task_running.store(false);
-        vRingbufferDelete(static_cast<RingbufHandle_t>(_ring_buffer_handle));
-        _ring_buffer_handle = nullptr;
+        GetHAL().mixer.close(_stream);
+        _stream = -1;
+        _capture_src.deinit();
+        _jitter.deinit();
+        vQueueDelete(static_cast<QueueHandle_t>(_fx_queue));
+        _fx_queue = nullptr;
         return;
     }
     _task_handle = read_handle;
-
-    // Create Write Task (Consumer)
-    TaskHandle_t write_handle = nullptr;
-    BaseType_t ok_write = xTaskCreatePinnedToCore(
-        AudioLoopbackApp::writeTaskMain,
-        "loop_write",
-        8192,
-        this,
-        4,
-        &write_handle,
-        1);
-
-    if (ok_write != pdPASS) {
-        mclog::tagError(kTag, "create write task failed");
-        // Clean up read task (it will stop because _task_running is set to false, but we should be careful)
-        _task_running.store(false);
-        // We rely on stopLoopbackTask logic or manual cleanup, but here just set null
-        // Read task will exit soon
-        _write_task_handle = nullptr; 
-        return;
-    }
-    _write_task_handle = write_handle;
 }
 
 void AudioLoopbackApp::stopLoopbackTask()
 {
     _task_running.store(false);
-    
-    // Wait for tasks to stop
-    while (_task_handle != nullptr || _write_task_handle != nullptr) {
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-    }
-
-    if (_ring_buffer_handle != nullptr) {
-        vRingbufferDelete(static_cast<RingbufHandle_t>(_ring_buffer_handle));
-        _ring_buffer_handle = nullptr;
-    }
-}
 
-bool AudioLoopbackApp::initLoopbackEngine()
-{
-    if (_i2s_tx_handle != nullptr || _i2s_rx_handle != nullptr) {
-        return true;
+    // Wait for the read task and a correlation still running, then for the mixer to stop pulling
+    while (_task_handle != nullptr || _cal_state.load() == CalState::Correlating) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
     }
-
-    mclog::tagInfo(
-        kTag,
-        "I2C enabled={} port={} sda={} scl={}",
-        M5.In_I2C.isEnabled(),
-        static_cast<int>(M5.In_I2C.getPort()),
-        static_cast<int>(M5.In_I2C.getSDA()),
-        static_cast<int>(M5.In_I2C.getSCL()));
-
-    if (!M5.In_I2C.isEnabled()) {
-        mclog::tagError(kTag, "I2C not enabled");
-        return false;
+    GetHAL().mixer.close(_stream);
+    _stream = -1;
+
+    // With the read task gone the UI finishes a recording that was still open and drops one still waiting for a name
+    GetIoService().cancel(_rec_name_request);
+    _rec_name_request = 0;
+    const RecState rec = _rec_state.load();
+    if (rec == RecState::Recording || rec == RecState::Stopping) {
+        _recorder.finish();
+        _rec_state.store(RecState::Flushing);
     }
-
-    const bool codec_found = M5.In_I2C.scanID(kEs8311Addr, 400000);
-    mclog::tagInfo(kTag, "ES8311 found={} addr=0x{:02X}", codec_found, static_cast<unsigned>(kEs8311Addr));
-    if (!codec_found) {
-        return false;
+    _recorder.wait();
+    updateRecording();
+
+    // A calibration cut short is dropped, the last result stays
+    std::vector<int8_t>().swap(_cal_mls);
+    std::vector<int16_t>().swap(_cal_capture);
+    std::vector<int32_t>().swap(_cal_corr);
+    _cal_state.store(CalState::Idle);
+
+    _capture_src.deinit();
+    _jitter.deinit();
+    if (_fx_queue != nullptr) {
+        vQueueDelete(static_cast<QueueHandle_t>(_fx_queue));
+        _fx_queue = nullptr;
     }
-
-    GetHAL().speaker.stop();
-    GetHAL().speaker.end();
-    GetHAL().mic.end();
-
-    auto wr = [&](uint8_t reg, uint8_t val) -> bool {
-        bool ok = M5.In_I2C.writeRegister8(kEs8311Addr, reg, val, 400000);
-        if (!ok) {
-            mclog::tagError(kTag, "i2c write fail: reg=0x{:02X} val=0x{:02X}", (unsigned)reg, (unsigned)val);
-        }
-        return ok;
-    };
-    auto rd = [&](uint8_t reg, uint8_t* out) -> bool {
-        return M5.In_I2C.readRegister(kEs8311Addr, reg, out, 1, 400000);
-    };
-
-    uint8_t reg00 = 0;
-    if (rd(0x00, &reg00)) {
-        mclog::tagInfo(kTag, "ES8311 reg00(before)=0x{:02X}", (unsigned)reg00);
-    } else {
-        mclog::tagWarn(kTag, "i2c read fail: reg00(before)");
-    }
-
-    bool ok_i2c = true;
-    ok_i2c &= wr(0x00, 0x80);
-    ok_i2c &= wr(0x01, 0xBF);
-    ok_i2c &= wr(0x02, 0x18);
-    ok_i2c &= wr(0x0D, 0x01);
-    ok_i2c &= wr(0x0E, 0x02);
-    ok_i2c &= wr(0x14, 0x10);
-    ok_i2c &= wr(0x17, 0xBF);
-    ok_i2c &= wr(0x1C, 0x6A);
-    ok_i2c &= wr(0x12, 0x00);
-    ok_i2c &= wr(0x13, 0x10);
-    ok_i2c &= wr(0x32, 0x00);
-    ok_i2c &= wr(0x37, 0x08);
-
-    if (!ok_i2c) {
-        return false;
-    }
-
-    if (ok_i2c) {
-        uint8_t r1 = 0, r0d = 0, r0e = 0, r12 = 0, r13 = 0, r32 = 0;
-        rd(0x01, &r1);
-        rd(0x0D, &r0d);
-        rd(0x0E, &r0e);
-        rd(0x12, &r12);
-        rd(0x13, &r13);
-        rd(0x32, &r32);
-        mclog::tagInfo(
-            kTag,
-            "ES8311 regs: 01=0x{:02X} 0D=0x{:02X} 0E=0x{:02X} 12=0x{:02X} 13=0x{:02X} 32=0x{:02X}",
-            (unsigned)r1,
-            (unsigned)r0d,
-            (unsigned)r0e,
-            (unsigned)r12,
-            (unsigned)r13,
-            (unsigned)r32);
-    }
-
-    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(kI2SPort, I2S_ROLE_MASTER);
-    chan_cfg.dma_desc_num = 4;
-    chan_cfg.dma_frame_num = 128;
-    chan_cfg.auto_clear = true;
-
-    i2s_chan_handle_t tx_handle = nullptr;
-    i2s_chan_handle_t rx_handle = nullptr;
-    esp_err_t err = i2s_new_channel(&chan_cfg, &tx_handle, &rx_handle);
-    if (err != ESP_OK) {
-        mclog::tagError(kTag, "i2s_new_channel failed: {}", esp_err_to_name(err));
-        return false;
-    }
-
-    i2s_std_config_t tx_cfg;
-    std::memset(&tx_cfg, 0, sizeof(tx_cfg));
-    tx_cfg.clk_cfg.clk_src = i2s_clock_src_t::I2S_CLK_SRC_PLL_160M;
-    tx_cfg.clk_cfg.sample_rate_hz = kSampleRate;
-    tx_cfg.clk_cfg.mclk_multiple = i2s_mclk_multiple_t::I2S_MCLK_MULTIPLE_128;
-    tx_cfg.slot_cfg.data_bit_width = i2s_data_bit_width_t::I2S_DATA_BIT_WIDTH_16BIT;
-    tx_cfg.slot_cfg.slot_bit_width = i2s_slot_bit_width_t::I2S_SLOT_BIT_WIDTH_16BIT;
-    tx_cfg.slot_cfg.slot_mode = i2s_slot_mode_t::I2S_SLOT_MODE_STEREO;
-    tx_cfg.slot_cfg.slot_mask = i2s_std_slot_mask_t::I2S_STD_SLOT_BOTH;
-    tx_cfg.slot_cfg.ws_width = 16;
-    tx_cfg.slot_cfg.ws_pol = false;
-    tx_cfg.slot_cfg.bit_shift = true;
-    tx_cfg.slot_cfg.left_align = true;
-    tx_cfg.slot_cfg.big_endian = false;
-    tx_cfg.slot_cfg.bit_order_lsb = false;
-    tx_cfg.gpio_cfg.bclk = kI2SBclk;
-    tx_cfg.gpio_cfg.ws = kI2SWs;
-    tx_cfg.gpio_cfg.dout = kI2SDout;
-    tx_cfg.gpio_cfg.din = GPIO_NUM_NC;
-    tx_cfg.gpio_cfg.mclk = GPIO_NUM_NC;
-
-    i2s_std_config_t rx_cfg = tx_cfg;
-    rx_cfg.gpio_cfg.dout = GPIO_NUM_NC;
-    rx_cfg.gpio_cfg.din = kI2SDin;
-
-    err = i2s_channel_init_std_mode(tx_handle, &tx_cfg);
-    if (err != ESP_OK) {
-        mclog::tagError(kTag, "i2s init tx failed: {}", esp_err_to_name(err));
-        i2s_del_channel(tx_handle);
-        i2s_del_channel(rx_handle);
-        return false;
-    }
-    err = i2s_channel_init_std_mode(rx_handle, &rx_cfg);
-    if (err != ESP_OK) {
-        mclog::tagError(kTag, "i2s init rx failed: {}", esp_err_to_name(err));
-        i2s_del_channel(tx_handle);
-        i2s_del_channel(rx_handle);
-        return false;
-    }
-
-    err = i2s_channel_enable(tx_handle);
-    if (err != ESP_OK) {
-        mclog::tagError(kTag, "i2s enable tx failed: {}", esp_err_to_name(err));
-        i2s_del_channel(tx_handle);
-        i2s_del_channel(rx_handle);
-        return false;
-    }
-    err = i2s_channel_enable(rx_handle);
-    if (err != ESP_OK) {
-        mclog::tagError(kTag, "i2s enable rx failed: {}", esp_err_to_name(err));
-        i2s_channel_disable(tx_handle);
-        i2s_del_channel(tx_handle);
-        i2s_del_channel(rx_handle);
-        return false;
-    }
-
-    _i2s_tx_handle = tx_handle;
-    _i2s_rx_handle = rx_handle;
-    mclog::tagInfo(kTag, "i2s enabled ok");
-    return true;
 }
 
-void AudioLoopbackApp::deinitLoopbackEngine()
+void AudioLoopbackApp::selectPreset(int index)
 {
-    auto* tx = static_cast<i2s_chan_handle_t>(_i2s_tx_handle);
-    auto* rx = static_cast<i2s_chan_handle_t>(_i2s_rx_handle);
-    _i2s_tx_handle = nullptr;
-    _i2s_rx_handle = nullptr;
-
-    if (tx) {
-        i2s_channel_disable(tx);
-        i2s_del_channel(tx);
-    }
-    if (rx) {
-        i2s_channel_disable(rx);
-        i2s_del_channel(rx);
+    _preset = index % kPresetCount;
+    _needs_redraw = true;
+    if (_fx_queue == nullptr) {
+        return;
     }
-
-    M5.In_I2C.writeRegister8(kEs8311Addr, 0x0D, 0xFC, 400000);
-    M5.In_I2C.writeRegister8(kEs8311Addr, 0x0E, 0x6A, 400000);
-    M5.In_I2C.writeRegister8(kEs8311Addr, 0x00, 0x00, 400000);
+    const Preset_t preset = makePreset(_preset);
+    xQueueOverwrite(static_cast<QueueHandle_t>(_fx_queue), &preset.config);
 }
 
 void AudioLoopbackApp::hookKeyboard()
@@ -487,6 +568,33 @@ void AudioLoopbackApp::hookKeyboard()
             return;
         }
 
+        if (e.keyCode == KEY_C) {
+            startCalibration();
+            return;
+        }
+
+        if (e.keyCode == KEY_E) {
+            selectPreset(_preset + 1);
+            return;
+        }
+
+        if (e.keyCode == KEY_R) {
+            if (_rec_state.load() == RecState::Idle) {
+                startRecording();
+            } else {
+                stopRecording();
+            }
+            return;
+        }
+
+        if (e.keyCode == KEY_A) {
+            if (_rec_state.load() == RecState::Idle) {
+                _rec_adpcm = !_rec_adpcm;
+                _needs_redraw = true;
+            }
+            return;
+        }
+
         if (e.keyCode == KEY_LEFTBRACE || e.keyCode == KEY_RIGHTBRACE) {
             int d = _delay_ms.load();
             const int step = 50;
@@ -528,6 +636,28 @@ void AudioLoopbackApp::unhookKeyboard()
     _keyboard_slot_id = 0;
 }
 
+void AudioLoopbackApp::hookSdCard()
+{
+    if (_sd_card_slot_id != 0) {
+        return;
+    }
+    // The writer fails on its own once the card is gone, this just closes the recording instead of leaving it open
+    _sd_card_slot_id = GetHAL().onSdCardEvent.connect([this](const Hal::SdCardEvent_t& e) {
+        if (!e.mounted) {
+            stopRecording();
+        }
+    });
+}
+
+void AudioLoopbackApp::unhookSdCard()
+{
+    if (_sd_card_slot_id == 0) {
+        return;
+    }
+    GetHAL().onSdCardEvent.disconnect(_sd_card_slot_id);
+    _sd_card_slot_id = 0;
+}
+
 void AudioLoopbackApp::openDesktopAndCloseSelf()
 {
     auto& mc = mooncake::GetMooncake();
@@ -550,6 +680,7 @@ void AudioLoopbackApp::openDesktopAndCloseSelf()
 
 void AudioLoopbackApp::draw()
 {
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "Audio Loopback");
     auto& canvas = GetHAL().canvas;
     const uint16_t bg = lgfx::color565(0x22, 0x22, 0x22);
     const uint16_t fg = lgfx::color565(0xEE, 0xEE, 0xEE);
@@ -572,8 +703,59 @@ void AudioLoopbackApp::draw()
     std::snprintf(volbuf, sizeof(volbuf), "Vol:%u  Delay:%dms", static_cast<unsigned>(_volume.load()), _delay_ms.load());
     canvas.drawString(volbuf, 6, 28);
 
-    canvas.drawString("Ent/Spc:Toggle  +/-:Vol", 6, 42);
-    canvas.drawString("[ ]:Delay  Bksp:Exit", 6, 56);
+    // Delay actually held by the jitter buffer and how far its read rate is off to hold it
+    _shown_stats = _jitter.stats();
+    char statbuf[48];
+    std::snprintf(statbuf, sizeof(statbuf), "Buf:%dms %+dppm  U:%u O:%u",
+                  static_cast<int>(_shown_stats.delay / static_cast<int32_t>(kSampleRate / 1000)),
+                  static_cast<int>(_shown_stats.rate_ppm), static_cast<unsigned>(_shown_stats.underruns),
+                  static_cast<unsigned>(_shown_stats.overruns));
+    canvas.drawString(statbuf, 6, 42);
+
+    // Delay is end to end, the round trip through DMA and codec is measured and taken off the buffer
+    char calbuf[48];
+    const CalState cal = _cal_state.load();
+    if (cal != CalState::Idle) {
+        std::snprintf(calbuf, sizeof(calbuf), "Calibrating...");
+    } else if (_cal_failed) {
+        std::snprintf(calbuf, sizeof(calbuf), "RT: no echo found");
+    } else if (_round_trip.load() == 0) {
+        std::snprintf(calbuf, sizeof(calbuf), "RT: not measured");
+    } else {
+        std::snprintf(calbuf, sizeof(calbuf), "RT:%.1fms", static_cast<double>(_round_trip_ms));
+    }
+    canvas.setTextColor(cal != CalState::Idle ? accent : fg);
+    canvas.drawString(calbuf, 6, 56);
+    canvas.setTextColor(fg);
+
+    // Howl notches placed so far and what the chain costs per sample
+    _shown_fx_cycles = _fx_cycles.load();
+    _shown_fx_notches = _fx_notches.load();
+    char fxbuf[48];
+    std::snprintf(fxbuf, sizeof(fxbuf), "FX:%s  Notch:%u  %ucyc", makePreset(_preset).name,
+                  static_cast<unsigned>(_shown_fx_notches), static_cast<unsigned>(_shown_fx_cycles));
+    canvas.drawString(fxbuf, 6, 70);
+
+    // Recording time, frames that found no free slot and the slowest card write so far
+    _shown_rec = _recorder.stats();
+    const RecState rec = _rec_state.load();
+    const char* codec = _rec_adpcm ? "ADPCM" : "PCM";
+    char recbuf[48];
+    if (rec != RecState::Idle) {
+        const unsigned sec = _shown_rec.frames / kSampleRate;
+        std::snprintf(recbuf, sizeof(recbuf), "REC %02u:%02u %s D:%u W:%ums", sec / 60, sec % 60, codec,
+                      static_cast<unsigned>(_shown_rec.dropped), static_cast<unsigned>(_shown_rec.max_write_us / 1000));
+    } else if (_shown_rec.error != 0) {
+        std::snprintf(recbuf, sizeof(recbuf), "Rec:%s  error %d", codec, _shown_rec.error);
+    } else {
+        std::snprintf(recbuf, sizeof(recbuf), "Rec:%s", codec);
+    }
+    canvas.setTextColor(rec != RecState::Idle ? accent : fg);
+    canvas.drawString(recbuf, 6, 84);
+    canvas.setTextColor(fg);
+
+    canvas.drawString("Ent:Loop +/-:Vol [ ]:Delay C:Cal", 6, 98);
+    canvas.drawString("E:FX  R:Rec  A:PCM/ADPCM  Bksp:Exit", 6, 112);
 
     GetHAL().pushCanvas();
 }
@@ -2,6 +2,13 @@
 #include <mooncake.h>
 #include <atomic>
 #include <cstdint>
+#include <string>
+#include <vector>
+#include "utils/audio/effects.h"
+#include "utils/audio/jitter_buffer.h"
+#include "utils/audio/latency_probe.h"
+#include "utils/audio/resampler.h"
+#include "utils/audio/wav_recorder.h"
 
 class AudioLoopbackApp : public mooncake::AppAbility {
 public:
@@ -13,19 +20,31 @@ public:
 
 private:
     static void loopbackTaskMain(void* arg);
-
-    bool initLoopbackEngine();
-    void deinitLoopbackEngine();
+    static void pullOutput(int16_t* out, size_t frames, void* ctx);
 
     void draw();
     void hookKeyboard();
     void unhookKeyboard();
+    void hookSdCard();
+    void unhookSdCard();
     void openDesktopAndCloseSelf();
 
     void startLoopbackTask();
     void stopLoopbackTask();
 
+    void selectPreset(int index);
+
+    static void calibrateTaskMain(void* arg);
+    void startCalibration();
+    void updateCalibration();
+
+    void startRecording();
+    void beginRecording(const std::string& path);
+    void stopRecording();
+    void updateRecording();
+
     size_t _keyboard_slot_id = 0;
+    size_t _sd_card_slot_id  = 0;
     bool _needs_redraw       = true;
 
     std::atomic<bool> _loopback_enabled{false};
@@ -34,16 +53,61 @@ private:
 
     static constexpr int kMaxDelayMs = 1000;
 
-    uint8_t _prev_volume = 0;
-    bool _prev_volume_valid = false;
-
     void* _task_handle = nullptr;
-    void* _write_task_handle = nullptr;
-    void* _ring_buffer_handle = nullptr;
+    int _stream = -1;  // Voice stream of the mixer, pulls from the jitter buffer
+    JitterBuffer _jitter;
+    Resampler _capture_src;  // Mic down to the loopback rate, used by the read task
     std::atomic<bool> _task_running{false};
+    uint32_t _last_stats_ms = 0;
+    JitterBuffer::Stats_t _shown_stats;
 
-    void* _i2s_tx_handle = nullptr;
-    void* _i2s_rx_handle = nullptr;
-private:
-    static void writeTaskMain(void* arg);
+    // Effects on the mic path, owned by the read task. Configs reach it through a one deep overwrite queue
+    dsp::EffectsChain _effects;
+    void* _fx_queue = nullptr;
+    int _preset = 0;
+    std::atomic<uint32_t> _fx_cycles{0};  // Per sample, averaged
+    std::atomic<uint8_t> _fx_notches{0};
+    uint32_t _shown_fx_cycles = 0;
+    uint8_t _shown_fx_notches = 0;
+
+    // Round trip calibration, each state is left by the side named
+    enum class CalState : uint8_t {
+        Idle,
+        Armed,        // Read task, on its next chunk
+        Ready,        // Mixer pull, stamps the start and plays the sequence
+        Playing,      // Read task, once the capture is full
+        Captured,     // UI, starts the correlation
+        Correlating,  // Calibrate task
+        Done,         // UI, applies the result
+        Failed,       // UI
+    };
+    std::atomic<CalState> _cal_state{CalState::Idle};
+    std::vector<int8_t> _cal_mls;
+    std::vector<int16_t> _cal_capture;
+    std::vector<int32_t> _cal_corr;
+    std::atomic<uint32_t> _cal_start{0};  // Stream position of the first captured sample
+    float _cal_offset = 0.0f;             // From the start stamp to that sample
+    size_t _cal_played = 0;
+    size_t _cal_captured = 0;
+    latency::Peak_t _cal_peak;
+    int64_t _cal_us = 0;
+    bool _cal_failed = false;
+    // Samples from handing a block to the mixer until it comes back from the mic, taken off the jitter buffer target
+    std::atomic<int32_t> _round_trip{0};
+    float _round_trip_ms = 0.0f;
+
+    // Raw mic to a WAV on the card. The read task pushes and, asked to stop, finishes, the recorder's writer does the
+    // card I/O
+    enum class RecState : uint8_t {
+        Idle,
+        Recording,  // Read task pushes every chunk
+        Stopping,   // Read task, finishes the file
+        Flushing,   // UI, once the writer closed it
+    };
+    WavRecorder _recorder;
+    std::atomic<RecState> _rec_state{RecState::Idle};
+    bool _rec_adpcm            = false;
+    uint32_t _rec_name_request = 0;  // IoService search for a free file name
+    std::string _rec_path;
+    WavRecorder::Stats_t _shown_rec;
 };
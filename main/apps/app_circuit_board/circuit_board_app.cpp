@@ -1,8 +1,4 @@
 #include "circuit_board_app.h"
-#include <sys/stat.h>
-#include <dirent.h>
-#include <fstream>
-#include <sstream>
 #include <cJSON.h>
 
 extern "C" {
@@ -190,6 +186,22 @@ void CircuitBoardApp::onOpen() {
         });
     }
 
+    // The load dialog lists the card that was in when it opened
+    if (_sd_card_slot_id == 0) {
+        _sd_card_slot_id = GetHAL().onSdCardEvent.connect([this](const Hal::SdCardEvent_t& e) {
+            if (!_is_loading) return;
+            if (e.mounted) {
+                refreshFileList();
+                draw();
+            } else {
+                GetIoService().cancel(_list_request);
+                _list_request = 0;
+                _is_loading = false;
+                showMessage("SD Card removed!", TFT_RED);
+            }
+        });
+    }
+
     draw();
 }
 
@@ -199,25 +211,40 @@ void CircuitBoardApp::onRunning() {
     }
     
     // Refresh if message times out
-    if (_message_timeout > 0 && GetHAL().millis() >= _message_timeout) {
-        _message_timeout = 0;
+    if (_message_timeout.expired(GetHAL().millis())) {
         draw();
     }
 
     if (_is_loading) {
         _file_list.update(GetHAL().millis());
-        draw();
+        if (_file_list.isAnimating()) {
+            draw();
+        }
     }
 }
 
 void CircuitBoardApp::onClose() {
+    // A save in flight still completes, only its message is dropped
+    auto& io = GetIoService();
+    io.cancel(_list_request);
+    io.cancel(_load_request);
+    io.cancel(_save_request);
+    _list_request = 0;
+    _load_request = 0;
+    _save_request = 0;
+
     if (_keyboard_slot_id != 0) {
         GetHAL().keyboard.onKeyEvent.disconnect(_keyboard_slot_id);
         _keyboard_slot_id = 0;
     }
+    if (_sd_card_slot_id != 0) {
+        GetHAL().onSdCardEvent.disconnect(_sd_card_slot_id);
+        _sd_card_slot_id = 0;
+    }
 }
 
 void CircuitBoardApp::draw() {
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "Circuit Board");
     auto& canvas = GetHAL().canvas;
     canvas.fillScreen(TFT_BLACK);
 
@@ -295,7 +322,7 @@ void CircuitBoardApp::draw() {
     }
 
     // Draw message
-    if (GetHAL().millis() < _message_timeout) {
+    if (_message_timeout.isActive(GetHAL().millis())) {
         canvas.setFont(&fonts::efontCN_12);
         canvas.setTextSize(1);
         canvas.setTextColor(_message_color, TFT_BLACK);
@@ -469,7 +496,7 @@ void CircuitBoardApp::removeComponentAtCursor() {
 void CircuitBoardApp::showMessage(const std::string& text, uint16_t color) {
     _message_text = text;
     _message_color = color;
-    _message_timeout = GetHAL().millis() + 2000;
+    _message_timeout.start(GetHAL().millis(), 2000);
     draw();
 }
 
@@ -509,7 +536,7 @@ void CircuitBoardApp::saveToFile(const std::string& filename) {
         return;
     }
 
-    std::string path = "/sdcard/" + filename;
+    std::string path = std::string(GetHAL().getSdCardMountPoint()) + "/" + filename;
     if (path.length() < 11 || path.substr(path.length() - 11) != ".coscircuit") {
         path += ".coscircuit";
     }
@@ -531,34 +558,29 @@ void CircuitBoardApp::saveToFile(const std::string& filename) {
     }
 
     char* json_str = cJSON_Print(root);
-    std::ofstream ofs(path);
-    if (ofs.is_open()) {
-        ofs << json_str;
-        ofs.close();
-        _current_filename = filename;
-        if (_current_filename.length() < 11 || _current_filename.substr(_current_filename.length() - 11) != ".coscircuit") {
-             // Keep filename without extension or with extension? Usually user inputs name without extension.
-             // Let's store what we used to save.
-             // Actually, let's just store the basename.
-        }
-        // Normalize _current_filename to be the one we can reuse
-        // If user typed "foo", we saved to "/sdcard/foo.coscircuit".
-        // Next time we want to save to "foo.coscircuit" or just reuse the path.
-        // Let's store the full filename (basename + ext)
-        size_t last_slash = path.find_last_of('/');
-        if (last_slash != std::string::npos) {
-            _current_filename = path.substr(last_slash + 1);
-        } else {
-            _current_filename = path;
-        }
+    std::string json = json_str ? json_str : "";
+    free(json_str);
+    cJSON_Delete(root);
 
-        showMessage("Saved: " + _current_filename, TFT_GREEN);
-    } else {
+    // Reuse the name we saved under, the user usually types it without the extension
+    size_t last_slash = path.find_last_of('/');
+    std::string saved_name = last_slash != std::string::npos ? path.substr(last_slash + 1) : path;
+
+    auto& io = GetIoService();
+    io.cancel(_save_request);
+    _save_request = io.writeFile(path, std::move(json), IoService::Priority::Normal,
+        [this, saved_name](IoService::Result_t& result) {
+            _save_request = 0;
+            if (result.ok) {
+                _current_filename = saved_name;
+                showMessage("Saved: " + _current_filename, TFT_GREEN);
+            } else {
+                showMessage("Save Failed!", TFT_RED);
+            }
+        });
+    if (_save_request == 0) {
         showMessage("Save Failed!", TFT_RED);
     }
-
-    free(json_str);
-    cJSON_Delete(root);
 }
 
 void CircuitBoardApp::openLoadDialog() {
@@ -581,20 +603,30 @@ void CircuitBoardApp::closeLoadDialog() {
 
 void CircuitBoardApp::refreshFileList() {
     _file_list_entries.clear();
-    DIR* dir = opendir("/sdcard");
-    if (!dir) return;
-
-    struct dirent* ent;
-    while ((ent = readdir(dir)) != NULL) {
-        std::string name = ent->d_name;
-        if (name.length() > 11 && name.substr(name.length() - 11) == ".coscircuit") {
-            _file_list_entries.push_back({name, "/sdcard/" + name});
-        }
-    }
-    closedir(dir);
-    
-    // Reset list
-    _file_list.jumpTo(0, _file_list_entries.size(), 5); // 5 visible rows
+    _file_list_version++;
+    _file_list.jumpTo(0, 0, 5);
+
+    const std::string root = GetHAL().getSdCardMountPoint();
+    const auto is_circuit = [](std::string_view name, bool is_dir) {
+        return !is_dir && name.length() > 11 && name.substr(name.length() - 11) == ".coscircuit";
+    };
+    auto& io = GetIoService();
+    io.cancel(_list_request);
+    _list_request = io.listDir(root, IoService::Priority::Browse,
+        [this, root](IoService::Result_t& result) {
+            _list_request = 0;
+            for (auto& entry : result.entries) {
+                _file_list_entries.push_back({entry.name, root + "/" + entry.name});
+            }
+            _file_list_version++;
+
+            // Reset list
+            _file_list.jumpTo(0, _file_list_entries.size(), 5); // 5 visible rows
+            if (_is_loading) {
+                draw();
+            }
+        },
+        is_circuit);
 }
 
 void CircuitBoardApp::loadSelectedFile() {
@@ -606,16 +638,22 @@ void CircuitBoardApp::loadSelectedFile() {
 }
 
 void CircuitBoardApp::loadFromFile(const std::string& path) {
-    std::ifstream ifs(path);
-    if (!ifs.is_open()) {
+    auto& io = GetIoService();
+    io.cancel(_load_request);
+    _load_request = io.readFile(path, IoService::Priority::Normal, [this, path](IoService::Result_t& result) {
+        _load_request = 0;
+        if (!result.ok) {
+            showMessage("Open Failed!", TFT_RED);
+            return;
+        }
+        applyLoadedFile(path, result.data);
+    });
+    if (_load_request == 0) {
         showMessage("Open Failed!", TFT_RED);
-        return;
     }
+}
 
-    std::stringstream buffer;
-    buffer << ifs.rdbuf();
-    std::string json_str = buffer.str();
-
+void CircuitBoardApp::applyLoadedFile(const std::string& path, const std::string& json_str) {
     cJSON* root = cJSON_Parse(json_str.c_str());
     if (!root) {
         showMessage("Parse Failed!", TFT_RED);
@@ -714,7 +752,8 @@ void CircuitBoardApp::drawLoadDialog() {
     
     if (_file_list_entries.empty()) {
         canvas.setTextDatum(textdatum_t::middle_center);
-        canvas.drawString("(No .coscircuit files)", dlg_x + dlg_w / 2, dlg_y + dlg_h / 2);
+        const char* text = _list_request != 0 ? "(Reading...)" : "(No .coscircuit files)";
+        canvas.drawString(text, dlg_x + dlg_w / 2, dlg_y + dlg_h / 2);
     } else {
         SimpleListStyle style;
         style.bg_color = TFT_DARKGREY;
@@ -730,9 +769,10 @@ void CircuitBoardApp::drawLoadDialog() {
             dlg_w - 10,
             dlg_h - 30,
             _file_list_entries.size(),
-            [this](int idx) {
-                if (idx < 0 || idx >= static_cast<int>(_file_list_entries.size())) return std::string("");
-                return _file_list_entries[idx].name;
+            _file_list_version,
+            [this](int idx, char*, size_t) {
+                if (idx < 0 || idx >= static_cast<int>(_file_list_entries.size())) return std::string_view();
+                return std::string_view(_file_list_entries[idx].name);
             },
             style
         );
@@ -5,7 +5,9 @@
 
 #include <string>
 #include <vector>
+#include "utils/ui/animation.h"
 #include "utils/ui/simple_list.h"
+#include "utils/fs/io_service.h"
 
 class CircuitBoardApp : public mooncake::AppAbility {
 public:
@@ -20,6 +22,7 @@ private:
     void moveCursor(int dx, int dy);
 
     size_t _keyboard_slot_id = 0;
+    size_t _sd_card_slot_id = 0;
     int _cursor_x = 0;
     int _cursor_y = 0;
     
@@ -69,7 +72,7 @@ private:
     bool checkOverlap(int x, int y, int w, int h, int exclude_index = -1);
     void removeComponentAtCursor();
 
-    uint32_t _message_timeout = 0;
+    anim::Timeout _message_timeout;
     std::string _message_text;
     uint16_t _message_color = TFT_WHITE;
     void showMessage(const std::string& text, uint16_t color);
@@ -86,6 +89,12 @@ private:
     };
     std::vector<FileEntry> _file_list_entries;
     SmoothSimpleList _file_list;
+    uint32_t _file_list_version = 0;
+
+    // Outstanding IoService requests, 0 when idle
+    uint32_t _list_request = 0;
+    uint32_t _load_request = 0;
+    uint32_t _save_request = 0;
 
     void openSaveDialog(bool force_new = false);
     void closeSaveDialog();
@@ -97,6 +106,7 @@ private:
     void refreshFileList();
     void loadSelectedFile();
     void loadFromFile(const std::string& path);
+    void applyLoadedFile(const std::string& path, const std::string& json_str);
     void moveLoadSelection(int delta);
     void drawSaveDialog();
     void drawLoadDialog();
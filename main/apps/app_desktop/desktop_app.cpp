@@ -29,6 +29,7 @@ void DesktopApp::onClose()
 void DesktopApp::refreshAppList()
 {
     _apps.clear();
+    _label_version++;
 
     auto& mc = mooncake::GetMooncake();
     auto* app_mgr = mc.getAppAbilityManager();
@@ -131,6 +132,7 @@ void DesktopApp::unhookKeyboard()
 
 void DesktopApp::draw()
 {
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "Desktop");
     auto& canvas = GetHAL().canvas;
     const uint16_t bg_color = lgfx::color565(0x33, 0x33, 0x33);
     const uint16_t container_2_color = lgfx::color565(0xFF, 0x8D, 0x1A);
@@ -165,7 +167,8 @@ void DesktopApp::draw()
         list_w,
         list_h,
         static_cast<int>(_apps.size()),
-        [this](int idx) { return _apps[idx].name; },
+        _label_version,
+        [this](int idx, char*, size_t) { return std::string_view(_apps[idx].name); },
         style);
 
     GetHAL().pushAppCanvas();
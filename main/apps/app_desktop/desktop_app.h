@@ -26,5 +26,6 @@ private:
 
     std::vector<AppEntry> _apps;
     SmoothSimpleList _list;
+    uint32_t _label_version = 0;
     size_t _keyboard_slot_id = 0;
 };
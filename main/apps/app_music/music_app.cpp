@@ -1,12 +1,23 @@
 #include "music_app.h"
 #include "music_player.h"
 #include <hal.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
 #include <optional>
 #include "utils/ui/simple_list.h"
+#include "utils/audio/audio_mixer.h"
+
+static bool is_mp3_file(std::string_view name, bool is_dir)
+{
+    if (is_dir || name.size() < 4) {
+        return false;
+    }
+    const std::string_view ext = name.substr(name.size() - 4);
+    return std::equal(ext.begin(), ext.end(), ".mp3", [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == b;
+    });
+}
 
 MusicApp::MusicApp()
 {
@@ -18,10 +29,10 @@ void MusicApp::onOpen()
     MusicPlayer::instance().init();
     resetToRoot();
     refreshMp3List();
-    _playing_path.clear();
-    _playback_started_for_path = false;
-    _last_volume = static_cast<int>(GetHAL().speaker.getVolume());
+    setPlayingPath(std::string());
+    _last_volume = static_cast<int>(GetHAL().mixer.getVolume());
     hookKeyboard();
+    hookSdCard();
     draw();
 }
 
@@ -37,7 +48,7 @@ void MusicApp::onRunning()
     }
 
     {
-        const int vol = static_cast<int>(GetHAL().speaker.getVolume());
+        const int vol = static_cast<int>(GetHAL().mixer.getVolume());
         if (vol != _last_volume) {
             _last_volume = vol;
             need_redraw = true;
@@ -45,25 +56,16 @@ void MusicApp::onRunning()
     }
 
     if (st == MusicPlayerState::Idle && !_playing_path.empty() && _playback_started_for_path) {
-        _playing_path.clear();
-        _playback_started_for_path = false;
+        setPlayingPath(std::string());
         need_redraw = true;
     }
 
     {
-        const std::string name = getInfoPanelFileNameNoExt();
-        if (name != _panel_name_cache) {
-            _panel_name_cache = name;
-            _panel_scroll_x = 0;
-            _panel_scroll_last_ms = GetHAL().millis();
+        if (refreshPanelName()) {
             need_redraw = true;
         }
-        if (!_panel_name_cache.empty()) {
-            const uint32_t now = GetHAL().millis();
-            if (now - _panel_scroll_last_ms >= 60) {
-                _panel_scroll_last_ms = now;
-                need_redraw = true;
-            }
+        if (!_panel_name_cache.empty() && _panel_marquee.needsRedraw(GetHAL().millis())) {
+            need_redraw = true;
         }
     }
 
@@ -81,14 +83,53 @@ void MusicApp::onRunning()
 
 void MusicApp::onClose()
 {
+    GetIoService().cancel(_list_request);
+    _list_request = 0;
+    _list_loading = false;
     unhookKeyboard();
+    unhookSdCard();
     MusicPlayer::instance().stop();
-    _playing_path.clear();
-    _playback_started_for_path = false;
+    setPlayingPath(std::string());
 }
 
 void MusicApp::refreshMp3List()
 {
+    const std::string root = GetHAL().getSdCardMountPoint();
+    auto& io               = GetIoService();
+    io.cancel(_list_request);
+    _list_request = io.listDir(
+        root, IoService::Priority::Browse,
+        [this, root](IoService::Result_t& result) {
+            _list_request = 0;
+            _list_loading = false;
+            // A folder that can't be opened lists nothing, same as an empty one
+            applyMp3List(root, result.entries);
+            draw();
+        },
+        is_mp3_file);
+    _list_loading = _list_request != 0;
+}
+
+void MusicApp::handleSdCard(bool mounted)
+{
+    // Tracks and the open file belong to the card as it was before, even a remount of the same card invalidates them
+    MusicPlayer::instance().stop();
+    setPlayingPath(std::string());
+    resetToRoot();
+    if (mounted) {
+        refreshMp3List();
+    } else {
+        GetIoService().cancel(_list_request);
+        _list_request = 0;
+        _list_loading = false;
+        applyMp3List(GetHAL().getSdCardMountPoint(), {});
+    }
+    draw();
+}
+
+void MusicApp::applyMp3List(const std::string& root, const std::vector<IoService::DirEntry_t>& entries)
+{
+    _label_version++;
     _all_tracks.clear();
     _album_to_tracks.clear();
     _artist_to_tracks.clear();
@@ -96,13 +137,6 @@ void MusicApp::refreshMp3List()
     _album_keys.clear();
     _artist_keys.clear();
 
-    const char* root = "/sdcard";
-    DIR* dir         = opendir(root);
-    if (!dir) {
-        resetToRoot();
-        return;
-    }
-
     const auto trim = [](std::string s) -> std::string {
         size_t start = 0;
         while (start < s.size() && std::isspace(static_cast<unsigned char>(s[start]))) {
@@ -143,32 +177,9 @@ void MusicApp::refreshMp3List()
         return std::make_tuple(artist, album, title);
     };
 
-    while (true) {
-        dirent* ent = readdir(dir);
-        if (!ent) {
-            break;
-        }
-
-        if (ent->d_name[0] == '.') {
-            continue;
-        }
-
-        std::string name = ent->d_name;
-        std::string lower = name;
-        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-
-        if (lower.size() < 4 || lower.rfind(".mp3") != (lower.size() - 4)) {
-            continue;
-        }
-
-        std::string path = std::string(root) + "/" + name;
-        struct stat st {};
-        if (stat(path.c_str(), &st) != 0) {
-            continue;
-        }
-        if (!S_ISREG(st.st_mode)) {
-            continue;
-        }
+    for (const auto& entry : entries) {
+        const std::string& name = entry.name;
+        const std::string path  = root + "/" + name;
 
         TrackInfo ti;
         ti.file_name = name;
@@ -188,7 +199,6 @@ void MusicApp::refreshMp3List()
             _uncategorized_tracks.push_back(idx);
         }
     }
-    closedir(dir);
 
     for (const auto& kv : _album_to_tracks) {
         _album_keys.push_back(kv.first);
@@ -258,7 +268,7 @@ void MusicApp::hookKeyboard()
 
         if (e.keyCode == KEY_MINUS || e.keyCode == KEY_EQUAL) {
             constexpr int step = 5;
-            int vol = static_cast<int>(GetHAL().speaker.getVolume());
+            int vol = static_cast<int>(GetHAL().mixer.getVolume());
             if (e.keyCode == KEY_MINUS) {
                 vol -= step;
             } else {
@@ -269,7 +279,7 @@ void MusicApp::hookKeyboard()
             } else if (vol > 255) {
                 vol = 255;
             }
-            GetHAL().speaker.setVolume(static_cast<uint8_t>(vol));
+            GetHAL().mixer.setVolume(static_cast<uint8_t>(vol));
             draw();
             return;
         }
@@ -281,8 +291,7 @@ void MusicApp::hookKeyboard()
 
         if (e.keyCode == KEY_BACKSPACE || e.keyCode == KEY_DELETE) {
             MusicPlayer::instance().stop();
-            _playing_path.clear();
-            _playback_started_for_path = false;
+            setPlayingPath(std::string());
             draw();
             return;
         }
@@ -345,8 +354,28 @@ void MusicApp::unhookKeyboard()
     _keyboard_slot_id = 0;
 }
 
+void MusicApp::hookSdCard()
+{
+    if (_sd_card_slot_id != 0) {
+        return;
+    }
+    _sd_card_slot_id =
+        GetHAL().onSdCardEvent.connect([this](const Hal::SdCardEvent_t& e) { handleSdCard(e.mounted); });
+}
+
+void MusicApp::unhookSdCard()
+{
+    if (_sd_card_slot_id == 0) {
+        return;
+    }
+    GetHAL().onSdCardEvent.disconnect(_sd_card_slot_id);
+    _sd_card_slot_id = 0;
+}
+
 void MusicApp::draw()
 {
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "Music");
+    refreshPanelName();
     auto& canvas = GetHAL().canvas;
     const uint16_t bg_color = TFT_NAVY;
     const uint16_t border_color = lgfx::color565(0xAA, 0xAA, 0xAA);
@@ -381,7 +410,8 @@ void MusicApp::draw()
     const int item_count = getCurrentItemCount();
     if (item_count <= 0) {
         canvas.setTextDatum(textdatum_t::middle_center);
-        canvas.drawString("No MP3 files in /sdcard", canvas.width() / 2, canvas.height() / 2);
+        canvas.drawString(_list_loading ? "Loading..." : "No MP3 files in /sdcard", canvas.width() / 2,
+                          canvas.height() / 2);
         GetHAL().pushAppCanvas();
         return;
     }
@@ -400,15 +430,17 @@ void MusicApp::draw()
         list_w,
         list_h,
         item_count,
-        [this](int idx) {
-            std::string label = getCurrentItemLabel(idx);
+        _label_version,
+        [this](int idx, char* scratch, size_t scratch_size) {
+            const std::string_view label = getCurrentItemLabel(idx);
+            bool playing = false;
             if (isCurrentItemTrack(idx)) {
                 const int ti = getCurrentItemTrackIndex(idx);
-                if (ti >= 0 && ti < static_cast<int>(_all_tracks.size()) && _all_tracks[ti].path == _playing_path) {
-                    return std::string(">> ") + label;
-                }
+                playing = ti >= 0 && ti < static_cast<int>(_all_tracks.size()) && _all_tracks[ti].path == _playing_path;
             }
-            return std::string("   ") + label;
+            const int n = std::snprintf(scratch, scratch_size, "%s%.*s", playing ? ">> " : "   ",
+                                        static_cast<int>(label.size()), label.data());
+            return std::string_view(scratch, std::min<size_t>(n > 0 ? n : 0, scratch_size - 1));
         },
         style);
 
@@ -417,13 +449,15 @@ void MusicApp::draw()
     canvas.drawRect(panel_x, panel_y, panel_w, panel_h, panel_border);
     canvas.fillRect(panel_x + 1, panel_y + 1, panel_w - 2, panel_h - 2, panel_bg);
 
-    std::string status = "Vol " + std::to_string(GetHAL().speaker.getVolume());
     const auto st = MusicPlayer::instance().state();
+    const char* st_suffix = "";
     if (st == MusicPlayerState::Playing) {
-        status += " >";
+        st_suffix = " >";
     } else if (st == MusicPlayerState::Paused) {
-        status += " ||";
+        st_suffix = " ||";
     }
+    char status[24];
+    std::snprintf(status, sizeof(status), "Vol %u%s", static_cast<unsigned>(GetHAL().mixer.getVolume()), st_suffix);
 
     const int info_pad = 6;
     const int info_x0 = panel_x + info_pad;
@@ -433,9 +467,9 @@ void MusicApp::draw()
     canvas.setTextColor(TFT_WHITE, panel_bg);
     canvas.setTextDatum(textdatum_t::top_left);
 
-    canvas.drawString(status.c_str(), info_x0, info_y0);
+    canvas.drawString(status, info_x0, info_y0);
 
-    const std::string name = getInfoPanelFileNameNoExt();
+    const std::string& name = _panel_name_cache;
     if (!name.empty()) {
         const int box_y = info_y0 + canvas.fontHeight() + 4;
         const int box_h = canvas.fontHeight() + 6;
@@ -449,23 +483,19 @@ void MusicApp::draw()
         canvas.setTextDatum(textdatum_t::middle_left);
         canvas.setTextColor(TFT_WHITE, panel_bg);
 
-        int text_x = box_x + 3 - _panel_scroll_x;
-        const int text_y = box_y + box_h / 2;
-        canvas.drawString(name.c_str(), text_x, text_y);
-
+        const uint32_t now = GetHAL().millis();
         const int text_w = canvas.textWidth(name.c_str());
         const int avail_w = box_w - 6;
+        const int gap = 18;
+        _panel_marquee.setPeriod(text_w > avail_w ? text_w + gap : 0);
+
+        const int text_x = box_x + 3 - _panel_marquee.offset(now);
+        const int text_y = box_y + box_h / 2;
+        canvas.drawString(name.c_str(), text_x, text_y);
         if (text_w > avail_w) {
-            const int gap = 18;
             canvas.drawString(name.c_str(), text_x + text_w + gap, text_y);
-            _panel_scroll_x += 2;
-            const int period = text_w + gap;
-            if (_panel_scroll_x >= period) {
-                _panel_scroll_x = 0;
-            }
-        } else {
-            _panel_scroll_x = 0;
         }
+        _panel_marquee.markDrawn(now);
         canvas.clearClipRect();
         canvas.setTextDatum(textdatum_t::top_left);
 
@@ -475,7 +505,7 @@ void MusicApp::draw()
             canvas.drawRect(box_x, vol_bar_y, box_w, vol_bar_h, border_color);
             canvas.fillRect(box_x + 1, vol_bar_y + 1, box_w - 2, vol_bar_h - 2, panel_bg);
 
-            const int vol = static_cast<int>(GetHAL().speaker.getVolume());
+            const int vol = static_cast<int>(GetHAL().mixer.getVolume());
             const int inner_w = box_w - 4;
             int fill_w = (inner_w * vol) / 255;
             if (fill_w < 0) fill_w = 0;
@@ -490,6 +520,23 @@ void MusicApp::draw()
     GetHAL().pushAppCanvas();
 }
 
+bool MusicApp::refreshPanelName()
+{
+    // The playing track only changes together with the labels, so skip the lookup otherwise
+    if (_panel_name_version == _label_version) {
+        return false;
+    }
+    _panel_name_version = _label_version;
+
+    std::string name = getInfoPanelFileNameNoExt();
+    if (name == _panel_name_cache) {
+        return false;
+    }
+    _panel_name_cache = std::move(name);
+    _panel_marquee.restart(GetHAL().millis());
+    return true;
+}
+
 std::string MusicApp::getInfoPanelFileNameNoExt() const
 {
     auto strip_ext = [](const std::string& s) -> std::string {
@@ -515,6 +562,14 @@ std::string MusicApp::getInfoPanelFileNameNoExt() const
     return strip_ext(_playing_path.substr(pos + 1));
 }
 
+void MusicApp::setPlayingPath(const std::string& path)
+{
+    // The list marks the playing row and the panel shows its name, both are only redrawn when the labels change
+    _playing_path = path;
+    _playback_started_for_path = false;
+    _label_version++;
+}
+
 void MusicApp::resetToRoot()
 {
     _view_stack.clear();
@@ -608,8 +663,7 @@ void MusicApp::activateSelection()
             player.togglePause();
         } else {
             if (player.playFile(_all_tracks[ti].path)) {
-                _playing_path = _all_tracks[ti].path;
-                _playback_started_for_path = false;
+                setPlayingPath(_all_tracks[ti].path);
             }
         }
         draw();
@@ -656,7 +710,7 @@ int MusicApp::getCurrentItemCount() const
     }
 }
 
-std::string MusicApp::getCurrentItemLabel(int idx) const
+std::string_view MusicApp::getCurrentItemLabel(int idx) const
 {
     if (_view_stack.empty()) {
         return "";
@@ -680,10 +734,11 @@ std::string MusicApp::getCurrentItemLabel(int idx) const
         if (ti < 0 || ti >= static_cast<int>(_all_tracks.size())) return "";
         const auto& t = _all_tracks[ti];
         if (v.kind == ViewKind::Uncategorized) {
-            if (t.file_name.size() >= 4 && t.file_name.rfind(".mp3") == t.file_name.size() - 4) {
-                return t.file_name.substr(0, t.file_name.size() - 4);
+            std::string_view name = t.file_name;
+            if (name.size() >= 4 && name.rfind(".mp3") == name.size() - 4) {
+                name.remove_suffix(4);
             }
-            return t.file_name;
+            return name;
         }
         if (v.kind == ViewKind::AlbumTracks) {
             return t.title;
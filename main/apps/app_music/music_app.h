@@ -1,10 +1,14 @@
 #pragma once
 #include <mooncake.h>
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include "utils/ui/animation.h"
 #include "utils/ui/simple_list.h"
+#include "utils/fs/io_service.h"
 
 class MusicApp : public mooncake::AppAbility {
 public:
@@ -41,18 +45,24 @@ private:
 
     void draw();
     void refreshMp3List();
+    void applyMp3List(const std::string& root, const std::vector<IoService::DirEntry_t>& entries);
     void hookKeyboard();
     void unhookKeyboard();
+    void hookSdCard();
+    void unhookSdCard();
+    void handleSdCard(bool mounted);
+    void setPlayingPath(const std::string& path);
     void resetToRoot();
     void navigateBackOrExit();
     void activateSelection();
     void moveSelection(int delta, int visible_rows);
     int getCurrentItemCount() const;
-    std::string getCurrentItemLabel(int idx) const;
+    std::string_view getCurrentItemLabel(int idx) const;
     bool isCurrentItemTrack(int idx) const;
     int getCurrentItemTrackIndex(int idx) const;
     std::string getViewTitle() const;
     std::string getInfoPanelFileNameNoExt() const;
+    bool refreshPanelName();
 
     std::vector<TrackInfo> _all_tracks;
     std::map<std::string, std::vector<int>> _album_to_tracks;
@@ -67,8 +77,12 @@ private:
     int _last_player_state = 0;
     int _last_volume = -1;
     size_t _keyboard_slot_id = 0;
+    size_t _sd_card_slot_id = 0;
+    uint32_t _label_version = 0;
+    uint32_t _list_request = 0;
+    bool _list_loading = false;
 
     std::string _panel_name_cache;
-    int _panel_scroll_x = 0;
-    uint32_t _panel_scroll_last_ms = 0;
+    uint32_t _panel_name_version = UINT32_MAX;
+    anim::Marquee _panel_marquee;
 };
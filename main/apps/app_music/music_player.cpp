@@ -6,31 +6,32 @@ extern "C" {
 }
 
 #include <algorithm>
-#include <array>
 #include <atomic>
 #include <cstdint>
 #include <cstring>
-#include <vector>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "utils/audio/audio_mixer.h"
 
 namespace {
 
-struct SpeakerWriteCtx {
-    int speaker_channel = 0;
-    uint32_t sample_rate = 44100;
+// Decoded PCM goes to a Music stream of the mixer, reopened whenever the format changes
+struct MixerWriteCtx {
+    int stream = -1;
+    uint32_t sample_rate = 0;
     bool stereo = true;
-    size_t buf_index = 0;
-    std::array<std::vector<int16_t>, 3> buffers;
 };
 
+// About 85 ms at 48 kHz, enough for the decoder's longest stall between frames
+constexpr size_t kStreamFrames = 4096;
+
 static std::atomic<bool> g_inited = false;
 static std::atomic<bool> g_dirty = false;
 static std::atomic<audio_player_state_t> g_state_cache = AUDIO_PLAYER_STATE_IDLE;
-static SpeakerWriteCtx g_write_ctx;
+static MixerWriteCtx g_write_ctx;
 static std::atomic<uint64_t> g_pcm_frames_written = 0;
 static std::atomic<uint32_t> g_base_ms = 0;
 
@@ -68,15 +69,31 @@ static esp_err_t clk_set(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
     if (bits_cfg != 16) {
         return ESP_ERR_INVALID_ARG;
     }
-    g_write_ctx.sample_rate = rate;
-    g_write_ctx.stereo = (ch == I2S_SLOT_MODE_STEREO);
-    return ESP_OK;
+    const bool stereo = (ch == I2S_SLOT_MODE_STEREO);
+    auto& w = g_write_ctx;
+    if (w.stream >= 0 && w.sample_rate == rate && w.stereo == stereo) {
+        return ESP_OK;
+    }
+
+    auto& mixer = GetHAL().mixer;
+    mixer.close(w.stream);
+    AudioMixer::StreamConfig_t config;
+    config.role = AudioMixer::Role::Music;
+    config.sample_rate = rate;
+    config.channels = stereo ? 2 : 1;
+    config.buffer_frames = kStreamFrames;
+    // Whatever rate the file has, converted to the mixer's with the longest filter, music is where it is heard
+    config.quality = Resampler::Quality::High;
+    w.stream = mixer.open(config);
+    w.sample_rate = rate;
+    w.stereo = stereo;
+    return w.stream >= 0 ? ESP_OK : ESP_ERR_NO_MEM;
 }
 
 static esp_err_t write_pcm(void* audio_buffer, size_t len, size_t* bytes_written, uint32_t timeout_ms, void* ctx)
 {
     (void)timeout_ms;
-    auto* w = static_cast<SpeakerWriteCtx*>(ctx);
+    auto* w = static_cast<MixerWriteCtx*>(ctx);
     if (w == nullptr || bytes_written == nullptr) {
         return ESP_ERR_INVALID_ARG;
     }
@@ -84,30 +101,12 @@ static esp_err_t write_pcm(void* audio_buffer, size_t len, size_t* bytes_written
         return ESP_ERR_INVALID_SIZE;
     }
 
-    const size_t sample_count = len / 2;
-    auto& buf = w->buffers[w->buf_index++ % w->buffers.size()];
-    buf.resize(sample_count);
-    std::memcpy(buf.data(), audio_buffer, len);
-
-    if (w->sample_rate > 0) {
-        const uint32_t ch = w->stereo ? 2u : 1u;
-        g_pcm_frames_written.fetch_add(sample_count / ch);
-    }
-
-    while (GetHAL().speaker.isPlaying(w->speaker_channel) == 2) {
-        vTaskDelay(1);
-    }
-
-    while (!GetHAL().speaker.playRaw(
-        buf.data(),
-        sample_count,
-        w->sample_rate,
-        w->stereo,
-        1,
-        w->speaker_channel,
-        false)) {
-        vTaskDelay(1);
-    }
+    // Blocks for room in the stream, the mixer drains it at the output rate
+    const uint32_t ch = w->stereo ? 2u : 1u;
+    const size_t frames = len / (sizeof(int16_t) * ch);
+    const size_t queued =
+        GetHAL().mixer.write(w->stream, static_cast<const int16_t*>(audio_buffer), frames, portMAX_DELAY);
+    g_pcm_frames_written.fetch_add(queued);
 
     *bytes_written = len;
     return ESP_OK;
@@ -339,7 +338,7 @@ static void cmd_task_main(void*)
         if (cmd.type == PlayerCmdType::Stop) {
             player_lock();
             audio_player_stop();
-            GetHAL().speaker.stop(g_write_ctx.speaker_channel);
+            GetHAL().mixer.flush(g_write_ctx.stream);
             g_state_cache.store(audio_player_get_state());
             player_unlock();
             g_dirty.store(true);
@@ -363,7 +362,7 @@ static void cmd_task_main(void*)
         if (cmd.type == PlayerCmdType::PlayFile) {
             player_lock();
             audio_player_stop();
-            GetHAL().speaker.stop(g_write_ctx.speaker_channel);
+            GetHAL().mixer.flush(g_write_ctx.stream);
             FILE* fp = fopen(cmd.path, "rb");
             if (fp) {
                 Mp3CbrInfo info{};
@@ -423,7 +422,7 @@ static void cmd_task_main(void*)
             player_lock();
             const bool want_paused = (audio_player_get_state() == AUDIO_PLAYER_STATE_PAUSE);
             audio_player_stop();
-            GetHAL().speaker.stop(g_write_ctx.speaker_channel);
+            GetHAL().mixer.flush(g_write_ctx.stream);
 
             FILE* fp = fopen(g_track.path, "rb");
             if (fp) {
@@ -489,7 +488,7 @@ bool MusicPlayer::init()
     }
 
     audio_player_callback_register(player_cb, nullptr);
-    GetHAL().speaker.setVolume(20);
+    GetHAL().mixer.setVolume(20);
     g_state_cache.store(audio_player_get_state());
 
     g_cmd_queue = xQueueCreate(8, sizeof(PlayerCmd));
@@ -0,0 +1,276 @@
+#include "image_prefetcher.h"
+#include "utils/image/image_info.h"
+#include "utils/image/image_decoder.h"
+#include <esp_heap_caps.h>
+#include <mooncake_log.h>
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+static const std::string _tag = "Prefetch";
+
+static void render_region(ImagePrefetcher::Region_t& region)
+{
+    const auto& key = region.key;
+    region.sprite.setColorDepth(16);
+    if (!region.sprite.createSprite(key.w, key.h)) {
+        mclog::tagWarn(_tag, "region of {}x{} doesn't fit", key.w, key.h);
+        return;
+    }
+    region.sprite.fillScreen(TFT_BLACK);
+    region.ok = drawImageFile(region.sprite, key.path.c_str(), 0, 0, key.w, key.h, key.pan_x, key.pan_y, key.scale,
+                              0.0f, datum_t::middle_center);
+    if (!region.ok) {
+        region.sprite.deleteSprite();
+    }
+}
+
+bool ImagePrefetcher::start()
+{
+    if (_task) {
+        return true;
+    }
+    _cmd_queue    = xQueueCreate(4, sizeof(Request_t*));
+    _result_queue = xQueueCreate(kCapacity + 1, sizeof(Result_t));
+    if (!_cmd_queue || !_result_queue) {
+        mclog::tagError(_tag, "create queues failed");
+        return false;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(task_main, "prefetch", 8192, this, 2, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(_tag, "create task failed");
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ImagePrefetcher::is_wanted(const std::string& path) const
+{
+    return std::find(_wanted.begin(), _wanted.end(), path) != _wanted.end();
+}
+
+void ImagePrefetcher::evict_unwanted()
+{
+    _cache.erase(std::remove_if(_cache.begin(), _cache.end(),
+                                [this](const ImagePyramid& image) { return !is_wanted(image.path()); }),
+                 _cache.end());
+    // Still over capacity, drop the oldest
+    while (_cache.size() > kCapacity) {
+        _cache.erase(_cache.begin());
+    }
+}
+
+void ImagePrefetcher::request(const std::vector<std::string>& paths, const std::string& keep, int view_w, int view_h)
+{
+    if (!start()) {
+        return;
+    }
+
+    _wanted = paths;
+    _wanted.push_back(keep);
+    evict_unwanted();
+    _failed.erase(std::remove_if(_failed.begin(), _failed.end(),
+                                 [this](const std::string& path) { return !is_wanted(path); }),
+                  _failed.end());
+
+    // Only what isn't already decoded or known to fail goes to the worker
+    auto* req      = new Request_t;
+    req->view_w    = view_w;
+    req->view_h    = view_h;
+    req->on_screen = paths.empty() ? std::string() : paths.front();
+    _on_screen     = req->on_screen;
+    _pending.clear();
+    for (const auto& path : paths) {
+        if (path.empty() || path == keep || hasFailed(path)) {
+            continue;
+        }
+        const bool cached = std::any_of(_cache.begin(), _cache.end(),
+                                        [&path](const ImagePyramid& image) { return image.path() == path; });
+        const bool queued = std::find(req->paths.begin(), req->paths.end(), path) != req->paths.end();
+        if (!cached && !queued) {
+            req->paths.push_back(path);
+            _pending.push_back(path);
+        }
+    }
+
+    if (xQueueSend(_cmd_queue, &req, pdMS_TO_TICKS(50)) != pdTRUE) {
+        mclog::tagWarn(_tag, "command queue full");
+        _pending.clear();
+        delete req;
+    }
+}
+
+void ImagePrefetcher::requestRegion(const RegionKey_t& key)
+{
+    if (!start()) {
+        return;
+    }
+
+    // A single region is ever held, the one on screen goes before the next is rendered
+    _region.reset();
+    _region_key = key;
+    _region_serial++;
+    auto* req           = new Request_t;
+    req->region         = new Region_t;
+    req->region->key    = key;
+    req->region->serial = _region_serial;
+    if (xQueueSend(_cmd_queue, &req, 0) != pdTRUE) {
+        mclog::tagWarn(_tag, "command queue full");
+        _region_key = RegionKey_t();
+        delete req->region;
+        delete req;
+    }
+}
+
+bool ImagePrefetcher::take(std::string_view path, ImagePyramid& out)
+{
+    for (auto it = _cache.begin(); it != _cache.end(); ++it) {
+        if (it->path() == path) {
+            out = std::move(*it);
+            _cache.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ImagePrefetcher::put(ImagePyramid&& image)
+{
+    if (!image.isLoaded() || !is_wanted(image.path())) {
+        image.reset();
+        return;
+    }
+    _cache.push_back(std::move(image));
+    evict_unwanted();
+}
+
+bool ImagePrefetcher::isPending(std::string_view path) const
+{
+    return std::find(_pending.begin(), _pending.end(), path) != _pending.end();
+}
+
+bool ImagePrefetcher::hasFailed(std::string_view path) const
+{
+    return std::find(_failed.begin(), _failed.end(), path) != _failed.end();
+}
+
+void ImagePrefetcher::clear()
+{
+    _wanted.clear();
+    _pending.clear();
+    _failed.clear();
+    _on_screen.clear();
+    _cache.clear();
+    _region.reset();
+    _region_key = RegionKey_t();
+    if (!_task) {
+        return;
+    }
+    auto* req = new Request_t;
+    if (xQueueSend(_cmd_queue, &req, pdMS_TO_TICKS(50)) != pdTRUE) {
+        delete req;
+    }
+    poll();
+}
+
+bool ImagePrefetcher::poll()
+{
+    if (!_result_queue) {
+        return false;
+    }
+    bool arrived = false;
+    Result_t r;
+    while (xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        arrived = true;
+        if (r.region) {
+            // Only the region of the last request is worth holding on to
+            if (r.region->serial == _region_serial && isRegionRequested(r.region->key)) {
+                _region.reset(r.region);
+            } else {
+                delete r.region;
+            }
+            continue;
+        }
+        _pending.erase(std::remove(_pending.begin(), _pending.end(), *r.path), _pending.end());
+        if (r.image && is_wanted(*r.path)) {
+            _cache.push_back(std::move(*r.image));
+            evict_unwanted();
+        } else if (!r.image && *r.path == _on_screen && !hasFailed(*r.path)) {
+            // Only the image on screen had the whole budget, a neighbour is tried again once it is on screen
+            _failed.push_back(*r.path);
+        }
+        delete r.image;
+        delete r.path;
+    }
+    return arrived;
+}
+
+void ImagePrefetcher::task_main(void* arg)
+{
+    auto* self = static_cast<ImagePrefetcher*>(arg);
+    std::deque<std::string> jobs;
+    std::string on_screen;
+    Region_t* region = nullptr;
+    int view_w       = 0;
+    int view_h       = 0;
+
+    while (true) {
+        // Latest request wins, queued jobs of older ones are cancelled
+        Request_t* req = nullptr;
+        while (xQueueReceive(self->_cmd_queue, &req, jobs.empty() && !region ? portMAX_DELAY : 0) == pdTRUE) {
+            if (req->region) {
+                // Same for regions, but they leave the prefetch jobs alone
+                delete region;
+                region = req->region;
+                delete req;
+                continue;
+            }
+            // Asked for again is decoded again, the viewer may have taken and dropped the last result already
+            jobs.assign(req->paths.begin(), req->paths.end());
+            view_w    = req->view_w;
+            view_h    = req->view_h;
+            on_screen = std::move(req->on_screen);
+            delete req;
+        }
+
+        // The viewer is waiting on a region, prefetches can wait
+        if (region) {
+            render_region(*region);
+            Result_t r;
+            r.region = region;
+            region   = nullptr;
+            if (xQueueSend(self->_result_queue, &r, pdMS_TO_TICKS(100)) != pdTRUE) {
+                delete r.region;
+            }
+            continue;
+        }
+        if (jobs.empty()) {
+            continue;
+        }
+
+        Result_t r;
+        r.path = new std::string(std::move(jobs.front()));
+        jobs.pop_front();
+
+        ImageInfo_t info;
+        if (readImageInfo(r.path->c_str(), info)) {
+            // The image on screen may take as much as the viewer could give it, the neighbours only a slice
+            size_t budget = ImagePyramid::budget();
+            if (*r.path != on_screen && heap_caps_get_total_size(MALLOC_CAP_SPIRAM) == 0) {
+                budget = std::min(budget, kInternalPrefetchBudget);
+            }
+            r.image = new ImagePyramid;
+            if (!r.image->load(r.path->c_str(), fitScale(info.width, info.height, view_w, view_h), view_w, view_h,
+                               budget)) {
+                delete r.image;
+                r.image = nullptr;
+            }
+        }
+
+        if (xQueueSend(self->_result_queue, &r, pdMS_TO_TICKS(100)) != pdTRUE) {
+            delete r.image;
+            delete r.path;
+        }
+    }
+}
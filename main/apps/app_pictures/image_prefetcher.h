@@ -0,0 +1,123 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "utils/image/image_pyramid.h"
+
+/**
+ * Decodes the images around the one on screen in a worker task
+ *
+ * The viewer posts the paths it wants next, in priority order, and hands the pyramid it stops showing back with put().
+ * Finished pyramids wait in a small cache until the viewer takes them. A new request replaces the queued jobs of the
+ * previous one, cached or in flight images that are no longer wanted are dropped.
+ *
+ * At a zoom the pyramid can't hold, the visible part is rendered straight from the file as a region, ahead of any
+ * prefetch. The viewer never decodes anything itself.
+ */
+class ImagePrefetcher {
+public:
+    static constexpr size_t kCapacity               = 3;
+    static constexpr size_t kInternalPrefetchBudget = 80 * 1024;
+
+    struct RegionKey_t {
+        std::string path;
+        int w       = 0;
+        int h       = 0;
+        int pan_x   = 0;
+        int pan_y   = 0;
+        float scale = 0.0f;
+
+        bool operator==(const RegionKey_t& other) const
+        {
+            return path == other.path && w == other.w && h == other.h && pan_x == other.pan_x &&
+                   pan_y == other.pan_y && scale == other.scale;
+        }
+    };
+
+    /** w x h of path at scale, panned like ImagePyramid::draw(). ok is false if no decoder could render it */
+    struct Region_t {
+        RegionKey_t key;
+        uint32_t serial = 0;
+        bool ok         = false;
+        LGFX_Sprite sprite;
+    };
+
+    /**
+     * Prefetch paths in order, fit to a view_w x view_h box. The first one is the image on screen and gets the whole
+     * memory budget. keep is also spared from eviction
+     */
+    void request(const std::vector<std::string>& paths, const std::string& keep, int view_w, int view_h);
+
+    /** Render key on the worker, replaces the region shown before and any that hasn't arrived yet */
+    void requestRegion(const RegionKey_t& key);
+
+    /** The region of the last requestRegion() once it has arrived, nullptr until then */
+    Region_t* region()
+    {
+        return _region && _region->serial == _region_serial ? _region.get() : nullptr;
+    }
+    /** The last requestRegion() asked for key */
+    bool isRegionRequested(const RegionKey_t& key) const
+    {
+        return _region_serial != 0 && _region_key == key;
+    }
+
+    /** Move the cached pyramid of path into out, false if it isn't ready */
+    bool take(std::string_view path, ImagePyramid& out);
+
+    /** Return a pyramid to the cache, kept only while it is still wanted */
+    void put(ImagePyramid&& image);
+
+    /** True while path is queued or being decoded */
+    bool isPending(std::string_view path) const;
+
+    /** The decode of path was wanted and failed, it isn't tried again until clear() */
+    bool hasFailed(std::string_view path) const;
+
+    /** Drop all jobs and cached images */
+    void clear();
+
+    /** Take finished decodes from the worker, true if any arrived */
+    bool poll();
+
+private:
+    struct Request_t {
+        std::vector<std::string> paths;
+        std::string on_screen;
+        int view_w       = 0;
+        int view_h       = 0;
+        Region_t* region = nullptr;  // Set on a region request, which leaves the prefetch jobs alone
+    };
+
+    struct Result_t {
+        std::string* path   = nullptr;
+        ImagePyramid* image = nullptr;
+        Region_t* region    = nullptr;
+    };
+
+    QueueHandle_t _cmd_queue    = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    TaskHandle_t _task          = nullptr;
+
+    std::vector<ImagePyramid> _cache;
+    std::vector<std::string> _wanted;
+    std::vector<std::string> _pending;
+    std::vector<std::string> _failed;
+    std::string _on_screen;
+
+    std::unique_ptr<Region_t> _region;
+    RegionKey_t _region_key;
+    uint32_t _region_serial = 0;
+
+    bool start();
+    bool is_wanted(const std::string& path) const;
+    void evict_unwanted();
+
+    static void task_main(void* arg);
+};
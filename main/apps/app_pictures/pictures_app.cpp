@@ -1,10 +1,21 @@
 #include "pictures_app.h"
 #include <hal.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <algorithm>
-#include <cctype>
+#include <cstdio>
 #include "utils/ui/simple_list.h"
+#include "utils/ui/glyph_cache.h"
+#include "utils/image/image_decoder.h"
+#include "utils/ui/animation.h"
+
+static constexpr int kGridCols  = 5;
+static constexpr int kGridRows  = 2;
+static constexpr int kGridCellW = 48;
+static constexpr int kGridCellH = 49;
+
+static constexpr uint32_t kSlideshowIntervalsMs[] = {2000, 3000, 5000, 10000, 15000, 30000, 60000};
+static constexpr uint32_t kSlideshowStatusMs      = 1500;
+
+static constexpr size_t kPathMax = 256;
 
 PicturesApp::PicturesApp()
 {
@@ -16,16 +27,44 @@ void PicturesApp::onOpen()
     _mode = Mode::Browse;
     _dir_stack.clear();
     _dir_stack.emplace_back();
-    _dir_stack.back().dir_path = "/sdcard";
+    _dir_stack.back().dir_path = GetHAL().getSdCardMountPoint();
     _view_entry_index = -1;
     resetViewTransform();
     refreshCurrentDir();
     hookKeyboard();
+    hookSdCard();
     draw();
 }
 
 void PicturesApp::onRunning()
 {
+    if (pollListing() && _mode != Mode::Slideshow) {
+        draw();
+        return;
+    }
+    if (_mode == Mode::Slideshow) {
+        const uint32_t now = GetHAL().millis();
+        bool redraw        = _slideshow.update(now);
+        if (_slideshow_status_timeout.expired(now)) {
+            redraw = true;
+        }
+        if (redraw) {
+            draw();
+        }
+        return;
+    }
+    if (_mode == Mode::View) {
+        if (_prefetch.poll() && _view_loading) {
+            draw();
+        }
+        return;
+    }
+    if (_grid) {
+        if (_thumbs.poll() && _mode == Mode::Browse) {
+            draw();
+        }
+        return;
+    }
     if (_mode == Mode::Browse && !_dir_stack.empty()) {
         auto& st = _dir_stack.back();
         st.list.update(GetHAL().millis());
@@ -38,6 +77,11 @@ void PicturesApp::onRunning()
 void PicturesApp::onClose()
 {
     unhookKeyboard();
+    unhookSdCard();
+    _thumbs.closeFolder();
+    _slideshow.stop();
+    closeViewer();
+    _listing.close();
     _dir_stack.clear();
     _view_entry_index = -1;
 }
@@ -53,9 +97,63 @@ void PicturesApp::hookKeyboard()
             return;
         }
 
+        if (_mode == Mode::Slideshow) {
+            auto options = _slideshow.options();
+            if (e.keyCode == KEY_ESC || e.keyCode == KEY_GRAVE) {
+                stopSlideshow();
+            } else if (e.keyCode == KEY_SPACE || e.keyCode == KEY_ENTER) {
+                _slideshow.setPaused(!_slideshow.isPaused());
+                showSlideshowStatus(slideshowStatus());
+            } else if (e.keyCode == KEY_RIGHTBRACE || e.keyCode == KEY_SLASH || e.keyCode == KEY_D ||
+                       e.keyCode == KEY_L) {
+                _slideshow.skip();
+            } else if (e.keyCode == KEY_MINUS || e.keyCode == KEY_EQUAL) {
+                const auto* begin = std::begin(kSlideshowIntervalsMs);
+                const auto* end   = std::end(kSlideshowIntervalsMs);
+                const auto* it    = std::lower_bound(begin, end, options.interval_ms);
+                if (e.keyCode == KEY_MINUS) {
+                    it = it == begin ? begin : it - 1;
+                } else {
+                    it = (it == end || *it > options.interval_ms) ? it : it + 1;
+                }
+                options.interval_ms = *std::min(it, end - 1);
+                _slideshow.setOptions(options);
+                showSlideshowStatus(slideshowStatus());
+            } else if (e.keyCode == KEY_T) {
+                const int next = (static_cast<int>(options.transition) + 1) %
+                                 static_cast<int>(Slideshow::Transition::Count);
+                options.transition = static_cast<Slideshow::Transition>(next);
+                _slideshow.setOptions(options);
+                showSlideshowStatus(slideshowStatus());
+            } else if (e.keyCode == KEY_Z || e.keyCode == KEY_R) {
+                // The play list changes, start over from the slide on screen
+                if (e.keyCode == KEY_Z) {
+                    options.shuffle = !options.shuffle;
+                } else {
+                    options.recursive = !options.recursive;
+                }
+                _slideshow_options = options;
+                const std::string current = _slideshow.currentPath();
+                auto& canvas              = GetHAL().canvas;
+                _slideshow.start(_dir_stack.back().dir_path, current, options, canvas.width(), canvas.height());
+                showSlideshowStatus(slideshowStatus());
+            } else {
+                return;
+            }
+            _slideshow_options = _slideshow.options();
+            draw();
+            return;
+        }
+
+        if (e.keyCode == KEY_P) {
+            startSlideshow();
+            draw();
+            return;
+        }
+
         if (_mode == Mode::View) {
             if (e.keyCode == KEY_ESC || e.keyCode == KEY_GRAVE) {
-                _mode = Mode::Browse;
+                closeViewer();
                 draw();
                 return;
             }
@@ -117,6 +215,12 @@ void PicturesApp::hookKeyboard()
             return;
         }
 
+        if (e.keyCode == KEY_G) {
+            setGridMode(!_grid);
+            draw();
+            return;
+        }
+
         if (e.keyCode == KEY_ESC || e.keyCode == KEY_GRAVE) {
             goBackOrExit();
             return;
@@ -134,18 +238,32 @@ void PicturesApp::hookKeyboard()
             return code == KEY_DOWN || code == KEY_S || code == KEY_J || code == KEY_DOT;
         };
 
-        if (is_up(e.keyCode) || is_down(e.keyCode)) {
-            auto& canvas = GetHAL().canvas;
-            canvas.setFont(&fonts::efontCN_12);
-            canvas.setTextSize(1);
-
-            const int pad = 4;
-            const int header_h = canvas.fontHeight() + 4;
-            const int list_h = canvas.height() - header_h - pad * 2;
-            const int row_h = SimpleList::rowHeight(canvas);
-            const int visible_row = SimpleList::visibleRows(list_h, row_h);
+        if (_grid) {
+            const auto is_left = [](KeScanCode_t code) {
+                return code == KEY_LEFT || code == KEY_A || code == KEY_H || code == KEY_COMMA;
+            };
+            const auto is_right = [](KeScanCode_t code) {
+                return code == KEY_RIGHT || code == KEY_D || code == KEY_L || code == KEY_SLASH;
+            };
+            int delta = 0;
+            if (is_up(e.keyCode)) {
+                delta = -kGridCols;
+            } else if (is_down(e.keyCode)) {
+                delta = kGridCols;
+            } else if (is_left(e.keyCode)) {
+                delta = -1;
+            } else if (is_right(e.keyCode)) {
+                delta = 1;
+            }
+            if (delta != 0) {
+                moveGridSelection(delta);
+                draw();
+            }
+            return;
+        }
 
-            moveSelection(is_up(e.keyCode) ? -1 : 1, visible_row);
+        if (is_up(e.keyCode) || is_down(e.keyCode)) {
+            moveSelection(is_up(e.keyCode) ? -1 : 1, listVisibleRows());
             draw();
             return;
         }
@@ -161,9 +279,45 @@ void PicturesApp::unhookKeyboard()
     _keyboard_slot_id = 0;
 }
 
+void PicturesApp::hookSdCard()
+{
+    if (_sd_card_slot_id != 0) {
+        return;
+    }
+    _sd_card_slot_id = GetHAL().onSdCardEvent.connect([this](const Hal::SdCardEvent_t&) { handleSdCard(); });
+}
+
+void PicturesApp::unhookSdCard()
+{
+    if (_sd_card_slot_id == 0) {
+        return;
+    }
+    GetHAL().onSdCardEvent.disconnect(_sd_card_slot_id);
+    _sd_card_slot_id = 0;
+}
+
+void PicturesApp::handleSdCard()
+{
+    // Listing, thumbnails and prefetched frames all describe the card as it was, start over from the root
+    _slideshow.stop();
+    closeViewer();
+    _thumbs.closeFolder();
+    _listing.close();
+    _dir_stack.clear();
+    _dir_stack.emplace_back();
+    _dir_stack.back().dir_path = GetHAL().getSdCardMountPoint();
+    _view_entry_index = -1;
+    resetViewTransform();
+    refreshCurrentDir();
+    draw();
+}
+
 void PicturesApp::draw()
 {
-    if (_mode == Mode::View) {
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "Pictures");
+    if (_mode == Mode::Slideshow) {
+        drawSlideshow();
+    } else if (_mode == Mode::View) {
         drawView();
     } else {
         drawBrowse();
@@ -186,13 +340,10 @@ void PicturesApp::drawBrowse()
     canvas.setTextColor(TFT_WHITE, header_bg);
     canvas.setTextDatum(textdatum_t::middle_left);
 
-    std::string title = "Pictures: ";
-    if (!_dir_stack.empty()) {
-        title += baseName(_dir_stack.back().dir_path);
-    } else {
-        title += "(none)";
-    }
-    canvas.drawString(title.c_str(), pad, header_h / 2);
+    char title[96];
+    const std::string_view dir_name = _dir_stack.empty() ? "(none)" : baseName(_dir_stack.back().dir_path);
+    std::snprintf(title, sizeof(title), "Pictures: %.*s", static_cast<int>(dir_name.size()), dir_name.data());
+    canvas.drawString(title, pad, header_h / 2);
 
     if (!GetHAL().isSdCardMounted()) {
         canvas.setTextColor(TFT_WHITE, bg);
@@ -211,15 +362,29 @@ void PicturesApp::drawBrowse()
     }
 
     auto& st = _dir_stack.back();
-    const int item_count = static_cast<int>(st.entries.size());
+    const int item_count = _listing.size();
     if (item_count <= 0) {
+        char message[40] = "No folders or images";
+        if (_listing.isLoading()) {
+            const int scanned = _listing.scannedCount();
+            std::snprintf(message, sizeof(message), scanned > 0 ? "Reading folder... %d" : "Loading...", scanned);
+        }
         canvas.setTextColor(TFT_WHITE, bg);
         canvas.setTextDatum(textdatum_t::middle_center);
-        canvas.drawString("No folders or PNG files", canvas.width() / 2, canvas.height() / 2);
+        canvas.drawString(message, canvas.width() / 2, canvas.height() / 2);
+        GetHAL().pushAppCanvas();
+        return;
+    }
+
+    if (_grid) {
+        drawGrid(st, header_h + 1, canvas.height());
         GetHAL().pushAppCanvas();
         return;
     }
 
+    // Rows around the cursor are read ahead, the list draws kPlaceholder for any that haven't arrived yet
+    _listing.ensureResident(st.list.getSelectedIndex(), 1);
+
     SimpleListStyle style;
     style.bg_color = bg;
     style.text_color = TFT_WHITE;
@@ -239,15 +404,15 @@ void PicturesApp::drawBrowse()
         list_w,
         list_h,
         item_count,
-        [&st](int idx) {
-            if (idx < 0 || idx >= static_cast<int>(st.entries.size())) {
-                return std::string();
+        st.label_version,
+        [this](int idx, char* scratch, size_t scratch_size) {
+            const std::string_view name = _listing.name(idx);
+            if (_listing.isDir(idx)) {
+                const int n =
+                    std::snprintf(scratch, scratch_size, "[DIR] %.*s", static_cast<int>(name.size()), name.data());
+                return std::string_view(scratch, std::min<size_t>(n > 0 ? n : 0, scratch_size - 1));
             }
-            const auto& e = st.entries[idx];
-            if (e.is_dir) {
-                return std::string("[DIR] ") + e.name;
-            }
-            return stripPngExt(e.name);
+            return stripImageExt(name);
         },
         style);
 
@@ -267,13 +432,13 @@ void PicturesApp::drawView()
     canvas.setTextColor(TFT_WHITE, TFT_BLACK);
     canvas.setTextDatum(textdatum_t::middle_left);
 
-    std::string label;
-    if (!_dir_stack.empty() && _view_entry_index >= 0 && _view_entry_index < static_cast<int>(_dir_stack.back().entries.size())) {
-        label = stripPngExt(_dir_stack.back().entries[_view_entry_index].name);
-    } else {
-        label = "Picture";
+    char label[96];
+    std::string_view label_name = "Picture";
+    if (!_dir_stack.empty() && _view_entry_index >= 0 && _view_entry_index < _listing.size()) {
+        label_name = stripImageExt(_listing.name(_view_entry_index));
     }
-    canvas.drawString(label.c_str(), pad, header_h / 2);
+    std::snprintf(label, sizeof(label), "%.*s", static_cast<int>(label_name.size()), label_name.data());
+    canvas.drawString(label, pad, header_h / 2);
 
     if (!GetHAL().isSdCardMounted()) {
         canvas.setTextDatum(textdatum_t::middle_center);
@@ -282,115 +447,317 @@ void PicturesApp::drawView()
         return;
     }
 
-    if (_dir_stack.empty() || _view_entry_index < 0 || _view_entry_index >= static_cast<int>(_dir_stack.back().entries.size())) {
+    if (_dir_stack.empty() || _view_entry_index < 0 || _view_entry_index >= _listing.size()) {
         canvas.setTextDatum(textdatum_t::middle_center);
         canvas.drawString("No image", canvas.width() / 2, canvas.height() / 2);
         GetHAL().pushAppCanvas();
         return;
     }
 
-    const auto& e = _dir_stack.back().entries[_view_entry_index];
+    char path_buffer[kPathMax];
+    const std::string_view path = _listing.path(_view_entry_index, path_buffer, sizeof(path_buffer));
     bool ok = false;
-    if (!e.path.empty()) {
+    // Nothing is decoded here, until the worker delivers the view shows Loading... and onRunning() redraws
+    _view_loading = path.empty() && !_listing.isResident(_view_entry_index);
+    if (!path.empty()) {
         const int view_x = 0;
         const int view_y = header_h;
         const int view_w = canvas.width();
         const int view_h = canvas.height() - header_h;
-        ok = canvas.drawPngFile(e.path.c_str(), view_x, view_y, view_w, view_h, _view_pan_x, _view_pan_y, _view_scale, 0.0f, datum_t::middle_center);
+
+        // Decoded once by the prefetcher, pan and zoom are then resampled from memory
+        if (!_view_image.isLoaded() || _view_image.path() != path) {
+            if (_view_image.isLoaded()) {
+                _prefetch.put(std::move(_view_image));
+            }
+            if (!_prefetch.take(path, _view_image) && !_prefetch.isPending(path) && !_prefetch.hasFailed(path)) {
+                // Never asked for, or evicted since
+                _prefetch_for.clear();
+            }
+        }
+        prefetchAround(_view_entry_index, view_w, view_h);
+
+        const bool have_image = _view_image.isLoaded() && _view_image.path() == path;
+        if (have_image && _view_image.canDraw(_view_scale)) {
+            _view_image.draw(canvas, view_x, view_y, view_w, view_h, _view_scale, _view_pan_x, _view_pan_y);
+            ok = true;
+        } else if (have_image || _prefetch.hasFailed(path)) {
+            // Too large to keep in memory at this zoom or at all, the worker renders the visible part from the file
+            ImagePrefetcher::RegionKey_t key;
+            key.path  = path;
+            key.w     = view_w;
+            key.h     = view_h;
+            key.pan_x = _view_pan_x;
+            key.pan_y = _view_pan_y;
+            key.scale = _view_scale;
+            if (!_prefetch.isRegionRequested(key)) {
+                _prefetch.requestRegion(key);
+            }
+            auto* region  = _prefetch.region();
+            _view_loading = region == nullptr;
+            if (region && region->ok) {
+                region->sprite.pushSprite(&canvas, view_x, view_y);
+                ok = true;
+            } else if (have_image) {
+                // Magnify the reduced copy until the region arrives, or for good if M5GFX can't draw the format
+                _view_image.draw(canvas, view_x, view_y, view_w, view_h, _view_scale, _view_pan_x, _view_pan_y);
+                ok = true;
+            }
+        } else {
+            _view_loading = true;
+        }
     }
 
     if (!ok) {
         canvas.setTextDatum(textdatum_t::middle_center);
-        canvas.drawString("Failed to load PNG", canvas.width() / 2, canvas.height() / 2);
+        canvas.drawString(_view_loading ? "Loading..." : "Failed to load image", canvas.width() / 2,
+                          canvas.height() / 2);
     }
 
     GetHAL().pushAppCanvas();
 }
 
-void PicturesApp::refreshCurrentDir()
+void PicturesApp::drawSlideshow()
 {
-    if (_dir_stack.empty()) {
-        return;
+    auto& canvas       = GetHAL().canvas;
+    const uint32_t now = GetHAL().millis();
+    canvas.setFont(&fonts::efontCN_12);
+    canvas.setTextSize(1);
+
+    const char* message = nullptr;
+    if (_slideshow.outOfMemory()) {
+        message = "Not enough memory";
+    } else if (_slideshow.isEmpty()) {
+        message = "No images";
+    } else if (_slideshow.isLoading()) {
+        message = "Loading...";
+    }
+    if (message) {
+        canvas.fillScreen(TFT_BLACK);
+        canvas.setTextColor(TFT_WHITE, TFT_BLACK);
+        canvas.setTextDatum(textdatum_t::middle_center);
+        canvas.drawString(message, canvas.width() / 2, canvas.height() / 2);
+    } else {
+        _slideshow.draw(canvas, now);
     }
 
-    auto& st = _dir_stack.back();
-    st.entries.clear();
+    if (_slideshow_status_timeout.isActive(now)) {
+        const int h = canvas.fontHeight() + 4;
+        canvas.fillRect(0, canvas.height() - h, canvas.width(), h, TFT_BLACK);
+        canvas.setTextColor(TFT_WHITE, TFT_BLACK);
+        canvas.setTextDatum(textdatum_t::middle_center);
+        canvas.drawString(_slideshow_status.c_str(), canvas.width() / 2, canvas.height() - h / 2);
+    }
 
-    if (!GetHAL().isSdCardMounted()) {
-        st.list.jumpTo(0, 0, 1);
-        return;
+    GetHAL().pushAppCanvas();
+}
+
+void PicturesApp::drawGrid(FolderState& st, int top, int bottom)
+{
+    auto& canvas         = GetHAL().canvas;
+    auto& glyphs         = GetGlyphCache();
+    const int item_count = _listing.size();
+    const int selected   = std::clamp(st.list.getSelectedIndex(), 0, item_count - 1);
+    const int total_rows = (item_count + kGridCols - 1) / kGridCols;
+    const int rows       = std::max(1, std::min(kGridRows, (bottom - top) / kGridCellH));
+
+    // Keep the selected cell on screen
+    const int sel_row = selected / kGridCols;
+    if (sel_row < st.grid_top_row) {
+        st.grid_top_row = sel_row;
+    } else if (sel_row >= st.grid_top_row + rows) {
+        st.grid_top_row = sel_row - rows + 1;
     }
+    st.grid_top_row = std::clamp(st.grid_top_row, 0, std::max(0, total_rows - rows));
 
-    DIR* dir = opendir(st.dir_path.c_str());
-    if (!dir) {
-        st.list.jumpTo(0, 0, 1);
-        return;
+    const int first   = st.grid_top_row * kGridCols;
+    const int last    = std::min(item_count, first + rows * kGridCols);
+    const int x0      = (canvas.width() - kGridCols * kGridCellW) / 2;
+    const int thumb_x = (kGridCellW - ThumbnailCache::kThumbW) / 2;
+
+    // Thumbnails cover the resident entries of the listing, follow it when the page moves it
+    _listing.ensureResident(first, last - first);
+    if (_listing.windowFirst() != _thumb_window_first || _listing.windowSize() != _thumb_window_size) {
+        openThumbnails();
     }
 
-    while (true) {
-        dirent* ent = readdir(dir);
-        if (!ent) {
-            break;
+    // Images sort after the folders, so the visible thumbnails are one contiguous range of items
+    const int thumb_first = std::max(first, _thumb_base) - _thumb_base;
+    const int thumb_last  = std::max(last, _thumb_base) - _thumb_base;
+    _thumbs.setVisible(thumb_first, thumb_last - thumb_first);
+
+    const uint16_t placeholder = lgfx::color565(0x30, 0x30, 0x30);
+    const uint16_t folder      = lgfx::color565(0xE0, 0xB0, 0x40);
+    for (int i = first; i < last; ++i) {
+        const bool is_dir = _listing.isDir(i);
+        const int cell_x  = x0 + (i % kGridCols) * kGridCellW;
+        const int cell_y  = top + ((i - first) / kGridCols) * kGridCellH;
+        const int tx      = cell_x + thumb_x;
+        const int ty      = cell_y + 1;
+        const bool is_sel = i == selected;
+        const uint16_t fg = is_sel ? TFT_BLACK : TFT_WHITE;
+
+        if (is_sel) {
+            canvas.fillRect(cell_x, cell_y - 1, kGridCellW, kGridCellH, TFT_WHITE);
         }
 
-        if (ent->d_name[0] == '.') {
-            continue;
+        if (is_dir) {
+            canvas.fillRect(tx + 8, ty + 6, 12, 4, folder);
+            canvas.fillRect(tx + 8, ty + 9, 28, 19, folder);
+        } else if (const uint16_t* pixels = _thumbs.get(i - _thumb_base)) {
+            canvas.pushImage(tx, ty, ThumbnailCache::kThumbW, ThumbnailCache::kThumbH,
+                             reinterpret_cast<const lgfx::swap565_t*>(pixels));
+        } else {
+            canvas.fillRect(tx, ty, ThumbnailCache::kThumbW, ThumbnailCache::kThumbH, placeholder);
         }
 
-        std::string name = ent->d_name;
-        std::string path = joinPath(st.dir_path, name);
+        const std::string_view name = is_dir ? _listing.name(i) : stripImageExt(_listing.name(i));
+        // Long names are left aligned and clipped to the cell
+        const int label_y = ty + ThumbnailCache::kThumbH + 1;
+        const bool fits   = glyphs.textWidth(name) <= kGridCellW - 2;
+        canvas.setClipRect(cell_x + 1, label_y, kGridCellW - 2, glyphs.fontHeight());
+        canvas.setTextDatum(fits ? textdatum_t::top_center : textdatum_t::top_left);
+        glyphs.drawStringTransparent(canvas, name, fits ? cell_x + kGridCellW / 2 : cell_x + 1, label_y, fg);
+        canvas.clearClipRect();
+    }
+}
 
-        struct stat s {};
-        if (stat(path.c_str(), &s) != 0) {
-            continue;
-        }
+void PicturesApp::setGridMode(bool grid)
+{
+    if (_grid == grid) {
+        return;
+    }
+    _grid = grid;
+    if (_grid) {
+        openThumbnails();
+    } else {
+        _thumbs.closeFolder();
+    }
+}
 
-        if (S_ISDIR(s.st_mode)) {
-            st.entries.push_back(Entry{name, path, true});
-            continue;
-        }
+void PicturesApp::openThumbnails()
+{
+    _thumb_window_first = _listing.windowFirst();
+    _thumb_window_size = _listing.windowSize();
+    _thumb_base = std::max(_thumb_window_first, _listing.dirCount());
+    if (_dir_stack.empty() || !GetHAL().isSdCardMounted()) {
+        _thumbs.closeFolder();
+        return;
+    }
 
-        if (S_ISREG(s.st_mode) && isPngFileName(name)) {
-            st.entries.push_back(Entry{name, path, false});
-        }
+    // Only the images of the resident window, a folder of thousands is never handed over whole
+    std::vector<std::string> names;
+    for (int i = _thumb_base; i < _thumb_window_first + _thumb_window_size; ++i) {
+        names.emplace_back(_listing.name(i));
     }
-    closedir(dir);
+    _thumbs.openFolder(_dir_stack.back().dir_path, std::move(names), _thumb_window_size == _listing.size());
+}
 
-    std::sort(st.entries.begin(), st.entries.end(), [](const Entry& a, const Entry& b) {
-        if (a.is_dir != b.is_dir) {
-            return a.is_dir && !b.is_dir;
-        }
-        std::string an = a.name;
-        std::string bn = b.name;
-        std::transform(an.begin(), an.end(), an.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-        std::transform(bn.begin(), bn.end(), bn.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-        return an < bn;
-    });
+void PicturesApp::moveGridSelection(int delta)
+{
+    if (_dir_stack.empty()) {
+        return;
+    }
+    auto& st        = _dir_stack.back();
+    const int count = _listing.size();
+    if (count <= 0) {
+        return;
+    }
+    const int idx = std::clamp(st.list.getSelectedIndex() + delta, 0, count - 1);
+
+    // Keep the list scroll in sync for when the grid is turned off
+    st.list.jumpTo(idx, count, listVisibleRows());
+}
+
+void PicturesApp::refreshCurrentDir()
+{
+    if (_dir_stack.empty()) {
+        return;
+    }
+
+    if (!GetHAL().isSdCardMounted()) {
+        _listing.close();
+    } else {
+        // Never waits on the worker, the browser shows Loading... until onRunning() picks up the listing
+        _listing.open(_dir_stack.back().dir_path, GetHAL().getSdCardMountPoint(), isImageFileName);
+    }
+    syncListing(std::string(), std::string());
+}
+
+bool PicturesApp::pollListing()
+{
+    if (_dir_stack.empty() || !_listing.hasResults()) {
+        return false;
+    }
+
+    // Entries may move if the folder changed since its sidecar was written, remember what they were on
+    std::string selected;
+    std::string viewed;
+    const int selected_index = _dir_stack.back().list.getSelectedIndex();
+    if (_listing.isResident(selected_index)) {
+        selected = _listing.name(selected_index);
+    }
+    if (_mode == Mode::View && _listing.isResident(_view_entry_index)) {
+        viewed = _listing.name(_view_entry_index);
+    }
+    if (!_listing.poll()) {
+        return false;
+    }
+    if (_listing.version() != _listing_version) {
+        syncListing(selected, viewed);
+    } else {
+        // A window arrived, rows drawn with the placeholder need their names
+        _dir_stack.back().label_version++;
+    }
+    return true;
+}
+
+void PicturesApp::syncListing(const std::string& selected, const std::string& viewed)
+{
+    auto& st = _dir_stack.back();
+    _listing_version = _listing.version();
+    st.label_version++;
+
+    if (_grid) {
+        openThumbnails();
+    }
 
-    const int item_count = static_cast<int>(st.entries.size());
+    const int item_count = _listing.size();
     if (item_count <= 0) {
-        st.list.jumpTo(0, 0, 1);
+        // Keep the selection of a folder that is still being listed
+        if (!_listing.isLoading()) {
+            st.list.jumpTo(0, 0, 1);
+        }
         return;
     }
 
+    int idx = selected.empty() ? -1 : _listing.find(selected);
+    if (idx < 0) {
+        idx = std::min(st.list.getSelectedIndex(), item_count - 1);
+    }
+    st.list.jumpTo(idx, item_count, listVisibleRows());
+
+    if (_mode == Mode::View) {
+        if (!viewed.empty()) {
+            _view_entry_index = _listing.find(viewed);
+        }
+        if (_view_entry_index < 0 || _view_entry_index >= item_count || _listing.isDir(_view_entry_index)) {
+            closeViewer();
+            _view_entry_index = -1;
+        }
+    }
+}
+
+int PicturesApp::listVisibleRows()
+{
     auto& canvas = GetHAL().canvas;
     canvas.setFont(&fonts::efontCN_12);
+    canvas.setTextSize(1);
     const int pad = 4;
     const int header_h = canvas.fontHeight() + 4;
     const int list_h = canvas.height() - header_h - pad * 2;
     const int row_h = SimpleList::rowHeight(canvas);
-    const int visible_rows = SimpleList::visibleRows(list_h, row_h);
-
-    int idx = st.list.getSelectedIndex();
-    if (idx >= item_count) idx = item_count - 1;
-    st.list.jumpTo(idx, item_count, visible_rows);
-
-    if (_mode == Mode::View) {
-        if (_view_entry_index < 0 || _view_entry_index >= item_count || st.entries[_view_entry_index].is_dir) {
-            _mode = Mode::Browse;
-            _view_entry_index = -1;
-        }
-    }
+    return SimpleList::visibleRows(list_h, row_h);
 }
 
 void PicturesApp::enterSelected()
@@ -400,18 +767,22 @@ void PicturesApp::enterSelected()
     }
 
     auto& st = _dir_stack.back();
-    if (st.entries.empty()) {
+    if (_listing.size() <= 0) {
         return;
     }
 
     int idx = st.list.getSelectedIndex();
     if (idx < 0) idx = 0;
-    if (idx >= static_cast<int>(st.entries.size())) idx = static_cast<int>(st.entries.size()) - 1;
+    if (idx >= _listing.size()) idx = _listing.size() - 1;
 
-    const auto& e = st.entries[idx];
-    if (e.is_dir) {
+    if (_listing.isDir(idx)) {
+        char path[kPathMax];
+        const std::string_view dir_path = _listing.path(idx, path, sizeof(path));
+        if (dir_path.empty()) {
+            return;
+        }
         _dir_stack.emplace_back();
-        _dir_stack.back().dir_path = e.path;
+        _dir_stack.back().dir_path = dir_path;
         refreshCurrentDir();
         draw();
         return;
@@ -427,14 +798,8 @@ void PicturesApp::openImageAtEntryIndex(int entry_index)
         return;
     }
 
-    auto& st = _dir_stack.back();
-    if (entry_index < 0 || entry_index >= static_cast<int>(st.entries.size())) {
-        return;
-    }
-    if (st.entries[entry_index].is_dir) {
-        return;
-    }
-    if (!isPngFileName(st.entries[entry_index].name)) {
+    // Every file in the listing is an image
+    if (entry_index < 0 || entry_index >= _listing.size() || _listing.isDir(entry_index)) {
         return;
     }
 
@@ -453,7 +818,7 @@ void PicturesApp::resetViewTransform()
 void PicturesApp::goBackOrExit()
 {
     if (_mode == Mode::View) {
-        _mode = Mode::Browse;
+        closeViewer();
         draw();
         return;
     }
@@ -489,7 +854,7 @@ void PicturesApp::moveSelection(int delta, int visible_rows)
     }
     auto& st = _dir_stack.back();
     int idx = st.list.getSelectedIndex();
-    st.list.go(idx + delta, static_cast<int>(st.entries.size()), visible_rows);
+    st.list.go(idx + delta, _listing.size(), visible_rows);
 }
 
 void PicturesApp::stepImage(int delta)
@@ -504,115 +869,158 @@ void PicturesApp::stepImage(int delta)
     const int next = findNextImageEntryIndex(_view_entry_index, delta);
     if (next >= 0) {
         _view_entry_index = next;
-        
-        // Calculate visible rows for jumpTo
-        auto& canvas = GetHAL().canvas;
-        canvas.setFont(&fonts::efontCN_12);
-        const int pad = 4;
-        const int header_h = canvas.fontHeight() + 4;
-        const int list_h = canvas.height() - header_h - pad * 2;
-        const int row_h = SimpleList::rowHeight(canvas);
-        const int visible_rows = SimpleList::visibleRows(list_h, row_h);
-
-        _dir_stack.back().list.jumpTo(next, static_cast<int>(_dir_stack.back().entries.size()), visible_rows);
+        _dir_stack.back().list.jumpTo(next, _listing.size(), listVisibleRows());
         resetViewTransform();
     }
 }
 
-int PicturesApp::findNextImageEntryIndex(int start_entry_index, int delta) const
+void PicturesApp::prefetchAround(int entry_index, int view_w, int view_h)
 {
-    if (_dir_stack.empty()) {
-        return -1;
+    if (_dir_stack.empty() || entry_index < 0) {
+        return;
     }
-    const auto& entries = _dir_stack.back().entries;
-    const int n = static_cast<int>(entries.size());
-    if (n <= 0) {
-        return -1;
+    char path[kPathMax];
+    const std::string_view current = _listing.path(entry_index, path, sizeof(path));
+    if (current.empty() || _prefetch_for == current) {
+        return;
     }
-    if (delta == 0) {
-        return start_entry_index;
+    _prefetch_for = current;
+
+    // The current image first in case it is still in flight, then the likely next steps
+    std::vector<std::string> paths;
+    paths.emplace_back(current);
+    const int next = findNextImageEntryIndex(entry_index, 1);
+    const int prev = findNextImageEntryIndex(entry_index, -1);
+    // A neighbour outside the window, past a wrap around, is requested once the window follows
+    if (next >= 0 && next != entry_index && _listing.isResident(next)) {
+        paths.push_back(_listing.path(next));
+    }
+    if (prev >= 0 && prev != entry_index && prev != next && _listing.isResident(prev)) {
+        paths.push_back(_listing.path(prev));
     }
+    _prefetch.request(paths, _view_image.isLoaded() ? _view_image.path() : std::string(), view_w, view_h);
+}
 
-    int idx = start_entry_index;
-    for (int step = 0; step < n; ++step) {
-        idx += (delta > 0) ? 1 : -1;
-        if (idx < 0) idx = n - 1;
-        if (idx >= n) idx = 0;
-        if (!entries[idx].is_dir && isPngFileName(entries[idx].name)) {
-            return idx;
-        }
+void PicturesApp::closeViewer()
+{
+    _mode = Mode::Browse;
+    _view_loading = false;
+    _view_image.reset();
+    _prefetch.clear();
+    _prefetch_for.clear();
+}
+
+void PicturesApp::startSlideshow()
+{
+    if (_dir_stack.empty() || !GetHAL().isSdCardMounted()) {
+        return;
+    }
+    auto& st = _dir_stack.back();
+
+    // Start at the image on screen or under the cursor
+    int idx = _mode == Mode::View ? _view_entry_index : st.list.getSelectedIndex();
+    std::string first;
+    if (idx >= 0 && idx < _listing.size() && !_listing.isDir(idx)) {
+        first = _listing.path(idx);
+    }
+
+    // The viewer's pyramids would only compete with the two slide frames for memory
+    const Mode from = _mode;
+    closeViewer();
+
+    auto& canvas = GetHAL().canvas;
+    if (!_slideshow.start(st.dir_path, first, _slideshow_options, canvas.width(), canvas.height())) {
+        _mode = from;
+        return;
     }
-    return -1;
+    _slideshow_return = from;
+    _mode             = Mode::Slideshow;
+    showSlideshowStatus(slideshowStatus());
 }
 
-int PicturesApp::countImagesInCurrentDir() const
+void PicturesApp::stopSlideshow()
 {
-    if (_dir_stack.empty()) {
-        return 0;
+    const std::string current = _slideshow.currentPath();
+    _slideshow.stop();
+    _slideshow_status_timeout.cancel();
+    _mode = Mode::Browse;
+    if (_slideshow_return != Mode::View || _dir_stack.empty()) {
+        return;
     }
-    int c = 0;
-    for (const auto& e : _dir_stack.back().entries) {
-        if (!e.is_dir && isPngFileName(e.name)) {
-            ++c;
+
+    // Back to the viewer on the last slide if it is in this folder, otherwise on the image it was started from
+    const size_t slash = current.find_last_of('/');
+    if (slash != std::string::npos && current.compare(0, slash, _listing.dir()) == 0) {
+        const int idx = _listing.find(std::string_view(current).substr(slash + 1));
+        if (idx >= 0) {
+            _view_entry_index = idx;
         }
     }
-    return c;
+    resetViewTransform();
+    _mode = Mode::View;
 }
 
-int PicturesApp::getFirstImageEntryIndex() const
+void PicturesApp::showSlideshowStatus(std::string text)
+{
+    _slideshow_status = std::move(text);
+    _slideshow_status_timeout.start(GetHAL().millis(), kSlideshowStatusMs);
+}
+
+std::string PicturesApp::slideshowStatus() const
+{
+    static const char* kTransitionNames[] = {"Cut", "Crossfade", "Wipe"};
+
+    const auto& options = _slideshow.options();
+    char text[64];
+    std::snprintf(text, sizeof(text), "%us  %s%s%s%s", static_cast<unsigned>(options.interval_ms / 1000),
+                  kTransitionNames[static_cast<int>(options.transition)], options.shuffle ? "  Shuffle" : "",
+                  options.recursive ? "  Subfolders" : "", _slideshow.isPaused() ? "  Paused" : "");
+    return text;
+}
+
+int PicturesApp::findNextImageEntryIndex(int start_entry_index, int delta) const
 {
     if (_dir_stack.empty()) {
         return -1;
     }
-    const auto& entries = _dir_stack.back().entries;
-    for (int i = 0; i < static_cast<int>(entries.size()); ++i) {
-        if (!entries[i].is_dir && isPngFileName(entries[i].name)) {
-            return i;
-        }
+    // Listed files are all images and sort after the folders
+    const int first = _listing.dirCount();
+    const int count = _listing.size() - first;
+    if (count <= 0) {
+        return -1;
+    }
+    if (delta == 0) {
+        return start_entry_index;
+    }
+    if (start_entry_index < first) {
+        return delta > 0 ? first : first + count - 1;
     }
-    return -1;
+
+    const int step = delta > 0 ? 1 : -1;
+    return first + ((start_entry_index - first + step) % count + count) % count;
 }
 
-bool PicturesApp::isPngFileName(const std::string& name)
+int PicturesApp::countImagesInCurrentDir() const
 {
-    if (name.size() < 4) {
-        return false;
+    if (_dir_stack.empty()) {
+        return 0;
     }
-    std::string lower = name;
-    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-    return lower.rfind(".png") == lower.size() - 4;
+    return std::max(0, _listing.size() - _listing.dirCount());
 }
 
-std::string PicturesApp::stripPngExt(const std::string& name)
+int PicturesApp::getFirstImageEntryIndex() const
 {
-    if (isPngFileName(name) && name.size() >= 4) {
-        return name.substr(0, name.size() - 4);
+    if (_dir_stack.empty() || _listing.dirCount() >= _listing.size()) {
+        return -1;
     }
-    return name;
+    return _listing.dirCount();
 }
 
-std::string PicturesApp::baseName(const std::string& path)
+std::string_view PicturesApp::baseName(std::string_view path)
 {
-    if (path.empty()) {
-        return "";
-    }
     const auto pos = path.find_last_of('/');
-    if (pos == std::string::npos) {
-        return path;
-    }
-    if (pos + 1 >= path.size()) {
+    if (pos == std::string_view::npos || pos + 1 >= path.size()) {
         return path;
     }
     return path.substr(pos + 1);
 }
-
-std::string PicturesApp::joinPath(const std::string& dir, const std::string& name)
-{
-    if (dir.empty()) {
-        return name;
-    }
-    if (dir.back() == '/') {
-        return dir + name;
-    }
-    return dir + "/" + name;
-}
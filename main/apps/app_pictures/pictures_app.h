@@ -1,62 +1,96 @@
-#pragma once
-#include <mooncake.h>
-#include <cstddef>
-#include <string>
-#include <vector>
-#include "utils/ui/simple_list.h"
-
-class PicturesApp : public mooncake::AppAbility {
-public:
-    PicturesApp();
-
-    void onOpen() override;
-    void onRunning() override;
-    void onClose() override;
-
-private:
-    enum class Mode : uint8_t {
-        Browse = 0,
-        View = 1,
-    };
-
-    struct Entry {
-        std::string name;
-        std::string path;
-        bool is_dir = false;
-    };
-
-    struct FolderState {
-        std::string dir_path;
-        std::vector<Entry> entries;
-        SmoothSimpleList list;
-    };
-
-    void draw();
-    void drawBrowse();
-    void drawView();
-    void hookKeyboard();
-    void unhookKeyboard();
-    void refreshCurrentDir();
-    void enterSelected();
-    void goBackOrExit();
-    void moveSelection(int delta, int visible_rows);
-    void openImageAtEntryIndex(int entry_index);
-    void stepImage(int delta);
-    void resetViewTransform();
-    int findNextImageEntryIndex(int start_entry_index, int delta) const;
-    int countImagesInCurrentDir() const;
-    int getFirstImageEntryIndex() const;
-    static bool isPngFileName(const std::string& name);
-    static std::string stripPngExt(const std::string& name);
-    static std::string baseName(const std::string& path);
-    static std::string joinPath(const std::string& dir, const std::string& name);
-
-    Mode _mode = Mode::Browse;
-    std::vector<FolderState> _dir_stack;
-    int _view_entry_index = -1;
-    float _view_scale = 1.0f;
-    int _view_pan_x = 0;
-    int _view_pan_y = 0;
-    size_t _keyboard_slot_id = 0;
-};
-
+#pragma once
+#include <mooncake.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "utils/ui/simple_list.h"
+#include "utils/fs/dir_listing.h"
+#include "thumbnail_cache.h"
+#include "image_prefetcher.h"
+#include "slideshow.h"
+#include "utils/image/image_pyramid.h"
+
+class PicturesApp : public mooncake::AppAbility {
+public:
+    PicturesApp();
+
+    void onOpen() override;
+    void onRunning() override;
+    void onClose() override;
+
+private:
+    enum class Mode : uint8_t {
+        Browse = 0,
+        View = 1,
+        Slideshow = 2,
+    };
+
+    // Only the folder on top is listed, the ones below keep their place for when it is popped
+    struct FolderState {
+        std::string dir_path;
+        SmoothSimpleList list;
+        uint32_t label_version = 0;
+        int grid_top_row = 0;
+    };
+
+    void draw();
+    void drawBrowse();
+    void drawView();
+    void drawGrid(FolderState& st, int top, int bottom);
+    void drawSlideshow();
+    void setGridMode(bool grid);
+    void openThumbnails();
+    void moveGridSelection(int delta);
+    void hookKeyboard();
+    void unhookKeyboard();
+    void hookSdCard();
+    void unhookSdCard();
+    void handleSdCard();
+    void refreshCurrentDir();
+    bool pollListing();
+    void syncListing(const std::string& selected, const std::string& viewed);
+    int listVisibleRows();
+    void enterSelected();
+    void goBackOrExit();
+    void moveSelection(int delta, int visible_rows);
+    void openImageAtEntryIndex(int entry_index);
+    void stepImage(int delta);
+    void prefetchAround(int entry_index, int view_w, int view_h);
+    void closeViewer();
+    void startSlideshow();
+    void stopSlideshow();
+    void showSlideshowStatus(std::string text);
+    std::string slideshowStatus() const;
+    void resetViewTransform();
+    int findNextImageEntryIndex(int start_entry_index, int delta) const;
+    int countImagesInCurrentDir() const;
+    int getFirstImageEntryIndex() const;
+    static std::string_view baseName(std::string_view path);
+
+    Mode _mode = Mode::Browse;
+    std::vector<FolderState> _dir_stack;
+    DirListing _listing;
+    uint32_t _listing_version = 0;
+    int _view_entry_index = -1;
+    float _view_scale = 1.0f;
+    int _view_pan_x = 0;
+    int _view_pan_y = 0;
+    size_t _keyboard_slot_id = 0;
+    size_t _sd_card_slot_id = 0;
+    bool _grid = false;
+    int _thumb_base = 0;
+    int _thumb_window_first = 0;
+    int _thumb_window_size = 0;
+    ThumbnailCache _thumbs;
+    ImagePyramid _view_image;
+    ImagePrefetcher _prefetch;
+    std::string _prefetch_for;
+    bool _view_loading = false;
+    Slideshow _slideshow;
+    Slideshow::Options_t _slideshow_options;
+    Mode _slideshow_return = Mode::Browse;
+    std::string _slideshow_status;
+    anim::Timeout _slideshow_status_timeout;
+};
+
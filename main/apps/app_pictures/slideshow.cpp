@@ -0,0 +1,517 @@
+#include "slideshow.h"
+#include "utils/image/image_decoder.h"
+#include "utils/image/image_info.h"
+#include "utils/image/rgb565_blend.h"
+#include <esp_heap_caps.h>
+#include <mooncake_log.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+static const std::string _tag = "Slideshow";
+
+static constexpr int kWipeFeather = 24;
+static constexpr int kMaxFailures = 8;
+
+static uint16_t* alloc_frame(size_t bytes)
+{
+    void* p = nullptr;
+    if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0) {
+        p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    }
+    if (!p) {
+        p = heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return static_cast<uint16_t*>(p);
+}
+
+namespace {
+
+/**
+ * Play list, only touched from the worker task
+ */
+class PlayList {
+public:
+    void build(const std::string& dir, const std::string& first, bool shuffle, bool recursive)
+    {
+        _paths.clear();
+        _cursor    = 0;
+        _shuffle   = shuffle;
+        _recursive = recursive;
+        scan(dir, 0);
+
+        if (_shuffle) {
+            std::shuffle(_paths.begin(), _paths.end(), _rng);
+        }
+        // Start at the image the user was on
+        const auto it = std::find(_paths.begin(), _paths.end(), first);
+        if (it != _paths.end()) {
+            if (_shuffle) {
+                std::iter_swap(_paths.begin(), it);
+            } else {
+                _cursor = static_cast<size_t>(it - _paths.begin());
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return _paths.size();
+    }
+
+    const std::string& next()
+    {
+        if (_cursor >= _paths.size()) {
+            _cursor = 0;
+            if (_shuffle && _paths.size() > 2) {
+                // New order each round, but never the same image twice in a row
+                const std::string last = _paths.back();
+                std::shuffle(_paths.begin(), _paths.end(), _rng);
+                if (_paths.front() == last) {
+                    std::swap(_paths.front(), _paths.back());
+                }
+            }
+        }
+        return _paths[_cursor++];
+    }
+
+private:
+    std::vector<std::string> _paths;
+    size_t _cursor  = 0;
+    bool _shuffle   = false;
+    bool _recursive = false;
+    std::mt19937 _rng{std::random_device{}()};
+
+    static std::string lower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    }
+
+    void scan(const std::string& dir, int depth)
+    {
+        DIR* d = opendir(dir.c_str());
+        if (!d) {
+            return;
+        }
+        std::vector<std::string> files;
+        std::vector<std::string> dirs;
+        while (dirent* ent = readdir(d)) {
+            if (ent->d_name[0] == '.') {
+                continue;
+            }
+            // d_type tells folders from files, stat() only where the file system leaves it out
+            bool is_dir = ent->d_type == DT_DIR;
+            if (ent->d_type == DT_UNKNOWN && !isImageFileName(ent->d_name)) {
+                const std::string path = dir + "/" + ent->d_name;
+                struct stat s {};
+                is_dir = stat(path.c_str(), &s) == 0 && S_ISDIR(s.st_mode);
+            }
+            if (!is_dir) {
+                if (isImageFileName(ent->d_name)) {
+                    files.emplace_back(ent->d_name);
+                }
+            } else if (_recursive && depth < Slideshow::kMaxDepth) {
+                dirs.emplace_back(ent->d_name);
+            }
+        }
+        closedir(d);
+
+        // Same order as the browser
+        const auto by_name = [](const std::string& a, const std::string& b) { return lower(a) < lower(b); };
+        std::sort(files.begin(), files.end(), by_name);
+        std::sort(dirs.begin(), dirs.end(), by_name);
+        for (const auto& name : files) {
+            if (_paths.size() >= Slideshow::kMaxImages) {
+                return;
+            }
+            _paths.push_back(dir + "/" + name);
+        }
+        for (const auto& name : dirs) {
+            scan(dir + "/" + name, depth + 1);
+        }
+    }
+};
+
+/** Fit path into a w x h black frame, centered */
+bool render(const std::string& path, uint16_t* frame, int w, int h)
+{
+    const size_t bytes = static_cast<size_t>(w) * h * sizeof(uint16_t);
+    std::memset(frame, 0, bytes);
+
+    if (auto decoder = openImageDecoder(path.c_str())) {
+        // Reduce by the largest whole factor that stays above the fit size, then pick rows and columns from that
+        const float fit  = fitScale(decoder->width(), decoder->height(), w, h);
+        const int out_w  = std::clamp(static_cast<int>(std::lround(decoder->width() * fit)), 1, w);
+        const int out_h  = std::clamp(static_cast<int>(std::lround(decoder->height() * fit)), 1, h);
+        const int factor = std::max(1, static_cast<int>(1.0f / fit + 1e-4f));
+        const int src_w  = ImageDecoder::scaledSize(decoder->width(), factor);
+        const int src_h  = ImageDecoder::scaledSize(decoder->height(), factor);
+        uint16_t* origin = frame + ((h - out_h) / 2) * w + (w - out_w) / 2;
+        std::unique_ptr<uint16_t[]> cols(new (std::nothrow) uint16_t[out_w]);
+        if (cols) {
+            for (int x = 0; x < out_w; ++x) {
+                cols[x] = static_cast<uint16_t>(x * src_w / out_w);
+            }
+            int next_y    = 0;
+            const bool ok = decoder->decode(factor, [&](int y, const uint16_t* row, int) {
+                while (next_y < out_h && next_y * src_h / out_h <= y) {
+                    uint16_t* dst = origin + next_y * w;
+                    for (int x = 0; x < out_w; ++x) {
+                        dst[x] = row[cols[x]];
+                    }
+                    next_y++;
+                }
+            });
+            if (ok) {
+                return true;
+            }
+            std::memset(frame, 0, bytes);
+        }
+    }
+
+    ImageInfo_t info;
+    if (!readImageInfo(path.c_str(), info)) {
+        return false;
+    }
+    LGFX_Sprite sprite;
+    sprite.setColorDepth(16);
+    sprite.setBuffer(frame, w, h, 16);
+    const float fit = fitScale(info.width, info.height, w, h);
+    return drawImageFile(sprite, path.c_str(), 0, 0, w, h, 0, 0, fit, fit, datum_t::middle_center);
+}
+
+}  // namespace
+
+/* -------------------------------------------------------------------------- */
+/*                                   UI side                                  */
+/* -------------------------------------------------------------------------- */
+bool Slideshow::start_task()
+{
+    if (_task) {
+        return true;
+    }
+    _cmd_queue    = xQueueCreate(4, sizeof(Command_t));
+    _result_queue = xQueueCreate(2, sizeof(Result_t));
+    _lock         = xSemaphoreCreateMutex();
+    if (!_cmd_queue || !_result_queue || !_lock) {
+        mclog::tagError(_tag, "create queues failed");
+        return false;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(task_main, "slideshow", 8192, this, 2, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(_tag, "create task failed");
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool Slideshow::start(const std::string& dir, const std::string& first_path, const Options_t& options, int w, int h)
+{
+    if (!start_task()) {
+        return false;
+    }
+    stop();
+
+    _options       = options;
+    _w             = w;
+    _h             = h;
+    _running       = true;
+    _paused        = false;
+    _empty         = false;
+    _out_of_memory = false;
+    _skip          = false;
+    _due           = false;
+    _image_count   = 0;
+
+    Command_t cmd;
+    cmd.type       = CommandType::Start;
+    cmd.generation = _generation;
+    cmd.dir        = new std::string(dir);
+    cmd.first      = new std::string(first_path);
+    cmd.shuffle    = options.shuffle;
+    cmd.recursive  = options.recursive;
+    if (xQueueSend(_cmd_queue, &cmd, pdMS_TO_TICKS(50)) != pdTRUE) {
+        delete cmd.dir;
+        delete cmd.first;
+        _running = false;
+        return false;
+    }
+    request_next(nullptr);
+    return true;
+}
+
+void Slideshow::request_next(uint16_t* reuse)
+{
+    Command_t cmd;
+    cmd.type       = CommandType::Render;
+    cmd.generation = _generation;
+    cmd.w          = _w;
+    cmd.h          = _h;
+    cmd.frame      = reuse;
+    if (xQueueSend(_cmd_queue, &cmd, pdMS_TO_TICKS(50)) != pdTRUE) {
+        mclog::tagWarn(_tag, "command queue full");
+        heap_caps_free(reuse);
+    }
+}
+
+void Slideshow::stop()
+{
+    if (!_task) {
+        return;
+    }
+    // From here on the worker drops whatever it is still rendering, anything it already posted is freed here
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _generation++;
+    drain_results();
+    xSemaphoreGive(_lock);
+
+    heap_caps_free(_front);
+    heap_caps_free(_next);
+    _front = nullptr;
+    _next  = nullptr;
+    _front_path.clear();
+    _next_path.clear();
+    _running       = false;
+    _transitioning = false;
+    _advance.cancel();
+}
+
+bool Slideshow::drain_results()
+{
+    bool changed = false;
+    Result_t r;
+    while (_result_queue && xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        if (r.generation != _generation) {
+            heap_caps_free(r.frame);
+            delete r.path;
+            continue;
+        }
+        if (r.type == CommandType::Start) {
+            _image_count = r.image_count;
+            _empty       = r.image_count == 0;
+            changed      = true;
+            continue;
+        }
+
+        if (r.path && r.frame) {
+            _next      = r.frame;
+            _next_path = std::move(*r.path);
+        } else {
+            heap_caps_free(r.frame);
+            _out_of_memory = r.out_of_memory;
+            _empty         = !r.out_of_memory;
+            changed        = true;
+        }
+        delete r.path;
+    }
+    return changed;
+}
+
+void Slideshow::setOptions(const Options_t& options)
+{
+    const bool interval_changed = options.interval_ms != _options.interval_ms;
+    _options                    = options;
+    if (interval_changed && _running && !_paused && !_due && _front) {
+        _advance.start(anim::now(), _options.interval_ms);
+    }
+}
+
+void Slideshow::setPaused(bool paused)
+{
+    _paused = paused;
+    _due    = false;
+    if (paused) {
+        _advance.cancel();
+    } else if (_front) {
+        _advance.start(anim::now(), _options.interval_ms);
+    }
+}
+
+void Slideshow::skip()
+{
+    _skip = true;
+}
+
+void Slideshow::finish_transition(uint32_t now)
+{
+    uint16_t* old  = _front;
+    _front         = _next;
+    _next          = nullptr;
+    _front_path    = std::move(_next_path);
+    _transitioning = false;
+    _next_path.clear();
+    if (!_paused) {
+        _advance.start(now, _options.interval_ms);
+    }
+    // The frame that just went off screen is where the slide after next gets rendered
+    if (_image_count > 1) {
+        request_next(old);
+    } else {
+        heap_caps_free(old);
+    }
+}
+
+bool Slideshow::update(uint32_t now)
+{
+    if (!_running) {
+        return false;
+    }
+    bool changed = drain_results();
+
+    if (!_front) {
+        if (!_next) {
+            return changed;
+        }
+        // First slide, no transition from black
+        _front      = _next;
+        _next       = nullptr;
+        _front_path = std::move(_next_path);
+        _next_path.clear();
+        if (!_paused) {
+            _advance.start(now, _options.interval_ms);
+        }
+        if (_image_count > 1) {
+            request_next(nullptr);
+        }
+        return true;
+    }
+
+    if (_transitioning) {
+        if (_progress.isDone(now)) {
+            finish_transition(now);
+        } else {
+            _progress.schedule(now);
+        }
+        return true;
+    }
+
+    if (!_paused && _advance.expired(now)) {
+        _due = true;
+    }
+    if (!(_due || _skip) || !_next) {
+        return changed;
+    }
+    _due  = false;
+    _skip = false;
+
+    _active_transition = _options.transition;
+    if (_active_transition == Transition::Cut || _image_count <= 1) {
+        finish_transition(now);
+        return true;
+    }
+    _transitioning = true;
+    _progress.setEasing(_active_transition == Transition::Wipe ? anim::easeOutCubic : anim::linear);
+    _progress.snap(0.0f);
+    _progress.retarget(1.0f, now);
+    _progress.schedule(now);
+    return true;
+}
+
+void Slideshow::draw(LGFX_Sprite& dst, uint32_t now)
+{
+    if (!_front || (dst.getColorDepth() & 0xFF) != 16 || dst.width() != _w || dst.height() != _h) {
+        return;
+    }
+    auto* out          = static_cast<uint16_t*>(dst.getBuffer());
+    const size_t count = static_cast<size_t>(_w) * _h;
+    if (!_transitioning || !_next) {
+        std::memcpy(out, _front, count * sizeof(uint16_t));
+        return;
+    }
+
+    const float t = std::clamp(_progress.value(now), 0.0f, 1.0f);
+    if (_active_transition == Transition::Wipe) {
+        const int edge = static_cast<int>(std::lround(t * (_w + kWipeFeather)));
+        rgb565::wipe(out, _front, _next, _w, _h, _w, edge, kWipeFeather);
+    } else {
+        rgb565::blend(out, _front, _next, count, static_cast<uint8_t>(std::lround(t * rgb565::kBlendMax)));
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Worker                                   */
+/* -------------------------------------------------------------------------- */
+void Slideshow::task_main(void* arg)
+{
+    auto* self = static_cast<Slideshow*>(arg);
+    PlayList list;
+
+    const auto is_stale = [self](uint32_t generation) {
+        xSemaphoreTake(self->_lock, portMAX_DELAY);
+        const bool stale = generation != self->_generation;
+        xSemaphoreGive(self->_lock);
+        return stale;
+    };
+
+    const auto post = [self](Result_t& r) {
+        // Checked under the lock so stop() can't miss a result posted right after it drained the queue
+        xSemaphoreTake(self->_lock, portMAX_DELAY);
+        const bool stale = r.generation != self->_generation;
+        const bool sent  = !stale && xQueueSend(self->_result_queue, &r, pdMS_TO_TICKS(100)) == pdTRUE;
+        xSemaphoreGive(self->_lock);
+        if (!sent) {
+            heap_caps_free(r.frame);
+            delete r.path;
+        }
+    };
+
+    while (true) {
+        Command_t cmd;
+        if (xQueueReceive(self->_cmd_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        Result_t r;
+        r.type       = cmd.type;
+        r.generation = cmd.generation;
+
+        if (cmd.type == CommandType::Start) {
+            list.build(*cmd.dir, *cmd.first, cmd.shuffle, cmd.recursive);
+            delete cmd.dir;
+            delete cmd.first;
+            mclog::tagInfo(_tag, "{} images", list.size());
+            r.image_count = list.size();
+            post(r);
+            continue;
+        }
+
+        // Stopped or restarted while this was queued
+        if (is_stale(cmd.generation)) {
+            heap_caps_free(cmd.frame);
+            continue;
+        }
+
+        r.image_count = list.size();
+        r.frame       = cmd.frame ? cmd.frame : alloc_frame(static_cast<size_t>(cmd.w) * cmd.h * sizeof(uint16_t));
+        if (!r.frame) {
+            mclog::tagWarn(_tag, "no memory for a {}x{} frame", cmd.w, cmd.h);
+            r.out_of_memory = true;
+            post(r);
+            continue;
+        }
+
+        // Skip over broken files, but don't spin forever on a folder of them
+        const int attempts = static_cast<int>(std::min<size_t>(list.size(), kMaxFailures));
+        for (int i = 0; i < attempts; ++i) {
+            const std::string& path = list.next();
+            if (render(path, r.frame, cmd.w, cmd.h)) {
+                r.path = new std::string(path);
+                break;
+            }
+            mclog::tagWarn(_tag, "render {} failed", path);
+        }
+        if (!r.path) {
+            heap_caps_free(r.frame);
+            r.frame = nullptr;
+        }
+        post(r);
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <M5GFX.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "utils/ui/animation.h"
+
+/**
+ * Unattended slideshow over a folder
+ *
+ * A worker task builds the play list and renders each slide, fit to the screen, into a frame buffer while the current
+ * one is on display. At most two frames exist at once: the one shown and the next one, which is being decoded or
+ * waiting for its slot. A transition composites the two, then the old frame is handed back to the worker for the slide
+ * after. If the next slide isn't ready when its slot comes the current one simply stays up longer.
+ */
+class Slideshow {
+public:
+    enum class Transition : uint8_t {
+        Cut = 0,
+        Crossfade,
+        Wipe,
+        Count,
+    };
+
+    struct Options_t {
+        uint32_t interval_ms  = 5000;
+        Transition transition = Transition::Crossfade;
+        bool shuffle          = false;
+        bool recursive        = false;
+    };
+
+    static constexpr uint32_t kTransitionMs = 600;
+    static constexpr size_t kMaxImages      = 512;
+    static constexpr int kMaxDepth          = 4;
+
+    /** Play the images of dir, starting at first_path if it is one of them, on a w x h screen */
+    bool start(const std::string& dir, const std::string& first_path, const Options_t& options, int w, int h);
+
+    /** Stop and release both frames */
+    void stop();
+
+    /** Interval and transition apply from the next slide, shuffle and recursive only on start() */
+    void setOptions(const Options_t& options);
+    const Options_t& options() const
+    {
+        return _options;
+    }
+
+    void setPaused(bool paused);
+    bool isPaused() const
+    {
+        return _paused;
+    }
+
+    /** Move on as soon as the next slide is ready */
+    void skip();
+
+    /** Take finished slides from the worker and advance the show, true if the frame changed */
+    bool update(uint32_t now);
+
+    /** Composite the current frame into dst, which must be a 16-bit sprite of the size given to start() */
+    void draw(LGFX_Sprite& dst, uint32_t now);
+
+    bool isRunning() const
+    {
+        return _running;
+    }
+    /** Nothing to show yet */
+    bool isLoading() const
+    {
+        return _running && !_front;
+    }
+    /** The play list is empty or every image failed */
+    bool isEmpty() const
+    {
+        return _empty;
+    }
+    bool outOfMemory() const
+    {
+        return _out_of_memory;
+    }
+    const std::string& currentPath() const
+    {
+        return _front_path;
+    }
+    size_t imageCount() const
+    {
+        return _image_count;
+    }
+
+private:
+    enum class CommandType : uint8_t {
+        Start = 0,
+        Render,
+    };
+
+    struct Command_t {
+        CommandType type    = CommandType::Start;
+        uint32_t generation = 0;
+        std::string* dir    = nullptr;
+        std::string* first  = nullptr;
+        bool shuffle        = false;
+        bool recursive      = false;
+        int w               = 0;
+        int h               = 0;
+        uint16_t* frame     = nullptr;
+    };
+
+    struct Result_t {
+        CommandType type    = CommandType::Start;
+        uint32_t generation = 0;
+        size_t image_count  = 0;
+        std::string* path   = nullptr;
+        uint16_t* frame     = nullptr;
+        bool out_of_memory  = false;
+    };
+
+    QueueHandle_t _cmd_queue    = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    SemaphoreHandle_t _lock     = nullptr;
+    TaskHandle_t _task          = nullptr;
+
+    // Written by the UI under _lock, the worker drops results of older generations itself
+    uint32_t _generation = 0;
+
+    Options_t _options;
+    bool _running       = false;
+    bool _paused        = false;
+    bool _empty         = false;
+    bool _out_of_memory = false;
+    bool _skip          = false;
+    bool _due           = false;
+    size_t _image_count = 0;
+    int _w              = 0;
+    int _h              = 0;
+
+    uint16_t* _front = nullptr;
+    uint16_t* _next  = nullptr;
+    std::string _front_path;
+    std::string _next_path;
+    bool _transitioning           = false;
+    Transition _active_transition = Transition::Cut;
+    anim::Tween _progress{kTransitionMs, anim::easeOutCubic};
+    anim::Timeout _advance;
+
+    bool start_task();
+    void request_next(uint16_t* reuse);
+    bool drain_results();
+    void finish_transition(uint32_t now);
+
+    static void task_main(void* arg);
+};
@@ -0,0 +1,708 @@
+#include "thumbnail_cache.h"
+#include "utils/image/image_info.h"
+#include "utils/image/image_decoder.h"
+#include "utils/fs/fs_utils.h"
+#include <M5GFX.h>
+#include <mooncake_log.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+static const std::string _tag = "Thumbs";
+
+static constexpr uint32_t kFileMagic     = 0x43485450;  // "PTHC"
+static constexpr uint16_t kFileVersion   = 2;
+static constexpr size_t kCommitInterval  = 32;
+static constexpr size_t kMinStaleRecords = 32;
+static constexpr int32_t kUnresolved     = -2;
+
+struct ThumbnailCache::Folder_t {
+    std::string dir;
+    std::vector<std::string> names;
+    bool complete = false;
+};
+
+namespace {
+
+struct Record_t {
+    uint64_t name_hash;
+    uint32_t size;
+    uint32_t mtime;
+};
+
+struct Footer_t {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t thumb_w;
+    uint8_t thumb_h;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Record_t) == 16, "cache file record layout");
+static_assert(sizeof(Footer_t) == 16, "cache file footer layout");
+
+long file_size(std::FILE* f)
+{
+    return std::fseek(f, 0, SEEK_END) == 0 ? std::ftell(f) : -1;
+}
+
+/**
+ * Worker side state of the open folder, only touched from the worker task
+ */
+class Worker {
+public:
+    void open(std::string dir, std::vector<std::string> names, bool complete, uint32_t generation)
+    {
+        close();
+        _generation = generation;
+        _dir        = std::move(dir);
+        _items.resize(names.size());
+        for (size_t i = 0; i < names.size(); ++i) {
+            _items[i].name = std::move(names[i]);
+        }
+        _blob.assign(_items.size(), kUnresolved);
+        _failed.assign(_items.size(), 0);
+        _gen_cursor = 0;
+        load_index(complete);
+    }
+
+    void close()
+    {
+        commit();
+        if (_file) {
+            std::fclose(_file);
+            _file = nullptr;
+        }
+        _items.clear();
+        _blob.clear();
+        _failed.clear();
+        _records.clear();
+        _order.clear();
+        _pending_loads.clear();
+        _pending_gens.clear();
+    }
+
+    void request(const int16_t* indices, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            const int idx = indices[i];
+            if (idx < 0 || idx >= static_cast<int>(_items.size())) {
+                continue;
+            }
+            resolve(idx);
+            if (_blob[idx] >= 0) {
+                _pending_loads.push_back(idx);
+            } else if (!_failed[idx]) {
+                _pending_gens.push_back(idx);
+            }
+        }
+    }
+
+    bool hasWork() const
+    {
+        return !_pending_loads.empty() || !_pending_gens.empty() || _gen_cursor < _items.size() || _dirty > 0;
+    }
+
+    /** Do one unit of work, results for requested items are handed to post */
+    template <typename PostFn>
+    void step(PostFn&& post)
+    {
+        if (!_pending_loads.empty()) {
+            load_pending(post);
+            return;
+        }
+        if (!_pending_gens.empty()) {
+            const int idx = _pending_gens.front();
+            _pending_gens.erase(_pending_gens.begin());
+            if (_blob[idx] < 0 && !_failed[idx]) {
+                generate(idx, post);
+            }
+            return;
+        }
+        if (_gen_cursor < _items.size()) {
+            const int idx = static_cast<int>(_gen_cursor++);
+            resolve(idx);
+            if (_blob[idx] < 0 && !_failed[idx]) {
+                generate(idx, nullptr);
+            }
+            return;
+        }
+        commit();
+    }
+
+private:
+    struct Item_t {
+        std::string name;
+        uint32_t size  = 0;
+        uint32_t mtime = 0;
+    };
+
+    uint32_t _generation = 0;
+    std::string _dir;
+    std::vector<Item_t> _items;
+    std::vector<int32_t> _blob;
+    std::vector<uint8_t> _failed;
+    std::vector<Record_t> _records;
+    std::vector<uint32_t> _order;
+    std::vector<int> _pending_loads;
+    std::vector<int> _pending_gens;
+    size_t _gen_cursor = 0;
+    size_t _dirty      = 0;
+    std::FILE* _file   = nullptr;
+    LGFX_Sprite _sprite;
+
+    std::string file_path() const
+    {
+        return _dir + "/" + ThumbnailCache::kFileName;
+    }
+
+    std::string index_path() const
+    {
+        return _dir + "/" + ThumbnailCache::kIndexFileName;
+    }
+
+    std::string index_tmp_path() const
+    {
+        return index_path() + ".tmp";
+    }
+
+    void remove_files() const
+    {
+        std::remove(file_path().c_str());
+        std::remove(index_path().c_str());
+        std::remove(index_tmp_path().c_str());
+    }
+
+    /** Records of a whole index file, false unless its footer was written and matches its size */
+    bool read_index(std::FILE* f)
+    {
+        Footer_t footer{};
+        const long size = file_size(f);
+        bool ok = size >= static_cast<long>(sizeof(footer)) &&
+                  std::fseek(f, size - static_cast<long>(sizeof(footer)), SEEK_SET) == 0 &&
+                  std::fread(&footer, sizeof(footer), 1, f) == 1 && footer.magic == kFileMagic &&
+                  footer.version == kFileVersion && footer.thumb_w == ThumbnailCache::kThumbW &&
+                  footer.thumb_h == ThumbnailCache::kThumbH &&
+                  static_cast<unsigned long>(size) == footer.count * sizeof(Record_t) + sizeof(footer);
+        if (ok) {
+            _records.resize(footer.count);
+            ok = std::fseek(f, 0, SEEK_SET) == 0 &&
+                 std::fread(_records.data(), sizeof(Record_t), footer.count, f) == footer.count;
+        }
+        return ok;
+    }
+
+    void load_index(bool complete)
+    {
+        _records.clear();
+        _order.clear();
+        // Only the temporary index is left if a commit was cut off between removing the old one and the rename
+        std::FILE* f = std::fopen(index_path().c_str(), "rb");
+        if (!f) {
+            f = std::fopen(index_tmp_path().c_str(), "rb");
+        }
+        if (!f) {
+            remove_files();
+            return;
+        }
+        bool ok = read_index(f);
+        std::fclose(f);
+
+        // Blobs were synced before the index naming them was written, a shorter blob file is not ours
+        if (ok) {
+            std::FILE* blobs = std::fopen(file_path().c_str(), "rb");
+            ok = blobs && file_size(blobs) >= static_cast<long>(_records.size() * ThumbnailCache::kThumbBytes);
+            if (blobs) {
+                std::fclose(blobs);
+            }
+        }
+        if (!ok) {
+            mclog::tagWarn(_tag, "invalid cache file in {}, rebuilding", _dir);
+            _records.clear();
+            remove_files();
+            return;
+        }
+
+        // Items are matched against the index by hash here, size and mtime are checked in resolve()
+        _order.resize(_records.size());
+        for (uint32_t i = 0; i < _order.size(); ++i) {
+            _order[i] = i;
+        }
+        std::sort(_order.begin(), _order.end(),
+                  [this](uint32_t a, uint32_t b) { return _records[a].name_hash < _records[b].name_hash; });
+
+        size_t live = 0;
+        for (const auto& item : _items) {
+            if (find_record(fs_utils::hash_name(item.name)) != _order.end()) {
+                live++;
+            }
+        }
+
+        // Deleted files leave dead blobs behind, start over once they dominate the file
+        if (complete && _records.size() >= kMinStaleRecords && live * 2 < _records.size()) {
+            mclog::tagInfo(_tag, "{} of {} thumbnails stale in {}, rebuilding", _records.size() - live,
+                           _records.size(), _dir);
+            _records.clear();
+            _order.clear();
+            remove_files();
+            return;
+        }
+        mclog::tagInfo(_tag, "{}: {} of {} cached", _dir, live, _items.size());
+    }
+
+    std::vector<uint32_t>::const_iterator find_record(uint64_t hash) const
+    {
+        auto it = std::lower_bound(_order.begin(), _order.end(), hash,
+                                   [this](uint32_t r, uint64_t v) { return _records[r].name_hash < v; });
+        return it != _order.end() && _records[*it].name_hash == hash ? it : _order.end();
+    }
+
+    /** Look item idx up in the index, stat()ing it only now that it is needed */
+    void resolve(int idx)
+    {
+        if (_blob[idx] != kUnresolved) {
+            return;
+        }
+        _blob[idx] = -1;
+        auto& item = _items[idx];
+        struct stat s {};
+        if (stat((_dir + "/" + item.name).c_str(), &s) != 0) {
+            _failed[idx] = 1;
+            return;
+        }
+        item.size  = static_cast<uint32_t>(s.st_size);
+        item.mtime = static_cast<uint32_t>(s.st_mtime);
+
+        const uint64_t h = fs_utils::hash_name(item.name);
+        for (auto it = find_record(h); it != _order.end() && _records[*it].name_hash == h; ++it) {
+            const auto& r = _records[*it];
+            if (r.size == item.size && r.mtime == item.mtime) {
+                _blob[idx] = static_cast<int32_t>(*it);
+                return;
+            }
+        }
+    }
+
+    bool open_file_for_read()
+    {
+        if (_file) {
+            return true;
+        }
+        _file = std::fopen(file_path().c_str(), "r+b");
+        return _file != nullptr;
+    }
+
+    bool open_file_for_append()
+    {
+        if (_file) {
+            return true;
+        }
+        _file = std::fopen(file_path().c_str(), "r+b");
+        if (!_file) {
+            _file = std::fopen(file_path().c_str(), "w+b");
+        }
+        if (!_file) {
+            mclog::tagError(_tag, "open {} failed", file_path());
+        }
+        return _file != nullptr;
+    }
+
+    template <typename PostFn>
+    void load_pending(PostFn& post)
+    {
+        std::sort(_pending_loads.begin(), _pending_loads.end(), [this](int a, int b) { return _blob[a] < _blob[b]; });
+        _pending_loads.erase(std::unique(_pending_loads.begin(), _pending_loads.end()), _pending_loads.end());
+        if (!open_file_for_read()) {
+            _pending_loads.clear();
+            return;
+        }
+
+        // Coalesce runs of consecutive blobs into single reads
+        size_t i = 0;
+        while (i < _pending_loads.size()) {
+            size_t j = i + 1;
+            while (j < _pending_loads.size() && _blob[_pending_loads[j]] == _blob[_pending_loads[j - 1]] + 1) {
+                j++;
+            }
+            const size_t run = j - i;
+            std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[run * ThumbnailCache::kThumbBytes]);
+            const long offset = static_cast<long>(_blob[_pending_loads[i]]) * ThumbnailCache::kThumbBytes;
+            if (buffer && std::fseek(_file, offset, SEEK_SET) == 0 &&
+                std::fread(buffer.get(), ThumbnailCache::kThumbBytes, run, _file) == run) {
+                for (size_t k = 0; k < run; ++k) {
+                    auto* pixels = new (std::nothrow) uint16_t[ThumbnailCache::kThumbW * ThumbnailCache::kThumbH];
+                    if (pixels) {
+                        std::memcpy(pixels, buffer.get() + k * ThumbnailCache::kThumbBytes,
+                                    ThumbnailCache::kThumbBytes);
+                        post(_pending_loads[i + k], pixels);
+                    }
+                }
+            }
+            i = j;
+        }
+        _pending_loads.clear();
+    }
+
+    template <typename PostFn>
+    void generate(int idx, PostFn post)
+    {
+        const std::string path = _dir + "/" + _items[idx].name;
+        if (_sprite.width() == 0) {
+            _sprite.setColorDepth(16);
+            if (!_sprite.createSprite(ThumbnailCache::kThumbW, ThumbnailCache::kThumbH)) {
+                _failed[idx] = 1;
+                return;
+            }
+        }
+        _sprite.fillScreen(TFT_BLACK);
+
+        // Reduce while decoding, M5GFX is only needed for what the streaming decoders can't handle
+        bool ok = false;
+        if (auto decoder = openImageDecoder(path.c_str())) {
+            const int factor = ImageDecoder::factorToFit(decoder->width(), decoder->height(), ThumbnailCache::kThumbW,
+                                                         ThumbnailCache::kThumbH);
+            const int w      = ImageDecoder::scaledSize(decoder->width(), factor);
+            const int h      = ImageDecoder::scaledSize(decoder->height(), factor);
+            ok = decoder->decodeInto(factor, static_cast<uint16_t*>(_sprite.getBuffer()), ThumbnailCache::kThumbW,
+                                     ThumbnailCache::kThumbH, (ThumbnailCache::kThumbW - w) / 2,
+                                     (ThumbnailCache::kThumbH - h) / 2);
+        }
+        ImageInfo_t info;
+        if (!ok && readImageInfo(path.c_str(), info)) {
+            const float scale = fitScale(info.width, info.height, ThumbnailCache::kThumbW, ThumbnailCache::kThumbH);
+            _sprite.fillScreen(TFT_BLACK);
+            ok = drawImageFile(_sprite, path.c_str(), 0, 0, ThumbnailCache::kThumbW, ThumbnailCache::kThumbH, 0, 0,
+                               scale, scale, datum_t::middle_center);
+        }
+        if (!ok) {
+            _failed[idx] = 1;
+            return;
+        }
+
+        if (open_file_for_append()) {
+            const long offset = static_cast<long>(_records.size()) * ThumbnailCache::kThumbBytes;
+            if (std::fseek(_file, offset, SEEK_SET) == 0 &&
+                std::fwrite(_sprite.getBuffer(), ThumbnailCache::kThumbBytes, 1, _file) == 1) {
+                _blob[idx] = static_cast<int32_t>(_records.size());
+                _records.push_back({fs_utils::hash_name(_items[idx].name), _items[idx].size, _items[idx].mtime});
+                if (++_dirty >= kCommitInterval) {
+                    commit();
+                }
+            }
+        }
+
+        if constexpr (!std::is_same_v<PostFn, std::nullptr_t>) {
+            auto* pixels = new (std::nothrow) uint16_t[ThumbnailCache::kThumbW * ThumbnailCache::kThumbH];
+            if (pixels) {
+                std::memcpy(pixels, _sprite.getBuffer(), ThumbnailCache::kThumbBytes);
+                post(idx, pixels);
+            }
+        }
+    }
+
+    void commit()
+    {
+        if (_dirty == 0 || !_file) {
+            return;
+        }
+        Footer_t footer{};
+        footer.magic   = kFileMagic;
+        footer.version = kFileVersion;
+        footer.thumb_w = ThumbnailCache::kThumbW;
+        footer.thumb_h = ThumbnailCache::kThumbH;
+        footer.count   = static_cast<uint32_t>(_records.size());
+
+        // The blobs have to be on the card before an index naming them is
+        _dirty = 0;
+        if (std::fflush(_file) != 0 || fsync(fileno(_file)) != 0) {
+            mclog::tagError(_tag, "sync thumbnails of {} failed", _dir);
+            return;
+        }
+
+        const std::string tmp = index_tmp_path();
+        std::FILE* f          = std::fopen(tmp.c_str(), "wb");
+        bool ok               = f && std::fwrite(_records.data(), sizeof(Record_t), _records.size(), f) ==
+                                         _records.size();
+        // Footer last, an index cut off before it doesn't match its size and is never taken for valid
+        ok = ok && std::fwrite(&footer, sizeof(footer), 1, f) == 1 && std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+        if (f) {
+            std::fclose(f);
+        }
+        if (!ok) {
+            mclog::tagError(_tag, "write index of {} failed", _dir);
+            std::remove(tmp.c_str());
+            return;
+        }
+        // FAT can't rename over an existing file, load_index() falls back to the temporary one until the rename
+        if ((std::remove(index_path().c_str()) != 0 && errno != ENOENT) ||
+            std::rename(tmp.c_str(), index_path().c_str()) != 0) {
+            mclog::tagError(_tag, "replace index of {} failed", _dir);
+        }
+    }
+};
+
+}  // namespace
+
+/* -------------------------------------------------------------------------- */
+/*                                   UI side                                  */
+/* -------------------------------------------------------------------------- */
+bool ThumbnailCache::start()
+{
+    if (_task) {
+        return true;
+    }
+    _cmd_queue    = xQueueCreate(8, sizeof(Command_t));
+    _result_queue = xQueueCreate(kSlotCount, sizeof(Result_t));
+    if (!_cmd_queue || !_result_queue) {
+        mclog::tagError(_tag, "create queues failed");
+        return false;
+    }
+    // Pinned away from the UI loop, image decode needs a fair bit of stack
+    BaseType_t ok = xTaskCreatePinnedToCore(task_main, "thumbs", 8192, this, 2, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(_tag, "create task failed");
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ThumbnailCache::send(const Command_t& cmd)
+{
+    return xQueueSend(_cmd_queue, &cmd, 0) == pdTRUE;
+}
+
+bool ThumbnailCache::send_pending()
+{
+    Command_t cmd;
+    cmd.generation = _generation;
+    if (_pending_open) {
+        cmd.type   = CommandType::Open;
+        cmd.folder = _pending_open.get();
+        if (!send(cmd)) {
+            return false;
+        }
+        // The worker owns it now
+        _pending_open.release();
+    } else if (_pending_close) {
+        cmd.type = CommandType::Close;
+        if (!send(cmd)) {
+            return false;
+        }
+        _pending_close = false;
+    }
+    return true;
+}
+
+void ThumbnailCache::drop_results()
+{
+    Result_t r;
+    while (_result_queue && xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        delete[] r.pixels;
+    }
+}
+
+// Out of line, Folder_t of the pending open is only complete here
+ThumbnailCache::ThumbnailCache()  = default;
+ThumbnailCache::~ThumbnailCache() = default;
+
+void ThumbnailCache::openFolder(const std::string& dir, std::vector<std::string> names, bool complete)
+{
+    if (!start()) {
+        return;
+    }
+    drop_results();
+
+    _generation++;
+    _item_count    = static_cast<int>(names.size());
+    _visible_first = 0;
+    _visible_count = 0;
+    _slots.resize(kSlotCount);
+    for (auto& slot : _slots) {
+        slot.index = -1;
+    }
+    _requested.assign(names.size(), 0);
+
+    // Replaces an open or close still waiting for room in the queue
+    _pending_close = false;
+    _pending_open.reset(new (std::nothrow) Folder_t{dir, std::move(names), complete});
+    if (!_pending_open) {
+        _item_count = 0;
+        return;
+    }
+    send_pending();
+}
+
+void ThumbnailCache::closeFolder()
+{
+    if (!_task) {
+        return;
+    }
+    _generation++;
+    _item_count = 0;
+    _slots.clear();
+    _slots.shrink_to_fit();
+    _requested.clear();
+    drop_results();
+
+    _pending_open.reset();
+    _pending_close = true;
+    send_pending();
+}
+
+void ThumbnailCache::setVisible(int first, int count)
+{
+    // Requests sent before the open would be taken for the previous folder's
+    if (!_task || _item_count == 0 || !send_pending()) {
+        return;
+    }
+    first = std::max(0, first);
+    count = std::min({count, _item_count - first, static_cast<int>(kSlotCount)});
+    if (count <= 0) {
+        return;
+    }
+    _visible_first = first;
+    _visible_count = count;
+
+    Command_t cmd;
+    cmd.type       = CommandType::Visible;
+    cmd.generation = _generation;
+    for (int i = first; i < first + count; ++i) {
+        if (!_requested[i]) {
+            _requested[i]                   = 1;
+            cmd.indices[cmd.index_count++] = static_cast<int16_t>(i);
+        }
+    }
+    if (cmd.index_count > 0 && !send(cmd)) {
+        // Asked again on the next draw
+        for (uint8_t i = 0; i < cmd.index_count; ++i) {
+            _requested[cmd.indices[i]] = 0;
+        }
+    }
+}
+
+const uint16_t* ThumbnailCache::get(int index) const
+{
+    for (const auto& slot : _slots) {
+        if (slot.index == index) {
+            return slot.pixels.get();
+        }
+    }
+    return nullptr;
+}
+
+ThumbnailCache::Slot_t& ThumbnailCache::take_slot()
+{
+    // Least recently filled slot outside the visible page
+    Slot_t* victim = nullptr;
+    for (auto& slot : _slots) {
+        if (slot.index < 0) {
+            return slot;
+        }
+        const bool visible = slot.index >= _visible_first && slot.index < _visible_first + _visible_count;
+        if (!visible && (!victim || slot.last_used < victim->last_used)) {
+            victim = &slot;
+        }
+    }
+    if (!victim) {
+        victim = &_slots.front();
+    }
+    _requested[victim->index] = 0;
+    return *victim;
+}
+
+bool ThumbnailCache::poll()
+{
+    if (!_result_queue) {
+        return false;
+    }
+    // Once the open went through the page can be asked for
+    const bool had_open = _pending_open != nullptr;
+    bool changed        = send_pending() && had_open;
+    Result_t r;
+    while (xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        if (r.generation != _generation || r.index < 0 || r.index >= _item_count) {
+            delete[] r.pixels;
+            continue;
+        }
+        // A result asked again after a drop may still have its slot
+        auto it    = std::find_if(_slots.begin(), _slots.end(), [&](const Slot_t& s) { return s.index == r.index; });
+        auto& slot = it != _slots.end() ? *it : take_slot();
+        slot.index     = r.index;
+        slot.last_used = ++_use_tick;
+        slot.pixels.reset(r.pixels);
+        if (r.index >= _visible_first && r.index < _visible_first + _visible_count) {
+            changed = true;
+        }
+    }
+    if (_results_dropped.exchange(false)) {
+        changed = rerequest_dropped() || changed;
+    }
+    return changed;
+}
+
+bool ThumbnailCache::rerequest_dropped()
+{
+    // Which results were lost isn't known, everything asked for and not held is asked again on the next draw
+    bool cleared = false;
+    for (size_t i = 0; i < _requested.size(); ++i) {
+        if (_requested[i] && !get(static_cast<int>(i))) {
+            _requested[i] = 0;
+            cleared       = true;
+        }
+    }
+    return cleared;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Worker task                                */
+/* -------------------------------------------------------------------------- */
+void ThumbnailCache::task_main(void* arg)
+{
+    auto* self = static_cast<ThumbnailCache*>(arg);
+    Worker worker;
+    uint32_t generation = 0;
+
+    auto post = [&](int index, uint16_t* pixels) {
+        Result_t r;
+        r.generation = generation;
+        r.index      = index;
+        r.pixels     = pixels;
+        // The UI may have stopped polling, don't wait on it forever
+        if (xQueueSend(self->_result_queue, &r, pdMS_TO_TICKS(100)) != pdTRUE) {
+            delete[] pixels;
+            self->_results_dropped.store(true);
+        }
+    };
+
+    while (true) {
+        Command_t cmd;
+        const TickType_t wait = worker.hasWork() ? 0 : portMAX_DELAY;
+        if (xQueueReceive(self->_cmd_queue, &cmd, wait) == pdTRUE) {
+            switch (cmd.type) {
+                case CommandType::Open:
+                    generation = cmd.generation;
+                    worker.open(std::move(cmd.folder->dir), std::move(cmd.folder->names), cmd.folder->complete,
+                                generation);
+                    delete cmd.folder;
+                    break;
+                case CommandType::Visible:
+                    if (cmd.generation == generation) {
+                        worker.request(cmd.indices, cmd.index_count);
+                    }
+                    break;
+                case CommandType::Close:
+                    generation = cmd.generation;
+                    worker.close();
+                    break;
+            }
+            continue;
+        }
+        worker.step(post);
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Thumbnails of one folder, backed by a packed cache file inside that folder
+ *
+ * The blob file is [blob 0] ... [blob n-1], kThumbW x kThumbH RGB565 in display byte order. The index file next to it is
+ * [n x Record_t] [Footer_t], keying the blobs by name hash, size and mtime. Since thumbnails are generated in browse
+ * order a page of them is one contiguous read, and the index is a single read. New thumbnails are only ever appended to
+ * the blob file. On commit the blobs are synced first, then the index is written to a temporary file, footer last, and
+ * renamed over the old one, so a crash at any point leaves an index that only names blobs already on the card. Size and
+ * mtime are only stat()ed for the images actually loaded or generated, in a large folder on FAT every stat() is a scan
+ * of the directory.
+ *
+ * A worker task owns the file and does all decoding. The UI side only holds the thumbnails around the visible page.
+ */
+class ThumbnailCache {
+public:
+    static constexpr int kThumbW           = 44;
+    static constexpr int kThumbH           = 33;
+    static constexpr size_t kThumbBytes    = kThumbW * kThumbH * 2;
+    static constexpr size_t kSlotCount     = 20;
+    static constexpr const char* kFileName      = ".thumbs";
+    static constexpr const char* kIndexFileName = ".thumbs.idx";
+
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    /**
+     * Start loading / generating thumbnails for the named images of dir, drops the work queued for the previous folder.
+     * complete is false when names is only a window of a larger folder, then cached thumbnails of files missing from it
+     * are never taken for stale
+     */
+    void openFolder(const std::string& dir, std::vector<std::string> names, bool complete);
+
+    /** Write back the index of the open folder and release the UI side buffers */
+    void closeFolder();
+
+    /** Items [first, first + count) are on screen, anything missing there is loaded or generated first */
+    void setVisible(int first, int count);
+
+    /** Pixels of item index, nullptr until they arrive */
+    const uint16_t* get(int index) const;
+
+    /** Take finished thumbnails from the worker and retry commands the queue had no room for, true if a redraw is due */
+    bool poll();
+
+private:
+    enum class CommandType : uint8_t {
+        Open = 0,
+        Visible,
+        Close,
+    };
+
+    struct Folder_t;
+
+    struct Command_t {
+        CommandType type    = CommandType::Open;
+        uint32_t generation = 0;
+        Folder_t* folder    = nullptr;
+        uint8_t index_count = 0;
+        int16_t indices[kSlotCount];
+    };
+
+    struct Result_t {
+        uint32_t generation = 0;
+        int index           = -1;
+        uint16_t* pixels    = nullptr;
+    };
+
+    struct Slot_t {
+        int index          = -1;
+        uint32_t last_used = 0;
+        std::unique_ptr<uint16_t[]> pixels;
+    };
+
+    QueueHandle_t _cmd_queue    = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    TaskHandle_t _task          = nullptr;
+
+    uint32_t _generation = 0;
+    int _item_count      = 0;
+    int _visible_first   = 0;
+    int _visible_count   = 0;
+    uint32_t _use_tick   = 0;
+    std::vector<Slot_t> _slots;
+    std::vector<uint8_t> _requested;
+    // Never waited for on the UI loop, an open or close that didn't fit in the queue is sent again from poll()
+    std::unique_ptr<Folder_t> _pending_open;
+    bool _pending_close = false;
+    // Set by the worker when a result found the queue full and was dropped
+    std::atomic<bool> _results_dropped{false};
+
+    bool start();
+    bool send(const Command_t& cmd);
+    bool send_pending();
+    void drop_results();
+    Slot_t& take_slot();
+    bool rerequest_dropped();
+
+    static void task_main(void* arg);
+};
@@ -0,0 +1,438 @@
+#include "sd_bench_app.h"
+#include <hal.h>
+#include <mooncake_log.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+const std::string kTag = "SdBench";
+
+constexpr const char* kTestFile = "/sdbench.tmp";
+constexpr int kRowH = 14;
+constexpr int kListY = 16;
+constexpr int kVisibleRows = 6;
+
+const char* short_name(sdbench::Pattern pattern)
+{
+    switch (pattern) {
+        case sdbench::Pattern::SeqWrite:
+            return "SW";
+        case sdbench::Pattern::SeqRead:
+            return "SR";
+        case sdbench::Pattern::RandWrite:
+            return "RW";
+        case sdbench::Pattern::RandRead:
+            return "RR";
+        default:
+            return "?";
+    }
+}
+
+/** 512, 4K, 64K, 1M */
+void format_size(char* out, size_t out_size, size_t bytes)
+{
+    if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0) {
+        std::snprintf(out, out_size, "%uM", static_cast<unsigned>(bytes / (1024 * 1024)));
+    } else if (bytes >= 1024 && bytes % 1024 == 0) {
+        std::snprintf(out, out_size, "%uK", static_cast<unsigned>(bytes / 1024));
+    } else {
+        std::snprintf(out, out_size, "%u", static_cast<unsigned>(bytes));
+    }
+}
+
+}  // namespace
+
+SdBenchApp::SdBenchApp()
+{
+    setAppInfo().name = "SD Bench";
+}
+
+void SdBenchApp::onOpen()
+{
+    _generation++;
+    _running = false;
+    _scroll = 0;
+    _results.clear();
+    _mounted = GetHAL().isSdCardMounted();
+    _freq_khz = GetHAL().getSdCardFrequency();
+    _cluster_bytes = 0;
+    _needs_redraw = true;
+    hookKeyboard();
+    hookSdCard();
+    post(CommandType::Query);
+}
+
+void SdBenchApp::onRunning()
+{
+    if (GetHAL().homeButton.wasPressed()) {
+        openDesktopAndCloseSelf();
+        return;
+    }
+    if (drainResults()) {
+        _needs_redraw = true;
+    }
+    if (_needs_redraw) {
+        _needs_redraw = false;
+        draw();
+    }
+}
+
+void SdBenchApp::onClose()
+{
+    // The worker stops at the next operation and its results are dropped by generation
+    stopRun();
+    _generation++;
+    unhookKeyboard();
+    unhookSdCard();
+}
+
+/* ---- Worker task ---- */
+
+bool SdBenchApp::startTask()
+{
+    if (_task) {
+        return true;
+    }
+    _cmd_queue = xQueueCreate(2, sizeof(Command_t));
+    _result_queue = xQueueCreate(8, sizeof(Result_t));
+    if (!_cmd_queue || !_result_queue) {
+        mclog::tagError(kTag, "create queues failed");
+        return false;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(taskMain, "sdbench", 8192, this, 2, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(kTag, "create task failed");
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void SdBenchApp::taskMain(void* arg)
+{
+    auto* self = static_cast<SdBenchApp*>(arg);
+
+    while (true) {
+        Command_t cmd;
+        if (xQueueReceive(self->_cmd_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        const auto post = [&](Result_t& r) {
+            r.generation = cmd.generation;
+            xQueueSend(self->_result_queue, &r, portMAX_DELAY);
+        };
+
+        // Every command reports the card state first
+        Result_t info;
+        info.type = ResultType::Info;
+        if (cmd.type == CommandType::SetFrequency) {
+            GetHAL().setSdCardFrequency(cmd.freq_khz);
+        }
+        info.mounted = GetHAL().isSdCardMounted();
+        info.freq_khz = GetHAL().getSdCardFrequency();
+        info.cluster_bytes = GetHAL().getSdCardClusterSize();
+        post(info);
+
+        if (cmd.type == CommandType::Run && info.mounted) {
+            sdbench::Config_t config;
+            config.path = std::string(GetHAL().getSdCardMountPoint()) + kTestFile;
+            for (const auto& c : sdbench::defaultCases(cmd.span_sweep)) {
+                if (self->_stop.load()) {
+                    break;
+                }
+                config.block_bytes = c.block_bytes;
+                config.span_bytes = c.span_bytes;
+
+                Result_t r;
+                r.type = ResultType::Case;
+                sdbench::run(config, c.pattern, r.result, &self->_stop);
+                if (r.result.cancelled) {
+                    break;
+                }
+                post(r);
+            }
+            std::remove(config.path.c_str());
+        }
+
+        Result_t done;
+        done.type = ResultType::Done;
+        post(done);
+    }
+}
+
+/* ---- UI side ---- */
+
+void SdBenchApp::post(CommandType type)
+{
+    if (_busy || !startTask()) {
+        return;
+    }
+    Command_t cmd;
+    cmd.type = type;
+    cmd.generation = _generation;
+    cmd.freq_khz = kFrequencies[_freq_index];
+    cmd.span_sweep = _span_sweep;
+    if (xQueueSend(_cmd_queue, &cmd, 0) == pdTRUE) {
+        _busy = true;
+    }
+}
+
+void SdBenchApp::startRun()
+{
+    if (_busy || !GetHAL().isSdCardMounted()) {
+        return;
+    }
+    _stop.store(false);
+    _results.clear();
+    _scroll = 0;
+    _case_count = sdbench::defaultCases(_span_sweep).size();
+    post(CommandType::Run);
+    _running = _busy;
+    if (_running) {
+        std::printf("SD bench at %u kHz\r\n", static_cast<unsigned>(_freq_khz));
+        sdbench::writeCsvHeader(stdout);
+    }
+    _needs_redraw = true;
+}
+
+void SdBenchApp::stopRun()
+{
+    if (_running) {
+        _stop.store(true);
+    }
+}
+
+void SdBenchApp::cycleFrequency()
+{
+    if (_busy) {
+        return;
+    }
+    _freq_index = (_freq_index + 1) % (sizeof(kFrequencies) / sizeof(kFrequencies[0]));
+    post(CommandType::SetFrequency);
+    _needs_redraw = true;
+}
+
+void SdBenchApp::scroll(int delta)
+{
+    const int max_top = std::max(0, static_cast<int>(_results.size()) - kVisibleRows);
+    _scroll = std::clamp(_scroll + delta, 0, max_top);
+    _needs_redraw = true;
+}
+
+bool SdBenchApp::drainResults()
+{
+    if (!_result_queue) {
+        return false;
+    }
+    bool changed = false;
+    Result_t r;
+    while (xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        // The worker takes one command at a time, whichever generation it was for
+        if (r.type == ResultType::Done) {
+            _busy = false;
+        }
+        if (r.generation != _generation) {
+            continue;
+        }
+        switch (r.type) {
+            case ResultType::Info:
+                _mounted = r.mounted;
+                _freq_khz = r.freq_khz;
+                _cluster_bytes = r.cluster_bytes;
+                break;
+            case ResultType::Case: {
+                char label[16];
+                std::snprintf(label, sizeof(label), "%ukHz", static_cast<unsigned>(_freq_khz));
+                sdbench::writeCsv(stdout, label, r.result);
+                // Follow the newest result unless scrolled back
+                const bool at_bottom = static_cast<int>(_results.size()) - _scroll <= kVisibleRows;
+                _results.push_back(r.result);
+                if (at_bottom) {
+                    _scroll = std::max(0, static_cast<int>(_results.size()) - kVisibleRows);
+                }
+                break;
+            }
+            case ResultType::Done:
+                _running = false;
+                break;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+void SdBenchApp::draw()
+{
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "SD Bench");
+    auto& canvas = GetHAL().canvas;
+    const uint16_t bg = lgfx::color565(0x22, 0x22, 0x22);
+    const uint16_t fg = lgfx::color565(0xEE, 0xEE, 0xEE);
+    const uint16_t dim = lgfx::color565(0x88, 0x88, 0x88);
+    const uint16_t accent = lgfx::color565(0xFF, 0x8D, 0x1A);
+
+    canvas.fillScreen(bg);
+    canvas.setFont(&fonts::efontCN_12);
+    canvas.setTextSize(1);
+    canvas.setTextDatum(textdatum_t::top_left);
+
+    char line[64];
+    char cluster[8];
+    format_size(cluster, sizeof(cluster), _cluster_bytes);
+    if (_freq_khz > 0) {
+        std::snprintf(line, sizeof(line), "SD Bench  %.1fMHz  clu %s", _freq_khz / 1000.0f,
+                      _cluster_bytes ? cluster : "-");
+    } else {
+        std::snprintf(line, sizeof(line), "SD Bench  clu %s", _cluster_bytes ? cluster : "-");
+    }
+    canvas.setTextColor(fg);
+    canvas.drawString(line, 4, 0);
+    if (_running) {
+        std::snprintf(line, sizeof(line), "%u/%u", static_cast<unsigned>(_results.size() + 1),
+                      static_cast<unsigned>(_case_count));
+        canvas.setTextColor(accent);
+        canvas.setTextDatum(textdatum_t::top_right);
+        canvas.drawString(line, canvas.width() - 4, 0);
+        canvas.setTextDatum(textdatum_t::top_left);
+    }
+
+    if (!_mounted) {
+        canvas.setTextColor(fg);
+        canvas.setTextDatum(textdatum_t::middle_center);
+        canvas.drawString("SD card not mounted", canvas.width() / 2, canvas.height() / 2);
+        GetHAL().pushAppCanvas();
+        return;
+    }
+
+    if (_results.empty()) {
+        canvas.setTextColor(dim);
+        canvas.drawString(_busy ? "Working..." : "Enter to run the benchmark", 4, kListY);
+    }
+    for (int i = 0; i < kVisibleRows; ++i) {
+        const int idx = _scroll + i;
+        if (idx >= static_cast<int>(_results.size())) {
+            break;
+        }
+        const auto& r = _results[idx];
+        char block[8];
+        char span[12] = "";
+        format_size(block, sizeof(block), r.block_bytes);
+        if (r.span_bytes > 0) {
+            span[0] = '@';
+            format_size(span + 1, sizeof(span) - 1, r.span_bytes);
+        }
+        if (r.ok) {
+            std::snprintf(line, sizeof(line), "%s %s%s  %.2fMB/s  %.0f IOPS  p99 %.1fms", short_name(r.pattern), block,
+                          span, r.mbPerSec(), r.iops(), r.lat_p99_us / 1000.0f);
+        } else {
+            std::snprintf(line, sizeof(line), "%s %s%s  failed (errno %d)", short_name(r.pattern), block, span,
+                          r.error);
+        }
+        canvas.setTextColor(r.ok ? fg : TFT_RED);
+        canvas.drawString(line, 4, kListY + i * kRowH);
+    }
+
+    std::snprintf(line, sizeof(line), "Ent:%s F:Clock S:Span%s ;.:Scroll", _running ? "Stop" : "Run",
+                  _span_sweep ? "*" : "");
+    canvas.setTextColor(dim);
+    canvas.setTextDatum(textdatum_t::bottom_left);
+    canvas.drawString(line, 4, canvas.height() - 1);
+
+    GetHAL().pushAppCanvas();
+}
+
+void SdBenchApp::hookKeyboard()
+{
+    if (_keyboard_slot_id != 0) {
+        return;
+    }
+
+    _keyboard_slot_id = GetHAL().keyboard.onKeyEvent.connect([this](const Keyboard::KeyEvent_t& e) {
+        if (!e.state) {
+            return;
+        }
+
+        if (e.keyCode == KEY_ESC || e.keyCode == KEY_GRAVE || e.keyCode == KEY_BACKSPACE) {
+            openDesktopAndCloseSelf();
+            return;
+        }
+        if (e.keyCode == KEY_ENTER || e.keyCode == KEY_SPACE) {
+            if (_running) {
+                stopRun();
+            } else {
+                startRun();
+            }
+            return;
+        }
+        if (e.keyCode == KEY_F) {
+            cycleFrequency();
+            return;
+        }
+        if (e.keyCode == KEY_S && !_running) {
+            _span_sweep = !_span_sweep;
+            _needs_redraw = true;
+            return;
+        }
+        if (e.keyCode == KEY_SEMICOLON || e.keyCode == KEY_UP) {
+            scroll(-1);
+            return;
+        }
+        if (e.keyCode == KEY_DOT || e.keyCode == KEY_DOWN) {
+            scroll(1);
+            return;
+        }
+    });
+}
+
+void SdBenchApp::unhookKeyboard()
+{
+    if (_keyboard_slot_id == 0) {
+        return;
+    }
+    GetHAL().keyboard.onKeyEvent.disconnect(_keyboard_slot_id);
+    _keyboard_slot_id = 0;
+}
+
+void SdBenchApp::hookSdCard()
+{
+    if (_sd_card_slot_id != 0) {
+        return;
+    }
+    // A run in progress fails on its own, otherwise ask the worker for the new card's clock and cluster size
+    _sd_card_slot_id = GetHAL().onSdCardEvent.connect([this](const Hal::SdCardEvent_t& e) {
+        _mounted = e.mounted;
+        _needs_redraw = true;
+        post(CommandType::Query);
+    });
+}
+
+void SdBenchApp::unhookSdCard()
+{
+    if (_sd_card_slot_id == 0) {
+        return;
+    }
+    GetHAL().onSdCardEvent.disconnect(_sd_card_slot_id);
+    _sd_card_slot_id = 0;
+}
+
+void SdBenchApp::openDesktopAndCloseSelf()
+{
+    auto& mc = mooncake::GetMooncake();
+    auto* app_mgr = mc.getAppAbilityManager();
+    const auto app_instances = app_mgr ? app_mgr->getAllAbilityInstance() : std::vector<mooncake::AbilityBase*>{};
+
+    for (auto* app : app_instances) {
+        if (app == nullptr) {
+            continue;
+        }
+        const int id = app->getId();
+        const auto info = mc.getAppInfo(id);
+        if (info.name == "Desktop") {
+            mc.openApp(id);
+            break;
+        }
+    }
+    mc.closeApp(getId());
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <mooncake.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "utils/fs/sd_bench.h"
+
+/**
+ * SD card benchmark
+ *
+ * Runs the sdbench suite on a worker task and lists the results as they come in. The SPI clock can be changed between
+ * runs, which remounts the card, and the random write span sweep added to compare how writes spread over more of the
+ * card's allocation units behave. Every result is also printed as CSV over the serial console.
+ */
+class SdBenchApp : public mooncake::AppAbility {
+public:
+    SdBenchApp();
+
+    void onOpen() override;
+    void onRunning() override;
+    void onClose() override;
+
+private:
+    enum class CommandType : uint8_t {
+        Query = 0,
+        Run,
+        SetFrequency,
+    };
+
+    enum class ResultType : uint8_t {
+        Info = 0,
+        Case,
+        Done,
+    };
+
+    struct Command_t {
+        CommandType type = CommandType::Query;
+        uint32_t generation = 0;
+        uint32_t freq_khz = 0;
+        bool span_sweep = false;
+    };
+
+    struct Result_t {
+        ResultType type = ResultType::Info;
+        uint32_t generation = 0;
+        bool mounted = false;
+        uint32_t freq_khz = 0;
+        uint32_t cluster_bytes = 0;
+        sdbench::Result_t result;
+    };
+
+    static constexpr uint32_t kFrequencies[] = {4000, 10000, 20000, 40000};
+
+    QueueHandle_t _cmd_queue = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    TaskHandle_t _task = nullptr;
+    std::atomic<bool> _stop{false};
+    uint32_t _generation = 0;
+
+    size_t _keyboard_slot_id = 0;
+    size_t _sd_card_slot_id = 0;
+    bool _needs_redraw = true;
+    bool _running = false;
+    bool _busy = false;
+    bool _span_sweep = false;
+    size_t _freq_index = 3;
+    size_t _case_count = 0;
+    int _scroll = 0;
+
+    bool _mounted = false;
+    uint32_t _freq_khz = 0;
+    uint32_t _cluster_bytes = 0;
+    std::vector<sdbench::Result_t> _results;
+
+    bool startTask();
+    void post(CommandType type);
+    void startRun();
+    void stopRun();
+    void cycleFrequency();
+    void scroll(int delta);
+    bool drainResults();
+
+    void draw();
+    void hookKeyboard();
+    void unhookKeyboard();
+    void hookSdCard();
+    void unhookSdCard();
+    void openDesktopAndCloseSelf();
+
+    static void taskMain(void* arg);
+};
@@ -0,0 +1,505 @@
+#include "sound_meter_app.h"
+#include <hal.h>
+#include <mooncake_log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "utils/audio/pcm.h"
+#include "utils/audio/audio_mixer.h"
+#include "utils/fs/io_service.h"
+
+namespace {
+
+const std::string kTag = "SoundMeter";
+
+// Mic frames per read, under a block at any mixer rate so a read finishes one block at most
+constexpr size_t kChunkFrames = 256;
+
+// Window and log interval, seconds
+constexpr uint16_t kIntervals[] = {1, 5, 10, 30, 60};
+constexpr int kIntervalCount = sizeof(kIntervals) / sizeof(kIntervals[0]);
+constexpr int kDefaultInterval = 2;
+
+constexpr float kCalStepDb = 0.5f;
+constexpr float kMaxCalDb = 140.0f;
+
+// Scale of the level bar, dB over the calibration
+constexpr float kBarLowDb = -90.0f;
+constexpr float kBarHighDb = 0.0f;
+
+constexpr const char* kLogDir = "/sound_meter";
+
+uint32_t blocksOf(int interval)
+{
+    return kIntervals[interval] * 1000 / slm::kBlockMs;
+}
+
+}  // namespace
+
+SoundMeterApp::SoundMeterApp()
+{
+    setAppInfo().name = "Sound Meter";
+    _interval.store(kDefaultInterval);
+}
+
+void SoundMeterApp::onOpen()
+{
+    mclog::tagInfo(kTag, "onOpen");
+    _has_levels = false;
+    _needs_redraw = true;
+
+    _mic_ok = GetHAL().mixer.isRunning();
+    if (!_mic_ok) {
+        mclog::tagError(kTag, "mixer not running");
+    } else {
+        _mic_ok = startTask();
+    }
+    hookKeyboard();
+    hookSdCard();
+    draw();
+}
+
+void SoundMeterApp::onRunning()
+{
+    if (GetHAL().homeButton.wasPressed()) {
+        openDesktopAndCloseSelf();
+        return;
+    }
+
+    drainResults();
+    if (_needs_redraw) {
+        _needs_redraw = false;
+        draw();
+    }
+}
+
+void SoundMeterApp::onClose()
+{
+    mclog::tagInfo(kTag, "onClose");
+    stopLog();
+    stopTask();
+    unhookKeyboard();
+    unhookSdCard();
+}
+
+/* ---- Meter task ---- */
+
+bool SoundMeterApp::startTask()
+{
+    if (_task != nullptr) {
+        return true;
+    }
+
+    slm::Meter::Config_t config;
+    config.sample_rate = static_cast<float>(GetHAL().mixer.sampleRate());
+    config.window_s = kIntervals[_interval.load()];
+    config.max_window_s = kIntervals[kIntervalCount - 1];
+    if (!_meter.init(config)) {
+        mclog::tagError(kTag, "create meter failed");
+        return false;
+    }
+    // Two seconds of blocks, the UI only falls that far behind while something else holds the loop
+    _result_queue = xQueueCreate(16, sizeof(Result_t));
+    if (_result_queue == nullptr) {
+        mclog::tagError(kTag, "create result queue failed");
+        _meter.deinit();
+        return false;
+    }
+
+    _task_running.store(true);
+    _task_done.store(false);
+    BaseType_t ok = xTaskCreatePinnedToCore(SoundMeterApp::taskMain, "sound_meter", 4096, this, 4, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(kTag, "create task failed");
+        _task = nullptr;
+        _task_done.store(true);
+        stopTask();
+        return false;
+    }
+    return true;
+}
+
+void SoundMeterApp::stopTask()
+{
+    _task_running.store(false);
+    while (!_task_done.load(std::memory_order_acquire)) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+    _task = nullptr;
+    if (_result_queue != nullptr) {
+        vQueueDelete(_result_queue);
+        _result_queue = nullptr;
+    }
+    _meter.deinit();
+}
+
+void SoundMeterApp::taskMain(void* arg)
+{
+    auto* app = static_cast<SoundMeterApp*>(arg);
+    mclog::tagInfo(kTag, "meter task start");
+
+    alignas(pcm::kAlign) static int16_t buf[kChunkFrames * 2];
+    alignas(pcm::kAlign) static int16_t mono[kChunkFrames];
+    static float x[kChunkFrames];
+    uint8_t generation = app->_window_gen.load();
+    int interval = app->_interval.load();
+    uint32_t block = 0;
+
+    while (app->_task_running.load()) {
+        // A new interval, or the log starting, begins the window afresh
+        if (app->_window_gen.load() != generation) {
+            generation = app->_window_gen.load();
+            interval = app->_interval.load();
+            app->_meter.setWindow(kIntervals[interval]);
+            block = 0;
+        }
+
+        const size_t got = GetHAL().micRead(buf, kChunkFrames, 100);
+        if (got == 0) {
+            continue;
+        }
+        pcm::stereoToMono(mono, buf, got);
+        pcm::toFloat(x, mono, got);
+        if (!app->_meter.process(x, got)) {
+            continue;
+        }
+
+        Result_t r;
+        r.levels = app->_meter.levels();
+        r.block = ++block;
+        r.interval_end = block % blocksOf(interval) == 0;
+        r.generation = generation;
+        if (xQueueSend(app->_result_queue, &r, 0) != pdTRUE) {
+            Result_t dropped;
+            xQueueReceive(app->_result_queue, &dropped, 0);
+            xQueueSend(app->_result_queue, &r, 0);
+        }
+    }
+
+    mclog::tagInfo(kTag, "meter task stop");
+    app->_task_done.store(true, std::memory_order_release);
+    vTaskDelete(nullptr);
+}
+
+/* ---- UI side ---- */
+
+void SoundMeterApp::drainResults()
+{
+    if (_result_queue == nullptr) {
+        return;
+    }
+    Result_t r;
+    while (xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        // Blocks of a window that was started over since are stale
+        if (r.generation != _window_gen.load()) {
+            continue;
+        }
+        _shown = r;
+        _has_levels = true;
+        _needs_redraw = true;
+        if (_logging && r.interval_end) {
+            appendLog(r);
+        }
+    }
+}
+
+void SoundMeterApp::selectInterval(int index)
+{
+    _interval.store(static_cast<uint8_t>((index + kIntervalCount) % kIntervalCount));
+    _window_gen.fetch_add(1);
+    _has_levels = false;
+    _needs_redraw = true;
+}
+
+void SoundMeterApp::startLog()
+{
+    if (_logging || _task == nullptr || _log_name_request != 0) {
+        return;
+    }
+    if (!GetHAL().isSdCardMounted()) {
+        mclog::tagWarn(kTag, "log: no SD card");
+        return;
+    }
+
+    // Same as the loopback recordings, the folder and a free name come from the IoService worker
+    const std::string dir = std::string(GetHAL().getSdCardMountPoint()) + kLogDir;
+    _log_name_request = GetIoService().newFileName(
+        dir, "slm_%04d.csv", IoService::Priority::Normal, [this](IoService::Result_t& result) {
+            _log_name_request = 0;
+            if (!result.ok) {
+                mclog::tagError(kTag, "log: no free name in {}: {}", result.path, result.error);
+                return;
+            }
+            beginLog(result.path);
+        });
+}
+
+void SoundMeterApp::beginLog(const std::string& path)
+{
+    if (_logging || _task == nullptr) {
+        return;
+    }
+
+    char header[160];
+    std::snprintf(header, sizeof(header),
+                  "# Sound Meter, %u Hz, calibration %+.1f dB, levels in dB over the interval ending at t_s\n"
+                  "t_s,interval_s,LAeq,LAFmax,LZpeak,LA10,LA50,LA90,voice_pct\n",
+                  static_cast<unsigned>(GetHAL().mixer.sampleRate()), static_cast<double>(_cal_db));
+    _log_path = path;
+    _log_pending = header;
+    _log_lines = 0;
+    _log_blocks = 0;
+    _log_error = 0;
+    _logging = true;
+    // The first line covers the first interval after this, not what came before
+    _window_gen.fetch_add(1);
+    _has_levels = false;
+    flushLog();
+    mclog::tagInfo(kTag, "log: {} every {} s", _log_path, kIntervals[_interval.load()]);
+    _needs_redraw = true;
+}
+
+void SoundMeterApp::stopLog()
+{
+    // A log still waiting for its name never opens
+    GetIoService().cancel(_log_name_request);
+    _log_name_request = 0;
+    if (!_logging) {
+        return;
+    }
+    _logging = false;
+    // What is still queued goes out without waiting for the one in flight, appends run in order
+    if (!_log_pending.empty()) {
+        GetIoService().appendFile(_log_path, std::move(_log_pending), IoService::Priority::Normal, nullptr);
+        _log_pending.clear();
+    }
+    GetIoService().cancel(_log_request);
+    _log_request = 0;
+    mclog::tagInfo(kTag, "log: {} closed, {} lines", _log_path, _log_lines);
+    _needs_redraw = true;
+}
+
+void SoundMeterApp::appendLog(const Result_t& r)
+{
+    const auto& l = r.levels;
+    const int interval = _interval.load();
+    _log_blocks += blocksOf(interval);
+    char line[128];
+    std::snprintf(line, sizeof(line), "%.3f,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f\n",
+                  _log_blocks * slm::kBlockMs / 1000.0, static_cast<unsigned>(kIntervals[interval]),
+                  static_cast<double>(l.leq + _cal_db), static_cast<double>(l.lmax + _cal_db),
+                  static_cast<double>(l.peak + _cal_db), static_cast<double>(l.l10 + _cal_db),
+                  static_cast<double>(l.l50 + _cal_db), static_cast<double>(l.l90 + _cal_db),
+                  static_cast<double>(l.voice * 100.0f));
+    _log_pending += line;
+    ++_log_lines;
+    flushLog();
+}
+
+void SoundMeterApp::flushLog()
+{
+    if (_log_pending.empty() || GetIoService().isPending(_log_request)) {
+        return;
+    }
+    _log_request = GetIoService().appendFile(
+        _log_path, std::move(_log_pending), IoService::Priority::Normal, [this](IoService::Result_t& result) {
+            _log_request = 0;
+            if (!result.ok && _log_error == 0) {
+                _log_error = result.error;
+                mclog::tagError(kTag, "log: append to {} failed: {}", result.path, result.error);
+                _needs_redraw = true;
+            }
+            flushLog();
+        });
+    _log_pending.clear();
+}
+
+void SoundMeterApp::draw()
+{
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "SoundMeter");
+    auto& canvas = GetHAL().canvas;
+    const uint16_t bg = lgfx::color565(0x22, 0x22, 0x22);
+    const uint16_t fg = lgfx::color565(0xEE, 0xEE, 0xEE);
+    const uint16_t dim = lgfx::color565(0x88, 0x88, 0x88);
+    const uint16_t accent = lgfx::color565(0xFF, 0x8D, 0x1A);
+    const uint16_t good = lgfx::color565(0x3C, 0xD0, 0x70);
+    const uint16_t bad = lgfx::color565(0xE0, 0x40, 0x40);
+
+    canvas.fillScreen(bg);
+    canvas.setFont(&fonts::efontCN_12);
+    canvas.setTextSize(1);
+    canvas.setTextColor(fg);
+    canvas.setTextDatum(textdatum_t::top_left);
+
+    char line[96];
+    const int interval = _interval.load();
+    std::snprintf(line, sizeof(line), "Sound Meter  %us  Cal:%+.1fdB", static_cast<unsigned>(kIntervals[interval]),
+                  static_cast<double>(_cal_db));
+    canvas.drawString(line, 6, 0);
+    if (_logging) {
+        canvas.setTextDatum(textdatum_t::top_right);
+        canvas.setTextColor(_log_error != 0 ? bad : accent);
+        if (_log_error != 0) {
+            std::snprintf(line, sizeof(line), "LOG ERR %d", _log_error);
+        } else {
+            std::snprintf(line, sizeof(line), "LOG %u", static_cast<unsigned>(_log_lines));
+        }
+        canvas.drawString(line, canvas.width() - 6, 0);
+        canvas.setTextDatum(textdatum_t::top_left);
+    }
+
+    if (!_mic_ok) {
+        canvas.setTextColor(fg);
+        canvas.setTextDatum(textdatum_t::middle_center);
+        canvas.drawString("Mic not available", canvas.width() / 2, canvas.height() / 2);
+        GetHAL().pushAppCanvas();
+        return;
+    }
+
+    const auto& l = _shown.levels;
+    const auto show = [this](float db) { return db + _cal_db; };
+
+    // LAF, big, with the voice indicator next to it
+    canvas.setTextColor(fg);
+    canvas.setTextSize(3);
+    if (_has_levels) {
+        std::snprintf(line, sizeof(line), "%.1f", static_cast<double>(show(l.laf)));
+    } else {
+        std::snprintf(line, sizeof(line), "--.-");
+    }
+    canvas.drawString(line, 6, 16);
+    canvas.setTextSize(1);
+    canvas.drawString("dB(A) F", 150, 20);
+    canvas.setTextColor(_has_levels && l.speaking ? good : dim);
+    canvas.drawString("VOICE", 150, 36);
+
+    // Bar of LAF over the calibrated scale, LAFmax and Leq of the window as ticks
+    const int bar_x = 6;
+    const int bar_y = 56;
+    const int bar_w = canvas.width() - 12;
+    const auto bar_at = [&](float db) {
+        const float t = (show(db) - kBarLowDb) / (kBarHighDb - kBarLowDb);
+        return bar_x + static_cast<int>(std::clamp(t, 0.0f, 1.0f) * bar_w);
+    };
+    canvas.drawRect(bar_x, bar_y, bar_w, 8, dim);
+    if (_has_levels) {
+        canvas.fillRect(bar_x + 1, bar_y + 1, bar_at(l.laf) - bar_x, 6, accent);
+        canvas.drawFastVLine(bar_at(l.leq), bar_y - 2, 12, fg);
+        canvas.drawFastVLine(bar_at(l.lmax), bar_y - 2, 12, bad);
+    }
+
+    // Window statistics
+    canvas.setTextColor(fg);
+    if (_has_levels) {
+        std::snprintf(line, sizeof(line), "Leq %.1f  Max %.1f  Pk %.1f", static_cast<double>(show(l.leq)),
+                      static_cast<double>(show(l.lmax)), static_cast<double>(show(l.peak)));
+        canvas.drawString(line, 6, 68);
+        std::snprintf(line, sizeof(line), "L10 %.1f  L50 %.1f  L90 %.1f", static_cast<double>(show(l.l10)),
+                      static_cast<double>(show(l.l50)), static_cast<double>(show(l.l90)));
+        canvas.drawString(line, 6, 82);
+        canvas.setTextColor(dim);
+        std::snprintf(line, sizeof(line), "Voice %.0f%%  %.1f/%us", static_cast<double>(l.voice * 100.0f),
+                      static_cast<double>(l.seconds), static_cast<unsigned>(kIntervals[interval]));
+    } else {
+        canvas.setTextColor(dim);
+        std::snprintf(line, sizeof(line), "Window starting");
+    }
+    canvas.setTextDatum(textdatum_t::bottom_left);
+    canvas.drawString(line, 6, canvas.height() - 14);
+    canvas.setTextColor(dim);
+    canvas.drawString("[ ]:Win  -/=:Cal  L:Log  Bksp:Exit", 6, canvas.height() - 1);
+
+    GetHAL().pushAppCanvas();
+}
+
+void SoundMeterApp::hookKeyboard()
+{
+    if (_keyboard_slot_id != 0) {
+        return;
+    }
+
+    _keyboard_slot_id = GetHAL().keyboard.onKeyEvent.connect([this](const Keyboard::KeyEvent_t& e) {
+        if (!e.state) {
+            return;
+        }
+
+        if (e.keyCode == KEY_ESC || e.keyCode == KEY_GRAVE || e.keyCode == KEY_BACKSPACE) {
+            openDesktopAndCloseSelf();
+            return;
+        }
+
+        // A new interval starts the window over, and the log goes on at the new one
+        if (e.keyCode == KEY_LEFTBRACE || e.keyCode == KEY_RIGHTBRACE) {
+            selectInterval(_interval.load() + (e.keyCode == KEY_LEFTBRACE ? -1 : 1));
+            return;
+        }
+
+        if (e.keyCode == KEY_MINUS || e.keyCode == KEY_EQUAL) {
+            const float step = e.keyCode == KEY_MINUS ? -kCalStepDb : kCalStepDb;
+            _cal_db = std::clamp(_cal_db + step, -kMaxCalDb, kMaxCalDb);
+            _needs_redraw = true;
+            return;
+        }
+
+        if (e.keyCode == KEY_L) {
+            if (_logging) {
+                stopLog();
+            } else {
+                startLog();
+            }
+            return;
+        }
+    });
+}
+
+void SoundMeterApp::unhookKeyboard()
+{
+    if (_keyboard_slot_id == 0) {
+        return;
+    }
+    GetHAL().keyboard.onKeyEvent.disconnect(_keyboard_slot_id);
+    _keyboard_slot_id = 0;
+}
+
+void SoundMeterApp::hookSdCard()
+{
+    if (_sd_card_slot_id != 0) {
+        return;
+    }
+    // Appends would only fail from here on, the log is closed instead
+    _sd_card_slot_id = GetHAL().onSdCardEvent.connect([this](const Hal::SdCardEvent_t& e) {
+        if (!e.mounted) {
+            stopLog();
+        }
+    });
+}
+
+void SoundMeterApp::unhookSdCard()
+{
+    if (_sd_card_slot_id == 0) {
+        return;
+    }
+    GetHAL().onSdCardEvent.disconnect(_sd_card_slot_id);
+    _sd_card_slot_id = 0;
+}
+
+void SoundMeterApp::openDesktopAndCloseSelf()
+{
+    auto& mc = mooncake::GetMooncake();
+    auto* app_mgr = mc.getAppAbilityManager();
+    const auto app_instances = app_mgr ? app_mgr->getAllAbilityInstance() : std::vector<mooncake::AbilityBase*>{};
+
+    for (auto* app : app_instances) {
+        if (app == nullptr) {
+            continue;
+        }
+        const int id = app->getId();
+        const auto info = mc.getAppInfo(id);
+        if (info.name == "Desktop") {
+            mc.openApp(id);
+            break;
+        }
+    }
+    mc.closeApp(getId());
+}
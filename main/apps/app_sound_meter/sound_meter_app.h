@@ -0,0 +1,82 @@
+#pragma once
+#include <mooncake.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "utils/audio/sound_level.h"
+
+/**
+ * Sound level meter
+ *
+ * A meter task reads the mic at the mixer rate and runs it through slm::Meter, each finished block of 125 ms posts the
+ * levels to the UI. The window the statistics slide over is also the log interval: with logging on, every time the
+ * window has moved on by its whole length a CSV line of its levels is appended to a file on the card through the
+ * IoService, so the lines cover the recording back to back. Levels are shown and logged as dBFS plus a calibration
+ * offset, set against a reference meter or a calibrator.
+ */
+class SoundMeterApp : public mooncake::AppAbility {
+public:
+    SoundMeterApp();
+
+    void onOpen() override;
+    void onRunning() override;
+    void onClose() override;
+
+private:
+    struct Result_t {
+        slm::Levels_t levels;
+        uint32_t block = 0;         // Blocks since the window last started over
+        bool interval_end = false;  // The window moved on by its whole length since the last one
+        uint8_t generation = 0;     // Of the window, see _window_gen
+    };
+
+    static void taskMain(void* arg);
+    bool startTask();
+    void stopTask();
+
+    void drainResults();
+    void draw();
+    void hookKeyboard();
+    void unhookKeyboard();
+    void hookSdCard();
+    void unhookSdCard();
+    void openDesktopAndCloseSelf();
+
+    void selectInterval(int index);
+    void startLog();
+    void beginLog(const std::string& path);
+    void stopLog();
+    void appendLog(const Result_t& r);
+    void flushLog();
+
+    // Meter task
+    TaskHandle_t _task = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    std::atomic<bool> _task_running{false};
+    std::atomic<bool> _task_done{true};
+    std::atomic<uint8_t> _interval{0};
+    std::atomic<uint8_t> _window_gen{0};  // Bumped by the UI, the task starts the window over at _interval
+    slm::Meter _meter;
+
+    size_t _keyboard_slot_id = 0;
+    size_t _sd_card_slot_id = 0;
+    bool _mic_ok = false;
+    bool _needs_redraw = true;
+    float _cal_db = 0.0f;
+    Result_t _shown;
+    bool _has_levels = false;
+
+    // Log on the card, lines queue up here while an append is on its way
+    bool _logging = false;
+    uint32_t _log_name_request = 0;  // IoService search for a free file name
+    std::string _log_path;
+    std::string _log_pending;
+    uint32_t _log_request = 0;
+    uint32_t _log_lines = 0;
+    uint32_t _log_blocks = 0;
+    int _log_error = 0;
+};
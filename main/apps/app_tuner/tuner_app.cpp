@@ -0,0 +1,370 @@
+#include "tuner_app.h"
+#include <hal.h>
+#include <mooncake_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "utils/audio/pcm.h"
+#include "utils/audio/audio_mixer.h"
+#include "utils/ui/animation.h"
+
+namespace {
+
+const std::string kTag = "Tuner";
+
+constexpr uint32_t kSampleRate = 16000;
+// One detection per hop, 8 ms
+constexpr size_t kHop = 128;
+// The mic comes in at the mixer rate and is resampled to kSampleRate, from at most this many times faster
+constexpr size_t kMaxCaptureRatio = 3;
+
+constexpr uint32_t kFrameMs = 33;
+// A note stays up this long after the sound stops, dimmed
+constexpr uint32_t kHoldMs = 1500;
+constexpr uint32_t kLatencyWindowMs = 1000;
+// Within this many cents the needle turns green
+constexpr float kInTuneCents = 5.0f;
+constexpr float kMinA4 = 415.0f;
+constexpr float kMaxA4 = 466.0f;
+
+constexpr int kScaleX = 20;
+constexpr int kScaleW = 200;
+constexpr int kScaleY = 72;
+
+}  // namespace
+
+TunerApp::TunerApp()
+{
+    setAppInfo().name = "Tuner";
+}
+
+void TunerApp::onOpen()
+{
+    mclog::tagInfo(kTag, "onOpen");
+    _has_note = false;
+    _voiced = false;
+    _needle = 0.0f;
+    _pending_us = 0;
+    _latency_ms = 0.0f;
+    _latency_max_ms = 0.0f;
+    _window_max_ms = 0.0f;
+    _window_start_ms = GetHAL().millis();
+    _next_frame_ms = GetHAL().millis();
+
+    _mic_ok = GetHAL().mixer.isRunning() && GetHAL().mixer.sampleRate() <= kSampleRate * kMaxCaptureRatio;
+    if (!_mic_ok) {
+        mclog::tagError(kTag, "mixer not running at up to {} Hz", kSampleRate * kMaxCaptureRatio);
+    } else {
+        _mic_ok = startTask();
+    }
+    hookKeyboard();
+}
+
+void TunerApp::onRunning()
+{
+    if (GetHAL().homeButton.wasPressed()) {
+        openDesktopAndCloseSelf();
+        return;
+    }
+
+    const uint32_t now = GetHAL().millis();
+    drainResults(now);
+    if (static_cast<int32_t>(now - _next_frame_ms) >= 0) {
+        _next_frame_ms = now + kFrameMs;
+        draw(now);
+    }
+    anim::requestFrame(_next_frame_ms);
+}
+
+void TunerApp::onClose()
+{
+    mclog::tagInfo(kTag, "onClose");
+    stopTask();
+    unhookKeyboard();
+}
+
+/* ---- Detector task ---- */
+
+bool TunerApp::startTask()
+{
+    if (_task != nullptr) {
+        return true;
+    }
+
+    pitch::Config_t config;
+    config.sample_rate = static_cast<float>(kSampleRate);
+    const uint32_t mixer_rate = GetHAL().mixer.sampleRate();
+    if (!_detector.init(config) ||
+        !_src.init(mixer_rate, kSampleRate, 1, Resampler::Quality::Medium, kHop * kMaxCaptureRatio)) {
+        mclog::tagError(kTag, "create detector failed");
+        stopTask();
+        return false;
+    }
+    _frame.reset(new (std::nothrow) float[_detector.frameSize()]());
+    _result_queue = xQueueCreate(8, sizeof(Result_t));
+    if (!_frame || _result_queue == nullptr) {
+        mclog::tagError(kTag, "create buffers failed");
+        stopTask();
+        return false;
+    }
+
+    _task_running.store(true);
+    _task_done.store(false);
+    BaseType_t ok = xTaskCreatePinnedToCore(TunerApp::taskMain, "tuner", 4096, this, 4, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(kTag, "create task failed");
+        _task = nullptr;
+        _task_done.store(true);
+        stopTask();
+        return false;
+    }
+    return true;
+}
+
+void TunerApp::stopTask()
+{
+    _task_running.store(false);
+    while (!_task_done.load(std::memory_order_acquire)) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+    _task = nullptr;
+    if (_result_queue != nullptr) {
+        vQueueDelete(_result_queue);
+        _result_queue = nullptr;
+    }
+    _frame.reset();
+    _src.deinit();
+    _detector.deinit();
+}
+
+void TunerApp::taskMain(void* arg)
+{
+    auto* app = static_cast<TunerApp*>(arg);
+    mclog::tagInfo(kTag, "detector task start");
+
+    alignas(pcm::kAlign) static int16_t buf[kHop * kMaxCaptureRatio * 2];
+    alignas(pcm::kAlign) static int16_t wide[kHop * kMaxCaptureRatio];
+    // A read makes kHop samples, one more when the resampler's position carries over
+    alignas(pcm::kAlign) static int16_t pcm16[kHop + 1];
+    static float hop[kHop + 1];
+    const size_t chunk_in = kHop * GetHAL().mixer.sampleRate() / kSampleRate;
+    const size_t frame_size = app->_detector.frameSize();
+    float* frame = app->_frame.get();
+    size_t filled = 0;
+
+    while (app->_task_running.load()) {
+        const size_t got = GetHAL().micRead(buf, chunk_in, 100);
+        const int64_t captured_us = esp_timer_get_time();
+        if (got == 0) {
+            continue;
+        }
+        pcm::stereoToMono(wide, buf, got);
+        const size_t n = app->_src.convert(wide, got, pcm16);
+        if (n == 0) {
+            continue;
+        }
+
+        // Slide the frame by what came in, detection starts once it is full
+        pcm::toFloat(hop, pcm16, n);
+        std::memmove(frame, frame + n, (frame_size - n) * sizeof(float));
+        std::memcpy(frame + frame_size - n, hop, n * sizeof(float));
+        filled = std::min(filled + n, frame_size);
+        if (filled < frame_size) {
+            continue;
+        }
+
+        Result_t r;
+        const int64_t start = esp_timer_get_time();
+        r.est = app->_detector.detect(frame);
+        r.detect_us = static_cast<uint32_t>(esp_timer_get_time() - start);
+        r.captured_us = captured_us;
+        // The UI only wants the newest, if it fell behind the oldest goes
+        if (xQueueSend(app->_result_queue, &r, 0) != pdTRUE) {
+            Result_t dropped;
+            xQueueReceive(app->_result_queue, &dropped, 0);
+            xQueueSend(app->_result_queue, &r, 0);
+        }
+    }
+
+    mclog::tagInfo(kTag, "detector task stop");
+    app->_task_done.store(true, std::memory_order_release);
+    vTaskDelete(nullptr);
+}
+
+/* ---- UI side ---- */
+
+void TunerApp::drainResults(uint32_t now)
+{
+    if (_result_queue == nullptr) {
+        return;
+    }
+    Result_t r;
+    while (xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        _pending_us = r.captured_us;
+        _detect_us = r.detect_us;
+        _level_db = r.est.level_db;
+        _voiced = r.est.voiced;
+        if (!r.est.voiced) {
+            continue;
+        }
+        // A new note jumps the needle there, the same note eases over a few frames
+        const auto note = pitch::nearestNote(r.est.hz, _a4_hz);
+        if (!_has_note || note.midi != _note.midi) {
+            _needle = note.cents;
+        }
+        _note = note;
+        _hz = r.est.hz;
+        _has_note = true;
+        _last_voiced_ms = now;
+    }
+}
+
+void TunerApp::draw(uint32_t now)
+{
+    profiler::ScopedMarker marker(profiler::Marker::Draw, "Tuner");
+    auto& canvas = GetHAL().canvas;
+    const uint16_t bg = lgfx::color565(0x22, 0x22, 0x22);
+    const uint16_t fg = lgfx::color565(0xEE, 0xEE, 0xEE);
+    const uint16_t dim = lgfx::color565(0x88, 0x88, 0x88);
+    const uint16_t accent = lgfx::color565(0xFF, 0x8D, 0x1A);
+    const uint16_t good = lgfx::color565(0x3C, 0xD0, 0x70);
+
+    canvas.fillScreen(bg);
+    canvas.setFont(&fonts::efontCN_12);
+    canvas.setTextSize(1);
+    canvas.setTextColor(fg);
+    canvas.setTextDatum(textdatum_t::top_left);
+
+    char line[64];
+    std::snprintf(line, sizeof(line), "Tuner  A4=%.0fHz", static_cast<double>(_a4_hz));
+    canvas.drawString(line, 6, 0);
+    if (!_mic_ok) {
+        canvas.setTextDatum(textdatum_t::middle_center);
+        canvas.drawString("Mic not available", canvas.width() / 2, canvas.height() / 2);
+        GetHAL().pushAppCanvas();
+        return;
+    }
+
+    // Input level, so a quiet instrument is told from a missing one
+    const int level_w = std::clamp(static_cast<int>((_level_db + 60.0f) * 1.0f), 0, 60);
+    canvas.drawRect(canvas.width() - 66, 3, 62, 8, dim);
+    canvas.fillRect(canvas.width() - 65, 4, level_w, 6, _voiced ? good : dim);
+
+    const bool held = _has_note && now - _last_voiced_ms < kHoldMs;
+    const bool live = held && _voiced;
+    if (held) {
+        _needle += (_note.cents - _needle) * 0.5f;
+    }
+    const bool in_tune = live && std::fabs(_needle) <= kInTuneCents;
+    const uint16_t note_color = !live ? dim : in_tune ? good : accent;
+
+    // Note, big, with the cents and the frequency under it
+    canvas.setTextDatum(textdatum_t::top_center);
+    canvas.setTextSize(3);
+    canvas.setTextColor(note_color);
+    if (held) {
+        std::snprintf(line, sizeof(line), "%s%d", pitch::noteName(_note.midi), pitch::noteOctave(_note.midi));
+    } else {
+        std::snprintf(line, sizeof(line), "--");
+    }
+    canvas.drawString(line, canvas.width() / 2, 16);
+    canvas.setTextSize(1);
+    if (held) {
+        std::snprintf(line, sizeof(line), "%+.1f cents  %.2f Hz", static_cast<double>(_note.cents),
+                      static_cast<double>(_hz));
+        canvas.drawString(line, canvas.width() / 2, 54);
+    }
+
+    // Scale from -50 to +50 cents, a tick every 10, and the needle
+    const int mid = kScaleX + kScaleW / 2;
+    canvas.drawFastHLine(kScaleX, kScaleY + 12, kScaleW + 1, dim);
+    for (int c = -50; c <= 50; c += 10) {
+        const int x = mid + c * kScaleW / 100;
+        const int h = c == 0 ? 12 : 6;
+        canvas.drawFastVLine(x, kScaleY + 12 - h, h, c == 0 ? fg : dim);
+    }
+    if (held) {
+        const int x = mid + static_cast<int>(std::lround(std::clamp(_needle, -50.0f, 50.0f) * kScaleW / 100.0f));
+        canvas.fillTriangle(x, kScaleY + 12, x - 4, kScaleY, x + 4, kScaleY, note_color);
+        canvas.drawFastVLine(x, kScaleY + 12, 6, note_color);
+    }
+
+    // From the newest sample read to this frame on the display, averaged and the worst of the last second
+    std::snprintf(line, sizeof(line), "Lat:%.0fms max %.0f  Det:%.1fms", static_cast<double>(_latency_ms),
+                  static_cast<double>(_latency_max_ms), _detect_us / 1000.0);
+    canvas.setTextDatum(textdatum_t::bottom_left);
+    canvas.setTextColor(dim);
+    canvas.drawString(line, 6, canvas.height() - 14);
+    canvas.drawString("[ ]:A4  Bksp:Exit", 6, canvas.height() - 1);
+
+    GetHAL().pushAppCanvas();
+
+    if (_pending_us != 0) {
+        const float ms = (esp_timer_get_time() - _pending_us) / 1000.0f;
+        _pending_us = 0;
+        _latency_ms = _latency_ms == 0.0f ? ms : _latency_ms + (ms - _latency_ms) / 8.0f;
+        _window_max_ms = std::max(_window_max_ms, ms);
+    }
+    if (now - _window_start_ms >= kLatencyWindowMs) {
+        _window_start_ms = now;
+        _latency_max_ms = _window_max_ms;
+        _window_max_ms = 0.0f;
+    }
+}
+
+void TunerApp::hookKeyboard()
+{
+    if (_keyboard_slot_id != 0) {
+        return;
+    }
+
+    _keyboard_slot_id = GetHAL().keyboard.onKeyEvent.connect([this](const Keyboard::KeyEvent_t& e) {
+        if (!e.state) {
+            return;
+        }
+
+        if (e.keyCode == KEY_ESC || e.keyCode == KEY_GRAVE || e.keyCode == KEY_BACKSPACE) {
+            openDesktopAndCloseSelf();
+            return;
+        }
+        // Reference pitch, the shown note and cents follow from the next estimate
+        if (e.keyCode == KEY_LEFTBRACE || e.keyCode == KEY_RIGHTBRACE) {
+            const float step = e.keyCode == KEY_LEFTBRACE ? -1.0f : 1.0f;
+            _a4_hz = std::clamp(_a4_hz + step, kMinA4, kMaxA4);
+            return;
+        }
+    });
+}
+
+void TunerApp::unhookKeyboard()
+{
+    if (_keyboard_slot_id == 0) {
+        return;
+    }
+    GetHAL().keyboard.onKeyEvent.disconnect(_keyboard_slot_id);
+    _keyboard_slot_id = 0;
+}
+
+void TunerApp::openDesktopAndCloseSelf()
+{
+    auto& mc = mooncake::GetMooncake();
+    auto* app_mgr = mc.getAppAbilityManager();
+    const auto app_instances = app_mgr ? app_mgr->getAllAbilityInstance() : std::vector<mooncake::AbilityBase*>{};
+
+    for (auto* app : app_instances) {
+        if (app == nullptr) {
+            continue;
+        }
+        const int id = app->getId();
+        const auto info = mc.getAppInfo(id);
+        if (info.name == "Desktop") {
+            mc.openApp(id);
+            break;
+        }
+    }
+    mc.closeApp(getId());
+}
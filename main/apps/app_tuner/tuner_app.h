@@ -0,0 +1,77 @@
+#pragma once
+#include <mooncake.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "utils/audio/pitch.h"
+#include "utils/audio/resampler.h"
+
+/**
+ * Instrument tuner
+ *
+ * A detector task reads the mic at the mixer rate, resamples it to 16 kHz and runs the pitch detector over the last
+ * frame every hop of kHop samples (8 ms). Each estimate is posted with the time its newest sample came in. The UI
+ * draws at 30 fps from the newest estimate, the note, how many cents off it is against the A4 set and a needle, and
+ * shows how old that sample was by the time the frame was on the display. Hops are short against the frame period,
+ * so that age is the mic DMA block, one hop at most, the detection and the draw, well under 50 ms.
+ */
+class TunerApp : public mooncake::AppAbility {
+public:
+    TunerApp();
+
+    void onOpen() override;
+    void onRunning() override;
+    void onClose() override;
+
+private:
+    struct Result_t {
+        pitch::Estimate_t est;
+        int64_t captured_us = 0;  // Newest sample of the frame read
+        uint32_t detect_us = 0;
+    };
+
+    static void taskMain(void* arg);
+    bool startTask();
+    void stopTask();
+
+    void drainResults(uint32_t now);
+    void draw(uint32_t now);
+    void hookKeyboard();
+    void unhookKeyboard();
+    void openDesktopAndCloseSelf();
+
+    // Detector task, set up and torn down by the UI while it isn't running
+    TaskHandle_t _task = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    std::atomic<bool> _task_running{false};
+    std::atomic<bool> _task_done{true};
+    Resampler _src;
+    pitch::Detector _detector;
+    std::unique_ptr<float[]> _frame;
+
+    size_t _keyboard_slot_id = 0;
+    bool _mic_ok = false;
+    float _a4_hz = 440.0f;
+    uint32_t _next_frame_ms = 0;
+
+    // Shown note, held a while after the sound stops
+    bool _has_note = false;
+    bool _voiced = false;
+    pitch::Note_t _note;
+    float _hz = 0.0f;
+    float _needle = 0.0f;  // Cents, eased towards the newest estimate every frame
+    float _level_db = -120.0f;
+    uint32_t _last_voiced_ms = 0;
+
+    // Newest sample not on the display yet, and how long it took to get there
+    int64_t _pending_us = 0;
+    uint32_t _detect_us = 0;
+    float _latency_ms = 0.0f;
+    float _latency_max_ms = 0.0f;
+    float _window_max_ms = 0.0f;
+    uint32_t _window_start_ms = 0;
+};
@@ -3,100 +3,119 @@
  *
  * SPDX-License-Identifier: MIT
  */
+#include "audio.h"
 #include <vector>
 #include <cmath>
 #include <cstdlib>
 #include <cstdint>
+#include <cstdio>
 #include <algorithm>
 #include <hal/hal.h>
 #include <mooncake_log.h>
 #include <random>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "pcm.h"
+#include "audio_mixer.h"
 
 namespace audio {
 
 static std::vector<int> c_major_scale = {60, 62, 64, 65, 67, 69, 71};  // C major scale (C D E F G A B)
 
-void play_tone(int frequency, double durationSec)
-{
-    if (GetHAL().speaker.getVolume() <= 0) {
-        return;
-    }
+// -14 dBFS, the level the tones always had
+static constexpr uint16_t kToneVelocity = 32767 / 5;
+// 1 ms attack, 4 ms release, what the old per-call fade-out sounded like
+static const Synth::Patch_t kTonePatch = {Synth::Wave::Sine, 1, 0, 32767, 4};
+// One block queued in the mixer while the next one renders
+static constexpr size_t kSynthBufferFrames = 2 * Synth::kBlockFrames;
 
-    const int sample_rate = GetHAL().speaker.config().sample_rate;
-    const int samples     = static_cast<int>(sample_rate * durationSec);
-    std::vector<int16_t> buffer(samples * 2);  // stereo
+static Synth _synth;
+static int _synth_stream = -1;
+alignas(pcm::kAlign) static int16_t _synth_block[Synth::kBlockFrames];
 
-    const int fade_len    = 200;  // fade-out length (samples)
-    const float amplitude = 32767.0f / 5;
-
-    for (int i = 0; i < samples; ++i) {
-        float amp = amplitude;
-
-        // Apply fade-out at the end
-        if (i >= samples - fade_len) {
-            float fade_factor = static_cast<float>(samples - i) / fade_len;
-            amp *= fade_factor;
+static void _synth_task_main(void* /*arg*/)
+{
+    auto& mixer = GetHAL().mixer;
+    while (true) {
+        // Nothing sounds: sleep on the command queue instead of rendering silence
+        if (_synth.idle()) {
+            _synth.wait(portMAX_DELAY);
         }
-
-        int16_t value     = static_cast<int16_t>(amp * sin(2.0 * M_PI * frequency * i / sample_rate));
-        buffer[i * 2]     = value;  // left channel
-        buffer[i * 2 + 1] = value;  // right channel
+        _synth.render(_synth_block, Synth::kBlockFrames);
+        mixer.write(_synth_stream, _synth_block, Synth::kBlockFrames, portMAX_DELAY);
     }
+}
 
-    GetHAL().speaker.playRaw(buffer.data(), buffer.size());
+// Started on the first note, then runs for good
+static bool _synth_ready()
+{
+    static const bool ready = [] {
+        auto& mixer = GetHAL().mixer;
+        AudioMixer::StreamConfig_t config;
+        config.role          = AudioMixer::Role::System;
+        config.sample_rate   = mixer.sampleRate();
+        config.channels      = 1;
+        config.buffer_frames = kSynthBufferFrames;
+        _synth_stream        = mixer.open(config);
+        if (_synth_stream < 0 || !_synth.begin(config.sample_rate)) {
+            mclog::tagError("audio", "synth begin failed");
+            mixer.close(_synth_stream);
+            return false;
+        }
+        BaseType_t ok = xTaskCreatePinnedToCore(_synth_task_main, "synth", 3072, nullptr, 4, nullptr, 1);
+        if (ok != pdPASS) {
+            mclog::tagError("audio", "create synth task failed");
+            _synth.end();
+            mixer.close(_synth_stream);
+            return false;
+        }
+        return true;
+    }();
+    return ready;
+}
+
+static double _midi_to_hz(int midi)
+{
+    return 440.0 * std::pow(2.0, (midi - 69) / 12.0);
 }
 
-void play_melody(const std::vector<int>& midiList, double durationSec = 0.1)
+void play_tone(int frequency, double durationSec)
 {
-    if (GetHAL().speaker.getVolume() <= 0) {
+    if (GetHAL().mixer.getVolume() <= 0 || !_synth_ready()) {
         return;
     }
+    _synth.noteOn(static_cast<float>(frequency), static_cast<uint32_t>(durationSec * 1000.0), kToneVelocity,
+                  kTonePatch);
+}
 
-    const int sample_rate      = GetHAL().speaker.config().sample_rate;
-    const int samples_per_note = static_cast<int>(sample_rate * durationSec);
-    const int fade_len         = 200;  // fade-out length per note (samples)
-    const float amplitude      = 32767.0f / 5;
-
-    std::vector<int16_t> buffer;                             // store the whole melody
-    buffer.reserve(midiList.size() * samples_per_note * 2);  // stereo capacity
-
-    for (int midiNote : midiList) {
-        for (int i = 0; i < samples_per_note; ++i) {
-            float amp = amplitude;
-
-            // Apply fade-out at the end of each note
-            if (i >= samples_per_note - fade_len) {
-                float fade_factor = static_cast<float>(samples_per_note - i) / fade_len;
-                amp *= fade_factor;
-            }
-
-            int16_t sample = 0;
-            if (midiNote >= 0) {
-                double freq = 440.0 * pow(2.0, (midiNote - 69) / 12.0);
-                sample      = static_cast<int16_t>(amp * sin(2.0 * M_PI * freq * i / sample_rate));
-            }
+void play_melody(const std::vector<int>& midiList, double durationSec)
+{
+    if (GetHAL().mixer.getVolume() <= 0 || !_synth_ready()) {
+        return;
+    }
 
-            buffer.push_back(sample);  // left channel
-            buffer.push_back(sample);  // right channel
+    // Every note is posted now with its start as a delay, rests just leave a gap
+    const uint32_t note_ms = static_cast<uint32_t>(durationSec * 1000.0);
+    for (size_t n = 0; n < midiList.size(); ++n) {
+        if (midiList[n] >= 0) {
+            _synth.noteOn(static_cast<float>(_midi_to_hz(midiList[n])), note_ms, kToneVelocity, kTonePatch,
+                          static_cast<uint32_t>(n * note_ms));
         }
     }
-
-    GetHAL().speaker.playRaw(buffer.data(), buffer.size());
 }
 
 void play_tone_from_midi(int midi, double durationSec)
 {
-    if (GetHAL().speaker.getVolume() <= 0) {
+    if (GetHAL().mixer.getVolume() <= 0 || !_synth_ready()) {
         return;
     }
-
-    double freq = 440.0 * std::pow(2.0, (midi - 69) / 12.0);
-    play_tone(static_cast<int>(freq), durationSec);
+    _synth.noteOn(static_cast<float>(_midi_to_hz(midi)), static_cast<uint32_t>(durationSec * 1000.0), kToneVelocity,
+                  kTonePatch);
 }
 
-void play_random_tone(int semitoneShift = 0, double durationSec = 0.15)
+void play_random_tone(int semitoneShift, double durationSec)
 {
-    if (GetHAL().speaker.getVolume() <= 0) {
+    if (GetHAL().mixer.getVolume() <= 0) {
         return;
     }
 
@@ -110,6 +129,16 @@ void play_random_tone(int semitoneShift = 0, double durationSec = 0.15)
     play_tone_from_midi(midi, durationSec);
 }
 
+void dump_synth_stats()
+{
+    const Synth::Stats_t s = _synth.stats();
+    std::printf("notes,dropped,stolen,blocks,peak_voices,voice_ns,max_block_us\r\n");
+    std::printf("%u,%u,%u,%u,%u,%u,%u\r\n", static_cast<unsigned>(s.notes), static_cast<unsigned>(s.dropped),
+                static_cast<unsigned>(s.stolen), static_cast<unsigned>(s.blocks), static_cast<unsigned>(s.peak_voices),
+                static_cast<unsigned>(s.voice_ns), static_cast<unsigned>(s.max_block_us));
+    std::fflush(stdout);
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                  Keyboard                                  */
 /* -------------------------------------------------------------------------- */
@@ -119,8 +148,6 @@ static void _keyboard_sfx_on_key_event(const Keyboard::KeyEvent_t& event)
         return;
     }
 
-    GetHAL().speaker.setVolume(90);
-
     int semitoneShift = 48;
     switch (event.keyCode) {
         case KEY_1:
@@ -6,6 +6,7 @@
 #pragma once
 #include <cstdint>
 #include <vector>
+#include "synth.h"
 
 namespace audio {
 
@@ -19,4 +20,7 @@ void play_random_tone(int semitoneShift = 48, double durationSec = 0.02);
 
 void set_keyboard_sfx_enable(bool enable);
 
+/** Prints notes, drops, voice steals and the render cost per voice per block of the synth behind the calls above */
+void dump_synth_stats();
+
 }  // namespace audio
\ No newline at end of file
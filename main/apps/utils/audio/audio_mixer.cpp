@@ -0,0 +1,381 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "audio_mixer.h"
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+static constexpr int32_t kUnity       = 32768;  // Q15, gains reach exactly 1.0
+static constexpr int32_t kDuckLevel   = 8231;   // -12 dB
+static constexpr uint32_t kDuckDownMs = 20;
+static constexpr uint32_t kDuckUpMs   = 300;
+// Gains ramp across a block with a shift instead of a divide per sample
+static constexpr int kBlockShift = 8;
+static_assert(AudioMixer::kBlockFrames == 1u << kBlockShift, "ramp shift has to match the block");
+
+AudioMixer::~AudioMixer()
+{
+    end();
+}
+
+bool AudioMixer::begin(const Output_t& output)
+{
+    if (_task != nullptr || output.write == nullptr || output.sample_rate == 0) {
+        return false;
+    }
+    _output   = output;
+    _wake_sem = xSemaphoreCreateBinary();
+    if (_wake_sem == nullptr) {
+        return false;
+    }
+
+    const uint64_t block_us = static_cast<uint64_t>(kBlockFrames) * 1000000 / _output.sample_rate;
+    _duck                   = kUnity;
+    _duck_down = static_cast<int32_t>(std::max<uint64_t>(1, (kUnity - kDuckLevel) * block_us / (kDuckDownMs * 1000)));
+    _duck_up   = static_cast<int32_t>(std::max<uint64_t>(1, (kUnity - kDuckLevel) * block_us / (kDuckUpMs * 1000)));
+
+    _running.store(true);
+    _task_done.store(false);
+    // Above the decoders and capture tasks that feed it, the output write blocks it most of the time
+    BaseType_t ok = xTaskCreatePinnedToCore(AudioMixer::taskMain, "mixer", 4096, this, 7, &_task, 1);
+    if (ok != pdPASS) {
+        _running.store(false);
+        _task_done.store(true);
+        _task = nullptr;
+        vSemaphoreDelete(_wake_sem);
+        _wake_sem = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void AudioMixer::end()
+{
+    if (_task != nullptr) {
+        _running.store(false);
+        wake();
+        while (!_task_done.load(std::memory_order_acquire)) {
+            vTaskDelay(1);
+        }
+        _task = nullptr;
+    }
+    if (_wake_sem != nullptr) {
+        vSemaphoreDelete(_wake_sem);
+        _wake_sem = nullptr;
+    }
+    for (auto& s : _streams) {
+        if (s.state.load() != Slot::Free) {
+            release(s);
+        }
+    }
+}
+
+void AudioMixer::wake()
+{
+    if (_wake_sem != nullptr) {
+        xSemaphoreGive(_wake_sem);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Streams                                  */
+/* -------------------------------------------------------------------------- */
+int AudioMixer::open(const StreamConfig_t& config)
+{
+    if (_output.sample_rate == 0 || config.channels < 1 || config.channels > 2 || config.sample_rate == 0 ||
+        config.sample_rate > _output.sample_rate * kMaxRateRatio || (config.pull == nullptr && config.buffer_frames == 0)) {
+        return -1;
+    }
+
+    for (size_t id = 0; id < kMaxStreams; ++id) {
+        Stream_t& s   = _streams[id];
+        Slot expected = Slot::Free;
+        if (!s.state.compare_exchange_strong(expected, Slot::Opening)) {
+            continue;
+        }
+
+        s.config = config;
+        const bool src_ok =
+            s.src.init(config.sample_rate, _output.sample_rate, config.channels, config.quality, kBlockFrames);
+        const bool ring_ok = config.pull != nullptr || s.ring.init(config.buffer_frames * config.channels);
+        if (!src_ok || !ring_ok) {
+            release(s);
+            return -1;
+        }
+        s.applied = -1;
+        s.playing = false;
+        s.gain.store(kUnity);
+        s.flush.store(false);
+        s.state.store(Slot::Open, std::memory_order_release);
+        wake();
+        return static_cast<int>(id);
+    }
+    return -1;
+}
+
+void AudioMixer::close(int stream)
+{
+    Stream_t* s = get(stream);
+    if (s == nullptr) {
+        return;
+    }
+    s->state.store(Slot::Closing, std::memory_order_release);
+    if (_task != nullptr) {
+        wake();
+        while (s->state.load(std::memory_order_acquire) != Slot::Closed) {
+            vTaskDelay(1);
+        }
+    }
+    release(*s);
+}
+
+void AudioMixer::release(Stream_t& s)
+{
+    s.ring.deinit();
+    s.src.deinit();
+    s.state.store(Slot::Free, std::memory_order_release);
+}
+
+AudioMixer::Stream_t* AudioMixer::get(int stream)
+{
+    if (stream < 0 || stream >= static_cast<int>(kMaxStreams)) {
+        return nullptr;
+    }
+    Stream_t& s = _streams[stream];
+    return s.state.load(std::memory_order_acquire) == Slot::Open ? &s : nullptr;
+}
+
+const AudioMixer::Stream_t* AudioMixer::get(int stream) const
+{
+    return const_cast<AudioMixer*>(this)->get(stream);
+}
+
+size_t AudioMixer::write(int stream, const int16_t* frames, size_t count, TickType_t wait)
+{
+    Stream_t* s = get(stream);
+    if (s == nullptr || s->config.pull != nullptr) {
+        return 0;
+    }
+
+    // Whole frames only, so the mixer never reads half of one
+    const size_t ch   = s->config.channels;
+    size_t done       = 0;
+    TickType_t waited = 0;
+    while (true) {
+        const size_t room = (s->ring.capacity() - s->ring.size()) / ch;
+        const size_t n    = std::min(count - done, room);
+        if (n > 0) {
+            s->ring.write(frames + done * ch, n * ch);
+            done += n;
+            wake();
+        }
+        if (done == count || !_running.load(std::memory_order_relaxed) || (wait != portMAX_DELAY && waited >= wait)) {
+            break;
+        }
+        vTaskDelay(1);
+        ++waited;
+    }
+    return done;
+}
+
+void AudioMixer::flush(int stream)
+{
+    Stream_t* s = get(stream);
+    if (s == nullptr) {
+        return;
+    }
+    s->flush.store(true, std::memory_order_release);
+    if (_task == nullptr) {
+        service(*s);
+        return;
+    }
+    wake();
+    while (s->flush.load(std::memory_order_acquire)) {
+        vTaskDelay(1);
+    }
+}
+
+size_t AudioMixer::buffered(int stream) const
+{
+    const Stream_t* s = get(stream);
+    return s == nullptr ? 0 : s->ring.size() / s->config.channels;
+}
+
+void AudioMixer::setGain(int stream, float gain)
+{
+    Stream_t* s = get(stream);
+    if (s != nullptr) {
+        s->gain.store(static_cast<uint16_t>(std::clamp(gain, 0.0f, 1.0f) * kUnity), std::memory_order_relaxed);
+    }
+}
+
+AudioMixer::Stats_t AudioMixer::stats() const
+{
+    Stats_t st;
+    st.blocks       = _blocks.load(std::memory_order_relaxed);
+    st.underruns    = _underruns.load(std::memory_order_relaxed);
+    st.max_block_us = _max_block_us.load(std::memory_order_relaxed);
+    st.block_us     = _block_us.load(std::memory_order_relaxed);
+    st.ducking      = _ducking.load(std::memory_order_relaxed);
+    for (const auto& s : _streams) {
+        st.streams += s.state.load(std::memory_order_relaxed) == Slot::Open ? 1 : 0;
+    }
+    return st;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Mixer task                                 */
+/* -------------------------------------------------------------------------- */
+void AudioMixer::taskMain(void* arg)
+{
+    static_cast<AudioMixer*>(arg)->taskLoop();
+    vTaskDelete(nullptr);
+}
+
+void AudioMixer::taskLoop()
+{
+    while (_running.load(std::memory_order_relaxed)) {
+        // Nothing to play: sleep until a client writes, opens, closes or flushes
+        if (!mixBlock()) {
+            xSemaphoreTake(_wake_sem, portMAX_DELAY);
+        }
+    }
+    _task_done.store(true, std::memory_order_release);
+}
+
+// Flush requests are served on the mixer side, the only one allowed to drop what the ring holds
+void AudioMixer::service(Stream_t& s)
+{
+    if (!s.flush.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (s.config.pull == nullptr) {
+        s.ring.skip(s.ring.size());
+    }
+    s.src.reset();
+    s.playing = false;
+    s.flush.store(false, std::memory_order_release);
+}
+
+bool AudioMixer::active(const Stream_t& s) const
+{
+    return s.config.pull != nullptr || s.ring.size() > 0;
+}
+
+int32_t AudioMixer::targetGain(const Stream_t& s, int32_t duck) const
+{
+    int32_t g = s.gain.load(std::memory_order_relaxed);
+    if (s.config.role == Role::Music) {
+        g = (g * duck) >> 15;
+    }
+    if (!s.config.master) {
+        return g >> 3;
+    }
+    // Q12, volume squared: kUnityVolume (64) is 4096
+    const int32_t v = _volume.load(std::memory_order_relaxed);
+    return static_cast<int32_t>((static_cast<int64_t>(g) * v * v) >> 15);
+}
+
+void AudioMixer::resample(Stream_t& s, int16_t* out, size_t frames)
+{
+    const size_t ch   = s.config.channels;
+    const size_t need = s.src.need(frames);
+    if (need > 0) {
+        int16_t* dst = s.src.tail();
+        if (s.config.pull != nullptr) {
+            s.config.pull(dst, need, s.config.ctx);
+        } else {
+            const size_t got = s.ring.read(dst, need * ch) / ch;
+            if (got < need) {
+                std::memset(dst + got * ch, 0, (need - got) * ch * sizeof(int16_t));
+                _underruns.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        s.src.commit(need);
+    }
+
+    if (ch == 2) {
+        s.src.render(out, frames);
+    } else {
+        s.src.render(_mono, frames);
+        pcm::monoToStereo(out, _mono, frames);
+    }
+}
+
+bool AudioMixer::mixBlock()
+{
+    const int64_t start = esp_timer_get_time();
+    bool any            = false;
+    bool duck           = false;
+    for (auto& s : _streams) {
+        const Slot state = s.state.load(std::memory_order_acquire);
+        if (state == Slot::Closing) {
+            s.state.store(Slot::Closed, std::memory_order_release);
+            continue;
+        }
+        if (state != Slot::Open) {
+            continue;
+        }
+        service(s);
+        if (!active(s)) {
+            // Gone quiet, the filter history runs on into the silence a later start follows
+            s.playing = false;
+            continue;
+        }
+        s.playing = true;
+        any       = true;
+        duck |= s.config.role == Role::Notification || s.config.role == Role::Voice;
+    }
+
+    const int32_t duck_target = duck ? kDuckLevel : kUnity;
+    _ducking.store(duck, std::memory_order_relaxed);
+    if (!any) {
+        _duck = duck_target;
+        return false;
+    }
+    _duck = _duck > duck_target ? std::max(duck_target, _duck - _duck_down) : std::min(duck_target, _duck + _duck_up);
+
+    std::memset(_acc, 0, sizeof(_acc));
+    for (auto& s : _streams) {
+        if (s.state.load(std::memory_order_relaxed) != Slot::Open || !s.playing) {
+            continue;
+        }
+        resample(s, _tmp, kBlockFrames);
+
+        // Gain ramps from where the last block ended, a stream that was quiet starts right at its target
+        const int32_t to   = targetGain(s, _duck);
+        const int32_t from = s.applied < 0 ? to : s.applied;
+        s.applied          = to;
+        if (from == to) {
+            for (size_t i = 0; i < kBlockFrames * 2; ++i) {
+                _acc[i] += (_tmp[i] * to) >> 12;
+            }
+            continue;
+        }
+        const int32_t delta = to - from;
+        for (size_t k = 0; k < kBlockFrames; ++k) {
+            const int32_t g = from + ((delta * static_cast<int32_t>(k)) >> kBlockShift);
+            _acc[2 * k] += (_tmp[2 * k] * g) >> 12;
+            _acc[2 * k + 1] += (_tmp[2 * k + 1] * g) >> 12;
+        }
+    }
+    for (size_t i = 0; i < kBlockFrames * 2; ++i) {
+        _out[i] = static_cast<int16_t>(std::clamp<int32_t>(_acc[i], INT16_MIN, INT16_MAX));
+    }
+
+    const auto us = static_cast<uint32_t>(esp_timer_get_time() - start);
+    if (us > _max_block_us.load(std::memory_order_relaxed)) {
+        _max_block_us.store(us, std::memory_order_relaxed);
+    }
+    const uint32_t avg = _block_us.load(std::memory_order_relaxed);
+    _block_us.store(avg == 0 ? us : avg + ((static_cast<int32_t>(us) - static_cast<int32_t>(avg)) >> 4),
+                    std::memory_order_relaxed);
+
+    _output.write(_out, kBlockFrames, _output.ctx);
+    _blocks.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
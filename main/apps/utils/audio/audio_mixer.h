@@ -0,0 +1,180 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "pcm.h"
+#include "resampler.h"
+#include "spsc_ring.h"
+
+/**
+ * The one owner of the speaker output, every sound in the firmware is a stream mixed in here
+ *
+ * A mixer task renders stereo blocks of kBlockFrames at the output rate and hands them to the output, whose write
+ * blocks on the DMA and so paces the task. Streams come in two kinds. A push stream has a ring its client write()s
+ * into from any one task, the mixer drains it. A pull stream has a callback the mixer task calls for exactly the
+ * frames a block needs, for sources that keep their own clock like the Audio Loopback jitter buffer. Either kind runs
+ * at its own rate, mono or stereo, and is converted to the output rate by its own polyphase Resampler at the quality
+ * it asks for, a stream at the output rate passes through.
+ *
+ * Per block every stream gets its gain, the master volume unless it opts out, and the duck gain of its role, all
+ * ramped across the block so a change never clicks. Music is ducked while a Notification or Voice stream plays. The
+ * rings and conversion buffers are allocated by open(), the mixer task itself never allocates. With no stream
+ * playing the task sleeps and writes nothing, the output is expected to play silence on its own.
+ */
+class AudioMixer {
+public:
+    enum class Role : uint8_t {
+        Music = 0,     // Ducked while a Notification or Voice stream plays
+        System,        // Key clicks and UI sounds, neither ducked nor ducking
+        Notification,  // Ducks Music
+        Voice,         // Ducks Music, e.g. the loopback
+    };
+
+    static constexpr size_t kMaxStreams  = 6;
+    static constexpr size_t kBlockFrames = 256;
+
+    // Fastest stream rate against the output rate
+    static constexpr uint32_t kMaxRateRatio = 2;
+    // Unity master volume, the gain grows with the square of the volume like the M5 speaker's did
+    static constexpr uint8_t kUnityVolume = 64;
+
+    /** Output side, blocks until count interleaved stereo frames are queued, false on an error */
+    using WriteFn = bool (*)(const int16_t* frames, size_t count, void* ctx);
+    /** Pull stream source, called from the mixer task for frames frames of the stream's format, must not block */
+    using PullFn = void (*)(int16_t* out, size_t frames, void* ctx);
+
+    struct Output_t {
+        uint32_t sample_rate = 48000;
+        WriteFn write        = nullptr;
+        void* ctx            = nullptr;
+    };
+
+    struct StreamConfig_t {
+        Role role                  = Role::Music;
+        uint32_t sample_rate       = 48000;
+        uint8_t channels           = 2;        // 1 or 2
+        size_t buffer_frames       = 2048;     // Push streams, room in the ring
+        bool master                = true;     // Follows setVolume(), off for sources with a volume of their own
+        PullFn pull                = nullptr;  // Makes it a pull stream
+        void* ctx                  = nullptr;
+        Resampler::Quality quality = Resampler::Quality::Medium;  // Conversion to the output rate, if it differs
+    };
+
+    struct Stats_t {
+        uint32_t blocks       = 0;  // Written to the output
+        uint32_t underruns    = 0;  // Blocks a push stream ran dry in, the tail of every sound counts once
+        uint32_t max_block_us = 0;  // Mixing only, without the output write
+        uint32_t block_us     = 0;  // Same, averaged
+        uint8_t streams       = 0;  // Open
+        bool ducking          = false;
+    };
+
+    AudioMixer() = default;
+    ~AudioMixer();
+    AudioMixer(const AudioMixer&)            = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    /** Starts the mixer task on the output */
+    bool begin(const Output_t& output);
+    /** Stops the task, streams still open are closed */
+    void end();
+    bool isRunning() const
+    {
+        return _task != nullptr;
+    }
+    uint32_t sampleRate() const
+    {
+        return _output.sample_rate;
+    }
+
+    /** A stream id, -1 if every slot is taken, the format is out of range or memory is short */
+    int open(const StreamConfig_t& config);
+    /** Waits for the mixer to let go of the stream, drops whatever it still buffered */
+    void close(int stream);
+
+    /** Push stream client. Queues up to count frames, waiting up to wait ticks for room, returns how many it took */
+    size_t write(int stream, const int16_t* frames, size_t count, TickType_t wait);
+    /** Push stream client. Drops what is buffered, for a stop or a seek, returns once the mixer did */
+    void flush(int stream);
+    /** Frames waiting in the ring */
+    size_t buffered(int stream) const;
+
+    /** Any task. Linear gain of one stream in [0, 1], ramped in over the next block */
+    void setGain(int stream, float gain);
+
+    /** Any task. Master volume 0..255 of the streams that follow it */
+    void setVolume(uint8_t volume)
+    {
+        _volume.store(volume, std::memory_order_relaxed);
+    }
+    uint8_t getVolume() const
+    {
+        return _volume.load(std::memory_order_relaxed);
+    }
+
+    Stats_t stats() const;
+
+private:
+    enum class Slot : uint8_t {
+        Free = 0,
+        Opening,  // Client, setting it up
+        Open,
+        Closing,  // Client asked, the mixer lets go
+        Closed,   // Mixer let go, the client frees it
+    };
+
+    struct Stream_t {
+        std::atomic<Slot> state{Slot::Free};
+        StreamConfig_t config;
+        SpscRing<int16_t> ring;
+        Resampler src;
+        std::atomic<uint16_t> gain{32768};  // Q15, 32768 is unity
+        std::atomic<bool> flush{false};
+        int32_t applied = 0;  // Q12 gain the last block ended at, -1 before the first
+        bool playing    = false;
+    };
+
+    static void taskMain(void* arg);
+    void taskLoop();
+    bool mixBlock();
+    void service(Stream_t& s);
+    bool active(const Stream_t& s) const;
+    void resample(Stream_t& s, int16_t* out, size_t frames);
+    int32_t targetGain(const Stream_t& s, int32_t duck) const;
+    Stream_t* get(int stream);
+    const Stream_t* get(int stream) const;
+    void release(Stream_t& s);
+    void wake();
+
+    Output_t _output;
+    Stream_t _streams[kMaxStreams];
+    TaskHandle_t _task          = nullptr;
+    SemaphoreHandle_t _wake_sem = nullptr;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _task_done{true};
+    std::atomic<uint8_t> _volume{kUnityVolume};
+
+    // Mixer task
+    int32_t _duck      = 32768;  // Q15, applied to Music
+    int32_t _duck_down = 0;      // Per block
+    int32_t _duck_up   = 0;
+    alignas(pcm::kAlign) int32_t _acc[kBlockFrames * 2];
+    alignas(pcm::kAlign) int16_t _tmp[kBlockFrames * 2];
+    alignas(pcm::kAlign) int16_t _mono[kBlockFrames];
+    alignas(pcm::kAlign) int16_t _out[kBlockFrames * 2];
+
+    std::atomic<uint32_t> _blocks{0};
+    std::atomic<uint32_t> _underruns{0};
+    std::atomic<uint32_t> _max_block_us{0};
+    std::atomic<uint32_t> _block_us{0};
+    std::atomic<bool> _ducking{false};
+};
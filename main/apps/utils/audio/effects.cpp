@@ -0,0 +1,410 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "effects.h"
+#include "pcm.h"
+#include <algorithm>
+#include <cmath>
+
+namespace dsp {
+
+static constexpr float kPi = 3.14159265358979f;
+
+static float db_to_gain(float db)
+{
+    return std::pow(10.0f, db / 20.0f);
+}
+
+// One pole smoothing coefficient that covers about 63% of a step in ms
+static float time_coeff(float ms, float sample_rate)
+{
+    const float samples = std::max(ms * 1e-3f * sample_rate, 1.0f);
+    return 1.0f - std::exp(-1.0f / samples);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Biquad                                   */
+/* -------------------------------------------------------------------------- */
+
+BiquadCoeffs_t design(Band type, float sample_rate, float freq, float q, float gain_db)
+{
+    BiquadCoeffs_t c;
+    if (type == Band::Off) {
+        return c;
+    }
+
+    freq               = std::clamp(freq, 10.0f, sample_rate * 0.49f);
+    q                  = std::max(q, 0.1f);
+    const float w0     = 2.0f * kPi * freq / sample_rate;
+    const float cosw   = std::cos(w0);
+    const float alpha  = std::sin(w0) / (2.0f * q);
+    const float a      = std::pow(10.0f, gain_db / 40.0f);
+    const float sqrt_a = 2.0f * std::sqrt(a) * alpha;
+
+    float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a0 = 1.0f, a1 = 0.0f, a2 = 0.0f;
+    switch (type) {
+        case Band::HighPass:
+            b0 = (1.0f + cosw) / 2.0f;
+            b1 = -(1.0f + cosw);
+            b2 = (1.0f + cosw) / 2.0f;
+            a0 = 1.0f + alpha;
+            a1 = -2.0f * cosw;
+            a2 = 1.0f - alpha;
+            break;
+        case Band::LowShelf:
+            b0 = a * ((a + 1.0f) - (a - 1.0f) * cosw + sqrt_a);
+            b1 = 2.0f * a * ((a - 1.0f) - (a + 1.0f) * cosw);
+            b2 = a * ((a + 1.0f) - (a - 1.0f) * cosw - sqrt_a);
+            a0 = (a + 1.0f) + (a - 1.0f) * cosw + sqrt_a;
+            a1 = -2.0f * ((a - 1.0f) + (a + 1.0f) * cosw);
+            a2 = (a + 1.0f) + (a - 1.0f) * cosw - sqrt_a;
+            break;
+        case Band::Peaking:
+            b0 = 1.0f + alpha * a;
+            b1 = -2.0f * cosw;
+            b2 = 1.0f - alpha * a;
+            a0 = 1.0f + alpha / a;
+            a1 = -2.0f * cosw;
+            a2 = 1.0f - alpha / a;
+            break;
+        case Band::HighShelf:
+            b0 = a * ((a + 1.0f) + (a - 1.0f) * cosw + sqrt_a);
+            b1 = -2.0f * a * ((a - 1.0f) + (a + 1.0f) * cosw);
+            b2 = a * ((a + 1.0f) + (a - 1.0f) * cosw - sqrt_a);
+            a0 = (a + 1.0f) - (a - 1.0f) * cosw + sqrt_a;
+            a1 = 2.0f * ((a - 1.0f) - (a + 1.0f) * cosw);
+            a2 = (a + 1.0f) - (a - 1.0f) * cosw - sqrt_a;
+            break;
+        case Band::Notch:
+            b0 = 1.0f;
+            b1 = -2.0f * cosw;
+            b2 = 1.0f;
+            a0 = 1.0f + alpha;
+            a1 = -2.0f * cosw;
+            a2 = 1.0f - alpha;
+            break;
+        default:
+            break;
+    }
+
+    c.b0 = b0 / a0;
+    c.b1 = b1 / a0;
+    c.b2 = b2 / a0;
+    c.a1 = a1 / a0;
+    c.a2 = a2 / a0;
+    return c;
+}
+
+void Biquad::process(float* x, size_t count)
+{
+    const BiquadCoeffs_t c = _c;
+    float z1               = _z1;
+    float z2               = _z2;
+    for (size_t i = 0; i < count; ++i) {
+        const float in  = x[i];
+        const float out = c.b0 * in + z1;
+        z1              = c.b1 * in - c.a1 * out + z2;
+        z2              = c.b2 * in - c.a2 * out;
+        x[i]            = out;
+    }
+    _z1 = z1;
+    _z2 = z2;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Noise gate                                 */
+/* -------------------------------------------------------------------------- */
+
+void NoiseGate::configure(const Config_t& config, float sample_rate)
+{
+    _open_level  = db_to_gain(config.threshold_db);
+    _close_level = _open_level * 0.5f;
+    _range       = db_to_gain(std::min(config.range_db, 0.0f));
+    // The detector averages over a few ms so the crest of hiss doesn't hold the gate open, and falls faster than
+    // the gain so the hold starts counting as soon as the signal stops
+    _env_attack  = time_coeff(1.0f, sample_rate);
+    _env_release = time_coeff(20.0f, sample_rate);
+    _attack      = time_coeff(config.attack_ms, sample_rate);
+    _release     = time_coeff(config.release_ms, sample_rate);
+    _hold        = static_cast<uint32_t>(config.hold_ms * 1e-3f * sample_rate);
+}
+
+void NoiseGate::reset()
+{
+    _env  = 0.0f;
+    _gain = _range;
+    _held = 0;
+    _open = false;
+}
+
+void NoiseGate::process(float* x, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float level = std::fabs(x[i]);
+        _env += (level - _env) * (level > _env ? _env_attack : _env_release);
+
+        if (_env >= _open_level) {
+            _open = true;
+            _held = 0;
+        } else if (_env >= _close_level) {
+            _held = 0;
+        } else if (_open && ++_held > _hold) {
+            _open = false;
+        }
+
+        const float target = _open ? 1.0f : _range;
+        _gain += (target - _gain) * (target > _gain ? _attack : _release);
+        x[i] *= _gain;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Compressor                                 */
+/* -------------------------------------------------------------------------- */
+
+void Compressor::configure(const Config_t& config, float sample_rate)
+{
+    _threshold_db = config.threshold_db;
+    _slope        = 1.0f - 1.0f / std::max(config.ratio, 1.0f);
+    _makeup_db    = config.makeup_db;
+    _attack       = time_coeff(config.attack_ms, sample_rate);
+    _release      = time_coeff(config.release_ms, sample_rate);
+}
+
+void Compressor::reset()
+{
+    _env          = 0.0f;
+    _gain         = db_to_gain(_makeup_db);
+    _reduction_db = 0.0f;
+}
+
+void Compressor::process(float* x, size_t count)
+{
+    for (size_t start = 0; start < count; start += kGainStep) {
+        const size_t n = std::min(kGainStep, count - start);
+        float* p       = x + start;
+
+        for (size_t i = 0; i < n; ++i) {
+            const float level = std::fabs(p[i]);
+            _env += (level - _env) * (level > _env ? _attack : _release);
+        }
+
+        // The log and the pow are the expensive part, once per step and a linear ramp in between
+        const float over   = 20.0f * std::log10(std::max(_env, 1e-5f)) - _threshold_db;
+        _reduction_db      = over > 0.0f ? over * _slope : 0.0f;
+        const float target = db_to_gain(_makeup_db - _reduction_db);
+        const float step   = (target - _gain) / static_cast<float>(n);
+        for (size_t i = 0; i < n; ++i) {
+            _gain += step;
+            p[i] *= _gain;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Limiter                                  */
+/* -------------------------------------------------------------------------- */
+
+void Limiter::configure(const Config_t& config, float sample_rate)
+{
+    _ceiling = db_to_gain(std::min(config.ceiling_db, 0.0f));
+    _release = time_coeff(config.release_ms, sample_rate);
+}
+
+void Limiter::reset()
+{
+    _gain = 1.0f;
+}
+
+void Limiter::process(float* x, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float level = std::fabs(x[i]);
+        float gain        = _gain + (1.0f - _gain) * _release;
+        if (level * gain > _ceiling) {
+            gain = _ceiling / level;
+        }
+        _gain = gain;
+        x[i] *= gain;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Howl suppression                              */
+/* -------------------------------------------------------------------------- */
+
+// Pole radius of the tracker, about 250 Hz wide at 16 kHz: narrow enough to leave speech mostly alone
+static constexpr float kTrackerRadius = 0.95f;
+static constexpr float kTrackerStep   = 0.002f;
+static constexpr float kPowerAverage  = 1.0f / 64.0f;
+
+void HowlSuppressor::configure(const Config_t& config, float sample_rate)
+{
+    const float level = db_to_gain(config.min_level_db);
+    _config           = config;
+    _sample_rate      = sample_rate;
+    _min_level        = level * level;
+    _min_depth        = std::pow(10.0f, config.depth_db / 10.0f);
+    for (int i = 0; i < _count; ++i) {
+        _notch[i].setCoeffs(design(Band::Notch, _sample_rate, _notch_hz[i], _config.notch_q, 0.0f));
+    }
+}
+
+void HowlSuppressor::reset()
+{
+    _count     = 0;
+    _oldest    = 0;
+    _a         = 0.0f;
+    _s1        = 0.0f;
+    _s2        = 0.0f;
+    _power     = 0.0f;
+    _candidate = 0.0f;
+    _held_ms   = 0.0f;
+}
+
+float HowlSuppressor::trackedFrequency() const
+{
+    const float c = std::clamp(-_a / 2.0f, -1.0f, 1.0f);
+    return std::acos(c) * _sample_rate / (2.0f * kPi);
+}
+
+void HowlSuppressor::place_notch(float freq)
+{
+    // A howl close to an existing notch means it sits a little off, move that one instead of spending another
+    int slot = -1;
+    for (int i = 0; i < _count; ++i) {
+        if (std::fabs(_notch_hz[i] - freq) < freq * 0.03f) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        if (_count < kMaxNotches) {
+            slot = _count++;
+        } else {
+            slot    = _oldest;
+            _oldest = (_oldest + 1) % kMaxNotches;
+        }
+        _notch[slot].reset();
+    }
+    _notch_hz[slot] = freq;
+    _notch[slot].setCoeffs(design(Band::Notch, _sample_rate, freq, _config.notch_q, 0.0f));
+}
+
+void HowlSuppressor::process(float* x, size_t count)
+{
+    for (int i = 0; i < _count; ++i) {
+        _notch[i].process(x, count);
+    }
+
+    // Track on what is left after the notches, so a second howl is found while the first stays notched
+    constexpr float r2 = kTrackerRadius * kTrackerRadius;
+    float in_energy    = 0.0f;
+    float out_energy   = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        const float s0 = x[i] - kTrackerRadius * _a * _s1 - r2 * _s2;
+        const float y  = s0 + _a * _s1 + _s2;
+        _power += (_s1 * _s1 - _power) * kPowerAverage;
+        _a = std::clamp(_a - kTrackerStep * y * _s1 / (_power + 1e-9f), -1.99f, 1.99f);
+        _s2 = _s1;
+        _s1 = s0;
+        in_energy += x[i] * x[i];
+        out_energy += y * y;
+    }
+
+    const float freq     = trackedFrequency();
+    const float block_ms = static_cast<float>(count) * 1000.0f / _sample_rate;
+    const bool loud      = in_energy > _min_level * static_cast<float>(count);
+    const bool tonal     = in_energy > _min_depth * out_energy;
+    const bool steady    = std::fabs(freq - _candidate) < std::max(20.0f, freq * 0.02f);
+    _held_ms             = loud && tonal && steady ? _held_ms + block_ms : 0.0f;
+    _candidate           = freq;
+    if (_held_ms >= _config.hold_ms) {
+        place_notch(freq);
+        _held_ms = 0.0f;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Chain                                   */
+/* -------------------------------------------------------------------------- */
+
+void EffectsChain::init(float sample_rate)
+{
+    _sample_rate = sample_rate;
+    _config      = Config_t();
+    configure(_config);
+    reset();
+}
+
+void EffectsChain::configure(const Config_t& config)
+{
+    for (int i = 0; i < kMaxEqBands; ++i) {
+        const auto& band = config.eq[i];
+        _eq[i].setCoeffs(design(band.type, _sample_rate, band.freq, band.q, band.gain_db));
+        if (band.type != _config.eq[i].type) {
+            _eq[i].reset();
+        }
+    }
+    _gate.configure(config.gate, _sample_rate);
+    _comp.configure(config.comp, _sample_rate);
+    _limit.configure(config.limit, _sample_rate);
+    _howl.configure(config.howl, _sample_rate);
+
+    if (config.gate_on && !_config.gate_on) {
+        _gate.reset();
+    }
+    if (config.comp_on && !_config.comp_on) {
+        _comp.reset();
+    }
+    if (config.limit_on && !_config.limit_on) {
+        _limit.reset();
+    }
+    if (config.howl_on && !_config.howl_on) {
+        _howl.reset();
+    }
+    _config = config;
+}
+
+void EffectsChain::reset()
+{
+    for (auto& eq : _eq) {
+        eq.reset();
+    }
+    _gate.reset();
+    _comp.reset();
+    _limit.reset();
+    _howl.reset();
+}
+
+void EffectsChain::process(int16_t* samples, size_t count)
+{
+    for (size_t start = 0; start < count; start += kMaxBlock) {
+        const size_t n = std::min(kMaxBlock, count - start);
+        int16_t* p     = samples + start;
+
+        pcm::toFloat(_block, p, n);
+        for (int b = 0; b < kMaxEqBands; ++b) {
+            if (_config.eq[b].type != Band::Off) {
+                _eq[b].process(_block, n);
+            }
+        }
+        if (_config.howl_on) {
+            _howl.process(_block, n);
+        }
+        if (_config.gate_on) {
+            _gate.process(_block, n);
+        }
+        if (_config.comp_on) {
+            _comp.process(_block, n);
+        }
+        if (_config.limit_on) {
+            _limit.process(_block, n);
+        }
+        pcm::fromFloat(p, _block, n);
+    }
+}
+
+}  // namespace dsp
@@ -0,0 +1,261 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Block based mono effects for live audio
+ *
+ * Each kernel processes a block of float samples in place, full scale is +-1.0. None of them allocate, and the cost
+ * per sample is bounded by the configuration rather than the input, so a chain of them has a fixed CPU budget: at most
+ * kMaxEqBands + kMaxNotches biquads, a gate, a compressor and a limiter. Parameters are set with configure(), on the
+ * task that calls process().
+ *
+ * Nothing here depends on the device, see simulator/effects_main.cpp for the host checks and benchmark.
+ */
+namespace dsp {
+
+static constexpr size_t kMaxBlock = 128;
+static constexpr int kMaxEqBands  = 4;
+static constexpr int kMaxNotches  = 4;
+
+enum class Band : uint8_t {
+    Off,
+    HighPass,
+    LowShelf,
+    Peaking,
+    HighShelf,
+    Notch,
+};
+
+struct BiquadCoeffs_t {
+    float b0 = 1.0f;
+    float b1 = 0.0f;
+    float b2 = 0.0f;
+    float a1 = 0.0f;
+    float a2 = 0.0f;
+};
+
+/** Audio EQ cookbook designs, gain_db only applies to the shelves and Peaking. Off passes through */
+BiquadCoeffs_t design(Band type, float sample_rate, float freq, float q, float gain_db);
+
+/** Transposed direct form II, coefficients can change between blocks without a click */
+class Biquad {
+public:
+    void setCoeffs(const BiquadCoeffs_t& coeffs)
+    {
+        _c = coeffs;
+    }
+    void reset()
+    {
+        _z1 = 0.0f;
+        _z2 = 0.0f;
+    }
+    void process(float* x, size_t count);
+
+private:
+    BiquadCoeffs_t _c;
+    float _z1 = 0.0f;
+    float _z2 = 0.0f;
+};
+
+/** Attenuates by range_db while the level stays under the threshold, opens again 6 dB above where it closed */
+class NoiseGate {
+public:
+    struct Config_t {
+        float threshold_db = -50.0f;
+        float range_db     = -40.0f;
+        float attack_ms    = 1.0f;
+        float hold_ms      = 50.0f;
+        float release_ms   = 100.0f;
+    };
+
+    void configure(const Config_t& config, float sample_rate);
+    void reset();
+    void process(float* x, size_t count);
+    bool isOpen() const
+    {
+        return _open;
+    }
+
+private:
+    float _open_level  = 0.0f;
+    float _close_level = 0.0f;
+    float _range       = 0.0f;
+    float _env_attack  = 0.0f;
+    float _env_release = 0.0f;
+    float _attack      = 0.0f;
+    float _release     = 0.0f;
+    uint32_t _hold     = 0;
+    float _env         = 0.0f;
+    float _gain        = 1.0f;
+    uint32_t _held     = 0;
+    bool _open         = false;
+};
+
+/** Peak compressor, hard knee. The gain is computed every kGainStep samples and ramped in between */
+class Compressor {
+public:
+    struct Config_t {
+        float threshold_db = -24.0f;
+        float ratio        = 3.0f;
+        float attack_ms    = 5.0f;
+        float release_ms   = 120.0f;
+        float makeup_db    = 6.0f;
+    };
+
+    void configure(const Config_t& config, float sample_rate);
+    void reset();
+    void process(float* x, size_t count);
+    /** Gain reduction of the last block, positive dB */
+    float reduction() const
+    {
+        return _reduction_db;
+    }
+
+private:
+    static constexpr size_t kGainStep = 16;
+
+    float _threshold_db = 0.0f;
+    float _slope        = 0.0f;
+    float _makeup_db    = 0.0f;
+    float _attack       = 0.0f;
+    float _release      = 0.0f;
+    float _env          = 0.0f;
+    float _gain         = 1.0f;
+    float _reduction_db = 0.0f;
+};
+
+/** Peak limiter without lookahead, the output never exceeds the ceiling */
+class Limiter {
+public:
+    struct Config_t {
+        float ceiling_db = -1.0f;
+        float release_ms = 50.0f;
+    };
+
+    void configure(const Config_t& config, float sample_rate);
+    void reset();
+    void process(float* x, size_t count);
+
+private:
+    float _ceiling = 1.0f;
+    float _release = 0.0f;
+    float _gain    = 1.0f;
+};
+
+/**
+ * Acoustic feedback suppression
+ *
+ * An adaptive notch (a second order lattice whose centre follows the strongest sinusoid by normalized LMS) runs on
+ * the output. Howl is a tone that holds: when the notch takes away more than depth_db of a block above min_level_db,
+ * at a steady frequency, for hold_ms, a fixed narrow notch goes in at that frequency. Up to kMaxNotches stay in place
+ * until reset(), after that the oldest is retuned.
+ */
+class HowlSuppressor {
+public:
+    struct Config_t {
+        float min_level_db = -45.0f;
+        float depth_db     = 15.0f;
+        float hold_ms      = 250.0f;
+        float notch_q      = 20.0f;
+    };
+
+    void configure(const Config_t& config, float sample_rate);
+    void reset();
+    void process(float* x, size_t count);
+
+    int notchCount() const
+    {
+        return _count;
+    }
+    float notchFrequency(int index) const
+    {
+        return _notch_hz[index];
+    }
+    /** Frequency the tracker sits on now */
+    float trackedFrequency() const;
+
+private:
+    Config_t _config;
+    float _sample_rate = 16000.0f;
+    float _min_level   = 0.0f;
+    float _min_depth   = 0.0f;
+
+    Biquad _notch[kMaxNotches];
+    float _notch_hz[kMaxNotches] = {};
+    int _count                   = 0;
+    int _oldest                  = 0;
+
+    // Tracker, a = -2 cos(w)
+    float _a         = 0.0f;
+    float _s1        = 0.0f;
+    float _s2        = 0.0f;
+    float _power     = 0.0f;
+    float _candidate = 0.0f;
+    float _held_ms   = 0.0f;
+
+    void place_notch(float freq);
+};
+
+/** EQ bands, howl notches, gate, compressor and limiter on 16-bit samples, in that order */
+class EffectsChain {
+public:
+    struct EqBand_t {
+        Band type     = Band::Off;
+        float freq    = 1000.0f;
+        float q       = 0.707f;
+        float gain_db = 0.0f;
+    };
+
+    struct Config_t {
+        EqBand_t eq[kMaxEqBands];
+        bool gate_on  = false;
+        bool comp_on  = false;
+        bool limit_on = false;
+        bool howl_on  = false;
+        NoiseGate::Config_t gate;
+        Compressor::Config_t comp;
+        Limiter::Config_t limit;
+        HowlSuppressor::Config_t howl;
+    };
+
+    void init(float sample_rate);
+    /** Keeps the state of stages that stay on, so a change mid stream doesn't click */
+    void configure(const Config_t& config);
+    void reset();
+    void process(int16_t* samples, size_t count);
+
+    const Config_t& config() const
+    {
+        return _config;
+    }
+    const NoiseGate& gate() const
+    {
+        return _gate;
+    }
+    const Compressor& compressor() const
+    {
+        return _comp;
+    }
+    const HowlSuppressor& howl() const
+    {
+        return _howl;
+    }
+
+private:
+    float _sample_rate = 16000.0f;
+    Config_t _config;
+    Biquad _eq[kMaxEqBands];
+    NoiseGate _gate;
+    Compressor _comp;
+    Limiter _limit;
+    HowlSuppressor _howl;
+    float _block[kMaxBlock];
+};
+
+}  // namespace dsp
@@ -0,0 +1,111 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ima_adpcm.h"
+#include <algorithm>
+
+namespace adpcm {
+
+static constexpr int16_t kStepTable[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+    544,   598,   658,   724,   796,   876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+    9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static constexpr int8_t kIndexTable[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+// Applies one code to the state, shared by both directions so the encoder tracks exactly what a decoder rebuilds
+static inline void apply(State_t& s, uint8_t code)
+{
+    const int32_t step = kStepTable[s.index];
+    int32_t diff       = step >> 3;
+    if (code & 4) {
+        diff += step;
+    }
+    if (code & 2) {
+        diff += step >> 1;
+    }
+    if (code & 1) {
+        diff += step >> 2;
+    }
+    s.predictor = std::clamp<int32_t>((code & 8) ? s.predictor - diff : s.predictor + diff, INT16_MIN, INT16_MAX);
+    s.index     = std::clamp<int32_t>(s.index + kIndexTable[code & 7], 0, 88);
+}
+
+static inline uint8_t encode(State_t& s, int16_t sample)
+{
+    int32_t diff = sample - s.predictor;
+    uint8_t code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    int32_t step = kStepTable[s.index];
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 2;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 1;
+    }
+    apply(s, code);
+    return code;
+}
+
+void encodeBlock(const int16_t* frames, size_t channels, State_t* states, uint8_t* out)
+{
+    // The header sample is stored as is, the predictor restarts from it
+    for (size_t c = 0; c < channels; ++c) {
+        const int16_t first = frames[c];
+        states[c].predictor = first;
+        out[0]              = static_cast<uint8_t>(first & 0xFF);
+        out[1]              = static_cast<uint8_t>((first >> 8) & 0xFF);
+        out[2]              = static_cast<uint8_t>(states[c].index);
+        out[3]              = 0;
+        out += 4;
+    }
+    for (size_t group = 1; group < kFramesPerBlock; group += 8) {
+        for (size_t c = 0; c < channels; ++c) {
+            for (size_t i = 0; i < 8; i += 2) {
+                const uint8_t lo = encode(states[c], frames[(group + i) * channels + c]);
+                const uint8_t hi = encode(states[c], frames[(group + i + 1) * channels + c]);
+                *out++           = static_cast<uint8_t>(lo | (hi << 4));
+            }
+        }
+    }
+}
+
+void decodeBlock(const uint8_t* in, size_t channels, int16_t* frames)
+{
+    State_t states[2];
+    channels = std::min<size_t>(channels, 2);
+    for (size_t c = 0; c < channels; ++c) {
+        states[c].predictor = static_cast<int16_t>(in[0] | (in[1] << 8));
+        states[c].index     = std::min<int32_t>(in[2], 88);
+        frames[c]           = static_cast<int16_t>(states[c].predictor);
+        in += 4;
+    }
+    for (size_t group = 1; group < kFramesPerBlock; group += 8) {
+        for (size_t c = 0; c < channels; ++c) {
+            for (size_t i = 0; i < 8; i += 2) {
+                const uint8_t byte = *in++;
+                apply(states[c], byte & 0x0F);
+                frames[(group + i) * channels + c] = static_cast<int16_t>(states[c].predictor);
+                apply(states[c], byte >> 4);
+                frames[(group + i + 1) * channels + c] = static_cast<int16_t>(states[c].predictor);
+            }
+        }
+    }
+}
+
+}  // namespace adpcm
@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * IMA ADPCM in the block layout of WAVE format 0x0011 (4 bits per sample, a quarter of 16-bit PCM)
+ *
+ * A block holds kBlockBytesPerChannel bytes per channel: a 4 byte header per channel with the first sample and the
+ * step index, then the other samples as nibbles, low nibble first, in 4 byte groups of eight samples that alternate
+ * between the channels. Mono or stereo.
+ */
+namespace adpcm {
+
+static constexpr size_t kBlockBytesPerChannel = 512;
+static constexpr size_t kFramesPerBlock       = (kBlockBytesPerChannel - 4) * 2 + 1;
+
+/** Encoder state of one channel, carried from block to block */
+struct State_t {
+    int32_t predictor = 0;
+    int32_t index     = 0;
+};
+
+inline size_t blockBytes(size_t channels)
+{
+    return kBlockBytesPerChannel * channels;
+}
+
+/** kFramesPerBlock interleaved frames into blockBytes(channels) bytes, states holds one State_t per channel */
+void encodeBlock(const int16_t* frames, size_t channels, State_t* states, uint8_t* out);
+
+/** blockBytes(channels) bytes back into kFramesPerBlock interleaved frames */
+void decodeBlock(const uint8_t* in, size_t channels, int16_t* frames);
+
+}  // namespace adpcm
@@ -0,0 +1,217 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "jitter_buffer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// A delay error beyond this is a new target rather than drift, jump instead of slewing there
+static constexpr uint32_t kResyncMs = 30;
+// The PI loop settles an error with about this time constant, critically damped
+static constexpr float kSettleSeconds = 2.0f;
+static constexpr float kDelayAverage  = 1.0f / 32.0f;
+// 0.2% is far beyond any crystal, 2% (about a third of a semitone) only while closing a large error
+static constexpr float kMaxDriftPpm = 2000.0f;
+static constexpr float kMaxRatePpm  = 20000.0f;
+
+bool JitterBuffer::init(size_t capacity, uint32_t sample_rate)
+{
+    if (!_ring.init(capacity)) {
+        return false;
+    }
+    _sample_rate = sample_rate;
+    _kp          = 1e6f / (static_cast<float>(sample_rate) * kSettleSeconds);
+    _ki          = _kp * _kp * static_cast<float>(sample_rate) * 1e-6f / 4.0f;
+
+    _stamp_us.store(0);
+    _stamp_written.store(0);
+    _last_push.store(0);
+    _overruns.store(0);
+    _underruns.store(0);
+    _resyncs.store(0);
+    std::memset(_history, 0, sizeof(_history));
+    _priming   = true;
+    _fade_in   = 0;
+    _delay_avg = 0.0f;
+    _drift_ppm = 0.0f;
+    set_rate(0.0f);
+    return true;
+}
+
+void JitterBuffer::deinit()
+{
+    _ring.deinit();
+}
+
+void JitterBuffer::setTarget(uint32_t samples)
+{
+    // Leave room for a push and a pull on top of the target
+    const uint32_t limit = static_cast<uint32_t>(_ring.capacity() * 3 / 4);
+    _target.store(std::min(samples, limit), std::memory_order_relaxed);
+}
+
+size_t JitterBuffer::push(const int16_t* samples, size_t count, int64_t now_us)
+{
+    const size_t written = _ring.write(samples, count);
+    if (written < count) {
+        _overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    _last_push.store(static_cast<uint32_t>(written), std::memory_order_relaxed);
+    _stamp_us.store(static_cast<uint32_t>(now_us), std::memory_order_relaxed);
+    _stamp_written.store(static_cast<uint32_t>(_ring.written()), std::memory_order_release);
+    return written;
+}
+
+double JitterBuffer::capturePosition(int64_t now_us) const
+{
+    const uint32_t stamped = _stamp_written.load(std::memory_order_acquire);
+    const uint32_t stamp   = _stamp_us.load(std::memory_order_relaxed);
+    const uint32_t pushed  = _last_push.load(std::memory_order_relaxed);
+    const size_t written   = _ring.written();
+    double position        = static_cast<double>(written);
+
+    // Samples captured since the last push count too, at most one more push worth. A push that landed between the
+    // loads above doesn't match its stamp yet, one stamped after now was just pushed, both count as zero
+    const int32_t elapsed_us = static_cast<int32_t>(static_cast<uint32_t>(now_us) - stamp);
+    if (static_cast<uint32_t>(written) == stamped && elapsed_us > 0) {
+        const double in_flight = static_cast<double>(elapsed_us) * 1e-6 * static_cast<double>(_sample_rate);
+        position += std::min(in_flight, static_cast<double>(pushed));
+    }
+    return position;
+}
+
+float JitterBuffer::measure_delay(int64_t now_us) const
+{
+    double delay = capturePosition(now_us) - static_cast<double>(_ring.consumed());
+    if (!_priming) {
+        // The interpolator holds on to the last few samples it read
+        delay += 3.0 - static_cast<double>(_phase) / kPhaseOne;
+    }
+    return static_cast<float>(delay);
+}
+
+void JitterBuffer::set_rate(float ppm)
+{
+    ppm   = std::clamp(ppm, -kMaxRatePpm, kMaxRatePpm);
+    _step = kPhaseOne + static_cast<int32_t>(std::lround(static_cast<float>(kPhaseOne) * ppm * 1e-6f));
+    _stat_ppm.store(static_cast<int32_t>(std::lround(ppm)), std::memory_order_relaxed);
+}
+
+bool JitterBuffer::next_sample(int32_t& out)
+{
+    while (_phase >= kPhaseOne) {
+        int16_t x = 0;
+        if (_ring.read(&x, 1) == 0) {
+            return false;
+        }
+        _history[0] = _history[1];
+        _history[1] = _history[2];
+        _history[2] = _history[3];
+        _history[3] = x;
+        _phase -= kPhaseOne;
+    }
+
+    // Catmull-Rom between history[1] and history[2], coefficients doubled to stay integer
+    const int64_t xm1 = _history[0];
+    const int64_t x0  = _history[1];
+    const int64_t x1  = _history[2];
+    const int64_t x2  = _history[3];
+    const int64_t t   = _phase >> (kPhaseBits - 15);
+    int64_t v         = 3 * (x0 - x1) + x2 - xm1;
+    v                 = ((v * t) >> 15) + 2 * xm1 - 5 * x0 + 4 * x1 - x2;
+    v                 = ((v * t) >> 15) + x1 - xm1;
+    v                 = ((v * t) >> 15) + 2 * x0;
+    out               = static_cast<int32_t>(std::clamp<int64_t>(v >> 1, INT16_MIN, INT16_MAX));
+
+    _phase += _step;
+    return true;
+}
+
+void JitterBuffer::pull(int16_t* out, size_t count, int64_t now_us)
+{
+    const float target = static_cast<float>(_target.load(std::memory_order_relaxed));
+    const float delay  = measure_delay(now_us);
+    size_t i           = 0;
+
+    if (_priming) {
+        if (delay < target || _ring.size() < 4) {
+            std::memset(out, 0, count * sizeof(int16_t));
+            _stat_delay.store(static_cast<int32_t>(delay), std::memory_order_relaxed);
+            return;
+        }
+        // Start right on the target, with three samples to fill the interpolator and silence before them so the fade
+        // starts from zero
+        const size_t excess = std::min(static_cast<size_t>(delay - target), _ring.size() - 4);
+        _ring.skip(excess);
+        std::memset(_history, 0, sizeof(_history));
+        _phase     = 3 * kPhaseOne;
+        _priming   = false;
+        _fade_in   = kFadeSamples;
+        _delay_avg = delay - static_cast<float>(excess);
+    }
+
+    _delay_avg += (delay - _delay_avg) * kDelayAverage;
+    const float error     = _delay_avg - target;
+    const float resync_at = static_cast<float>(_sample_rate * kResyncMs / 1000);
+
+    if (std::fabs(error) > resync_at) {
+        // Fade out what is playing, then jump. Too much buffered drops the excess, too little starts over
+        _resyncs.fetch_add(1, std::memory_order_relaxed);
+        const size_t fade = std::min<size_t>(kFadeSamples, count);
+        for (int32_t y = 0; i < fade; ++i) {
+            if (!next_sample(y)) {
+                break;
+            }
+            out[i] = static_cast<int16_t>(y * static_cast<int32_t>(fade - i) / static_cast<int32_t>(fade));
+        }
+        if (error < 0.0f) {
+            _priming = true;
+            std::memset(out + i, 0, (count - i) * sizeof(int16_t));
+            _stat_delay.store(static_cast<int32_t>(delay), std::memory_order_relaxed);
+            return;
+        }
+        const size_t skipped = _ring.skip(static_cast<size_t>(delay - target));
+        _delay_avg           = delay - static_cast<float>(skipped);
+        _fade_in             = kFadeSamples;
+    } else {
+        const float dt = static_cast<float>(count) / static_cast<float>(_sample_rate);
+        _drift_ppm     = std::clamp(_drift_ppm + _ki * error * dt, -kMaxDriftPpm, kMaxDriftPpm);
+        set_rate(_drift_ppm + _kp * error);
+    }
+    _stat_delay.store(static_cast<int32_t>(std::lround(_delay_avg)), std::memory_order_relaxed);
+
+    for (int32_t y = 0; i < count; ++i) {
+        if (!next_sample(y)) {
+            // Capture stalled, play silence until the target is buffered again
+            _underruns.fetch_add(1, std::memory_order_relaxed);
+            _priming = true;
+            std::memset(out + i, 0, (count - i) * sizeof(int16_t));
+            return;
+        }
+        if (_fade_in > 0) {
+            y = y * (kFadeSamples - _fade_in) / kFadeSamples;
+            _fade_in--;
+        }
+        out[i] = static_cast<int16_t>(y);
+    }
+}
+
+double JitterBuffer::readPosition() const
+{
+    return static_cast<double>(_ring.consumed()) - 3.0 + static_cast<double>(_phase) / kPhaseOne;
+}
+
+JitterBuffer::Stats_t JitterBuffer::stats() const
+{
+    Stats_t s;
+    s.delay     = _stat_delay.load(std::memory_order_relaxed);
+    s.target    = static_cast<int32_t>(_target.load(std::memory_order_relaxed));
+    s.rate_ppm  = _stat_ppm.load(std::memory_order_relaxed);
+    s.underruns = _underruns.load(std::memory_order_relaxed);
+    s.overruns  = _overruns.load(std::memory_order_relaxed);
+    s.resyncs   = _resyncs.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Mono 16-bit jitter buffer between a capture task and a playback task
+ *
+ * The producer pushes whatever it captured, the consumer pulls exactly what its output needs and always gets it. In
+ * between sits a lock-free SpscRing and a rate controller that holds the delay between the two (samples in the ring
+ * plus those captured since the last push, extrapolated from its timestamp) at the target. The consumer reads the
+ * ring through a cubic interpolator at a slightly variable rate, a PI loop steers that rate so clock drift between the
+ * two sides is absorbed without dropping or inserting samples. Only a target change far from the current delay, or an
+ * underrun, jumps the read position, faded out and back in.
+ *
+ * Timestamps are passed in by the caller, so a host test can run both sides on a synthetic clock.
+ */
+class JitterBuffer {
+public:
+    struct Stats_t {
+        int32_t delay      = 0;  // Samples from producer to consumer, smoothed
+        int32_t target     = 0;
+        int32_t rate_ppm   = 0;  // How much faster than nominal the consumer reads
+        uint32_t underruns = 0;
+        uint32_t overruns  = 0;
+        uint32_t resyncs   = 0;
+    };
+
+    bool init(size_t capacity, uint32_t sample_rate);
+    void deinit();
+
+    /** Any task. Clamped to what the ring can hold */
+    void setTarget(uint32_t samples);
+
+    /** Producer task. Returns how many samples fit, the rest are dropped and counted as an overrun */
+    size_t push(const int16_t* samples, size_t count, int64_t now_us);
+
+    /** Consumer task. Always writes count samples, silence while (re)filling to the target */
+    void pull(int16_t* out, size_t count, int64_t now_us);
+
+    /** Any task */
+    Stats_t stats() const;
+
+    /** Consumer task. Stream position, in pushed samples, of the next sample pull() plays */
+    double readPosition() const;
+
+    /** Producer task. Stream position of the next sample push() stores */
+    size_t written() const
+    {
+        return _ring.written();
+    }
+
+    /** Any task. Stream position of the sample being captured at now_us, extrapolated from the last push */
+    double capturePosition(int64_t now_us) const;
+
+private:
+    static constexpr uint32_t kPhaseBits = 24;
+    static constexpr uint32_t kPhaseOne  = 1u << kPhaseBits;
+    static constexpr int kFadeSamples    = 64;
+
+    SpscRing<int16_t> _ring;
+    uint32_t _sample_rate = 16000;
+    std::atomic<uint32_t> _target{0};
+
+    // Producer side, the stamp is the time of the last push and the stream position it ended at
+    std::atomic<uint32_t> _stamp_us{0};
+    std::atomic<uint32_t> _stamp_written{0};
+    std::atomic<uint32_t> _last_push{0};
+    std::atomic<uint32_t> _overruns{0};
+
+    // Consumer side
+    int16_t _history[4] = {0, 0, 0, 0};
+    uint32_t _phase     = kPhaseOne;
+    uint32_t _step      = kPhaseOne;
+    bool _priming       = true;
+    int _fade_in        = 0;
+    float _delay_avg    = 0.0f;
+    float _drift_ppm    = 0.0f;
+    float _kp           = 0.0f;
+    float _ki           = 0.0f;
+    std::atomic<int32_t> _stat_delay{0};
+    std::atomic<int32_t> _stat_ppm{0};
+    std::atomic<uint32_t> _underruns{0};
+    std::atomic<uint32_t> _resyncs{0};
+
+    float measure_delay(int64_t now_us) const;
+    void set_rate(float ppm);
+    bool next_sample(int32_t& out);
+};
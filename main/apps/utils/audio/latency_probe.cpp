@@ -0,0 +1,105 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "latency_probe.h"
+#include <cmath>
+#include <cstdlib>
+
+namespace latency {
+
+// Galois LFSR feedback masks of primitive polynomials, indexed by order - kMinOrder
+static constexpr uint32_t _taps[] = {0x110, 0x240, 0x500, 0x829, 0x100D, 0x2015, 0x6000};
+
+std::vector<int8_t> makeMls(int order)
+{
+    if (order < kMinOrder || order > kMaxOrder) {
+        return {};
+    }
+    const uint32_t taps = _taps[order - kMinOrder];
+    const size_t length = (1u << order) - 1;
+
+    std::vector<int8_t> mls(length);
+    uint32_t state = 1;
+    for (auto& chip : mls) {
+        const uint32_t bit = state & 1;
+        chip               = bit ? 1 : -1;
+        state >>= 1;
+        if (bit) {
+            state ^= taps;
+        }
+    }
+    return mls;
+}
+
+void correlate(const int8_t* ref, size_t ref_len, const int16_t* signal, size_t lags, int32_t* out)
+{
+    // Four lags at a time share every chip load, the inner loop is then four multiply-adds per chip
+    size_t lag = 0;
+    for (; lag + 4 <= lags; lag += 4) {
+        const int16_t* s = signal + lag;
+        int32_t a0       = 0;
+        int32_t a1       = 0;
+        int32_t a2       = 0;
+        int32_t a3       = 0;
+        for (size_t i = 0; i < ref_len; ++i) {
+            const int32_t r = ref[i];
+            a0 += r * s[i];
+            a1 += r * s[i + 1];
+            a2 += r * s[i + 2];
+            a3 += r * s[i + 3];
+        }
+        out[lag]     = a0;
+        out[lag + 1] = a1;
+        out[lag + 2] = a2;
+        out[lag + 3] = a3;
+    }
+    for (; lag < lags; ++lag) {
+        const int16_t* s = signal + lag;
+        int32_t acc      = 0;
+        for (size_t i = 0; i < ref_len; ++i) {
+            acc += ref[i] * s[i];
+        }
+        out[lag] = acc;
+    }
+}
+
+Peak_t findPeak(const int32_t* corr, size_t lags, float min_ratio)
+{
+    Peak_t peak;
+    if (lags == 0) {
+        return peak;
+    }
+
+    size_t best      = 0;
+    double sum_sq    = 0.0;
+    int64_t best_abs = -1;
+    for (size_t i = 0; i < lags; ++i) {
+        const int64_t v = std::llabs(static_cast<int64_t>(corr[i]));
+        sum_sq += static_cast<double>(v) * static_cast<double>(v);
+        if (v > best_abs) {
+            best_abs = v;
+            best     = i;
+        }
+    }
+    const double rms = std::sqrt(sum_sq / static_cast<double>(lags));
+    peak.ratio       = rms > 0.0 ? static_cast<float>(static_cast<double>(best_abs) / rms) : 0.0f;
+    peak.lag         = static_cast<float>(best);
+
+    // The microphone may be wired inverted, the peak counts either way but is refined on its own sign
+    if (best > 0 && best + 1 < lags) {
+        const double sign = corr[best] < 0 ? -1.0 : 1.0;
+        const double y0   = sign * corr[best - 1];
+        const double y1   = sign * corr[best];
+        const double y2   = sign * corr[best + 1];
+        const double den  = y0 - 2.0 * y1 + y2;
+        if (den < 0.0) {
+            peak.lag += static_cast<float>(0.5 * (y0 - y2) / den);
+        }
+    }
+    peak.found = peak.ratio >= min_ratio;
+    return peak;
+}
+
+}  // namespace latency
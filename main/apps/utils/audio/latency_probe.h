@@ -0,0 +1,45 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Round trip latency measurement
+ *
+ * A maximum length sequence (MLS) is played and recorded back, the lag where the recording correlates best with the
+ * sequence is the latency. An MLS is white and its autocorrelation is a single spike, so the peak stays sharp through
+ * a speaker and a microphone. The sequence chips are +1 / -1, which keeps the correlation an integer sum of 16-bit
+ * samples that fits in 32 bits for any order up to 15.
+ *
+ * Nothing here depends on the device, see simulator/latency_probe_main.cpp for the host check and benchmark.
+ */
+namespace latency {
+
+static constexpr int kMinOrder       = 9;
+static constexpr int kMaxOrder       = 15;
+static constexpr float kMinPeakRatio = 8.0f;
+
+/** 2^order - 1 chips of +1 / -1, empty for an order outside [kMinOrder, kMaxOrder] */
+std::vector<int8_t> makeMls(int order);
+
+/**
+ * out[lag] = sum of ref[i] * signal[lag + i] over i < ref_len, for every lag < lags. signal needs
+ * ref_len + lags - 1 samples
+ */
+void correlate(const int8_t* ref, size_t ref_len, const int16_t* signal, size_t lags, int32_t* out);
+
+struct Peak_t {
+    bool found  = false;
+    float lag   = 0.0f;  // Samples, refined between lags by a parabola through the peak and its neighbours
+    float ratio = 0.0f;  // Peak over the RMS of all lags
+};
+
+/** Strongest lag of a correlation, found only when it stands out from the rest by min_ratio */
+Peak_t findPeak(const int32_t* corr, size_t lags, float min_ratio = kMinPeakRatio);
+
+}  // namespace latency
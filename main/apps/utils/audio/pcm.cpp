@@ -0,0 +1,283 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "pcm.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(ESP_PLATFORM)
+#include <sdkconfig.h>
+#endif
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#define PCM_USE_PIE 1
+// pcm_pie.S, every pointer 16-byte aligned, counts in blocks of eight samples or frames
+extern "C" {
+void pcm_stereo_to_mono_pie(int16_t* dst, const int16_t* src, size_t blocks, const int16_t* ones);
+void pcm_mono_to_stereo_pie(int16_t* dst, const int16_t* src, size_t blocks);
+void pcm_deinterleave_pie(int16_t* left, int16_t* right, const int16_t* src, size_t blocks);
+void pcm_interleave_pie(int16_t* dst, const int16_t* left, const int16_t* right, size_t blocks);
+void pcm_gain_pie(int16_t* dst, const int16_t* src, size_t blocks, const int16_t* lanes, uint32_t shift);
+void pcm_mix_add_pie(int16_t* dst, const int16_t* src, size_t blocks);
+}
+#else
+#define PCM_USE_PIE 0
+#endif
+
+namespace pcm {
+
+static constexpr size_t kLanes = 8;
+
+static inline int16_t saturate(int32_t v)
+{
+    return static_cast<int16_t>(std::clamp<int32_t>(v, INT16_MIN, INT16_MAX));
+}
+
+[[maybe_unused]] static inline bool aligned(const void* p)
+{
+    return (reinterpret_cast<uintptr_t>(p) & (kAlign - 1)) == 0;
+}
+
+Gain_t makeGain(float linear)
+{
+    Gain_t g;
+    if (!(linear > 0.0f)) {
+        g.q15 = 0;
+        return g;
+    }
+    while (linear >= 1.0f && g.shift < 15) {
+        linear *= 0.5f;
+        g.shift++;
+    }
+    g.q15 = static_cast<int16_t>(std::min(std::lround(linear * 32768.0f), 32767L));
+    return g;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Reference                                 */
+/* -------------------------------------------------------------------------- */
+
+void ref::stereoToMono(int16_t* dst, const int16_t* src, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        dst[i] = static_cast<int16_t>((src[i * 2] + src[i * 2 + 1]) >> 1);
+    }
+}
+
+void ref::monoToStereo(int16_t* dst, const int16_t* src, size_t frames)
+{
+    // Backwards, so dst can be src
+    for (size_t i = frames; i-- > 0;) {
+        const int16_t v = src[i];
+        dst[i * 2]      = v;
+        dst[i * 2 + 1]  = v;
+    }
+}
+
+void ref::deinterleave(int16_t* left, int16_t* right, const int16_t* src, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        left[i]  = src[i * 2];
+        right[i] = src[i * 2 + 1];
+    }
+}
+
+void ref::interleave(int16_t* dst, const int16_t* left, const int16_t* right, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        dst[i * 2]     = left[i];
+        dst[i * 2 + 1] = right[i];
+    }
+}
+
+void ref::gain(int16_t* dst, const int16_t* src, size_t count, Gain_t gain)
+{
+    const int32_t q15 = std::max<int32_t>(gain.q15, -32767);
+    const int32_t mul = 1 << std::min<uint8_t>(gain.shift, 15);
+    for (size_t i = 0; i < count; ++i) {
+        const int32_t scaled = (src[i] * q15) >> 15;
+        dst[i]               = saturate(scaled * mul);
+    }
+}
+
+void ref::mixAdd(int16_t* dst, const int16_t* src, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = saturate(dst[i] + src[i]);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Dispatching                                */
+/* -------------------------------------------------------------------------- */
+
+void stereoToMono(int16_t* dst, const int16_t* src, size_t frames)
+{
+    size_t done = 0;
+#if PCM_USE_PIE
+    if (aligned(dst) && aligned(src) && frames >= kLanes) {
+        alignas(kAlign) static const int16_t ones[kLanes] = {1, 1, 1, 1, 1, 1, 1, 1};
+        done = frames / kLanes * kLanes;
+        pcm_stereo_to_mono_pie(dst, src, frames / kLanes, ones);
+    }
+#endif
+    ref::stereoToMono(dst + done, src + done * 2, frames - done);
+}
+
+void monoToStereo(int16_t* dst, const int16_t* src, size_t frames)
+{
+#if PCM_USE_PIE
+    // In place would overwrite samples before they are read, that case stays on the backwards reference loop
+    if (aligned(dst) && aligned(src) && frames >= kLanes && dst != src) {
+        const size_t done = frames / kLanes * kLanes;
+        pcm_mono_to_stereo_pie(dst, src, frames / kLanes);
+        ref::monoToStereo(dst + done * 2, src + done, frames - done);
+        return;
+    }
+#endif
+    ref::monoToStereo(dst, src, frames);
+}
+
+void deinterleave(int16_t* left, int16_t* right, const int16_t* src, size_t frames)
+{
+    size_t done = 0;
+#if PCM_USE_PIE
+    if (aligned(left) && aligned(right) && aligned(src) && frames >= kLanes) {
+        done = frames / kLanes * kLanes;
+        pcm_deinterleave_pie(left, right, src, frames / kLanes);
+    }
+#endif
+    ref::deinterleave(left + done, right + done, src + done * 2, frames - done);
+}
+
+void interleave(int16_t* dst, const int16_t* left, const int16_t* right, size_t frames)
+{
+    size_t done = 0;
+#if PCM_USE_PIE
+    if (aligned(dst) && aligned(left) && aligned(right) && frames >= kLanes) {
+        done = frames / kLanes * kLanes;
+        pcm_interleave_pie(dst, left, right, frames / kLanes);
+    }
+#endif
+    ref::interleave(dst + done * 2, left + done, right + done, frames - done);
+}
+
+void gain(int16_t* dst, const int16_t* src, size_t count, Gain_t gain)
+{
+    gain.q15    = std::max<int16_t>(gain.q15, -32767);
+    gain.shift  = std::min<uint8_t>(gain.shift, 15);
+    size_t done = 0;
+#if PCM_USE_PIE
+    if (aligned(dst) && aligned(src) && count >= kLanes) {
+        alignas(kAlign) int16_t lanes[kLanes];
+        std::fill(lanes, lanes + kLanes, gain.q15);
+        done = count / kLanes * kLanes;
+        pcm_gain_pie(dst, src, count / kLanes, lanes, gain.shift);
+    }
+#endif
+    ref::gain(dst + done, src + done, count - done, gain);
+}
+
+void mixAdd(int16_t* dst, const int16_t* src, size_t count)
+{
+    size_t done = 0;
+#if PCM_USE_PIE
+    if (aligned(dst) && aligned(src) && count >= kLanes) {
+        done = count / kLanes * kLanes;
+        pcm_mix_add_pie(dst, src, count / kLanes);
+    }
+#endif
+    ref::mixAdd(dst + done, src + done, count - done);
+}
+
+// PIE has no float lanes, these stay on the FPU and are unrolled so the loads and conversions overlap
+void toFloat(float* dst, const int16_t* src, size_t count)
+{
+    constexpr float kScale = 1.0f / 32768.0f;
+    size_t i               = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float a = static_cast<float>(src[i]);
+        const float b = static_cast<float>(src[i + 1]);
+        const float c = static_cast<float>(src[i + 2]);
+        const float d = static_cast<float>(src[i + 3]);
+        dst[i]        = a * kScale;
+        dst[i + 1]    = b * kScale;
+        dst[i + 2]    = c * kScale;
+        dst[i + 3]    = d * kScale;
+    }
+    for (; i < count; ++i) {
+        dst[i] = static_cast<float>(src[i]) * kScale;
+    }
+}
+
+void fromFloat(int16_t* dst, const float* src, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float v = std::clamp(src[i] * 32768.0f, -32768.0f, 32767.0f);
+        dst[i]        = static_cast<int16_t>(v < 0.0f ? v - 0.5f : v + 0.5f);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Self test                                 */
+/* -------------------------------------------------------------------------- */
+
+bool selfTest()
+{
+    // Two blocks and an odd tail, full scale values mixed in so every saturation gets hit
+    constexpr size_t kFrames = 2 * kLanes * 4 + 5;
+    alignas(kAlign) static int16_t a[kFrames * 2];
+    alignas(kAlign) static int16_t b[kFrames * 2];
+    alignas(kAlign) static int16_t out[kFrames * 2];
+    alignas(kAlign) static int16_t out_r[kFrames * 2];
+    alignas(kAlign) static int16_t out2[kFrames];
+    alignas(kAlign) static int16_t out2_r[kFrames];
+
+    uint32_t seed = 0x1234567;
+    for (size_t i = 0; i < kFrames * 2; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        a[i] = static_cast<int16_t>(seed >> 16);
+        b[i] = static_cast<int16_t>(seed >> 8);
+        if (i % 7 == 0) {
+            a[i] = (i % 2) ? INT16_MIN : INT16_MAX;
+        }
+    }
+    const auto same = [](const int16_t* x, const int16_t* y, size_t n) { return std::memcmp(x, y, n * 2) == 0; };
+
+    stereoToMono(out, a, kFrames);
+    ref::stereoToMono(out_r, a, kFrames);
+    if (!same(out, out_r, kFrames)) {
+        return false;
+    }
+    monoToStereo(out, a, kFrames);
+    ref::monoToStereo(out_r, a, kFrames);
+    if (!same(out, out_r, kFrames * 2)) {
+        return false;
+    }
+    deinterleave(out, out2, a, kFrames);
+    ref::deinterleave(out_r, out2_r, a, kFrames);
+    if (!same(out, out_r, kFrames) || !same(out2, out2_r, kFrames)) {
+        return false;
+    }
+    interleave(out, a, b, kFrames);
+    ref::interleave(out_r, a, b, kFrames);
+    if (!same(out, out_r, kFrames * 2)) {
+        return false;
+    }
+    for (const Gain_t g : {Gain_t{32767, 0}, Gain_t{-32768, 0}, Gain_t{20000, 3}, Gain_t{-12345, 6}, Gain_t{1, 15}}) {
+        gain(out, a, kFrames * 2, g);
+        ref::gain(out_r, a, kFrames * 2, g);
+        if (!same(out, out_r, kFrames * 2)) {
+            return false;
+        }
+    }
+    std::memcpy(out, a, sizeof(a));
+    std::memcpy(out_r, a, sizeof(a));
+    mixAdd(out, b, kFrames * 2);
+    ref::mixAdd(out_r, b, kFrames * 2);
+    return same(out, out_r, kFrames * 2);
+}
+
+}  // namespace pcm
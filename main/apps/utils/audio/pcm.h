@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * 16-bit PCM kernels
+ *
+ * On the ESP32-S3 the integer kernels run eight samples at a time on the PIE vector unit (pcm_pie.S) whenever every
+ * buffer passed is 16-byte aligned, the rest of the samples and unaligned calls go through the portable code in
+ * pcm::ref. Both give bit-identical results, the vector code only uses operations whose lanes can't overflow, checked
+ * on the host by simulator/pcm_kernels_main.cpp. Declare hot buffers alignas(kAlign) to get the vector path.
+ *
+ * dst may be the same buffer as src (not for interleave / deinterleave).
+ */
+namespace pcm {
+
+static constexpr size_t kAlign = 16;
+
+/** A linear gain as a Q15 fraction and a power of two, the product saturates */
+struct Gain_t {
+    int16_t q15   = 32767;  // -32768 is taken as -32767
+    uint8_t shift = 0;      // 0..15
+};
+
+/** Closest Gain_t to a linear gain in [0, 32768) */
+Gain_t makeGain(float linear);
+
+/** dst[i] = (src[2i] + src[2i + 1]) >> 1, rounding down */
+void stereoToMono(int16_t* dst, const int16_t* src, size_t frames);
+
+/** Both channels of dst get src */
+void monoToStereo(int16_t* dst, const int16_t* src, size_t frames);
+
+void deinterleave(int16_t* left, int16_t* right, const int16_t* src, size_t frames);
+
+void interleave(int16_t* dst, const int16_t* left, const int16_t* right, size_t frames);
+
+/** dst[i] = saturate(((src[i] * gain.q15) >> 15) << gain.shift) */
+void gain(int16_t* dst, const int16_t* src, size_t count, Gain_t gain);
+
+/** dst[i] = saturate(dst[i] + src[i]) */
+void mixAdd(int16_t* dst, const int16_t* src, size_t count);
+
+/** dst[i] = src[i] / 32768 */
+void toFloat(float* dst, const int16_t* src, size_t count);
+
+/** dst[i] = saturate(round(src[i] * 32768)), halves away from zero */
+void fromFloat(int16_t* dst, const float* src, size_t count);
+
+/** Runs every kernel against pcm::ref on fixed pseudo random data, false on the first difference */
+bool selfTest();
+
+/** Portable reference, what the dispatching kernels above must match bit for bit */
+namespace ref {
+void stereoToMono(int16_t* dst, const int16_t* src, size_t frames);
+void monoToStereo(int16_t* dst, const int16_t* src, size_t frames);
+void deinterleave(int16_t* left, int16_t* right, const int16_t* src, size_t frames);
+void interleave(int16_t* dst, const int16_t* left, const int16_t* right, size_t frames);
+void gain(int16_t* dst, const int16_t* src, size_t count, Gain_t gain);
+void mixAdd(int16_t* dst, const int16_t* src, size_t count);
+}  // namespace ref
+
+}  // namespace pcm
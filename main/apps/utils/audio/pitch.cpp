@@ -0,0 +1,163 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "pitch.h"
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+namespace pitch {
+
+// Lags are correlated this many at a time, the lag range is rounded up to it
+static constexpr size_t kLagBlock = 4;
+
+// Offset of the vertex of the parabola through y[at - 1], y[at], y[at + 1] from at, within half a sample
+static float parabola(const float* y, size_t at)
+{
+    const float a     = y[at - 1];
+    const float b     = y[at];
+    const float c     = y[at + 1];
+    const float curve = a - 2.0f * b + c;
+    return curve > 0.0f ? std::clamp(0.5f * (a - c) / curve, -0.5f, 0.5f) : 0.0f;
+}
+
+bool Detector::init(const Config_t& config)
+{
+    deinit();
+    if (config.sample_rate <= 0.0f || config.min_hz <= 0.0f || config.max_hz <= config.min_hz ||
+        config.max_hz >= config.sample_rate / 2.0f) {
+        return false;
+    }
+
+    _config = config;
+    // One lag past the longest period for the parabola through its dip
+    const auto longest = static_cast<size_t>(std::ceil(config.sample_rate / config.min_hz)) + 1;
+    _max_lag           = (longest + kLagBlock - 1) / kLagBlock * kLagBlock;
+    _min_lag           = std::max<size_t>(2, static_cast<size_t>(config.sample_rate / config.max_hz));
+    _window            = _max_lag;
+    _diff.reset(new (std::nothrow) float[_max_lag + 1]);
+    _cmnd.reset(new (std::nothrow) float[_max_lag + 1]);
+    if (!_diff || !_cmnd) {
+        deinit();
+        return false;
+    }
+    return true;
+}
+
+void Detector::deinit()
+{
+    _diff.reset();
+    _cmnd.reset();
+    _window  = 0;
+    _min_lag = 0;
+    _max_lag = 0;
+}
+
+Estimate_t Detector::detect(const float* frame)
+{
+    Estimate_t est;
+    const size_t w = _window;
+    float* d       = _diff.get();
+    float* n       = _cmnd.get();
+
+    // Energy of the window at lag 0, the level is taken over the whole frame
+    float e0 = 0.0f;
+    for (size_t j = 0; j < w; ++j) {
+        e0 += frame[j] * frame[j];
+    }
+    float total = e0;
+    for (size_t j = w; j < w + _max_lag; ++j) {
+        total += frame[j] * frame[j];
+    }
+    est.level_db = 10.0f * std::log10(std::max(total / (w + _max_lag), 1e-12f));
+
+    // d(lag) = e(0) + e(lag) - 2 r(lag), four lags share every load of frame[j]
+    float e = e0;
+    d[0]    = 0.0f;
+    for (size_t lag = 1; lag <= _max_lag; lag += kLagBlock) {
+        const float* y = frame + lag;
+        float r0 = 0.0f, r1 = 0.0f, r2 = 0.0f, r3 = 0.0f;
+        for (size_t j = 0; j < w; ++j) {
+            const float x = frame[j];
+            r0 += x * y[j];
+            r1 += x * y[j + 1];
+            r2 += x * y[j + 2];
+            r3 += x * y[j + 3];
+        }
+        const float r[kLagBlock] = {r0, r1, r2, r3};
+        for (size_t k = 0; k < kLagBlock; ++k) {
+            const size_t l = lag + k;
+            e += frame[l - 1 + w] * frame[l - 1 + w] - frame[l - 1] * frame[l - 1];
+            d[l] = std::max(0.0f, e0 + e - 2.0f * r[k]);
+        }
+    }
+
+    // Cumulative mean normalized difference, 1 at lag 0
+    n[0]      = 1.0f;
+    float sum = 0.0f;
+    for (size_t lag = 1; lag <= _max_lag; ++lag) {
+        sum += d[lag];
+        n[lag] = sum > 0.0f ? d[lag] * lag / sum : 1.0f;
+    }
+
+    // First dip under the threshold, followed down to its bottom. Without one the deepest dip, unvoiced
+    size_t best = 0;
+    for (size_t lag = _min_lag; lag < _max_lag; ++lag) {
+        if (n[lag] < _config.threshold) {
+            while (lag + 1 < _max_lag && n[lag + 1] < n[lag]) {
+                ++lag;
+            }
+            best = lag;
+            break;
+        }
+    }
+    const bool found = best != 0;
+    if (!found) {
+        best = _min_lag;
+        for (size_t lag = _min_lag + 1; lag < _max_lag; ++lag) {
+            best = n[lag] < n[best] ? lag : best;
+        }
+    }
+    est.clarity = std::clamp(1.0f - n[best], 0.0f, 1.0f);
+    est.voiced  = found && est.level_db >= _config.min_db;
+
+    // A short period spans few samples and the parabola is off by a few cents. The difference dips again at every
+    // multiple of the period, the one furthest out is interpolated instead and divided back, which divides the error
+    const float period = best + parabola(n, best);
+    const auto times   = static_cast<size_t>((_max_lag - 1) / period);
+    if (times < 2) {
+        est.hz = _config.sample_rate / period;
+        return est;
+    }
+    auto lag = static_cast<size_t>(std::lround(period * times));
+    while (lag > 1 && d[lag - 1] < d[lag]) {
+        --lag;
+    }
+    while (lag + 1 < _max_lag && d[lag + 1] < d[lag]) {
+        ++lag;
+    }
+    est.hz = _config.sample_rate * times / (lag + parabola(d, lag));
+    return est;
+}
+
+Note_t nearestNote(float hz, float a4_hz)
+{
+    Note_t note;
+    if (hz <= 0.0f || a4_hz <= 0.0f) {
+        return note;
+    }
+    const float midi = 69.0f + 12.0f * std::log2(hz / a4_hz);
+    note.midi        = static_cast<int>(std::lround(midi));
+    note.cents       = (midi - note.midi) * 100.0f;
+    return note;
+}
+
+const char* noteName(int midi)
+{
+    static const char* kNames[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    return kNames[((midi % 12) + 12) % 12];
+}
+
+}  // namespace pitch
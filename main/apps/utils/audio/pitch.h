@@ -0,0 +1,86 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Monophonic pitch detection for the tuner
+ *
+ * YIN (de Cheveigne and Kawahara, 2002) on a frame of twice the longest period: the squared difference of the first
+ * half against the frame shifted by every lag, normalized by its running mean, and the first dip under the threshold is
+ * the period. A parabola through the dip and its neighbours gives the fraction of a sample, taken at the furthest
+ * multiple of the period in the frame where a short period spans too few samples for it. The difference is taken as
+ * energy(0) + energy(lag) - 2 * correlation(lag), the energies slide along with one square in and one out so only the
+ * correlation costs a multiply per sample and lag, and it runs four lags per pass over the samples, in float for the
+ * ESP32-S3 FPU. Frames overlap by whatever the caller hops, the detector keeps no state between them.
+ *
+ * Nothing here depends on the device, see simulator/pitch_main.cpp for the host checks and benchmark.
+ */
+namespace pitch {
+
+struct Config_t {
+    float sample_rate = 16000.0f;
+    float min_hz      = 65.0f;    // C2, below a guitar's low E and a drop C
+    float max_hz      = 1400.0f;  // About F6, past the top of a violin's first position
+    float threshold   = 0.15f;    // Normalized difference a dip has to reach, lower is stricter
+    float min_db      = -55.0f;   // RMS over the frame, dBFS, quieter frames are unvoiced
+};
+
+struct Estimate_t {
+    bool voiced    = false;
+    float hz       = 0.0f;
+    float clarity  = 0.0f;  // 1 - normalized difference at the period, 1 is a pure periodic signal
+    float level_db = -120.0f;
+};
+
+class Detector {
+public:
+    Detector() = default;
+    Detector(const Detector&)            = delete;
+    Detector& operator=(const Detector&) = delete;
+
+    /** Sizes the frame from the rates, false if they make no sense or memory is short */
+    bool init(const Config_t& config);
+    void deinit();
+
+    /** Samples detect() takes */
+    size_t frameSize() const
+    {
+        return _window + _max_lag;
+    }
+
+    /** frameSize() samples, full scale +-1.0. Never allocates */
+    Estimate_t detect(const float* frame);
+
+private:
+    Config_t _config;
+    size_t _window  = 0;  // Samples compared per lag, as long as the longest period
+    size_t _min_lag = 0;
+    size_t _max_lag = 0;
+    std::unique_ptr<float[]> _diff;  // Difference per lag
+    std::unique_ptr<float[]> _cmnd;  // Its cumulative mean normalized form
+};
+
+struct Note_t {
+    int midi    = 0;  // 69 is A4
+    float cents = 0.0f;
+};
+
+/** Nearest equal tempered note to hz with A4 at a4_hz, and how far off it is */
+Note_t nearestNote(float hz, float a4_hz = 440.0f);
+
+/** "C", "C#" .. "B" of a MIDI note */
+const char* noteName(int midi);
+
+/** Octave in scientific pitch notation, 4 for A4 */
+inline int noteOctave(int midi)
+{
+    return midi / 12 - 1;
+}
+
+}  // namespace pitch
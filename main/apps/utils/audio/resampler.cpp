@@ -0,0 +1,217 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+struct Design_t {
+    uint8_t taps;
+    uint8_t phase_bits;
+    double beta;     // Kaiser window, sets the stopband
+    double rolloff;  // Cutoff against half the lower rate
+};
+
+// Stopband about 45, 65 and 85 dB. The cutoff leaves the transition band room below the lower Nyquist frequency
+static constexpr Design_t kDesigns[] = {
+    {8, 5, 4.5, 0.78},
+    {16, 6, 6.5, 0.86},
+    {32, 7, 8.5, 0.91},
+};
+// Going down the filter spans as many output frames as going up, so the taps grow with the ratio, up to this
+static constexpr size_t kMaxDownScale = 6;
+// Coefficients in a table, 16 KB. The cutoff falls with the ratio and the filter gets smoother between phases, so a
+// long downsampling filter does with fewer of them
+static constexpr size_t kMaxTable = 8192;
+
+// Zeroth order modified Bessel function of the first kind, the series converges fast for the betas above
+static double bessel_i0(double x)
+{
+    double sum  = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+bool Resampler::init(uint32_t in_rate, uint32_t out_rate, uint8_t channels, Quality quality, size_t max_frames)
+{
+    deinit();
+    if (in_rate == 0 || out_rate == 0 || channels < 1 || channels > 2 || max_frames == 0) {
+        return false;
+    }
+
+    _channels = channels;
+    _step     = (static_cast<uint64_t>(in_rate) << 32) / out_rate;
+    if (in_rate == out_rate) {
+        _taps       = 1;
+        _phase_bits = 0;
+    } else {
+        const Design_t& d = kDesigns[static_cast<size_t>(quality)];
+        const auto scale  = static_cast<size_t>(std::ceil(static_cast<double>(in_rate) / out_rate));
+        _taps             = d.taps * std::clamp<size_t>(scale, 1, kMaxDownScale);
+        _phase_bits       = d.phase_bits;
+        while (((1u << _phase_bits) + 1) * _taps > kMaxTable) {
+            --_phase_bits;
+        }
+        _table.reset(new (std::nothrow) int16_t[((1u << _phase_bits) + 1) * _taps]);
+        if (!_table || !build(d.rolloff * std::min(1.0, static_cast<double>(out_rate) / in_rate), d.beta)) {
+            deinit();
+            return false;
+        }
+    }
+
+    // The input behind the largest render(), or the largest convert() on top of the taps still held
+    const uint64_t per_render = ((static_cast<uint64_t>(max_frames) * _step) >> 32) + 1;
+    _capacity                 = _taps + std::max<size_t>(max_frames, per_render) + 1;
+    _buf.reset(new (std::nothrow) int16_t[_capacity * _channels]);
+    if (!_buf) {
+        deinit();
+        return false;
+    }
+    reset();
+    return true;
+}
+
+void Resampler::deinit()
+{
+    _table.reset();
+    _buf.reset();
+    _capacity = 0;
+    _have     = 0;
+    _taps     = 0;
+}
+
+void Resampler::reset()
+{
+    // Half the taps of silence ahead, so the first output frame is centred on the first input frame
+    _have = _taps / 2 == 0 ? 0 : _taps / 2 - 1;
+    _pos  = 0;
+    if (_buf) {
+        std::memset(_buf.get(), 0, _capacity * _channels * sizeof(int16_t));
+    }
+}
+
+// Phase p holds the taps for an output frame p / 2^phase_bits past its first tap's frame plus taps / 2 - 1. Every
+// phase is quantised to sum to exactly 1.0, so DC passes at unity whatever the fraction
+bool Resampler::build(double cutoff, double beta)
+{
+    std::unique_ptr<double[]> h(new (std::nothrow) double[_taps]);
+    if (!h) {
+        return false;
+    }
+    const size_t phases = (1u << _phase_bits) + 1;
+    const double half   = _taps / 2.0;
+    const double norm   = bessel_i0(beta);
+    for (size_t p = 0; p < phases; ++p) {
+        const double f = static_cast<double>(p) / (1u << _phase_bits);
+        double sum     = 0.0;
+        for (size_t k = 0; k < _taps; ++k) {
+            const double t = static_cast<double>(k) - (half - 1.0) - f;
+            const double x = M_PI * cutoff * t;
+            const double s = t == 0.0 ? 1.0 : std::sin(x) / x;
+            const double r = t / half;
+            const double w = r * r >= 1.0 ? 0.0 : bessel_i0(beta * std::sqrt(1.0 - r * r)) / norm;
+            h[k]           = cutoff * s * w;
+            sum += h[k];
+        }
+
+        int16_t* row  = &_table[p * _taps];
+        int32_t total = 0;
+        size_t peak   = 0;
+        for (size_t k = 0; k < _taps; ++k) {
+            row[k] = static_cast<int16_t>(std::lround(h[k] / sum * 32768.0));
+            total += row[k];
+            peak = std::abs(row[k]) > std::abs(row[peak]) ? k : peak;
+        }
+        row[peak] = static_cast<int16_t>(row[peak] + 32768 - total);
+    }
+    return true;
+}
+
+size_t Resampler::need(size_t out_frames) const
+{
+    if (out_frames == 0) {
+        return 0;
+    }
+    const uint64_t last   = _pos + (out_frames - 1) * _step;
+    const size_t required = static_cast<size_t>(last >> 32) + _taps;
+    return required > _have ? required - _have : 0;
+}
+
+size_t Resampler::maxOutput(size_t in_frames) const
+{
+    return static_cast<size_t>(((static_cast<uint64_t>(in_frames) << 32) + _step - 1) / _step) + 1;
+}
+
+void Resampler::render(int16_t* out, size_t out_frames)
+{
+    const size_t ch  = _channels;
+    const int16_t* x = _buf.get();
+
+    if (bypass()) {
+        std::memcpy(out, x, out_frames * ch * sizeof(int16_t));
+    } else {
+        const size_t n         = _taps;
+        const int frac_shift   = 32 - _phase_bits;
+        const int weight_shift = frac_shift - 15;
+        uint64_t pos           = _pos;
+        for (size_t o = 0; o < out_frames; ++o, pos += _step) {
+            const auto frac   = static_cast<uint32_t>(pos);
+            const int16_t* c0 = &_table[(frac >> frac_shift) * n];
+            const int16_t* c1 = c0 + n;
+            const int64_t w   = (frac >> weight_shift) & 0x7FFF;
+            const int16_t* in = x + (pos >> 32) * ch;
+            // Both phases over the same taps, then the fraction between them: Q15 coefficients, Q30 result
+            if (ch == 1) {
+                int32_t a = 0, b = 0;
+                for (size_t k = 0; k < n; ++k) {
+                    a += in[k] * c0[k];
+                    b += in[k] * c1[k];
+                }
+                const int64_t y = ((static_cast<int64_t>(a) << 15) + (b - a) * w + (1 << 29)) >> 30;
+                out[o]          = static_cast<int16_t>(std::clamp<int64_t>(y, INT16_MIN, INT16_MAX));
+            } else {
+                int32_t al = 0, bl = 0, ar = 0, br = 0;
+                for (size_t k = 0; k < n; ++k) {
+                    al += in[2 * k] * c0[k];
+                    bl += in[2 * k] * c1[k];
+                    ar += in[2 * k + 1] * c0[k];
+                    br += in[2 * k + 1] * c1[k];
+                }
+                const int64_t l = ((static_cast<int64_t>(al) << 15) + (bl - al) * w + (1 << 29)) >> 30;
+                const int64_t r = ((static_cast<int64_t>(ar) << 15) + (br - ar) * w + (1 << 29)) >> 30;
+                out[2 * o]      = static_cast<int16_t>(std::clamp<int64_t>(l, INT16_MIN, INT16_MAX));
+                out[2 * o + 1]  = static_cast<int16_t>(std::clamp<int64_t>(r, INT16_MIN, INT16_MAX));
+            }
+        }
+    }
+
+    // Drop what no later frame reaches back to
+    const uint64_t end = _pos + out_frames * _step;
+    const size_t drop  = std::min<size_t>(static_cast<size_t>(end >> 32), _have);
+    std::memmove(_buf.get(), x + drop * ch, (_have - drop) * ch * sizeof(int16_t));
+    _have -= drop;
+    _pos = end - (static_cast<uint64_t>(drop) << 32);
+}
+
+size_t Resampler::convert(const int16_t* in, size_t in_frames, int16_t* out)
+{
+    const size_t take = std::min(in_frames, _capacity - _have);
+    std::memcpy(tail(), in, take * _channels * sizeof(int16_t));
+    _have += take;
+    if (_have < _taps || (_pos >> 32) + _taps > _have) {
+        return 0;
+    }
+    // Every frame whose last tap is in
+    const uint64_t span = (static_cast<uint64_t>(_have - _taps) << 32) - _pos;
+    const size_t frames = static_cast<size_t>(span / _step) + 1;
+    render(out, frames);
+    return frames;
+}
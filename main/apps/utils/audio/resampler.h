@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Fixed-point polyphase sample rate converter
+ *
+ * A Kaiser windowed sinc is sampled at 2^phase_bits fractional offsets into a table of Q15 phases, each one a filter
+ * of the quality's tap count. An output frame sits at a Q32 position in the input. The phase at its fraction and the
+ * next one are both run over the input and the two results interpolated in between, so any pair of rates works from
+ * the same table with no drift to speak of (the step is exact to 2^-32 frames). The cutoff follows the lower of the
+ * two rates and a downsampling filter is longer by the ratio, so what would alias is filtered out. Equal rates pass
+ * through untouched.
+ *
+ * Input goes into an internal history sized by init(). Either the caller asks for a fixed number of output frames,
+ * tops up the need() frames at tail() and render()s, the way a mixer pulls a stream, or it hands in whatever it
+ * captured and convert() returns what that makes. The filter table and history are allocated by init(), the rest
+ * never allocates. Mono or interleaved stereo.
+ */
+class Resampler {
+public:
+    enum class Quality : uint8_t {
+        Low = 0,  // 8 taps, 32 phases
+        Medium,   // 16 taps, 64 phases
+        High,     // 32 taps, 128 phases. Downsampling takes up to 6 times the taps
+    };
+
+    Resampler() = default;
+    Resampler(const Resampler&)            = delete;
+    Resampler& operator=(const Resampler&) = delete;
+
+    /**
+     * Builds the filter, max_frames is the most output frames one render() makes and the most input frames one
+     * convert() takes. False if a rate is 0, channels isn't 1 or 2, or memory is short
+     */
+    bool init(uint32_t in_rate, uint32_t out_rate, uint8_t channels, Quality quality, size_t max_frames);
+    void deinit();
+    /** Forgets the history, the next frame starts from silence */
+    void reset();
+
+    /** Pull side. Input frames missing for the next out_frames output frames */
+    size_t need(size_t out_frames) const;
+    /** Pull side. Where the need() frames go, then commit() them */
+    int16_t* tail()
+    {
+        return _buf.get() + _have * _channels;
+    }
+    void commit(size_t frames)
+    {
+        _have += frames;
+    }
+    /** Pull side. Writes out_frames frames, need(out_frames) has to be 0 */
+    void render(int16_t* out, size_t out_frames);
+
+    /** Push side. Takes in_frames frames and writes what they complete, at most maxOutput(in_frames), returns that */
+    size_t convert(const int16_t* in, size_t in_frames, int16_t* out);
+    size_t maxOutput(size_t in_frames) const;
+
+    bool bypass() const
+    {
+        return _taps == 1;
+    }
+    size_t taps() const
+    {
+        return _taps;
+    }
+    uint8_t channels() const
+    {
+        return _channels;
+    }
+
+private:
+    bool build(double cutoff, double beta);
+
+    std::unique_ptr<int16_t[]> _table;  // (phases + 1) x taps, Q15
+    std::unique_ptr<int16_t[]> _buf;    // History, frames
+    size_t _capacity    = 0;            // Frames
+    size_t _have        = 0;
+    size_t _taps        = 0;
+    uint8_t _phase_bits = 0;
+    uint8_t _channels   = 1;
+    uint64_t _step      = 0;  // Q32 input frames per output frame
+    uint64_t _pos       = 0;  // Q32 position of the next output frame, _buf frame 0 is its first tap
+};
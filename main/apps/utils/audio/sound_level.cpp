@@ -0,0 +1,470 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "sound_level.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <new>
+
+namespace slm {
+
+static constexpr double kPi = 3.14159265358979323846;
+
+// Poles of the analog A weighting, IEC 61672-1 Annex E
+static constexpr double kPoleLow  = 20.598997;
+static constexpr double kPoleMid1 = 107.65265;
+static constexpr double kPoleMid2 = 737.86223;
+static constexpr double kPoleHigh = 12194.217;
+
+float toDb(float energy)
+{
+    return energy > 1e-12f ? std::max(10.0f * std::log10(energy), kFloorDb) : kFloorDb;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 A weighting                                */
+/* -------------------------------------------------------------------------- */
+
+static dsp::BiquadCoeffs_t to_coeffs(const double b[3], const double a[3])
+{
+    dsp::BiquadCoeffs_t c;
+    c.b0 = static_cast<float>(b[0] / a[0]);
+    c.b1 = static_cast<float>(b[1] / a[0]);
+    c.b2 = static_cast<float>(b[2] / a[0]);
+    c.a1 = static_cast<float>(a[1] / a[0]);
+    c.a2 = static_cast<float>(a[2] / a[0]);
+    return c;
+}
+
+static std::complex<double> response_of(const dsp::BiquadCoeffs_t& c, double w)
+{
+    const std::complex<double> z1 = std::polar(1.0, -w);
+    const std::complex<double> z2 = z1 * z1;
+    const double b0 = c.b0, b1 = c.b1, b2 = c.b2, a1 = c.a1, a2 = c.a2;
+    return (b0 + b1 * z1 + b2 * z2) / (1.0 + a1 * z1 + a2 * z2);
+}
+
+bool AWeighting::init(float sample_rate)
+{
+    if (sample_rate < 8000.0f) {
+        return false;
+    }
+
+    // s = k (1 - 1/z) / (1 + 1/z), each factor s + p of the denominator becomes (k + p) - (k - p) / z
+    const double k  = 2.0 * sample_rate;
+    const double p1 = 2.0 * kPi * kPoleLow;
+    const double p2 = 2.0 * kPi * kPoleMid1;
+    const double p3 = 2.0 * kPi * kPoleMid2;
+    const double p4 = 2.0 * kPi * kPoleHigh;
+
+    dsp::BiquadCoeffs_t c[kStages];
+    // s / (s + p1), twice
+    {
+        const double b[3] = {k, -k, 0.0};
+        const double a[3] = {k + p1, -(k - p1), 0.0};
+        c[0]              = to_coeffs(b, a);
+        c[1]              = c[0];
+    }
+    // s^2 / ((s + p2) (s + p3))
+    {
+        const double b[3] = {k * k, -2.0 * k * k, k * k};
+        const double a[3] = {(k + p2) * (k + p3), -((k + p2) * (k - p3) + (k - p2) * (k + p3)), (k - p2) * (k - p3)};
+        c[2]              = to_coeffs(b, a);
+    }
+    // 1 / (s + p4)^2
+    {
+        const double b[3] = {1.0, 2.0, 1.0};
+        const double a[3] = {(k + p4) * (k + p4), -2.0 * (k + p4) * (k - p4), (k - p4) * (k - p4)};
+        c[3]              = to_coeffs(b, a);
+    }
+
+    // The constant of the analog form is replaced by whatever makes 1 kHz unity here
+    const double w               = 2.0 * kPi * 1000.0 / sample_rate;
+    std::complex<double> at_1khz = 1.0;
+    for (const auto& stage : c) {
+        at_1khz *= response_of(stage, w);
+    }
+    const auto gain = static_cast<float>(1.0 / std::abs(at_1khz));
+    c[3].b0 *= gain;
+    c[3].b1 *= gain;
+    c[3].b2 *= gain;
+
+    for (int i = 0; i < kStages; ++i) {
+        _stages[i].setCoeffs(c[i]);
+        _stages[i].reset();
+    }
+    return true;
+}
+
+void AWeighting::reset()
+{
+    for (auto& stage : _stages) {
+        stage.reset();
+    }
+}
+
+void AWeighting::process(float* x, size_t count)
+{
+    for (auto& stage : _stages) {
+        stage.process(x, count);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                     VAD                                    */
+/* -------------------------------------------------------------------------- */
+
+void Vad::configure(const Config_t& config)
+{
+    _config       = config;
+    _hangover     = static_cast<uint32_t>(std::max(config.hangover_ms, 0.0f) / kFrameMs + 0.5f);
+    _floor_frames = std::clamp<uint32_t>(static_cast<uint32_t>(config.floor_ms / kFrameMs + 0.5f), 1, kMaxFloorFrames);
+    reset();
+}
+
+void Vad::reset()
+{
+    _head   = 0;
+    _size   = 0;
+    _seq    = 0;
+    _held   = 0;
+    _active = false;
+}
+
+bool Vad::update(float energy)
+{
+    const float db = toDb(energy);
+
+    // Sliding minimum: a louder frame behind a quieter one can never be the floor
+    const uint32_t seq = _seq++;
+    while (_size > 0 && _mins[(_head + _size - 1) % kMaxFloorFrames].db >= db) {
+        --_size;
+    }
+    while (_size > 0 && seq - _mins[_head].seq >= _floor_frames) {
+        _head = (_head + 1) % kMaxFloorFrames;
+        --_size;
+    }
+    _mins[(_head + _size) % kMaxFloorFrames] = {seq, db};
+    ++_size;
+
+    const float above = db - floorDb();
+    if (db >= _config.min_db && above >= (_active ? _config.release_db : _config.onset_db)) {
+        _active = true;
+        _held   = _hangover;
+    } else if (_active) {
+        if (_held == 0) {
+            _active = false;
+        } else {
+            --_held;
+        }
+    }
+    return _active;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Level window                                */
+/* -------------------------------------------------------------------------- */
+
+void LevelWindow::MaxQueue_t::clear()
+{
+    head = 0;
+    size = 0;
+}
+
+void LevelWindow::MaxQueue_t::push(uint32_t seq, float value, uint32_t oldest)
+{
+    // Whatever the new value tops can never be the maximum again, and the front may have left the window
+    while (size > 0 && entries[(head + size - 1) % capacity].value <= value) {
+        --size;
+    }
+    while (size > 0 && static_cast<int32_t>(entries[head].seq - oldest) < 0) {
+        head = (head + 1) % capacity;
+        --size;
+    }
+    entries[(head + size) % capacity] = {seq, value};
+    ++size;
+}
+
+float LevelWindow::MaxQueue_t::front() const
+{
+    return size > 0 ? entries[head].value : 0.0f;
+}
+
+bool LevelWindow::init(size_t max_blocks)
+{
+    deinit();
+    if (max_blocks == 0) {
+        return false;
+    }
+    _slots.reset(new (std::nothrow) Slot_t[max_blocks]);
+    _histogram.reset(new (std::nothrow) uint16_t[kBins]);
+    _lmax.entries.reset(new (std::nothrow) MaxQueue_t::Entry_t[max_blocks]);
+    _peak.entries.reset(new (std::nothrow) MaxQueue_t::Entry_t[max_blocks]);
+    if (!_slots || !_histogram || !_lmax.entries || !_peak.entries || max_blocks > UINT16_MAX) {
+        deinit();
+        return false;
+    }
+    _capacity      = max_blocks;
+    _lmax.capacity = max_blocks;
+    _peak.capacity = max_blocks;
+    _length        = max_blocks;
+    reset();
+    return true;
+}
+
+void LevelWindow::deinit()
+{
+    _slots.reset();
+    _histogram.reset();
+    _lmax.entries.reset();
+    _peak.entries.reset();
+    _capacity = 0;
+    _length   = 0;
+    _count    = 0;
+}
+
+void LevelWindow::setLength(size_t blocks)
+{
+    _length = std::clamp<size_t>(blocks, 1, _capacity);
+    reset();
+}
+
+void LevelWindow::reset()
+{
+    if (_histogram) {
+        std::fill(_histogram.get(), _histogram.get() + kBins, 0);
+    }
+    _count       = 0;
+    _head        = 0;
+    _seq         = 0;
+    _since_resum = 0;
+    _energy_sum  = 0.0;
+    _voice_sum   = 0.0;
+    _lmax.clear();
+    _peak.clear();
+}
+
+void LevelWindow::push(const Block_t& block)
+{
+    if (_length == 0) {
+        return;
+    }
+
+    // The slot written next is the oldest block once the window is full
+    Slot_t& slot = _slots[_head];
+    if (_count == _length) {
+        _energy_sum -= slot.energy;
+        _voice_sum -= slot.voice;
+        --_histogram[slot.bin];
+    } else {
+        ++_count;
+    }
+    slot.energy = block.energy;
+    slot.voice  = block.voice;
+    slot.bin    = static_cast<uint16_t>(binOf(toDb(block.laf)));
+    _energy_sum += slot.energy;
+    _voice_sum += slot.voice;
+    ++_histogram[slot.bin];
+    _head = (_head + 1) % _length;
+
+    const uint32_t seq    = _seq++;
+    const uint32_t oldest = seq + 1 - static_cast<uint32_t>(_count);
+    _lmax.push(seq, block.lmax, oldest);
+    _peak.push(seq, block.peak, oldest);
+
+    // Adding and taking off leaves round off behind, which would show once a loud spell left the window. Summing
+    // afresh once a window keeps it to one window's worth and costs one more add per block on average
+    if (++_since_resum >= _length) {
+        resum();
+    }
+}
+
+void LevelWindow::resum()
+{
+    _since_resum = 0;
+    _energy_sum  = 0.0;
+    _voice_sum   = 0.0;
+    for (size_t i = 0; i < _count; ++i) {
+        _energy_sum += _slots[i].energy;
+        _voice_sum += _slots[i].voice;
+    }
+}
+
+float LevelWindow::leqDb() const
+{
+    return _count > 0 ? toDb(static_cast<float>(std::max(_energy_sum, 0.0) / _count)) : kFloorDb;
+}
+
+float LevelWindow::lmaxDb() const
+{
+    return toDb(_lmax.front());
+}
+
+float LevelWindow::peakDb() const
+{
+    const float peak = _peak.front();
+    return toDb(peak * peak);
+}
+
+float LevelWindow::percentileDb(float percent) const
+{
+    if (_count == 0) {
+        return kFloorDb;
+    }
+    // Counting down from the loudest, the bin holding the block that many percent of the window is louder than
+    const auto rank = std::min(static_cast<size_t>(std::max(percent, 0.0f) / 100.0f * _count), _count - 1);
+    size_t above    = 0;
+    for (int bin = kBins - 1; bin >= 0; --bin) {
+        above += _histogram[bin];
+        if (above > rank) {
+            return levelOf(bin);
+        }
+    }
+    return kFloorDb;
+}
+
+float LevelWindow::voiceRatio() const
+{
+    return _count > 0 ? static_cast<float>(std::clamp(_voice_sum / _count, 0.0, 1.0)) : 0.0f;
+}
+
+int LevelWindow::binOf(float db)
+{
+    return std::clamp(static_cast<int>(std::floor((db - kFloorDb) / kBinDb)), 0, kBins - 1);
+}
+
+float LevelWindow::levelOf(int bin)
+{
+    return kFloorDb + (bin + 0.5f) * kBinDb;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Meter                                   */
+/* -------------------------------------------------------------------------- */
+
+bool Meter::init(const Config_t& config)
+{
+    deinit();
+    const auto max_blocks = static_cast<size_t>(std::ceil(config.max_window_s * 1000.0f / kBlockMs));
+    if (!_weighting.init(config.sample_rate) || !_window.init(max_blocks)) {
+        deinit();
+        return false;
+    }
+    _config    = config;
+    _block_len = static_cast<uint32_t>(std::lround(config.sample_rate * kBlockMs / 1000.0f));
+    _frame_len = static_cast<uint32_t>(std::lround(config.sample_rate * Vad::kFrameMs / 1000.0f));
+    _fast      = 1.0f - std::exp(-1.0f / (config.sample_rate * 0.125f));
+    _vad.configure(config.vad);
+    setWindow(config.window_s);
+    reset();
+    return true;
+}
+
+void Meter::deinit()
+{
+    _window.deinit();
+    _block_len = 0;
+    _frame_len = 0;
+}
+
+void Meter::setWindow(float seconds)
+{
+    _window.setLength(static_cast<size_t>(std::lround(seconds * 1000.0f / kBlockMs)));
+}
+
+void Meter::reset()
+{
+    _weighting.reset();
+    _vad.reset();
+    _window.reset();
+    _laf         = 0.0f;
+    _block_sum   = 0.0f;
+    _block_lmax  = 0.0f;
+    _block_peak  = 0.0f;
+    _block_left  = _block_len;
+    _block_voice = 0;
+    _frame_sum   = 0.0f;
+    _frame_left  = _frame_len;
+}
+
+bool Meter::process(const float* x, size_t count)
+{
+    if (_block_len == 0) {
+        return false;
+    }
+
+    bool finished = false;
+    while (count > 0) {
+        // Up to the end of the block or VAD frame, whichever comes first
+        const auto n = static_cast<uint32_t>(std::min<size_t>({count, dsp::kMaxBlock, _block_left, _frame_left}));
+        float peak   = _block_peak;
+        for (uint32_t i = 0; i < n; ++i) {
+            peak = std::max(peak, std::fabs(x[i]));
+        }
+        std::copy(x, x + n, _scratch);
+        _weighting.process(_scratch, n);
+
+        float sum  = 0.0f;
+        float laf  = _laf;
+        float lmax = _block_lmax;
+        for (uint32_t i = 0; i < n; ++i) {
+            const float e = _scratch[i] * _scratch[i];
+            sum += e;
+            laf += (e - laf) * _fast;
+            lmax = std::max(lmax, laf);
+        }
+        _laf        = laf;
+        _block_lmax = lmax;
+        _block_peak = peak;
+        _block_sum += sum;
+        _frame_sum += sum;
+        _block_voice += _vad.active() ? n : 0;
+        _block_left -= n;
+        _frame_left -= n;
+        x += n;
+        count -= n;
+
+        if (_frame_left == 0) {
+            _vad.update(_frame_sum / _frame_len);
+            _frame_sum  = 0.0f;
+            _frame_left = _frame_len;
+        }
+        if (_block_left == 0) {
+            LevelWindow::Block_t block;
+            block.energy = _block_sum / _block_len;
+            block.laf    = _laf;
+            block.lmax   = _block_lmax;
+            block.peak   = _block_peak;
+            block.voice  = static_cast<float>(_block_voice) / _block_len;
+            _window.push(block);
+            _block_sum   = 0.0f;
+            _block_lmax  = 0.0f;
+            _block_peak  = 0.0f;
+            _block_voice = 0;
+            _block_left  = _block_len;
+            finished     = true;
+        }
+    }
+    return finished;
+}
+
+Levels_t Meter::levels() const
+{
+    Levels_t levels;
+    levels.laf      = toDb(_laf);
+    levels.leq      = _window.leqDb();
+    levels.lmax     = _window.lmaxDb();
+    levels.peak     = _window.peakDb();
+    levels.l10      = _window.percentileDb(10.0f);
+    levels.l50      = _window.percentileDb(50.0f);
+    levels.l90      = _window.percentileDb(90.0f);
+    levels.voice    = _window.voiceRatio();
+    levels.speaking = _vad.active();
+    levels.seconds  = _window.count() * kBlockMs / 1000.0f;
+    return levels;
+}
+
+}  // namespace slm
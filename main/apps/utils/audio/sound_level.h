@@ -0,0 +1,252 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "effects.h"
+
+/**
+ * Sound level meter
+ *
+ * The mic is A weighted (IEC 61672, the analog poles through the bilinear transform) and squared. From there every
+ * sample costs the same fixed handful of operations: it is added to the energy of the current block of kBlockMs, the
+ * Fast (125 ms) time weighting follows it, and the block keeps its LAF maximum and the unweighted sample peak. Each
+ * finished block goes into a window of the last window_s seconds that slides one block at a time, again at a fixed
+ * cost: the energy sum takes the new block and drops the one leaving, the maxima are kept in monotonic queues, and
+ * the LAF at the end of each block is counted into a histogram of kBinDb bins that the percentile levels are read
+ * from. Only reading a percentile walks the histogram. The weighted energy of every kFrameMs also feeds the VAD, the
+ * share of each block it was on for is summed over the window like the energy.
+ *
+ * Levels are dBFS, the caller adds the mic's calibration. Nothing here depends on the device, see
+ * simulator/sound_level_main.cpp for the host checks against the IEC reference values and the benchmark.
+ */
+namespace slm {
+
+// What silence reads as, and the bottom of the histogram
+static constexpr float kFloorDb = -120.0f;
+static constexpr float kTopDb   = 10.0f;
+static constexpr float kBinDb   = 0.1f;
+
+static constexpr uint32_t kBlockMs = 125;
+
+/** A weighting, 0 dB at 1 kHz. The 20.6 Hz poles are two first order stages, which keeps float round off small */
+class AWeighting {
+public:
+    /** False if sample_rate is under 8 kHz, where the weighting makes no sense */
+    bool init(float sample_rate);
+    void reset();
+    void process(float* x, size_t count);
+
+private:
+    static constexpr int kStages = 4;
+
+    dsp::Biquad _stages[kStages];
+};
+
+/**
+ * Energy based voice activity. The noise floor is the quietest frame of the last floor_ms, a sliding minimum that sits
+ * on the gaps between words and catches up with a background that got louder once floor_ms has passed. A frame is
+ * voice when it stands onset_db above the floor
+ */
+class Vad {
+public:
+    struct Config_t {
+        float onset_db    = 9.0f;     // Above the floor to start
+        float release_db  = 4.0f;     // Above the floor to keep going
+        float min_db      = -65.0f;   // Quieter frames never are voice
+        float hangover_ms = 300.0f;   // Held through short gaps between words
+        float floor_ms    = 1500.0f;  // Speech without a gap this long fades into the floor
+    };
+
+    static constexpr uint32_t kFrameMs      = 20;
+    static constexpr size_t kMaxFloorFrames = 128;
+
+    void configure(const Config_t& config);
+    void reset();
+    /** Mean square of one kFrameMs frame, true while voice */
+    bool update(float energy);
+
+    bool active() const
+    {
+        return _active;
+    }
+    float floorDb() const
+    {
+        return _size > 0 ? _mins[_head].db : kFloorDb;
+    }
+
+private:
+    struct Min_t {
+        uint32_t seq = 0;
+        float db     = 0.0f;
+    };
+
+    Config_t _config;
+    uint32_t _hangover     = 0;
+    uint32_t _floor_frames = 1;
+    // Frames that can still be the minimum, oldest first, each quieter than the ones after it
+    Min_t _mins[kMaxFloorFrames];
+    size_t _head   = 0;
+    size_t _size   = 0;
+    uint32_t _seq  = 0;
+    uint32_t _held = 0;
+    bool _active   = false;
+};
+
+/** Block statistics over a sliding window of blocks, every push() O(1) */
+class LevelWindow {
+public:
+    struct Block_t {
+        float energy = 0.0f;  // Mean square
+        float laf    = 0.0f;  // Time weighted mean square at the end of the block
+        float lmax   = 0.0f;  // Its maximum during the block
+        float peak   = 0.0f;  // Largest sample, unweighted
+        float voice  = 0.0f;  // Share of the block that was voice
+    };
+
+    LevelWindow() = default;
+    LevelWindow(const LevelWindow&)            = delete;
+    LevelWindow& operator=(const LevelWindow&) = delete;
+
+    bool init(size_t max_blocks);
+    void deinit();
+    /** Clears the window, blocks is clamped to what init() made room for */
+    void setLength(size_t blocks);
+    void reset();
+    void push(const Block_t& block);
+
+    size_t length() const
+    {
+        return _length;
+    }
+    /** Blocks in the window, up to length() */
+    size_t count() const
+    {
+        return _count;
+    }
+
+    float leqDb() const;
+    float lmaxDb() const;
+    float peakDb() const;
+    /** Level exceeded percent of the time, L10 is percentile(10). Quantized to kBinDb */
+    float percentileDb(float percent) const;
+    float voiceRatio() const;
+
+    /** Bin a level is counted in, and the level a bin reads as */
+    static int binOf(float db);
+    static float levelOf(int bin);
+
+private:
+    static constexpr int kBins = static_cast<int>((kTopDb - kFloorDb) / kBinDb + 0.5f);
+
+    struct Slot_t {
+        float energy = 0.0f;
+        float voice  = 0.0f;
+        uint16_t bin = 0;
+    };
+
+    // Largest value of the blocks still in the window, oldest first, each entry larger than the ones after it
+    struct MaxQueue_t {
+        struct Entry_t {
+            uint32_t seq = 0;
+            float value  = 0.0f;
+        };
+        std::unique_ptr<Entry_t[]> entries;
+        size_t capacity = 0;
+        size_t head     = 0;
+        size_t size     = 0;
+
+        void clear();
+        void push(uint32_t seq, float value, uint32_t oldest);
+        float front() const;
+    };
+
+    void resum();
+
+    std::unique_ptr<Slot_t[]> _slots;
+    std::unique_ptr<uint16_t[]> _histogram;
+    size_t _capacity    = 0;
+    size_t _length      = 0;
+    size_t _count       = 0;
+    size_t _head        = 0;  // Next slot written
+    uint32_t _seq       = 0;  // Blocks pushed since reset()
+    size_t _since_resum = 0;
+    double _energy_sum  = 0.0;
+    double _voice_sum   = 0.0;
+    MaxQueue_t _lmax;
+    MaxQueue_t _peak;
+};
+
+struct Levels_t {
+    float laf     = kFloorDb;  // A weighted, Fast, now
+    float leq     = kFloorDb;  // A weighted equivalent level over the window
+    float lmax    = kFloorDb;  // Highest LAF in the window
+    float peak    = kFloorDb;  // Highest unweighted sample in the window
+    float l10     = kFloorDb;
+    float l50     = kFloorDb;
+    float l90     = kFloorDb;
+    float voice   = 0.0f;  // Share of the window that was voice
+    bool speaking = false;
+    float seconds = 0.0f;  // Covered by the window so far
+};
+
+class Meter {
+public:
+    struct Config_t {
+        float sample_rate  = 48000.0f;
+        float window_s     = 10.0f;
+        float max_window_s = 60.0f;  // Memory is taken for this, 28 bytes a block
+        Vad::Config_t vad;
+    };
+
+    Meter() = default;
+    Meter(const Meter&)            = delete;
+    Meter& operator=(const Meter&) = delete;
+
+    bool init(const Config_t& config);
+    void deinit();
+    /** Starts the window over */
+    void setWindow(float seconds);
+    void reset();
+
+    /** Mono, full scale +-1.0, any count. True if a block finished since the call before, levels() moved on */
+    bool process(const float* x, size_t count);
+
+    /** Walks the histogram for the percentiles, call it once per block at most */
+    Levels_t levels() const;
+
+    float windowSeconds() const
+    {
+        return _window.length() * kBlockMs / 1000.0f;
+    }
+
+private:
+    Config_t _config;
+    AWeighting _weighting;
+    Vad _vad;
+    LevelWindow _window;
+    float _scratch[dsp::kMaxBlock];
+
+    float _fast         = 0.0f;  // One pole coefficient of the Fast time weighting
+    uint32_t _block_len = 0;
+    uint32_t _frame_len = 0;
+
+    // Running block and VAD frame
+    float _laf            = 0.0f;
+    float _block_sum      = 0.0f;
+    float _block_lmax     = 0.0f;
+    float _block_peak     = 0.0f;
+    uint32_t _block_left  = 0;
+    uint32_t _block_voice = 0;  // Samples while the VAD was on
+    float _frame_sum      = 0.0f;
+    uint32_t _frame_left  = 0;
+};
+
+/** 10 log10 of a mean square, kFloorDb for silence */
+float toDb(float energy);
+
+}  // namespace slm
@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+
+/**
+ * Lock-free single producer / single consumer ring
+ *
+ * One task writes and one other task reads, neither ever blocks or takes a lock. Head and tail are free running
+ * counters, the capacity is rounded up to a power of two so they wrap with a mask. Elements are copied with memcpy,
+ * so T has to be trivially copyable.
+ */
+template <typename T>
+class SpscRing {
+public:
+    /** Allocate room for at least capacity elements, drops anything buffered before */
+    bool init(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _data.reset(new (std::nothrow) T[size]);
+        _mask = _data ? size - 1 : 0;
+        _head.store(0, std::memory_order_relaxed);
+        _tail.store(0, std::memory_order_relaxed);
+        return _data != nullptr;
+    }
+
+    void deinit()
+    {
+        _data.reset();
+        _mask = 0;
+    }
+
+    size_t capacity() const
+    {
+        return _data ? _mask + 1 : 0;
+    }
+
+    /** Elements waiting, exact on the consumer side and a lower bound on the producer side */
+    size_t size() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    /** Total elements ever written / read, for callers that track positions in the stream */
+    size_t written() const
+    {
+        return _head.load(std::memory_order_acquire);
+    }
+    size_t consumed() const
+    {
+        return _tail.load(std::memory_order_acquire);
+    }
+
+    /** Producer side. Copies as many elements as fit and returns how many that were */
+    size_t write(const T* src, size_t count)
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        const size_t tail = _tail.load(std::memory_order_acquire);
+        count             = std::min(count, capacity() - (head - tail));
+        copy_in(head, src, count);
+        _head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /** Consumer side. Copies out up to count elements and returns how many there were */
+    size_t read(T* dst, size_t count)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t head = _head.load(std::memory_order_acquire);
+        count             = std::min(count, head - tail);
+        copy_out(tail, dst, count);
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /** Consumer side. Drops up to count elements */
+    size_t skip(size_t count)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t head = _head.load(std::memory_order_acquire);
+        count             = std::min(count, head - tail);
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::unique_ptr<T[]> _data;
+    size_t _mask = 0;
+    std::atomic<size_t> _head{0};
+    std::atomic<size_t> _tail{0};
+
+    void copy_in(size_t pos, const T* src, size_t count)
+    {
+        if (count == 0) {
+            return;
+        }
+        const size_t at    = pos & _mask;
+        const size_t first = std::min(count, _mask + 1 - at);
+        std::memcpy(&_data[at], src, first * sizeof(T));
+        std::memcpy(&_data[0], src + first, (count - first) * sizeof(T));
+    }
+
+    void copy_out(size_t pos, T* dst, size_t count) const
+    {
+        if (count == 0) {
+            return;
+        }
+        const size_t at    = pos & _mask;
+        const size_t first = std::min(count, _mask + 1 - at);
+        std::memcpy(dst, &_data[at], first * sizeof(T));
+        std::memcpy(dst + first, &_data[0], (count - first) * sizeof(T));
+    }
+};
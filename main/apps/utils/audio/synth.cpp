@@ -0,0 +1,397 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "synth.h"
+#include <esp_timer.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static constexpr int32_t kEnvMax    = 1 << 30;
+static constexpr uint32_t kForever  = 0xFFFFFFFFu;
+static constexpr int kHarmonics     = 24;  // Of the band limited tables, keeps the C8 key clicks clear of aliasing
+static constexpr size_t kFracShift  = 32 - Synth::kTableBits - 15;
+static constexpr size_t kTableCount = 4;
+
+namespace {
+
+// One period per wave, plus a guard sample so the interpolation never wraps
+struct Tables {
+    int16_t wave[kTableCount][Synth::kTableSize + 1];
+
+    Tables()
+    {
+        float tmp[Synth::kTableSize];
+        for (size_t w = 0; w < kTableCount; ++w) {
+            float peak = 0.0f;
+            for (size_t i = 0; i < Synth::kTableSize; ++i) {
+                const double x = 2.0 * M_PI * i / Synth::kTableSize;
+                double y       = 0.0;
+                switch (static_cast<Synth::Wave>(w)) {
+                    case Synth::Wave::Sine:
+                        y = std::sin(x);
+                        break;
+                    case Synth::Wave::Square:
+                        for (int k = 1; k <= kHarmonics; k += 2) {
+                            y += std::sin(k * x) / k;
+                        }
+                        break;
+                    case Synth::Wave::Saw:
+                        for (int k = 1; k <= kHarmonics; ++k) {
+                            y += ((k & 1) ? 1.0 : -1.0) * std::sin(k * x) / k;
+                        }
+                        break;
+                    case Synth::Wave::Triangle:
+                        for (int k = 1; k <= kHarmonics; k += 2) {
+                            y += (((k >> 1) & 1) ? -1.0 : 1.0) * std::sin(k * x) / (k * k);
+                        }
+                        break;
+                }
+                tmp[i] = static_cast<float>(y);
+                peak   = std::max(peak, std::fabs(tmp[i]));
+            }
+            for (size_t i = 0; i < Synth::kTableSize; ++i) {
+                wave[w][i] = static_cast<int16_t>(std::lround(tmp[i] * 32767.0f / peak));
+            }
+            wave[w][Synth::kTableSize] = wave[w][0];
+        }
+    }
+};
+
+const Tables& tables()
+{
+    static const Tables t;
+    return t;
+}
+
+}  // namespace
+
+Synth::~Synth()
+{
+    end();
+}
+
+bool Synth::begin(uint32_t sample_rate)
+{
+    if (_queue != nullptr || sample_rate == 0) {
+        return false;
+    }
+    tables();
+    _queue = xQueueCreate(kQueueDepth, sizeof(Command_t));
+    if (_queue == nullptr) {
+        return false;
+    }
+    _sample_rate   = sample_rate;
+    _frame         = 0;
+    _pending_count = 0;
+    for (auto& v : _voices) {
+        v.stage = Stage::Off;
+    }
+    return true;
+}
+
+void Synth::end()
+{
+    if (_queue != nullptr) {
+        vQueueDelete(_queue);
+        _queue = nullptr;
+    }
+}
+
+uint32_t Synth::msToSamples(uint32_t ms) const
+{
+    return static_cast<uint32_t>(static_cast<uint64_t>(ms) * _sample_rate / 1000);
+}
+
+bool Synth::post(const Command_t& command)
+{
+    if (_queue == nullptr || xQueueSend(_queue, &command, 0) != pdTRUE) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool Synth::noteOn(float hz, uint32_t duration_ms, uint16_t velocity, const Patch_t& patch, uint32_t delay_ms)
+{
+    Command_t command;
+    command.op          = Op::NoteOn;
+    command.velocity    = velocity;
+    command.hz          = hz;
+    command.duration_ms = duration_ms;
+    command.delay_ms    = delay_ms;
+    command.patch       = patch;
+    return post(command);
+}
+
+bool Synth::allOff()
+{
+    Command_t command;
+    command.op = Op::AllOff;
+    return post(command);
+}
+
+bool Synth::idle() const
+{
+    if (_pending_count > 0 || (_queue != nullptr && uxQueueMessagesWaiting(_queue) > 0)) {
+        return false;
+    }
+    for (const auto& v : _voices) {
+        if (v.stage != Stage::Off) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Synth::wait(TickType_t ticks)
+{
+    Command_t command;
+    if (_queue == nullptr || xQueueReceive(_queue, &command, ticks) != pdTRUE) {
+        return false;
+    }
+    apply(command);
+    return true;
+}
+
+void Synth::apply(const Command_t& command)
+{
+    if (command.op == Op::AllOff) {
+        _pending_count = 0;
+        for (auto& v : _voices) {
+            if (v.stage != Stage::Off && v.stage != Stage::Release) {
+                enterStage(v, Stage::Release);
+            }
+        }
+        return;
+    }
+    if (command.hz <= 0.0f || command.hz >= _sample_rate / 2) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (command.delay_ms == 0) {
+        start(command, 0);
+        return;
+    }
+    if (_pending_count == kMaxPending) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    _pending[_pending_count].start   = _frame + msToSamples(command.delay_ms);
+    _pending[_pending_count].command = command;
+    ++_pending_count;
+}
+
+Synth::Voice_t& Synth::allocate()
+{
+    Voice_t* quietest = nullptr;
+    Voice_t* oldest   = &_voices[0];
+    for (auto& v : _voices) {
+        if (v.stage == Stage::Off) {
+            return v;
+        }
+        if (v.stage == Stage::Release && (quietest == nullptr || v.level < quietest->level)) {
+            quietest = &v;
+        }
+        if (v.started < oldest->started) {
+            oldest = &v;
+        }
+    }
+    _stolen.fetch_add(1, std::memory_order_relaxed);
+    return quietest != nullptr ? *quietest : *oldest;
+}
+
+void Synth::start(const Command_t& command, uint32_t skip)
+{
+    const auto& p = command.patch;
+    Voice_t& v    = allocate();
+    v.table       = tables().wave[std::min<size_t>(static_cast<size_t>(p.wave), kTableCount - 1)];
+    v.phase       = 0;
+    v.step        = static_cast<uint32_t>(static_cast<double>(command.hz) / _sample_rate * 4294967296.0);
+    v.level       = 0;
+    v.sustain     = static_cast<int32_t>(std::min<uint32_t>(p.sustain, 32767)) << 15;
+    v.gate        = msToSamples(command.duration_ms);
+    v.attack      = msToSamples(p.attack_ms);
+    v.decay       = msToSamples(p.decay_ms);
+    v.release     = msToSamples(p.release_ms);
+    v.skip        = skip;
+    v.velocity    = std::min<int32_t>(command.velocity, 32767);
+    v.started     = _frame + skip;
+    enterStage(v, v.gate > 0 ? Stage::Attack : Stage::Release);
+    _notes.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Each stage is a straight line from the level it starts at, zero length stages fall through to the next one
+void Synth::enterStage(Voice_t& v, Stage stage)
+{
+    v.stage = stage;
+    switch (stage) {
+        case Stage::Attack:
+            if (v.attack == 0) {
+                v.level = kEnvMax;
+                enterStage(v, Stage::Decay);
+                return;
+            }
+            v.left  = v.attack;
+            v.slope = (kEnvMax - v.level) / static_cast<int32_t>(v.attack);
+            return;
+        case Stage::Decay:
+            if (v.decay == 0) {
+                v.level = v.sustain;
+                enterStage(v, Stage::Sustain);
+                return;
+            }
+            v.left  = v.decay;
+            v.slope = (v.sustain - v.level) / static_cast<int32_t>(v.decay);
+            return;
+        case Stage::Sustain:
+            if (v.sustain == 0) {
+                v.stage = Stage::Off;
+                return;
+            }
+            v.left  = kForever;
+            v.slope = 0;
+            return;
+        case Stage::Release:
+            if (v.release == 0 || v.level == 0) {
+                v.stage = Stage::Off;
+                return;
+            }
+            v.left  = v.release;
+            v.slope = -(v.level / static_cast<int32_t>(v.release));
+            return;
+        case Stage::Off:
+            return;
+    }
+}
+
+void Synth::renderVoice(Voice_t& v, int16_t* out, size_t frames)
+{
+    size_t i = std::min<size_t>(v.skip, frames);
+    std::memset(out, 0, i * sizeof(int16_t));
+    v.skip = 0;
+
+    const int16_t* table = v.table;
+    while (i < frames && v.stage != Stage::Off) {
+        const bool held = v.stage != Stage::Release;
+        uint32_t run    = static_cast<uint32_t>(std::min<size_t>(frames - i, v.left));
+        if (held) {
+            run = std::min(run, v.gate);
+        }
+
+        uint32_t phase = v.phase;
+        int32_t level  = v.level;
+        for (uint32_t n = 0; n < run; ++n) {
+            const uint32_t idx = phase >> (32 - kTableBits);
+            const int32_t frac = static_cast<int32_t>((phase >> kFracShift) & 0x7FFF);
+            const int32_t a    = table[idx];
+            const int32_t s    = a + (((table[idx + 1] - a) * frac) >> 15);
+            const int32_t amp  = ((level >> 15) * v.velocity) >> 15;
+            out[i + n]         = static_cast<int16_t>((s * amp) >> 15);
+            level += v.slope;
+            phase += v.step;
+        }
+        i += run;
+        v.phase = phase;
+        v.level = level;
+        v.left -= run;
+        if (held) {
+            v.gate -= run;
+        }
+
+        if (held && v.gate == 0) {
+            enterStage(v, Stage::Release);
+        } else if (v.left == 0) {
+            // Land on the exact target so rounding in the slope never carries over
+            switch (v.stage) {
+                case Stage::Attack:
+                    v.level = kEnvMax;
+                    enterStage(v, Stage::Decay);
+                    break;
+                case Stage::Decay:
+                    v.level = v.sustain;
+                    enterStage(v, Stage::Sustain);
+                    break;
+                default:
+                    v.level = 0;
+                    v.stage = Stage::Off;
+                    break;
+            }
+        }
+    }
+    std::memset(out + i, 0, (frames - i) * sizeof(int16_t));
+}
+
+void Synth::renderBlock(int16_t* out, size_t frames)
+{
+    // Delayed notes that start inside this block go to a voice, skipping up to their frame
+    for (size_t p = 0; p < _pending_count;) {
+        if (_pending[p].start < _frame + frames) {
+            const uint64_t at = std::max(_pending[p].start, _frame);
+            start(_pending[p].command, static_cast<uint32_t>(at - _frame));
+            _pending[p] = _pending[--_pending_count];
+        } else {
+            ++p;
+        }
+    }
+
+    std::memset(out, 0, frames * sizeof(int16_t));
+    uint32_t sounding   = 0;
+    const int64_t begin = esp_timer_get_time();
+    for (auto& v : _voices) {
+        if (v.stage == Stage::Off) {
+            continue;
+        }
+        renderVoice(v, _scratch, frames);
+        pcm::mixAdd(out, _scratch, frames);
+        ++sounding;
+    }
+    // Microsecond ticks truncate each block, but a block starts at a random point of a tick so the sum stays unbiased
+    const auto us = static_cast<uint32_t>(esp_timer_get_time() - begin);
+
+    _frame += frames;
+    _blocks.fetch_add(1, std::memory_order_relaxed);
+    if (sounding == 0) {
+        return;
+    }
+    _voice_blocks.fetch_add(sounding, std::memory_order_relaxed);
+    _voice_us.fetch_add(us, std::memory_order_relaxed);
+    if (us > _max_block_us.load(std::memory_order_relaxed)) {
+        _max_block_us.store(us, std::memory_order_relaxed);
+    }
+    if (sounding > _peak_voices.load(std::memory_order_relaxed)) {
+        _peak_voices.store(sounding, std::memory_order_relaxed);
+    }
+}
+
+void Synth::render(int16_t* out, size_t frames)
+{
+    Command_t command;
+    while (_queue != nullptr && xQueueReceive(_queue, &command, 0) == pdTRUE) {
+        apply(command);
+    }
+    while (frames > 0) {
+        const size_t n = std::min(frames, kBlockFrames);
+        renderBlock(out, n);
+        out += n;
+        frames -= n;
+    }
+}
+
+Synth::Stats_t Synth::stats() const
+{
+    Stats_t s;
+    s.notes        = _notes.load(std::memory_order_relaxed);
+    s.dropped      = _dropped.load(std::memory_order_relaxed);
+    s.stolen       = _stolen.load(std::memory_order_relaxed);
+    s.blocks       = _blocks.load(std::memory_order_relaxed);
+    s.voice_blocks = _voice_blocks.load(std::memory_order_relaxed);
+    s.max_block_us = _max_block_us.load(std::memory_order_relaxed);
+    s.peak_voices  = _peak_voices.load(std::memory_order_relaxed);
+    if (s.voice_blocks > 0) {
+        s.voice_ns = static_cast<uint32_t>(_voice_us.load(std::memory_order_relaxed) * 1000ull / s.voice_blocks);
+    }
+    return s;
+}
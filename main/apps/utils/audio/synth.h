@@ -0,0 +1,169 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "pcm.h"
+
+/**
+ * Polyphonic wavetable synth for UI sounds
+ *
+ * Any task posts notes with noteOn(), which never blocks and never allocates: the note is copied into a small command
+ * queue and dropped (and counted) if that is full. The render task owns everything else. It wait()s on the queue while
+ * nothing sounds, then render()s mono blocks: queued notes go to a fixed pool of kMaxVoices voices (the quietest
+ * releasing or else the oldest one is stolen when all are busy), each voice reads a band limited wavetable through a
+ * 32-bit phase accumulator with linear interpolation and follows an integer ADSR envelope, and the voices are summed
+ * with saturation. Notes posted with a delay wait in a fixed list until their start frame, which is how a melody is
+ * posted in one go.
+ *
+ * The time spent on the voices of each block is measured, Stats_t reports it per voice per block.
+ */
+class Synth {
+public:
+    enum class Wave : uint8_t {
+        Sine = 0,
+        Square,
+        Saw,
+        Triangle,
+    };
+
+    static constexpr size_t kMaxVoices   = 8;
+    static constexpr size_t kMaxPending  = 32;  // Delayed notes waiting for their start
+    static constexpr size_t kQueueDepth  = 32;
+    static constexpr size_t kBlockFrames = 256;  // Longest run rendered at once, longer render() calls loop
+    static constexpr size_t kTableBits   = 8;
+    static constexpr size_t kTableSize   = 1 << kTableBits;
+
+    struct Patch_t {
+        Wave wave           = Wave::Sine;
+        uint16_t attack_ms  = 1;
+        uint16_t decay_ms   = 0;
+        uint16_t sustain    = 32767;  // Q15 of the peak
+        uint16_t release_ms = 4;
+    };
+
+    struct Stats_t {
+        uint32_t notes        = 0;  // Started
+        uint32_t dropped      = 0;  // Queue or pending list full
+        uint32_t stolen       = 0;  // Voices cut short for a new note
+        uint32_t blocks       = 0;
+        uint32_t voice_blocks = 0;  // Sum over blocks of the voices that sounded in it
+        uint32_t voice_ns     = 0;  // Mean cost of one voice for one block
+        uint32_t max_block_us = 0;
+        uint32_t peak_voices  = 0;
+    };
+
+    Synth() = default;
+    ~Synth();
+    Synth(const Synth&)            = delete;
+    Synth& operator=(const Synth&) = delete;
+
+    /** Creates the command queue, the wavetables are built by the first call */
+    bool begin(uint32_t sample_rate);
+    void end();
+
+    /**
+     * Any task. Starts a note of hz after delay_ms, held for duration_ms before it releases. velocity is the Q15 peak
+     * level. False if the command queue is full
+     */
+    bool noteOn(float hz, uint32_t duration_ms, uint16_t velocity, const Patch_t& patch, uint32_t delay_ms = 0);
+
+    /** Any task. Releases every voice and forgets delayed notes */
+    bool allOff();
+
+    /** Render task. True when no voice sounds and nothing is queued or pending, the task may wait() */
+    bool idle() const;
+
+    /** Render task. Blocks up to ticks for a command and takes it in, false on timeout */
+    bool wait(TickType_t ticks);
+
+    /** Render task. Takes in queued commands and fills out with frames mono samples */
+    void render(int16_t* out, size_t frames);
+
+    uint32_t sampleRate() const
+    {
+        return _sample_rate;
+    }
+
+    Stats_t stats() const;
+
+private:
+    enum class Op : uint8_t {
+        NoteOn = 0,
+        AllOff,
+    };
+
+    struct Command_t {
+        Op op                = Op::NoteOn;
+        uint16_t velocity    = 0;
+        float hz             = 0.0f;
+        uint32_t duration_ms = 0;
+        uint32_t delay_ms    = 0;
+        Patch_t patch;
+    };
+
+    struct Pending_t {
+        uint64_t start = 0;  // Frame
+        Command_t command;
+    };
+
+    enum class Stage : uint8_t {
+        Off = 0,
+        Attack,
+        Decay,
+        Sustain,
+        Release,
+    };
+
+    struct Voice_t {
+        const int16_t* table = nullptr;
+        uint32_t phase       = 0;
+        uint32_t step        = 0;
+        int32_t level        = 0;  // Q30 envelope
+        int32_t slope        = 0;  // Per sample
+        int32_t sustain      = 0;  // Q30
+        uint32_t left        = 0;  // Samples to the end of the stage
+        uint32_t gate        = 0;  // Samples to the release
+        uint32_t attack      = 0;
+        uint32_t decay       = 0;
+        uint32_t release     = 0;
+        uint32_t skip        = 0;  // Silent samples before the start, first block only
+        int32_t velocity     = 0;  // Q15
+        uint64_t started     = 0;  // Frame, the oldest is stolen first
+        Stage stage          = Stage::Off;
+    };
+
+    bool post(const Command_t& command);
+    void apply(const Command_t& command);
+    void start(const Command_t& command, uint32_t skip);
+    Voice_t& allocate();
+    void enterStage(Voice_t& v, Stage stage);
+    void renderVoice(Voice_t& v, int16_t* out, size_t frames);
+    void renderBlock(int16_t* out, size_t frames);
+    uint32_t msToSamples(uint32_t ms) const;
+
+    QueueHandle_t _queue  = nullptr;
+    uint32_t _sample_rate = 0;
+    uint64_t _frame       = 0;
+
+    // Render task
+    Voice_t _voices[kMaxVoices];
+    Pending_t _pending[kMaxPending];
+    size_t _pending_count = 0;
+    alignas(pcm::kAlign) int16_t _scratch[kBlockFrames];
+
+    std::atomic<uint32_t> _notes{0};
+    std::atomic<uint32_t> _dropped{0};
+    std::atomic<uint32_t> _stolen{0};
+    std::atomic<uint32_t> _blocks{0};
+    std::atomic<uint32_t> _voice_blocks{0};
+    std::atomic<uint32_t> _voice_us{0};
+    std::atomic<uint32_t> _max_block_us{0};
+    std::atomic<uint32_t> _peak_voices{0};
+};
@@ -0,0 +1,397 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "wav_recorder.h"
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+static constexpr int16_t kNoSlot = -1;
+// Sizes of a header that was never patched, players read to the end of the file
+static constexpr uint32_t kStreaming = 0xFFFFFFFFu;
+// RIFF sizes are 32 bits, stop taking data a little before the file would overflow them
+static constexpr uint32_t kMaxDataBytes = 0xFFFF0000u;
+
+static uint8_t* put16(uint8_t* p, uint16_t v)
+{
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+    return p + 4;
+}
+
+static uint8_t* putTag(uint8_t* p, const char* tag)
+{
+    std::memcpy(p, tag, 4);
+    return p + 4;
+}
+
+WavRecorder::~WavRecorder()
+{
+    if (busy()) {
+        finish();
+        wait();
+    }
+}
+
+uint32_t WavRecorder::byteRate(const Config_t& config)
+{
+    if (config.codec == Codec::ImaAdpcm) {
+        const uint64_t bytes = static_cast<uint64_t>(config.sample_rate) * adpcm::blockBytes(config.channels);
+        return static_cast<uint32_t>((bytes + adpcm::kFramesPerBlock / 2) / adpcm::kFramesPerBlock);
+    }
+    return config.sample_rate * config.channels * 2;
+}
+
+size_t WavRecorder::headerBytes() const
+{
+    // ADPCM adds cbSize and samples per block to fmt, and a fact chunk with the frame count
+    return _config.codec == Codec::ImaAdpcm ? 60 : 44;
+}
+
+void WavRecorder::buildHeader(uint8_t* out, uint32_t data_bytes, uint32_t frames) const
+{
+    const bool ima       = _config.codec == Codec::ImaAdpcm;
+    const uint16_t ch    = _config.channels;
+    const uint16_t align = ima ? static_cast<uint16_t>(adpcm::blockBytes(ch)) : static_cast<uint16_t>(ch * 2);
+    const uint32_t riff  = data_bytes == kStreaming ? kStreaming : data_bytes + headerBytes() - 8;
+    uint8_t* p           = out;
+
+    p = putTag(p, "RIFF");
+    p = put32(p, riff);
+    p = putTag(p, "WAVE");
+    p = putTag(p, "fmt ");
+    p = put32(p, ima ? 20 : 16);
+    p = put16(p, ima ? 0x0011 : 0x0001);
+    p = put16(p, ch);
+    p = put32(p, _config.sample_rate);
+    p = put32(p, byteRate(_config));
+    p = put16(p, align);
+    p = put16(p, ima ? 4 : 16);
+    if (ima) {
+        p = put16(p, 2);
+        p = put16(p, static_cast<uint16_t>(adpcm::kFramesPerBlock));
+        p = putTag(p, "fact");
+        p = put32(p, 4);
+        p = put32(p, frames);
+    }
+    p = putTag(p, "data");
+    put32(p, data_bytes);
+}
+
+bool WavRecorder::start(const Config_t& config)
+{
+    if (busy() || config.path.empty() || config.sample_rate == 0 || config.channels < 1 || config.channels > 2) {
+        return false;
+    }
+    _config = config;
+
+    // As many slots as asked for if the heap has them, never fewer than two, one filling while the other is written
+    _slots = std::max(config.slots, kMinSlots);
+    while (_slots >= kMinSlots) {
+        _pool = static_cast<uint8_t*>(heap_caps_malloc(_slots * kChunkBytes, MALLOC_CAP_DMA | MALLOC_CAP_8BIT));
+        if (_pool != nullptr) {
+            break;
+        }
+        _slots--;
+    }
+    if (_pool == nullptr) {
+        _error.store(ENOMEM);
+        return false;
+    }
+    _free_queue = xQueueCreate(_slots, sizeof(int16_t));
+    // One more than the slots, the last chunk may carry none
+    _full_queue = xQueueCreate(_slots + 1, sizeof(Chunk_t));
+    if (_free_queue == nullptr || _full_queue == nullptr) {
+        if (_free_queue != nullptr) {
+            vQueueDelete(_free_queue);
+        }
+        if (_full_queue != nullptr) {
+            vQueueDelete(_full_queue);
+        }
+        heap_caps_free(_pool);
+        _pool = nullptr;
+        _error.store(ENOMEM);
+        return false;
+    }
+    for (int16_t slot = 0; slot < static_cast<int16_t>(_slots); ++slot) {
+        xQueueSend(_free_queue, &slot, 0);
+    }
+
+    _frames.store(0);
+    _dropped.store(0);
+    _bytes.store(0);
+    _writes.store(0);
+    _max_write_us.store(0);
+    _min_free.store(static_cast<uint32_t>(_slots));
+    _error.store(0);
+    _fill_slot = kNoSlot;
+    _next_slot = kNoSlot;
+    _fill      = 0;
+    _encoded   = 0;
+    _finishing = false;
+    if (_config.codec == Codec::ImaAdpcm) {
+        _staged.assign(adpcm::kFramesPerBlock * _config.channels, 0);
+        _block.assign(adpcm::blockBytes(_config.channels), 0);
+        _staged_frames = 0;
+        _adpcm[0]      = adpcm::State_t{};
+        _adpcm[1]      = adpcm::State_t{};
+    }
+
+    // The first slot starts with the header, so every later write lands on a kChunkBytes boundary of the file
+    takeSlot(_fill_slot);
+    buildHeader(_pool + _fill_slot * kChunkBytes, kStreaming, 0);
+    _fill = headerBytes();
+
+    _busy.store(true, std::memory_order_release);
+    BaseType_t ok = xTaskCreatePinnedToCore(WavRecorder::writerTaskMain, "wav_writer", 4096, this, 3, &_writer, 0);
+    if (ok != pdPASS) {
+        _writer = nullptr;
+        vQueueDelete(_free_queue);
+        vQueueDelete(_full_queue);
+        _free_queue = nullptr;
+        _full_queue = nullptr;
+        heap_caps_free(_pool);
+        _pool = nullptr;
+        _error.store(ENOMEM);
+        _busy.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Capture side                                */
+/* -------------------------------------------------------------------------- */
+
+bool WavRecorder::takeSlot(int16_t& slot)
+{
+    if (xQueueReceive(_free_queue, &slot, 0) != pdTRUE) {
+        slot = kNoSlot;
+        _min_free.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    const uint32_t left = uxQueueMessagesWaiting(_free_queue);
+    if (left < _min_free.load(std::memory_order_relaxed)) {
+        _min_free.store(left, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void WavRecorder::sendFill(bool last)
+{
+    Chunk_t chunk;
+    chunk.slot  = _fill_slot;
+    chunk.bytes = static_cast<uint32_t>(_fill);
+    chunk.last  = last;
+    if (last) {
+        chunk.frames = _frames.load(std::memory_order_relaxed);
+        chunk.data   = _encoded;
+        // A slot taken ahead is never filled, the writer frees the pool as a whole
+        _next_slot = kNoSlot;
+    }
+    // Never blocks, there are more places in the queue than slots
+    xQueueSend(_full_queue, &chunk, 0);
+    _fill_slot = kNoSlot;
+    _fill      = 0;
+}
+
+// All or nothing, a block split over a dropped slot would throw every later ADPCM block off. len <= kChunkBytes
+bool WavRecorder::append(const uint8_t* data, size_t len)
+{
+    if (_encoded + len > kMaxDataBytes) {
+        return false;
+    }
+    if (_fill_slot == kNoSlot && !takeSlot(_fill_slot)) {
+        return false;
+    }
+    const size_t room = kChunkBytes - _fill;
+    if (len > room && _next_slot == kNoSlot && !takeSlot(_next_slot)) {
+        return false;
+    }
+
+    const size_t first = std::min(len, room);
+    std::memcpy(_pool + _fill_slot * kChunkBytes + _fill, data, first);
+    _fill += first;
+    _encoded += static_cast<uint32_t>(len);
+    if (_fill == kChunkBytes) {
+        const int16_t next = _next_slot;
+        _next_slot         = kNoSlot;
+        sendFill(false);
+        _fill_slot = next;
+    }
+    if (first < len) {
+        std::memcpy(_pool + _fill_slot * kChunkBytes, data + first, len - first);
+        _fill = len - first;
+    }
+    return true;
+}
+
+void WavRecorder::encodeStaged()
+{
+    adpcm::encodeBlock(_staged.data(), _config.channels, _adpcm, _block.data());
+    if (append(_block.data(), _block.size())) {
+        _frames.fetch_add(static_cast<uint32_t>(_staged_frames), std::memory_order_relaxed);
+    } else {
+        _dropped.fetch_add(static_cast<uint32_t>(_staged_frames), std::memory_order_relaxed);
+    }
+    _staged_frames = 0;
+}
+
+void WavRecorder::push(const int16_t* frames, size_t count)
+{
+    if (!busy() || _finishing) {
+        return;
+    }
+    const size_t ch = _config.channels;
+
+    if (_config.codec == Codec::ImaAdpcm) {
+        while (count > 0) {
+            const size_t n = std::min(count, adpcm::kFramesPerBlock - _staged_frames);
+            std::memcpy(_staged.data() + _staged_frames * ch, frames, n * ch * sizeof(int16_t));
+            _staged_frames += n;
+            frames += n * ch;
+            count -= n;
+            if (_staged_frames == adpcm::kFramesPerBlock) {
+                encodeStaged();
+            }
+        }
+        return;
+    }
+
+    // Half a slot at most per append, so the all or nothing rule never throws away much at once
+    const size_t max_frames = kChunkBytes / 2 / (ch * sizeof(int16_t));
+    while (count > 0) {
+        const size_t n = std::min(count, max_frames);
+        if (append(reinterpret_cast<const uint8_t*>(frames), n * ch * sizeof(int16_t))) {
+            _frames.fetch_add(static_cast<uint32_t>(n), std::memory_order_relaxed);
+        } else {
+            _dropped.fetch_add(static_cast<uint32_t>(n), std::memory_order_relaxed);
+        }
+        frames += n * ch;
+        count -= n;
+    }
+}
+
+void WavRecorder::finish()
+{
+    if (!busy() || _finishing) {
+        return;
+    }
+    // The last ADPCM block is padded with its last frame, the fact chunk tells players where the audio ends
+    if (_config.codec == Codec::ImaAdpcm && _staged_frames > 0) {
+        const size_t ch = _config.channels;
+        for (size_t i = _staged_frames; i < adpcm::kFramesPerBlock; ++i) {
+            std::memcpy(_staged.data() + i * ch, _staged.data() + (_staged_frames - 1) * ch, ch * sizeof(int16_t));
+        }
+        encodeStaged();
+    }
+    _finishing = true;
+    sendFill(true);
+}
+
+void WavRecorder::wait()
+{
+    while (busy()) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+}
+
+WavRecorder::Stats_t WavRecorder::stats() const
+{
+    Stats_t s;
+    s.frames       = _frames.load(std::memory_order_relaxed);
+    s.dropped      = _dropped.load(std::memory_order_relaxed);
+    s.bytes        = _bytes.load(std::memory_order_relaxed);
+    s.writes       = _writes.load(std::memory_order_relaxed);
+    s.max_write_us = _max_write_us.load(std::memory_order_relaxed);
+    s.min_free     = _min_free.load(std::memory_order_relaxed);
+    s.slots        = static_cast<uint32_t>(_slots);
+    s.error        = _error.load(std::memory_order_relaxed);
+    s.busy         = busy();
+    return s;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Writer                                   */
+/* -------------------------------------------------------------------------- */
+
+void WavRecorder::writerTaskMain(void* arg)
+{
+    static_cast<WavRecorder*>(arg)->writerLoop();
+    vTaskDelete(nullptr);
+}
+
+void WavRecorder::writerLoop()
+{
+    const WriteFn write = _config.write ? _config.write : ::write;
+    const int fd        = open(_config.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        _error.store(errno);
+    }
+
+    // After an error the chunks still go round so the capture side never stalls, they just aren't written
+    Chunk_t chunk;
+    while (true) {
+        xQueueReceive(_full_queue, &chunk, portMAX_DELAY);
+        if (chunk.slot != kNoSlot && chunk.bytes > 0 && fd >= 0 && _error.load() == 0) {
+            const int64_t start = esp_timer_get_time();
+            const ssize_t n     = write(fd, _pool + chunk.slot * kChunkBytes, chunk.bytes);
+            const auto us       = static_cast<uint32_t>(esp_timer_get_time() - start);
+            if (n != static_cast<ssize_t>(chunk.bytes)) {
+                _error.store(n < 0 ? errno : ENOSPC);
+            } else {
+                _bytes.fetch_add(chunk.bytes, std::memory_order_relaxed);
+                _writes.fetch_add(1, std::memory_order_relaxed);
+                if (us > _max_write_us.load(std::memory_order_relaxed)) {
+                    _max_write_us.store(us, std::memory_order_relaxed);
+                }
+            }
+        }
+        if (chunk.last) {
+            break;
+        }
+        xQueueSend(_free_queue, &chunk.slot, 0);
+    }
+
+    if (fd >= 0) {
+        if (_error.load() == 0) {
+            uint8_t header[64];
+            const size_t size = headerBytes();
+            buildHeader(header, chunk.data, chunk.frames);
+            if (lseek(fd, 0, SEEK_SET) != 0 || write(fd, header, size) != static_cast<ssize_t>(size)) {
+                _error.store(errno ? errno : EIO);
+            }
+        }
+        // Data still in the file system's buffers hasn't been written yet
+        if (fsync(fd) != 0 && _error.load() == 0) {
+            _error.store(errno);
+        }
+        if (close(fd) != 0 && _error.load() == 0) {
+            _error.store(errno);
+        }
+    }
+
+    vQueueDelete(_free_queue);
+    vQueueDelete(_full_queue);
+    _free_queue = nullptr;
+    _full_queue = nullptr;
+    heap_caps_free(_pool);
+    _pool   = nullptr;
+    _writer = nullptr;
+    _busy.store(false, std::memory_order_release);
+}
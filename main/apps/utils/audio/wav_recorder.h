@@ -0,0 +1,138 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <sys/types.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ima_adpcm.h"
+
+/**
+ * Streams 16-bit audio into a WAV file, as PCM or IMA ADPCM, without the capture side ever waiting on the card
+ *
+ * The capture task push()es frames, which are encoded straight into a pool of preallocated kChunkBytes slots. Full
+ * slots go to a writer task that owns the file and writes one whole slot per call, so every write covers a full
+ * 16 KB run of clusters at a 16 KB aligned offset (the header is part of the first slot). While a write stalls the
+ * capture side keeps filling the free slots, only once none is left are frames dropped and counted.
+ *
+ * The header goes out with placeholder sizes and is patched by the writer once the capture side calls finish(), a
+ * file cut short by power loss still opens as a stream. start() and the stats come from any task, push() and
+ * finish() from the one capture task.
+ */
+class WavRecorder {
+public:
+    enum class Codec : uint8_t {
+        Pcm16 = 0,
+        ImaAdpcm,
+    };
+
+    using WriteFn = ssize_t (*)(int fd, const void* data, size_t len);
+
+    static constexpr size_t kChunkBytes = 16 * 1024;
+    static constexpr size_t kMinSlots   = 2;
+
+    struct Config_t {
+        std::string path;
+        uint32_t sample_rate = 16000;
+        uint8_t channels     = 1;  // 1 or 2
+        Codec codec          = Codec::Pcm16;
+        // Stall the capture side rides out is slots * kChunkBytes of encoded audio, fewer are taken if memory is short
+        size_t slots = 4;
+        // In place of ::write, lets the host runner inject card stalls
+        WriteFn write = nullptr;
+    };
+
+    struct Stats_t {
+        uint32_t frames       = 0;  // Accepted, what the file will hold
+        uint32_t dropped      = 0;  // Frames that found no free slot
+        uint32_t bytes        = 0;  // Written to the card, header included
+        uint32_t writes       = 0;
+        uint32_t max_write_us = 0;
+        uint32_t min_free     = 0;  // Fewest slots left free after taking one, headroom that was never needed
+        uint32_t slots        = 0;
+        int error             = 0;  // errno of the first open or write that failed
+        bool busy             = false;
+    };
+
+    WavRecorder() = default;
+    ~WavRecorder();
+    WavRecorder(const WavRecorder&)            = delete;
+    WavRecorder& operator=(const WavRecorder&) = delete;
+
+    /** Allocate the slots and start the writer task, which creates the file. False if one is still finishing */
+    bool start(const Config_t& config);
+
+    /** Capture side. Takes count interleaved frames, what finds no free slot is counted in Stats_t::dropped */
+    void push(const int16_t* frames, size_t count);
+
+    /** Capture side, after the last push(). The writer flushes, patches the header, closes and frees the slots */
+    void finish();
+
+    /** Blocks until the writer is done, for tear down paths that can't wait for the next frame */
+    void wait();
+
+    /** True from start() until the writer closed the file */
+    bool busy() const
+    {
+        return _busy.load(std::memory_order_acquire);
+    }
+
+    Stats_t stats() const;
+
+    /** Bytes per second going to the card */
+    static uint32_t byteRate(const Config_t& config);
+
+private:
+    struct Chunk_t {
+        int16_t slot    = -1;
+        uint32_t bytes  = 0;
+        bool last       = false;
+        uint32_t frames = 0;  // last only, total accepted
+        uint32_t data   = 0;  // last only, total encoded bytes after the header
+    };
+
+    static void writerTaskMain(void* arg);
+    void writerLoop();
+    size_t headerBytes() const;
+    void buildHeader(uint8_t* out, uint32_t data_bytes, uint32_t frames) const;
+
+    bool takeSlot(int16_t& slot);
+    bool append(const uint8_t* data, size_t len);
+    void sendFill(bool last);
+    void encodeStaged();
+
+    Config_t _config;
+    uint8_t* _pool            = nullptr;
+    size_t _slots             = 0;
+    QueueHandle_t _free_queue = nullptr;  // Slot indices
+    QueueHandle_t _full_queue = nullptr;  // Chunk_t
+    TaskHandle_t _writer      = nullptr;
+
+    // Capture side
+    int16_t _fill_slot = -1;
+    int16_t _next_slot = -1;  // Taken ahead when an append spills over
+    size_t _fill       = 0;
+    uint32_t _encoded  = 0;
+    bool _finishing    = false;
+    std::vector<int16_t> _staged;  // ADPCM, one block of frames
+    size_t _staged_frames = 0;
+    adpcm::State_t _adpcm[2];
+    std::vector<uint8_t> _block;
+
+    std::atomic<bool> _busy{false};
+    std::atomic<uint32_t> _frames{0};
+    std::atomic<uint32_t> _dropped{0};
+    std::atomic<uint32_t> _bytes{0};
+    std::atomic<uint32_t> _writes{0};
+    std::atomic<uint32_t> _max_write_us{0};
+    std::atomic<uint32_t> _min_free{0};
+    std::atomic<int> _error{0};
+};
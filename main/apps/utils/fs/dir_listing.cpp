@@ -0,0 +1,950 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "dir_listing.h"
+#include "fs_utils.h"
+#include "io_service.h"
+#include <mooncake_log.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+static const std::string _tag = "DirListing";
+
+static constexpr uint32_t kFileMagic      = 0x5453494C;  // "LIST"
+static constexpr uint16_t kFileVersion    = 1;
+static constexpr size_t kRunBufferBytes   = 1024;
+static constexpr size_t kOffsetChunk      = 256;
+static constexpr int kCancelCheckInterval = 64;
+
+struct DirListing::Request_t {
+    std::string dir;
+    std::string cache_dir;
+    std::string sidecar_path;
+    FileFilter filter = nullptr;
+};
+
+struct DirListing::Window_t {
+    std::string names;
+    std::vector<uint32_t> offsets;
+    int dir_count = 0;
+};
+
+namespace {
+
+struct Header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t count;
+    uint32_t dir_count;
+    uint64_t signature;
+    uint64_t dir_hash;
+    uint32_t names_bytes;
+    uint32_t reserved2;
+};
+
+static_assert(sizeof(Header_t) == 40, "sidecar header layout");
+
+/** Case-folded sort key, ASCII only like the std::tolower() compare the browser always used */
+void fold_into(std::string_view name, std::string& out)
+{
+    for (char c : name) {
+        out.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c);
+    }
+}
+
+std::string folded(std::string_view name)
+{
+    std::string key;
+    key.reserve(name.size());
+    fold_into(name, key);
+    return key;
+}
+
+/** Folders first, then by folded key, with the exact name as tie break so the order is total */
+bool entry_less(bool a_dir, std::string_view a_key, std::string_view a_name, bool b_dir, std::string_view b_key,
+                std::string_view b_name)
+{
+    if (a_dir != b_dir) {
+        return a_dir;
+    }
+    const int c = a_key.compare(b_key);
+    if (c != 0) {
+        return c < 0;
+    }
+    return a_name < b_name;
+}
+
+/** Order independent digest of the listed set, readdir() order changes don't invalidate a sidecar */
+struct Signature_t {
+    uint32_t count     = 0;
+    uint32_t dir_count = 0;
+    uint64_t sum       = 0;
+
+    void add(std::string_view name, bool is_dir)
+    {
+        const uint64_t h = fs_utils::hash_name(name);
+        sum += is_dir ? ~h : h;
+        count++;
+        dir_count += is_dir ? 1 : 0;
+    }
+};
+
+/** 1 for a folder, 0 for a listed file, -1 to skip */
+int classify(const std::string& dir, const dirent* ent, DirListing::FileFilter filter)
+{
+    const int kind = fs_utils::classify(dir, ent);
+    return kind == 0 && filter && !filter(ent->d_name) ? -1 : kind;
+}
+
+/**
+ * Entries sorted in memory at once. Each one is stored as its folded key followed by its name in a single pool, so
+ * sorting never allocates
+ */
+class Page {
+public:
+    /** False if the entry doesn't fit anymore */
+    bool add(std::string_view name, bool is_dir)
+    {
+        if (_items.size() >= DirListing::kPageEntries || _pool.size() + name.size() * 2 > DirListing::kPageBytes) {
+            return false;
+        }
+        _items.push_back({static_cast<uint32_t>(_pool.size()), static_cast<uint16_t>(name.size()), is_dir});
+        fold_into(name, _pool);
+        _pool.append(name);
+        return true;
+    }
+
+    void sort()
+    {
+        std::sort(_items.begin(), _items.end(), [this](const Item_t& a, const Item_t& b) {
+            return entry_less(a.is_dir, key(a), name(a), b.is_dir, key(b), name(b));
+        });
+    }
+
+    void clear()
+    {
+        _items.clear();
+        _pool.clear();
+    }
+
+    bool empty() const
+    {
+        return _items.empty();
+    }
+
+    /** fn(name, is_dir) for every entry in order */
+    template <typename Fn>
+    void forEach(Fn&& fn) const
+    {
+        for (const auto& item : _items) {
+            fn(name(item), item.is_dir);
+        }
+    }
+
+private:
+    struct Item_t {
+        uint32_t offset;
+        uint16_t len;
+        bool is_dir;
+    };
+
+    std::string _pool;
+    std::vector<Item_t> _items;
+
+    std::string_view key(const Item_t& item) const
+    {
+        return std::string_view(_pool).substr(item.offset, item.len);
+    }
+    std::string_view name(const Item_t& item) const
+    {
+        return std::string_view(_pool).substr(item.offset + item.len, item.len);
+    }
+};
+
+bool write_record(std::FILE* f, std::string_view name, bool is_dir)
+{
+    const uint8_t head[3] = {static_cast<uint8_t>(is_dir), static_cast<uint8_t>(name.size() & 0xFF),
+                             static_cast<uint8_t>(name.size() >> 8)};
+    return std::fwrite(head, sizeof(head), 1, f) == 1 && std::fwrite(name.data(), 1, name.size(), f) == name.size();
+}
+
+/** Sequential reader of one sorted run, buffered so all runs can share the one run file during the merge */
+class RunReader {
+public:
+    RunReader(std::FILE* f, long begin, long end) : _file(f), _pos(begin), _end(end)
+    {
+    }
+
+    std::string name;
+    std::string key;
+    bool is_dir = false;
+
+    /** Load the next record, false once the run is exhausted */
+    bool next()
+    {
+        uint8_t head[3];
+        if (!read(head, sizeof(head))) {
+            return false;
+        }
+        is_dir = head[0] != 0;
+        name.resize(head[1] | (head[2] << 8));
+        if (!read(name.data(), name.size())) {
+            return false;
+        }
+        key.clear();
+        fold_into(name, key);
+        return true;
+    }
+
+private:
+    std::FILE* _file;
+    long _pos;
+    long _end;
+    std::unique_ptr<uint8_t[]> _buffer;
+    size_t _head = 0;
+    size_t _fill = 0;
+
+    bool read(void* dst, size_t bytes)
+    {
+        auto* out = static_cast<uint8_t*>(dst);
+        while (bytes > 0) {
+            if (_head == _fill) {
+                const size_t chunk = std::min<long>(kRunBufferBytes, _end - _pos);
+                if (chunk == 0) {
+                    return false;
+                }
+                if (!_buffer) {
+                    _buffer.reset(new (std::nothrow) uint8_t[kRunBufferBytes]);
+                }
+                if (!_buffer || std::fseek(_file, _pos, SEEK_SET) != 0 ||
+                    std::fread(_buffer.get(), 1, chunk, _file) != chunk) {
+                    return false;
+                }
+                _pos += static_cast<long>(chunk);
+                _head = 0;
+                _fill = chunk;
+            }
+            const size_t n = std::min(bytes, _fill - _head);
+            std::memcpy(out, _buffer.get() + _head, n);
+            _head += n;
+            out += n;
+            bytes -= n;
+        }
+        return true;
+    }
+};
+
+/**
+ * Streams the merged names out behind the offset table. The table is written a chunk at a time since it isn't
+ * known until every name is out
+ */
+class SidecarWriter {
+public:
+    bool open(const std::string& path, uint32_t count)
+    {
+        _file        = std::fopen(path.c_str(), "w+b");
+        _count       = count;
+        _names_base  = static_cast<long>(sizeof(Header_t) + (count + 1) * sizeof(uint32_t));
+        _names_bytes = 0;
+        _written     = 0;
+        _chunk.clear();
+        return _file && std::fseek(_file, _names_base, SEEK_SET) == 0;
+    }
+
+    bool add(std::string_view name)
+    {
+        _chunk.push_back(_names_bytes);
+        _names_bytes += static_cast<uint32_t>(name.size());
+        if (std::fwrite(name.data(), 1, name.size(), _file) != name.size()) {
+            return false;
+        }
+        return _chunk.size() < kOffsetChunk || flush_offsets();
+    }
+
+    bool finish(Header_t header)
+    {
+        _chunk.push_back(_names_bytes);
+        if (!flush_offsets() || _written != _count + 1) {
+            return false;
+        }
+        header.names_bytes = _names_bytes;
+        const bool ok = std::fseek(_file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, _file) == 1 &&
+                        std::fflush(_file) == 0;
+        fsync(fileno(_file));
+        return ok;
+    }
+
+    void close()
+    {
+        if (_file) {
+            std::fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+private:
+    std::FILE* _file      = nullptr;
+    uint32_t _count       = 0;
+    long _names_base      = 0;
+    uint32_t _names_bytes = 0;
+    uint32_t _written     = 0;
+    std::vector<uint32_t> _chunk;
+
+    bool flush_offsets()
+    {
+        const long at = static_cast<long>(sizeof(Header_t) + _written * sizeof(uint32_t));
+        if (std::fseek(_file, at, SEEK_SET) != 0 ||
+            std::fwrite(_chunk.data(), sizeof(uint32_t), _chunk.size(), _file) != _chunk.size()) {
+            return false;
+        }
+        _written += static_cast<uint32_t>(_chunk.size());
+        _chunk.clear();
+        return std::fseek(_file, _names_base + _names_bytes, SEEK_SET) == 0;
+    }
+};
+
+bool read_header(std::FILE* f, uint64_t dir_hash, Header_t& header)
+{
+    return std::fseek(f, 0, SEEK_SET) == 0 && std::fread(&header, sizeof(header), 1, f) == 1 &&
+           header.magic == kFileMagic && header.version == kFileVersion && header.dir_hash == dir_hash;
+}
+
+void make_dirs(const std::string& path)
+{
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    }
+    mkdir(path.c_str(), 0755);
+}
+
+enum class Outcome : uint8_t {
+    Resident = 0,
+    Valid,
+    Built,
+    Failed,
+    Cancelled,
+};
+
+/**
+ * Worker side of one listing. A first readdir() pass only keeps the first page and the signature: if the folder fits
+ * in a page it is done, if the signature matches the sidecar nothing needs writing. Otherwise a second pass sorts pages
+ * into runs and merges them into a fresh sidecar at sidecar_path + ".tmp"
+ */
+class Builder {
+public:
+    template <typename ProgressFn, typename CancelFn>
+    Outcome run(const std::string& dir, const std::string& cache_dir, const std::string& sidecar_path,
+                DirListing::FileFilter filter, ProgressFn&& progress, CancelFn&& cancelled)
+    {
+        DIR* d = opendir(dir.c_str());
+        if (!d) {
+            mclog::tagWarn(_tag, "open {} failed", dir);
+            return Outcome::Failed;
+        }
+        // Local so its buffers are gone once the worker goes idle
+        Page page;
+        Signature_t sig;
+        bool fits     = true;
+        uint32_t seen = 0;
+        while (dirent* ent = readdir(d)) {
+            if (++seen % kCancelCheckInterval == 0) {
+                if (cancelled()) {
+                    closedir(d);
+                    return Outcome::Cancelled;
+                }
+                if (seen % DirListing::kPageEntries == 0) {
+                    progress(static_cast<int>(sig.count));
+                }
+            }
+            const int kind = classify(dir, ent, filter);
+            if (kind < 0) {
+                continue;
+            }
+            sig.add(ent->d_name, kind == 1);
+            if (fits && !page.add(ent->d_name, kind == 1)) {
+                fits = false;
+                page.clear();
+            }
+        }
+        closedir(d);
+
+        count     = static_cast<int>(sig.count);
+        dir_count = static_cast<int>(sig.dir_count);
+        if (fits) {
+            page.sort();
+            names.clear();
+            offsets.clear();
+            page.forEach([this](std::string_view name, bool) {
+                offsets.push_back(static_cast<uint32_t>(names.size()));
+                names.append(name);
+            });
+            offsets.push_back(static_cast<uint32_t>(names.size()));
+            return Outcome::Resident;
+        }
+
+        const uint64_t dir_hash = fs_utils::hash_name(dir);
+        if (std::FILE* f = std::fopen(sidecar_path.c_str(), "rb")) {
+            Header_t header{};
+            const bool valid = read_header(f, dir_hash, header) && header.count == sig.count &&
+                               header.dir_count == sig.dir_count && header.signature == sig.sum;
+            std::fclose(f);
+            if (valid) {
+                return Outcome::Valid;
+            }
+        }
+
+        make_dirs(cache_dir);
+        const std::string runs_path = cache_dir + "/runs.tmp";
+        std::FILE* runs             = std::fopen(runs_path.c_str(), "w+b");
+        if (!runs) {
+            mclog::tagError(_tag, "open {} failed", runs_path);
+            return Outcome::Failed;
+        }
+        page.clear();
+        const Outcome outcome = build(dir, sidecar_path + ".tmp", dir_hash, filter, page, runs, cancelled);
+        std::fclose(runs);
+        std::remove(runs_path.c_str());
+        if (outcome != Outcome::Built) {
+            std::remove((sidecar_path + ".tmp").c_str());
+        }
+        return outcome;
+    }
+
+    // Resident result
+    std::string names;
+    std::vector<uint32_t> offsets;
+    int count     = 0;
+    int dir_count = 0;
+
+private:
+    template <typename CancelFn>
+    Outcome build(const std::string& dir, const std::string& tmp_path, uint64_t dir_hash,
+                  DirListing::FileFilter filter, Page& page, std::FILE* runs, CancelFn& cancelled)
+    {
+        DIR* d = opendir(dir.c_str());
+        if (!d) {
+            return Outcome::Failed;
+        }
+
+        // Sorted pages go to the run file back to back
+        Signature_t sig;
+        std::vector<std::pair<long, long>> bounds;
+        bool ok          = true;
+        const auto spill = [&]() {
+            const long begin = std::ftell(runs);
+            page.sort();
+            page.forEach([&](std::string_view name, bool is_dir) { ok = ok && write_record(runs, name, is_dir); });
+            page.clear();
+            bounds.emplace_back(begin, std::ftell(runs));
+        };
+        uint32_t seen = 0;
+        while (dirent* ent = readdir(d)) {
+            if (++seen % kCancelCheckInterval == 0 && cancelled()) {
+                closedir(d);
+                return Outcome::Cancelled;
+            }
+            const int kind = classify(dir, ent, filter);
+            if (kind < 0) {
+                continue;
+            }
+            sig.add(ent->d_name, kind == 1);
+            if (!page.add(ent->d_name, kind == 1)) {
+                spill();
+                page.add(ent->d_name, kind == 1);
+            }
+        }
+        closedir(d);
+        if (!page.empty()) {
+            spill();
+        }
+        if (!ok || std::fflush(runs) != 0) {
+            mclog::tagError(_tag, "write runs of {} failed", dir);
+            return Outcome::Failed;
+        }
+
+        // k-way merge of the runs, each run head carries its folded key
+        std::vector<RunReader> readers;
+        std::vector<int> heap;
+        readers.reserve(bounds.size());
+        for (const auto& [begin, end] : bounds) {
+            readers.emplace_back(runs, begin, end);
+            if (readers.back().next()) {
+                heap.push_back(static_cast<int>(readers.size() - 1));
+            }
+        }
+        const auto greater = [&readers](int a, int b) {
+            const auto& ra = readers[a];
+            const auto& rb = readers[b];
+            return entry_less(rb.is_dir, rb.key, rb.name, ra.is_dir, ra.key, ra.name);
+        };
+        std::make_heap(heap.begin(), heap.end(), greater);
+
+        SidecarWriter writer;
+        ok             = writer.open(tmp_path, sig.count);
+        uint32_t moved = 0;
+        while (ok && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            auto& head = readers[heap.back()];
+            ok         = writer.add(head.name);
+            if (head.next()) {
+                std::push_heap(heap.begin(), heap.end(), greater);
+            } else {
+                heap.pop_back();
+            }
+            if (++moved % kCancelCheckInterval == 0 && cancelled()) {
+                writer.close();
+                return Outcome::Cancelled;
+            }
+        }
+
+        Header_t header{};
+        header.magic     = kFileMagic;
+        header.version   = kFileVersion;
+        header.count     = sig.count;
+        header.dir_count = sig.dir_count;
+        header.signature = sig.sum;
+        header.dir_hash  = dir_hash;
+        ok               = ok && moved == sig.count && writer.finish(header);
+        writer.close();
+        if (!ok) {
+            mclog::tagError(_tag, "write {} failed", tmp_path);
+            return Outcome::Failed;
+        }
+        count     = static_cast<int>(sig.count);
+        dir_count = static_cast<int>(sig.dir_count);
+        mclog::tagInfo(_tag, "{}: {} entries sorted in {} runs", dir, count, bounds.size());
+        return Outcome::Built;
+    }
+};
+
+}  // namespace
+
+/* -------------------------------------------------------------------------- */
+/*                                   UI side                                  */
+/* -------------------------------------------------------------------------- */
+bool DirListing::start()
+{
+    if (_task) {
+        return true;
+    }
+    _cmd_queue    = xQueueCreate(4, sizeof(Command_t));
+    _result_queue = xQueueCreate(8, sizeof(Result_t));
+    if (!_cmd_queue || !_result_queue) {
+        mclog::tagError(_tag, "create queues failed");
+        return false;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(task_main, "dirlist", 8192, this, 2, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(_tag, "create task failed");
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void DirListing::drop_results()
+{
+    Result_t r;
+    while (_result_queue && xQueueReceive(_result_queue, &r, 0) == pdTRUE) {
+        delete r.window;
+    }
+}
+
+void DirListing::open(const std::string& dir, const std::string& cache_root, FileFilter filter)
+{
+    close();
+    if (!start()) {
+        return;
+    }
+
+    char name[24];
+    std::snprintf(name, sizeof(name), "/%016llx.idx", static_cast<unsigned long long>(fs_utils::hash_name(dir)));
+    const std::string cache_dir = cache_root + kCacheDir;
+    _dir                        = dir;
+    _sidecar_path               = cache_dir + name;
+    _loading                    = !open_sidecar();
+    _scanned                    = 0;
+    _version++;
+
+    // Even with a sidecar up, the worker still checks it against the folder
+    Command_t cmd;
+    cmd.generation = _generation;
+    cmd.request    = new Request_t{dir, cache_dir, _sidecar_path, filter};
+    if (xQueueSend(_cmd_queue, &cmd, pdMS_TO_TICKS(50)) != pdTRUE) {
+        mclog::tagWarn(_tag, "command queue full");
+        delete cmd.request;
+        _loading = false;
+    }
+}
+
+void DirListing::close()
+{
+    _generation++;
+    drop_results();
+    close_sidecar();
+    _names.clear();
+    _offsets.clear();
+    _window_first   = 0;
+    _size           = 0;
+    _dir_count      = 0;
+    _loading        = false;
+    _window_arrived = false;
+    _dir.clear();
+    _version++;
+
+    // An empty command makes the worker give up on whatever it is building
+    if (_task) {
+        Command_t cmd;
+        cmd.generation = _generation;
+        xQueueSend(_cmd_queue, &cmd, 0);
+    }
+}
+
+bool DirListing::poll(uint32_t wait_ms)
+{
+    if (!_result_queue) {
+        return false;
+    }
+    const TickType_t start = xTaskGetTickCount();
+    const TickType_t wait  = pdMS_TO_TICKS(wait_ms);
+    bool changed           = _window_arrived;
+    _window_arrived        = false;
+    while (true) {
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        const TickType_t ticks   = _loading && elapsed < wait ? wait - elapsed : 0;
+        Result_t r;
+        if (xQueueReceive(_result_queue, &r, ticks) != pdTRUE) {
+            break;
+        }
+        if (r.generation != _generation) {
+            delete r.window;
+            continue;
+        }
+        changed = apply(r) || changed;
+    }
+    return changed;
+}
+
+bool DirListing::apply(const Result_t& r)
+{
+    switch (r.type) {
+        case ResultType::Progress:
+            // Only worth a redraw while there's nothing else to show
+            _scanned = r.count;
+            return _loading;
+        case ResultType::Resident:
+            // Small enough to hold whole, a sidecar left from when it was larger is no use anymore
+            if (_file) {
+                close_sidecar();
+            }
+            std::remove(_sidecar_path.c_str());
+            _names        = std::move(r.window->names);
+            _offsets      = std::move(r.window->offsets);
+            _window_first = 0;
+            _size         = r.count;
+            _dir_count    = r.window->dir_count;
+            delete r.window;
+            break;
+        case ResultType::SidecarValid:
+            if (_file) {
+                _loading = false;
+                return false;
+            }
+            if (open_sidecar()) {
+                break;
+            }
+            _size      = 0;
+            _dir_count = 0;
+            break;
+        case ResultType::SidecarBuilt: {
+            // Only the UI side touches the live sidecar, the worker wrote its replacement next to it
+            close_sidecar();
+            const std::string tmp_path = _sidecar_path + ".tmp";
+            std::remove(_sidecar_path.c_str());
+            if (std::rename(tmp_path.c_str(), _sidecar_path.c_str()) != 0 || !open_sidecar()) {
+                mclog::tagError(_tag, "install {} failed", _sidecar_path);
+                _size      = 0;
+                _dir_count = 0;
+            }
+            break;
+        }
+        case ResultType::Failed:
+            close_sidecar();
+            _names.clear();
+            _offsets.clear();
+            _size      = 0;
+            _dir_count = 0;
+            break;
+    }
+    _loading = false;
+    _version++;
+    return true;
+}
+
+bool DirListing::open_sidecar()
+{
+    close_sidecar();
+    _file = std::fopen(_sidecar_path.c_str(), "rb");
+    if (!_file) {
+        return false;
+    }
+    Header_t header{};
+    if (!read_header(_file, fs_utils::hash_name(_dir), header)) {
+        close_sidecar();
+        return false;
+    }
+    _size         = static_cast<int>(header.count);
+    _dir_count    = static_cast<int>(header.dir_count);
+    _names_offset = static_cast<uint32_t>(sizeof(Header_t) + (header.count + 1) * sizeof(uint32_t));
+    _names.clear();
+    _offsets.clear();
+    _window_first = 0;
+    request_window(0);
+    return true;
+}
+
+void DirListing::close_sidecar()
+{
+    cancel_window();
+    if (_file) {
+        std::fclose(_file);
+        _file = nullptr;
+        _names.clear();
+        _offsets.clear();
+    }
+}
+
+void DirListing::request_window(int first)
+{
+    cancel_window();
+    const int count = std::min(kWindowEntries, _size - first);
+    const auto done = [this, first, count](IoService::Result_t& read) {
+        _window_request = 0;
+        if (!read.ok || read.data.size() != (count + 1) * sizeof(uint32_t)) {
+            mclog::tagWarn(_tag, "read {} failed", _sidecar_path);
+            return;
+        }
+        std::vector<uint32_t> offsets(count + 1);
+        std::memcpy(offsets.data(), read.data.data(), read.data.size());
+        const uint32_t base = offsets.front();
+        const uint32_t end  = offsets.back();
+        if (end < base) {
+            mclog::tagWarn(_tag, "read {} failed", _sidecar_path);
+            return;
+        }
+        for (auto& offset : offsets) {
+            offset -= base;
+        }
+
+        // The names of the window follow from its offsets
+        _window_request = GetIoService().readRange(
+            _sidecar_path, _names_offset + base, end - base, IoService::Priority::Browse,
+            [this, first, offsets = std::move(offsets)](IoService::Result_t& names) mutable {
+                _window_request = 0;
+                if (!names.ok || names.data.size() != offsets.back()) {
+                    mclog::tagWarn(_tag, "read {} failed", _sidecar_path);
+                    return;
+                }
+                _names          = std::move(names.data);
+                _offsets        = std::move(offsets);
+                _window_first   = first;
+                _window_arrived = true;
+            });
+    };
+    _window_wanted  = first;
+    _window_request = GetIoService().readRange(_sidecar_path,
+                                               static_cast<uint32_t>(sizeof(Header_t) + first * sizeof(uint32_t)),
+                                               (count + 1) * sizeof(uint32_t), IoService::Priority::Browse, done);
+}
+
+void DirListing::cancel_window()
+{
+    if (_window_request) {
+        GetIoService().cancel(_window_request);
+        _window_request = 0;
+    }
+}
+
+void DirListing::ensureResident(int first, int count)
+{
+    if (!_file || _size == 0) {
+        return;
+    }
+    count = std::min(count, kWindowEntries);
+    first = std::clamp(first, 0, _size - 1);
+    count = std::min(count, _size - first);
+
+    // Read ahead once the range gets within a quarter window of an edge that isn't an end of the listing
+    const int last      = _window_first + windowSize();
+    const int margin    = kWindowEntries / 4;
+    const bool resident = first >= _window_first && first + count <= last;
+    const bool near_edge =
+        (_window_first > 0 && first < _window_first + margin) || (last < _size && first + count > last - margin);
+    if (resident && !near_edge) {
+        return;
+    }
+    // Centered on the range so small moves either way stay inside
+    const int centered = first + count / 2 - kWindowEntries / 2;
+    const int wanted   = std::clamp(centered, 0, std::max(0, _size - kWindowEntries));
+    if (resident && wanted == _window_first) {
+        return;
+    }
+    if (_window_request && first >= _window_wanted && first + count <= _window_wanted + kWindowEntries) {
+        // Already on its way
+        return;
+    }
+    request_window(wanted);
+}
+
+std::string_view DirListing::name(int index)
+{
+    if (index < 0 || index >= _size) {
+        return {};
+    }
+    ensureResident(index, 1);
+    if (!isResident(index)) {
+        return kPlaceholder;
+    }
+    const int i = index - _window_first;
+    return std::string_view(_names).substr(_offsets[i], _offsets[i + 1] - _offsets[i]);
+}
+
+std::string DirListing::path(int index)
+{
+    const std::string_view n = name(index);
+    if (n.empty() || !isResident(index)) {
+        return {};
+    }
+    if (!_dir.empty() && _dir.back() == '/') {
+        return _dir + std::string(n);
+    }
+    return _dir + "/" + std::string(n);
+}
+
+std::string_view DirListing::path(int index, char* buffer, size_t size)
+{
+    const std::string_view n = name(index);
+    if (n.empty() || !isResident(index)) {
+        return {};
+    }
+    const char* sep = !_dir.empty() && _dir.back() == '/' ? "" : "/";
+    const int len   = std::snprintf(buffer, size, "%s%s%.*s", _dir.c_str(), sep, static_cast<int>(n.size()), n.data());
+    if (len < 0 || static_cast<size_t>(len) >= size) {
+        return {};
+    }
+    return std::string_view(buffer, len);
+}
+
+bool DirListing::read_name(int index, std::string& out)
+{
+    const int i = index - _window_first;
+    if (i >= 0 && i < windowSize()) {
+        out.assign(_names, _offsets[i], _offsets[i + 1] - _offsets[i]);
+        return true;
+    }
+    if (!_file) {
+        return false;
+    }
+
+    // Outside the window, probe the sidecar directly rather than moving the window around
+    uint32_t span[2];
+    if (std::fseek(_file, static_cast<long>(sizeof(Header_t) + index * sizeof(uint32_t)), SEEK_SET) != 0 ||
+        std::fread(span, sizeof(uint32_t), 2, _file) != 2 || span[1] < span[0]) {
+        return false;
+    }
+    out.resize(span[1] - span[0]);
+    return std::fseek(_file, static_cast<long>(_names_offset + span[0]), SEEK_SET) == 0 &&
+           std::fread(out.data(), 1, out.size(), _file) == out.size();
+}
+
+int DirListing::find(std::string_view name)
+{
+    const std::string key = folded(name);
+    std::string probe;
+    for (const bool is_dir : {true, false}) {
+        // Binary search within the folders or within the files
+        int lo = is_dir ? 0 : _dir_count;
+        int hi = is_dir ? _dir_count : _size;
+        while (lo < hi) {
+            const int mid = lo + (hi - lo) / 2;
+            if (!read_name(mid, probe)) {
+                return -1;
+            }
+            if (entry_less(is_dir, folded(probe), probe, is_dir, key, name)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < (is_dir ? _dir_count : _size) && read_name(lo, probe) && probe == name) {
+            return lo;
+        }
+    }
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Worker task                                */
+/* -------------------------------------------------------------------------- */
+void DirListing::task_main(void* arg)
+{
+    auto* self = static_cast<DirListing*>(arg);
+    Builder builder;
+
+    while (true) {
+        Command_t cmd;
+        if (xQueueReceive(self->_cmd_queue, &cmd, portMAX_DELAY) != pdTRUE || !cmd.request) {
+            continue;
+        }
+        std::unique_ptr<Request_t> request(cmd.request);
+
+        const auto post = [&](ResultType type, int count, Window_t* window, TickType_t wait) {
+            Result_t r;
+            r.type       = type;
+            r.generation = cmd.generation;
+            r.count      = count;
+            r.window     = window;
+            if (xQueueSend(self->_result_queue, &r, wait) != pdTRUE) {
+                delete window;
+            }
+        };
+        // Progress is only for show, never wait on the UI for it
+        const auto progress  = [&](int count) { post(ResultType::Progress, count, nullptr, 0); };
+        const auto cancelled = [&]() { return uxQueueMessagesWaiting(self->_cmd_queue) > 0; };
+
+        const Outcome outcome = builder.run(request->dir, request->cache_dir, request->sidecar_path, request->filter,
+                                            progress, cancelled);
+        switch (outcome) {
+            case Outcome::Resident: {
+                auto* window = new (std::nothrow) Window_t;
+                if (!window) {
+                    post(ResultType::Failed, 0, nullptr, pdMS_TO_TICKS(100));
+                    break;
+                }
+                window->names     = std::move(builder.names);
+                window->offsets   = std::move(builder.offsets);
+                window->dir_count = builder.dir_count;
+                post(ResultType::Resident, builder.count, window, pdMS_TO_TICKS(100));
+                break;
+            }
+            case Outcome::Valid:
+                post(ResultType::SidecarValid, builder.count, nullptr, pdMS_TO_TICKS(100));
+                break;
+            case Outcome::Built:
+                post(ResultType::SidecarBuilt, builder.count, nullptr, pdMS_TO_TICKS(100));
+                break;
+            case Outcome::Failed:
+                post(ResultType::Failed, 0, nullptr, pdMS_TO_TICKS(100));
+                break;
+            case Outcome::Cancelled:
+                break;
+        }
+    }
+}
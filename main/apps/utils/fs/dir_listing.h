@@ -0,0 +1,185 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Sorted listing of one folder that stays small in memory however many entries the folder has
+ *
+ * Entries are read with readdir() alone, d_type tells folders from files so nothing is stat()ed. Folders sort first,
+ * then names by a case-folded key that is computed once per entry. A folder of up to kPageEntries entries is kept in
+ * memory whole. Larger ones are sorted a page at a time into runs that are merged into a sidecar file in the cache
+ * folder, and only a window of entries around the ones being looked at is resident.
+ *
+ * Sidecar layout is [Header_t] [count + 1 name offsets] [names]. It is reused as long as the folder signature, entry
+ * counts plus a hash of every name, still matches. On open a sidecar is shown right away while a worker task checks it
+ * with one readdir() pass, and only rebuilt if the folder changed. Windows are read through the IoService worker, the
+ * UI side only ever sees a window once it has arrived.
+ */
+class DirListing {
+public:
+    static constexpr int kPageEntries      = 512;
+    static constexpr size_t kPageBytes     = 16 * 1024;
+    static constexpr int kWindowEntries    = 128;
+    static constexpr const char* kCacheDir = "/.cache/listings";
+
+    /** Name of an entry whose window is still being read */
+    static constexpr std::string_view kPlaceholder = "...";
+
+    /** Which files to list, folders are always listed and names starting with '.' never are */
+    using FileFilter = bool (*)(std::string_view name);
+
+    /**
+     * List dir, sidecars live under cache_root + kCacheDir. Use poll() to pick up the result, a valid sidecar is
+     * available right away
+     */
+    void open(const std::string& dir, const std::string& cache_root, FileFilter filter);
+
+    /** Drop the listing and any work queued for it */
+    void close();
+
+    /** Take results from the worker, waiting up to wait_ms for the listing to finish. True if a redraw is due */
+    bool poll(uint32_t wait_ms = 0);
+
+    /** The worker has posted something for poll(), or a window has arrived */
+    bool hasResults() const
+    {
+        return _window_arrived || (_result_queue && uxQueueMessagesWaiting(_result_queue) > 0);
+    }
+    /** Nothing to show yet */
+    bool isLoading() const
+    {
+        return _loading;
+    }
+    /** Entries read so far while loading */
+    int scannedCount() const
+    {
+        return _scanned;
+    }
+    /** Bumped every time the contents change */
+    uint32_t version() const
+    {
+        return _version;
+    }
+
+    const std::string& dir() const
+    {
+        return _dir;
+    }
+    int size() const
+    {
+        return _size;
+    }
+    int dirCount() const
+    {
+        return _dir_count;
+    }
+    bool isDir(int index) const
+    {
+        return index >= 0 && index < _dir_count;
+    }
+
+    /**
+     * Name of entry index, kPlaceholder until the window around it has arrived. Valid until the next IoService
+     * dispatch(), which may move the window
+     */
+    std::string_view name(int index);
+    /** Empty until the window around index has arrived */
+    std::string path(int index);
+    /** Same as path() into buffer, for the draw path. Empty if it doesn't fit */
+    std::string_view path(int index, char* buffer, size_t size);
+
+    /**
+     * Have [first, first + count) resident, count is capped to kWindowEntries. A missing window is requested from the
+     * IoService, and once the range nears an edge of the window the next one is read ahead
+     */
+    void ensureResident(int first, int count);
+    bool isResident(int index) const
+    {
+        const int i = index - _window_first;
+        return i >= 0 && i < windowSize();
+    }
+    int windowFirst() const
+    {
+        return _window_first;
+    }
+    int windowSize() const
+    {
+        return static_cast<int>(_offsets.empty() ? 0 : _offsets.size() - 1);
+    }
+
+    /** Index of the entry called name, -1 if there is none */
+    int find(std::string_view name);
+
+private:
+    enum class ResultType : uint8_t {
+        Progress = 0,
+        Resident,
+        SidecarValid,
+        SidecarBuilt,
+        Failed,
+    };
+
+    struct Request_t;
+    struct Window_t;
+
+    struct Command_t {
+        uint32_t generation = 0;
+        Request_t* request  = nullptr;
+    };
+
+    struct Result_t {
+        ResultType type     = ResultType::Progress;
+        uint32_t generation = 0;
+        int count           = 0;
+        Window_t* window    = nullptr;
+    };
+
+    QueueHandle_t _cmd_queue    = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    TaskHandle_t _task          = nullptr;
+
+    uint32_t _generation = 0;
+    uint32_t _version    = 0;
+    std::string _dir;
+    std::string _sidecar_path;
+    bool _loading  = false;
+    int _scanned   = 0;
+    int _size      = 0;
+    int _dir_count = 0;
+
+    // Resident window, names of entries [_window_first, _window_first + windowSize()) back to back
+    int _window_first = 0;
+    std::string _names;
+    std::vector<uint32_t> _offsets;
+
+    // Window being read by the IoService, offsets first and then names
+    uint32_t _window_request = 0;
+    int _window_wanted       = 0;
+    bool _window_arrived     = false;
+
+    std::FILE* _file       = nullptr;
+    uint32_t _names_offset = 0;
+
+    bool start();
+    void drop_results();
+    bool apply(const Result_t& r);
+    bool open_sidecar();
+    void close_sidecar();
+    void request_window(int first);
+    void cancel_window();
+    bool read_name(int index, std::string& out);
+
+    static void task_main(void* arg);
+};
@@ -0,0 +1,53 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <dirent.h>
+#include <sys/stat.h>
+#include <hal/utils/profiler/percentile.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Small helpers shared by the SD card listings, caches and their stats
+namespace fs_utils {
+
+/** 1 for a folder, 0 for a regular file, -1 to leave the entry out. Names starting with '.' are always left out */
+inline int classify(const std::string& dir, const dirent* ent)
+{
+    if (ent->d_name[0] == '.') {
+        return -1;
+    }
+    unsigned type = ent->d_type;
+    if (type == DT_UNKNOWN) {
+        // Not every file system fills in d_type
+        const std::string path = dir + "/" + ent->d_name;
+        struct stat s {};
+        if (stat(path.c_str(), &s) != 0) {
+            return -1;
+        }
+        type = S_ISDIR(s.st_mode) ? DT_DIR : (S_ISREG(s.st_mode) ? DT_REG : DT_UNKNOWN);
+    }
+    if (type == DT_DIR) {
+        return 1;
+    }
+    return type == DT_REG ? 0 : -1;
+}
+
+/** FNV-1a of name, stored in cache files so it must never change */
+inline uint64_t hash_name(std::string_view name)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Same one the frame profiler uses, so SD and frame percentiles are read the same way
+using profiler::percentile;
+
+}  // namespace fs_utils
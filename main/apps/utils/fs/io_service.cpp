@@ -0,0 +1,564 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "io_service.h"
+#include "fs_utils.h"
+#include <mooncake_log.h>
+#include <esp_timer.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <new>
+
+static const std::string _tag = "IoService";
+
+static const char* _op_names[]       = {"list", "read", "read_range", "write", "append", "rename", "new_name"};
+static const char* _priority_names[] = {"audio", "normal", "browse"};
+
+struct IoService::Request_t {
+    uint32_t id       = 0;
+    Op op             = Op::ListDir;
+    Priority priority = Priority::Normal;
+    std::string path;
+    std::string to;
+    uint32_t offset     = 0;
+    size_t size         = 0;  // ReadFile: most bytes allowed, ReadRange: bytes wanted
+    Filter filter       = nullptr;
+    const char* pattern = nullptr;  // NewFileName
+    std::string data;               // WriteFile and AppendFile
+    std::atomic<bool> cancelled{false};
+    Result_t result;
+
+    // UI side only, the worker never touches it
+    Callback done;
+
+    // Worker side, between chunks
+    std::FILE* file     = nullptr;
+    DIR* dir            = nullptr;
+    size_t pos          = 0;
+    int64_t posted_us   = 0;
+    int64_t started_us  = 0;
+    int64_t finished_us = 0;
+};
+
+static size_t index_of(IoService::Priority priority)
+{
+    return static_cast<size_t>(priority);
+}
+
+static std::string temp_path_of(const std::string& path)
+{
+    return path + ".tmp";
+}
+
+/** 1 for a folder, 0 for a file, -1 to leave the entry out */
+static int classify(const std::string& dir, const dirent* ent, IoService::Filter filter)
+{
+    const int kind = fs_utils::classify(dir, ent);
+    if (kind < 0 || (filter && !filter(ent->d_name, kind == 1))) {
+        return -1;
+    }
+    return kind;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   UI side                                  */
+/* -------------------------------------------------------------------------- */
+IoService& GetIoService()
+{
+    static IoService service;
+    return service;
+}
+
+uint32_t IoService::listDir(const std::string& path, Priority priority, Callback done, Filter filter)
+{
+    auto* r = new (std::nothrow) Request_t;
+    if (!r) {
+        return 0;
+    }
+    r->op       = Op::ListDir;
+    r->priority = priority;
+    r->path     = path;
+    r->filter   = filter;
+    return submit(r, std::move(done));
+}
+
+uint32_t IoService::readFile(const std::string& path, Priority priority, Callback done, size_t max_bytes)
+{
+    auto* r = new (std::nothrow) Request_t;
+    if (!r) {
+        return 0;
+    }
+    r->op       = Op::ReadFile;
+    r->priority = priority;
+    r->path     = path;
+    r->size     = max_bytes;
+    return submit(r, std::move(done));
+}
+
+uint32_t IoService::readRange(const std::string& path, uint32_t offset, size_t size, Priority priority, Callback done)
+{
+    auto* r = new (std::nothrow) Request_t;
+    if (!r) {
+        return 0;
+    }
+    r->op       = Op::ReadRange;
+    r->priority = priority;
+    r->path     = path;
+    r->offset   = offset;
+    r->size     = size;
+    return submit(r, std::move(done));
+}
+
+uint32_t IoService::writeFile(const std::string& path, std::string data, Priority priority, Callback done)
+{
+    auto* r = new (std::nothrow) Request_t;
+    if (!r) {
+        return 0;
+    }
+    r->op       = Op::WriteFile;
+    r->priority = priority;
+    r->path     = path;
+    r->data     = std::move(data);
+    return submit(r, std::move(done));
+}
+
+uint32_t IoService::appendFile(const std::string& path, std::string data, Priority priority, Callback done)
+{
+    auto* r = new (std::nothrow) Request_t;
+    if (!r) {
+        return 0;
+    }
+    r->op       = Op::AppendFile;
+    r->priority = priority;
+    r->path     = path;
+    r->data     = std::move(data);
+    return submit(r, std::move(done));
+}
+
+uint32_t IoService::rename(const std::string& from, const std::string& to, Priority priority, Callback done)
+{
+    auto* r = new (std::nothrow) Request_t;
+    if (!r) {
+        return 0;
+    }
+    r->op       = Op::Rename;
+    r->priority = priority;
+    r->path     = from;
+    r->to       = to;
+    return submit(r, std::move(done));
+}
+
+uint32_t IoService::newFileName(const std::string& dir, const char* pattern, Priority priority, Callback done)
+{
+    auto* r = new (std::nothrow) Request_t;
+    if (!r) {
+        return 0;
+    }
+    r->op       = Op::NewFileName;
+    r->priority = priority;
+    r->path     = dir;
+    r->pattern  = pattern;
+    return submit(r, std::move(done));
+}
+
+bool IoService::start()
+{
+    if (_task) {
+        return true;
+    }
+    // Both queues hold every request that can be in flight, so neither side ever waits on a full queue
+    const UBaseType_t depth = kMaxInFlight * static_cast<UBaseType_t>(Priority::Count);
+    _cmd_queue              = xQueueCreate(depth, sizeof(Request_t*));
+    _result_queue           = xQueueCreate(depth, sizeof(Request_t*));
+    if (!_cmd_queue || !_result_queue) {
+        mclog::tagError(_tag, "create queues failed");
+        return false;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(task_main, "io", 8192, this, 2, &_task, 1);
+    if (ok != pdPASS) {
+        mclog::tagError(_tag, "create task failed");
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+uint32_t IoService::submit(Request_t* r, Callback done)
+{
+    std::unique_ptr<Request_t> owned(r);
+    auto& s = _stats[index_of(r->priority)];
+    if (s.depth >= kMaxInFlight || !start()) {
+        s.rejected++;
+        mclog::tagWarn(_tag, "{} {} rejected, {} in flight", _op_names[static_cast<size_t>(r->op)], r->path, s.depth);
+        return 0;
+    }
+
+    if (++_next_id == 0) {
+        _next_id = 1;
+    }
+    r->id          = _next_id;
+    r->done        = std::move(done);
+    r->result.op   = r->op;
+    r->result.path = r->path;
+    r->posted_us   = esp_timer_get_time();
+    if (xQueueSend(_cmd_queue, &r, 0) != pdTRUE) {
+        s.rejected++;
+        return 0;
+    }
+    owned.release();
+
+    _in_flight.push_back(r);
+    s.depth++;
+    s.max_depth = std::max(s.max_depth, s.depth);
+    return r->id;
+}
+
+void IoService::cancel(uint32_t id)
+{
+    for (auto* r : _in_flight) {
+        if (r->id == id) {
+            r->cancelled = r->op != Op::WriteFile && r->op != Op::AppendFile && r->op != Op::Rename;
+            r->done      = nullptr;
+            return;
+        }
+    }
+}
+
+bool IoService::isPending(uint32_t id) const
+{
+    return id != 0 &&
+           std::any_of(_in_flight.begin(), _in_flight.end(), [id](const Request_t* r) { return r->id == id; });
+}
+
+void IoService::dispatch()
+{
+    if (!_result_queue) {
+        return;
+    }
+    Request_t* raw = nullptr;
+    while (xQueueReceive(_result_queue, &raw, 0) == pdTRUE) {
+        std::unique_ptr<Request_t> r(raw);
+        _in_flight.erase(std::remove(_in_flight.begin(), _in_flight.end(), raw), _in_flight.end());
+        record(*r);
+
+        // The callback may post the next request, take it out first
+        Callback done = std::move(r->done);
+        if (done && !r->cancelled) {
+            done(r->result);
+        }
+    }
+}
+
+void IoService::record(const Request_t& r)
+{
+    const size_t p = index_of(r.priority);
+    auto& s        = _stats[p];
+    s.depth--;
+    if (r.cancelled) {
+        s.cancelled++;
+    } else if (r.result.ok) {
+        s.completed++;
+    } else {
+        s.failed++;
+    }
+
+    // A request cancelled before it was picked up has no start time
+    const int64_t started  = r.started_us ? r.started_us : r.finished_us;
+    const uint32_t wait_us = static_cast<uint32_t>(started - r.posted_us);
+    const uint32_t service = static_cast<uint32_t>(r.finished_us - started);
+    auto& l                = _latency[p];
+    l.wait_us[l.head]      = wait_us;
+    l.service_us[l.head]   = service;
+    l.head                 = (l.head + 1) % kLatencySamples;
+    l.count                = std::min(l.count + 1, kLatencySamples);
+    s.service_max          = std::max(s.service_max, service);
+
+    if (wait_us + service >= kSlowUs) {
+        mclog::tagWarn(_tag, "slow {} {} ({}): wait {} ms, service {} ms", _op_names[static_cast<size_t>(r.op)],
+                       r.path, _priority_names[p], wait_us / 1000, service / 1000);
+    }
+}
+
+IoService::Stats_t IoService::stats(Priority priority) const
+{
+    const size_t p = index_of(priority);
+    Stats_t s      = _stats[p];
+    const auto& l  = _latency[p];
+    uint32_t values[kLatencySamples];
+    std::copy(l.wait_us, l.wait_us + l.count, values);
+    s.wait_p50 = fs_utils::percentile(values, l.count, 50);
+    s.wait_p99 = fs_utils::percentile(values, l.count, 99);
+    std::copy(l.service_us, l.service_us + l.count, values);
+    s.service_p50 = fs_utils::percentile(values, l.count, 50);
+    s.service_p99 = fs_utils::percentile(values, l.count, 99);
+    return s;
+}
+
+void IoService::dumpStats() const
+{
+    std::printf("priority,completed,failed,cancelled,rejected,depth,max_depth,wait_p50_us,wait_p99_us,"
+                "service_p50_us,service_p99_us,service_max_us\r\n");
+    for (size_t p = 0; p < static_cast<size_t>(Priority::Count); ++p) {
+        const Stats_t s = stats(static_cast<Priority>(p));
+        std::printf("%s,%u,%u,%u,%u,%d,%d,%u,%u,%u,%u,%u\r\n", _priority_names[p], static_cast<unsigned>(s.completed),
+                    static_cast<unsigned>(s.failed), static_cast<unsigned>(s.cancelled),
+                    static_cast<unsigned>(s.rejected), s.depth, s.max_depth, static_cast<unsigned>(s.wait_p50),
+                    static_cast<unsigned>(s.wait_p99), static_cast<unsigned>(s.service_p50),
+                    static_cast<unsigned>(s.service_p99), static_cast<unsigned>(s.service_max));
+    }
+    std::fflush(stdout);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Worker task                                */
+/* -------------------------------------------------------------------------- */
+static bool fail(IoService::Result_t& result, int error)
+{
+    result.ok    = false;
+    result.error = error;
+    return true;
+}
+
+void IoService::release(Request_t& r)
+{
+    if (r.dir) {
+        closedir(r.dir);
+        r.dir = nullptr;
+    }
+    if (r.file) {
+        std::fclose(r.file);
+        r.file = nullptr;
+        if (r.op == Op::WriteFile) {
+            // Never finished, the old file stays as it was
+            std::remove(temp_path_of(r.path).c_str());
+        }
+    }
+}
+
+bool IoService::step(Request_t& r)
+{
+    auto& result = r.result;
+    switch (r.op) {
+        case Op::ListDir: {
+            if (!r.dir) {
+                r.dir = opendir(r.path.c_str());
+                if (!r.dir) {
+                    return fail(result, errno);
+                }
+            }
+            for (int i = 0; i < kChunkEntries; ++i) {
+                const dirent* ent = readdir(r.dir);
+                if (!ent) {
+                    closedir(r.dir);
+                    r.dir     = nullptr;
+                    result.ok = true;
+                    return true;
+                }
+                const int kind = classify(r.path, ent, r.filter);
+                if (kind >= 0) {
+                    result.entries.push_back({ent->d_name, kind == 1});
+                }
+            }
+            return false;
+        }
+
+        case Op::ReadFile:
+        case Op::ReadRange: {
+            if (!r.file) {
+                r.file = std::fopen(r.path.c_str(), "rb");
+                if (!r.file) {
+                    return fail(result, errno);
+                }
+                size_t want = r.size;
+                if (r.op == Op::ReadFile) {
+                    if (std::fseek(r.file, 0, SEEK_END) != 0) {
+                        return fail(result, errno);
+                    }
+                    const long size = std::ftell(r.file);
+                    if (size < 0) {
+                        return fail(result, errno);
+                    }
+                    if (static_cast<size_t>(size) > r.size) {
+                        return fail(result, EFBIG);
+                    }
+                    want = static_cast<size_t>(size);
+                }
+                if (std::fseek(r.file, static_cast<long>(r.op == Op::ReadFile ? 0 : r.offset), SEEK_SET) != 0) {
+                    return fail(result, errno);
+                }
+                result.data.resize(want);
+            }
+
+            const size_t n   = std::min(kChunkBytes, result.data.size() - r.pos);
+            const size_t got = n ? std::fread(&result.data[r.pos], 1, n, r.file) : 0;
+            r.pos += got;
+            if (got == n && r.pos < result.data.size()) {
+                return false;
+            }
+            if (got < n && std::ferror(r.file)) {
+                return fail(result, EIO);
+            }
+            // Short at the end of the file
+            result.data.resize(r.pos);
+            std::fclose(r.file);
+            r.file    = nullptr;
+            result.ok = true;
+            return true;
+        }
+
+        case Op::WriteFile: {
+            const std::string temp = temp_path_of(r.path);
+            if (!r.file) {
+                r.file = std::fopen(temp.c_str(), "wb");
+                if (!r.file) {
+                    return fail(result, errno);
+                }
+            }
+
+            const size_t n = std::min(kChunkBytes, r.data.size() - r.pos);
+            if (n > 0) {
+                if (std::fwrite(r.data.data() + r.pos, 1, n, r.file) != n) {
+                    return fail(result, errno ? errno : EIO);
+                }
+                r.pos += n;
+                if (r.pos < r.data.size()) {
+                    return false;
+                }
+            }
+
+            const bool closed = std::fclose(r.file) == 0;
+            r.file            = nullptr;
+            if (!closed) {
+                const int error = errno;
+                std::remove(temp.c_str());
+                return fail(result, error);
+            }
+            // FAT won't rename over an existing file
+            std::remove(r.path.c_str());
+            if (std::rename(temp.c_str(), r.path.c_str()) != 0) {
+                const int error = errno;
+                std::remove(temp.c_str());
+                return fail(result, error);
+            }
+            result.ok = true;
+            return true;
+        }
+
+        case Op::AppendFile: {
+            if (!r.file) {
+                r.file = std::fopen(r.path.c_str(), "ab");
+                if (!r.file) {
+                    return fail(result, errno);
+                }
+            }
+
+            const size_t n = std::min(kChunkBytes, r.data.size() - r.pos);
+            if (n > 0) {
+                if (std::fwrite(r.data.data() + r.pos, 1, n, r.file) != n) {
+                    return fail(result, errno ? errno : EIO);
+                }
+                r.pos += n;
+                if (r.pos < r.data.size()) {
+                    return false;
+                }
+            }
+
+            const bool closed = std::fclose(r.file) == 0;
+            r.file            = nullptr;
+            if (!closed) {
+                return fail(result, errno);
+            }
+            result.ok = true;
+            return true;
+        }
+
+        case Op::Rename: {
+            if (std::rename(r.path.c_str(), r.to.c_str()) != 0) {
+                struct stat s {};
+                if (stat(r.path.c_str(), &s) != 0 || stat(r.to.c_str(), &s) != 0 || std::remove(r.to.c_str()) != 0 ||
+                    std::rename(r.path.c_str(), r.to.c_str()) != 0) {
+                    return fail(result, errno);
+                }
+            }
+            result.ok = true;
+            return true;
+        }
+
+        case Op::NewFileName: {
+            struct stat s {};
+            if (r.pos == 0 && stat(r.path.c_str(), &s) != 0 && mkdir(r.path.c_str(), 0755) != 0) {
+                return fail(result, errno);
+            }
+            // One stat() per number, a chunk of them at a time like the entries of a listing
+            char name[64];
+            for (int i = 0; i < kChunkEntries && r.pos < kMaxNumberedFiles; ++i, ++r.pos) {
+                std::snprintf(name, sizeof(name), r.pattern, static_cast<int>(r.pos));
+                result.path = r.path + "/" + name;
+                if (stat(result.path.c_str(), &s) != 0) {
+                    result.ok = true;
+                    return true;
+                }
+            }
+            if (r.pos < kMaxNumberedFiles) {
+                return false;
+            }
+            result.path = r.path;
+            return fail(result, ENOSPC);
+        }
+
+        default:
+            return fail(result, EINVAL);
+    }
+}
+
+void IoService::task_main(void* arg)
+{
+    auto* self = static_cast<IoService*>(arg);
+    std::deque<Request_t*> ready[static_cast<size_t>(Priority::Count)];
+    size_t active = 0;
+
+    while (true) {
+        // Take in everything posted so far, then work one chunk of the most urgent request
+        Request_t* r    = nullptr;
+        TickType_t wait = active ? 0 : portMAX_DELAY;
+        while (xQueueReceive(self->_cmd_queue, &r, wait) == pdTRUE) {
+            ready[index_of(r->priority)].push_back(r);
+            active++;
+            wait = 0;
+        }
+        if (active == 0) {
+            continue;
+        }
+
+        auto* queue = std::find_if(std::begin(ready), std::end(ready), [](const auto& q) { return !q.empty(); });
+        r           = queue->front();
+
+        bool finished = false;
+        if (r->cancelled) {
+            fail(r->result, ECANCELED);
+            finished = true;
+        } else {
+            if (!r->started_us) {
+                r->started_us = esp_timer_get_time();
+            }
+            finished = step(*r);
+        }
+        if (!finished) {
+            continue;
+        }
+
+        release(*r);
+        r->finished_us = esp_timer_get_time();
+        queue->pop_front();
+        active--;
+        xQueueSend(self->_result_queue, &r, portMAX_DELAY);
+    }
+}
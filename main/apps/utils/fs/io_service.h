@@ -0,0 +1,154 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Shared SD card I/O off the UI loop
+ *
+ * Apps post requests and get the result back through a callback, which dispatch() runs on the UI loop, so nothing on
+ * the UI side ever waits on the card. One worker task owns all requests. It works on them in chunks of kChunkBytes or
+ * kChunkEntries and picks the highest priority request before every chunk, so a large folder listing in the browser
+ * holds the bus for one chunk at most before an audio read gets its turn.
+ *
+ * Each request is timed from post to start of work (wait) and from start to finish (service). The last kLatencySamples
+ * of each priority are kept for percentiles next to the number of requests in flight.
+ */
+class IoService {
+public:
+    enum class Priority : uint8_t {
+        Audio = 0,
+        Normal,
+        Browse,
+        Count,
+    };
+
+    enum class Op : uint8_t {
+        ListDir = 0,
+        ReadFile,
+        ReadRange,
+        WriteFile,
+        AppendFile,
+        Rename,
+        NewFileName,
+        Count,
+    };
+
+    struct DirEntry_t {
+        std::string name;
+        bool is_dir = false;
+    };
+
+    struct Result_t {
+        Op op     = Op::ListDir;
+        bool ok   = false;
+        int error = 0;  // errno of the call that failed
+        std::string path;                 // NewFileName: the free name found
+        std::vector<DirEntry_t> entries;  // ListDir, in readdir() order
+        std::string data;                 // ReadFile and ReadRange
+    };
+
+    struct Stats_t {
+        uint32_t completed   = 0;
+        uint32_t failed      = 0;
+        uint32_t cancelled   = 0;
+        uint32_t rejected    = 0;
+        int depth            = 0;
+        int max_depth        = 0;
+        uint32_t wait_p50    = 0;
+        uint32_t wait_p99    = 0;
+        uint32_t service_p50 = 0;
+        uint32_t service_p99 = 0;
+        uint32_t service_max = 0;
+    };
+
+    using Callback = std::function<void(Result_t& result)>;
+
+    /** Which entries to list, names starting with '.' never are */
+    using Filter = bool (*)(std::string_view name, bool is_dir);
+
+    static constexpr size_t kChunkBytes     = 16 * 1024;
+    static constexpr int kChunkEntries      = 64;
+    static constexpr int kMaxInFlight       = 16;
+    static constexpr size_t kMaxReadBytes   = 256 * 1024;
+    static constexpr size_t kLatencySamples = 64;
+    static constexpr uint32_t kSlowUs       = 250 * 1000;
+    static constexpr int kMaxNumberedFiles  = 10000;
+
+    /**
+     * Each of these returns a request id, 0 if the request could not be queued because kMaxInFlight requests of that
+     * priority are outstanding. In that case the callback is never called.
+     */
+    uint32_t listDir(const std::string& path, Priority priority, Callback done, Filter filter = nullptr);
+    /** Whole file, fails with EFBIG if it is larger than max_bytes */
+    uint32_t readFile(const std::string& path, Priority priority, Callback done, size_t max_bytes = kMaxReadBytes);
+    /** size bytes from offset, fewer at the end of the file */
+    uint32_t readRange(const std::string& path, uint32_t offset, size_t size, Priority priority, Callback done);
+    /** Written to path + ".tmp" first and renamed over path, so a failed write leaves the old file alone */
+    uint32_t writeFile(const std::string& path, std::string data, Priority priority, Callback done);
+    /** Added to the end of path, which is created if it doesn't exist. For logs, a failed write can leave part of it */
+    uint32_t appendFile(const std::string& path, std::string data, Priority priority, Callback done);
+    /** Replaces to if it exists */
+    uint32_t rename(const std::string& from, const std::string& to, Priority priority, Callback done);
+    /**
+     * First name of dir + "/" + pattern, numbered from 0 to kMaxNumberedFiles - 1, that isn't taken, for a new
+     * recording or log. dir is created if it doesn't exist. pattern has one int conversion such as "rec_%04d.wav" and
+     * must outlive the request. Fails with ENOSPC if every number is taken. The file itself is not created
+     */
+    uint32_t newFileName(const std::string& dir, const char* pattern, Priority priority, Callback done);
+
+    /**
+     * Drop the callback of request id. Listings, reads and name searches stop at the next chunk, writes, appends and
+     * renames still finish so the file is never left half written
+     */
+    void cancel(uint32_t id);
+
+    /** Run the callbacks of finished requests, called once per UI loop iteration */
+    void dispatch();
+
+    bool isPending(uint32_t id) const;
+    Stats_t stats(Priority priority) const;
+
+    /** Print the stats of every priority over the serial console */
+    void dumpStats() const;
+
+private:
+    struct Request_t;
+
+    struct Latency_t {
+        uint32_t wait_us[kLatencySamples]    = {0};
+        uint32_t service_us[kLatencySamples] = {0};
+        size_t head                          = 0;
+        size_t count                         = 0;
+    };
+
+    QueueHandle_t _cmd_queue    = nullptr;
+    QueueHandle_t _result_queue = nullptr;
+    TaskHandle_t _task          = nullptr;
+
+    uint32_t _next_id = 0;
+    std::vector<Request_t*> _in_flight;
+    Stats_t _stats[static_cast<size_t>(Priority::Count)];
+    Latency_t _latency[static_cast<size_t>(Priority::Count)];
+
+    bool start();
+    uint32_t submit(Request_t* r, Callback done);
+    void record(const Request_t& r);
+
+    static bool step(Request_t& r);
+    static void release(Request_t& r);
+    static void task_main(void* arg);
+};
+
+IoService& GetIoService();
@@ -0,0 +1,189 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "sd_bench.h"
+#include "fs_utils.h"
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+namespace sdbench {
+
+static constexpr size_t kMinRandomOps = 64;
+static constexpr size_t kSpanOps      = 256;
+
+static const char* _pattern_names[] = {"seq_write", "seq_read", "rand_write", "rand_read"};
+
+const char* patternName(Pattern pattern)
+{
+    return pattern < Pattern::Count ? _pattern_names[static_cast<size_t>(pattern)] : "";
+}
+
+std::vector<Case_t> defaultCases(bool span_sweep)
+{
+    std::vector<Case_t> cases;
+    for (const size_t block : kBlockSizes) {
+        for (size_t p = 0; p < static_cast<size_t>(Pattern::Count); ++p) {
+            cases.push_back({static_cast<Pattern>(p), block, 0});
+        }
+    }
+    if (span_sweep) {
+        // The file has to be as large as the widest span, written with the largest block to keep it quick
+        cases.push_back({Pattern::SeqWrite, kMaxBlock, 0});
+        for (const size_t span : kSpanSizes) {
+            cases.push_back({Pattern::RandWrite, kSpanBlock, span});
+            cases.push_back({Pattern::RandRead, kSpanBlock, span});
+        }
+    }
+    return cases;
+}
+
+/** xorshift32, the same seed gives the same offsets on every run */
+static uint32_t next_random(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/** DMA capable so the SPI driver doesn't bounce every block through its own buffer */
+struct Buffer {
+    uint8_t* data = nullptr;
+
+    explicit Buffer(size_t size)
+    {
+        data = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_DMA | MALLOC_CAP_8BIT));
+    }
+    ~Buffer()
+    {
+        heap_caps_free(data);
+    }
+};
+
+bool run(const Config_t& config, Pattern pattern, Result_t& result, const std::atomic<bool>* stop)
+{
+    result             = Result_t{};
+    result.pattern     = pattern;
+    result.block_bytes = config.block_bytes;
+    result.span_bytes  = config.span_bytes;
+
+    const size_t block = config.block_bytes;
+    if (block == 0 || block > kMaxBlock || config.path.empty()) {
+        result.error = EINVAL;
+        return false;
+    }
+    Buffer buffer(block);
+    if (!buffer.data) {
+        result.error = ENOMEM;
+        return false;
+    }
+    uint32_t state = config.seed ? config.seed : 1;
+    for (size_t i = 0; i < block; ++i) {
+        buffer.data[i] = static_cast<uint8_t>(next_random(state));
+    }
+
+    const bool write      = pattern == Pattern::SeqWrite || pattern == Pattern::RandWrite;
+    const bool sequential = pattern == Pattern::SeqWrite || pattern == Pattern::SeqRead;
+    int flags             = write ? O_WRONLY : O_RDONLY;
+    if (pattern == Pattern::SeqWrite) {
+        flags |= O_CREAT | O_TRUNC;
+    }
+    const int fd = open(config.path.c_str(), flags, 0644);
+    if (fd < 0) {
+        result.error = errno;
+        return false;
+    }
+
+    // Sequential tests cover the file from the start, random ones stay inside what SeqWrite left
+    size_t extent = config.file_bytes;
+    if (pattern != Pattern::SeqWrite) {
+        struct stat s {};
+        if (fstat(fd, &s) != 0) {
+            result.error = errno;
+            close(fd);
+            return false;
+        }
+        extent = std::min(extent, static_cast<size_t>(s.st_size));
+    }
+    if (!sequential && config.span_bytes > 0) {
+        extent = std::min(extent, config.span_bytes);
+    }
+    const size_t slots = extent / block;
+    if (slots == 0) {
+        result.error = ENOSPC;
+        close(fd);
+        return false;
+    }
+    // One pass over the extent. A span sweep does the same number of operations at every span so they compare
+    size_t wanted = sequential ? slots : std::max(slots, kMinRandomOps);
+    if (!sequential && config.span_bytes > 0) {
+        wanted = kSpanOps;
+    }
+    const uint32_t ops  = static_cast<uint32_t>(std::min<size_t>(wanted, config.max_ops));
+
+    std::vector<uint32_t> latency;
+    latency.reserve(ops);
+    const int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < ops; ++i) {
+        if (stop && stop->load(std::memory_order_relaxed)) {
+            result.cancelled = true;
+            break;
+        }
+
+        const int64_t op_start = esp_timer_get_time();
+        if (!sequential) {
+            const off_t offset = static_cast<off_t>(next_random(state) % slots) * static_cast<off_t>(block);
+            if (lseek(fd, offset, SEEK_SET) < 0) {
+                result.error = errno;
+                break;
+            }
+        }
+        const ssize_t n = write ? ::write(fd, buffer.data, block) : ::read(fd, buffer.data, block);
+        if (n != static_cast<ssize_t>(block)) {
+            result.error = n < 0 ? errno : EIO;
+            break;
+        }
+        latency.push_back(static_cast<uint32_t>(esp_timer_get_time() - op_start));
+        result.ops++;
+        result.bytes += block;
+    }
+    // Data still in the file system's buffers hasn't been written yet
+    if (write && result.error == 0 && fsync(fd) != 0) {
+        result.error = errno;
+    }
+    result.elapsed_us = static_cast<uint32_t>(esp_timer_get_time() - start);
+    if (close(fd) != 0 && result.error == 0) {
+        result.error = errno;
+    }
+
+    result.lat_max_us = latency.empty() ? 0 : *std::max_element(latency.begin(), latency.end());
+    result.lat_p50_us = fs_utils::percentile(latency.data(), latency.size(), 50);
+    result.lat_p90_us = fs_utils::percentile(latency.data(), latency.size(), 90);
+    result.lat_p99_us = fs_utils::percentile(latency.data(), latency.size(), 99);
+    result.ok         = result.error == 0 && !result.cancelled;
+    return result.ok;
+}
+
+void writeCsvHeader(std::FILE* out)
+{
+    std::fprintf(out, "label,pattern,block,span,ops,bytes,elapsed_us,mb_s,iops,p50_us,p90_us,p99_us,max_us,error\r\n");
+}
+
+void writeCsv(std::FILE* out, const char* label, const Result_t& r)
+{
+    std::fprintf(out, "%s,%s,%u,%u,%u,%llu,%u,%.3f,%.1f,%u,%u,%u,%u,%d\r\n", label ? label : "",
+                 patternName(r.pattern), static_cast<unsigned>(r.block_bytes), static_cast<unsigned>(r.span_bytes),
+                 static_cast<unsigned>(r.ops), static_cast<unsigned long long>(r.bytes),
+                 static_cast<unsigned>(r.elapsed_us), r.mbPerSec(), r.iops(), static_cast<unsigned>(r.lat_p50_us),
+                 static_cast<unsigned>(r.lat_p90_us), static_cast<unsigned>(r.lat_p99_us),
+                 static_cast<unsigned>(r.lat_max_us), r.error);
+}
+
+}  // namespace sdbench
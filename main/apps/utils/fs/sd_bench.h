@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * SD card throughput benchmark
+ *
+ * Runs sequential and random reads and writes against one test file with plain POSIX open / read / write / lseek, so
+ * the numbers are what the file system and the card deliver, without stdio buffering. Every operation is timed on its
+ * own for latency percentiles. Throughput (MB/s, 1 MB = 10^6 bytes) covers the whole run, including the fsync() that
+ * ends a write test.
+ *
+ * Nothing here depends on the device, so the same code builds on Linux against a file in a host folder (see
+ * simulator/sd_bench_main.cpp) and the CSV of two runs can be diffed.
+ */
+namespace sdbench {
+
+enum class Pattern : uint8_t {
+    SeqWrite = 0,
+    SeqRead,
+    RandWrite,
+    RandRead,
+    Count,
+};
+
+struct Config_t {
+    std::string path;  // Test file, truncated by SeqWrite
+    size_t file_bytes  = 4 * 1024 * 1024;
+    size_t block_bytes = 4096;
+    size_t span_bytes  = 0;  // Random offsets fall in [0, span), 0 for the whole file
+    uint32_t max_ops   = 2048;
+    uint32_t seed      = 1;
+};
+
+struct Result_t {
+    Pattern pattern     = Pattern::SeqWrite;
+    size_t block_bytes  = 0;
+    size_t span_bytes   = 0;
+    uint32_t ops        = 0;
+    uint64_t bytes      = 0;
+    uint32_t elapsed_us = 0;
+    uint32_t lat_p50_us = 0;
+    uint32_t lat_p90_us = 0;
+    uint32_t lat_p99_us = 0;
+    uint32_t lat_max_us = 0;
+    bool ok             = false;
+    int error           = 0;  // errno of the call that failed
+    bool cancelled      = false;
+
+    float mbPerSec() const
+    {
+        return elapsed_us ? static_cast<float>(bytes) / static_cast<float>(elapsed_us) : 0.0f;
+    }
+    float iops() const
+    {
+        return elapsed_us ? ops * 1e6f / static_cast<float>(elapsed_us) : 0.0f;
+    }
+};
+
+/** One test of a suite */
+struct Case_t {
+    Pattern pattern    = Pattern::SeqWrite;
+    size_t block_bytes = 0;
+    size_t span_bytes  = 0;
+};
+
+static constexpr size_t kBlockSizes[] = {512, 4 * 1024, 16 * 1024, 64 * 1024};
+static constexpr size_t kSpanSizes[]  = {16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+static constexpr size_t kSpanBlock    = 4 * 1024;
+static constexpr size_t kMaxBlock     = 64 * 1024;
+
+const char* patternName(Pattern pattern);
+
+/**
+ * Every pattern at every block in kBlockSizes. With span_sweep random writes and reads of kSpanBlock are added
+ * for every span in kSpanSizes, which shows how the card copes with writes spread over more of its allocation units
+ */
+std::vector<Case_t> defaultCases(bool span_sweep);
+
+/**
+ * Run one test. Reads need the file written by a SeqWrite first and stay inside its size. Returns false with
+ * result.error set on failure, or result.cancelled once stop turns true
+ */
+bool run(const Config_t& config, Pattern pattern, Result_t& result, const std::atomic<bool>* stop = nullptr);
+
+void writeCsvHeader(std::FILE* out);
+void writeCsv(std::FILE* out, const char* label, const Result_t& result);
+
+}  // namespace sdbench
@@ -0,0 +1,219 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "bmp_decoder.h"
+#include <esp_timer.h>
+#include <mooncake_log.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+static const std::string _tag = "Bmp";
+
+static uint32_t read_le16(const uint8_t* p)
+{
+    return p[0] | (static_cast<uint32_t>(p[1]) << 8);
+}
+
+static uint32_t read_le32(const uint8_t* p)
+{
+    return p[0] | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+}
+
+BmpDecoder::~BmpDecoder()
+{
+    close();
+}
+
+void BmpDecoder::close()
+{
+    if (_file) {
+        std::fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool BmpDecoder::open(const char* path)
+{
+    close();
+    _file = std::fopen(path, "rb");
+    if (!_file) {
+        return false;
+    }
+
+    // File header plus the largest info header we look into, V4 / V5 masks sit inside the first 56 bytes
+    uint8_t head[14 + 56] = {};
+    const size_t got      = std::fread(head, 1, sizeof(head), _file);
+    if (got < 14 + 12 || head[0] != 'B' || head[1] != 'M') {
+        close();
+        return false;
+    }
+    const uint32_t data_offset = read_le32(head + 10);
+    const uint32_t dib_size    = read_le32(head + 14);
+    const uint8_t* dib         = head + 14;
+
+    uint32_t compression = 0;
+    uint32_t colors_used = 0;
+    int32_t height       = 0;
+    if (dib_size == 12) {
+        _width = static_cast<int>(read_le16(dib + 4));
+        height = static_cast<int16_t>(read_le16(dib + 6));
+        _bpp   = static_cast<uint16_t>(read_le16(dib + 10));
+    } else if (dib_size >= 40 && got >= 14 + 40) {
+        _width      = static_cast<int32_t>(read_le32(dib + 4));
+        height      = static_cast<int32_t>(read_le32(dib + 8));
+        _bpp        = static_cast<uint16_t>(read_le16(dib + 14));
+        compression = read_le32(dib + 16);
+        colors_used = read_le32(dib + 32);
+    } else {
+        close();
+        return false;
+    }
+    // Negated in 64 bits, INT32_MIN has no positive int32_t
+    const int64_t abs_height = height < 0 ? -static_cast<int64_t>(height) : height;
+    _bottom_up               = height > 0;
+    _bitfields               = compression == 3 || compression == 6;
+
+    const bool bpp_ok = _bpp == 1 || _bpp == 4 || _bpp == 8 || _bpp == 16 || _bpp == 24 || _bpp == 32;
+    if (_width <= 0 || _width > kMaxSize || abs_height <= 0 || abs_height > kMaxSize || !bpp_ok ||
+        (compression != 0 && !_bitfields) || (_bitfields && _bpp != 16 && _bpp != 32)) {
+        close();
+        return false;
+    }
+    _height = static_cast<int>(abs_height);
+    _stride = ((static_cast<size_t>(_width) * _bpp + 31) / 32) * 4;
+
+    // At most 1 GB of rows, the pixel data has to end where a long can still seek to
+    if (data_offset + static_cast<uint64_t>(_height) * _stride > static_cast<uint64_t>(INT32_MAX)) {
+        close();
+        return false;
+    }
+    _data_offset = static_cast<long>(data_offset);
+
+    // Masks follow a plain info header, or live inside the larger ones
+    uint32_t masks[3] = {0, 0, 0};
+    if (_bitfields) {
+        uint8_t extra[12];
+        const uint8_t* src = dib + 40;
+        if (dib_size == 40) {
+            std::fseek(_file, 14 + 40, SEEK_SET);
+            if (std::fread(extra, 1, sizeof(extra), _file) != sizeof(extra)) {
+                close();
+                return false;
+            }
+            src = extra;
+        }
+        for (int i = 0; i < 3; ++i) {
+            masks[i] = read_le32(src + i * 4);
+        }
+    } else if (_bpp == 16) {
+        masks[0] = 0x7C00;
+        masks[1] = 0x03E0;
+        masks[2] = 0x001F;
+    }
+    for (int i = 0; i < 3; ++i) {
+        auto& ch = _channel[i];
+        ch.mask  = masks[i];
+        ch.shift = ch.mask ? static_cast<uint8_t>(__builtin_ctz(ch.mask)) : 0;
+        ch.max   = ch.mask >> ch.shift;
+    }
+
+    _palette_size = 0;
+    if (_bpp <= 8) {
+        const size_t entry = dib_size == 12 ? 3 : 4;
+        const uint32_t max = 1u << _bpp;
+        _palette_size      = static_cast<uint16_t>(colors_used ? std::min(colors_used, max) : max);
+        std::memset(_palette, 0, sizeof(_palette));
+        std::fseek(_file, 14 + static_cast<long>(dib_size), SEEK_SET);
+        for (int i = 0; i < _palette_size; ++i) {
+            uint8_t bgr[4];
+            if (std::fread(bgr, 1, entry, _file) != entry) {
+                close();
+                return false;
+            }
+            _palette[i][0] = bgr[2];
+            _palette[i][1] = bgr[1];
+            _palette[i][2] = bgr[0];
+        }
+    }
+    return true;
+}
+
+void BmpDecoder::read_pixel(const uint8_t* row, int x, uint32_t& r, uint32_t& g, uint32_t& b) const
+{
+    switch (_bpp) {
+        case 24: {
+            const uint8_t* p = row + x * 3;
+            r                = p[2];
+            g                = p[1];
+            b                = p[0];
+            return;
+        }
+        case 32:
+            if (!_bitfields) {
+                const uint8_t* p = row + x * 4;
+                r                = p[2];
+                g                = p[1];
+                b                = p[0];
+                return;
+            }
+            [[fallthrough]];
+        case 16: {
+            const uint32_t v = _bpp == 16 ? read_le16(row + x * 2) : read_le32(row + x * 4);
+            uint32_t* out[3] = {&r, &g, &b};
+            for (int i = 0; i < 3; ++i) {
+                const auto& ch = _channel[i];
+                *out[i]        = ch.max ? ((v & ch.mask) >> ch.shift) * 255 / ch.max : 0;
+            }
+            return;
+        }
+        default: {
+            const int per_byte = 8 / _bpp;
+            const uint8_t byte = row[x / per_byte];
+            const int shift    = 8 - _bpp * (x % per_byte + 1);
+            const int index    = (byte >> shift) & ((1 << _bpp) - 1);
+            const uint8_t* c   = _palette[index < _palette_size ? index : 0];
+            r                  = c[0];
+            g                  = c[1];
+            b                  = c[2];
+            return;
+        }
+    }
+}
+
+bool BmpDecoder::decode(int factor, const RowSink& sink)
+{
+    if (!_file || factor < 1) {
+        return false;
+    }
+    const int64_t start_us = esp_timer_get_time();
+    _stats                 = Stats_t{};
+
+    std::unique_ptr<uint8_t[]> row(new (std::nothrow) uint8_t[_stride]);
+    BoxReducer reducer;
+    if (!row || !reducer.begin(_width, _height, factor)) {
+        mclog::tagWarn(_tag, "alloc failed for {}x{}", _width, _height);
+        return false;
+    }
+    _stats.peak_bytes = _stride + reducer.bytes() + sizeof(*this);
+
+    for (int y = 0; y < _height; ++y) {
+        if (reducer.wantsRow(y)) {
+            const int file_row = _bottom_up ? _height - 1 - y : y;
+            const long offset  = _data_offset + static_cast<long>(file_row) * static_cast<long>(_stride);
+            if (std::fseek(_file, offset, SEEK_SET) != 0 || std::fread(row.get(), 1, _stride, _file) != _stride) {
+                mclog::tagWarn(_tag, "short read at row {} of {}", y, _height);
+                return false;
+            }
+            const uint8_t* px = row.get();
+            reducer.addRow([this, px](int x, uint32_t& r, uint32_t& g, uint32_t& b) { read_pixel(px, x, r, g, b); });
+        }
+        reducer.endRow(y, sink);
+    }
+
+    _stats.total_us = static_cast<uint32_t>(esp_timer_get_time() - start_us);
+    return true;
+}
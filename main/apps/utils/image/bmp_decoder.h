@@ -0,0 +1,48 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "image_decoder.h"
+
+/**
+ * Uncompressed BMP decoder
+ *
+ * Rows are stored at a fixed stride, so only the rows the BoxReducer samples are read from the card, seeking over the
+ * rest. Bottom-up files are read back to front. Handles 1/4/8-bit palettes, 16-bit 555 and bit field, 24-bit and
+ * 32-bit. RLE compressed files are rejected.
+ */
+class BmpDecoder : public ImageDecoder {
+public:
+    ~BmpDecoder() override;
+
+    bool open(const char* path) override;
+    void close() override;
+    bool decode(int factor, const RowSink& sink) override;
+
+private:
+    // Keeps the stride and every row offset well inside a 32-bit long
+    static constexpr int kMaxSize = 16384;
+
+    struct Channel_t {
+        uint32_t mask = 0;
+        uint8_t shift = 0;
+        uint32_t max  = 0;
+    };
+
+    std::FILE* _file       = nullptr;
+    uint16_t _bpp          = 0;
+    bool _bottom_up        = true;
+    bool _bitfields        = false;
+    size_t _stride         = 0;
+    long _data_offset      = 0;
+    uint16_t _palette_size = 0;
+    Channel_t _channel[3];
+    uint8_t _palette[256][3];
+
+    void read_pixel(const uint8_t* row, int x, uint32_t& r, uint32_t& g, uint32_t& b) const;
+};
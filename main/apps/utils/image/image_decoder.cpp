@@ -0,0 +1,260 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "image_decoder.h"
+#include "png_stream.h"
+#include "jpeg_decoder.h"
+#include "bmp_decoder.h"
+#include "qoi_decoder.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+bool ImageDecoder::decodeInto(int factor, uint16_t* dst, int dst_w, int dst_h, int x, int y)
+{
+    return decode(factor, [&](int row_y, const uint16_t* row, int w) {
+        const int dy = y + row_y;
+        if (dy < 0 || dy >= dst_h) {
+            return;
+        }
+        const int x0 = std::max(0, -x);
+        const int x1 = std::min(w, dst_w - x);
+        if (x0 < x1) {
+            std::memcpy(dst + dy * dst_w + x + x0, row + x0, (x1 - x0) * sizeof(uint16_t));
+        }
+    });
+}
+
+int ImageDecoder::factorToFit(int w, int h, int box_w, int box_h)
+{
+    int factor = 1;
+    while (scaledSize(w, factor) > box_w || scaledSize(h, factor) > box_h) {
+        factor++;
+    }
+    return factor;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 BoxReducer                                 */
+/* -------------------------------------------------------------------------- */
+bool BoxReducer::begin(int in_w, int in_h, int factor)
+{
+    _in_w          = in_w;
+    _in_h          = in_h;
+    _factor        = std::max(1, factor);
+    _taps          = std::min(_factor, kMaxTaps);
+    _out_w         = ImageDecoder::scaledSize(in_w, _factor);
+    _out_y         = 0;
+    _rows_in_block = 0;
+
+    // Sample offsets inside each block, increasing so the taps that land inside the image are always the first ones
+    for (int t = 0; t < _taps; ++t) {
+        _tap_offset[t] = (2 * t + 1) * _factor / (2 * _taps);
+    }
+
+    _acc.reset(new (std::nothrow) uint32_t[_out_w * 3]());
+    _col_taps.reset(new (std::nothrow) uint8_t[_out_w]);
+    _out.reset(new (std::nothrow) uint16_t[_out_w]);
+    if (!_acc || !_col_taps || !_out) {
+        end();
+        return false;
+    }
+    for (int ox = 0; ox < _out_w; ++ox) {
+        int n = 0;
+        for (int t = 0; t < _taps; ++t) {
+            n += ox * _factor + _tap_offset[t] < _in_w ? 1 : 0;
+        }
+        _col_taps[ox] = static_cast<uint8_t>(n);
+    }
+    return true;
+}
+
+void BoxReducer::end()
+{
+    _acc.reset();
+    _col_taps.reset();
+    _out.reset();
+}
+
+bool BoxReducer::wantsRow(int y) const
+{
+    const int phase = y % _factor;
+    for (int t = 0; t < _taps; ++t) {
+        if (phase == _tap_offset[t]) {
+            return true;
+        }
+    }
+    // A last block too short to reach the first tap samples its first row instead
+    return phase == 0 && y + _tap_offset[0] >= _in_h;
+}
+
+void BoxReducer::addRowRgb888(const uint8_t* rgb)
+{
+    addRow([rgb](int x, uint32_t& r, uint32_t& g, uint32_t& b) {
+        r = rgb[x * 3];
+        g = rgb[x * 3 + 1];
+        b = rgb[x * 3 + 2];
+    });
+}
+
+void BoxReducer::endRow(int y, const ImageDecoder::RowSink& sink)
+{
+    if (y % _factor != _factor - 1 && y != _in_h - 1) {
+        return;
+    }
+    const uint32_t* a = _acc.get();
+    for (int ox = 0; ox < _out_w; ++ox, a += 3) {
+        const uint32_t n = std::max<uint32_t>(_col_taps[ox], 1) * std::max(_rows_in_block, 1);
+        const uint32_t r = a[0] / n;
+        const uint32_t g = a[1] / n;
+        const uint32_t b = a[2] / n;
+        _out[ox] = __builtin_bswap16(static_cast<uint16_t>(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)));
+    }
+    sink(_out_y++, _out.get(), _out_w);
+    std::memset(_acc.get(), 0, sizeof(uint32_t) * _out_w * 3);
+    _rows_in_block = 0;
+}
+
+size_t BoxReducer::bytes() const
+{
+    return static_cast<size_t>(_out_w) * (3 * sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint16_t));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Registry                                  */
+/* -------------------------------------------------------------------------- */
+static const char* const _png_ext[]  = {".png", nullptr};
+static const char* const _jpeg_ext[] = {".jpg", ".jpeg", nullptr};
+static const char* const _bmp_ext[]  = {".bmp", nullptr};
+static const char* const _qoi_ext[]  = {".qoi", nullptr};
+
+static const ImageCodec_t _codecs[] = {
+    {
+        "PNG",
+        _png_ext,
+        8,
+        [](const uint8_t* h, size_t len) {
+            static constexpr uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+            return len >= 8 && std::memcmp(h, kSignature, 8) == 0;
+        },
+        []() -> std::unique_ptr<ImageDecoder> { return std::make_unique<PngStreamDecoder>(); },
+        [](LGFX_Sprite& dst, const char* path, int x, int y, int max_w, int max_h, int off_x, int off_y, float sx,
+           float sy, datum_t datum) {
+            return dst.drawPngFile(path, x, y, max_w, max_h, off_x, off_y, sx, sy, datum);
+        },
+    },
+    {
+        "JPEG",
+        _jpeg_ext,
+        3,
+        [](const uint8_t* h, size_t len) { return len >= 3 && h[0] == 0xFF && h[1] == 0xD8 && h[2] == 0xFF; },
+        []() -> std::unique_ptr<ImageDecoder> { return std::make_unique<JpegDecoder>(); },
+        [](LGFX_Sprite& dst, const char* path, int x, int y, int max_w, int max_h, int off_x, int off_y, float sx,
+           float sy, datum_t datum) {
+            return dst.drawJpgFile(path, x, y, max_w, max_h, off_x, off_y, sx, sy, datum);
+        },
+    },
+    {
+        "BMP",
+        _bmp_ext,
+        2,
+        [](const uint8_t* h, size_t len) { return len >= 2 && h[0] == 'B' && h[1] == 'M'; },
+        []() -> std::unique_ptr<ImageDecoder> { return std::make_unique<BmpDecoder>(); },
+        [](LGFX_Sprite& dst, const char* path, int x, int y, int max_w, int max_h, int off_x, int off_y, float sx,
+           float sy, datum_t datum) {
+            return dst.drawBmpFile(path, x, y, max_w, max_h, off_x, off_y, sx, sy, datum);
+        },
+    },
+    {
+        "QOI",
+        _qoi_ext,
+        4,
+        [](const uint8_t* h, size_t len) { return len >= 4 && std::memcmp(h, "qoif", 4) == 0; },
+        []() -> std::unique_ptr<ImageDecoder> { return std::make_unique<QoiDecoder>(); },
+        nullptr,
+    },
+};
+
+const ImageCodec_t* findImageCodec(const char* path)
+{
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        return nullptr;
+    }
+    uint8_t head[8];
+    const size_t n = std::fread(head, 1, sizeof(head), f);
+    std::fclose(f);
+
+    for (const auto& codec : _codecs) {
+        if (n >= codec.signature_len && codec.matches(head, n)) {
+            return &codec;
+        }
+    }
+    return nullptr;
+}
+
+static bool has_ext(std::string_view name, std::string_view ext)
+{
+    if (name.size() < ext.size()) {
+        return false;
+    }
+    const std::string_view tail = name.substr(name.size() - ext.size());
+    for (size_t i = 0; i < ext.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(tail[i])) != ext[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char* find_ext(std::string_view name)
+{
+    for (const auto& codec : _codecs) {
+        for (auto* ext = codec.extensions; *ext; ++ext) {
+            if (has_ext(name, *ext)) {
+                return *ext;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool isImageFileName(std::string_view name)
+{
+    return find_ext(name) != nullptr;
+}
+
+std::string_view stripImageExt(std::string_view name)
+{
+    const char* ext = find_ext(name);
+    if (ext) {
+        name.remove_suffix(std::strlen(ext));
+    }
+    return name;
+}
+
+std::unique_ptr<ImageDecoder> openImageDecoder(const char* path)
+{
+    const ImageCodec_t* codec = findImageCodec(path);
+    if (!codec) {
+        return nullptr;
+    }
+    auto decoder = codec->create();
+    if (!decoder || !decoder->open(path)) {
+        return nullptr;
+    }
+    return decoder;
+}
+
+bool drawImageFile(LGFX_Sprite& dst, const char* path, int x, int y, int max_w, int max_h, int off_x, int off_y,
+                   float scale_x, float scale_y, datum_t datum)
+{
+    const ImageCodec_t* codec = findImageCodec(path);
+    if (!codec || !codec->draw_file) {
+        return false;
+    }
+    return codec->draw_file(dst, path, x, y, max_w, max_h, off_x, off_y, scale_x, scale_y, datum);
+}
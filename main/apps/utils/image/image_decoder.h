@@ -0,0 +1,163 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <M5GFX.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+/**
+ * Streaming image decoder
+ *
+ * Decoders produce the image reduced by an integer factor, top to bottom, one output row at a time in display
+ * (swap565) byte order. They never hold the whole image, only what their format needs plus a BoxReducer row.
+ */
+class ImageDecoder {
+public:
+    /** Called once per output row with ceil(width / factor) pixels */
+    using RowSink = std::function<void(int y, const uint16_t* row, int w)>;
+
+    struct Stats_t {
+        size_t peak_bytes   = 0;
+        uint32_t inflate_us = 0;
+        uint32_t total_us   = 0;
+    };
+
+    virtual ~ImageDecoder() = default;
+
+    /** Read the header, fails on anything the decoder can't handle */
+    virtual bool open(const char* path) = 0;
+    virtual void close() = 0;
+
+    /** Decode the whole image reduced by factor, open() must have succeeded */
+    virtual bool decode(int factor, const RowSink& sink) = 0;
+
+    /** Decode reduced by factor into a dst_w x dst_h buffer at (x, y), rows and columns outside are dropped */
+    bool decodeInto(int factor, uint16_t* dst, int dst_w, int dst_h, int x = 0, int y = 0);
+
+    int width() const
+    {
+        return _width;
+    }
+    int height() const
+    {
+        return _height;
+    }
+    const Stats_t& stats() const
+    {
+        return _stats;
+    }
+
+    /** Smallest factor that shrinks the image into box_w x box_h */
+    static int factorToFit(int w, int h, int box_w, int box_h);
+
+    static int scaledSize(int size, int factor)
+    {
+        return (size + factor - 1) / factor;
+    }
+
+protected:
+    int _width  = 0;
+    int _height = 0;
+    Stats_t _stats;
+};
+
+/**
+ * Integer box filter that reduces a stream of rows to one accumulator row
+ *
+ * Each factor x factor block is sampled on an up to kMaxTaps x kMaxTaps grid, so the work per output pixel is bounded
+ * no matter how large the factor. Rows that hold no taps can skip pixel conversion entirely, see wantsRow().
+ */
+class BoxReducer {
+public:
+    static constexpr int kMaxTaps = 4;
+
+    bool begin(int in_w, int in_h, int factor);
+    void end();
+
+    /** True if row y is sampled */
+    bool wantsRow(int y) const;
+
+    /** Accumulate a wanted row, read(x, r, g, b) fetches 8-bit RGB of input column x */
+    template <typename ReadFn>
+    void addRow(ReadFn&& read)
+    {
+        uint32_t* a = _acc.get();
+        for (int ox = 0; ox < _out_w; ++ox, a += 3) {
+            const int n = _col_taps[ox];
+            for (int t = 0; t < (n > 0 ? n : 1); ++t) {
+                uint32_t r, g, b;
+                read(ox * _factor + (n > 0 ? _tap_offset[t] : 0), r, g, b);
+                a[0] += r;
+                a[1] += g;
+                a[2] += b;
+            }
+        }
+        _rows_in_block++;
+    }
+
+    /** Accumulate a wanted row of packed 8-bit RGB */
+    void addRowRgb888(const uint8_t* rgb);
+
+    /** Call for every input row in order, emits an output row once its block is complete */
+    void endRow(int y, const ImageDecoder::RowSink& sink);
+
+    int outWidth() const
+    {
+        return _out_w;
+    }
+    size_t bytes() const;
+
+private:
+    int _in_w          = 0;
+    int _in_h          = 0;
+    int _factor        = 1;
+    int _taps          = 1;
+    int _out_w         = 0;
+    int _out_y         = 0;
+    int _rows_in_block = 0;
+    int _tap_offset[kMaxTaps];
+    std::unique_ptr<uint32_t[]> _acc;
+    std::unique_ptr<uint8_t[]> _col_taps;
+    std::unique_ptr<uint16_t[]> _out;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                  Registry                                  */
+/* -------------------------------------------------------------------------- */
+/**
+ * One supported format. Files are matched by their signature, the extensions only pick which directory entries are
+ * worth showing without opening them
+ */
+struct ImageCodec_t {
+    const char* name;
+    const char* const* extensions;
+    size_t signature_len;
+    bool (*matches)(const uint8_t* head, size_t len);
+    std::unique_ptr<ImageDecoder> (*create)();
+
+    /** M5GFX's own decoder for files the streaming one rejects, may be nullptr */
+    bool (*draw_file)(LGFX_Sprite& dst, const char* path, int x, int y, int max_w, int max_h, int off_x, int off_y,
+                      float scale_x, float scale_y, datum_t datum);
+};
+
+/** Codec for the file at path by its signature, nullptr if none matches */
+const ImageCodec_t* findImageCodec(const char* path);
+
+/** True if name has the extension of a registered format */
+bool isImageFileName(std::string_view name);
+
+/** name without an image extension */
+std::string_view stripImageExt(std::string_view name);
+
+/** Opened decoder for the file at path, nullptr if the format is unknown or the decoder rejects it */
+std::unique_ptr<ImageDecoder> openImageDecoder(const char* path);
+
+/** Draw the file through M5GFX, the fallback for anything the streaming decoders reject */
+bool drawImageFile(LGFX_Sprite& dst, const char* path, int x, int y, int max_w, int max_h, int off_x, int off_y,
+                   float scale_x, float scale_y, datum_t datum);
@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "image_info.h"
+#include "image_decoder.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static uint32_t read_be32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static bool read_png_info(std::FILE* f, ImageInfo_t& info)
+{
+    static constexpr uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    // Signature, IHDR length and type, then width and height
+    uint8_t head[24];
+    if (std::fread(head, 1, sizeof(head), f) != sizeof(head) ||
+        std::memcmp(head, kSignature, sizeof(kSignature)) != 0 || std::memcmp(head + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+    info.width  = static_cast<int>(read_be32(head + 16));
+    info.height = static_cast<int>(read_be32(head + 20));
+    return true;
+}
+
+static bool read_jpeg_info(std::FILE* f, ImageInfo_t& info)
+{
+    // Walk the marker segments up to the first start of frame, whatever its coding
+    uint8_t seg[9];
+    if (std::fread(seg, 1, 2, f) != 2 || seg[0] != 0xFF || seg[1] != 0xD8) {
+        return false;
+    }
+    while (std::fread(seg, 1, 4, f) == 4 && seg[0] == 0xFF) {
+        const uint8_t marker = seg[1];
+        const long len       = (seg[2] << 8) | seg[3];
+        const bool frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (frame) {
+            if (std::fread(seg, 1, 5, f) != 5) {
+                return false;
+            }
+            info.height = (seg[1] << 8) | seg[2];
+            info.width  = (seg[3] << 8) | seg[4];
+            return true;
+        }
+        if (marker == 0xDA || marker == 0xD9 || len < 2 || std::fseek(f, len - 2, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool readImageInfo(const char* path, ImageInfo_t& info)
+{
+    if (auto decoder = openImageDecoder(path)) {
+        info.width  = decoder->width();
+        info.height = decoder->height();
+        return true;
+    }
+
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    bool ok = read_png_info(f, info);
+    if (!ok) {
+        std::rewind(f);
+        ok = read_jpeg_info(f, info);
+    }
+    std::fclose(f);
+    return ok && info.width > 0 && info.height > 0;
+}
+
+float fitScale(int w, int h, int box_w, int box_h)
+{
+    if (w <= 0 || h <= 0) {
+        return 1.0f;
+    }
+    const float sx = static_cast<float>(box_w) / w;
+    const float sy = static_cast<float>(box_h) / h;
+    return std::min(1.0f, std::min(sx, sy));
+}
@@ -0,0 +1,21 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstdint>
+
+struct ImageInfo_t {
+    int width  = 0;
+    int height = 0;
+};
+
+/**
+ * Read the dimensions of any registered image format without decoding anything. Also works for files only M5GFX can
+ * draw, like interlaced PNG and progressive JPEG
+ */
+bool readImageInfo(const char* path, ImageInfo_t& info);
+
+/** Largest scale <= 1 that fits a w x h image into box_w x box_h */
+float fitScale(int w, int h, int box_w, int box_h);
@@ -0,0 +1,292 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "image_pyramid.h"
+#include "image_info.h"
+#include "image_decoder.h"
+#include <esp_heap_caps.h>
+#include <mooncake_log.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+static const std::string _tag = "ImagePyramid";
+
+static constexpr int kMaxDrawW = 320;
+
+// RGB565 with the channels spread apart so four pixels can be summed in one 32-bit word
+static inline uint32_t spread565(uint16_t swapped)
+{
+    const uint32_t v = __builtin_bswap16(swapped);
+    return (v | (v << 16)) & 0x07E0F81F;
+}
+
+static inline uint16_t pack565(uint32_t sum4)
+{
+    const uint32_t v = ((sum4 + 0x00401002) >> 2) & 0x07E0F81F;
+    return __builtin_bswap16(static_cast<uint16_t>(v | (v >> 16)));
+}
+
+static inline uint16_t average4(uint16_t a, uint16_t b, uint16_t c, uint16_t d)
+{
+    return pack565(spread565(a) + spread565(b) + spread565(c) + spread565(d));
+}
+
+ImagePyramid::~ImagePyramid()
+{
+    reset();
+}
+
+ImagePyramid::ImagePyramid(ImagePyramid&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+ImagePyramid& ImagePyramid::operator=(ImagePyramid&& other) noexcept
+{
+    if (this == &other) {
+        return *this;
+    }
+    reset();
+    _path        = std::move(other._path);
+    _width       = other._width;
+    _height      = other._height;
+    _base_scale  = other._base_scale;
+    _bytes       = other._bytes;
+    _memory      = other._memory;
+    _level_count = other._level_count;
+    std::copy(other._levels, other._levels + kMaxLevels, _levels);
+    other._memory      = nullptr;
+    other._level_count = 0;
+    other._bytes       = 0;
+    other._path.clear();
+    return *this;
+}
+
+void ImagePyramid::reset()
+{
+    if (_memory) {
+        heap_caps_free(_memory);
+        _memory = nullptr;
+    }
+    _path.clear();
+    _width       = 0;
+    _height      = 0;
+    _base_scale  = 0.0f;
+    _bytes       = 0;
+    _level_count = 0;
+}
+
+size_t ImagePyramid::budget()
+{
+    if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0) {
+        return std::min(kPsramBudget, heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+    }
+    const size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return largest > kInternalReserve ? std::min(kInternalBudget, largest - kInternalReserve) : 0;
+}
+
+void* ImagePyramid::alloc_pixels(size_t bytes)
+{
+    if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0) {
+        return heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    }
+    return heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+bool ImagePyramid::load(const char* path, float min_scale, int min_w, int min_h, size_t budget_bytes)
+{
+    reset();
+
+    auto decoder          = openImageDecoder(path);
+    const bool streamable = decoder != nullptr;
+    ImageInfo_t info;
+    if (streamable) {
+        info.width  = decoder->width();
+        info.height = decoder->height();
+    } else if (!readImageInfo(path, info)) {
+        return false;
+    }
+
+    // Level dimensions for a given level 0 size, the pyramid adds about a third on top of level 0
+    Level_t levels[kMaxLevels];
+    int level_count   = 0;
+    size_t total      = 0;
+    const auto layout = [&](int w, int h) {
+        level_count = 0;
+        total       = 0;
+        while (level_count < kMaxLevels) {
+            levels[level_count++] = Level_t{w, h, nullptr};
+            total += static_cast<size_t>(w) * h * 2;
+            if ((w <= min_w && h <= min_h) || (w == 1 && h == 1)) {
+                break;
+            }
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+    };
+
+    // Start from level 0 alone filling the budget and shrink until the whole pyramid fits
+    const double area = static_cast<double>(info.width) * info.height;
+    const auto scaled = [&info](float scale) {
+        return std::make_pair(std::max(1, static_cast<int>(std::lround(info.width * scale))),
+                              std::max(1, static_cast<int>(std::lround(info.height * scale))));
+    };
+    float scale = static_cast<float>(std::min(1.0, std::sqrt(budget_bytes / (2.0 * area))));
+    layout(scaled(scale).first, scaled(scale).second);
+    while (total > budget_bytes && scale >= min_scale) {
+        scale *= 0.95f;
+        layout(scaled(scale).first, scaled(scale).second);
+    }
+    if (scale < min_scale * 0.999f || total > budget_bytes) {
+        mclog::tagDebug(_tag, "{}x{} doesn't fit {} bytes at scale {:.2f}", info.width, info.height, budget_bytes,
+                        min_scale);
+        return false;
+    }
+
+    // The streaming decoder only reduces by whole factors, take the next one down if it is still sharp enough
+    const int factor = static_cast<int>(std::ceil(1.0f / scale - 1e-4f));
+    bool stream      = streamable && 1.0f / factor >= min_scale * 0.999f;
+    if (stream) {
+        layout(ImageDecoder::scaledSize(info.width, factor), ImageDecoder::scaledSize(info.height, factor));
+        if (total > budget_bytes) {
+            stream = false;
+            layout(scaled(scale).first, scaled(scale).second);
+        }
+    }
+
+    _memory = alloc_pixels(total);
+    if (!_memory) {
+        mclog::tagWarn(_tag, "alloc {} bytes failed", total);
+        return false;
+    }
+
+    auto* cursor = static_cast<uint16_t*>(_memory);
+    for (int i = 0; i < level_count; ++i) {
+        levels[i].pixels = cursor;
+        cursor += static_cast<size_t>(levels[i].w) * levels[i].h;
+    }
+
+    // Decode straight into level 0, reduced while streaming when possible. Otherwise through a sprite that only
+    // borrows the buffer
+    const float sx = static_cast<float>(levels[0].w) / info.width;
+    const float sy = static_cast<float>(levels[0].h) / info.height;
+    bool decoded   = false;
+    if (stream) {
+        decoded = decoder->decodeInto(factor, levels[0].pixels, levels[0].w, levels[0].h);
+    }
+    decoder.reset();
+    if (!decoded) {
+        LGFX_Sprite sprite;
+        sprite.setColorDepth(16);
+        sprite.setBuffer(levels[0].pixels, levels[0].w, levels[0].h, 16);
+        sprite.fillScreen(TFT_BLACK);
+        decoded = drawImageFile(sprite, path, 0, 0, levels[0].w, levels[0].h, 0, 0, sx, sy, datum_t::top_left);
+    }
+    if (!decoded) {
+        mclog::tagWarn(_tag, "decode {} failed", path);
+        heap_caps_free(_memory);
+        _memory = nullptr;
+        return false;
+    }
+
+    for (int i = 1; i < level_count; ++i) {
+        downsample(levels[i - 1], levels[i]);
+    }
+
+    _path        = path;
+    _width       = info.width;
+    _height      = info.height;
+    _base_scale  = sx;
+    _bytes       = total;
+    _level_count = level_count;
+    std::copy(levels, levels + level_count, _levels);
+    mclog::tagDebug(_tag, "{}: {}x{} base {:.2f}, {} levels, {} bytes", path, _width, _height, _base_scale,
+                    _level_count, _bytes);
+    return true;
+}
+
+void ImagePyramid::downsample(const Level_t& src, Level_t& dst)
+{
+    for (int y = 0; y < dst.h; ++y) {
+        const int sy0      = std::min(y * 2, src.h - 1);
+        const int sy1      = std::min(y * 2 + 1, src.h - 1);
+        const uint16_t* r0 = src.pixels + sy0 * src.w;
+        const uint16_t* r1 = src.pixels + sy1 * src.w;
+        uint16_t* out      = dst.pixels + y * dst.w;
+        for (int x = 0; x < dst.w; ++x) {
+            const int sx0 = std::min(x * 2, src.w - 1);
+            const int sx1 = std::min(x * 2 + 1, src.w - 1);
+            out[x]        = average4(r0[sx0], r0[sx1], r1[sx0], r1[sx1]);
+        }
+    }
+}
+
+bool ImagePyramid::canDraw(float scale) const
+{
+    if (!_memory) {
+        return false;
+    }
+    // A full resolution level 0 may be magnified, a reduced one would just look worse than the file
+    return _base_scale >= 0.999f || scale <= _base_scale * 1.001f;
+}
+
+void ImagePyramid::draw(LGFX_Sprite& dst, int x, int y, int w, int h, float scale, int off_x, int off_y) const
+{
+    if (!_memory || scale <= 0.0f || (dst.getColorDepth() & 0xFF) != 16) {
+        return;
+    }
+
+    // Smallest level that is still at least as large as the requested scale
+    int k = 0;
+    while (k + 1 < _level_count && static_cast<float>(_levels[k + 1].w) / _width >= scale) {
+        k++;
+    }
+    const Level_t& lv  = _levels[k];
+    const float step_x = static_cast<float>(lv.w) / _width / scale;
+    const float step_y = static_cast<float>(lv.h) / _height / scale;
+
+    const float left = x + (w - _width * scale) / 2.0f - off_x;
+    const float top  = y + (h - _height * scale) / 2.0f - off_y;
+
+    const int dx0 = std::max({x, 0, static_cast<int>(std::ceil(left))});
+    const int dy0 = std::max({y, 0, static_cast<int>(std::ceil(top))});
+    const int dx1 = std::min(
+        {x + w, static_cast<int>(dst.width()), static_cast<int>(std::floor(left + _width * scale)), dx0 + kMaxDrawW});
+    const int dy1 =
+        std::min({y + h, static_cast<int>(dst.height()), static_cast<int>(std::floor(top + _height * scale))});
+    if (dx0 >= dx1 || dy0 >= dy1) {
+        return;
+    }
+
+    uint16_t cols[kMaxDrawW];
+    for (int dx = dx0; dx < dx1; ++dx) {
+        const int sx   = static_cast<int>((dx + 0.5f - left) * step_x);
+        cols[dx - dx0] = static_cast<uint16_t>(std::clamp(sx, 0, lv.w - 1));
+    }
+
+    // Box filter when minifying from the level, plain copies otherwise
+    const bool filter = step_x > 1.0f || step_y > 1.0f;
+    auto* out_base    = static_cast<uint16_t*>(dst.getBuffer());
+    const int stride  = dst.width();
+    for (int dy = dy0; dy < dy1; ++dy) {
+        const int sy         = std::clamp(static_cast<int>((dy + 0.5f - top) * step_y), 0, lv.h - 1);
+        const uint16_t* row0 = lv.pixels + sy * lv.w;
+        uint16_t* out        = out_base + dy * stride + dx0;
+        const int n          = dx1 - dx0;
+        if (!filter) {
+            for (int i = 0; i < n; ++i) {
+                out[i] = row0[cols[i]];
+            }
+            continue;
+        }
+        const uint16_t* row1 = lv.pixels + std::min(sy + 1, lv.h - 1) * lv.w;
+        for (int i = 0; i < n; ++i) {
+            const int sx0 = cols[i];
+            const int sx1 = std::min(sx0 + 1, lv.w - 1);
+            out[i]        = average4(row0[sx0], row0[sx1], row1[sx0], row1[sx1]);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <M5GFX.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * A decoded image kept in memory as a mip pyramid of RGB565 levels
+ *
+ * The image is decoded once into level 0, each further level is a 2x2 box filtered half of the previous one down to
+ * screen size. Drawing at any scale is then a resample from the nearest level that is at least as large, no file
+ * access. Level 0 is decoded at the largest scale <= 1 that fits the memory budget (PSRAM when the board has it, a
+ * slice of the internal heap otherwise), zooming in past that scale is left to the caller.
+ */
+class ImagePyramid {
+public:
+    static constexpr size_t kInternalBudget  = 128 * 1024;
+    static constexpr size_t kInternalReserve = 48 * 1024;
+    static constexpr size_t kPsramBudget     = 4 * 1024 * 1024;
+    static constexpr int kMaxLevels          = 10;
+
+    ImagePyramid() = default;
+    ~ImagePyramid();
+    ImagePyramid(const ImagePyramid&)            = delete;
+    ImagePyramid& operator=(const ImagePyramid&) = delete;
+    ImagePyramid(ImagePyramid&& other) noexcept;
+    ImagePyramid& operator=(ImagePyramid&& other) noexcept;
+
+    /**
+     * Decode the image at path. Levels stop once they fit min_w x min_h. Fails when the image can't be held at
+     * min_scale or better within budget_bytes, the caller should fall back to decoding straight from the file then
+     */
+    bool load(const char* path, float min_scale, int min_w, int min_h, size_t budget_bytes = budget());
+    void reset();
+
+    /**
+     * Draw the image into the w x h box at (x, y) of dst, centered and scaled like drawPngFile() with
+     * datum_t::middle_center, (off_x, off_y) pans the image in screen pixels. Only pixels inside the box are written
+     */
+    void draw(LGFX_Sprite& dst, int x, int y, int w, int h, float scale, int off_x, int off_y) const;
+
+    /** True if scale can be drawn without upscaling a level that was decoded below full resolution */
+    bool canDraw(float scale) const;
+
+    bool isLoaded() const
+    {
+        return _memory != nullptr;
+    }
+    const std::string& path() const
+    {
+        return _path;
+    }
+    int width() const
+    {
+        return _width;
+    }
+    int height() const
+    {
+        return _height;
+    }
+    float baseScale() const
+    {
+        return _base_scale;
+    }
+    size_t bytes() const
+    {
+        return _bytes;
+    }
+
+    /** Bytes an image may take right now, PSRAM if present, otherwise what the internal heap can spare */
+    static size_t budget();
+
+private:
+    struct Level_t {
+        int w            = 0;
+        int h            = 0;
+        uint16_t* pixels = nullptr;
+    };
+
+    std::string _path;
+    int _width        = 0;
+    int _height       = 0;
+    float _base_scale = 0.0f;
+    size_t _bytes     = 0;
+    void* _memory     = nullptr;
+    Level_t _levels[kMaxLevels];
+    int _level_count = 0;
+
+    static void* alloc_pixels(size_t bytes);
+    static void downsample(const Level_t& src, Level_t& dst);
+};
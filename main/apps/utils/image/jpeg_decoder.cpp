@@ -0,0 +1,592 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "jpeg_decoder.h"
+#include <esp_timer.h>
+#include <mooncake_log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+static const std::string _tag = "Jpeg";
+
+static constexpr uint8_t kZigzag[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+                                        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+                                        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+                                        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+/**
+ * N point IDCT bases for N = 1, 2, 4, 8, in Q12 with the C(u) / 2 normalisation folded in. Evaluating the lowest N
+ * frequencies of an 8 point block at N evenly spaced positions is the reduced size IDCT
+ */
+struct IdctTables {
+    int16_t basis[4][8][8];
+
+    IdctTables()
+    {
+        for (int level = 0; level < 4; ++level) {
+            const int n = 1 << level;
+            for (int k = 0; k < n; ++k) {
+                for (int u = 0; u < n; ++u) {
+                    const double c = u == 0 ? std::sqrt(0.5) : 1.0;
+                    const double v = c / 2.0 * std::cos((2 * k + 1) * u * M_PI / (2.0 * n));
+                    basis[level][k][u] = static_cast<int16_t>(std::lround(v * 4096.0));
+                }
+            }
+        }
+    }
+};
+
+static const IdctTables& idct_tables()
+{
+    static const IdctTables tables;
+    return tables;
+}
+
+static inline uint8_t clamp_u8(int v)
+{
+    return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static inline int extend(int v, int t)
+{
+    return v < (1 << (t - 1)) ? v - (1 << t) + 1 : v;
+}
+
+/** coef is in natural order, only its top left n x n is read. out gets n x n samples */
+static void idct(const int32_t* coef, int n, bool ac_nonzero, uint8_t* out, int stride)
+{
+    if (!ac_nonzero) {
+        // Flat block, the DC term alone is coef[0] / 8 at any size
+        const uint8_t v = clamp_u8(((coef[0] + 4) >> 3) + 128);
+        for (int y = 0; y < n; ++y) {
+            std::memset(out + y * stride, v, n);
+        }
+        return;
+    }
+
+    int level = 0;
+    while ((1 << level) < n) {
+        level++;
+    }
+    const auto& basis = idct_tables().basis[level];
+
+    // Rows keep 2 fractional bits, columns remove the remaining Q12 + 2
+    int32_t tmp[8][8];
+    for (int v = 0; v < n; ++v) {
+        const int32_t* row = coef + v * 8;
+        for (int k = 0; k < n; ++k) {
+            int32_t sum = 0;
+            for (int u = 0; u < n; ++u) {
+                sum += basis[k][u] * std::clamp(row[u], -4096, 4095);
+            }
+            tmp[v][k] = sum >> 10;
+        }
+    }
+    for (int k = 0; k < n; ++k) {
+        uint8_t* dst = out + k * stride;
+        for (int j = 0; j < n; ++j) {
+            int32_t sum = 0;
+            for (int v = 0; v < n; ++v) {
+                sum += basis[k][v] * tmp[v][j];
+            }
+            dst[j] = clamp_u8(((sum + (1 << 13)) >> 14) + 128);
+        }
+    }
+}
+
+JpegDecoder::~JpegDecoder()
+{
+    close();
+}
+
+void JpegDecoder::close()
+{
+    if (_file) {
+        std::fclose(_file);
+        _file = nullptr;
+    }
+}
+
+int JpegDecoder::read_byte()
+{
+    if (_buf_pos >= _buf_len) {
+        _buf_len = std::fread(_buf, 1, sizeof(_buf), _file);
+        _buf_pos = 0;
+        if (_buf_len == 0) {
+            return -1;
+        }
+    }
+    return _buf[_buf_pos++];
+}
+
+void JpegDecoder::skip_bytes(size_t n)
+{
+    const size_t buffered = std::min(n, _buf_len - _buf_pos);
+    _buf_pos += buffered;
+    n -= buffered;
+    if (n > 0) {
+        std::fseek(_file, static_cast<long>(n), SEEK_CUR);
+    }
+}
+
+bool JpegDecoder::build_huffman(Huffman_t& table, const uint8_t* counts, const uint8_t* values, int total)
+{
+    if (total > 256) {
+        return false;
+    }
+    std::memset(table.fast_len, 0, sizeof(table.fast_len));
+    std::memcpy(table.values, values, total);
+
+    int code = 0;
+    int k    = 0;
+    for (int len = 1; len <= 16; ++len) {
+        table.valptr[len]  = static_cast<int16_t>(k);
+        table.mincode[len] = static_cast<uint16_t>(code);
+        for (int i = 0; i < counts[len - 1]; ++i, ++code, ++k) {
+            if (len <= kFastBits) {
+                const int first = code << (kFastBits - len);
+                for (int j = 0; j < (1 << (kFastBits - len)); ++j) {
+                    table.fast_len[first + j] = static_cast<uint8_t>(len);
+                    table.fast_val[first + j] = values[k];
+                }
+            }
+        }
+        table.maxcode[len] = counts[len - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+    table.defined = true;
+    return true;
+}
+
+bool JpegDecoder::read_segment(uint8_t marker, uint16_t len)
+{
+    const size_t size = len - 2;
+    const bool wanted = marker == 0xC0 || marker == 0xC1 || marker == 0xC4 || marker == 0xDB || marker == 0xDD;
+    if (!wanted) {
+        // Other frame types are progressive, lossless or arithmetic coded
+        if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            return false;
+        }
+        skip_bytes(size);
+        return true;
+    }
+
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        const int b = read_byte();
+        if (b < 0) {
+            return false;
+        }
+        data[i] = static_cast<uint8_t>(b);
+    }
+    const uint8_t* p   = data.data();
+    const uint8_t* end = p + size;
+
+    if (marker == 0xDB) {
+        while (p < end) {
+            const int pq = p[0] >> 4;
+            const int tq = p[0] & 0x0F;
+            p++;
+            if (tq > 3 || end - p < (pq ? 128 : 64)) {
+                return false;
+            }
+            for (int i = 0; i < 64; ++i) {
+                _qt[tq][kZigzag[i]] = pq ? static_cast<uint16_t>((p[i * 2] << 8) | p[i * 2 + 1]) : p[i];
+            }
+            p += pq ? 128 : 64;
+        }
+        return true;
+    }
+
+    if (marker == 0xC4) {
+        while (end - p >= 17) {
+            const int tc = p[0] >> 4;
+            const int th = p[0] & 0x0F;
+            if (tc > 1 || th > 1) {
+                return false;
+            }
+            const uint8_t* counts = p + 1;
+            int total             = 0;
+            for (int i = 0; i < 16; ++i) {
+                total += counts[i];
+            }
+            p += 17;
+            if (end - p < total || !build_huffman(tc ? _ac[th] : _dc[th], counts, p, total)) {
+                return false;
+            }
+            p += total;
+        }
+        return true;
+    }
+
+    if (marker == 0xDD) {
+        _restart_interval = size >= 2 ? (p[0] << 8) | p[1] : 0;
+        return true;
+    }
+
+    // Start of frame, baseline or extended sequential Huffman
+    if (size < 6 || p[0] != 8) {
+        return false;
+    }
+    _height     = (p[1] << 8) | p[2];
+    _width      = (p[3] << 8) | p[4];
+    _comp_count = p[5];
+    if ((_comp_count != 1 && _comp_count != 3) || size < 6u + _comp_count * 3u || _width <= 0 || _height <= 0) {
+        return false;
+    }
+    _hmax = 1;
+    _vmax = 1;
+    for (int i = 0; i < _comp_count; ++i) {
+        auto& c = _comp[i];
+        c.id    = p[6 + i * 3];
+        c.h     = p[7 + i * 3] >> 4;
+        c.v     = p[7 + i * 3] & 0x0F;
+        c.tq    = p[8 + i * 3];
+        if (c.h < 1 || c.h > 2 || c.v < 1 || c.v > 2 || c.tq > 3) {
+            return false;
+        }
+        // A lone component is never interleaved, its MCU is one block whatever the sampling says
+        if (_comp_count == 1) {
+            c.h = 1;
+            c.v = 1;
+        }
+        _hmax = std::max<int>(_hmax, c.h);
+        _vmax = std::max<int>(_vmax, c.v);
+    }
+    return true;
+}
+
+bool JpegDecoder::open(const char* path)
+{
+    close();
+    _file = std::fopen(path, "rb");
+    if (!_file) {
+        return false;
+    }
+    _buf_len          = 0;
+    _buf_pos          = 0;
+    _comp_count       = 0;
+    _restart_interval = 0;
+    _dc[0].defined = _dc[1].defined = false;
+    _ac[0].defined = _ac[1].defined = false;
+
+    bool ok = read_byte() == 0xFF && read_byte() == 0xD8;
+    while (ok) {
+        int m = read_byte();
+        if (m != 0xFF) {
+            ok = false;
+            break;
+        }
+        while (m == 0xFF) {
+            m = read_byte();
+        }
+        if (m < 0 || m == 0xD9) {
+            ok = false;
+            break;
+        }
+        if (m == 0x01 || (m >= 0xD0 && m <= 0xD8)) {
+            continue;
+        }
+        const int hi = read_byte();
+        const int lo = read_byte();
+        if (hi < 0 || lo < 0 || ((hi << 8) | lo) < 2) {
+            ok = false;
+            break;
+        }
+        const uint16_t len = static_cast<uint16_t>((hi << 8) | lo);
+
+        if (m != 0xDA) {
+            ok = read_segment(static_cast<uint8_t>(m), len);
+            continue;
+        }
+
+        // Start of scan, a single scan must carry every component
+        const int ns = read_byte();
+        if (_comp_count == 0 || ns != _comp_count) {
+            ok = false;
+            break;
+        }
+        for (int i = 0; i < ns && ok; ++i) {
+            const int id    = read_byte();
+            const int table = read_byte();
+            auto* comp      = std::find_if(_comp, _comp + _comp_count, [id](const Component_t& c) { return c.id == id; });
+            if (comp == _comp + _comp_count || table < 0) {
+                ok = false;
+                break;
+            }
+            comp->td = table >> 4;
+            comp->ta = table & 0x0F;
+            ok       = comp->td < 2 && comp->ta < 2 && _dc[comp->td].defined && _ac[comp->ta].defined;
+        }
+        const int ss = read_byte();
+        const int se = read_byte();
+        read_byte();
+        ok = ok && ss == 0 && se == 63;
+        if (ok) {
+            _scan_offset = std::ftell(_file) - static_cast<long>(_buf_len - _buf_pos);
+            return true;
+        }
+    }
+    close();
+    return false;
+}
+
+uint8_t JpegDecoder::next_scan_byte()
+{
+    if (_marker_hit) {
+        return 0;
+    }
+    int b = read_byte();
+    if (b < 0) {
+        _marker_hit = true;
+        return 0;
+    }
+    if (b == 0xFF) {
+        int next = read_byte();
+        while (next == 0xFF) {
+            next = read_byte();
+        }
+        if (next == 0) {
+            return 0xFF;
+        }
+        // A marker ends the segment, keep feeding zeros until restart() picks it up
+        _marker_hit = true;
+        _marker     = static_cast<uint8_t>(next < 0 ? 0 : next);
+        return 0;
+    }
+    return static_cast<uint8_t>(b);
+}
+
+void JpegDecoder::fill_bits(int n)
+{
+    while (_nbits < n) {
+        _bits |= static_cast<uint32_t>(next_scan_byte()) << (24 - _nbits);
+        _nbits += 8;
+    }
+}
+
+int JpegDecoder::get_bits(int n)
+{
+    fill_bits(n);
+    const int v = static_cast<int>(_bits >> (32 - n));
+    _bits <<= n;
+    _nbits -= n;
+    return v;
+}
+
+int JpegDecoder::decode_huffman(const Huffman_t& table)
+{
+    fill_bits(16);
+    const uint32_t fast = _bits >> (32 - kFastBits);
+    if (table.fast_len[fast]) {
+        const int len = table.fast_len[fast];
+        _bits <<= len;
+        _nbits -= len;
+        return table.fast_val[fast];
+    }
+    for (int len = kFastBits + 1; len <= 16; ++len) {
+        const int32_t code = static_cast<int32_t>(_bits >> (32 - len));
+        if (code <= table.maxcode[len]) {
+            _bits <<= len;
+            _nbits -= len;
+            return table.values[table.valptr[len] + code - table.mincode[len]];
+        }
+    }
+    return -1;
+}
+
+bool JpegDecoder::restart()
+{
+    _bits  = 0;
+    _nbits = 0;
+    if (!_marker_hit) {
+        // Padding before the marker, scan forward to it
+        int b = read_byte();
+        while (b >= 0) {
+            if (b == 0xFF) {
+                b = read_byte();
+                while (b == 0xFF) {
+                    b = read_byte();
+                }
+                if (b > 0) {
+                    _marker = static_cast<uint8_t>(b);
+                    break;
+                }
+            }
+            b = read_byte();
+        }
+        if (b < 0) {
+            return false;
+        }
+    }
+    _marker_hit = false;
+    for (int i = 0; i < _comp_count; ++i) {
+        _comp[i].dc_pred = 0;
+    }
+    return _marker >= 0xD0 && _marker <= 0xD7;
+}
+
+bool JpegDecoder::decode_block(Component_t& comp, int32_t* coef, int n, bool& ac_nonzero)
+{
+    const Huffman_t& dc = _dc[comp.td];
+    const Huffman_t& ac = _ac[comp.ta];
+    const uint16_t* q   = _qt[comp.tq];
+
+    for (int r = 0; r < n; ++r) {
+        std::memset(coef + r * 8, 0, n * sizeof(int32_t));
+    }
+
+    const int t = decode_huffman(dc);
+    if (t < 0 || t > 11) {
+        return false;
+    }
+    comp.dc_pred += t ? extend(get_bits(t), t) : 0;
+    coef[0]    = comp.dc_pred * q[0];
+    ac_nonzero = false;
+
+    // Every coefficient has to be read to stay in sync, only the top left n x n are kept
+    for (int k = 1; k < 64;) {
+        const int rs = decode_huffman(ac);
+        if (rs < 0) {
+            return false;
+        }
+        const int r = rs >> 4;
+        const int s = rs & 0x0F;
+        if (s == 0) {
+            if (r != 15) {
+                break;
+            }
+            k += 16;
+            continue;
+        }
+        k += r;
+        if (k > 63) {
+            return false;
+        }
+        const int v = extend(get_bits(s), s);
+        const int z = kZigzag[k];
+        if ((z >> 3) < n && (z & 7) < n) {
+            coef[z]    = v * q[z];
+            ac_nonzero = true;
+        }
+        k++;
+    }
+    return true;
+}
+
+bool JpegDecoder::decode(int factor, const RowSink& sink)
+{
+    if (!_file || factor < 1) {
+        return false;
+    }
+    const int64_t start_us = esp_timer_get_time();
+    _stats                 = Stats_t{};
+
+    // The largest of 8, 4, 2 that divides the factor is done in the IDCT, the rest by the box filter
+    int idct_scale = 8;
+    while (factor % idct_scale != 0) {
+        idct_scale >>= 1;
+    }
+    const int n        = 8 / idct_scale;
+    const int mcus_x   = (_width + 8 * _hmax - 1) / (8 * _hmax);
+    const int mcus_y   = (_height + 8 * _vmax - 1) / (8 * _vmax);
+    const int scaled_w = scaledSize(_width, idct_scale);
+    const int scaled_h = scaledSize(_height, idct_scale);
+
+    // One MCU row of samples per component
+    int plane_w[3];
+    size_t plane_bytes = 0;
+    for (int c = 0; c < _comp_count; ++c) {
+        plane_w[c] = mcus_x * _comp[c].h * n;
+        plane_bytes += static_cast<size_t>(plane_w[c]) * _comp[c].v * n;
+    }
+    std::unique_ptr<uint8_t[]> planes(new (std::nothrow) uint8_t[plane_bytes]);
+    BoxReducer reducer;
+    if (!planes || !reducer.begin(scaled_w, scaled_h, factor / idct_scale)) {
+        mclog::tagWarn(_tag, "alloc failed for {}x{}", _width, _height);
+        return false;
+    }
+    uint8_t* plane[3] = {planes.get(), nullptr, nullptr};
+    for (int c = 1; c < _comp_count; ++c) {
+        plane[c] = plane[c - 1] + static_cast<size_t>(plane_w[c - 1]) * _comp[c - 1].v * n;
+    }
+    _stats.peak_bytes = plane_bytes + reducer.bytes() + sizeof(*this);
+
+    // Chroma is upsampled by repeating samples, at most 2x in either direction
+    int shift_x[3];
+    int shift_y[3];
+    for (int c = 0; c < _comp_count; ++c) {
+        shift_x[c]       = _comp[c].h < _hmax ? 1 : 0;
+        shift_y[c]       = _comp[c].v < _vmax ? 1 : 0;
+        _comp[c].dc_pred = 0;
+    }
+
+    std::fseek(_file, _scan_offset, SEEK_SET);
+    _buf_len    = 0;
+    _buf_pos    = 0;
+    _bits       = 0;
+    _nbits      = 0;
+    _marker_hit = false;
+
+    int32_t coef[64];
+    int mcu_count   = 0;
+    const int row_h = _vmax * n;
+    for (int my = 0; my < mcus_y; ++my) {
+        for (int mx = 0; mx < mcus_x; ++mx) {
+            if (_restart_interval && mcu_count > 0 && mcu_count % _restart_interval == 0 && !restart()) {
+                mclog::tagWarn(_tag, "missing restart marker");
+                return false;
+            }
+            mcu_count++;
+            for (int c = 0; c < _comp_count; ++c) {
+                auto& comp = _comp[c];
+                for (int by = 0; by < comp.v; ++by) {
+                    for (int bx = 0; bx < comp.h; ++bx) {
+                        bool ac_nonzero = false;
+                        if (!decode_block(comp, coef, n, ac_nonzero)) {
+                            mclog::tagWarn(_tag, "corrupt data at mcu {}, {}", mx, my);
+                            return false;
+                        }
+                        uint8_t* dst = plane[c] + by * n * plane_w[c] + (mx * comp.h + bx) * n;
+                        idct(coef, n, ac_nonzero, dst, plane_w[c]);
+                    }
+                }
+            }
+        }
+
+        for (int ly = 0; ly < row_h; ++ly) {
+            const int y = my * row_h + ly;
+            if (y >= scaled_h) {
+                break;
+            }
+            if (reducer.wantsRow(y)) {
+                const uint8_t* luma = plane[0] + ly * plane_w[0];
+                if (_comp_count == 1) {
+                    reducer.addRow([luma](int x, uint32_t& r, uint32_t& g, uint32_t& b) { r = g = b = luma[x]; });
+                } else {
+                    const uint8_t* cb_row = plane[1] + (ly >> shift_y[1]) * plane_w[1];
+                    const uint8_t* cr_row = plane[2] + (ly >> shift_y[2]) * plane_w[2];
+                    const int sx1         = shift_x[1];
+                    const int sx2         = shift_x[2];
+                    reducer.addRow([=](int x, uint32_t& r, uint32_t& g, uint32_t& b) {
+                        const int yy = luma[x];
+                        const int cb = cb_row[x >> sx1] - 128;
+                        const int cr = cr_row[x >> sx2] - 128;
+                        r            = clamp_u8(yy + ((91881 * cr + 32768) >> 16));
+                        g            = clamp_u8(yy - ((22554 * cb + 46802 * cr + 32768) >> 16));
+                        b            = clamp_u8(yy + ((116130 * cb + 32768) >> 16));
+                    });
+                }
+            }
+            reducer.endRow(y, sink);
+        }
+    }
+
+    _stats.total_us = static_cast<uint32_t>(esp_timer_get_time() - start_us);
+    return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "image_decoder.h"
+
+/**
+ * Baseline JPEG decoder with scaling in the IDCT
+ *
+ * One MCU row is decoded at a time. Reductions by 2, 4 and 8 are done by running a 4, 2 or 1 point IDCT on the low
+ * frequency coefficients of each block, so a 1/8 decode is just the DC terms. Whatever is left of the factor after
+ * that goes through a BoxReducer. Handles 8-bit Huffman coded single scan images, gray or YCbCr with any 1x / 2x
+ * sampling, and restart markers. Progressive and arithmetic coded files are rejected.
+ */
+class JpegDecoder : public ImageDecoder {
+public:
+    ~JpegDecoder() override;
+
+    bool open(const char* path) override;
+    void close() override;
+    bool decode(int factor, const RowSink& sink) override;
+
+private:
+    static constexpr size_t kReadChunk = 2048;
+    static constexpr int kFastBits     = 9;
+
+    struct Huffman_t {
+        uint8_t fast_len[1 << kFastBits];
+        uint8_t fast_val[1 << kFastBits];
+        int32_t maxcode[18];
+        int16_t valptr[17];
+        uint16_t mincode[17];
+        uint8_t values[256];
+        bool defined = false;
+    };
+
+    struct Component_t {
+        uint8_t id  = 0;
+        uint8_t h   = 1;
+        uint8_t v   = 1;
+        uint8_t tq  = 0;
+        uint8_t td  = 0;
+        uint8_t ta  = 0;
+        int dc_pred = 0;
+    };
+
+    std::FILE* _file = nullptr;
+    uint16_t _qt[4][64];
+    Huffman_t _dc[2];
+    Huffman_t _ac[2];
+    Component_t _comp[3];
+    int _comp_count       = 0;
+    int _hmax             = 1;
+    int _vmax             = 1;
+    int _restart_interval = 0;
+    long _scan_offset     = 0;
+
+    // Entropy coded segment reader
+    uint8_t _buf[kReadChunk];
+    size_t _buf_len  = 0;
+    size_t _buf_pos  = 0;
+    uint32_t _bits   = 0;
+    int _nbits       = 0;
+    bool _marker_hit = false;
+    uint8_t _marker  = 0;
+
+    bool read_segment(uint8_t marker, uint16_t len);
+    bool build_huffman(Huffman_t& table, const uint8_t* counts, const uint8_t* values, int total);
+
+    int read_byte();
+    void skip_bytes(size_t n);
+    uint8_t next_scan_byte();
+    void fill_bits(int n);
+    int get_bits(int n);
+    int decode_huffman(const Huffman_t& table);
+    bool restart();
+    bool decode_block(Component_t& comp, int32_t* coef, int n, bool& ac_nonzero);
+};
@@ -0,0 +1,338 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "png_stream.h"
+#include <rom/miniz.h>
+#include <esp_timer.h>
+#include <mooncake_log.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+static const std::string _tag = "PngStream";
+
+static constexpr size_t kReadChunk = 4096;
+
+static uint32_t read_be32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline uint8_t paeth(int a, int b, int c)
+{
+    const int p  = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+static bool unfilter(uint8_t filter, uint8_t* cur, const uint8_t* prev, size_t stride, size_t bpp)
+{
+    switch (filter) {
+        case 0:
+            return true;
+        case 1:
+            for (size_t i = bpp; i < stride; ++i) {
+                cur[i] += cur[i - bpp];
+            }
+            return true;
+        case 2:
+            for (size_t i = 0; i < stride; ++i) {
+                cur[i] += prev[i];
+            }
+            return true;
+        case 3:
+            for (size_t i = 0; i < stride; ++i) {
+                const int left = i >= bpp ? cur[i - bpp] : 0;
+                cur[i] += static_cast<uint8_t>((left + prev[i]) >> 1);
+            }
+            return true;
+        case 4:
+            for (size_t i = 0; i < stride; ++i) {
+                const int left    = i >= bpp ? cur[i - bpp] : 0;
+                const int up_left = i >= bpp ? prev[i - bpp] : 0;
+                cur[i] += paeth(left, prev[i], up_left);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+PngStreamDecoder::~PngStreamDecoder()
+{
+    close();
+}
+
+void PngStreamDecoder::close()
+{
+    if (_file) {
+        std::fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool PngStreamDecoder::open(const char* path)
+{
+    static constexpr uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    close();
+    _palette_size = 0;
+    _file         = std::fopen(path, "rb");
+    if (!_file) {
+        return false;
+    }
+
+    uint8_t head[8 + 8 + 13];
+    if (std::fread(head, 1, sizeof(head), _file) != sizeof(head) ||
+        std::memcmp(head, kSignature, sizeof(kSignature)) != 0 || std::memcmp(head + 12, "IHDR", 4) != 0) {
+        close();
+        return false;
+    }
+    _width           = static_cast<int>(read_be32(head + 16));
+    _height          = static_cast<int>(read_be32(head + 20));
+    _bit_depth       = head[24];
+    _color_type      = head[25];
+    const bool laced = head[28] != 0;
+
+    static constexpr uint8_t kChannels[7] = {1, 0, 3, 1, 2, 0, 4};
+    _channels = _color_type < 7 ? kChannels[_color_type] : 0;
+    const bool depth_ok =
+        _bit_depth == 8 || (_bit_depth == 16 && _color_type != 3) ||
+        ((_bit_depth == 1 || _bit_depth == 2 || _bit_depth == 4) && (_color_type == 0 || _color_type == 3));
+    if (_width <= 0 || _height <= 0 || _channels == 0 || !depth_ok || laced) {
+        close();
+        return false;
+    }
+
+    // Palette and its alpha come before the first IDAT, remember where the data starts
+    std::fseek(_file, 4, SEEK_CUR);
+    while (true) {
+        uint8_t chunk[8];
+        const long offset = std::ftell(_file);
+        if (std::fread(chunk, 1, sizeof(chunk), _file) != sizeof(chunk)) {
+            close();
+            return false;
+        }
+        const uint32_t len = read_be32(chunk);
+        if (std::memcmp(chunk + 4, "IDAT", 4) == 0) {
+            _data_offset = offset;
+            break;
+        }
+        if (std::memcmp(chunk + 4, "PLTE", 4) == 0 && len <= 768) {
+            uint8_t rgb[768];
+            std::fread(rgb, 1, len, _file);
+            _palette_size = static_cast<uint16_t>(len / 3);
+            for (int i = 0; i < _palette_size; ++i) {
+                _palette[i][0] = rgb[i * 3];
+                _palette[i][1] = rgb[i * 3 + 1];
+                _palette[i][2] = rgb[i * 3 + 2];
+                _palette[i][3] = 0xFF;
+            }
+            std::fseek(_file, 4, SEEK_CUR);
+            continue;
+        }
+        if (std::memcmp(chunk + 4, "tRNS", 4) == 0 && _color_type == 3 && len <= 256) {
+            uint8_t alpha[256];
+            std::fread(alpha, 1, len, _file);
+            for (uint32_t i = 0; i < len && i < _palette_size; ++i) {
+                _palette[i][3] = alpha[i];
+            }
+            std::fseek(_file, 4, SEEK_CUR);
+            continue;
+        }
+        if (std::memcmp(chunk + 4, "IEND", 4) == 0) {
+            close();
+            return false;
+        }
+        std::fseek(_file, len + 4, SEEK_CUR);
+    }
+
+    if (_color_type == 3 && _palette_size == 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PngStreamDecoder::read_pixel(const uint8_t* row, int x, uint32_t& r, uint32_t& g, uint32_t& b) const
+{
+    uint32_t a = 255;
+    if (_bit_depth < 8) {
+        const int bit     = x * _bit_depth;
+        const int mask    = (1 << _bit_depth) - 1;
+        const uint8_t idx = (row[bit >> 3] >> (8 - _bit_depth - (bit & 7))) & mask;
+        if (_color_type == 3) {
+            const auto& p = _palette[idx];
+            r             = p[0];
+            g             = p[1];
+            b             = p[2];
+            a             = p[3];
+        } else {
+            r = g = b = idx * 255 / mask;
+        }
+    } else {
+        // 16-bit samples only keep their high byte
+        const int step   = _bit_depth >> 3;
+        const uint8_t* p = row + x * _channels * step;
+        switch (_color_type) {
+            case 0:
+                r = g = b = p[0];
+                break;
+            case 2:
+                r = p[0];
+                g = p[step];
+                b = p[step * 2];
+                break;
+            case 3: {
+                const auto& c = _palette[p[0]];
+                r             = c[0];
+                g             = c[1];
+                b             = c[2];
+                a             = c[3];
+                break;
+            }
+            case 4:
+                r = g = b = p[0];
+                a         = p[step];
+                break;
+            default:
+                r = p[0];
+                g = p[step];
+                b = p[step * 2];
+                a = p[step * 3];
+                break;
+        }
+    }
+    if (a != 255) {
+        r = r * a / 255;
+        g = g * a / 255;
+        b = b * a / 255;
+    }
+}
+
+bool PngStreamDecoder::decode(int factor, const RowSink& sink)
+{
+    if (!_file || factor < 1) {
+        return false;
+    }
+    const int64_t start_us = esp_timer_get_time();
+    _stats                 = Stats_t{};
+
+    const size_t bits   = static_cast<size_t>(_channels) * _bit_depth;
+    const size_t stride = (static_cast<size_t>(_width) * bits + 7) / 8;
+    const size_t bpp    = std::max<size_t>(1, bits / 8);
+
+    const size_t window_bytes = TINFL_LZ_DICT_SIZE;
+    const size_t rows_bytes   = (stride + 1) * 2;
+    std::unique_ptr<tinfl_decompressor> inflator(new (std::nothrow) tinfl_decompressor);
+    std::unique_ptr<uint8_t[]> window(new (std::nothrow) uint8_t[window_bytes]);
+    std::unique_ptr<uint8_t[]> rows(new (std::nothrow) uint8_t[rows_bytes]());
+    std::unique_ptr<uint8_t[]> input(new (std::nothrow) uint8_t[kReadChunk]);
+    BoxReducer reducer;
+    if (!inflator || !window || !rows || !input || !reducer.begin(_width, _height, factor)) {
+        mclog::tagWarn(_tag, "alloc failed for {}x{}", _width, _height);
+        return false;
+    }
+    _stats.peak_bytes =
+        sizeof(tinfl_decompressor) + window_bytes + rows_bytes + kReadChunk + reducer.bytes() + sizeof(*this);
+
+    // Raw rows are [filter byte][stride bytes], prev starts out as zeros for the first row
+    uint8_t* cur  = rows.get();
+    uint8_t* prev = rows.get() + stride + 1;
+    size_t fill   = 0;
+    int in_y      = 0;
+    bool ok       = true;
+
+    const auto finish_row = [&]() {
+        if (!unfilter(cur[0], cur + 1, prev + 1, stride, bpp)) {
+            return false;
+        }
+        if (reducer.wantsRow(in_y)) {
+            const uint8_t* px = cur + 1;
+            reducer.addRow([this, px](int x, uint32_t& r, uint32_t& g, uint32_t& b) { read_pixel(px, x, r, g, b); });
+        }
+        reducer.endRow(in_y++, sink);
+        std::swap(cur, prev);
+        return true;
+    };
+    tinfl_init(inflator.get());
+    size_t window_ofs   = 0;
+    uint32_t inflate_us = 0;
+    bool done           = false;
+    std::fseek(_file, _data_offset, SEEK_SET);
+    while (ok && !done) {
+        uint8_t chunk[8];
+        if (std::fread(chunk, 1, sizeof(chunk), _file) != sizeof(chunk) || std::memcmp(chunk + 4, "IDAT", 4) != 0) {
+            break;
+        }
+        uint32_t remaining = read_be32(chunk);
+        while (ok && !done && remaining > 0) {
+            size_t avail = std::fread(input.get(), 1, std::min<size_t>(remaining, kReadChunk), _file);
+            if (avail == 0) {
+                ok = false;
+                break;
+            }
+            remaining -= avail;
+
+            const uint8_t* in = input.get();
+            while (ok && !done) {
+                size_t in_bytes  = avail;
+                size_t produced  = window_bytes - window_ofs;
+                const int64_t t0 = esp_timer_get_time();
+                const tinfl_status status =
+                    tinfl_decompress(inflator.get(), in, &in_bytes, window.get(), window.get() + window_ofs, &produced,
+                                     TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+                inflate_us += static_cast<uint32_t>(esp_timer_get_time() - t0);
+                in += in_bytes;
+                avail -= in_bytes;
+
+                // Hand the inflated bytes over to the row assembler
+                const uint8_t* p = window.get() + window_ofs;
+                size_t n         = produced;
+                while (n > 0 && in_y < _height) {
+                    const size_t take = std::min(n, stride + 1 - fill);
+                    std::memcpy(cur + fill, p, take);
+                    fill += take;
+                    p += take;
+                    n -= take;
+                    if (fill == stride + 1) {
+                        fill = 0;
+                        if (!finish_row()) {
+                            ok = false;
+                            break;
+                        }
+                    }
+                }
+                window_ofs = (window_ofs + produced) & (window_bytes - 1);
+
+                if (status < TINFL_STATUS_DONE) {
+                    ok = false;
+                } else if (status == TINFL_STATUS_DONE || in_y >= _height) {
+                    done = true;
+                } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && avail == 0) {
+                    break;
+                }
+            }
+        }
+        if (!done) {
+            std::fseek(_file, remaining + 4, SEEK_CUR);
+        }
+    }
+
+    _stats.inflate_us = inflate_us;
+    _stats.total_us   = static_cast<uint32_t>(esp_timer_get_time() - start_us);
+    if (!ok || in_y < _height) {
+        mclog::tagWarn(_tag, "decode stopped at row {} of {}", in_y, _height);
+        return false;
+    }
+    return true;
+}
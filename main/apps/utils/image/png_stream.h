@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "image_decoder.h"
+
+/**
+ * Streaming PNG decoder that downsamples by an integer factor while it inflates
+ *
+ * Rows are inflated, unfiltered and folded into a BoxReducer as they arrive, so apart from the 32KB inflate window
+ * and two raw rows the decoder only holds one output row. Alpha is composited over black. Interlaced images are not
+ * supported, callers fall back to drawPngFile() for those.
+ */
+class PngStreamDecoder : public ImageDecoder {
+public:
+    ~PngStreamDecoder() override;
+
+    bool open(const char* path) override;
+    void close() override;
+    bool decode(int factor, const RowSink& sink) override;
+
+private:
+    std::FILE* _file       = nullptr;
+    uint8_t _bit_depth     = 0;
+    uint8_t _color_type    = 0;
+    uint8_t _channels      = 0;
+    uint16_t _palette_size = 0;
+    long _data_offset      = 0;
+    uint8_t _palette[256][4];
+
+    void read_pixel(const uint8_t* row, int x, uint32_t& r, uint32_t& g, uint32_t& b) const;
+};
@@ -0,0 +1,154 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "qoi_decoder.h"
+#include <esp_timer.h>
+#include <mooncake_log.h>
+#include <cstring>
+#include <memory>
+
+static const std::string _tag = "Qoi";
+
+static uint32_t read_be32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+QoiDecoder::~QoiDecoder()
+{
+    close();
+}
+
+void QoiDecoder::close()
+{
+    if (_file) {
+        std::fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool QoiDecoder::open(const char* path)
+{
+    close();
+    _file = std::fopen(path, "rb");
+    if (!_file) {
+        return false;
+    }
+
+    uint8_t head[kHeaderSize];
+    if (std::fread(head, 1, sizeof(head), _file) != sizeof(head) || std::memcmp(head, "qoif", 4) != 0) {
+        close();
+        return false;
+    }
+    const uint32_t w = read_be32(head + 4);
+    const uint32_t h = read_be32(head + 8);
+    _channels        = head[12];
+    if (w == 0 || h == 0 || w > kMaxSize || h > kMaxSize || (_channels != 3 && _channels != 4)) {
+        close();
+        return false;
+    }
+    _width  = static_cast<int>(w);
+    _height = static_cast<int>(h);
+    return true;
+}
+
+int QoiDecoder::read_byte()
+{
+    if (_buf_pos >= _buf_len) {
+        _buf_len = std::fread(_buf, 1, sizeof(_buf), _file);
+        _buf_pos = 0;
+        if (_buf_len == 0) {
+            return -1;
+        }
+    }
+    return _buf[_buf_pos++];
+}
+
+bool QoiDecoder::decode(int factor, const RowSink& sink)
+{
+    if (!_file || factor < 1) {
+        return false;
+    }
+    const int64_t start_us = esp_timer_get_time();
+    _stats                 = Stats_t{};
+
+    const size_t row_bytes = static_cast<size_t>(_width) * 3;
+    std::unique_ptr<uint8_t[]> row(new (std::nothrow) uint8_t[row_bytes]);
+    BoxReducer reducer;
+    if (!row || !reducer.begin(_width, _height, factor)) {
+        mclog::tagWarn(_tag, "alloc failed for {}x{}", _width, _height);
+        return false;
+    }
+    _stats.peak_bytes = row_bytes + reducer.bytes() + sizeof(*this);
+
+    std::fseek(_file, kHeaderSize, SEEK_SET);
+    _buf_len = 0;
+    _buf_pos = 0;
+
+    uint8_t index[64][4] = {};
+    uint8_t px[4]        = {0, 0, 0, 255};
+    int run              = 0;
+    // Every byte an op reads can be past the end of a cut off file
+    const auto truncated = [this](int y) {
+        mclog::tagWarn(_tag, "truncated at row {} of {}", y, _height);
+        return false;
+    };
+    for (int y = 0; y < _height; ++y) {
+        const bool keep = reducer.wantsRow(y);
+        uint8_t* out    = row.get();
+        for (int x = 0; x < _width; ++x) {
+            if (run > 0) {
+                run--;
+            } else {
+                const int op = read_byte();
+                if (op < 0) {
+                    return truncated(y);
+                }
+                if (op == 0xFE || op == 0xFF) {
+                    for (int i = 0; i < (op == 0xFF ? 4 : 3); ++i) {
+                        const int v = read_byte();
+                        if (v < 0) {
+                            return truncated(y);
+                        }
+                        px[i] = static_cast<uint8_t>(v);
+                    }
+                } else if ((op & 0xC0) == 0x00) {
+                    std::memcpy(px, index[op], 4);
+                } else if ((op & 0xC0) == 0x40) {
+                    px[0] += ((op >> 4) & 0x03) - 2;
+                    px[1] += ((op >> 2) & 0x03) - 2;
+                    px[2] += (op & 0x03) - 2;
+                } else if ((op & 0xC0) == 0x80) {
+                    const int next = read_byte();
+                    if (next < 0) {
+                        return truncated(y);
+                    }
+                    const int dg = (op & 0x3F) - 32;
+                    px[0] += dg - 8 + ((next >> 4) & 0x0F);
+                    px[1] += dg;
+                    px[2] += dg - 8 + (next & 0x0F);
+                } else {
+                    run = op & 0x3F;
+                }
+                std::memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 63], px, 4);
+            }
+            if (keep) {
+                const uint32_t a = _channels == 4 ? px[3] : 255;
+                out[0]           = static_cast<uint8_t>(px[0] * a / 255);
+                out[1]           = static_cast<uint8_t>(px[1] * a / 255);
+                out[2]           = static_cast<uint8_t>(px[2] * a / 255);
+                out += 3;
+            }
+        }
+        if (keep) {
+            reducer.addRowRgb888(row.get());
+        }
+        reducer.endRow(y, sink);
+    }
+
+    _stats.total_us = static_cast<uint32_t>(esp_timer_get_time() - start_us);
+    return true;
+}
@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "image_decoder.h"
+
+/**
+ * QOI decoder
+ *
+ * The format is one sequential op stream, every pixel has to be decoded, but only rows the BoxReducer samples are
+ * kept. Alpha is composited over black. M5GFX has no QOI support so there is no fallback for rejected files.
+ */
+class QoiDecoder : public ImageDecoder {
+public:
+    ~QoiDecoder() override;
+
+    bool open(const char* path) override;
+    void close() override;
+    bool decode(int factor, const RowSink& sink) override;
+
+private:
+    static constexpr size_t kHeaderSize = 14;
+    static constexpr size_t kReadChunk  = 2048;
+    static constexpr int kMaxSize       = 16384;
+
+    std::FILE* _file  = nullptr;
+    uint8_t _channels = 0;
+    uint8_t _buf[kReadChunk];
+    size_t _buf_len = 0;
+    size_t _buf_pos = 0;
+
+    int read_byte();
+};
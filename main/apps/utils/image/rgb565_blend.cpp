@@ -0,0 +1,77 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "rgb565_blend.h"
+#include <algorithm>
+#include <cstring>
+
+namespace rgb565 {
+
+// Green moved to the upper half leaves 5+ zero bits above every field, one multiply scales all three at once
+static constexpr uint32_t kSpreadMask = 0x07E0F81F;
+
+static inline uint32_t spread(uint16_t swapped)
+{
+    const uint32_t c = __builtin_bswap16(swapped);
+    return (c | (c << 16)) & kSpreadMask;
+}
+
+static inline uint16_t pack(uint32_t x)
+{
+    return __builtin_bswap16(static_cast<uint16_t>(x | (x >> 16)));
+}
+
+static inline uint16_t mix(uint16_t a, uint16_t b, uint32_t alpha)
+{
+    const uint32_t xa = spread(a);
+    const uint32_t xb = spread(b);
+    return pack((xa + (((xb - xa) * alpha) >> 5)) & kSpreadMask);
+}
+
+void blend(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t count, uint8_t alpha)
+{
+    if (alpha == 0) {
+        std::memmove(dst, a, count * sizeof(uint16_t));
+        return;
+    }
+    if (alpha >= kBlendMax) {
+        std::memmove(dst, b, count * sizeof(uint16_t));
+        return;
+    }
+
+    // Two pixels per iteration keeps the loads and the multiplies of both in flight
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const uint16_t a0 = a[i];
+        const uint16_t a1 = a[i + 1];
+        const uint16_t b0 = b[i];
+        const uint16_t b1 = b[i + 1];
+        dst[i]            = a0 == b0 ? a0 : mix(a0, b0, alpha);
+        dst[i + 1]        = a1 == b1 ? a1 : mix(a1, b1, alpha);
+    }
+    if (i < count) {
+        dst[i] = mix(a[i], b[i], alpha);
+    }
+}
+
+void wipe(uint16_t* dst, const uint16_t* a, const uint16_t* b, int w, int h, int stride, int edge, int feather)
+{
+    feather      = std::max(feather, 1);
+    const int x0 = std::clamp(edge - feather, 0, w);
+    const int x1 = std::clamp(edge, 0, w);
+    for (int y = 0; y < h; ++y) {
+        uint16_t* d        = dst + y * stride;
+        const uint16_t* ra = a + y * w;
+        const uint16_t* rb = b + y * w;
+        std::memcpy(d, rb, x0 * sizeof(uint16_t));
+        for (int x = x0; x < x1; ++x) {
+            // Fully b at edge - feather, fading to a at edge
+            d[x] = mix(ra[x], rb[x], static_cast<uint32_t>((edge - x) * kBlendMax / feather));
+        }
+        std::memcpy(d + x1, ra + x1, (w - x1) * sizeof(uint16_t));
+    }
+}
+
+}  // namespace rgb565
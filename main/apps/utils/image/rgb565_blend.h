@@ -0,0 +1,29 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Kernels compositing two frames of display order (swap565) pixels
+ *
+ * Alpha is 0..kBlendMax, 0 is all a and kBlendMax all b. 565 only keeps 5 bits of red and blue so finer steps would
+ * not show.
+ */
+namespace rgb565 {
+
+static constexpr uint8_t kBlendMax = 32;
+
+/** dst[i] = a[i] * (1 - alpha) + b[i] * alpha, dst may alias a or b */
+void blend(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t count, uint8_t alpha);
+
+/**
+ * Horizontal wipe of w x h frames with the given stride, columns left of edge come from b, the rest from a. A soft
+ * edge of feather columns is blended in between
+ */
+void wipe(uint16_t* dst, const uint16_t* a, const uint16_t* b, int w, int h, int stride, int edge, int feather);
+
+}  // namespace rgb565
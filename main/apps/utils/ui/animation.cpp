@@ -0,0 +1,137 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "animation.h"
+#include <cmath>
+
+namespace anim {
+
+static uint32_t _next_deadline = kNoDeadline;
+static uint32_t (*_get_tick)()  = nullptr;
+
+void setTickSource(uint32_t (*get_tick)())
+{
+    _get_tick = get_tick;
+}
+
+uint32_t now()
+{
+    return _get_tick ? _get_tick() : 0;
+}
+
+void requestFrame(uint32_t deadline_ms)
+{
+    if (deadline_ms < _next_deadline) {
+        _next_deadline = deadline_ms;
+    }
+}
+
+uint32_t takeNextDeadline()
+{
+    const uint32_t ret = _next_deadline;
+    _next_deadline     = kNoDeadline;
+    return ret;
+}
+
+float linear(float t)
+{
+    return t;
+}
+
+float easeOutCubic(float t)
+{
+    const float u = 1.0f - t;
+    return 1.0f - u * u * u;
+}
+
+float easeOutExpo(float t)
+{
+    return t >= 1.0f ? 1.0f : 1.0f - std::pow(2.0f, -10.0f * t);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Tween                                   */
+/* -------------------------------------------------------------------------- */
+void Tween::retarget(float target, uint32_t now)
+{
+    _from     = value(now);
+    _to       = target;
+    _start_ms = now;
+}
+
+void Tween::snap(float value)
+{
+    _from     = value;
+    _to       = value;
+    _start_ms = 0;
+}
+
+float Tween::value(uint32_t now) const
+{
+    const int32_t elapsed = static_cast<int32_t>(now - _start_ms);
+    if (elapsed <= 0) {
+        return _from;
+    }
+    if (_duration_ms == 0 || static_cast<uint32_t>(elapsed) >= _duration_ms || _from == _to) {
+        return _to;
+    }
+    const float t = static_cast<float>(elapsed) / _duration_ms;
+    return _from + (_to - _from) * _easing(t);
+}
+
+bool Tween::schedule(uint32_t now) const
+{
+    if (_from == _to || isDone(now)) {
+        return false;
+    }
+    requestFrame(now + kFrameIntervalMs);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Marquee                                  */
+/* -------------------------------------------------------------------------- */
+int Marquee::offset(uint32_t now) const
+{
+    if (_period_px <= 0 || _px_per_sec == 0) {
+        return 0;
+    }
+    const uint64_t px = static_cast<uint64_t>(now - _start_ms) * _px_per_sec / 1000;
+    const int wrapped = static_cast<int>(px % static_cast<uint64_t>(_period_px));
+    return wrapped - wrapped % _step_px;
+}
+
+bool Marquee::needsRedraw(uint32_t now)
+{
+    if (_period_px <= 0 || _px_per_sec == 0) {
+        return false;
+    }
+
+    // Time at which the travelled distance reaches the next step boundary
+    const uint64_t elapsed = now - _start_ms;
+    const uint64_t steps   = elapsed * _px_per_sec / 1000 / _step_px;
+    const uint64_t next    = ((steps + 1) * _step_px * 1000 + _px_per_sec - 1) / _px_per_sec;
+    requestFrame(_start_ms + static_cast<uint32_t>(next));
+
+    return offset(now) != _drawn_offset;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Timeout                                  */
+/* -------------------------------------------------------------------------- */
+bool Timeout::expired(uint32_t now)
+{
+    if (!_active) {
+        return false;
+    }
+    if (static_cast<int32_t>(now - _deadline_ms) >= 0) {
+        _active = false;
+        return true;
+    }
+    requestFrame(_deadline_ms);
+    return false;
+}
+
+}  // namespace anim
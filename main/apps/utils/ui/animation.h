@@ -0,0 +1,149 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstdint>
+
+/**
+ * Time based animations
+ *
+ * Everything is a pure function of millis(), so how fast something moves no longer depends on how often the app
+ * happens to redraw. While an animation is still running it registers the next time it needs a frame with
+ * requestFrame(), the main loop takes the earliest deadline with takeNextDeadline() and sleeps until then.
+ */
+namespace anim {
+
+using EasingFn = float (*)(float);
+
+static constexpr uint32_t kNoDeadline = UINT32_MAX;
+
+/** Frame interval while a tween is running, ~60 fps */
+static constexpr uint32_t kFrameIntervalMs = 16;
+
+/** Clock for code that isn't handed the time, set once at startup next to smooth_ui_toolkit's tick source */
+void setTickSource(uint32_t (*get_tick)());
+uint32_t now();
+
+/** Ask for a frame at or before deadline_ms, the earliest request wins */
+void requestFrame(uint32_t deadline_ms);
+
+/** Earliest requested deadline since the last call or kNoDeadline, resets the request */
+uint32_t takeNextDeadline();
+
+float linear(float t);
+float easeOutCubic(float t);
+float easeOutExpo(float t);
+
+/** Value moving from one point to another over a fixed duration */
+class Tween {
+public:
+    explicit Tween(uint32_t duration_ms = 200, EasingFn easing = easeOutExpo)
+        : _duration_ms(duration_ms), _easing(easing)
+    {
+    }
+
+    void setDuration(uint32_t duration_ms)
+    {
+        _duration_ms = duration_ms;
+    }
+    void setEasing(EasingFn easing)
+    {
+        _easing = easing;
+    }
+
+    /** Start from the current value towards target */
+    void retarget(float target, uint32_t now);
+    /** Jump to value with no animation */
+    void snap(float value);
+
+    float value(uint32_t now) const;
+    float target() const
+    {
+        return _to;
+    }
+    bool isDone(uint32_t now) const
+    {
+        return now - _start_ms >= _duration_ms;
+    }
+
+    /** Request the next frame if still running, returns true while running */
+    bool schedule(uint32_t now) const;
+
+private:
+    uint32_t _duration_ms;
+    EasingFn _easing;
+    uint32_t _start_ms = 0;
+    float _from        = 0.0f;
+    float _to          = 0.0f;
+};
+
+/**
+ * Constant speed scroll offset wrapping at period pixels, offsets move in steps of step_px so the redraw rate is
+ * speed / step_px no matter how often the app draws
+ */
+class Marquee {
+public:
+    explicit Marquee(uint32_t px_per_sec = 33, int step_px = 2) : _px_per_sec(px_per_sec), _step_px(step_px)
+    {
+    }
+
+    void restart(uint32_t now)
+    {
+        _start_ms = now;
+        _drawn_offset = -1;
+    }
+
+    /** Distance after which the offset wraps back to 0, 0 stops scrolling */
+    void setPeriod(int period_px)
+    {
+        _period_px = period_px;
+    }
+
+    int offset(uint32_t now) const;
+
+    /** Call after drawing with offset(now) */
+    void markDrawn(uint32_t now)
+    {
+        _drawn_offset = offset(now);
+    }
+
+    /** True if offset(now) moved since the last draw, also requests the frame of the next step */
+    bool needsRedraw(uint32_t now);
+
+private:
+    uint32_t _px_per_sec;
+    int _step_px;
+    uint32_t _start_ms = 0;
+    int _period_px     = 0;
+    int _drawn_offset  = -1;
+};
+
+/** One shot timer, the expiry is reported exactly once */
+class Timeout {
+public:
+    void start(uint32_t now, uint32_t duration_ms)
+    {
+        _deadline_ms = now + duration_ms;
+        _active      = true;
+    }
+    void cancel()
+    {
+        _active = false;
+    }
+
+    bool isActive(uint32_t now) const
+    {
+        return _active && static_cast<int32_t>(now - _deadline_ms) < 0;
+    }
+
+    /** True on the first call after the deadline, otherwise requests a frame at the deadline */
+    bool expired(uint32_t now);
+
+private:
+    uint32_t _deadline_ms = 0;
+    bool _active          = false;
+};
+
+}  // namespace anim
@@ -0,0 +1,316 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "glyph_cache.h"
+#include <algorithm>
+#include <cstring>
+
+GlyphCache::GlyphCache(const lgfx::IFont* font) : _font(font)
+{
+}
+
+GlyphCache& GetGlyphCache()
+{
+    static GlyphCache cache(&fonts::efontCN_12);
+    return cache;
+}
+
+void GlyphCache::clear()
+{
+    for (auto& slot : _slots) {
+        slot.used = false;
+    }
+    _count = 0;
+}
+
+uint32_t GlyphCache::decode_utf8(const char*& p, const char* end)
+{
+    const auto* s = reinterpret_cast<const uint8_t*>(p);
+    uint32_t cp   = s[0];
+    int extra     = 0;
+    if (cp < 0x80) {
+        extra = 0;
+    } else if ((cp & 0xE0) == 0xC0) {
+        cp &= 0x1F;
+        extra = 1;
+    } else if ((cp & 0xF0) == 0xE0) {
+        cp &= 0x0F;
+        extra = 2;
+    } else if ((cp & 0xF8) == 0xF0) {
+        cp &= 0x07;
+        extra = 3;
+    } else {
+        // Stray continuation byte, skip it
+        p += 1;
+        return 0;
+    }
+
+    if (extra >= end - p) {
+        p = end;
+        return 0;
+    }
+    for (int i = 1; i <= extra; ++i) {
+        if ((s[i] & 0xC0) != 0x80) {
+            p += i;
+            return 0;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    p += extra + 1;
+    return cp;
+}
+
+static size_t encode_utf8(uint32_t cp, char* out)
+{
+    if (cp < 0x80) {
+        out[0] = static_cast<char>(cp);
+        out[1] = 0;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = static_cast<char>(0xC0 | (cp >> 6));
+        out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+        out[2] = 0;
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = static_cast<char>(0xE0 | (cp >> 12));
+        out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+        out[3] = 0;
+        return 3;
+    }
+    out[0] = static_cast<char>(0xF0 | (cp >> 18));
+    out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+    out[4] = 0;
+    return 4;
+}
+
+bool GlyphCache::rasterize(uint32_t code_point, size_t slot)
+{
+    if (_scratch.width() == 0) {
+        _scratch.setColorDepth(1);
+        if (!_scratch.createSprite(kMaxGlyphW * 2, kMaxGlyphH)) {
+            return false;
+        }
+        _scratch.setFont(_font);
+        _scratch.setTextSize(1);
+        _scratch.setTextDatum(textdatum_t::top_left);
+        _scratch.setTextColor(TFT_WHITE, TFT_BLACK);
+        _font_h = _scratch.fontHeight();
+
+        lgfx::FontMetrics metrics;
+        _font->getDefaultMetric(&metrics);
+        _baseline = metrics.baseline;
+    }
+
+    char utf8[5];
+    encode_utf8(code_point, utf8);
+    const int w = _scratch.textWidth(utf8);
+    if (w <= 0 || w > kMaxGlyphW || _font_h > kMaxGlyphH) {
+        _slots[slot].code_point = code_point;
+        _slots[slot].width      = 0;
+        _slots[slot].used       = true;
+        _count++;
+        return false;
+    }
+
+    _scratch.fillScreen(TFT_BLACK);
+    _scratch.drawString(utf8, 0, 0);
+
+    // Pack into the MSB-first, byte-padded rows that drawBitmap() expects
+    uint8_t* bits        = _bitmaps[slot];
+    const int row_stride = (w + 7) / 8;
+    std::memset(bits, 0, kGlyphStride);
+    for (int y = 0; y < _font_h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            if (_scratch.readPixel(x, y) != 0) {
+                bits[y * row_stride + (x >> 3)] |= 0x80 >> (x & 7);
+            }
+        }
+    }
+
+    _slots[slot].code_point = code_point;
+    _slots[slot].width      = static_cast<uint8_t>(w);
+    _slots[slot].used       = true;
+    _count++;
+    return true;
+}
+
+int GlyphCache::lookup(uint32_t code_point)
+{
+    // Fibonacci hashing spreads the dense CJK ranges over the table
+    size_t idx = static_cast<size_t>((code_point * 2654435761u) >> 24) % kCapacity;
+    for (size_t probe = 0; probe < kCapacity; ++probe) {
+        auto& slot = _slots[idx];
+        if (!slot.used) {
+            break;
+        }
+        if (slot.code_point == code_point) {
+            _hits++;
+            return slot.width > 0 ? static_cast<int>(idx) : -1;
+        }
+        idx = (idx + 1) % kCapacity;
+    }
+
+    _misses++;
+    if (_count >= kMaxLoad) {
+        clear();
+        idx = static_cast<size_t>((code_point * 2654435761u) >> 24) % kCapacity;
+    }
+    while (_slots[idx].used) {
+        idx = (idx + 1) % kCapacity;
+    }
+    if (!rasterize(code_point, idx)) {
+        return -1;
+    }
+    return static_cast<int>(idx);
+}
+
+int GlyphCache::fontHeight()
+{
+    if (_font_h == 0) {
+        lookup(' ');
+    }
+    return _font_h;
+}
+
+int GlyphCache::textWidth(std::string_view text)
+{
+    int w         = 0;
+    const char* p = text.data();
+    const char* e = p + text.size();
+    while (p < e) {
+        const uint32_t cp = decode_utf8(p, e);
+        if (cp == 0) {
+            continue;
+        }
+        const int slot = lookup(cp);
+        if (slot >= 0) {
+            w += _slots[slot].width;
+        }
+    }
+    return w;
+}
+
+int GlyphCache::renderToBitmap(std::string_view text, uint8_t* dst, int dst_w, int dst_h, int x, int y)
+{
+    const int dst_stride = (dst_w + 7) / 8;
+    const char* p        = text.data();
+    const char* e        = p + text.size();
+    while (p < e && x < dst_w) {
+        const uint32_t cp = decode_utf8(p, e);
+        if (cp == 0) {
+            continue;
+        }
+        const int slot = lookup(cp);
+        if (slot < 0) {
+            continue;
+        }
+
+        const auto& glyph    = _slots[slot];
+        const uint8_t* src   = _bitmaps[slot];
+        const int src_stride = (glyph.width + 7) / 8;
+        for (int gy = 0; gy < _font_h; ++gy) {
+            const int dy = y + gy;
+            if (dy < 0 || dy >= dst_h) {
+                continue;
+            }
+            uint8_t* row = dst + dy * dst_stride;
+            for (int gx = 0; gx < glyph.width; ++gx) {
+                const int dx = x + gx;
+                if (dx < 0 || dx >= dst_w) {
+                    continue;
+                }
+                if (src[gy * src_stride + (gx >> 3)] & (0x80 >> (gx & 7))) {
+                    row[dx >> 3] |= 0x80 >> (dx & 7);
+                }
+            }
+        }
+        x += glyph.width;
+    }
+    return x;
+}
+
+bool GlyphCache::can_draw(LGFX_Sprite& canvas) const
+{
+    return canvas.getFont() == _font && canvas.getTextSizeX() == 1 && canvas.getTextSizeY() == 1;
+}
+
+void GlyphCache::drawString(LGFX_Sprite& canvas, std::string_view text, int x, int y, uint16_t fg, uint16_t bg)
+{
+    draw(canvas, text, x, y, fg, bg, true);
+}
+
+void GlyphCache::drawStringTransparent(LGFX_Sprite& canvas, std::string_view text, int x, int y, uint16_t fg)
+{
+    draw(canvas, text, x, y, fg, 0, false);
+}
+
+void GlyphCache::draw(LGFX_Sprite& canvas, std::string_view text, int x, int y, uint16_t fg, uint16_t bg,
+                      bool fill_bg)
+{
+    if (text.empty()) {
+        return;
+    }
+
+    if (fill_bg) {
+        canvas.setTextColor(fg, bg);
+    } else {
+        canvas.setTextColor(fg);
+    }
+
+    if (!can_draw(canvas) || fontHeight() == 0) {
+        char buffer[128];
+        const size_t n = std::min(text.size(), sizeof(buffer) - 1);
+        std::memcpy(buffer, text.data(), n);
+        buffer[n] = 0;
+        canvas.drawString(buffer, x, y);
+        return;
+    }
+
+    const uint8_t datum = static_cast<uint8_t>(canvas.getTextDatum());
+    if (datum & 0x03) {
+        const int w = textWidth(text);
+        x -= (datum & 0x01) ? w / 2 : w;
+    }
+    if (datum & 0x04) {
+        y -= _font_h / 2;
+    } else if (datum & 0x08) {
+        y -= _font_h;
+    } else if (datum & 0x10) {
+        y -= _baseline;
+    }
+
+    const char* p = text.data();
+    const char* e = p + text.size();
+    while (p < e) {
+        const uint32_t cp = decode_utf8(p, e);
+        if (cp == 0) {
+            continue;
+        }
+        const int slot = lookup(cp);
+        if (slot < 0) {
+            // Oversized glyph, let the font renderer handle this one
+            char utf8[5];
+            encode_utf8(cp, utf8);
+            const auto prev_datum = canvas.getTextDatum();
+            canvas.setTextDatum(textdatum_t::top_left);
+            x += canvas.drawString(utf8, x, y);
+            canvas.setTextDatum(prev_datum);
+            continue;
+        }
+
+        const auto& glyph = _slots[slot];
+        if (fill_bg) {
+            canvas.drawBitmap(x, y, _bitmaps[slot], glyph.width, _font_h, fg, bg);
+        } else {
+            canvas.drawBitmap(x, y, _bitmaps[slot], glyph.width, _font_h, fg);
+        }
+        x += glyph.width;
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <M5GFX.h>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Cache of pre-rasterized glyphs for one font
+ *
+ * Glyphs are rendered once into 1bpp bitmaps and kept in a fixed-size open-addressed table keyed by code point, so
+ * drawing a string becomes a handful of bitmap blits instead of a font table lookup and RLE decode per glyph. Glyphs
+ * too large to cache keep a slot of width 0, so they go to the font renderer without being rasterized again. When the
+ * table fills up it is flushed and refilled by whatever is on screen next.
+ */
+class GlyphCache {
+public:
+    static constexpr int kMaxGlyphW      = 16;
+    static constexpr int kMaxGlyphH      = 16;
+    static constexpr size_t kCapacity    = 256;
+    static constexpr size_t kMaxLoad     = kCapacity * 3 / 4;
+    static constexpr size_t kGlyphStride = ((kMaxGlyphW + 7) / 8) * kMaxGlyphH;
+
+    explicit GlyphCache(const lgfx::IFont* font);
+
+    /**
+     * Draw utf-8 text honoring the canvas text datum, falls back to canvas.drawString() when the canvas isn't using
+     * the cached font at text size 1
+     */
+    void drawString(LGFX_Sprite& canvas, std::string_view text, int x, int y, uint16_t fg, uint16_t bg);
+
+    /** Same as drawString() but leaves the glyph background untouched */
+    void drawStringTransparent(LGFX_Sprite& canvas, std::string_view text, int x, int y, uint16_t fg);
+
+    /**
+     * Render text into a 1bpp MSB-first bitmap with (dst_w + 7) / 8 bytes per row, (x, y) is the top left of the
+     * first glyph. Returns the x position after the last glyph
+     */
+    int renderToBitmap(std::string_view text, uint8_t* dst, int dst_w, int dst_h, int x, int y);
+
+    int textWidth(std::string_view text);
+    int fontHeight();
+    void clear();
+
+    const lgfx::IFont* font() const
+    {
+        return _font;
+    }
+    uint32_t hits() const
+    {
+        return _hits;
+    }
+    uint32_t misses() const
+    {
+        return _misses;
+    }
+
+private:
+    struct Slot_t {
+        uint32_t code_point = 0;
+        uint8_t width       = 0;  // 0 for a glyph that can't be cached
+        bool used           = false;
+    };
+
+    const lgfx::IFont* _font;
+    LGFX_Sprite _scratch;
+    int _font_h   = 0;
+    int _baseline = 0;
+    Slot_t _slots[kCapacity];
+    uint8_t _bitmaps[kCapacity][kGlyphStride];
+    size_t _count    = 0;
+    uint32_t _hits   = 0;
+    uint32_t _misses = 0;
+
+    bool can_draw(LGFX_Sprite& canvas) const;
+    void draw(LGFX_Sprite& canvas, std::string_view text, int x, int y, uint16_t fg, uint16_t bg, bool fill_bg);
+    int lookup(uint32_t code_point);
+    bool rasterize(uint32_t code_point, size_t slot);
+    static uint32_t decode_utf8(const char*& p, const char* end);
+};
+
+/** Shared cache for fonts::efontCN_12, the font used by every app */
+GlyphCache& GetGlyphCache();
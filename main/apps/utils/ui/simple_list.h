@@ -4,7 +4,11 @@
 #include <functional>
 #include <string>
 #include <cmath>
-#include <smooth_ui_toolkit.h>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "animation.h"
+#include "glyph_cache.h"
 
 struct SimpleListState {
     int selected_index = 0;
@@ -121,7 +125,7 @@ public:
             std::string label = label_fn ? label_fn(idx) : std::string();
 
             canvas.setClipRect(x, row_y, w, row_h);
-            canvas.drawString(label.c_str(), x + style.padding_x, row_y + row_h / 2);
+            GetGlyphCache().drawString(canvas, label.c_str(), x + style.padding_x, row_y + row_h / 2, row_fg, row_bg);
             canvas.clearClipRect();
         }
     }
@@ -129,30 +133,21 @@ public:
 
 class SmoothSimpleList {
 public:
-    SmoothSimpleList()
+    SmoothSimpleList() : _anim_idx(50), _anim_scroll(60)
     {
-        _anim_idx.init();
-        _anim_scroll.init();
-
-        auto& opt = _anim_idx.easingOptions();
-        opt.duration = 0.05f;
-        opt.easingFunction = smooth_ui_toolkit::ease::ease_out_expo;
-
-        auto& opt_s = _anim_scroll.easingOptions();
-        opt_s.duration = 0.06f;
-        opt_s.easingFunction = smooth_ui_toolkit::ease::ease_out_expo;
     }
 
     void update(uint32_t time_ms)
     {
-        float t = time_ms / 1000.0f;
-        _anim_idx.update(t);
-        _anim_scroll.update(t);
+        _now_ms = time_ms;
     }
 
+    /** Also requests the next frame from the main loop while the selection is still moving */
     bool isAnimating()
     {
-        return !_anim_idx.done() || !_anim_scroll.done();
+        const bool idx_running = _anim_idx.schedule(_now_ms);
+        const bool scroll_running = _anim_scroll.schedule(_now_ms);
+        return idx_running || scroll_running;
     }
 
     void go(int index, int item_count, int visible_rows)
@@ -175,36 +170,30 @@ public:
             if (target_scroll > max_scroll) target_scroll = max_scroll;
         }
 
-        _anim_idx.retarget(_anim_idx.value(), (float)index);
-        _anim_scroll.retarget(_anim_scroll.value(), (float)target_scroll);
-
-        _anim_idx.play();
-        _anim_scroll.play();
+        // Usually called from a key handler, so take the time now rather than from the last update()
+        _now_ms = anim::now();
+        _anim_idx.retarget((float)index, _now_ms);
+        _anim_scroll.retarget((float)target_scroll, _now_ms);
     }
     
     void jumpTo(int index, int item_count, int visible_rows) {
         go(index, item_count, visible_rows);
-        
-        // Calculate target scroll again to snap
-        int max_scroll = item_count - visible_rows;
-        if (max_scroll < 0) max_scroll = 0;
-        int target_scroll = 0;
-        if (item_count > visible_rows) {
-            target_scroll = _target_idx - visible_rows / 2;
-            if (target_scroll < 0) target_scroll = 0;
-            if (target_scroll > max_scroll) target_scroll = max_scroll;
-        }
-        float scroll_f = (float)target_scroll;
-        float idx_f = (float)_target_idx;
-        
-        _anim_idx.retarget(idx_f, idx_f);
-        _anim_scroll.retarget(scroll_f, scroll_f);
-        _anim_idx.complete();
-        _anim_scroll.complete();
+        _anim_idx.snap(_anim_idx.target());
+        _anim_scroll.snap(_anim_scroll.target());
     }
 
     int getSelectedIndex() const { return _target_idx; }
 
+    /**
+     * Label source, returns a view into caller-owned storage or into the scratch buffer. Only called when a row is not
+     * in the row cache, so it must not be relied on for side effects
+     */
+    using LabelFn = std::function<std::string_view(int idx, char* scratch, size_t scratch_size)>;
+
+    /**
+     * Rows are rendered once into 1bpp bitmaps keyed by index and label_version, then blitted with the normal or
+     * highlight colors, so scrolling never re-renders text. Bump label_version whenever any label may have changed
+     */
     void draw(
         LGFX_Sprite& canvas,
         int x,
@@ -212,7 +201,8 @@ public:
         int w,
         int h,
         int item_count,
-        const std::function<std::string(int)>& label_fn,
+        uint32_t label_version,
+        const LabelFn& label_fn,
         const SimpleListStyle& style)
     {
         canvas.fillRect(x, y, w, h, style.bg_color);
@@ -221,8 +211,13 @@ public:
         const int row_h = SimpleList::rowHeight(canvas);
         const int visible_rows_count = h / row_h + 2; 
 
-        float cur_scroll = _anim_scroll.value();
-        float cur_idx = _anim_idx.value();
+        float cur_scroll = _anim_scroll.value(_now_ms);
+        float cur_idx = _anim_idx.value(_now_ms);
+
+        const bool use_row_cache = canvas.getFont() == GetGlyphCache().font() && canvas.getTextSizeX() == 1;
+        if (use_row_cache) {
+            prepareRowCache(w, row_h, style.padding_x, label_version);
+        }
 
         // 1. Draw all items in normal color
         int start_idx = (int)std::floor(cur_scroll);
@@ -239,8 +234,8 @@ public:
             float item_y = y + (i - cur_scroll) * row_h;
             if (item_y + row_h <= y || item_y >= y + h) continue;
 
-            std::string label = label_fn(i);
-            canvas.drawString(label.c_str(), x + style.padding_x, (int)(item_y + row_h / 2));
+            drawRow(canvas, i, x, item_y, w, row_h, use_row_cache, label_fn, style.padding_x, style.text_color,
+                    style.bg_color);
         }
 
         // 2. Draw Highlight and selected text
@@ -264,16 +259,91 @@ public:
                 float item_y = y + (i - cur_scroll) * row_h;
                 if (item_y + row_h < hl_y || item_y > hl_y + hl_h) continue;
 
-                std::string label = label_fn(i);
-                canvas.drawString(label.c_str(), x + style.padding_x, (int)(item_y + row_h / 2));
+                drawRow(canvas, i, x, item_y, w, row_h, use_row_cache, label_fn, style.padding_x,
+                        style.selected_text_color, style.selected_bg_color);
             }
         }
         canvas.clearClipRect();
     }
 
 private:
-    smooth_ui_toolkit::Animate _anim_idx;
-    smooth_ui_toolkit::Animate _anim_scroll;
+    static constexpr int kRowCacheSize = 16;
+    static constexpr size_t kLabelScratchSize = 128;
+
+    struct RowCacheEntry {
+        int index = -1;
+    };
+
+    anim::Tween _anim_idx;
+    anim::Tween _anim_scroll;
+    uint32_t _now_ms = 0;
     int _target_idx = 0;
+
+    std::vector<uint8_t> _row_bits;
+    RowCacheEntry _rows[kRowCacheSize];
+    int _row_w = 0;
+    int _row_h = 0;
+    int _row_pad = 0;
+    uint32_t _row_version = 0;
+    char _label_scratch[kLabelScratchSize];
+
+    void prepareRowCache(int w, int row_h, int pad, uint32_t label_version)
+    {
+        if (w != _row_w || row_h != _row_h || pad != _row_pad) {
+            _row_w = w;
+            _row_h = row_h;
+            _row_pad = pad;
+            _row_bits.assign(kRowCacheSize * rowBytes(), 0);
+            invalidateRows();
+        }
+        if (label_version != _row_version) {
+            _row_version = label_version;
+            invalidateRows();
+        }
+    }
+
+    void invalidateRows()
+    {
+        for (auto& r : _rows) {
+            r.index = -1;
+        }
+    }
+
+    size_t rowBytes() const
+    {
+        return static_cast<size_t>((_row_w + 7) / 8) * _row_h;
+    }
+
+    const uint8_t* rowBitmap(int idx, const LabelFn& label_fn)
+    {
+        const int slot = idx % kRowCacheSize;
+        uint8_t* bits = _row_bits.data() + slot * rowBytes();
+        if (_rows[slot].index == idx) {
+            return bits;
+        }
+
+        std::memset(bits, 0, rowBytes());
+        if (label_fn) {
+            auto& glyphs = GetGlyphCache();
+            const std::string_view label = label_fn(idx, _label_scratch, sizeof(_label_scratch));
+            glyphs.renderToBitmap(label, bits, _row_w, _row_h, _row_pad, _row_h / 2 - glyphs.fontHeight() / 2);
+        }
+        _rows[slot].index = idx;
+        return bits;
+    }
+
+    void drawRow(LGFX_Sprite& canvas, int idx, int x, float item_y, int w, int row_h, bool use_row_cache,
+                 const LabelFn& label_fn, int pad, uint16_t fg, uint16_t bg)
+    {
+        const int text_y = (int)(item_y + row_h / 2);
+        if (use_row_cache) {
+            canvas.drawBitmap(x, text_y - row_h / 2, rowBitmap(idx, label_fn), w, row_h, fg, bg);
+            return;
+        }
+        if (label_fn) {
+            const std::string_view label = label_fn(idx, _label_scratch, sizeof(_label_scratch));
+            GetGlyphCache().drawString(canvas, label, x + pad, text_y, fg, bg);
+        }
+    }
 };
 
@@ -6,13 +6,21 @@
 #include "hal.h"
 #include "hal_config.h"
 #include <apps/utils/audio/audio.h>
+#include <apps/utils/audio/audio_mixer.h>
 #include <mooncake_log.h>
 #include <M5Unified.hpp>
 #include <esp_mac.h>
 #include <memory>
+#include <algorithm>
+#include <cstring>
 
 static std::unique_ptr<Hal> _hal_instance;
 static const std::string _tag = "HAL";
+static AudioMixer _mixer;
+
+Hal::Hal() : mixer(_mixer)
+{
+}
 
 Hal& GetHAL()
 {
@@ -29,14 +37,7 @@ void Hal::init()
 
     M5.begin();
     M5.Display.setBrightness(0);
-    {
-        auto cfg = M5.Speaker.config();
-        if (cfg.dma_buf_len < 512) cfg.dma_buf_len = 512;
-        if (cfg.dma_buf_count < 16) cfg.dma_buf_count = 16;
-        if (cfg.task_priority < 4) cfg.task_priority = 4;
-        M5.Speaker.config(cfg);
-    }
-    M5.Speaker.begin();  // Codec takes some time to initialize
+    audio_init();  // Codec takes some time to initialize
 
     display_init();
     i2c_scan();
@@ -49,8 +50,17 @@ void Hal::init()
 void Hal::update()
 {
     M5.update();
-    keyboard.update();
+    {
+        profiler::ScopedMarker marker(profiler::Marker::KeyDispatch);
+        keyboard.update();
+    }
     capLora868.update();
+
+    const std::uint32_t sd_card_generation = _sd_card_generation;
+    if (sd_card_generation != _sd_card_event_generation) {
+        _sd_card_event_generation = sd_card_generation;
+        onSdCardEvent.emit({_is_sd_card_mounted});
+    }
 }
 
 void Hal::feedTheDog()
@@ -58,6 +68,21 @@ void Hal::feedTheDog()
     vTaskDelay(1);
 }
 
+void Hal::idleUntil(std::uint32_t deadline_ms)
+{
+    std::uint32_t wait_ms = kMaxIdleMs;
+    if (deadline_ms != UINT32_MAX) {
+        const int32_t remain = static_cast<int32_t>(deadline_ms - millis());
+        wait_ms              = remain > 0 ? std::min(static_cast<std::uint32_t>(remain), kMaxIdleMs) : 0;
+    }
+
+    if (wait_ms == 0 || keyboard.hasPendingEvents()) {
+        feedTheDog();
+        return;
+    }
+    keyboard.waitForEvent(wait_ms);
+}
+
 std::vector<uint8_t> Hal::getDeviceMac()
 {
     std::vector<uint8_t> mac(6);
@@ -142,6 +167,121 @@ void Hal::keyboard_init()
     }
 }
 
+/* -------------------------------------------------------------------------- */
+/*                                    Audio                                   */
+/* -------------------------------------------------------------------------- */
+#include <driver/i2s_std.h>
+
+static constexpr uint8_t kEs8311Addr     = 0x18;
+static constexpr uint32_t kEs8311I2cFreq = 400000;
+static constexpr uint32_t kAudioRate     = 48000;
+static i2s_chan_handle_t _i2s_tx         = nullptr;
+static i2s_chan_handle_t _i2s_rx         = nullptr;
+
+// The mixer task's output, blocks on the DMA which is what paces the mixer
+static bool _i2s_write(const int16_t* frames, size_t count, void* /*ctx*/)
+{
+    size_t written = 0;
+    return i2s_channel_write(_i2s_tx, frames, count * 2 * sizeof(int16_t), &written, portMAX_DELAY) == ESP_OK;
+}
+
+static bool _es8311_init()
+{
+    if (!M5.In_I2C.isEnabled() || !M5.In_I2C.scanID(kEs8311Addr, kEs8311I2cFreq)) {
+        mclog::tagError(_tag, "ES8311 not found");
+        return false;
+    }
+
+    // Clocked from BCLK, no MCLK line: 256 fs from 32 fs times 8, which holds for any rate. DAC at 0 dB, the level is
+    // set digitally by the mixer
+    static constexpr uint8_t regs[][2] = {
+        {0x00, 0x80}, {0x01, 0xBF}, {0x02, 0x18}, {0x0D, 0x01}, {0x0E, 0x02}, {0x14, 0x10},
+        {0x17, 0xBF}, {0x1C, 0x6A}, {0x12, 0x00}, {0x13, 0x10}, {0x32, 0xBF}, {0x37, 0x08},
+    };
+    for (const auto& r : regs) {
+        if (!M5.In_I2C.writeRegister8(kEs8311Addr, r[0], r[1], kEs8311I2cFreq)) {
+            mclog::tagError(_tag, "ES8311 write fail: reg=0x{:02X} val=0x{:02X}", r[0], r[1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool _i2s_init()
+{
+    // Full duplex, playback and capture share the clocks. Four 256 frame descriptors, about 21 ms queued at 48 kHz
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_1, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num      = 4;
+    chan_cfg.dma_frame_num     = AudioMixer::kBlockFrames;
+    chan_cfg.auto_clear        = true;
+    if (i2s_new_channel(&chan_cfg, &_i2s_tx, &_i2s_rx) != ESP_OK) {
+        mclog::tagError(_tag, "i2s new channel failed");
+        return false;
+    }
+
+    i2s_std_config_t tx_cfg;
+    std::memset(&tx_cfg, 0, sizeof(tx_cfg));
+    tx_cfg.clk_cfg.clk_src          = I2S_CLK_SRC_PLL_160M;
+    tx_cfg.clk_cfg.sample_rate_hz   = kAudioRate;
+    tx_cfg.clk_cfg.mclk_multiple    = I2S_MCLK_MULTIPLE_128;
+    tx_cfg.slot_cfg.data_bit_width  = I2S_DATA_BIT_WIDTH_16BIT;
+    tx_cfg.slot_cfg.slot_bit_width  = I2S_SLOT_BIT_WIDTH_16BIT;
+    tx_cfg.slot_cfg.slot_mode       = I2S_SLOT_MODE_STEREO;
+    tx_cfg.slot_cfg.slot_mask       = I2S_STD_SLOT_BOTH;
+    tx_cfg.slot_cfg.ws_width        = 16;
+    tx_cfg.slot_cfg.ws_pol          = false;
+    tx_cfg.slot_cfg.bit_shift       = true;
+    tx_cfg.slot_cfg.left_align      = true;
+    tx_cfg.slot_cfg.big_endian      = false;
+    tx_cfg.slot_cfg.bit_order_lsb   = false;
+    tx_cfg.gpio_cfg.bclk            = HAL_PIN_I2S_BCLK;
+    tx_cfg.gpio_cfg.ws              = HAL_PIN_I2S_WS;
+    tx_cfg.gpio_cfg.dout            = HAL_PIN_I2S_DOUT;
+    tx_cfg.gpio_cfg.din             = GPIO_NUM_NC;
+    tx_cfg.gpio_cfg.mclk            = GPIO_NUM_NC;
+    i2s_std_config_t rx_cfg         = tx_cfg;
+    rx_cfg.gpio_cfg.dout            = GPIO_NUM_NC;
+    rx_cfg.gpio_cfg.din             = HAL_PIN_I2S_DIN;
+
+    if (i2s_channel_init_std_mode(_i2s_tx, &tx_cfg) != ESP_OK || i2s_channel_init_std_mode(_i2s_rx, &rx_cfg) != ESP_OK ||
+        i2s_channel_enable(_i2s_tx) != ESP_OK || i2s_channel_enable(_i2s_rx) != ESP_OK) {
+        mclog::tagError(_tag, "i2s init failed");
+        i2s_del_channel(_i2s_tx);
+        i2s_del_channel(_i2s_rx);
+        _i2s_tx = nullptr;
+        _i2s_rx = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Hal::audio_init()
+{
+    mclog::tagInfo(_tag, "audio init");
+
+    if (!_es8311_init() || !_i2s_init()) {
+        return;
+    }
+
+    AudioMixer::Output_t output;
+    output.sample_rate = kAudioRate;
+    output.write       = _i2s_write;
+    if (!mixer.begin(output)) {
+        mclog::tagError(_tag, "mixer start failed");
+    }
+}
+
+size_t Hal::micRead(int16_t* frames, size_t count, std::uint32_t timeout_ms)
+{
+    if (_i2s_rx == nullptr) {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        return 0;
+    }
+    size_t bytes = 0;
+    i2s_channel_read(_i2s_rx, frames, count * 2 * sizeof(int16_t), &bytes, pdMS_TO_TICKS(timeout_ms));
+    return bytes / (2 * sizeof(int16_t));
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                    WiFI                                    */
 /* -------------------------------------------------------------------------- */
@@ -718,53 +858,176 @@ void Hal::sd_card_init()
 {
     mclog::tagInfo(_tag, "sd card init");
 
+    if (!_sd_card_lock) {
+        _sd_card_lock = xSemaphoreCreateRecursiveMutex();
+    }
     if (!_spi_bus_initialized) {
         spi_init();
     }
 
+    xSemaphoreTakeRecursive(_sd_card_lock, portMAX_DELAY);
     // If already mounted successfully, return
     if (_is_sd_card_mounted) {
         mclog::tagInfo(_tag, "sd card already mounted");
-        return;
+    } else if (sd_card_mount(true)) {
+        mclog::tagInfo(_tag, "filesystem mounted successfully");
+        sdmmc_card_print_info(stdout, _sd_card);
+    } else {
+        // Don't clean up SPI bus on failure - leave it for retry
+        mclog::tagInfo(_tag, "sd card init failed, but spi bus remains initialized for retry");
     }
+    xSemaphoreGiveRecursive(_sd_card_lock);
 
-    esp_err_t ret;
+    sd_card_monitor_start();
+}
 
+bool Hal::sd_card_mount(bool verbose)
+{
     sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-    host.max_freq_khz = 40000;
+    host.max_freq_khz = _sd_card_freq_khz;
 
     // Options for mounting the filesystem
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
         .format_if_mount_failed = false, .max_files = 5, .allocation_unit_size = 16 * 1024};
 
-    const char mount_point[] = MOUNT_POINT;
-    mclog::tagInfo(_tag, "initializing SD card");
-
     // Initialize SD card slot
     sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
     slot_config.gpio_cs               = HAL_PIN_SD_CARD_CS;
     slot_config.host_id               = (spi_host_device_t)host.slot;
 
-    mclog::tagInfo(_tag, "mounting filesystem");
-    ret = esp_vfs_fat_sdspi_mount(mount_point, &host, &slot_config, &mount_config, &_sd_card);
-
+    esp_err_t ret = esp_vfs_fat_sdspi_mount(MOUNT_POINT, &host, &slot_config, &mount_config, &_sd_card);
     if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
+        if (!verbose) {
+            // The monitor retries every few seconds while no card is in
+        } else if (ret == ESP_FAIL) {
             mclog::tagError(_tag, "failed to mount filesystem");
         } else {
             mclog::tagError(_tag, "failed to initialize the card, make sure SD card lines have pull-up resistors");
         }
+        _sd_card = nullptr;
+        return false;
+    }
+    _is_sd_card_mounted = true;
+    return true;
+}
 
-        // Don't clean up SPI bus on failure - leave it for retry
-        mclog::tagInfo(_tag, "sd card init failed, but spi bus remains initialized for retry");
+void Hal::sd_card_unmount()
+{
+    if (!_is_sd_card_mounted) {
+        return;
+    }
+    // Cleared first so isSdCardMounted() callers stop starting new I/O
+    _is_sd_card_mounted = false;
+    esp_vfs_fat_sdcard_unmount(MOUNT_POINT, _sd_card);
+    _sd_card = nullptr;
+}
+
+/*
+ * There is no card detect pin, so the monitor asks the card itself. While mounted it sends CMD13 (sdmmc_get_status)
+ * every kSdPollMs, a failure is re-checked every kSdRecheckMs and only kSdRemovedAfter failures in a row unmount, a
+ * busy or glitching bus doesn't. While unmounted it tries a mount every kSdRetryMs, then waits kSdSettleMs for the
+ * contacts of a card that is still being pushed in and checks once more before announcing it.
+ *
+ * Mounting can take a few hundred ms, the UI loop never waits on it. It only sees the generation change in update()
+ * and emits onSdCardEvent from there
+ */
+static constexpr std::uint32_t kSdPollMs    = 1000;
+static constexpr std::uint32_t kSdRecheckMs = 100;
+static constexpr std::uint32_t kSdRetryMs   = 2000;
+static constexpr std::uint32_t kSdSettleMs  = 300;
+static constexpr int kSdRemovedAfter        = 3;
+static TaskHandle_t _sd_card_monitor_task   = nullptr;
+
+void Hal::sd_card_monitor_start()
+{
+    if (_sd_card_monitor_task) {
         return;
     }
+    xTaskCreatePinnedToCore(sd_card_monitor_task, "sdmon", 4096, this, 1, &_sd_card_monitor_task, 0);
+}
 
-    mclog::tagInfo(_tag, "filesystem mounted successfully");
+void Hal::sd_card_monitor_task(void* arg)
+{
+    auto* hal    = static_cast<Hal*>(arg);
+    int failures = 0;
+
+    while (true) {
+        if (hal->_is_sd_card_mounted) {
+            vTaskDelay(pdMS_TO_TICKS(failures > 0 ? kSdRecheckMs : kSdPollMs));
+
+            xSemaphoreTakeRecursive(hal->_sd_card_lock, portMAX_DELAY);
+            // Might have been remounted by setSdCardFrequency() in between
+            if (hal->_is_sd_card_mounted) {
+                if (sdmmc_get_status(_sd_card) == ESP_OK) {
+                    failures = 0;
+                } else if (++failures >= kSdRemovedAfter) {
+                    mclog::tagWarn(_tag, "sd card removed");
+                    hal->sd_card_unmount();
+                    hal->_sd_card_generation++;
+                    failures = 0;
+                }
+            }
+            xSemaphoreGiveRecursive(hal->_sd_card_lock);
+            continue;
+        }
 
-    sdmmc_card_print_info(stdout, _sd_card);
+        vTaskDelay(pdMS_TO_TICKS(kSdRetryMs));
 
-    _is_sd_card_mounted = true;
+        xSemaphoreTakeRecursive(hal->_sd_card_lock, portMAX_DELAY);
+        if (!hal->_is_sd_card_mounted && hal->sd_card_mount(false)) {
+            xSemaphoreGiveRecursive(hal->_sd_card_lock);
+            vTaskDelay(pdMS_TO_TICKS(kSdSettleMs));
+            xSemaphoreTakeRecursive(hal->_sd_card_lock, portMAX_DELAY);
+
+            if (!hal->_is_sd_card_mounted) {
+                // Unmounted by someone else while settling
+            } else if (sdmmc_get_status(_sd_card) == ESP_OK) {
+                mclog::tagInfo(_tag, "sd card inserted");
+                sdmmc_card_print_info(stdout, _sd_card);
+                hal->_sd_card_generation++;
+            } else {
+                hal->sd_card_unmount();
+            }
+        }
+        xSemaphoreGiveRecursive(hal->_sd_card_lock);
+    }
+}
+
+bool Hal::setSdCardFrequency(std::uint32_t freq_khz)
+{
+    mclog::tagInfo(_tag, "sd card frequency: {} kHz", freq_khz);
+
+    xSemaphoreTakeRecursive(_sd_card_lock, portMAX_DELAY);
+    const bool was_mounted = _is_sd_card_mounted;
+    sd_card_unmount();
+    _sd_card_freq_khz = freq_khz;
+    const bool mounted = sd_card_mount(true);
+    xSemaphoreGiveRecursive(_sd_card_lock);
+
+    // Open files and listings are gone either way
+    if (was_mounted || mounted) {
+        _sd_card_generation++;
+    }
+    return mounted;
+}
+
+std::uint32_t Hal::getSdCardFrequency() const
+{
+    return _is_sd_card_mounted && _sd_card ? static_cast<std::uint32_t>(_sd_card->real_freq_khz) : 0;
+}
+
+std::uint32_t Hal::getSdCardClusterSize()
+{
+    if (!_is_sd_card_mounted || !_sd_card) {
+        return 0;
+    }
+    // The card is the only FAT volume, registered as drive 0
+    FATFS* fs          = nullptr;
+    DWORD free_cluster = 0;
+    if (f_getfree("0:", &free_cluster, &fs) != FR_OK || !fs) {
+        return 0;
+    }
+    return static_cast<std::uint32_t>(fs->csize) * _sd_card->csd.sector_size;
 }
 
 Hal::SdCardProbeResult_t Hal::sdCardProbe()
@@ -773,11 +1036,14 @@ Hal::SdCardProbeResult_t Hal::sdCardProbe()
 
     if (!_is_sd_card_mounted) {
         sd_card_init();
-        if (!_is_sd_card_mounted) {
-            result.is_mounted = false;
-            result.size       = "Not Found";
-            return result;
-        }
+    }
+    // Keeps the monitor from unmounting under the card info
+    xSemaphoreTakeRecursive(_sd_card_lock, portMAX_DELAY);
+    if (!_is_sd_card_mounted) {
+        xSemaphoreGiveRecursive(_sd_card_lock);
+        result.is_mounted = false;
+        result.size       = "Not Found";
+        return result;
     }
 
     result.is_mounted = true;
@@ -805,6 +1071,7 @@ Hal::SdCardProbeResult_t Hal::sdCardProbe()
     }
 
     result.name = fmt::format("Name: {}", std::string(_sd_card->cid.name));
+    xSemaphoreGiveRecursive(_sd_card_lock);
 
     return result;
 }
@@ -7,15 +7,23 @@
 #include "keyboard/keyboard.h"
 #include "cap_lora868/cap_lora868.h"
 #include "utils/settings/settings.h"
+#include "utils/profiler/profiler.h"
 #include <M5Unified.hpp>
 #include <M5GFX.h>
+#include <mooncake_log_signal.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <atomic>
 #include <memory>
 #include <cstdint>
 #include <string>
 #include <vector>
 
+class AudioMixer;
+
 class Hal {
 public:
+    Hal();
     void init();
     void update();
 
@@ -29,6 +37,14 @@ public:
         return m5gfx::millis();
     }
     void feedTheDog();
+
+    /**
+     * Sleep until deadline_ms (UINT32_MAX for none) or a key interrupt. Capped at kMaxIdleMs so polled state like the
+     * home button and player status stays responsive, and always yields at least one tick to feed the watchdog
+     */
+    static constexpr std::uint32_t kMaxIdleMs = 20;
+    void idleUntil(std::uint32_t deadline_ms);
+
     std::vector<uint8_t> getDeviceMac();
     std::string getDeviceMacString();
 
@@ -39,11 +55,16 @@ public:
 
     inline void pushStatusBar()
     {
+        profiler::ScopedMarker marker(profiler::Marker::Push);
+        profiler::addPushBytes(canvasSystemBar.bufferLength());
         canvasSystemBar.pushSprite(0, 0);
     }
     inline void pushAppCanvas()
     {
+        profiler::ScopedMarker marker(profiler::Marker::Push);
+        profiler::addPushBytes(canvas.bufferLength());
         canvas.pushSprite(0, 21);
+        profiler::pushOverlay(&display, 0, 21, canvas.width());
     }
     inline void pushCanvas()
     {
@@ -51,8 +72,14 @@ public:
     }
 
     /* ---------------------------------- Audio --------------------------------- */
-    m5::Speaker_Class& speaker = M5.Speaker;
-    m5::Mic_Class& mic         = M5.Mic;
+    /** Owns the speaker, every sound is a stream of it. Lives in the apps, include its header to use it */
+    AudioMixer& mixer;
+
+    /**
+     * Mic capture, interleaved stereo at mixer.sampleRate() from the same full duplex I2S the mixer plays on. Blocks
+     * up to timeout_ms for count frames, returns how many it got. One reader at a time
+     */
+    size_t micRead(int16_t* frames, size_t count, std::uint32_t timeout_ms);
 
     /* ---------------------------------- Input --------------------------------- */
     m5::Button_Class& homeButton = M5.BtnA;
@@ -118,11 +145,28 @@ public:
         }
     };
 
+    /** Emitted on the UI loop once the card was mounted or unmounted, anything read from it before may be stale */
+    struct SdCardEvent_t {
+        bool mounted = false;
+    };
+    mclog::Signal<const SdCardEvent_t&> onSdCardEvent;
+
     SdCardProbeResult_t sdCardProbe();
     bool isSdCardMounted() const
     {
         return _is_sd_card_mounted;
     }
+    const char* getSdCardMountPoint() const
+    {
+        return "/sdcard";
+    }
+
+    /** Remount the card with the SPI clock capped at freq_khz, blocks for the remount so keep it off the UI loop */
+    bool setSdCardFrequency(std::uint32_t freq_khz);
+    /** Clock the card actually runs at, 0 if it isn't mounted */
+    std::uint32_t getSdCardFrequency() const;
+    /** Bytes per FAT cluster, 0 if unknown. May scan the FAT the first time, keep it off the UI loop */
+    std::uint32_t getSdCardClusterSize();
 
     /* ----------------------------------- Cap ---------------------------------- */
     CapLoRa868 capLora868;
@@ -135,19 +179,30 @@ private:
     bool _is_ir_inited              = false;
     bool _is_ble_keyboard_inited    = false;
     bool _is_usb_keyboard_inited    = false;
-    bool _is_sd_card_mounted        = false;
+    std::uint32_t _sd_card_freq_khz = 40000;
     int _ble_keyboard_event_slot_id = -1;
     int _usb_keyboard_event_slot_id = -1;
     std::unique_ptr<CapLoRa868> _cap_lora868;
 
+    // Written by the card monitor task, every mount or unmount bumps the generation and update() emits onSdCardEvent
+    std::atomic<bool> _is_sd_card_mounted{false};
+    std::atomic<std::uint32_t> _sd_card_generation{0};
+    std::uint32_t _sd_card_event_generation = 0;
+    SemaphoreHandle_t _sd_card_lock         = nullptr;
+
     void display_init();
     void i2c_scan();
     void keyboard_init();
+    void audio_init();
     void start_sntp();
     void stop_sntp();
     void setting_init();
     void spi_init();
     void sd_card_init();
+    bool sd_card_mount(bool verbose);
+    void sd_card_unmount();
+    void sd_card_monitor_start();
+    static void sd_card_monitor_task(void* arg);
     void handle_ble_keyboard_event(const Keyboard::KeyEvent_t& keyEvent);
     void handle_usb_keyboard_event(const Keyboard::KeyEvent_t& keyEvent);
 };
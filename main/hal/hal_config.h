@@ -7,6 +7,10 @@
 
 #define HAL_PIN_KEYBOARD_INT   11
 #define HAL_PIN_IR_TX          44
+#define HAL_PIN_I2S_BCLK       GPIO_NUM_41
+#define HAL_PIN_I2S_WS         GPIO_NUM_43
+#define HAL_PIN_I2S_DOUT       GPIO_NUM_42
+#define HAL_PIN_I2S_DIN        GPIO_NUM_46
 #define HAL_PIN_SPI_MISO       GPIO_NUM_39
 #define HAL_PIN_SPI_MOSI       GPIO_NUM_14
 #define HAL_PIN_SPI_SCLK       GPIO_NUM_40
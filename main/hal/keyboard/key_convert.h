@@ -0,0 +1,65 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include "key_value_map.h"
+#include <cstdint>
+
+// Modifier tracking and key event conversion on the remapped matrix, shared with the host simulator
+namespace key_convert {
+
+/** Track ctrl and shift in modifier_mask and the held state of caps lock from a raw event at (row, col) */
+inline void updateModifierMask(uint8_t row, uint8_t col, bool state, uint8_t& modifier_mask, bool& capslock_state)
+{
+    // Check control key (3, 0)
+    if (row == 3 && col == 0) {
+        if (state) {
+            modifier_mask |= KEY_MOD_LCTRL;
+        } else {
+            modifier_mask &= ~KEY_MOD_LCTRL;
+        }
+    }
+
+    // Check shift key (2, 0)
+    if (row == 2 && col == 0) {
+        if (state) {
+            modifier_mask |= KEY_MOD_LSHIFT;
+        } else {
+            modifier_mask &= ~KEY_MOD_LSHIFT;
+        }
+    }
+
+    // Check capslock key (2, 1)
+    if (row == 2 && col == 1) {
+        capslock_state = state;
+    }
+}
+
+/** Key event of a raw event, capslock is held or locked */
+template <typename KeyEvent, typename KeyEventRaw>
+KeyEvent toKeyEvent(const KeyEventRaw& key, uint8_t modifier_mask, bool capslock)
+{
+    KeyEvent ret;
+    ret.state = key.state;
+
+    // For letters: use shift/caps lock to determine case
+    // For special characters: use shift to determine which symbol
+    const KeyValue_t& value = _key_value_map[key.row][key.col];
+    const bool is_letter    = value.firstKeyCode >= KEY_A && value.firstKeyCode <= KEY_Z;
+    const bool use_shifted  = (modifier_mask & KEY_MOD_LSHIFT) || (is_letter && capslock);
+
+    if (use_shifted) {
+        ret.keyCode = value.secondKeyCode;
+        ret.keyName = value.secondName;
+    } else {
+        ret.keyCode = value.firstKeyCode;
+        ret.keyName = value.firstName;
+    }
+
+    ret.isModifier = ret.keyCode == KEY_LEFTSHIFT || ret.keyCode == KEY_LEFTCTRL || ret.keyCode == KEY_CAPSLOCK;
+    return ret;
+}
+
+}  // namespace key_convert
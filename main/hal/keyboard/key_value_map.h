@@ -0,0 +1,72 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include "keymap.h"
+
+// Key matrix after remap(), [row][col], shared with the host simulator
+struct KeyValue_t {
+    const char* firstName;
+    const KeScanCode_t firstKeyCode;
+    const char* secondName;
+    const KeScanCode_t secondKeyCode;
+};
+
+const KeyValue_t _key_value_map[4][14] = {{{"`", KEY_GRAVE, "~", KEY_GRAVE},
+                                           {"1", KEY_1, "!", KEY_1},
+                                           {"2", KEY_2, "@", KEY_2},
+                                           {"3", KEY_3, "#", KEY_3},
+                                           {"4", KEY_4, "$", KEY_4},
+                                           {"5", KEY_5, "%", KEY_5},
+                                           {"6", KEY_6, "^", KEY_6},
+                                           {"7", KEY_7, "&", KEY_7},
+                                           {"8", KEY_8, "*", KEY_8},
+                                           {"9", KEY_9, "(", KEY_9},
+                                           {"0", KEY_0, ")", KEY_0},
+                                           {"-", KEY_MINUS, "_", KEY_MINUS},
+                                           {"=", KEY_EQUAL, "+", KEY_EQUAL},
+                                           {"del", KEY_BACKSPACE, "del", KEY_BACKSPACE}},
+                                          {{"tab", KEY_TAB, "tab", KEY_TAB},
+                                           {"q", KEY_Q, "Q", KEY_Q},
+                                           {"w", KEY_W, "W", KEY_W},
+                                           {"e", KEY_E, "E", KEY_E},
+                                           {"r", KEY_R, "R", KEY_R},
+                                           {"t", KEY_T, "T", KEY_T},
+                                           {"y", KEY_Y, "Y", KEY_Y},
+                                           {"u", KEY_U, "U", KEY_U},
+                                           {"i", KEY_I, "I", KEY_I},
+                                           {"o", KEY_O, "O", KEY_O},
+                                           {"p", KEY_P, "P", KEY_P},
+                                           {"[", KEY_LEFTBRACE, "{", KEY_LEFTBRACE},
+                                           {"]", KEY_RIGHTBRACE, "}", KEY_RIGHTBRACE},
+                                           {"\\", KEY_BACKSLASH, "|", KEY_BACKSLASH}},
+                                          {{"shift", KEY_LEFTSHIFT, "shift", KEY_LEFTSHIFT},
+                                           {"capslock", KEY_CAPSLOCK, "capslock", KEY_CAPSLOCK},
+                                           {"a", KEY_A, "A", KEY_A},
+                                           {"s", KEY_S, "S", KEY_S},
+                                           {"d", KEY_D, "D", KEY_D},
+                                           {"f", KEY_F, "F", KEY_F},
+                                           {"g", KEY_G, "G", KEY_G},
+                                           {"h", KEY_H, "H", KEY_H},
+                                           {"j", KEY_J, "J", KEY_J},
+                                           {"k", KEY_K, "K", KEY_K},
+                                           {"l", KEY_L, "L", KEY_L},
+                                           {";", KEY_SEMICOLON, ":", KEY_SEMICOLON},
+                                           {"'", KEY_APOSTROPHE, "\"", KEY_APOSTROPHE},
+                                           {"enter", KEY_ENTER, "enter", KEY_ENTER}},
+                                          {{"ctrl", KEY_LEFTCTRL, "ctrl", KEY_LEFTCTRL},
+                                           {"opt", KEY_LEFTMETA, "opt", KEY_LEFTMETA},
+                                           {"alt", KEY_LEFTALT, "alt", KEY_LEFTALT},
+                                           {"z", KEY_Z, "Z", KEY_Z},
+                                           {"x", KEY_X, "X", KEY_X},
+                                           {"c", KEY_C, "C", KEY_C},
+                                           {"v", KEY_V, "V", KEY_V},
+                                           {"b", KEY_B, "B", KEY_B},
+                                           {"n", KEY_N, "N", KEY_N},
+                                           {"m", KEY_M, "M", KEY_M},
+                                           {",", KEY_COMMA, "<", KEY_COMMA},
+                                           {".", KEY_DOT, ">", KEY_DOT},
+                                           {"/", KEY_SLASH, "?", KEY_SLASH},
+                                           {" ", KEY_SPACE, " ", KEY_SPACE}}};
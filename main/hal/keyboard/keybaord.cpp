@@ -4,16 +4,26 @@
  * SPDX-License-Identifier: MIT
  */
 #include "keyboard.h"
+#include "key_convert.h"
 #include "../hal_config.h"
 #include <mooncake_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 static const std::string _tag = "Keyboard";
 
-static volatile bool _isr_flag = false;
+static volatile bool _isr_flag          = false;
+static SemaphoreHandle_t _isr_semaphore = nullptr;
 
 static void IRAM_ATTR gpio_isr_handler(void* arg)
 {
     _isr_flag = true;
+
+    BaseType_t woken = pdFALSE;
+    if (_isr_semaphore) {
+        xSemaphoreGiveFromISR(_isr_semaphore, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
 }
 
 bool Keyboard::init()
@@ -30,6 +40,8 @@ bool Keyboard::init()
     _tca8418->matrix(7, 8);
     _tca8418->flush();
 
+    _isr_semaphore = xSemaphoreCreateBinary();
+
     // Attach interrupt
     gpio_config_t io_conf;
     io_conf.intr_type    = GPIO_INTR_ANYEDGE;
@@ -75,9 +87,30 @@ void Keyboard::update()
     _key_event_buffer = convertToKeyEvent(_key_event_raw_buffer);
     // mclog::tagDebug(_tag, "key event: ({}) {} {}", (int)_key_event_buffer.code, _key_event_buffer.name,
     //                 _key_event_buffer.state);
+    if (_key_filter && _key_filter(_key_event_buffer)) {
+        _key_event_buffer.keyCode = KEY_NONE;
+        return;
+    }
     onKeyEvent.emit(_key_event_buffer);
 }
 
+bool Keyboard::hasPendingEvents() const
+{
+    return _isr_flag;
+}
+
+bool Keyboard::waitForEvent(uint32_t timeout_ms)
+{
+    if (_isr_flag) {
+        return true;
+    }
+    if (!_isr_semaphore) {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        return false;
+    }
+    return xSemaphoreTake(_isr_semaphore, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
 Keyboard::KeyEventRaw_t Keyboard::get_key_event_raw(const uint8_t& eventRaw)
 {
     KeyEventRaw_t ret;
@@ -108,133 +141,12 @@ void Keyboard::remap(KeyEventRaw_t& key)
 
 void Keyboard::update_modifier_mask(const KeyEventRaw_t& key)
 {
-    // Check control key (3, 0)
-    if (key.row == 3 && key.col == 0) {
-        if (key.state) {
-            _modifier_mask |= KEY_MOD_LCTRL;
-        } else {
-            _modifier_mask &= ~KEY_MOD_LCTRL;
-        }
-    }
-
-    // Check shift key (2, 0)
-    if (key.row == 2 && key.col == 0) {
-        if (key.state) {
-            _modifier_mask |= KEY_MOD_LSHIFT;
-        } else {
-            _modifier_mask &= ~KEY_MOD_LSHIFT;
-        }
-    }
-
-    // Check capslock key (2, 1)
-    if (key.row == 2 && key.col == 1) {
-        _capslock_state = key.state;
-    }
+    key_convert::updateModifierMask(key.row, key.col, key.state, _modifier_mask, _capslock_state);
 }
 
-struct KeyValue_t {
-    const char* firstName;
-    const KeScanCode_t firstKeyCode;
-    const char* secondName;
-    const KeScanCode_t secondKeyCode;
-};
-
-const KeyValue_t _key_value_map[4][14] = {{{"`", KEY_GRAVE, "~", KEY_GRAVE},
-                                           {"1", KEY_1, "!", KEY_1},
-                                           {"2", KEY_2, "@", KEY_2},
-                                           {"3", KEY_3, "#", KEY_3},
-                                           {"4", KEY_4, "$", KEY_4},
-                                           {"5", KEY_5, "%", KEY_5},
-                                           {"6", KEY_6, "^", KEY_6},
-                                           {"7", KEY_7, "&", KEY_7},
-                                           {"8", KEY_8, "*", KEY_8},
-                                           {"9", KEY_9, "(", KEY_9},
-                                           {"0", KEY_0, ")", KEY_0},
-                                           {"-", KEY_MINUS, "_", KEY_MINUS},
-                                           {"=", KEY_EQUAL, "+", KEY_EQUAL},
-                                           {"del", KEY_BACKSPACE, "del", KEY_BACKSPACE}},
-                                          {{"tab", KEY_TAB, "tab", KEY_TAB},
-                                           {"q", KEY_Q, "Q", KEY_Q},
-                                           {"w", KEY_W, "W", KEY_W},
-                                           {"e", KEY_E, "E", KEY_E},
-                                           {"r", KEY_R, "R", KEY_R},
-                                           {"t", KEY_T, "T", KEY_T},
-                                           {"y", KEY_Y, "Y", KEY_Y},
-                                           {"u", KEY_U, "U", KEY_U},
-                                           {"i", KEY_I, "I", KEY_I},
-                                           {"o", KEY_O, "O", KEY_O},
-                                           {"p", KEY_P, "P", KEY_P},
-                                           {"[", KEY_LEFTBRACE, "{", KEY_LEFTBRACE},
-                                           {"]", KEY_RIGHTBRACE, "}", KEY_RIGHTBRACE},
-                                           {"\\", KEY_BACKSLASH, "|", KEY_BACKSLASH}},
-                                          {{"shift", KEY_LEFTSHIFT, "shift", KEY_LEFTSHIFT},
-                                           {"capslock", KEY_CAPSLOCK, "capslock", KEY_CAPSLOCK},
-                                           {"a", KEY_A, "A", KEY_A},
-                                           {"s", KEY_S, "S", KEY_S},
-                                           {"d", KEY_D, "D", KEY_D},
-                                           {"f", KEY_F, "F", KEY_F},
-                                           {"g", KEY_G, "G", KEY_G},
-                                           {"h", KEY_H, "H", KEY_H},
-                                           {"j", KEY_J, "J", KEY_J},
-                                           {"k", KEY_K, "K", KEY_K},
-                                           {"l", KEY_L, "L", KEY_L},
-                                           {";", KEY_SEMICOLON, ":", KEY_SEMICOLON},
-                                           {"'", KEY_APOSTROPHE, "\"", KEY_APOSTROPHE},
-                                           {"enter", KEY_ENTER, "enter", KEY_ENTER}},
-                                          {{"ctrl", KEY_LEFTCTRL, "ctrl", KEY_LEFTCTRL},
-                                           {"opt", KEY_LEFTMETA, "opt", KEY_LEFTMETA},
-                                           {"alt", KEY_LEFTALT, "alt", KEY_LEFTALT},
-                                           {"z", KEY_Z, "Z", KEY_Z},
-                                           {"x", KEY_X, "X", KEY_X},
-                                           {"c", KEY_C, "C", KEY_C},
-                                           {"v", KEY_V, "V", KEY_V},
-                                           {"b", KEY_B, "B", KEY_B},
-                                           {"n", KEY_N, "N", KEY_N},
-                                           {"m", KEY_M, "M", KEY_M},
-                                           {",", KEY_COMMA, "<", KEY_COMMA},
-                                           {".", KEY_DOT, ">", KEY_DOT},
-                                           {"/", KEY_SLASH, "?", KEY_SLASH},
-                                           {" ", KEY_SPACE, " ", KEY_SPACE}}};
-
 Keyboard::KeyEvent_t Keyboard::convertToKeyEvent(const KeyEventRaw_t& key)
 {
-    KeyEvent_t ret;
-
-    ret.state = key.state;
-
-    // For letters: use shift/caps lock to determine case
-    // For special characters: use shift to determine which symbol
-    bool use_shifted_version = false;
-
-    // Check if this is a letter key (a-z)
-    KeScanCode_t baseKeyCode = _key_value_map[key.row][key.col].firstKeyCode;
-    bool isLetter            = (baseKeyCode >= KEY_A && baseKeyCode <= KEY_Z);
-
-    if (isLetter) {
-        // For letters, use shift OR caps lock
-        use_shifted_version = (_modifier_mask & KEY_MOD_LSHIFT) || _capslock_state || _is_capslock_locked;
-    } else {
-        // For non-letters (numbers, symbols), only use shift
-        use_shifted_version = (_modifier_mask & KEY_MOD_LSHIFT);
-    }
-
-    // mclog::tagDebug(_tag, "modifier mask: {:08b} {}", _modifier_mask, use_shifted_version);
-
-    if (use_shifted_version) {
-        ret.keyCode = _key_value_map[key.row][key.col].secondKeyCode;
-        ret.keyName = _key_value_map[key.row][key.col].secondName;
-    } else {
-        ret.keyCode = _key_value_map[key.row][key.col].firstKeyCode;
-        ret.keyName = _key_value_map[key.row][key.col].firstName;
-    }
-
-    if (ret.keyCode == KEY_LEFTSHIFT || ret.keyCode == KEY_LEFTCTRL || ret.keyCode == KEY_CAPSLOCK) {
-        ret.isModifier = true;
-    } else {
-        ret.isModifier = false;
-    }
-
-    return ret;
+    return key_convert::toKeyEvent<KeyEvent_t>(key, _modifier_mask, _capslock_state || _is_capslock_locked);
 }
 
 void Keyboard::clearKeyEvent()
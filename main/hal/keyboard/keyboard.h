@@ -26,8 +26,21 @@ public:
     mclog::Signal<const KeyEventRaw_t&> onKeyEventRaw;
     mclog::Signal<const KeyEvent_t&> onKeyEvent;
 
+    /** Sees each key event before onKeyEvent, returning true takes it. For system shortcuts the apps must not get */
+    using KeyFilter_t = bool (*)(const KeyEvent_t& keyEvent);
+    inline void setKeyFilter(KeyFilter_t filter)
+    {
+        _key_filter = filter;
+    }
+
     bool init();
     void update();
+
+    /** True if the controller has events that update() hasn't consumed yet */
+    bool hasPendingEvents() const;
+
+    /** Block until the keyboard interrupt fires or timeout_ms passes, returns true on interrupt */
+    bool waitForEvent(uint32_t timeout_ms);
     inline uint8_t getModifierMask()
     {
         return _modifier_mask;
@@ -53,6 +66,7 @@ public:
 
 private:
     Adafruit_TCA8418* _tca8418 = nullptr;
+    KeyFilter_t _key_filter    = nullptr;
     uint8_t _modifier_mask     = 0;
     bool _capslock_state       = false;
     bool _is_capslock_locked   = false;
@@ -0,0 +1,24 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace profiler {
+
+/** pct percentile of the first count values, which are reordered */
+inline uint32_t percentile(uint32_t* values, size_t count, size_t pct)
+{
+    if (count == 0) {
+        return 0;
+    }
+    const size_t k = (count - 1) * pct / 100;
+    std::nth_element(values, values + k, values + count);
+    return values[k];
+}
+
+}  // namespace profiler
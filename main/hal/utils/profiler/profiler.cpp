@@ -0,0 +1,209 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "profiler.h"
+#include "percentile.h"
+#include <hal.h>
+#include <mooncake_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace profiler {
+
+bool g_enabled = false;
+
+static const std::string _tag = "Profiler";
+
+static FrameSample_t _ring[kRingSize];
+static size_t _ring_head  = 0;
+static size_t _ring_count = 0;
+
+static FrameSample_t _current;
+static uint64_t _frame_start_us = 0;
+static bool _dump_requested     = false;
+
+static const char* _marker_names[] = {"draw_us", "push_us", "key_us", "update_us"};
+
+static DumpHook _dump_hooks[kMaxDumpHooks] = {};
+static size_t _dump_hook_count             = 0;
+
+uint64_t nowUs()
+{
+    return static_cast<uint64_t>(esp_timer_get_time());
+}
+
+static LGFX_Sprite _overlay;
+
+// Key filter, the release is taken too so no app sees half of the shortcut
+static bool on_key_event(const Keyboard::KeyEvent_t& e)
+{
+    if (e.keyCode != KEY_BACKSLASH) {
+        return false;
+    }
+    const uint8_t mask = GetHAL().keyboard.getModifierMask();
+    if (!(mask & KEY_MOD_LCTRL)) {
+        return false;
+    }
+    if (!e.state) {
+        return true;
+    }
+
+    if (mask & KEY_MOD_LSHIFT) {
+        // Dump outside the key handler so it doesn't show up as key dispatch time
+        _dump_requested = true;
+        return true;
+    }
+    setEnabled(!g_enabled);
+    // Apps that are idle don't push again, put the overlay up or take it down right away
+    GetHAL().pushAppCanvas();
+    return true;
+}
+
+void init()
+{
+    mclog::tagInfo(_tag, "init");
+    GetHAL().keyboard.setKeyFilter(on_key_event);
+}
+
+void setEnabled(bool enabled)
+{
+    mclog::tagInfo(_tag, "set enabled: {}", enabled);
+    g_enabled   = enabled;
+    _ring_head  = 0;
+    _ring_count = 0;
+    _current    = FrameSample_t{};
+}
+
+void beginFrame()
+{
+    if (!g_enabled) {
+        return;
+    }
+    _current          = FrameSample_t{};
+    _current.start_ms = GetHAL().millis();
+    _frame_start_us   = nowUs();
+}
+
+void endFrame()
+{
+    if (_dump_requested) {
+        _dump_requested = false;
+        dumpCsv();
+    }
+
+    if (!g_enabled || _frame_start_us == 0) {
+        return;
+    }
+
+    // Only frames that reached the display are interesting, idle loop iterations would swamp the percentiles
+    if (_current.push_bytes > 0) {
+        _current.frame_us = static_cast<uint32_t>(nowUs() - _frame_start_us);
+        _ring[_ring_head] = _current;
+        _ring_head        = (_ring_head + 1) % kRingSize;
+        if (_ring_count < kRingSize) {
+            _ring_count++;
+        }
+    }
+    _frame_start_us = 0;
+}
+
+void addMarkerTime(Marker marker, uint32_t us, const char* app)
+{
+    _current.marker_us[static_cast<size_t>(marker)] += us;
+    if (app != nullptr) {
+        _current.app = app;
+    }
+}
+
+void addPushBytes(uint32_t bytes)
+{
+    if (!g_enabled) {
+        return;
+    }
+    _current.push_bytes += bytes;
+}
+
+void pushOverlay(LovyanGFX* dst, int32_t x, int32_t y, int32_t canvas_width)
+{
+    if (!g_enabled) {
+        return;
+    }
+    if (_overlay.getBuffer() == nullptr) {
+        _overlay.setColorDepth(16);
+        if (!_overlay.createSprite(kOverlayWidth, kOverlayHeight)) {
+            return;
+        }
+    }
+
+    static uint32_t frame_us[kRingSize];
+    const uint32_t now = GetHAL().millis();
+    size_t count       = 0;
+    size_t frames_1s   = 0;
+    uint32_t last_push = 0;
+    for (size_t i = 0; i < _ring_count; ++i) {
+        const auto& s     = _ring[(_ring_head + kRingSize - 1 - i) % kRingSize];
+        frame_us[count++] = s.frame_us;
+        if (now - s.start_ms <= 1000) {
+            frames_1s++;
+        }
+        if (i == 0) {
+            last_push = s.push_bytes;
+        }
+    }
+    const uint32_t p50 = percentile(frame_us, count, 50);
+    const uint32_t p99 = percentile(frame_us, count, 99);
+
+    char line[3][32];
+    std::snprintf(line[0], sizeof(line[0]), "%u fps", static_cast<unsigned>(frames_1s));
+    std::snprintf(line[1], sizeof(line[1]), "p50 %.1f p99 %.1f", p50 / 1000.0f, p99 / 1000.0f);
+    std::snprintf(line[2], sizeof(line[2]), "push %uB", static_cast<unsigned>(last_push));
+
+    _overlay.fillScreen(TFT_BLACK);
+    _overlay.setFont(&fonts::Font0);
+    _overlay.setTextSize(1);
+    _overlay.setTextColor(TFT_GREEN, TFT_BLACK);
+    _overlay.setTextDatum(textdatum_t::top_left);
+    for (int i = 0; i < 3; ++i) {
+        _overlay.drawString(line[i], 2, 1 + i * 10);
+    }
+    _overlay.pushSprite(dst, x + canvas_width - kOverlayWidth, y);
+    addPushBytes(_overlay.bufferLength());
+}
+
+void addDumpHook(DumpHook hook)
+{
+    if (_dump_hook_count >= kMaxDumpHooks) {
+        mclog::tagWarn(_tag, "dump hook dropped, {} already registered", kMaxDumpHooks);
+        return;
+    }
+    _dump_hooks[_dump_hook_count++] = hook;
+}
+
+void dumpCsv()
+{
+    std::printf("start_ms,frame_us");
+    for (const auto* name : _marker_names) {
+        std::printf(",%s", name);
+    }
+    std::printf(",push_bytes,app\r\n");
+
+    const size_t oldest = (_ring_head + kRingSize - _ring_count) % kRingSize;
+    for (size_t i = 0; i < _ring_count; ++i) {
+        const auto& s = _ring[(oldest + i) % kRingSize];
+        std::printf("%u,%u", static_cast<unsigned>(s.start_ms), static_cast<unsigned>(s.frame_us));
+        for (size_t m = 0; m < static_cast<size_t>(Marker::Count); ++m) {
+            std::printf(",%u", static_cast<unsigned>(s.marker_us[m]));
+        }
+        std::printf(",%u,%s\r\n", static_cast<unsigned>(s.push_bytes), s.app ? s.app : "");
+    }
+    std::fflush(stdout);
+
+    for (size_t i = 0; i < _dump_hook_count; ++i) {
+        _dump_hooks[i]();
+    }
+}
+
+}  // namespace profiler
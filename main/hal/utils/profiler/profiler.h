@@ -0,0 +1,89 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <M5GFX.h>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Lightweight frame profiler
+ *
+ * Each main loop iteration is a frame. Frames that pushed pixels to the display are kept in a ring buffer together
+ * with the time spent in each marker. Toggle the overlay with Ctrl + \, dump the ring buffer as CSV over the serial
+ * console with Ctrl + Shift + \, followed by whatever the dump hooks print. Both keys are taken before the apps see them.
+ */
+namespace profiler {
+
+enum class Marker : uint8_t {
+    Draw = 0,
+    Push,
+    KeyDispatch,
+    MooncakeUpdate,
+    Count,
+};
+
+struct FrameSample_t {
+    uint32_t start_ms   = 0;
+    uint32_t frame_us   = 0;
+    uint32_t push_bytes = 0;
+    uint32_t marker_us[static_cast<size_t>(Marker::Count)] = {0};
+    const char* app     = "";
+};
+
+static constexpr size_t kRingSize = 128;
+
+extern bool g_enabled;
+
+inline bool isEnabled()
+{
+    return g_enabled;
+}
+
+void init();
+void setEnabled(bool enabled);
+
+void beginFrame();
+void endFrame();
+
+void addMarkerTime(Marker marker, uint32_t us, const char* app = nullptr);
+void addPushBytes(uint32_t bytes);
+
+/** Overlay in its own sprite, pushed to dst after the app canvas at (x, y), so its pixels never end up in the canvas */
+static constexpr int32_t kOverlayWidth  = 104;
+static constexpr int32_t kOverlayHeight = 30;
+void pushOverlay(LovyanGFX* dst, int32_t x, int32_t y, int32_t canvas_width);
+void dumpCsv();
+
+/** Called in order after dumpCsv() prints the ring buffer, for the layers above to add their own tables */
+using DumpHook                        = void (*)();
+static constexpr size_t kMaxDumpHooks = 4;
+void addDumpHook(DumpHook hook);
+
+uint64_t nowUs();
+
+class ScopedMarker {
+public:
+    explicit ScopedMarker(Marker marker, const char* app = nullptr) : _marker(marker), _app(app)
+    {
+        if (g_enabled) {
+            _start_us = nowUs();
+        }
+    }
+
+    ~ScopedMarker()
+    {
+        if (g_enabled && _start_us != 0) {
+            addMarkerTime(_marker, static_cast<uint32_t>(nowUs() - _start_us), _app);
+        }
+    }
+
+private:
+    Marker _marker;
+    const char* _app;
+    uint64_t _start_us = 0;
+};
+
+}  // namespace profiler
@@ -9,11 +9,18 @@
 #include <memory>
 #include <cstdio>
 #include <smooth_ui_toolkit.h>
+#include <apps/utils/ui/glyph_cache.h>
+#include <apps/utils/ui/animation.h>
+#include <apps/utils/fs/io_service.h>
+#include <apps/utils/audio/audio.h>
 #include <apps/app_desktop/desktop_app.h>
 #include <apps/app_audio_loopback/audio_loopback_app.h>
 #include <apps/app_music/music_app.h>
 #include <apps/app_pictures/pictures_app.h>
 #include <apps/app_circuit_board/circuit_board_app.h>
+#include <apps/app_sd_bench/sd_bench_app.h>
+#include <apps/app_tuner/tuner_app.h>
+#include <apps/app_sound_meter/sound_meter_app.h>
 
 class StatusBarService {
 public:
@@ -66,7 +73,7 @@ private:
 
         char buffer[16];
         std::snprintf(buffer, sizeof(buffer), "%u%%", level);
-        bar.drawString(buffer, x + w + tip_w + 6, bar.height() / 2);
+        GetGlyphCache().drawString(bar, buffer, x + w + tip_w + 6, bar.height() / 2, TFT_WHITE, TFT_BLACK);
 
         if (GetHAL().isSdCardMounted()) {
             constexpr int icon_w = 16;
@@ -91,11 +98,15 @@ public:
         _music_app_id = _mooncake.installApp(std::make_unique<MusicApp>());
         _pictures_app_id = _mooncake.installApp(std::make_unique<PicturesApp>());
         _circuit_board_app_id = _mooncake.installApp(std::make_unique<CircuitBoardApp>());
+        _sd_bench_app_id = _mooncake.installApp(std::make_unique<SdBenchApp>());
+        _tuner_app_id = _mooncake.installApp(std::make_unique<TunerApp>());
+        _sound_meter_app_id = _mooncake.installApp(std::make_unique<SoundMeterApp>());
         _mooncake.openApp(_desktop_app_id);
     }
 
     void update()
     {
+        profiler::ScopedMarker marker(profiler::Marker::MooncakeUpdate);
         _mooncake.update();
     }
 
@@ -106,6 +117,9 @@ private:
     int _music_app_id = -1;
     int _pictures_app_id = -1;
     int _circuit_board_app_id = -1;
+    int _sd_bench_app_id = -1;
+    int _tuner_app_id = -1;
+    int _sound_meter_app_id = -1;
 };
 
 static AppSystem g_app_system;
@@ -118,14 +132,26 @@ extern "C" void app_main(void)
     smooth_ui_toolkit::ui_hal::on_get_tick([] {
         return GetHAL().millis();
     });
+    anim::setTickSource([] {
+        return GetHAL().millis();
+    });
 
     GetHAL().display.setBrightness(128);
+    profiler::init();
+    // SD latency goes with the frame dump, a slow frame is often one that waited on the card
+    profiler::addDumpHook([] { GetIoService().dumpStats(); });
+    profiler::addDumpHook(audio::dump_synth_stats);
     g_app_system.init();
 
     while (1) {
-        GetHAL().feedTheDog();
+        profiler::beginFrame();
         GetHAL().update();
+        GetIoService().dispatch();
         g_status_bar.update();
         g_app_system.update();
+        profiler::endFrame();
+
+        // Sleep until the next animation frame is due, a key press wakes us up early
+        GetHAL().idleUntil(anim::takeNextDeadline());
     }
 }
@@ -0,0 +1,329 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/audio_mixer.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/**
+ * Host checks and benchmark of the audio mixer
+ *
+ * Sines are played through pull and push streams at the usual rates and fitted against an ideal one at the output
+ * for level and conversion noise, the master volume and stream gains have to scale them as documented, a push stream
+ * at the output rate has to come out unchanged, and Music has to duck under a Voice stream and come back with the
+ * configured times. The output stands in for the I2S DMA and paces the mixer in real time for the timing checks. Then
+ * every stream slot plays for -s seconds of audio unpaced and the mixing cost per block is printed. Fails when any
+ * check is off.
+ */
+static int failures = 0;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-34s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+// Collects what the mixer plays, after `frames` it only counts
+struct Capture_t {
+    std::vector<int16_t> out;
+    std::atomic<size_t> frames{0};
+    bool paced = true;
+};
+
+static bool capture_write(const int16_t* frames, size_t count, void* ctx)
+{
+    auto* c          = static_cast<Capture_t*>(ctx);
+    const size_t at  = c->frames.load();
+    const size_t end = std::min(c->out.size() / 2, at + count);
+    if (at < end) {
+        std::memcpy(&c->out[at * 2], frames, (end - at) * 2 * sizeof(int16_t));
+    }
+    c->frames.store(at + count);
+    if (c->paced) {
+        std::this_thread::sleep_for(std::chrono::microseconds(count * 1000000 / 48000));
+    }
+    return true;
+}
+
+static void wait_frames(const Capture_t& c, size_t frames)
+{
+    while (c.frames.load() < frames) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+struct Sine_t {
+    double hz        = 1000.0;
+    double rate      = 48000.0;
+    double amplitude = 16384.0;
+    uint8_t channels = 2;
+    uint64_t n       = 0;
+};
+
+static void sine_pull(int16_t* out, size_t frames, void* ctx)
+{
+    auto* s = static_cast<Sine_t*>(ctx);
+    for (size_t i = 0; i < frames; ++i, ++s->n) {
+        const auto v = static_cast<int16_t>(std::lround(s->amplitude * std::sin(2.0 * M_PI * s->hz * s->n / s->rate)));
+        for (uint8_t c = 0; c < s->channels; ++c) {
+            out[i * s->channels + c] = v;
+        }
+    }
+}
+
+static void silence_pull(int16_t* out, size_t frames, void* /*ctx*/)
+{
+    std::memset(out, 0, frames * sizeof(int16_t));
+}
+
+// Least squares fit of a sine of hz over the left channel of x[from, to), returns the amplitude and the SNR in dB
+static void fit_sine(const std::vector<int16_t>& x, size_t from, size_t to, double hz, double* amplitude, double* snr)
+{
+    const double w = 2.0 * M_PI * hz / 48000.0;
+    double ss = 0.0, cc = 0.0, sc = 0.0, xs = 0.0, xc = 0.0;
+    for (size_t i = from; i < to; ++i) {
+        const double s = std::sin(w * i);
+        const double c = std::cos(w * i);
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        xs += x[2 * i] * s;
+        xc += x[2 * i] * c;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a   = (xs * cc - xc * sc) / det;
+    const double b   = (xc * ss - xs * sc) / det;
+    double signal = 0.0, noise = 0.0;
+    for (size_t i = from; i < to; ++i) {
+        const double fit = a * std::sin(w * i) + b * std::cos(w * i);
+        signal += fit * fit;
+        noise += (x[2 * i] - fit) * (x[2 * i] - fit);
+    }
+    *amplitude = std::sqrt(a * a + b * b);
+    *snr       = 10.0 * std::log10(signal / std::max(noise, 1e-9));
+}
+
+static void check_conversion(uint32_t rate, uint8_t channels, double hz, double min_snr)
+{
+    Capture_t cap;
+    cap.out.assign(48000 * 2, 0);
+    cap.paced = false;
+    AudioMixer mixer;
+    mixer.begin({48000, capture_write, &cap});
+
+    Sine_t sine;
+    sine.hz       = hz;
+    sine.rate     = rate;
+    sine.channels = channels;
+    AudioMixer::StreamConfig_t config;
+    config.sample_rate = rate;
+    config.channels    = channels;
+    config.pull        = sine_pull;
+    config.ctx         = &sine;
+    mixer.open(config);
+    wait_frames(cap, 48000);
+    mixer.end();
+
+    double amplitude = 0.0, snr = 0.0;
+    fit_sine(cap.out, 4800, 48000, hz, &amplitude, &snr);
+    char name[48];
+    std::snprintf(name, sizeof(name), "%.0f Hz from %u Hz %s level", hz, rate, channels == 2 ? "stereo" : "mono");
+    check(name, amplitude, 16384 * 0.97, 16384 * 1.01, "");
+    std::snprintf(name, sizeof(name), "%.0f Hz from %u Hz %s SNR", hz, rate, channels == 2 ? "stereo" : "mono");
+    check(name, snr, min_snr, 200.0, "dB");
+}
+
+static double level_with(uint8_t volume, float gain, bool master)
+{
+    Capture_t cap;
+    cap.out.assign(9600 * 2, 0);
+    cap.paced = false;
+    AudioMixer mixer;
+    mixer.begin({48000, capture_write, &cap});
+    mixer.setVolume(volume);
+
+    Sine_t sine;
+    sine.amplitude = 4000.0;
+    AudioMixer::StreamConfig_t config;
+    config.role   = AudioMixer::Role::System;
+    config.master = master;
+    config.pull   = sine_pull;
+    config.ctx    = &sine;
+    const int id  = mixer.open(config);
+    mixer.setGain(id, gain);
+    wait_frames(cap, 9600);
+    mixer.end();
+
+    double amplitude = 0.0, snr = 0.0;
+    fit_sine(cap.out, 2400, 9600, sine.hz, &amplitude, &snr);
+    return amplitude;
+}
+
+static void check_gains()
+{
+    check("volume 64 level", level_with(64, 1.0f, true), 4000 * 0.99, 4000 * 1.01, "");
+    check("volume 128 level (4x)", level_with(128, 1.0f, true), 16000 * 0.99, 16000 * 1.01, "");
+    check("volume 32 level (1/4)", level_with(32, 1.0f, true), 1000 * 0.98, 1000 * 1.02, "");
+    check("gain 0.5 level", level_with(64, 0.5f, true), 2000 * 0.99, 2000 * 1.01, "");
+    check("no master, volume 0 level", level_with(0, 1.0f, false), 4000 * 0.99, 4000 * 1.01, "");
+}
+
+static void check_push()
+{
+    Capture_t cap;
+    cap.out.assign(24000 * 2, 0);
+    cap.paced = false;
+    AudioMixer mixer;
+    mixer.begin({48000, capture_write, &cap});
+
+    std::vector<int16_t> in(20000 * 2);
+    for (size_t i = 0; i < 20000; ++i) {
+        in[2 * i]     = static_cast<int16_t>(std::rand() - RAND_MAX / 2);
+        in[2 * i + 1] = static_cast<int16_t>(std::rand() - RAND_MAX / 2);
+    }
+    AudioMixer::StreamConfig_t config;
+    config.buffer_frames = 20000;
+    const int id         = mixer.open(config);
+    const size_t took    = mixer.write(id, in.data(), 20000, 0);
+    wait_frames(cap, 20001);
+    const auto s = mixer.stats();
+    mixer.end();
+
+    // Same rate, the resampler passes it through without a frame of delay
+    int diff = 0;
+    for (size_t i = 0; i < 20000 * 2; ++i) {
+        diff = std::max(diff, std::abs(in[i] - cap.out[i]));
+    }
+    check("push frames taken", took, 20000, 20000, "");
+    check("push at the output rate, error", diff, 0, 1, "lsb");
+    check("underruns, the tail only", s.underruns, 1, 1, "");
+}
+
+// Peak of the left channel over a block, the music level seen through the tone
+static double block_level(const std::vector<int16_t>& x, size_t block)
+{
+    int peak = 0;
+    for (size_t i = 0; i < AudioMixer::kBlockFrames; ++i) {
+        peak = std::max(peak, std::abs(static_cast<int>(x[2 * (block * AudioMixer::kBlockFrames + i)])));
+    }
+    return peak / 16384.0;
+}
+
+static void check_ducking()
+{
+    constexpr size_t kFrames = 48000 * 3 / 2;
+    Capture_t cap;
+    cap.out.assign(kFrames * 2, 0);
+    AudioMixer mixer;
+    mixer.begin({48000, capture_write, &cap});
+
+    Sine_t music;
+    AudioMixer::StreamConfig_t config;
+    config.pull = sine_pull;
+    config.ctx  = &music;
+    mixer.open(config);
+
+    // Voice opened about 200 ms in and closed about 500 ms later, the block it happened at is what counts
+    wait_frames(cap, 9600);
+    AudioMixer::StreamConfig_t voice;
+    voice.role        = AudioMixer::Role::Voice;
+    voice.channels    = 1;
+    voice.pull        = silence_pull;
+    const int id      = mixer.open(voice);
+    const size_t down = cap.frames.load() / AudioMixer::kBlockFrames;
+    wait_frames(cap, 9600 + 24000);
+    const bool ducking = mixer.stats().ducking;
+    mixer.close(id);
+    const size_t up = cap.frames.load() / AudioMixer::kBlockFrames;
+    wait_frames(cap, kFrames);
+    mixer.end();
+
+    // 20 ms down and 300 ms back up, 5.3 ms blocks, one block of slack either side for when the open landed
+    check("level before", block_level(cap.out, down - 2), 0.99, 1.01, "");
+    check("ducked after 20 ms", block_level(cap.out, down + 6), 0.245, 0.26, "");
+    check("ducking reported", ducking ? 1 : 0, 1, 1, "");
+    check("half way back after 150 ms", block_level(cap.out, up + 28), 0.5, 0.75, "");
+    check("back after 300 ms", block_level(cap.out, up + 60), 0.99, 1.01, "");
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -s <sec>   audio for the benchmark (default 60)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds  = 60.0f;
+    bool benchmark = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Medium quality resampling, the 16 kHz images sit closest to the stopband edge
+    check_conversion(44100, 2, 1000.0, 70.0);
+    check_conversion(48000, 2, 1000.0, 80.0);
+    check_conversion(16000, 1, 1000.0, 60.0);
+    check_conversion(22050, 1, 440.0, 70.0);
+    check_gains();
+    check_push();
+    check_ducking();
+
+    if (benchmark) {
+        // Every slot a stereo 44.1 kHz stream, unpaced so the mixer runs flat out
+        Capture_t cap;
+        cap.paced = false;
+        AudioMixer mixer;
+        mixer.begin({48000, capture_write, &cap});
+        Sine_t sines[AudioMixer::kMaxStreams];
+        for (size_t i = 0; i < AudioMixer::kMaxStreams; ++i) {
+            sines[i].rate      = 44100;
+            sines[i].hz        = 220.0 * (i + 1);
+            sines[i].amplitude = 3000.0;
+            AudioMixer::StreamConfig_t config;
+            config.role        = i == 0 ? AudioMixer::Role::Notification : AudioMixer::Role::Music;
+            config.sample_rate = 44100;
+            config.pull        = sine_pull;
+            config.ctx         = &sines[i];
+            mixer.open(config);
+        }
+        const size_t frames = static_cast<size_t>(seconds * 48000);
+        const auto t0       = std::chrono::steady_clock::now();
+        wait_frames(cap, frames);
+        const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        const auto s    = mixer.stats();
+        mixer.end();
+
+        std::printf("\n%u streams, %zu frame blocks at 48000 Hz\n", s.streams, AudioMixer::kBlockFrames);
+        std::printf("%-34s %10u us/block\n", "mixer stats", s.block_us);
+        std::printf("%-34s %10.1f us/block (sources included)\n", "host clock",
+                    us / (static_cast<double>(s.blocks)));
+        std::printf("%-34s %10u us\n", "slowest block", s.max_block_us);
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/fs/dir_listing.h>
+#include <apps/utils/fs/io_service.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Host checks and benchmark of the sorted folder listing the Pictures browser uses
+ *
+ * A folder of -n entries, folders, images and files the filter skips, is written to a temporary folder. It is then
+ * listed cold, which reads it twice, sorts it a page at a time and merges the pages into a sidecar, and warm, which
+ * shows the sidecar right away and only checks it against the folder. Every entry has to come back in order and find()
+ * has to land on random names. Then the listing is paged through with the UI loop simulated: a page down of kPageRows
+ * every kFrameUs, counting the pages whose names weren't read ahead, and random jumps, timing until the window
+ * arrives. Fails when any check is off.
+ */
+static int failures = 0;
+
+static constexpr int kPageRows     = 8;
+static constexpr int kFrameUs      = 1000;
+static constexpr int kJumps        = 200;
+static constexpr int kFindProbes   = 200;
+static constexpr int kTimeoutMs    = 60 * 1000;
+static constexpr int kDirEvery     = 50;
+static constexpr int kSkippedEvery = 10;
+
+using Clock = std::chrono::steady_clock;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+static double ms_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+static bool is_image(std::string_view name)
+{
+    return name.size() > 4 && (name.substr(name.size() - 4) == ".jpg" || name.substr(name.size() - 4) == ".png");
+}
+
+struct Entry_t {
+    std::string key;
+    std::string name;
+    bool is_dir = false;
+};
+
+/** Same order as the listing: folders first, then by case-folded name, then by exact name */
+static bool entry_less(const Entry_t& a, const Entry_t& b)
+{
+    if (a.is_dir != b.is_dir) {
+        return a.is_dir;
+    }
+    const int c = a.key.compare(b.key);
+    return c != 0 ? c < 0 : a.name < b.name;
+}
+
+static std::string folded(const std::string& name)
+{
+    std::string key = name;
+    for (auto& c : key) {
+        c = c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+    return key;
+}
+
+/** Listed entries of the folder written, in the order the listing has to return them */
+static std::vector<Entry_t> make_folder(const std::string& dir, int count, std::mt19937& rng)
+{
+    static const char kChars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_- ";
+    std::vector<Entry_t> listed;
+    std::string name;
+    for (int i = 0; i < count; ++i) {
+        // Unique by the index suffix, the random stem spreads them over the sort order
+        name.clear();
+        const int len = 4 + static_cast<int>(rng() % 16);
+        for (int c = 0; c < len; ++c) {
+            name.push_back(kChars[rng() % (sizeof(kChars) - 1)]);
+        }
+        name += "_" + std::to_string(i);
+        const std::string path = dir + "/";
+        if (i % kDirEvery == 0) {
+            mkdir((path + name).c_str(), 0755);
+            listed.push_back({folded(name), name, true});
+            continue;
+        }
+        name += i % kSkippedEvery == 1 ? ".txt" : (i % 2 ? ".jpg" : ".png");
+        if (std::FILE* f = std::fopen((path + name).c_str(), "wb")) {
+            std::fclose(f);
+        }
+        if (is_image(name)) {
+            listed.push_back({folded(name), name, false});
+        }
+    }
+    std::sort(listed.begin(), listed.end(), entry_less);
+    return listed;
+}
+
+static void remove_tree(const std::string& dir)
+{
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* ent = readdir(d)) {
+            if (std::strcmp(ent->d_name, ".") == 0 || std::strcmp(ent->d_name, "..") == 0) {
+                continue;
+            }
+            const std::string path = dir + "/" + ent->d_name;
+            struct stat s {};
+            if (lstat(path.c_str(), &s) == 0 && S_ISDIR(s.st_mode)) {
+                remove_tree(path);
+            } else {
+                std::remove(path.c_str());
+            }
+        }
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+}
+
+/** One UI loop iteration, the listing and the I/O callbacks are both serviced there on the device */
+static void ui_loop(DirListing& listing)
+{
+    GetIoService().dispatch();
+    listing.poll();
+}
+
+/** Run the UI loop until done() or the timeout, false on timeout */
+template <typename Fn>
+static bool run_until(DirListing& listing, Fn&& done)
+{
+    const auto t0 = Clock::now();
+    while (!done()) {
+        if (ms_since(t0) > kTimeoutMs) {
+            return false;
+        }
+        ui_loop(listing);
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    return true;
+}
+
+static double mismatches(DirListing& listing, const std::vector<Entry_t>& expected)
+{
+    if (listing.size() != static_cast<int>(expected.size())) {
+        return static_cast<double>(expected.size());
+    }
+    int bad = 0;
+    for (int i = 0; i < listing.size(); ++i) {
+        if (!run_until(listing, [&]() { return listing.isResident(i); })) {
+            return static_cast<double>(expected.size());
+        }
+        bad += listing.name(i) != expected[i].name || listing.isDir(i) != expected[i].is_dir;
+    }
+    return bad;
+}
+
+static double find_misses(DirListing& listing, const std::vector<Entry_t>& expected, std::mt19937& rng)
+{
+    int bad = 0;
+    for (int i = 0; i < kFindProbes; ++i) {
+        const int index = static_cast<int>(rng() % expected.size());
+        bad += listing.find(expected[index].name) != index;
+    }
+    return bad + (listing.find("not in the folder.jpg") != -1);
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -n <n>     entries in the folder (default 20000)\n"
+        "  -d <dir>   where to make the temporary folder (default /tmp)\n"
+        "  -r <seed>  random seed (default 1)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    int count       = 20000;
+    std::string tmp = "/tmp";
+    uint32_t seed   = 1;
+    bool benchmark  = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-n") == 0 && has_value) {
+            count = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-d") == 0 && has_value) {
+            tmp = argv[++i];
+        } else if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::string root = tmp + "/dir_listing_XXXXXX";
+    if (!mkdtemp(root.data())) {
+        std::fprintf(stderr, "mkdtemp in %s failed\n", tmp.c_str());
+        return 1;
+    }
+    const std::string dir = root + "/photos";
+    mkdir(dir.c_str(), 0755);
+
+    std::mt19937 rng(seed);
+    auto t0                             = Clock::now();
+    const std::vector<Entry_t> expected = make_folder(dir, count, rng);
+    std::printf("%d entries, %zu listed, written in %.0f ms\n\n", count, expected.size(), ms_since(t0));
+
+    // The readdir() pass alone, the cold listing does two of these
+    t0 = Clock::now();
+    if (DIR* d = opendir(dir.c_str())) {
+        while (readdir(d)) {
+        }
+        closedir(d);
+    }
+    const double readdir_ms = ms_since(t0);
+
+    const auto filter = [](std::string_view name) { return is_image(name); };
+    DirListing listing;
+
+    // Cold: nothing to show until the sidecar is built and its first window has arrived
+    t0 = Clock::now();
+    listing.open(dir, root, filter);
+    const bool cold_done = run_until(listing, [&]() { return !listing.isLoading() && listing.isResident(0); });
+    const double cold_ms = ms_since(t0);
+    check("cold listing finishes", cold_done ? 1 : 0, 1, 1, "");
+    check("cold listing entries out of order", mismatches(listing, expected), 0, 0, "");
+    check("cold listing folders", listing.dirCount(), (count + kDirEvery - 1) / kDirEvery,
+          (count + kDirEvery - 1) / kDirEvery, "");
+
+    // Warm: the sidecar is shown right away, the worker only checks it against the folder. A folder that fits in a
+    // page has no sidecar and is listed again
+    listing.close();
+    t0 = Clock::now();
+    listing.open(dir, root, filter);
+    const bool shown           = listing.size() == static_cast<int>(expected.size());
+    const bool first_window    = run_until(listing, [&]() { return !listing.isLoading() && listing.isResident(0); });
+    const double warm_first_ms = ms_since(t0);
+    if (expected.size() > DirListing::kPageEntries) {
+        check("warm listing shown right away", shown && first_window ? 1 : 0, 1, 1, "");
+    }
+    check("warm listing entries out of order", mismatches(listing, expected), 0, 0, "");
+    check("find() misses", find_misses(listing, expected, rng), 0, 0, "");
+
+    // Page down through the whole listing, a page whose names weren't read ahead shows placeholders for a frame
+    std::vector<int> pages;
+    for (int first = 0; first < listing.size(); first += kPageRows) {
+        pages.push_back(std::min(first, std::max(0, listing.size() - kPageRows)));
+    }
+    int misses        = 0;
+    double worst_miss = 0.0;
+    listing.ensureResident(0, kPageRows);
+    run_until(listing, [&]() { return listing.isResident(0); });
+    t0 = Clock::now();
+    for (const int first : pages) {
+        const auto frame = Clock::now();
+        const int last   = std::min(first + kPageRows, listing.size()) - 1;
+        listing.ensureResident(first, kPageRows);
+        if (!listing.isResident(first) || !listing.isResident(last)) {
+            misses++;
+            run_until(listing, [&]() { return listing.isResident(first) && listing.isResident(last); });
+            worst_miss = std::max(worst_miss, ms_since(frame));
+        }
+        ui_loop(listing);
+        std::this_thread::sleep_until(frame + std::chrono::microseconds(kFrameUs));
+    }
+    const double paging_ms = ms_since(t0);
+    check("pages not read ahead", misses, 0, 1, "");
+
+    // Random jumps always miss, time until the window lands
+    std::vector<double> jump_ms;
+    const int jumps = benchmark ? kJumps : 0;
+    for (int i = 0; i < jumps; ++i) {
+        const int index = static_cast<int>(rng() % listing.size());
+        t0              = Clock::now();
+        listing.ensureResident(index, 1);
+        run_until(listing, [&]() { return listing.isResident(index); });
+        jump_ms.push_back(ms_since(t0));
+    }
+    std::sort(jump_ms.begin(), jump_ms.end());
+
+    if (benchmark) {
+        std::printf("\n%-44s %10.2f ms\n", "readdir() pass", readdir_ms);
+        std::printf("%-44s %10.2f ms\n", "cold open to first window", cold_ms);
+        std::printf("%-44s %10.2f ms\n", "  of which sort, merge and sidecar write", cold_ms - 2 * readdir_ms);
+        std::printf("%-44s %10.2f ms\n", "warm open to first window", warm_first_ms);
+        std::printf("%-44s %10.2f ms  %d pages, %d missed, worst %.2f ms\n", "page down through the listing", paging_ms,
+                    static_cast<int>(pages.size()), misses, worst_miss);
+        if (!jump_ms.empty()) {
+            std::printf("%-44s %10.3f ms p50 %.3f ms p99 %.3f ms max\n", "random jump to window",
+                        jump_ms[jump_ms.size() / 2], jump_ms[jump_ms.size() * 99 / 100], jump_ms.back());
+        }
+    }
+
+    listing.close();
+    remove_tree(root);
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
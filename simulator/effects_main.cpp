@@ -0,0 +1,375 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/effects.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Host checks and benchmark of the loopback effects kernels
+ *
+ * Every kernel is fed test tones and noise and its steady state is checked against what it was configured for, the
+ * howl suppressor against a tone that builds up in noise and a sweep it must leave alone. Then each kernel and the
+ * worst case chain run in 128 sample blocks for -s seconds of audio and the cost is printed per sample, in ns and,
+ * on x86, in TSC cycles. Fails when any check is off.
+ */
+static constexpr float kRate   = 16000.0f;
+static constexpr size_t kBlock = 128;
+
+static int failures = 0;
+
+static void check(const char* name, float value, float lo, float hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-34s %8.2f %-4s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+static float db(float ratio)
+{
+    return 20.0f * std::log10(std::max(ratio, 1e-9f));
+}
+
+static float rms(const float* x, size_t n)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += static_cast<double>(x[i]) * x[i];
+    }
+    return static_cast<float>(std::sqrt(sum / static_cast<double>(n)));
+}
+
+static float peak(const float* x, size_t n)
+{
+    float p = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        p = std::max(p, std::fabs(x[i]));
+    }
+    return p;
+}
+
+// Level of one frequency in x, as the amplitude of a sine
+static float tone_level(const float* x, size_t n, float freq)
+{
+    const double w = 2.0 * M_PI * freq / kRate;
+    double re      = 0.0;
+    double im      = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        re += x[i] * std::cos(w * i);
+        im += x[i] * std::sin(w * i);
+    }
+    return static_cast<float>(2.0 * std::sqrt(re * re + im * im) / static_cast<double>(n));
+}
+
+static std::vector<float> sine(float freq, float amplitude, float seconds)
+{
+    std::vector<float> x(static_cast<size_t>(seconds * kRate));
+    for (size_t i = 0; i < x.size(); ++i) {
+        x[i] = amplitude * std::sin(2.0f * static_cast<float>(M_PI) * freq * i / kRate);
+    }
+    return x;
+}
+
+static void add_noise(std::vector<float>& x, float level_db, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, std::pow(10.0f, level_db / 20.0f));
+    for (auto& v : x) {
+        v += noise(rng);
+    }
+}
+
+// Runs a kernel over x in blocks, the way the loopback task does
+template <typename Kernel>
+static void run(Kernel& kernel, std::vector<float>& x)
+{
+    for (size_t start = 0; start < x.size(); start += kBlock) {
+        kernel.process(x.data() + start, std::min(kBlock, x.size() - start));
+    }
+}
+
+// Gain in dB of a biquad at freq, measured on the last half second of a tone
+static float biquad_gain(dsp::Band type, float f0, float q, float gain_db, float freq)
+{
+    dsp::Biquad bq;
+    bq.setCoeffs(dsp::design(type, kRate, f0, q, gain_db));
+    auto x = sine(freq, 0.25f, 1.0f);
+    run(bq, x);
+    const size_t half = x.size() / 2;
+    return db(rms(x.data() + half, half) / (0.25f / std::sqrt(2.0f)));
+}
+
+static void check_eq()
+{
+    check("peaking +6 dB at 1 kHz", biquad_gain(dsp::Band::Peaking, 1000, 1.0f, 6.0f, 1000), 5.8f, 6.2f, "dB");
+    check("peaking +6 dB at 1 kHz, 100 Hz", biquad_gain(dsp::Band::Peaking, 1000, 1.0f, 6.0f, 100), -0.3f, 0.5f,
+          "dB");
+    check("high pass 120 Hz, 30 Hz", biquad_gain(dsp::Band::HighPass, 120, 0.707f, 0.0f, 30), -30.0f, -20.0f, "dB");
+    check("high pass 120 Hz, 1 kHz", biquad_gain(dsp::Band::HighPass, 120, 0.707f, 0.0f, 1000), -0.2f, 0.2f, "dB");
+    check("low shelf +4 dB at 200 Hz, 40 Hz", biquad_gain(dsp::Band::LowShelf, 200, 0.707f, 4.0f, 40), 3.5f, 4.1f,
+          "dB");
+    check("high shelf -3 dB at 4 kHz, 7 kHz", biquad_gain(dsp::Band::HighShelf, 4000, 0.707f, -3.0f, 7000), -3.1f,
+          -2.5f, "dB");
+    check("notch Q 20 at 2 kHz", biquad_gain(dsp::Band::Notch, 2000, 20.0f, 0.0f, 2000), -200.0f, -40.0f, "dB");
+    check("notch Q 20 at 2 kHz, 1.5 kHz", biquad_gain(dsp::Band::Notch, 2000, 20.0f, 0.0f, 1500), -0.2f, 0.1f, "dB");
+}
+
+static void check_gate()
+{
+    dsp::NoiseGate gate;
+    dsp::NoiseGate::Config_t config;
+    gate.configure(config, kRate);
+    gate.reset();
+
+    // Hiss well under the threshold, then speech level, then hiss again
+    std::vector<float> hiss(static_cast<size_t>(kRate));
+    add_noise(hiss, -65.0f, 1);
+    auto x = hiss;
+    run(gate, x);
+    const float hiss_rms = rms(hiss.data(), hiss.size());
+    check("gate closed on -65 dB hiss", db(rms(x.data() + x.size() / 2, x.size() / 2) / hiss_rms), -41.0f, -35.0f,
+          "dB");
+
+    auto tone = sine(500, 0.1f, 0.5f);
+    run(gate, tone);
+    const float tone_rms = 0.1f / std::sqrt(2.0f);
+    check("gate open on -20 dB tone", db(rms(tone.data() + tone.size() / 2, tone.size() / 2) / tone_rms), -0.2f, 0.1f,
+          "dB");
+
+    // Hold, then a release of 100 ms from full gain down to the range, judged over the second after that
+    x = hiss;
+    run(gate, x);
+    x = hiss;
+    run(gate, x);
+    check("gate closed again after hold", db(rms(x.data(), x.size()) / hiss_rms), -41.0f, -35.0f, "dB");
+}
+
+static void check_dynamics()
+{
+    dsp::Compressor comp;
+    dsp::Compressor::Config_t config;
+    config.threshold_db = -24.0f;
+    config.ratio        = 3.0f;
+    config.makeup_db    = 0.0f;
+    comp.configure(config, kRate);
+    comp.reset();
+
+    // -6 dB peaks are 18 dB over, 3:1 leaves 6 of them
+    auto x = sine(1000, 0.5f, 1.0f);
+    run(comp, x);
+    check("compressor 3:1, -6 dB in", db(peak(x.data() + x.size() / 2, x.size() / 2)), -18.8f, -17.2f, "dBFS");
+
+    x = sine(1000, 0.03f, 1.0f);
+    run(comp, x);
+    check("compressor under threshold", db(peak(x.data() + x.size() / 2, x.size() / 2) / 0.03f), -0.2f, 0.2f, "dB");
+
+    dsp::Limiter limiter;
+    dsp::Limiter::Config_t limit;
+    limiter.configure(limit, kRate);
+    limiter.reset();
+    x = sine(200, 2.0f, 0.5f);
+    add_noise(x, -10.0f, 2);
+    run(limiter, x);
+    check("limiter -1 dB, +6 dB in", db(peak(x.data(), x.size())), -20.0f, -0.99f, "dBFS");
+}
+
+static void check_howl()
+{
+    dsp::HowlSuppressor howl;
+    dsp::HowlSuppressor::Config_t config;
+    howl.configure(config, kRate);
+    howl.reset();
+
+    // Room noise, then a tone that keeps ringing from 0.5 s
+    auto x = sine(2345, 0.1f, 3.0f);
+    std::fill(x.begin(), x.begin() + static_cast<size_t>(kRate / 2), 0.0f);
+    add_noise(x, -40.0f, 3);
+    run(howl, x);
+    check("howl notches placed", static_cast<float>(howl.notchCount()), 1, 1, "");
+    if (howl.notchCount() > 0) {
+        check("howl notch frequency", howl.notchFrequency(0), 2345 * 0.99f, 2345 * 1.01f, "Hz");
+    }
+    const size_t tail = static_cast<size_t>(kRate / 2);
+    check("howl tone after notch", db(tone_level(x.data() + x.size() - tail, tail, 2345) / 0.1f), -200.0f, -20.0f,
+          "dB");
+
+    // A second tone goes into a second notch, the first stays
+    x = sine(700, 0.1f, 2.0f);
+    add_noise(x, -40.0f, 4);
+    run(howl, x);
+    check("second howl notches placed", static_cast<float>(howl.notchCount()), 2, 2, "");
+
+    // Speech moves, a tone gliding from 300 Hz to 3 kHz over two seconds must not be notched
+    howl.reset();
+    std::vector<float> sweep(static_cast<size_t>(2.0f * kRate));
+    double phase = 0.0;
+    for (size_t i = 0; i < sweep.size(); ++i) {
+        const double f = 300.0 + 2700.0 * i / sweep.size();
+        phase += 2.0 * M_PI * f / kRate;
+        sweep[i] = 0.1f * static_cast<float>(std::sin(phase));
+    }
+    add_noise(sweep, -40.0f, 5);
+    run(howl, sweep);
+    check("howl notches on a sweep", static_cast<float>(howl.notchCount()), 0, 0, "");
+
+    howl.reset();
+    std::vector<float> noise(static_cast<size_t>(3.0f * kRate));
+    add_noise(noise, -20.0f, 6);
+    run(howl, noise);
+    check("howl notches on noise", static_cast<float>(howl.notchCount()), 0, 0, "");
+}
+
+static dsp::EffectsChain::Config_t worst_case_config()
+{
+    dsp::EffectsChain::Config_t config;
+    config.eq[0]    = {dsp::Band::HighPass, 120.0f, 0.707f, 0.0f};
+    config.eq[1]    = {dsp::Band::LowShelf, 250.0f, 0.707f, -2.0f};
+    config.eq[2]    = {dsp::Band::Peaking, 3000.0f, 1.0f, 4.0f};
+    config.eq[3]    = {dsp::Band::HighShelf, 6000.0f, 0.707f, -3.0f};
+    config.gate_on  = true;
+    config.comp_on  = true;
+    config.limit_on = true;
+    config.howl_on  = true;
+    return config;
+}
+
+// Cost of one kernel per sample, over the whole signal in blocks
+static void bench(const char* name, const std::function<void(float*, size_t)>& process, float seconds)
+{
+    std::vector<float> x(static_cast<size_t>(seconds * kRate));
+    add_noise(x, -20.0f, 7);
+
+    const auto t0 = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const uint64_t c0 = __rdtsc();
+#endif
+    for (size_t start = 0; start + kBlock <= x.size(); start += kBlock) {
+        process(x.data() + start, kBlock);
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+#if defined(__x86_64__) || defined(__i386__)
+    const double cycles = static_cast<double>(__rdtsc() - c0);
+    std::printf("%-34s %8.2f ns/sample %8.2f cycles/sample\n", name, ns / x.size(), cycles / x.size());
+#else
+    std::printf("%-34s %8.2f ns/sample\n", name, ns / x.size());
+#endif
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -s <sec>   audio per benchmark (default 20)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds   = 20.0f;
+    bool benchmark  = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    check_eq();
+    check_gate();
+    check_dynamics();
+    check_howl();
+
+    // The int16 path of the whole chain saturates instead of wrapping, a slow tone pushed 12 dB over full scale only
+    // ever moves a few thousand per sample
+    dsp::EffectsChain chain;
+    chain.init(kRate);
+    dsp::EffectsChain::Config_t config;
+    config.eq[0] = {dsp::Band::Peaking, 100.0f, 1.0f, 12.0f};
+    chain.configure(config);
+    std::vector<int16_t> loud(static_cast<size_t>(kRate / 2));
+    for (size_t i = 0; i < loud.size(); ++i) {
+        loud[i] = static_cast<int16_t>(30000.0f * std::sin(2.0f * static_cast<float>(M_PI) * 100.0f * i / kRate));
+    }
+    chain.process(loud.data(), loud.size());
+    int wraps = 0;
+    for (size_t i = 1; i < loud.size(); ++i) {
+        wraps += std::abs(loud[i] - loud[i - 1]) > 40000 ? 1 : 0;
+    }
+    check("chain int16 wraps at +12 dB", static_cast<float>(wraps), 0, 0, "");
+
+    if (benchmark) {
+        dsp::Biquad bq;
+        bq.setCoeffs(dsp::design(dsp::Band::Peaking, kRate, 1000, 1.0f, 6.0f));
+        dsp::NoiseGate gate;
+        gate.configure({}, kRate);
+        dsp::Compressor comp;
+        comp.configure({}, kRate);
+        dsp::Limiter limiter;
+        limiter.configure({}, kRate);
+        dsp::HowlSuppressor howl;
+        howl.configure({}, kRate);
+        howl.reset();
+        dsp::HowlSuppressor howl_full;
+        howl_full.configure({}, kRate);
+        howl_full.reset();
+        for (const float f : {700.0f, 1400.0f, 2345.0f, 3100.0f}) {
+            auto x = sine(f, 0.1f, 1.0f);
+            run(howl_full, x);
+        }
+
+        std::printf("\n");
+        bench("biquad", [&](float* x, size_t n) { bq.process(x, n); }, seconds);
+        bench("noise gate", [&](float* x, size_t n) { gate.process(x, n); }, seconds);
+        bench("compressor", [&](float* x, size_t n) { comp.process(x, n); }, seconds);
+        bench("limiter", [&](float* x, size_t n) { limiter.process(x, n); }, seconds);
+        bench("howl tracker", [&](float* x, size_t n) { howl.process(x, n); }, seconds);
+        char name[48];
+        std::snprintf(name, sizeof(name), "howl tracker + %d notches", howl_full.notchCount());
+        bench(name, [&](float* x, size_t n) { howl_full.process(x, n); }, seconds);
+
+        // Worst case: every EQ band and stage on, every notch placed, plus the int16 conversions
+        chain.init(kRate);
+        chain.configure(worst_case_config());
+        for (const float f : {700.0f, 1400.0f, 2345.0f, 3100.0f}) {
+            auto x = sine(f, 0.1f, 1.0f);
+            std::vector<int16_t> tone(x.size());
+            for (size_t i = 0; i < x.size(); ++i) {
+                tone[i] = static_cast<int16_t>(x[i] * 32767.0f);
+            }
+            chain.process(tone.data(), tone.size());
+        }
+        std::snprintf(name, sizeof(name), "chain, %d notches", chain.howl().notchCount());
+        std::vector<int16_t> pcm(kBlock);
+        bench(name,
+              [&](float* x, size_t n) {
+                  for (size_t i = 0; i < n; ++i) {
+                      pcm[i] = static_cast<int16_t>(x[i] * 32767.0f);
+                  }
+                  chain.process(pcm.data(), n);
+              },
+              seconds);
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct QueueDefinition {
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length    = 0;
+    UBaseType_t item_size = 0;
+};
+
+struct tskTaskControlBlock {
+    std::thread thread;
+};
+
+static const auto _start_time = std::chrono::steady_clock::now();
+
+template <typename Pred>
+static bool wait_for(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Pred pred)
+{
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, pred);
+        return true;
+    }
+    // A poll, without the timed wait that costs a syscall even when it can't block
+    if (ticks == 0) {
+        return pred();
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Tasks                                   */
+/* -------------------------------------------------------------------------- */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core_id)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+    (void)core_id;
+    // Tasks run until the process exits, the control block is never reclaimed
+    auto* tcb   = new tskTaskControlBlock;
+    tcb->thread = std::thread(fn, arg);
+    tcb->thread.detach();
+    if (handle) {
+        *handle = tcb;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg, UBaseType_t priority,
+                       TaskHandle_t* handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    (void)handle;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+    using namespace std::chrono;
+    return static_cast<TickType_t>(duration_cast<milliseconds>(steady_clock::now() - _start_time).count());
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Queues                                   */
+/* -------------------------------------------------------------------------- */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    auto* q      = new QueueDefinition;
+    q->length    = length;
+    q->item_size = item_size;
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void* item, TickType_t ticks, bool front)
+{
+    std::unique_lock<std::mutex> lock(q->mutex);
+    if (!wait_for(q->not_full, lock, ticks, [q] { return q->items.size() < q->length; })) {
+        return pdFALSE;
+    }
+    std::vector<uint8_t> data(q->item_size);
+    if (q->item_size > 0) {
+        std::memcpy(data.data(), item, q->item_size);
+    }
+    if (front) {
+        q->items.push_front(std::move(data));
+    } else {
+        q->items.push_back(std::move(data));
+    }
+    q->not_empty.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait)
+{
+    return queue_send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait)
+{
+    return queue_send(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> lock(q->mutex);
+    if (!wait_for(q->not_empty, lock, ticks_to_wait, [q] { return !q->items.empty(); })) {
+        return pdFALSE;
+    }
+    if (q->item_size > 0) {
+        std::memcpy(item, q->items.front().data(), q->item_size);
+    }
+    q->items.pop_front();
+    q->not_full.notify_one();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    return static_cast<UBaseType_t>(q->items.size());
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    q->items.clear();
+    q->not_full.notify_all();
+    return pdPASS;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Semaphores                                 */
+/* -------------------------------------------------------------------------- */
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    // Not recursive and without priority inheritance, fine for the host
+    auto* sem = xQueueCreate(1, 0);
+    xSemaphoreGive(sem);
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    auto* sem = xQueueCreate(max_count, 0);
+    for (UBaseType_t i = 0; i < initial_count; ++i) {
+        xSemaphoreGive(sem);
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return queue_send(sem, nullptr, 0, false);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    return xQueueReceive(sem, nullptr, ticks_to_wait);
+}
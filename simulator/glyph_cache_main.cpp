@@ -0,0 +1,191 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/ui/glyph_cache.h>
+#include <M5GFX.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+/**
+ * Host checks and benchmark of the efontCN_12 glyph cache
+ *
+ * A screen of list rows mixing ASCII and CJK, like the Music and Pictures lists, is drawn through the cache and through
+ * the font renderer with every text datum, and the two canvases have to match pixel for pixel. A font too large to
+ * cache has to go to the renderer without a miss after the first draw. Then the screen is drawn for -s seconds each way
+ * and the glyphs per millisecond are printed with the speedup. Fails when any check is off.
+ */
+static int failures = 0;
+
+static constexpr int kWidth  = 240;
+static constexpr int kHeight = 115;
+static constexpr int kRowH   = 14;
+
+static const char* kRows[] = {
+    "01 - 晴天.mp3",
+    "02 - Hotel California.mp3",
+    "03 - 青花瓷 (Live).mp3",
+    "IMG_20240612_183045.jpg",
+    "旅行 2024 / 京都 清水寺.png",
+    "Cardputer 设置 屏幕亮度 80%",
+    "04 - 夜曲 Nocturne.flac",
+    "README 说明.txt 12.4 KB",
+};
+static constexpr int kRowCount = sizeof(kRows) / sizeof(kRows[0]);
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+static int count_glyphs(const char* s)
+{
+    int n = 0;
+    for (; *s; ++s) {
+        n += (static_cast<uint8_t>(*s) & 0xC0) != 0x80;
+    }
+    return n;
+}
+
+static void setup(LGFX_Sprite& canvas, const lgfx::IFont* font, textdatum_t datum)
+{
+    canvas.fillScreen(TFT_BLACK);
+    canvas.setFont(font);
+    canvas.setTextSize(1);
+    canvas.setTextDatum(datum);
+}
+
+static void draw_screen(LGFX_Sprite& canvas, GlyphCache* cache, int y0)
+{
+    for (int i = 0; i < kRowCount; ++i) {
+        const uint16_t bg = i == 2 ? TFT_NAVY : TFT_BLACK;
+        if (cache) {
+            cache->drawString(canvas, kRows[i], 4, y0 + i * kRowH, TFT_WHITE, bg);
+        } else {
+            canvas.setTextColor(TFT_WHITE, bg);
+            canvas.drawString(kRows[i], 4, y0 + i * kRowH);
+        }
+    }
+}
+
+static int diff_pixels(LGFX_Sprite& a, LGFX_Sprite& b)
+{
+    int diff = 0;
+    for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+            diff += a.readPixel(x, y) != b.readPixel(x, y);
+        }
+    }
+    return diff;
+}
+
+static void check_datum(LGFX_Sprite& a, LGFX_Sprite& b, GlyphCache& cache, textdatum_t datum, const char* label)
+{
+    // Rows anchored by their bottom or baseline start one row lower so every datum stays on screen
+    const int y0 = (datum & 0x18) ? kRowH : (datum & 0x04) ? kRowH / 2 : 0;
+    setup(a, &fonts::efontCN_12, datum);
+    setup(b, &fonts::efontCN_12, datum);
+    draw_screen(a, &cache, y0);
+    draw_screen(b, nullptr, y0);
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s matches the font renderer", label);
+    check(name, diff_pixels(a, b), 0, 0, "px");
+}
+
+static void check_uncacheable(LGFX_Sprite& canvas)
+{
+    GlyphCache big(&fonts::Font4);
+    setup(canvas, &fonts::Font4, textdatum_t::top_left);
+    big.drawString(canvas, "ABC", 0, 0, TFT_WHITE, TFT_BLACK);
+    const uint32_t misses = big.misses();
+    big.drawString(canvas, "ABC", 0, 0, TFT_WHITE, TFT_BLACK);
+    check("oversized glyphs missed again", big.misses() - misses, 0, 0, "");
+}
+
+static double bench(LGFX_Sprite& canvas, GlyphCache* cache, float seconds, int glyphs_per_screen)
+{
+    setup(canvas, &fonts::efontCN_12, textdatum_t::top_left);
+    draw_screen(canvas, cache, 0);
+
+    long screens  = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    double ms     = 0.0;
+    do {
+        for (int i = 0; i < 16; ++i) {
+            draw_screen(canvas, cache, 0);
+        }
+        screens += 16;
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    } while (ms < seconds * 1000.0);
+
+    const double rate = screens * glyphs_per_screen / ms;
+    std::printf("%-34s %10.1f glyphs/ms %8.1f us/screen\n", cache ? "cached" : "font renderer", rate,
+                ms * 1000.0 / screens);
+    return rate;
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -s <sec>   drawing per benchmark (default 2)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds  = 2.0f;
+    bool benchmark = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LGFX_Sprite a, b;
+    a.setColorDepth(16);
+    b.setColorDepth(16);
+    if (!a.createSprite(kWidth, kHeight) || !b.createSprite(kWidth, kHeight)) {
+        std::fprintf(stderr, "create canvas failed\n");
+        return 1;
+    }
+
+    GlyphCache cache(&fonts::efontCN_12);
+    check_datum(a, b, cache, textdatum_t::top_left, "top left");
+    check_datum(a, b, cache, textdatum_t::middle_left, "middle left");
+    check_datum(a, b, cache, textdatum_t::bottom_left, "bottom left");
+    check_datum(a, b, cache, textdatum_t::baseline_left, "baseline left");
+    check_datum(a, b, cache, textdatum_t::top_center, "top center");
+    check_uncacheable(a);
+
+    int glyphs = 0;
+    for (const char* row : kRows) {
+        glyphs += count_glyphs(row);
+    }
+    std::printf("\n%d rows, %d glyphs per screen\n", kRowCount, glyphs);
+
+    if (benchmark) {
+        const double uncached = bench(a, nullptr, seconds, glyphs);
+        const double cached   = bench(a, &cache, seconds, glyphs);
+        check("speedup", cached / uncached, 1.0, 1000.0, "x");
+        check("hit rate", 100.0 * cache.hits() / (cache.hits() + cache.misses()), 99.0, 100.0, "%");
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
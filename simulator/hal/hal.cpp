@@ -0,0 +1,158 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "hal.h"
+#include <apps/utils/audio/audio_mixer.h>
+#include <mooncake_log.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+static const std::string _tag = "HalSim";
+// Defined before GetHAL()'s instance so it outlives ~Hal(), which stops it
+static AudioMixer _mixer;
+
+Hal::Hal() : mixer(_mixer)
+{
+}
+
+Hal& GetHAL()
+{
+    static Hal hal;
+    return hal;
+}
+
+void Hal::init()
+{
+    mclog::tagInfo(_tag, "init");
+
+    framebuffer.setColorDepth(16);
+    framebuffer.createSprite(240, 135);
+    framebuffer.fillScreen(TFT_BLACK);
+
+    canvasSystemBar.setColorDepth(16);
+    canvasSystemBar.createSprite(240, 20);
+    canvas.setColorDepth(16);
+    canvas.createSprite(240, 115);
+
+    keyboard.init();
+
+    struct stat st;
+    _is_sd_card_mounted = stat(_config.sdcard_dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    mclog::tagInfo(_tag, "sd card dir: {} ({})", _config.sdcard_dir, _is_sd_card_mounted ? "mounted" : "missing");
+
+    if (!_config.pcm_path.empty()) {
+        _pcm_sink = std::fopen(_config.pcm_path.c_str(), "wb");
+        if (_pcm_sink) {
+            mclog::tagInfo(_tag, "pcm sink: {} (s16le stereo)", _config.pcm_path);
+        } else {
+            mclog::tagError(_tag, "open pcm sink {} failed", _config.pcm_path);
+        }
+    }
+    AudioMixer::Output_t output;
+    output.write = pcm_write;
+    output.ctx   = this;
+    mixer.begin(output);
+}
+
+void Hal::update()
+{
+    profiler::ScopedMarker marker(profiler::Marker::KeyDispatch);
+    keyboard.update();
+
+    if (_sd_card_changed) {
+        _sd_card_changed = false;
+        onSdCardEvent.emit({_is_sd_card_mounted});
+    }
+}
+
+void Hal::setSdCardPresent(bool present)
+{
+    struct stat st;
+    const bool mounted = present && stat(_config.sdcard_dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    if (mounted != _is_sd_card_mounted) {
+        _is_sd_card_mounted = mounted;
+        _sd_card_changed    = true;
+        mclog::tagInfo(_tag, "sd card {}", mounted ? "inserted" : "removed");
+    }
+}
+
+void Hal::idleUntil(std::uint32_t deadline_ms)
+{
+    uint32_t wait_ms = _config.tick_ms;
+    if (deadline_ms != UINT32_MAX) {
+        const int32_t remain = static_cast<int32_t>(deadline_ms - _now_ms);
+        wait_ms              = remain > 0 ? std::min(static_cast<uint32_t>(remain), _config.tick_ms) : 0;
+    }
+    if (wait_ms == 0 || keyboard.hasPendingEvents()) {
+        wait_ms = 1;
+    }
+    _now_ms += wait_ms;
+}
+
+std::uint32_t Hal::getSdCardClusterSize()
+{
+    struct stat st;
+    if (!_is_sd_card_mounted || stat(_config.sdcard_dir.c_str(), &st) != 0) {
+        return 0;
+    }
+    return static_cast<std::uint32_t>(st.st_blksize);
+}
+
+bool Hal::dumpFramebuffer(const std::string& path)
+{
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        mclog::tagError(_tag, "open {} failed", path);
+        return false;
+    }
+
+    const int w = framebuffer.width();
+    const int h = framebuffer.height();
+    std::fprintf(f, "P6\n%d %d\n255\n", w, h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            const auto c         = framebuffer.readPixelRGB(x, y);
+            const uint8_t rgb[3] = {c.R8(), c.G8(), c.B8()};
+            std::fwrite(rgb, 1, sizeof(rgb), f);
+        }
+    }
+    std::fclose(f);
+    mclog::tagInfo(_tag, "framebuffer dumped to {}", path);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Audio                                   */
+/* -------------------------------------------------------------------------- */
+Hal::~Hal()
+{
+    // The mixer task writes to the sink until it stops
+    mixer.end();
+    if (_pcm_sink) {
+        std::fclose(_pcm_sink);
+    }
+}
+
+// Stands in for the I2S DMA, a block takes as long to write as it takes to play
+bool Hal::pcm_write(const int16_t* frames, size_t count, void* ctx)
+{
+    auto* hal = static_cast<Hal*>(ctx);
+    if (hal->_pcm_sink) {
+        std::fwrite(frames, sizeof(int16_t) * 2, count, hal->_pcm_sink);
+    }
+    hal->_pcm_frames += count;
+    std::this_thread::sleep_for(std::chrono::microseconds(count * 1000000 / hal->mixer.sampleRate()));
+    return true;
+}
+
+size_t Hal::micRead(int16_t* frames, size_t count, std::uint32_t timeout_ms)
+{
+    const uint32_t ms = std::min<uint32_t>(timeout_ms, count * 1000 / mixer.sampleRate());
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    std::fill(frames, frames + count * 2, 0);
+    return count;
+}
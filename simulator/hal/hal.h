@@ -0,0 +1,186 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include "keyboard/keyboard.h"
+#include <hal/utils/profiler/profiler.h>
+#include <M5GFX.h>
+#include <mooncake_log_signal.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class AudioMixer;
+
+/**
+ * Host stand-in for the device Hal
+ *
+ * Shadows main/hal/hal.h through the include path and exposes the same members the apps touch. Time is a virtual
+ * clock advanced by idleUntil() so runs are deterministic, both canvases are pushed into an in-memory framebuffer
+ * that can be dumped as PPM, speaker output goes to a raw PCM file and the SD card is a host directory.
+ */
+class Hal {
+public:
+    struct Config_t {
+        std::string sdcard_dir = "./sdcard";
+        std::string pcm_path;
+        uint32_t tick_ms = 20;
+    };
+
+    Hal();
+    ~Hal();
+    void init();
+    void update();
+
+    Config_t& config()
+    {
+        return _config;
+    }
+
+    /* --------------------------------- System --------------------------------- */
+    void delay(std::uint32_t ms)
+    {
+        _now_ms += ms;
+    }
+    std::uint32_t millis()
+    {
+        return _now_ms;
+    }
+    void feedTheDog()
+    {
+        _now_ms += 1;
+    }
+
+    /** Jumps the virtual clock to the deadline, at most tick_ms ahead and by 1ms while keys are pending */
+    void idleUntil(std::uint32_t deadline_ms);
+
+    /* --------------------------------- Display -------------------------------- */
+    class Display {
+    public:
+        void setBrightness(uint8_t brightness)
+        {
+            _brightness = brightness;
+        }
+        uint8_t getBrightness() const
+        {
+            return _brightness;
+        }
+
+    private:
+        uint8_t _brightness = 0;
+    };
+
+    Display display;
+    LGFX_Sprite canvas;
+    LGFX_Sprite canvasSystemBar;
+    LGFX_Sprite framebuffer;
+
+    inline void pushStatusBar()
+    {
+        profiler::ScopedMarker marker(profiler::Marker::Push);
+        profiler::addPushBytes(canvasSystemBar.bufferLength());
+        canvasSystemBar.pushSprite(&framebuffer, 0, 0);
+        _frame_count++;
+    }
+    inline void pushAppCanvas()
+    {
+        profiler::ScopedMarker marker(profiler::Marker::Push);
+        profiler::addPushBytes(canvas.bufferLength());
+        canvas.pushSprite(&framebuffer, 0, 21);
+        profiler::pushOverlay(&framebuffer, 0, 21, canvas.width());
+        _frame_count++;
+    }
+    inline void pushCanvas()
+    {
+        pushAppCanvas();
+    }
+    uint32_t getFrameCount() const
+    {
+        return _frame_count;
+    }
+    bool dumpFramebuffer(const std::string& path);
+
+    /* ---------------------------------- Audio --------------------------------- */
+    /** Same mixer as the device, its output goes to the PCM sink as s16le stereo, paced in real time */
+    AudioMixer& mixer;
+
+    /** No mic on the host: waits for the frames to come due and returns silence */
+    size_t micRead(int16_t* frames, size_t count, std::uint32_t timeout_ms);
+    /** Frames the mixer played, written to the sink or not */
+    size_t getPcmFramesWritten() const
+    {
+        return _pcm_frames.load();
+    }
+
+    /* ---------------------------------- Input --------------------------------- */
+    class Button {
+    public:
+        bool wasPressed()
+        {
+            bool ret = _pressed;
+            _pressed = false;
+            return ret;
+        }
+        void press()
+        {
+            _pressed = true;
+        }
+
+    private:
+        bool _pressed = false;
+    };
+
+    Button homeButton;
+    Keyboard keyboard;
+
+    /* ---------------------------------- Power --------------------------------- */
+    inline uint8_t getBatLevel()
+    {
+        return 100;
+    }
+
+    /* --------------------------------- SD Card -------------------------------- */
+    struct SdCardEvent_t {
+        bool mounted = false;
+    };
+    mclog::Signal<const SdCardEvent_t&> onSdCardEvent;
+
+    /** Pretend the card was pulled or pushed back in, onSdCardEvent is emitted by the next update() */
+    void setSdCardPresent(bool present);
+    bool isSdCardMounted() const
+    {
+        return _is_sd_card_mounted;
+    }
+    const char* getSdCardMountPoint() const
+    {
+        return _config.sdcard_dir.c_str();
+    }
+    /** There is no bus to clock, the host folder stays as it is */
+    bool setSdCardFrequency(std::uint32_t freq_khz)
+    {
+        (void)freq_khz;
+        return _is_sd_card_mounted;
+    }
+    std::uint32_t getSdCardFrequency() const
+    {
+        return 0;
+    }
+    /** Block size of the host file system */
+    std::uint32_t getSdCardClusterSize();
+
+private:
+    Config_t _config;
+    uint32_t _now_ms         = 0;
+    uint32_t _frame_count    = 0;
+    bool _is_sd_card_mounted = false;
+    bool _sd_card_changed    = false;
+    std::FILE* _pcm_sink     = nullptr;
+    std::atomic<size_t> _pcm_frames{0};
+
+    static bool pcm_write(const int16_t* frames, size_t count, void* ctx);
+};
+
+Hal& GetHAL();
@@ -0,0 +1,69 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "keyboard.h"
+#include <hal/keyboard/key_convert.h>
+#include <mooncake_log.h>
+
+static const std::string _tag = "KeyboardSim";
+
+bool Keyboard::init()
+{
+    mclog::tagInfo(_tag, "init");
+    return true;
+}
+
+void Keyboard::update()
+{
+    clearKeyEvent();
+
+    if (_pending.empty()) {
+        return;
+    }
+
+    _key_event_raw_buffer = _pending.front();
+    _pending.pop_front();
+    onKeyEventRaw.emit(_key_event_raw_buffer);
+
+    update_modifier_mask(_key_event_raw_buffer);
+    _key_event_buffer = convertToKeyEvent(_key_event_raw_buffer);
+    if (_key_filter && _key_filter(_key_event_buffer)) {
+        _key_event_buffer.keyCode = KEY_NONE;
+        return;
+    }
+    onKeyEvent.emit(_key_event_buffer);
+}
+
+bool Keyboard::inject(std::string_view keyName, bool state)
+{
+    for (uint8_t row = 0; row < 4; ++row) {
+        for (uint8_t col = 0; col < 14; ++col) {
+            if (keyName == _key_value_map[row][col].firstName) {
+                _pending.push_back({state, row, col});
+                return true;
+            }
+        }
+    }
+    mclog::tagWarn(_tag, "unknown key: {}", keyName);
+    return false;
+}
+
+void Keyboard::update_modifier_mask(const KeyEventRaw_t& key)
+{
+    key_convert::updateModifierMask(key.row, key.col, key.state, _modifier_mask, _capslock_state);
+}
+
+Keyboard::KeyEvent_t Keyboard::convertToKeyEvent(const KeyEventRaw_t& key)
+{
+    return key_convert::toKeyEvent<KeyEvent_t>(key, _modifier_mask, _capslock_state || _is_capslock_locked);
+}
+
+void Keyboard::clearKeyEvent()
+{
+    _key_event_raw_buffer.state = false;
+    _key_event_raw_buffer.row   = 233;
+    _key_event_raw_buffer.col   = 233;
+    _key_event_buffer.keyCode   = KEY_NONE;
+}
@@ -0,0 +1,86 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <hal/keyboard/keymap.h>
+#include <mooncake_log_signal.h>
+#include <deque>
+#include <string_view>
+
+/**
+ * Host stand-in for the TCA8418 keyboard
+ *
+ * Raw events are injected by name ("a", "enter", "ctrl", ";" ...) using the same matrix as the device, then go
+ * through the same modifier tracking and key event conversion. One queued event is dispatched per update(), like one
+ * interrupt per loop on the device.
+ */
+class Keyboard {
+public:
+    struct KeyEventRaw_t {
+        bool state  = false;
+        uint8_t row = 0;
+        uint8_t col = 0;
+    };
+
+    struct KeyEvent_t {
+        bool state           = false;
+        bool isModifier      = false;
+        KeScanCode_t keyCode = KEY_NONE;
+        const char* keyName  = "";
+    };
+
+    mclog::Signal<const KeyEventRaw_t&> onKeyEventRaw;
+    mclog::Signal<const KeyEvent_t&> onKeyEvent;
+
+    /** Sees each key event before onKeyEvent, returning true takes it. For system shortcuts the apps must not get */
+    using KeyFilter_t = bool (*)(const KeyEvent_t& keyEvent);
+    inline void setKeyFilter(KeyFilter_t filter)
+    {
+        _key_filter = filter;
+    }
+
+    bool init();
+    void update();
+    inline uint8_t getModifierMask()
+    {
+        return _modifier_mask;
+    }
+    inline bool isCapsLocked()
+    {
+        return _is_capslock_locked;
+    }
+    inline void setCapsLocked(bool locked)
+    {
+        _is_capslock_locked = locked;
+    }
+    inline const KeyEvent_t& getLatestKeyEvent()
+    {
+        return _key_event_buffer;
+    }
+    inline const KeyEventRaw_t& getLatestKeyEventRaw()
+    {
+        return _key_event_raw_buffer;
+    }
+    void clearKeyEvent();
+    KeyEvent_t convertToKeyEvent(const KeyEventRaw_t& key);
+
+    /** Queue a press or release of the key with the given unshifted name, false if no such key */
+    bool inject(std::string_view keyName, bool state);
+    bool hasPendingEvents() const
+    {
+        return !_pending.empty();
+    }
+
+private:
+    KeyFilter_t _key_filter  = nullptr;
+    uint8_t _modifier_mask   = 0;
+    bool _capslock_state     = false;
+    bool _is_capslock_locked = false;
+    KeyEventRaw_t _key_event_raw_buffer;
+    KeyEvent_t _key_event_buffer;
+    std::deque<KeyEventRaw_t> _pending;
+
+    void update_modifier_mask(const KeyEventRaw_t& key);
+};
@@ -0,0 +1,571 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/image/image_decoder.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Host checks and benchmark of the JPEG, BMP and QOI decoders behind ImageDecoder
+ *
+ * The same -w x -h photo stand in, gradients under a little noise, is written as a baseline 4:2:0 JPEG, a 24-bit BMP
+ * and a QOI file in -d, and each is opened through the registry the way the Pictures app does. Every format is decoded
+ * reduced to fit the 240 x 115 Pictures view and in full into a frame buffer, the reduced images have to match a box
+ * average of the source, and the time and peak bytes of both are printed as a table. Files cut short or with sizes
+ * out of range have to be rejected. Fails when any check is off.
+ */
+static int failures = 0;
+
+static constexpr int kViewW = 240;
+static constexpr int kViewH = 115;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+struct Image_t {
+    int w = 0;
+    int h = 0;
+    std::vector<uint8_t> rgb;
+
+    const uint8_t* at(int x, int y) const
+    {
+        x = std::clamp(x, 0, w - 1);
+        y = std::clamp(y, 0, h - 1);
+        return &rgb[(static_cast<size_t>(y) * w + x) * 3];
+    }
+};
+
+static Image_t make_photo(int w, int h)
+{
+    Image_t img{w, h, std::vector<uint8_t>(static_cast<size_t>(w) * h * 3)};
+    uint32_t seed = 1;
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            seed        = seed * 1664525u + 1013904223u;
+            const int n = static_cast<int>(seed >> 29) - 4;
+            uint8_t* p  = &img.rgb[(static_cast<size_t>(y) * w + x) * 3];
+            p[0]        = static_cast<uint8_t>(std::clamp(x * 255 / w + n, 0, 255));
+            p[1]        = static_cast<uint8_t>(std::clamp(y * 255 / h + n, 0, 255));
+            p[2]        = static_cast<uint8_t>(std::clamp(128 + (x - y) * 127 / w + n, 0, 255));
+        }
+    }
+    // Far from its neighbours and never seen before, so QOI has to spell the last pixel out in full
+    uint8_t* last = &img.rgb[img.rgb.size() - 3];
+    last[0]       = 0;
+    last[1]       = 255;
+    last[2]       = 0;
+    return img;
+}
+
+static bool write_file(const std::string& path, const std::vector<uint8_t>& data)
+{
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    const bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+    return std::fclose(f) == 0 && ok;
+}
+
+static void put_le16(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+static void put_le32(std::vector<uint8_t>& out, uint32_t v)
+{
+    put_le16(out, v & 0xFFFF);
+    put_le16(out, v >> 16);
+}
+
+static void put_be16(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static void put_be32(std::vector<uint8_t>& out, uint32_t v)
+{
+    put_be16(out, v >> 16);
+    put_be16(out, v & 0xFFFF);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    BMP                                     */
+/* -------------------------------------------------------------------------- */
+/** Bottom-up 24-bit, height_field overrides the height written to the header */
+static std::vector<uint8_t> encode_bmp(const Image_t& img, int32_t height_field)
+{
+    const uint32_t stride = (static_cast<uint32_t>(img.w) * 3 + 3) & ~3u;
+    const uint32_t size   = stride * img.h;
+    std::vector<uint8_t> out = {'B', 'M'};
+    put_le32(out, 54 + size);
+    put_le32(out, 0);
+    put_le32(out, 54);
+    put_le32(out, 40);
+    put_le32(out, img.w);
+    put_le32(out, static_cast<uint32_t>(height_field));
+    put_le16(out, 1);
+    put_le16(out, 24);
+    put_le32(out, 0);
+    put_le32(out, size);
+    put_le32(out, 2835);
+    put_le32(out, 2835);
+    put_le32(out, 0);
+    put_le32(out, 0);
+    for (int y = img.h - 1; y >= 0; --y) {
+        for (int x = 0; x < img.w; ++x) {
+            const uint8_t* p = img.at(x, y);
+            out.insert(out.end(), {p[2], p[1], p[0]});
+        }
+        out.resize(out.size() + stride - img.w * 3, 0);
+    }
+    return out;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    QOI                                     */
+/* -------------------------------------------------------------------------- */
+static std::vector<uint8_t> encode_qoi(const Image_t& img)
+{
+    std::vector<uint8_t> out = {'q', 'o', 'i', 'f'};
+    put_be32(out, img.w);
+    put_be32(out, img.h);
+    out.insert(out.end(), {3, 0});
+
+    uint8_t index[64][3] = {};
+    uint8_t prev[3]      = {0, 0, 0};
+    int run              = 0;
+    const size_t count   = static_cast<size_t>(img.w) * img.h;
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* px = &img.rgb[i * 3];
+        if (std::memcmp(px, prev, 3) == 0) {
+            if (++run == 62 || i + 1 == count) {
+                out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+            run = 0;
+        }
+        const int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) & 63;
+        if (std::memcmp(index[hash], px, 3) == 0) {
+            out.push_back(static_cast<uint8_t>(hash));
+        } else {
+            std::memcpy(index[hash], px, 3);
+            const int8_t dr   = static_cast<int8_t>(px[0] - prev[0]);
+            const int8_t dg   = static_cast<int8_t>(px[1] - prev[1]);
+            const int8_t db   = static_cast<int8_t>(px[2] - prev[2]);
+            const int8_t dr_g = static_cast<int8_t>(dr - dg);
+            const int8_t db_g = static_cast<int8_t>(db - dg);
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+            } else if (dg >= -32 && dg <= 31 && dr_g >= -8 && dr_g <= 7 && db_g >= -8 && db_g <= 7) {
+                out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                out.push_back(static_cast<uint8_t>((dr_g + 8) << 4 | (db_g + 8)));
+            } else {
+                out.insert(out.end(), {0xFE, px[0], px[1], px[2]});
+            }
+        }
+        std::memcpy(prev, px, 3);
+    }
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return out;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    JPEG                                    */
+/* -------------------------------------------------------------------------- */
+static constexpr uint8_t kZigzag[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+                                        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+                                        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+                                        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// Annex K luminance quantizer and Huffman tables, shared by all three components
+static constexpr uint8_t kQuant[64] = {16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+                                       14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+                                       18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+                                       49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+static constexpr uint8_t kDcCounts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static constexpr uint8_t kDcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static constexpr uint8_t kAcCounts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+static constexpr uint8_t kAcValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14,
+    0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09,
+    0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65,
+    0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+    0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9,
+    0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA,
+    0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA,
+    0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA};
+
+class JpegWriter {
+public:
+    std::vector<uint8_t> encode(const Image_t& img, int quality)
+    {
+        const int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+        for (int i = 0; i < 64; ++i) {
+            _quant[i] = static_cast<uint8_t>(std::clamp((kQuant[i] * scale + 50) / 100, 1, 255));
+        }
+        build_codes(kDcCounts, kDcValues, _dc_code, _dc_len);
+        build_codes(kAcCounts, kAcValues, _ac_code, _ac_len);
+
+        _out = {0xFF, 0xD8};
+        segment(0xDB, 65);
+        _out.push_back(0);
+        for (int i = 0; i < 64; ++i) {
+            _out.push_back(_quant[kZigzag[i]]);
+        }
+        segment(0xC0, 15);
+        _out.push_back(8);
+        put_be16(_out, img.h);
+        put_be16(_out, img.w);
+        _out.insert(_out.end(), {3, 1, 0x22, 0, 2, 0x11, 0, 3, 0x11, 0});
+        segment(0xC4, 1 + 16 + 12 + 1 + 16 + 162);
+        _out.push_back(0x00);
+        _out.insert(_out.end(), kDcCounts, kDcCounts + 16);
+        _out.insert(_out.end(), kDcValues, kDcValues + 12);
+        _out.push_back(0x10);
+        _out.insert(_out.end(), kAcCounts, kAcCounts + 16);
+        _out.insert(_out.end(), kAcValues, kAcValues + 162);
+        segment(0xDA, 10);
+        _out.insert(_out.end(), {3, 1, 0x00, 2, 0x00, 3, 0x00, 0, 63, 0});
+
+        int pred[3] = {0, 0, 0};
+        float block[64];
+        for (int my = 0; my < img.h; my += 16) {
+            for (int mx = 0; mx < img.w; mx += 16) {
+                for (int b = 0; b < 4; ++b) {
+                    const int x0 = mx + (b & 1) * 8;
+                    const int y0 = my + (b >> 1) * 8;
+                    for (int i = 0; i < 64; ++i) {
+                        const uint8_t* p = img.at(x0 + (i & 7), y0 + (i >> 3));
+                        block[i]         = 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] - 128.0f;
+                    }
+                    encode_block(block, pred[0]);
+                }
+                for (int c = 1; c < 3; ++c) {
+                    for (int i = 0; i < 64; ++i) {
+                        float sum = 0.0f;
+                        for (int k = 0; k < 4; ++k) {
+                            const uint8_t* p = img.at(mx + (i & 7) * 2 + (k & 1), my + (i >> 3) * 2 + (k >> 1));
+                            sum += c == 1 ? -0.168736f * p[0] - 0.331264f * p[1] + 0.5f * p[2]
+                                          : 0.5f * p[0] - 0.418688f * p[1] - 0.081312f * p[2];
+                        }
+                        block[i] = sum / 4.0f;
+                    }
+                    encode_block(block, pred[c]);
+                }
+            }
+        }
+        // Pad the last byte with ones
+        put_bits(0x7F, 7);
+        _out.insert(_out.end(), {0xFF, 0xD9});
+        return std::move(_out);
+    }
+
+private:
+    std::vector<uint8_t> _out;
+    uint8_t _quant[64];
+    uint16_t _dc_code[256], _ac_code[256];
+    uint8_t _dc_len[256], _ac_len[256];
+    uint32_t _bits = 0;
+    int _nbits     = 0;
+
+    void segment(uint8_t marker, int payload)
+    {
+        _out.insert(_out.end(), {0xFF, marker});
+        put_be16(_out, payload + 2);
+    }
+
+    static void build_codes(const uint8_t* counts, const uint8_t* values, uint16_t* code, uint8_t* len)
+    {
+        int c = 0, k = 0;
+        for (int l = 1; l <= 16; ++l, c <<= 1) {
+            for (int i = 0; i < counts[l - 1]; ++i, ++k, ++c) {
+                code[values[k]] = static_cast<uint16_t>(c);
+                len[values[k]]  = static_cast<uint8_t>(l);
+            }
+        }
+    }
+
+    void put_bits(uint32_t v, int n)
+    {
+        _bits = (_bits << n) | (v & ((1u << n) - 1));
+        _nbits += n;
+        while (_nbits >= 8) {
+            const uint8_t byte = static_cast<uint8_t>(_bits >> (_nbits - 8));
+            _out.push_back(byte);
+            if (byte == 0xFF) {
+                _out.push_back(0);
+            }
+            _nbits -= 8;
+        }
+    }
+
+    void put_value(int v, const uint16_t* code, const uint8_t* len, int run)
+    {
+        int size = 0;
+        for (int a = std::abs(v); a; a >>= 1) {
+            size++;
+        }
+        const int symbol = (run << 4) | size;
+        put_bits(code[symbol], len[symbol]);
+        if (size > 0) {
+            put_bits(v < 0 ? v - 1 : v, size);
+        }
+    }
+
+    void encode_block(const float* in, int& pred)
+    {
+        // Separable float DCT, slow but plain
+        float tmp[64];
+        int q[64];
+        for (int y = 0; y < 8; ++y) {
+            for (int u = 0; u < 8; ++u) {
+                float sum = 0.0f;
+                for (int x = 0; x < 8; ++x) {
+                    sum += in[y * 8 + x] * std::cos((2 * x + 1) * u * static_cast<float>(M_PI) / 16.0f);
+                }
+                tmp[y * 8 + u] = sum * (u == 0 ? std::sqrt(0.5f) : 1.0f) / 2.0f;
+            }
+        }
+        for (int u = 0; u < 8; ++u) {
+            for (int v = 0; v < 8; ++v) {
+                float sum = 0.0f;
+                for (int y = 0; y < 8; ++y) {
+                    sum += tmp[y * 8 + u] * std::cos((2 * y + 1) * v * static_cast<float>(M_PI) / 16.0f);
+                }
+                sum *= (v == 0 ? std::sqrt(0.5f) : 1.0f) / 2.0f;
+                q[v * 8 + u] = static_cast<int>(std::lround(sum / _quant[v * 8 + u]));
+            }
+        }
+
+        put_value(q[0] - pred, _dc_code, _dc_len, 0);
+        pred    = q[0];
+        int run = 0;
+        for (int k = 1; k < 64; ++k) {
+            const int v = q[kZigzag[k]];
+            if (v == 0) {
+                run++;
+                continue;
+            }
+            for (; run >= 16; run -= 16) {
+                put_bits(_ac_code[0xF0], _ac_len[0xF0]);
+            }
+            put_value(v, _ac_code, _ac_len, run);
+            run = 0;
+        }
+        if (run > 0) {
+            put_bits(_ac_code[0x00], _ac_len[0x00]);
+        }
+    }
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                   Checks                                   */
+/* -------------------------------------------------------------------------- */
+/** Mean error per channel of a reduced RGB565 image against the box average of the source */
+static double box_error(const Image_t& img, int factor, const uint16_t* out, int out_w, int out_h)
+{
+    double err = 0.0;
+    for (int oy = 0; oy < out_h; ++oy) {
+        for (int ox = 0; ox < out_w; ++ox) {
+            uint32_t sum[3] = {0, 0, 0};
+            int n           = 0;
+            for (int y = oy * factor; y < std::min(img.h, (oy + 1) * factor); ++y) {
+                for (int x = ox * factor; x < std::min(img.w, (ox + 1) * factor); ++x) {
+                    const uint8_t* p = img.at(x, y);
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                    n++;
+                }
+            }
+            // Compared against the middle of the RGB565 step
+            const uint16_t v = __builtin_bswap16(out[oy * out_w + ox]);
+            const int got[3] = {(v >> 8) & 0xF8, (v >> 3) & 0xFC, (v << 3) & 0xF8};
+            const int lsb[3] = {4, 2, 4};
+            for (int c = 0; c < 3; ++c) {
+                err += std::abs(static_cast<int>(sum[c] / n) - (got[c] + lsb[c]));
+            }
+        }
+    }
+    return err / (3.0 * out_w * out_h);
+}
+
+struct Run_t {
+    double ms         = 0.0;
+    size_t peak_bytes = 0;
+    double error      = 0.0;
+};
+
+/** Decode reduced by factor for seconds, peak bytes include the destination buffer */
+static Run_t bench(const std::string& path, const Image_t& img, int factor, float seconds)
+{
+    Run_t run;
+    auto decoder = openImageDecoder(path.c_str());
+    if (!decoder) {
+        return run;
+    }
+    const int out_w = ImageDecoder::scaledSize(decoder->width(), factor);
+    const int out_h = ImageDecoder::scaledSize(decoder->height(), factor);
+    std::vector<uint16_t> out(static_cast<size_t>(out_w) * out_h, 0);
+
+    long decodes  = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    double ms     = 0.0;
+    do {
+        if (!decoder->open(path.c_str()) || !decoder->decodeInto(factor, out.data(), out_w, out_h)) {
+            return Run_t{};
+        }
+        decodes++;
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    } while (ms < seconds * 1000.0);
+
+    run.ms         = ms / decodes;
+    run.peak_bytes = decoder->stats().peak_bytes + out.size() * sizeof(uint16_t);
+    run.error      = box_error(img, factor, out.data(), out_w, out_h);
+    return run;
+}
+
+/** True if the file opens and decodes in full */
+static bool decodes(const std::string& path)
+{
+    auto decoder = openImageDecoder(path.c_str());
+    if (!decoder) {
+        return false;
+    }
+    std::vector<uint16_t> out(static_cast<size_t>(decoder->width()) * decoder->height());
+    return decoder->decodeInto(1, out.data(), decoder->width(), decoder->height());
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -w <px>    width of the generated images (default 1600)\n"
+        "  -h <px>    height of the generated images (default 1200)\n"
+        "  -d <dir>   folder for the generated images (default /tmp)\n"
+        "  -s <sec>   decoding per format and size (default 2)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    int width       = 1600;
+    int height      = 1200;
+    std::string dir = "/tmp";
+    float seconds   = 2.0f;
+    bool benchmark  = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-w") == 0 && has_value) {
+            width = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-h") == 0 && has_value) {
+            height = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-d") == 0 && has_value) {
+            dir = argv[++i];
+        } else if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (width < 16 || height < 16) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const Image_t img = make_photo(width, height);
+    struct Format_t {
+        const char* name;
+        std::string path;
+        std::vector<uint8_t> data;
+        double max_error;
+    };
+    Format_t formats[] = {
+        {"JPEG", dir + "/image_decode_bench.jpg", JpegWriter().encode(img, 90), 6.0},
+        {"BMP", dir + "/image_decode_bench.bmp", encode_bmp(img, img.h), 4.0},
+        {"QOI", dir + "/image_decode_bench.qoi", encode_qoi(img), 4.0},
+    };
+    for (const auto& f : formats) {
+        if (!write_file(f.path, f.data)) {
+            std::fprintf(stderr, "write %s failed\n", f.path.c_str());
+            return 1;
+        }
+    }
+
+    const int factor = ImageDecoder::factorToFit(width, height, kViewW, kViewH);
+    std::printf("%d x %d, 1/%d to fit %d x %d\n\n", width, height, factor, kViewW, kViewH);
+
+    // A single decode for the checks, the benchmark repeats them for -s seconds
+    Run_t reduced[3], full[3];
+    char name[64];
+    for (int i = 0; i < 3; ++i) {
+        const auto& f = formats[i];
+        reduced[i]    = bench(f.path, img, factor, benchmark ? seconds : 0.0f);
+        full[i]       = bench(f.path, img, 1, benchmark ? seconds : 0.0f);
+        std::snprintf(name, sizeof(name), "%s decodes", f.name);
+        check(name, reduced[i].peak_bytes > 0 && full[i].peak_bytes > 0, 1, 1, "");
+        std::snprintf(name, sizeof(name), "%s reduced error against box average", f.name);
+        check(name, reduced[i].error, 0, f.max_error, "/255");
+        std::snprintf(name, sizeof(name), "%s full error against source", f.name);
+        check(name, full[i].error, 0, f.max_error, "/255");
+        std::snprintf(name, sizeof(name), "%s reduced peak bytes", f.name);
+        check(name, reduced[i].peak_bytes / 1024.0, 0, 96, "KB");
+    }
+
+    // Cut inside the operands of QOI's last op, nothing but the operand check notices
+    const std::string cut = dir + "/image_decode_bench_cut.qoi";
+    const auto& qoi       = formats[2].data;
+    write_file(cut, std::vector<uint8_t>(qoi.begin(), qoi.end() - 8 - 2));
+    check("QOI cut inside its last op rejected", !decodes(cut), 1, 1, "");
+    write_file(cut, std::vector<uint8_t>(qoi.begin(), qoi.begin() + qoi.size() / 2));
+    check("QOI cut in half rejected", !decodes(cut), 1, 1, "");
+    std::remove(cut.c_str());
+
+    const std::string bad = dir + "/image_decode_bench_bad.bmp";
+    const Image_t tiny    = make_photo(16, 16);
+    write_file(bad, encode_bmp(tiny, INT32_MIN));
+    check("BMP with height INT32_MIN rejected", !decodes(bad), 1, 1, "");
+    write_file(bad, encode_bmp(tiny, 100000));
+    check("BMP taller than kMaxSize rejected", !decodes(bad), 1, 1, "");
+    const auto& bmp = formats[1].data;
+    write_file(bad, std::vector<uint8_t>(bmp.begin(), bmp.begin() + bmp.size() / 2));
+    check("BMP cut in half rejected", !decodes(bad), 1, 1, "");
+    std::remove(bad.c_str());
+
+    std::printf("\n%-6s %10s %12s %16s %12s %16s\n", "", "file KB", "reduced ms", "reduced peak KB", "full ms",
+                "full peak KB");
+    for (int i = 0; i < 3; ++i) {
+        std::printf("%-6s %10.1f %12.2f %16.1f %12.2f %16.1f\n", formats[i].name, formats[i].data.size() / 1024.0,
+                    reduced[i].ms, reduced[i].peak_bytes / 1024.0, full[i].ms, full[i].peak_bytes / 1024.0);
+    }
+    std::printf("\n");
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/jitter_buffer.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/**
+ * Host run of the loopback jitter buffer on a synthetic clock
+ *
+ * A producer pushes a sine in blocks at the nominal rate skewed by -d ppm, the consumer pulls blocks at exactly the
+ * nominal rate, both wake up late by up to -j us. Prints the controller state as CSV every 100 ms and fails when the
+ * true delay from capture to playback, averaged over one second, strays from the target by more than -e samples over
+ * the last half of the run, or the output jumps by more than the sine ever does (a click).
+ */
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -d <ppm>   capture clock drift against playback (default 200)\n"
+        "  -t <ms>    target delay (default 100)\n"
+        "  -T <ms>    switch to this target half way through, 0 to keep it (default 0)\n"
+        "  -s <sec>   run time (default 60)\n"
+        "  -j <us>    wake up jitter of both sides (default 1000)\n"
+        "  -e <n>     allowed delay error in samples (default 4)\n"
+        "  -q         summary only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    constexpr uint32_t kRate  = 16000;
+    constexpr size_t kBlock   = 128;
+    constexpr float kToneHz   = 440.0f;
+    constexpr float kToneAmpl = 8000.0f;
+
+    double drift_ppm  = 200.0;
+    uint32_t target   = 100;
+    uint32_t target_2 = 0;
+    double seconds    = 60.0;
+    uint32_t jitter   = 1000;
+    double max_error  = 4.0;
+    bool quiet        = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-d") == 0 && has_value) {
+            drift_ppm = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-t") == 0 && has_value) {
+            target = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-T") == 0 && has_value) {
+            target_2 = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-j") == 0 && has_value) {
+            jitter = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-e") == 0 && has_value) {
+            max_error = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    JitterBuffer jb;
+    if (!jb.init(32 * 1024, kRate)) {
+        std::fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    jb.setTarget(target * kRate / 1000);
+
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint32_t> late(0, jitter);
+    const double produce_period_us = kBlock * 1e6 / (kRate * (1.0 + drift_ppm * 1e-6));
+    const double consume_period_us = kBlock * 1e6 / kRate;
+    const int64_t end_us           = static_cast<int64_t>(seconds * 1e6);
+    const int64_t switch_us        = target_2 ? end_us / 2 : end_us;
+    const int64_t judge_us         = end_us / 2 + (target_2 ? end_us / 4 : 0);
+
+    // A full scale sine at kToneHz never moves more than this between two samples, interpolation included
+    const double max_step = kToneAmpl * 2.0 * M_PI * kToneHz / kRate * 1.05;
+
+    int16_t in[kBlock];
+    int16_t out[kBlock];
+    uint64_t produced = 0;
+    uint64_t pushes   = 0;
+    uint64_t pulls    = 0;
+    int16_t last_out  = 0;
+    double worst      = 0.0;
+    uint32_t clicks   = 0;
+    int64_t next_csv  = 0;
+    double error_sum  = 0.0;
+    uint32_t error_n  = 0;
+    int32_t rate_min  = INT32_MAX;
+    int32_t rate_max  = INT32_MIN;
+
+    if (!quiet) {
+        std::printf("time_ms,true_delay,delay,target,rate_ppm,underruns,overruns,resyncs\n");
+    }
+    // A block can only be pushed once all of it was captured
+    int64_t push_at = static_cast<int64_t>(produce_period_us) + late(rng);
+    int64_t pull_at = late(rng);
+    while (true) {
+        const int64_t now = std::min(push_at, pull_at);
+        if (now >= end_us) {
+            break;
+        }
+        if (now >= switch_us && target_2) {
+            jb.setTarget(target_2 * kRate / 1000);
+        }
+
+        if (push_at <= pull_at) {
+            for (auto& s : in) {
+                s = static_cast<int16_t>(kToneAmpl * std::sin(2.0 * M_PI * kToneHz * produced++ / kRate));
+            }
+            jb.push(in, kBlock, now);
+            pushes++;
+            push_at = static_cast<int64_t>((pushes + 1) * produce_period_us) + late(rng);
+            continue;
+        }
+
+        // Playback of this block starts on the nominal tick however late the task runs, compare what was captured by
+        // then with what it plays
+        const double tick     = pulls * consume_period_us;
+        const double captured = tick * 1e-6 * kRate * (1.0 + drift_ppm * 1e-6);
+        const double delay    = captured - jb.readPosition();
+        jb.pull(out, kBlock, now);
+        pulls++;
+        pull_at = static_cast<int64_t>(pulls * consume_period_us) + late(rng);
+        const auto st = jb.stats();
+        for (const int16_t s : out) {
+            // Fades go through zero slower than the sine, a click is a jump the sine can't make
+            if (std::abs(s - last_out) > max_step) {
+                clicks++;
+            }
+            last_out = s;
+        }
+        if (now >= judge_us) {
+            error_sum += delay - st.target;
+            rate_min = std::min(rate_min, st.rate_ppm);
+            rate_max = std::max(rate_max, st.rate_ppm);
+            if (++error_n == kRate / kBlock) {
+                worst     = std::max(worst, std::fabs(error_sum / error_n));
+                error_sum = 0.0;
+                error_n   = 0;
+            }
+        }
+        if (!quiet && now >= next_csv) {
+            next_csv += 100000;
+            std::printf("%lld,%.1f,%d,%d,%d,%u,%u,%u\n", static_cast<long long>(now / 1000), delay, st.delay,
+                        st.target, st.rate_ppm, st.underruns, st.overruns, st.resyncs);
+        }
+    }
+
+    const auto st = jb.stats();
+    const bool ok = worst <= max_error && clicks == 0 && st.overruns == 0;
+    std::fprintf(stderr,
+                 "drift %.0f ppm, jitter %u us: worst delay error %.1f samples, rate %d..%d ppm, %u clicks, "
+                 "%u underruns, %u overruns, %u resyncs: %s\n",
+                 drift_ppm, jitter, worst, rate_min, rate_max, clicks, st.underruns, st.overruns, st.resyncs,
+                 ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
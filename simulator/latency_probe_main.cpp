@@ -0,0 +1,166 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/latency_probe.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/**
+ * Host check and benchmark of the loopback latency probe
+ *
+ * Plays the MLS into a synthetic room: a fractional delay, a gain, an optional later echo and white noise. Then
+ * correlates the recording the way the app does and fails when the measured lag is off by more than -e samples or the
+ * kernel disagrees with a plain reference correlation. The kernel is timed over -b runs.
+ */
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -o <order> MLS order (default 12)\n"
+        "  -l <ms>    true round trip latency (default 37.3)\n"
+        "  -m <ms>    longest latency searched (default 200)\n"
+        "  -g <dB>    path gain (default -20)\n"
+        "  -n <dB>    noise level against full scale (default -50)\n"
+        "  -r <ms>    add an echo this much after the direct sound, 6 dB down, 0 for none (default 0)\n"
+        "  -i         invert the recording\n"
+        "  -e <n>     allowed error in samples (default 0.5)\n"
+        "  -b <runs>  benchmark runs (default 20)\n",
+        argv0);
+}
+
+// Windowed sinc, delays x by a fraction of a sample
+static double fractional_tap(const std::vector<double>& x, double at)
+{
+    constexpr int kHalf = 16;
+    const int base      = static_cast<int>(std::floor(at));
+    double acc          = 0.0;
+    for (int k = base - kHalf + 1; k <= base + kHalf; ++k) {
+        if (k < 0 || k >= static_cast<int>(x.size())) {
+            continue;
+        }
+        const double t      = at - k;
+        const double sinc   = t == 0.0 ? 1.0 : std::sin(M_PI * t) / (M_PI * t);
+        const double window = 0.5 + 0.5 * std::cos(M_PI * t / kHalf);
+        acc += x[k] * sinc * window;
+    }
+    return acc;
+}
+
+int main(int argc, char** argv)
+{
+    constexpr uint32_t kRate    = 16000;
+    constexpr double kAmplitude = 6000.0;
+
+    int order         = 12;
+    double latency_ms = 37.3;
+    double max_ms     = 200.0;
+    double gain_db    = -20.0;
+    double noise_db   = -50.0;
+    double echo_ms    = 0.0;
+    bool invert       = false;
+    double max_error  = 0.5;
+    int runs          = 20;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-o") == 0 && has_value) {
+            order = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-l") == 0 && has_value) {
+            latency_ms = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-m") == 0 && has_value) {
+            max_ms = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-g") == 0 && has_value) {
+            gain_db = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-n") == 0 && has_value) {
+            noise_db = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            echo_ms = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-i") == 0) {
+            invert = true;
+        } else if (std::strcmp(argv[i], "-e") == 0 && has_value) {
+            max_error = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-b") == 0 && has_value) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const auto mls = latency::makeMls(order);
+    if (mls.empty()) {
+        std::fprintf(stderr, "order must be %d..%d\n", latency::kMinOrder, latency::kMaxOrder);
+        return 1;
+    }
+
+    // One period of a maximum length sequence holds exactly one more +1 than -1, and no state repeats before it ends
+    int balance = 0;
+    for (const int8_t chip : mls) {
+        balance += chip;
+    }
+    if (balance != 1) {
+        std::fprintf(stderr, "order %d: not a maximum length sequence (balance %d)\n", order, balance);
+        return 1;
+    }
+
+    const size_t lags     = static_cast<size_t>(max_ms * kRate / 1000.0);
+    const double delay    = latency_ms * kRate / 1000.0;
+    const double echo     = echo_ms * kRate / 1000.0;
+    const double gain     = std::pow(10.0, gain_db / 20.0) * (invert ? -1.0 : 1.0);
+    const double noise_sd = 32768.0 * std::pow(10.0, noise_db / 20.0);
+
+    std::vector<double> played(mls.size());
+    for (size_t i = 0; i < mls.size(); ++i) {
+        played[i] = kAmplitude * mls[i];
+    }
+
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, noise_sd);
+    std::vector<int16_t> recorded(mls.size() + lags - 1);
+    for (size_t i = 0; i < recorded.size(); ++i) {
+        double v = gain * fractional_tap(played, i - delay) + noise(rng);
+        if (echo_ms > 0.0) {
+            v += 0.5 * gain * fractional_tap(played, i - delay - echo);
+        }
+        recorded[i] = static_cast<int16_t>(std::clamp(std::lround(v), -32768L, 32767L));
+    }
+
+    std::vector<int32_t> corr(lags);
+    latency::correlate(mls.data(), mls.size(), recorded.data(), lags, corr.data());
+    for (size_t lag = 0; lag < lags; ++lag) {
+        int64_t ref = 0;
+        for (size_t i = 0; i < mls.size(); ++i) {
+            ref += mls[i] * recorded[lag + i];
+        }
+        if (ref != corr[lag]) {
+            std::fprintf(stderr, "kernel mismatch at lag %zu: %d, reference %lld\n", lag, corr[lag],
+                         static_cast<long long>(ref));
+            return 1;
+        }
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < runs; ++r) {
+        latency::correlate(mls.data(), mls.size(), recorded.data(), lags, corr.data());
+    }
+    const double us  = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / runs;
+    const double mac = static_cast<double>(mls.size()) * lags;
+
+    const auto peak  = latency::findPeak(corr.data(), lags);
+    const double err = peak.lag - delay;
+    const bool ok    = peak.found && std::fabs(err) <= max_error;
+    std::fprintf(stderr,
+                 "order %d, %zu lags: measured %.2f samples (true %.2f, error %+.2f), peak ratio %.1f, "
+                 "kernel %.2f ms (%.0f MMAC/s): %s\n",
+                 order, lags, peak.lag, delay, err, peak.ratio, us / 1000.0, mac / us, ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
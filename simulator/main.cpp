@@ -0,0 +1,327 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <hal.h>
+#include <mooncake.h>
+#include <mooncake_log.h>
+#include <smooth_ui_toolkit.h>
+#include <apps/utils/ui/animation.h>
+#include <apps/utils/fs/io_service.h>
+#include <apps/utils/audio/audio.h>
+#include <apps/app_desktop/desktop_app.h>
+#include <apps/app_music/music_app.h>
+#include <apps/app_pictures/pictures_app.h>
+#include <apps/app_circuit_board/circuit_board_app.h>
+#include <apps/app_sd_bench/sd_bench_app.h>
+#include <apps/app_tuner/tuner_app.h>
+#include <apps/app_sound_meter/sound_meter_app.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const std::string _tag = "Simulator";
+
+/**
+ * Replays a key script against the app system
+ *
+ * One command per line, '#' starts a comment:
+ *   key <name>[+<name>...]  press the keys in order then release them in reverse, e.g. "key ctrl+\"
+ *   down <name> / up <name> press or release a single key
+ *   home                    press the home button
+ *   sd <in|out>             insert or remove the SD card
+ *   wait <ms>               let the virtual clock run
+ *   snapshot <file.ppm>     dump the framebuffer, relative to the output dir
+ *   expect <file.ppm> [n]   the framebuffer has to match file.ppm, at most n pixels may differ (default 0)
+ *   expect_change <file.ppm> the framebuffer has to differ from file.ppm
+ *   quit                    stop the run
+ * Key names are the unshifted names of the device key matrix ("a", "enter", "del", "ctrl", "shift", ";" ...). The
+ * files of expect are looked up in the reference dir, by default the output dir so a script can compare against its
+ * own earlier snapshots. A failed expect dumps the framebuffer next to the snapshots as <file>.actual.ppm, the run goes
+ * on and exits non-zero at the end.
+ */
+class ScriptRunner {
+public:
+    bool load(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in) {
+            mclog::tagError(_tag, "open script {} failed", path);
+            return false;
+        }
+        std::string line;
+        for (size_t number = 1; std::getline(in, line); ++number) {
+            const auto hash = line.find('#');
+            if (hash != std::string::npos) {
+                line.resize(hash);
+            }
+            if (line.find_first_not_of(" \t\r") != std::string::npos) {
+                _lines.push_back(line);
+                _line_numbers.push_back(number);
+            }
+        }
+        return true;
+    }
+
+    void setOutputDir(const std::string& dir)
+    {
+        _out_dir = dir;
+    }
+
+    void setReferenceDir(const std::string& dir)
+    {
+        _ref_dir = dir;
+    }
+
+    int failures() const
+    {
+        return _failures;
+    }
+
+    bool isDone() const
+    {
+        return _quit || (_pc >= _lines.size() && !GetHAL().keyboard.hasPendingEvents());
+    }
+
+    /** Run commands until one of them needs the loop to advance */
+    void step()
+    {
+        auto& hal = GetHAL();
+        if (hal.keyboard.hasPendingEvents() || hal.millis() < _wait_until) {
+            return;
+        }
+
+        while (_pc < _lines.size() && !_quit) {
+            const size_t line = _line_numbers[_pc];
+            std::istringstream ss(_lines[_pc++]);
+            std::string cmd;
+            std::string arg;
+            ss >> cmd >> arg;
+
+            if (cmd == "key") {
+                std::vector<std::string> keys;
+                std::istringstream chord(arg);
+                std::string k;
+                while (std::getline(chord, k, '+')) {
+                    keys.push_back(k);
+                }
+                for (const auto& k : keys) {
+                    if (!hal.keyboard.inject(k, true)) {
+                        fail(line, "unknown key " + k);
+                    }
+                }
+                for (auto it = keys.rbegin(); it != keys.rend(); ++it) {
+                    hal.keyboard.inject(*it, false);
+                }
+                return;
+            } else if (cmd == "down" || cmd == "up") {
+                if (!hal.keyboard.inject(arg, cmd == "down")) {
+                    fail(line, "unknown key " + arg);
+                }
+                return;
+            } else if (cmd == "home") {
+                hal.homeButton.press();
+                return;
+            } else if (cmd == "sd") {
+                hal.setSdCardPresent(arg == "in");
+                return;
+            } else if (cmd == "wait") {
+                _wait_until = hal.millis() + static_cast<uint32_t>(std::strtoul(arg.c_str(), nullptr, 10));
+                return;
+            } else if (cmd == "snapshot") {
+                hal.dumpFramebuffer(_out_dir + "/" + arg);
+            } else if (cmd == "expect" || cmd == "expect_change") {
+                int tolerance = 0;
+                ss >> tolerance;
+                expect(line, arg, cmd == "expect", tolerance);
+            } else if (cmd == "quit") {
+                _quit = true;
+            } else {
+                fail(line, "unknown command " + cmd);
+            }
+        }
+    }
+
+private:
+    void fail(size_t line, const std::string& what)
+    {
+        mclog::tagError(_tag, "script line {}: {}", line, what);
+        _failures++;
+    }
+
+    void expect(size_t line, const std::string& name, bool same, int tolerance)
+    {
+        const int diff = diff_pixels(name.empty() || name[0] == '/' ? name : _ref_dir + "/" + name);
+        if (diff < 0) {
+            fail(line, "can't read " + name);
+            return;
+        }
+        if (same ? diff <= tolerance : diff > 0) {
+            mclog::tagInfo(_tag, "expect {}: {} pixels differ, ok", name, diff);
+            return;
+        }
+        fail(line, name + (same ? ": " + std::to_string(diff) + " pixels differ" : ": nothing changed"));
+        GetHAL().dumpFramebuffer(_out_dir + "/" + name + ".actual.ppm");
+    }
+
+    /** Pixels of the framebuffer that differ from a PPM written by snapshot, -1 if it can't be read or has another size */
+    static int diff_pixels(const std::string& path)
+    {
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) {
+            return -1;
+        }
+        auto& fb   = GetHAL().framebuffer;
+        int w      = 0;
+        int h      = 0;
+        int maxval = 0;
+        int diff   = -1;
+        if (std::fscanf(f, "P6 %d %d %d", &w, &h, &maxval) == 3 && std::fgetc(f) != EOF && w == fb.width() &&
+            h == fb.height() && maxval == 255) {
+            diff = 0;
+            uint8_t rgb[3];
+            for (int i = 0; i < w * h && diff >= 0; ++i) {
+                if (std::fread(rgb, 1, sizeof(rgb), f) != sizeof(rgb)) {
+                    diff = -1;
+                    break;
+                }
+                const auto c = fb.readPixelRGB(i % w, i / w);
+                diff += rgb[0] != c.R8() || rgb[1] != c.G8() || rgb[2] != c.B8();
+            }
+        }
+        std::fclose(f);
+        return diff;
+    }
+
+    std::vector<std::string> _lines;
+    std::vector<size_t> _line_numbers;
+    std::string _out_dir = ".";
+    std::string _ref_dir = ".";
+    int _failures        = 0;
+    size_t _pc           = 0;
+    uint32_t _wait_until = 0;
+    bool _quit           = false;
+};
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options] [script]\n"
+        "  -s <dir>   host directory mounted as the sd card (default ./sdcard)\n"
+        "  -o <dir>   output directory for snapshots (default .)\n"
+        "  -r <dir>   reference images for expect (default the output directory)\n"
+        "  -p <file>  write speaker output to a raw s16le stereo file\n"
+        "  -t <ms>    longest virtual time an idle loop iteration may skip (default 20)\n"
+        "  -n <n>     max loop iterations, without a script the last frame is dumped to final.ppm (default 600)\n"
+        "  -P         enable the frame profiler and dump its CSV on exit\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    auto& hal = GetHAL();
+    ScriptRunner script;
+    std::string script_path;
+    std::string out_dir  = ".";
+    std::string ref_dir;
+    uint32_t max_frames  = 600;
+    bool enable_profiler = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            hal.config().sdcard_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "-o") == 0 && has_value) {
+            out_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            ref_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "-p") == 0 && has_value) {
+            hal.config().pcm_path = argv[++i];
+        } else if (std::strcmp(argv[i], "-t") == 0 && has_value) {
+            hal.config().tick_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-n") == 0 && has_value) {
+            max_frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-P") == 0) {
+            enable_profiler = true;
+        } else if (argv[i][0] != '-' && script_path.empty()) {
+            script_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!script_path.empty() && !script.load(script_path)) {
+        return 1;
+    }
+    script.setOutputDir(out_dir);
+    script.setReferenceDir(ref_dir.empty() ? out_dir : ref_dir);
+
+    hal.init();
+
+    smooth_ui_toolkit::ui_hal::on_get_tick([] {
+        return GetHAL().millis();
+    });
+    anim::setTickSource([] {
+        return GetHAL().millis();
+    });
+
+    hal.display.setBrightness(128);
+    profiler::init();
+    // SD latency goes with the frame dump, a slow frame is often one that waited on the card
+    profiler::addDumpHook([] { GetIoService().dumpStats(); });
+    profiler::addDumpHook(audio::dump_synth_stats);
+    profiler::setEnabled(enable_profiler);
+
+    auto& mc = mooncake::GetMooncake();
+    const int desktop_app_id = mc.installApp(std::make_unique<DesktopApp>());
+    mc.installApp(std::make_unique<MusicApp>());
+    mc.installApp(std::make_unique<PicturesApp>());
+    mc.installApp(std::make_unique<CircuitBoardApp>());
+    mc.installApp(std::make_unique<SdBenchApp>());
+    mc.installApp(std::make_unique<TunerApp>());
+    mc.installApp(std::make_unique<SoundMeterApp>());
+    mc.openApp(desktop_app_id);
+
+    uint32_t frames = 0;
+    while (frames < max_frames) {
+        if (!script_path.empty()) {
+            script.step();
+            if (script.isDone()) {
+                break;
+            }
+        }
+
+        profiler::beginFrame();
+        hal.update();
+        GetIoService().dispatch();
+        {
+            profiler::ScopedMarker marker(profiler::Marker::MooncakeUpdate);
+            mc.update();
+        }
+        profiler::endFrame();
+        hal.idleUntil(anim::takeNextDeadline());
+        frames++;
+    }
+
+    if (script_path.empty()) {
+        hal.dumpFramebuffer(out_dir + "/final.ppm");
+    }
+    if (enable_profiler) {
+        profiler::dumpCsv();
+    }
+
+    mclog::tagInfo(_tag, "done: {} iterations, {} pushes, {} ms virtual, {} pcm frames", frames, hal.getFrameCount(),
+                   hal.millis(), hal.getPcmFramesWritten());
+    if (script.failures() > 0) {
+        mclog::tagError(_tag, "{} script checks failed", script.failures());
+        return 1;
+    }
+    return 0;
+}
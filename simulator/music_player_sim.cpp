@@ -0,0 +1,77 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/app_music/music_player.h>
+#include <mooncake_log.h>
+#include <sys/stat.h>
+
+// Host stand-in for the MP3 player task: tracks state transitions only, nothing is decoded
+
+static const std::string _tag = "MusicPlayerSim";
+
+static MusicPlayerState g_state = MusicPlayerState::Idle;
+static bool g_dirty             = false;
+
+static void set_state(MusicPlayerState state)
+{
+    if (g_state != state) {
+        g_state = state;
+        g_dirty = true;
+    }
+}
+
+MusicPlayer& MusicPlayer::instance()
+{
+    static MusicPlayer inst;
+    return inst;
+}
+
+bool MusicPlayer::init()
+{
+    return true;
+}
+
+bool MusicPlayer::playFile(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        mclog::tagError(_tag, "open {} failed", path);
+        return false;
+    }
+    mclog::tagInfo(_tag, "play: {}", path);
+    set_state(MusicPlayerState::Playing);
+    return true;
+}
+
+void MusicPlayer::togglePause()
+{
+    if (g_state == MusicPlayerState::Playing) {
+        set_state(MusicPlayerState::Paused);
+    } else if (g_state == MusicPlayerState::Paused) {
+        set_state(MusicPlayerState::Playing);
+    }
+}
+
+void MusicPlayer::stop()
+{
+    set_state(MusicPlayerState::Idle);
+}
+
+void MusicPlayer::seekBySeconds(int delta_seconds)
+{
+    mclog::tagInfo(_tag, "seek: {}s", delta_seconds);
+}
+
+MusicPlayerState MusicPlayer::state() const
+{
+    return g_state;
+}
+
+bool MusicPlayer::consumeDirty()
+{
+    bool ret = g_dirty;
+    g_dirty  = false;
+    return ret;
+}
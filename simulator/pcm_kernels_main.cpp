@@ -0,0 +1,412 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/pcm.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/**
+ * Host bit exactness check of the PCM kernels
+ *
+ * The PIE code in pcm_pie.S can't run here, so each of its instruction sequences is modelled lane by lane below with
+ * the documented semantics of the instructions it uses. Every kernel is fuzzed over -n rounds of random lengths and
+ * values, biased towards full scale, and the model, pcm::ref, the dispatching kernel and a plain 64-bit definition
+ * must agree on every sample. The float conversions are checked against their definition on all 65536 inputs.
+ */
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -n <rounds> fuzz rounds per kernel (default 2000)\n"
+        "  -r <seed>   random seed (default 1)\n",
+        argv0);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  PIE model                                 */
+/* -------------------------------------------------------------------------- */
+
+namespace pie {
+
+using Q = std::array<int16_t, 8>;
+
+static uint32_t sar = 0;
+
+static Q vld(const int16_t*& p)
+{
+    Q q;
+    std::memcpy(q.data(), p, sizeof(q));
+    p += 8;
+    return q;
+}
+
+static void vst(const Q& q, int16_t*& p)
+{
+    std::memcpy(p, q.data(), sizeof(q));
+    p += 8;
+}
+
+// ee.vadds.s16: saturating add
+static Q vadds(const Q& a, const Q& b)
+{
+    Q r;
+    for (int i = 0; i < 8; ++i) {
+        r[i] = static_cast<int16_t>(std::clamp(a[i] + b[i], INT16_MIN, INT16_MAX));
+    }
+    return r;
+}
+
+// ee.vmul.s16: 32-bit product, arithmetic shift right by SAR, low 16 bits kept
+static Q vmul(const Q& a, const Q& b)
+{
+    Q r;
+    for (int i = 0; i < 8; ++i) {
+        const int32_t product = static_cast<int32_t>(a[i]) * b[i];
+        const int32_t shifted = product >> sar;
+        if (shifted < INT16_MIN || shifted > INT16_MAX) {
+            std::fprintf(stderr, "vmul lane overflow: %d * %d >> %u\n", a[i], b[i], sar);
+            std::exit(1);
+        }
+        r[i] = static_cast<int16_t>(shifted);
+    }
+    return r;
+}
+
+static Q andq(const Q& a, const Q& b)
+{
+    Q r;
+    for (int i = 0; i < 8; ++i) {
+        r[i] = static_cast<int16_t>(a[i] & b[i]);
+    }
+    return r;
+}
+
+// ee.vzip.16: a and b interleaved, low half into a, high half into b
+static void vzip(Q& a, Q& b)
+{
+    Q lo, hi;
+    for (int i = 0; i < 4; ++i) {
+        lo[i * 2]     = a[i];
+        lo[i * 2 + 1] = b[i];
+        hi[i * 2]     = a[i + 4];
+        hi[i * 2 + 1] = b[i + 4];
+    }
+    a = lo;
+    b = hi;
+}
+
+// ee.vunzip.16: even lanes of a:b into a, odd lanes into b
+static void vunzip(Q& a, Q& b)
+{
+    Q even, odd;
+    for (int i = 0; i < 4; ++i) {
+        even[i]     = a[i * 2];
+        odd[i]      = a[i * 2 + 1];
+        even[i + 4] = b[i * 2];
+        odd[i + 4]  = b[i * 2 + 1];
+    }
+    a = even;
+    b = odd;
+}
+
+static void mix_add(int16_t* dst, const int16_t* src, size_t blocks)
+{
+    const int16_t* rd = dst;
+    while (blocks--) {
+        Q q0 = vld(rd);
+        Q q1 = vld(src);
+        q0   = vadds(q0, q1);
+        vst(q0, dst);
+    }
+}
+
+static void gain(int16_t* dst, const int16_t* src, size_t blocks, const int16_t* lanes, uint32_t shift)
+{
+    const Q q7 = vld(lanes);
+    sar        = 15;
+    while (blocks--) {
+        Q q0 = vmul(vld(src), q7);
+        for (uint32_t s = 0; s < shift; ++s) {
+            q0 = vadds(q0, q0);
+        }
+        vst(q0, dst);
+    }
+}
+
+static void stereo_to_mono(int16_t* dst, const int16_t* src, size_t blocks, const int16_t* ones)
+{
+    const Q q7 = vld(ones);
+    sar        = 1;
+    while (blocks--) {
+        Q q0 = vld(src);
+        Q q1 = vld(src);
+        vunzip(q0, q1);
+        Q q2 = andq(andq(q0, q1), q7);
+        q0   = vmul(q0, q7);
+        q1   = vmul(q1, q7);
+        q0   = vadds(vadds(q0, q1), q2);
+        vst(q0, dst);
+    }
+}
+
+static void mono_to_stereo(int16_t* dst, const int16_t* src, size_t blocks)
+{
+    while (blocks--) {
+        Q q0 = vld(src);
+        Q q1 = q0;
+        vzip(q0, q1);
+        vst(q0, dst);
+        vst(q1, dst);
+    }
+}
+
+static void deinterleave(int16_t* left, int16_t* right, const int16_t* src, size_t blocks)
+{
+    while (blocks--) {
+        Q q0 = vld(src);
+        Q q1 = vld(src);
+        vunzip(q0, q1);
+        vst(q0, left);
+        vst(q1, right);
+    }
+}
+
+static void interleave(int16_t* dst, const int16_t* left, const int16_t* right, size_t blocks)
+{
+    while (blocks--) {
+        Q q0 = vld(left);
+        Q q1 = vld(right);
+        vzip(q0, q1);
+        vst(q0, dst);
+        vst(q1, dst);
+    }
+}
+
+}  // namespace pie
+
+/* -------------------------------------------------------------------------- */
+/*                                   Checks                                   */
+/* -------------------------------------------------------------------------- */
+
+static int failures = 0;
+
+static void expect_same(const char* what, const std::vector<int16_t>& got, const std::vector<int16_t>& want,
+                        size_t round)
+{
+    for (size_t i = 0; i < want.size(); ++i) {
+        if (got[i] != want[i]) {
+            if (failures < 10) {
+                std::fprintf(stderr, "%s, round %zu: sample %zu is %d, expected %d\n", what, round, i, got[i], want[i]);
+            }
+            failures++;
+            return;
+        }
+    }
+}
+
+static int16_t sat(int64_t v)
+{
+    return static_cast<int16_t>(std::clamp<int64_t>(v, INT16_MIN, INT16_MAX));
+}
+
+int main(int argc, char** argv)
+{
+    size_t rounds = 2000;
+    uint32_t seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-n") == 0 && has_value) {
+            rounds = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> any(INT16_MIN, INT16_MAX);
+    std::uniform_int_distribution<int> pick(0, 7);
+    const auto sample = [&]() -> int16_t {
+        switch (pick(rng)) {
+            case 0: return INT16_MIN;
+            case 1: return INT16_MAX;
+            case 2: return static_cast<int16_t>(pick(rng) - 4);
+            default: return static_cast<int16_t>(any(rng));
+        }
+    };
+    const auto fill = [&](size_t n) {
+        std::vector<int16_t> v(n);
+        for (auto& s : v) {
+            s = sample();
+        }
+        return v;
+    };
+
+    if (!pcm::selfTest()) {
+        std::fprintf(stderr, "pcm::selfTest failed\n");
+        failures++;
+    }
+
+    for (size_t round = 0; round < rounds; ++round) {
+        // Whole blocks for the model, the tail only matters to the dispatcher
+        const size_t blocks = 1 + round % 24;
+        const size_t frames = blocks * 8;
+        const size_t tail   = round % 8;
+
+        const auto a = fill((frames + tail) * 2);
+        const auto b = fill((frames + tail) * 2);
+        std::vector<int16_t> want, model, ref, kernel, want2, model2, ref2, kernel2;
+
+        // Stereo to mono
+        want.assign(frames, 0);
+        for (size_t i = 0; i < frames; ++i) {
+            want[i] = static_cast<int16_t>((static_cast<int64_t>(a[i * 2]) + a[i * 2 + 1]) >> 1);
+        }
+        alignas(pcm::kAlign) static const int16_t ones[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+        model.assign(frames, 0);
+        ref.assign(frames + tail, 0);
+        kernel.assign(frames + tail, 0);
+        pie::stereo_to_mono(model.data(), a.data(), blocks, ones);
+        pcm::ref::stereoToMono(ref.data(), a.data(), frames + tail);
+        pcm::stereoToMono(kernel.data(), a.data(), frames + tail);
+        expect_same("stereoToMono model", model, want, round);
+        expect_same("stereoToMono ref", ref, want, round);
+        expect_same("stereoToMono kernel", kernel, ref, round);
+
+        // Mono to stereo
+        want.assign(frames * 2, 0);
+        for (size_t i = 0; i < frames; ++i) {
+            want[i * 2] = want[i * 2 + 1] = a[i];
+        }
+        model.assign(frames * 2, 0);
+        ref.assign((frames + tail) * 2, 0);
+        pie::mono_to_stereo(model.data(), a.data(), blocks);
+        pcm::ref::monoToStereo(ref.data(), a.data(), frames + tail);
+        kernel.assign(a.begin(), a.end());
+        pcm::monoToStereo(kernel.data(), kernel.data(), frames + tail);
+        expect_same("monoToStereo model", model, want, round);
+        expect_same("monoToStereo ref", ref, want, round);
+        expect_same("monoToStereo in place", kernel, ref, round);
+
+        // Deinterleave
+        want.assign(frames, 0);
+        want2.assign(frames, 0);
+        for (size_t i = 0; i < frames; ++i) {
+            want[i]  = a[i * 2];
+            want2[i] = a[i * 2 + 1];
+        }
+        model.assign(frames, 0);
+        model2.assign(frames, 0);
+        ref.assign(frames + tail, 0);
+        ref2.assign(frames + tail, 0);
+        kernel.assign(frames + tail, 0);
+        kernel2.assign(frames + tail, 0);
+        pie::deinterleave(model.data(), model2.data(), a.data(), blocks);
+        pcm::ref::deinterleave(ref.data(), ref2.data(), a.data(), frames + tail);
+        pcm::deinterleave(kernel.data(), kernel2.data(), a.data(), frames + tail);
+        expect_same("deinterleave model left", model, want, round);
+        expect_same("deinterleave model right", model2, want2, round);
+        expect_same("deinterleave ref left", ref, want, round);
+        expect_same("deinterleave ref right", ref2, want2, round);
+        expect_same("deinterleave kernel left", kernel, ref, round);
+        expect_same("deinterleave kernel right", kernel2, ref2, round);
+
+        // Interleave
+        want.assign(frames * 2, 0);
+        for (size_t i = 0; i < frames; ++i) {
+            want[i * 2]     = a[i];
+            want[i * 2 + 1] = b[i];
+        }
+        model.assign(frames * 2, 0);
+        ref.assign((frames + tail) * 2, 0);
+        kernel.assign((frames + tail) * 2, 0);
+        pie::interleave(model.data(), a.data(), b.data(), blocks);
+        pcm::ref::interleave(ref.data(), a.data(), b.data(), frames + tail);
+        pcm::interleave(kernel.data(), a.data(), b.data(), frames + tail);
+        expect_same("interleave model", model, want, round);
+        expect_same("interleave ref", ref, want, round);
+        expect_same("interleave kernel", kernel, ref, round);
+
+        // Gain, extremes of both fields every few rounds
+        pcm::Gain_t g;
+        g.q15   = (round % 5 == 0) ? INT16_MIN : (round % 5 == 1) ? INT16_MAX : static_cast<int16_t>(any(rng));
+        g.shift = static_cast<uint8_t>(round % 16);
+        const int16_t q15 = std::max<int16_t>(g.q15, -32767);
+        alignas(pcm::kAlign) int16_t lanes[8];
+        std::fill(lanes, lanes + 8, q15);
+        const size_t count = frames * 2;
+        want.assign(count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            const int64_t scaled = (static_cast<int64_t>(a[i]) * q15) >> 15;
+            want[i]              = sat(scaled * (int64_t{1} << g.shift));
+        }
+        model.assign(count, 0);
+        ref.assign(count + tail, 0);
+        pie::gain(model.data(), a.data(), blocks * 2, lanes, g.shift);
+        pcm::ref::gain(ref.data(), a.data(), count + tail, g);
+        kernel.assign(a.begin(), a.begin() + count + tail);
+        pcm::gain(kernel.data(), kernel.data(), count + tail, g);
+        expect_same("gain model", model, want, round);
+        expect_same("gain ref", ref, want, round);
+        expect_same("gain in place", kernel, ref, round);
+
+        // Mix add
+        want.assign(count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            want[i] = sat(static_cast<int64_t>(a[i]) + b[i]);
+        }
+        model.assign(a.begin(), a.begin() + count);
+        ref.assign(a.begin(), a.begin() + count + tail);
+        kernel.assign(a.begin(), a.begin() + count + tail);
+        pie::mix_add(model.data(), b.data(), blocks * 2);
+        pcm::ref::mixAdd(ref.data(), b.data(), count + tail);
+        pcm::mixAdd(kernel.data(), b.data(), count + tail);
+        expect_same("mixAdd model", model, want, round);
+        expect_same("mixAdd ref", ref, want, round);
+        expect_same("mixAdd kernel", kernel, ref, round);
+    }
+
+    // Float conversions: every int16 there and back, and the rounding and clamping edges on the way in
+    std::vector<int16_t> all(65536), back(65536);
+    std::vector<float> as_float(65536);
+    for (int i = 0; i < 65536; ++i) {
+        all[i] = static_cast<int16_t>(i - 32768);
+    }
+    pcm::toFloat(as_float.data(), all.data(), all.size());
+    pcm::fromFloat(back.data(), as_float.data(), as_float.size());
+    for (int i = 0; i < 65536; ++i) {
+        if (as_float[i] != all[i] / 32768.0f) {
+            std::fprintf(stderr, "toFloat(%d) = %.9g\n", all[i], as_float[i]);
+            failures++;
+            break;
+        }
+    }
+    expect_same("float round trip", back, all, 0);
+
+    const float edges[]        = {0.5f / 32768, -0.5f / 32768, 1.5f / 32768, -1.5f / 32768, 0.49f / 32768, 1.0f,
+                                  -1.0f,        2.0f,          -2.0f,        32767.5f / 32768};
+    const int16_t edge_want[] = {1, -1, 2, -2, 0, 32767, -32768, 32767, -32768, 32767};
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i) {
+        int16_t out;
+        pcm::fromFloat(&out, &edges[i], 1);
+        if (out != edge_want[i]) {
+            std::fprintf(stderr, "fromFloat(%.9g) = %d, expected %d\n", edges[i], out, edge_want[i]);
+            failures++;
+        }
+    }
+
+    std::fprintf(stderr, "%zu rounds, %d failures: %s\n", rounds, failures, failures ? "FAIL" : "OK");
+    return failures ? 1 : 0;
+}
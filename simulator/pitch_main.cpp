@@ -0,0 +1,448 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/pitch.h>
+#include <apps/utils/audio/resampler.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Host checks and benchmark of the tuner's pitch detector
+ *
+ * Tones are run through the detector the way the Tuner app does, a frame every kHop samples at 16 kHz, and every
+ * voiced frame is compared with the true pitch in cents: sines over the whole range, harmonic tones in noise, plucked
+ * strings that decay with a little inharmonicity and a low note whose fundamental is almost gone. Silence and noise
+ * must stay unvoiced and a note change must show within the latency budget. With -w a recorded 16-bit PCM WAV is
+ * converted to 16 kHz and tracked too, -f gives the pitch it should hold (e.g. a rec_NNNN.wav from the Audio Loopback
+ * app). Then the detector runs for -s seconds of audio and the cost is printed per frame, in ns and, on x86, in TSC
+ * cycles. Fails when any check is off.
+ */
+static constexpr float kRate   = 16000.0f;
+static constexpr size_t kHop   = 128;
+static constexpr float kA4     = 440.0f;
+static constexpr float kGross  = 50.0f;  // Cents, off by more is a wrong note, e.g. an octave error
+static int failures            = 0;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %9.2f %-5s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+static float cents(float hz, float ref)
+{
+    return 1200.0f * std::log2(hz / ref);
+}
+
+struct Track_t {
+    size_t frames    = 0;
+    size_t voiced    = 0;
+    size_t gross     = 0;     // Voiced, off by more than kGross
+    float max_error  = 0.0f;  // Cents, over the voiced frames that aren't gross
+    float mean_error = 0.0f;
+    float p95_error  = 0.0f;
+    float median_hz  = 0.0f;
+};
+
+// Every hop from the first full frame on. ref_hz 0 only counts
+static Track_t track(pitch::Detector& det, const std::vector<float>& x, float ref_hz, size_t skip_frames = 0)
+{
+    Track_t t;
+    std::vector<float> hz;
+    std::vector<float> errors;
+    for (size_t end = det.frameSize(); end <= x.size(); end += kHop) {
+        const auto est = det.detect(&x[end - det.frameSize()]);
+        if (t.frames++ < skip_frames || !est.voiced) {
+            continue;
+        }
+        ++t.voiced;
+        hz.push_back(est.hz);
+        if (ref_hz <= 0.0f) {
+            continue;
+        }
+        const float err = std::fabs(cents(est.hz, ref_hz));
+        if (err > kGross) {
+            ++t.gross;
+            continue;
+        }
+        errors.push_back(err);
+    }
+    t.frames -= std::min(t.frames, skip_frames);
+    if (!hz.empty()) {
+        std::nth_element(hz.begin(), hz.begin() + hz.size() / 2, hz.end());
+        t.median_hz = hz[hz.size() / 2];
+    }
+    if (!errors.empty()) {
+        double sum = 0.0;
+        for (float e : errors) {
+            sum += e;
+        }
+        std::sort(errors.begin(), errors.end());
+        t.max_error  = errors.back();
+        t.mean_error = static_cast<float>(sum / errors.size());
+        t.p95_error  = errors[errors.size() * 95 / 100];
+    }
+    return t;
+}
+
+static std::vector<float> sine(float hz, float amplitude, float seconds)
+{
+    std::vector<float> x(static_cast<size_t>(seconds * kRate));
+    for (size_t i = 0; i < x.size(); ++i) {
+        x[i] = amplitude * static_cast<float>(std::sin(2.0 * M_PI * hz * i / kRate));
+    }
+    return x;
+}
+
+/**
+ * Sum of harmonics with amplitudes 1/k below Nyquist, random phases, scaled to peak, then noise snr_db under it.
+ * fundamental scales the first harmonic alone. decay_s > 0 makes it a pluck, higher harmonics dying faster, and
+ * inharmonicity B stretches harmonic k to k * sqrt(1 + B k^2) like a stiff string
+ */
+static std::vector<float> harmonic(float hz, float seconds, float snr_db, uint32_t seed, float fundamental = 1.0f,
+                                   float decay_s = 0.0f, float inharmonicity = 0.0f)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> phase(0.0f, 2.0f * static_cast<float>(M_PI));
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+
+    std::vector<float> x(static_cast<size_t>(seconds * kRate), 0.0f);
+    for (int k = 1; k < 40; ++k) {
+        const double f = hz * k * std::sqrt(1.0 + inharmonicity * k * k);
+        if (f >= kRate * 0.45) {
+            break;
+        }
+        const double a   = (k == 1 ? fundamental : 1.0) / k;
+        const double p   = phase(rng);
+        const double tau = decay_s > 0.0f ? decay_s / k : 0.0;
+        for (size_t i = 0; i < x.size(); ++i) {
+            const double env = tau > 0.0 ? std::exp(-static_cast<double>(i) / kRate / tau) : 1.0;
+            x[i] += static_cast<float>(a * env * std::sin(2.0 * M_PI * f * i / kRate + p));
+        }
+    }
+    float peak = 0.0f;
+    double power = 0.0;
+    for (float v : x) {
+        peak = std::max(peak, std::fabs(v));
+        power += static_cast<double>(v) * v;
+    }
+    const float scale = 0.5f / peak;
+    const float sigma = static_cast<float>(std::sqrt(power / x.size()) * scale * std::pow(10.0, -snr_db / 20.0));
+    for (float& v : x) {
+        v = v * scale + sigma * noise(rng);
+    }
+    return x;
+}
+
+static void check_sines(pitch::Detector& det)
+{
+    // Every quarter tone from C2 to F6, most of them between the samples of a period
+    float worst = 0.0f, mean = 0.0f;
+    size_t gross = 0, missed = 0, tones = 0;
+    for (float midi = 36.0f; midi <= 89.0f; midi += 0.5f, ++tones) {
+        const float hz = kA4 * std::pow(2.0f, (midi - 69.0f) / 12.0f);
+        const auto t   = track(det, sine(hz, 0.3f, 0.25f), hz);
+        worst          = std::max(worst, t.max_error);
+        mean += t.mean_error;
+        gross += t.gross;
+        missed += t.frames - t.voiced;
+    }
+    check("sines C2..F6, worst error", worst, 0.0, 1.0, "cents");
+    check("sines C2..F6, mean error", mean / tones, 0.0, 0.2, "cents");
+    check("sines C2..F6, wrong notes", gross, 0, 0, "");
+    check("sines C2..F6, unvoiced frames", missed, 0, 0, "");
+}
+
+static void check_tones(pitch::Detector& det)
+{
+    // Open strings of a guitar, a bass's low E an octave down is out of range, and a few notes higher up
+    static const float kNotes[] = {82.41f, 110.0f, 146.83f, 196.0f, 246.94f, 329.63f, 440.0f, 659.26f, 987.77f};
+    float worst = 0.0f, pluck_p95 = 0.0f, pluck_mean = 0.0f;
+    size_t gross = 0, missed = 0;
+    uint32_t seed = 1;
+    for (float hz : kNotes) {
+        const auto t = track(det, harmonic(hz, 0.5f, 20.0f, seed++), hz);
+        worst        = std::max(worst, t.max_error);
+        gross += t.gross;
+        missed += t.frames - t.voiced;
+
+        // One second of a plucked string, the stretched upper partials pull the pitch up by a cent or less. The low
+        // notes' last frames hold two periods of a fundamental 15 dB over the noise, single frames scatter there
+        const auto p = track(det, harmonic(hz, 1.0f, 30.0f, seed++, 1.0f, 0.6f, 5e-5f), hz);
+        pluck_p95    = std::max(pluck_p95, p.p95_error);
+        pluck_mean   = std::max(pluck_mean, p.mean_error);
+        gross += p.gross;
+        missed += p.frames - p.voiced;
+    }
+    check("harmonic tones, 20 dB SNR, worst error", worst, 0.0, 3.0, "cents");
+    check("plucked strings, 95th percentile error", pluck_p95, 0.0, 8.0, "cents");
+    check("plucked strings, mean error", pluck_mean, 0.0, 2.0, "cents");
+    check("harmonic and plucked, wrong notes", gross, 0, 0, "");
+    check("harmonic and plucked, unvoiced frames", missed, 0, 0, "");
+
+    // Low E through a small speaker: the fundamental 20 dB under the harmonics must still be the note, not E3
+    const auto weak = track(det, harmonic(82.41f, 0.5f, 30.0f, seed++, 0.1f), 82.41f);
+    check("weak fundamental, wrong notes", weak.gross, 0, 0, "");
+    check("weak fundamental, worst error", weak.max_error, 0.0, 3.0, "cents");
+}
+
+static void check_unvoiced(pitch::Detector& det)
+{
+    const auto quiet = track(det, std::vector<float>(static_cast<size_t>(kRate / 2), 0.0f), 0.0f);
+    check("silence, voiced frames", quiet.voiced, 0, 0, "");
+
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+    std::vector<float> x(static_cast<size_t>(kRate));
+    for (float& v : x) {
+        v = noise(rng);
+    }
+    const auto hiss = track(det, x, 0.0f);
+    check("white noise -20 dBFS, voiced frames", 100.0 * hiss.voiced / hiss.frames, 0.0, 2.0, "%");
+
+    const auto faint = track(det, sine(220.0f, 0.001f, 0.25f), 0.0f);
+    check("sine at -63 dBFS, voiced frames", faint.voiced, 0, 0, "");
+}
+
+// From the note change to the first frame reporting the new note, and to the first within 10 cents that the rest
+// stay within
+static void check_latency(pitch::Detector& det)
+{
+    const float from = 110.0f;
+    const float to   = 146.83f;
+    auto x           = harmonic(from, 0.3f, 30.0f, 11);
+    const auto y     = harmonic(to, 0.3f, 30.0f, 12);
+    const size_t at  = x.size();
+    x.insert(x.end(), y.begin(), y.end());
+
+    float note_ms = -1.0f, settled_ms = -1.0f;
+    for (size_t end = det.frameSize(); end <= x.size(); end += kHop) {
+        if (end <= at) {
+            continue;
+        }
+        const auto est     = det.detect(&x[end - det.frameSize()]);
+        const float off    = est.voiced ? std::fabs(cents(est.hz, to)) : 1200.0f;
+        const float now_ms = (end - at) * 1000.0f / kRate;
+        if (note_ms < 0.0f && off <= kGross) {
+            note_ms = now_ms;
+        }
+        if (off > 10.0f) {
+            settled_ms = -1.0f;
+        } else if (settled_ms < 0.0f) {
+            settled_ms = now_ms;
+        }
+    }
+    // The new note has to fill the frame, twice the longest period (31 ms), and the next hop has to come
+    check("note change to the new note", note_ms, 0.0, 40.0, "ms");
+    check("note change to within 10 cents", settled_ms, 0.0, 40.0, "ms");
+}
+
+static void check_notes()
+{
+    const auto a = pitch::nearestNote(440.0f, kA4);
+    check("440 Hz is A4", a.midi == 69 && std::strcmp(pitch::noteName(a.midi), "A") == 0 && pitch::noteOctave(69) == 4,
+          1, 1, "");
+    check("445 Hz against A4", pitch::nearestNote(445.0f, kA4).cents, 19.5, 19.7, "cents");
+    const auto e = pitch::nearestNote(82.0f, kA4);
+    check("82 Hz is E2", e.midi == 40 && std::strcmp(pitch::noteName(e.midi), "E") == 0 && pitch::noteOctave(40) == 2,
+          1, 1, "");
+    check("82 Hz against A4 = 432", pitch::nearestNote(82.0f, 432.0f).cents, 23.1, 23.3, "cents");
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+// 16-bit PCM, mono or stereo averaged, at 16 kHz. Empty if the file isn't one
+static std::vector<float> load_wav(const std::string& path)
+{
+    std::vector<float> out;
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        return out;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        bytes.insert(bytes.end(), chunk, chunk + got);
+    }
+    std::fclose(f);
+    if (bytes.size() < 12 || std::memcmp(bytes.data(), "RIFF", 4) != 0 || std::memcmp(&bytes[8], "WAVE", 4) != 0) {
+        return out;
+    }
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    const uint8_t* data = nullptr;
+    size_t data_bytes   = 0;
+    for (size_t at = 12; at + 8 <= bytes.size();) {
+        const uint32_t size = get32(&bytes[at + 4]);
+        const size_t body   = at + 8;
+        if (std::memcmp(&bytes[at], "fmt ", 4) == 0 && size >= 16 && body + 16 <= bytes.size()) {
+            format   = get16(&bytes[body]);
+            channels = get16(&bytes[body + 2]);
+            rate     = get32(&bytes[body + 4]);
+            bits     = get16(&bytes[body + 14]);
+        } else if (std::memcmp(&bytes[at], "data", 4) == 0) {
+            data       = &bytes[body];
+            data_bytes = std::min<size_t>(size, bytes.size() - body);
+        }
+        at = body + size + (size & 1);
+    }
+    if (format != 1 || bits != 16 || channels < 1 || channels > 2 || rate == 0 || data == nullptr) {
+        return out;
+    }
+
+    const size_t frames = data_bytes / (2 * channels);
+    std::vector<int16_t> mono(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        int32_t sum = 0;
+        for (uint16_t c = 0; c < channels; ++c) {
+            sum += static_cast<int16_t>(get16(data + (i * channels + c) * 2));
+        }
+        mono[i] = static_cast<int16_t>(sum / channels);
+    }
+
+    std::vector<int16_t> pcm16;
+    if (rate == static_cast<uint32_t>(kRate)) {
+        pcm16 = std::move(mono);
+    } else {
+        Resampler src;
+        if (!src.init(rate, static_cast<uint32_t>(kRate), 1, Resampler::Quality::High, 1024)) {
+            return out;
+        }
+        std::vector<int16_t> buf(src.maxOutput(1024));
+        for (size_t at = 0; at < mono.size(); at += 1024) {
+            const size_t n = src.convert(&mono[at], std::min<size_t>(1024, mono.size() - at), buf.data());
+            pcm16.insert(pcm16.end(), buf.begin(), buf.begin() + n);
+        }
+    }
+    out.resize(pcm16.size());
+    for (size_t i = 0; i < pcm16.size(); ++i) {
+        out[i] = pcm16[i] / 32768.0f;
+    }
+    return out;
+}
+
+static void check_recording(pitch::Detector& det, const std::string& path, float ref_hz)
+{
+    const auto x = load_wav(path);
+    if (x.size() < det.frameSize()) {
+        std::printf("%s: not a 16-bit PCM WAV or too short\n", path.c_str());
+        ++failures;
+        return;
+    }
+    const auto t = track(det, x, ref_hz);
+    const auto n = pitch::nearestNote(t.median_hz, kA4);
+    std::printf("%s: %.2f s, %zu of %zu frames voiced, median %.2f Hz = %s%d %+.1f cents\n", path.c_str(),
+                x.size() / kRate, t.voiced, t.frames, t.median_hz, pitch::noteName(n.midi), pitch::noteOctave(n.midi),
+                n.cents);
+    if (ref_hz > 0.0f) {
+        check("recording, median against -f", cents(t.median_hz, ref_hz), -10.0, 10.0, "cents");
+        check("recording, wrong notes", t.voiced > 0 ? 100.0 * t.gross / t.voiced : 100.0, 0.0, 5.0, "%");
+    }
+}
+
+static void bench(pitch::Detector& det, float seconds)
+{
+    const auto x        = harmonic(196.0f, 1.0f, 30.0f, 3);
+    const size_t frames = static_cast<size_t>(seconds * kRate / kHop);
+    const size_t span   = x.size() - det.frameSize();
+    float sink          = 0.0f;
+
+    const auto t0 = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const uint64_t c0 = __rdtsc();
+#endif
+    for (size_t f = 0, at = 0; f < frames; ++f, at = (at + kHop) % span) {
+        sink += det.detect(&x[at]).hz;
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("%zu sample frames every %zu samples at %.0f Hz (sum %.0f)\n", det.frameSize(), kHop, kRate, sink);
+#if defined(__x86_64__) || defined(__i386__)
+    const double cycles = static_cast<double>(__rdtsc() - c0);
+    std::printf("%-34s %10.0f ns/frame %10.0f cycles/frame\n", "detect", ns / frames, cycles / frames);
+#else
+    std::printf("%-34s %10.0f ns/frame\n", "detect", ns / frames);
+#endif
+    std::printf("%-34s %10.2f %% of a core\n", "at the tuner's hop", ns / frames * (kRate / kHop) / 1e7);
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -s <sec>   audio to benchmark (default 20)\n"
+        "  -w <file>  track a recorded 16-bit PCM WAV too\n"
+        "  -f <hz>    pitch the recording holds, checks it\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds  = 20.0f;
+    bool benchmark = true;
+    std::string wav;
+    float wav_hz = 0.0f;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-w") == 0 && has_value) {
+            wav = argv[++i];
+        } else if (std::strcmp(argv[i], "-f") == 0 && has_value) {
+            wav_hz = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    pitch::Detector det;
+    if (!det.init(pitch::Config_t())) {
+        std::printf("detector init failed\n");
+        return 1;
+    }
+
+    check_sines(det);
+    check_tones(det);
+    check_unvoiced(det);
+    check_latency(det);
+    check_notes();
+    if (!wav.empty()) {
+        check_recording(det, wav, wav_hz);
+    }
+
+    if (benchmark) {
+        std::printf("\n");
+        bench(det, seconds);
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/image/png_stream.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Host checks and benchmark of the streaming PNG decoder
+ *
+ * A -w x -h RGB photo stand in, gradients under a little noise with every row filter in turn, is written to a PNG in
+ * -d (or -i names a real one). It is decoded reduced to fit the 240 x 115 Pictures view and in full into a frame
+ * buffer, the way a decoder without reduction has to. The reduced image has to match a box average of the source, and
+ * the time and peak bytes of both are printed side by side. Fails when any check is off.
+ */
+static int failures = 0;
+
+static constexpr int kViewW = 240;
+static constexpr int kViewH = 115;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 PNG writer                                 */
+/* -------------------------------------------------------------------------- */
+static uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc = 0)
+{
+    crc = ~crc;
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void put_be32(std::vector<uint8_t>& out, uint32_t v)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(v >> shift));
+    }
+}
+
+static void put_chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t len)
+{
+    put_be32(out, static_cast<uint32_t>(len));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + len);
+    put_be32(out, crc32(out.data() + start, len + 4));
+}
+
+/** zlib stream of one fixed Huffman block of literals, enough to keep the inflater on its Huffman path */
+static std::vector<uint8_t> deflate_literals(const std::vector<uint8_t>& raw)
+{
+    std::vector<uint8_t> out = {0x78, 0x01};
+    uint32_t bits            = 0;
+    int nbits                = 0;
+    const auto put_bits      = [&](uint32_t v, int n) {
+        bits |= v << nbits;
+        nbits += n;
+        while (nbits >= 8) {
+            out.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            nbits -= 8;
+        }
+    };
+    // Huffman codes go out most significant bit first
+    const auto put_code = [&](uint32_t code, int n) {
+        uint32_t rev = 0;
+        for (int i = 0; i < n; ++i) {
+            rev |= ((code >> i) & 1) << (n - 1 - i);
+        }
+        put_bits(rev, n);
+    };
+
+    put_bits(1, 1);  // Final block
+    put_bits(1, 2);  // Fixed codes
+    for (uint8_t c : raw) {
+        if (c < 144) {
+            put_code(0x30 + c, 8);
+        } else {
+            put_code(0x190 + c - 144, 9);
+        }
+    }
+    put_code(0, 7);  // End of block
+    if (nbits > 0) {
+        put_bits(0, 8 - nbits);
+    }
+
+    uint32_t a = 1, b = 0;
+    for (uint8_t c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_be32(out, (b << 16) | a);
+    return out;
+}
+
+static uint8_t paeth(int a, int b, int c)
+{
+    const int p  = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+static bool write_png(const std::string& path, const uint8_t* rgb, int w, int h)
+{
+    const size_t stride = static_cast<size_t>(w) * 3;
+    std::vector<uint8_t> raw;
+    raw.reserve((stride + 1) * h);
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* cur   = rgb + y * stride;
+        const uint8_t* prev  = y > 0 ? cur - stride : nullptr;
+        const uint8_t filter = static_cast<uint8_t>(y % 5);
+        raw.push_back(filter);
+        for (size_t i = 0; i < stride; ++i) {
+            const int a = i >= 3 ? cur[i - 3] : 0;
+            const int b = prev ? prev[i] : 0;
+            const int c = prev && i >= 3 ? prev[i - 3] : 0;
+            int p       = 0;
+            switch (filter) {
+                case 1:
+                    p = a;
+                    break;
+                case 2:
+                    p = b;
+                    break;
+                case 3:
+                    p = (a + b) >> 1;
+                    break;
+                case 4:
+                    p = paeth(a, b, c);
+                    break;
+            }
+            raw.push_back(static_cast<uint8_t>(cur[i] - p));
+        }
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> ihdr;
+    put_be32(ihdr, w);
+    put_be32(ihdr, h);
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0});
+    put_chunk(png, "IHDR", ihdr.data(), ihdr.size());
+    const std::vector<uint8_t> z = deflate_literals(raw);
+    for (size_t i = 0; i < z.size(); i += 8192) {
+        put_chunk(png, "IDAT", z.data() + i, std::min<size_t>(8192, z.size() - i));
+    }
+    put_chunk(png, "IEND", nullptr, 0);
+
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    const bool ok = std::fwrite(png.data(), 1, png.size(), f) == png.size();
+    return std::fclose(f) == 0 && ok;
+}
+
+static std::vector<uint8_t> make_photo(int w, int h)
+{
+    std::vector<uint8_t> rgb(static_cast<size_t>(w) * h * 3);
+    uint32_t seed = 1;
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            seed        = seed * 1664525u + 1013904223u;
+            const int n = static_cast<int>(seed >> 29) - 4;
+            uint8_t* p  = &rgb[(static_cast<size_t>(y) * w + x) * 3];
+            p[0]        = static_cast<uint8_t>(std::clamp(x * 255 / w + n, 0, 255));
+            p[1]        = static_cast<uint8_t>(std::clamp(y * 255 / h + n, 0, 255));
+            p[2]        = static_cast<uint8_t>(std::clamp(128 + (x - y) * 127 / w + n, 0, 255));
+        }
+    }
+    return rgb;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Checks                                   */
+/* -------------------------------------------------------------------------- */
+/** Mean error per channel of a reduced RGB565 image against the box average of the source */
+static double box_error(const std::vector<uint8_t>& rgb, int w, int h, int factor, const uint16_t* out, int out_w,
+                        int out_h)
+{
+    double err = 0.0;
+    for (int oy = 0; oy < out_h; ++oy) {
+        for (int ox = 0; ox < out_w; ++ox) {
+            uint32_t sum[3] = {0, 0, 0};
+            int n           = 0;
+            for (int y = oy * factor; y < std::min(h, (oy + 1) * factor); ++y) {
+                for (int x = ox * factor; x < std::min(w, (ox + 1) * factor); ++x) {
+                    const uint8_t* p = &rgb[(static_cast<size_t>(y) * w + x) * 3];
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                    n++;
+                }
+            }
+            // Compared against the middle of the RGB565 step
+            const uint16_t v = __builtin_bswap16(out[oy * out_w + ox]);
+            const int got[3] = {(v >> 8) & 0xF8, (v >> 3) & 0xFC, (v << 3) & 0xF8};
+            const int lsb[3] = {4, 2, 4};
+            for (int c = 0; c < 3; ++c) {
+                err += std::abs(static_cast<int>(sum[c] / n) - (got[c] + lsb[c]));
+            }
+        }
+    }
+    return err / (3.0 * out_w * out_h);
+}
+
+struct Run_t {
+    double ms         = 0.0;
+    size_t peak_bytes = 0;
+};
+
+/** Decode path reduced by factor for seconds, peak bytes include the destination buffer */
+static Run_t bench(const char* path, int factor, float seconds, std::vector<uint16_t>& out, int& out_w, int& out_h)
+{
+    Run_t run;
+    PngStreamDecoder decoder;
+    if (!decoder.open(path)) {
+        return run;
+    }
+    out_w = ImageDecoder::scaledSize(decoder.width(), factor);
+    out_h = ImageDecoder::scaledSize(decoder.height(), factor);
+    out.assign(static_cast<size_t>(out_w) * out_h, 0);
+
+    long decodes  = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    double ms     = 0.0;
+    do {
+        if (!decoder.open(path) || !decoder.decodeInto(factor, out.data(), out_w, out_h)) {
+            return Run_t{};
+        }
+        decodes++;
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    } while (ms < seconds * 1000.0);
+
+    run.ms         = ms / decodes;
+    run.peak_bytes = decoder.stats().peak_bytes + out.size() * sizeof(uint16_t);
+    return run;
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -w <px>    width of the generated image (default 1600)\n"
+        "  -h <px>    height of the generated image (default 1200)\n"
+        "  -d <dir>   folder for the generated image (default /tmp)\n"
+        "  -i <file>  decode this PNG instead, the box average check is skipped\n"
+        "  -s <sec>   decoding per benchmark (default 2)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    int width       = 1600;
+    int height      = 1200;
+    std::string dir = "/tmp";
+    std::string file;
+    float seconds  = 2.0f;
+    bool benchmark = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-w") == 0 && has_value) {
+            width = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-h") == 0 && has_value) {
+            height = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-d") == 0 && has_value) {
+            dir = argv[++i];
+        } else if (std::strcmp(argv[i], "-i") == 0 && has_value) {
+            file = argv[++i];
+        } else if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> rgb;
+    if (file.empty()) {
+        if (width <= 0 || height <= 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        rgb  = make_photo(width, height);
+        file = dir + "/png_stream_bench.png";
+        if (!write_png(file, rgb.data(), width, height)) {
+            std::fprintf(stderr, "write %s failed\n", file.c_str());
+            return 1;
+        }
+    }
+
+    PngStreamDecoder decoder;
+    if (!decoder.open(file.c_str())) {
+        std::fprintf(stderr, "open %s failed\n", file.c_str());
+        return 1;
+    }
+    width            = decoder.width();
+    height           = decoder.height();
+    const int factor = ImageDecoder::factorToFit(width, height, kViewW, kViewH);
+    decoder.close();
+    std::printf("%s: %d x %d, 1/%d to fit %d x %d\n\n", file.c_str(), width, height, factor, kViewW, kViewH);
+
+    // A single decode for the checks, the benchmark repeats them for -s seconds
+    std::vector<uint16_t> reduced, full;
+    int rw = 0, rh = 0, fw = 0, fh = 0;
+    const Run_t r = bench(file.c_str(), factor, benchmark ? seconds : 0.0f, reduced, rw, rh);
+    const Run_t f = bench(file.c_str(), 1, benchmark ? seconds : 0.0f, full, fw, fh);
+    check("reduced decode", r.peak_bytes > 0, 1, 1, "");
+    check("full decode", f.peak_bytes > 0, 1, 1, "");
+    if (r.peak_bytes == 0 || f.peak_bytes == 0) {
+        std::fprintf(stderr, "%d checks failed: FAIL\n", failures);
+        return 1;
+    }
+    check("reduced width fits", rw, 1, kViewW, "px");
+    check("reduced height fits", rh, 1, kViewH, "px");
+    if (!rgb.empty()) {
+        check("reduced error against box average", box_error(rgb, width, height, factor, reduced.data(), rw, rh), 0,
+              4, "/255");
+        check("full error against source", box_error(rgb, width, height, 1, full.data(), fw, fh), 0, 3, "/255");
+    }
+    check("reduced peak bytes", r.peak_bytes / 1024.0, 0, 128, "KB");
+
+    std::printf("\n%-20s %12s %12s\n", "", "time ms", "peak KB");
+    std::printf("%-20s %12.2f %12.1f\n", "reduced to fit", r.ms, r.peak_bytes / 1024.0);
+    std::printf("%-20s %12.2f %12.1f\n", "full frame buffer", f.ms, f.peak_bytes / 1024.0);
+    std::printf("%-20s %12.2fx %11.1fx\n\n", "full / reduced", f.ms / r.ms,
+                static_cast<double>(f.peak_bytes) / r.peak_bytes);
+    check("peak bytes saved", static_cast<double>(f.peak_bytes) / r.peak_bytes, 4.0, 1e6, "x");
+    if (benchmark) {
+        check("speedup", f.ms / r.ms, 1.0, 1000.0, "x");
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
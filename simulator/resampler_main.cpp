@@ -0,0 +1,261 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/resampler.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Host checks and benchmark of the polyphase sample rate converter
+ *
+ * Every rate the firmware plays is converted to 48 kHz, and 48 kHz down to the capture rates, at each quality. A tone
+ * is fitted against an ideal one at the output for its level and the SNR of everything else (images, aliasing,
+ * rounding), a tone above the lower Nyquist frequency has to be filtered out on the way down, and the pull and push
+ * sides have to give the same samples. Then the common conversions run for -s seconds of audio and the cost is
+ * printed per output sample, in ns and, on x86, in TSC cycles. Fails when any check is off.
+ */
+static int failures = 0;
+
+static const char* kQualityNames[] = {"low", "medium", "high"};
+// Least SNR of a 1 kHz tone per quality
+static const double kMinSnr[] = {40.0, 60.0, 75.0};
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+static std::vector<int16_t> tone(uint32_t rate, double hz, double amplitude, double seconds, uint8_t channels)
+{
+    std::vector<int16_t> x(static_cast<size_t>(seconds * rate) * channels);
+    for (size_t i = 0; i < x.size() / channels; ++i) {
+        const auto v = static_cast<int16_t>(std::lround(amplitude * std::sin(2.0 * M_PI * hz * i / rate)));
+        for (uint8_t c = 0; c < channels; ++c) {
+            x[i * channels + c] = v;
+        }
+    }
+    return x;
+}
+
+// Push side in chunks of `chunk` input frames
+static std::vector<int16_t> convert(Resampler& src, const std::vector<int16_t>& in, size_t chunk)
+{
+    const uint8_t ch = src.channels();
+    std::vector<int16_t> out;
+    std::vector<int16_t> buf(src.maxOutput(chunk) * ch);
+    for (size_t at = 0; at < in.size() / ch; at += chunk) {
+        const size_t n = std::min(chunk, in.size() / ch - at);
+        const size_t m = src.convert(&in[at * ch], n, buf.data());
+        out.insert(out.end(), buf.begin(), buf.begin() + m * ch);
+    }
+    return out;
+}
+
+// Pull side in blocks of `block` output frames, padded with silence once the input is used up
+static std::vector<int16_t> pull(Resampler& src, const std::vector<int16_t>& in, size_t block, size_t frames)
+{
+    const uint8_t ch = src.channels();
+    std::vector<int16_t> out(frames * ch);
+    size_t at = 0;
+    for (size_t o = 0; o + block <= frames; o += block) {
+        const size_t need = src.need(block);
+        int16_t* dst      = src.tail();
+        for (size_t i = 0; i < need * ch; ++i, ++at) {
+            dst[i] = at < in.size() ? in[at] : 0;
+        }
+        src.commit(need);
+        src.render(&out[o * ch], block);
+    }
+    return out;
+}
+
+// Least squares fit of a sine of hz over channel 0 of x[from, to), the amplitude and the SNR of the rest in dB
+static void fit_sine(const std::vector<int16_t>& x, uint8_t ch, uint32_t rate, double hz, size_t from, size_t to,
+                     double* amplitude, double* snr)
+{
+    const double w = 2.0 * M_PI * hz / rate;
+    double ss = 0.0, cc = 0.0, sc = 0.0, xs = 0.0, xc = 0.0;
+    for (size_t i = from; i < to; ++i) {
+        const double s = std::sin(w * i);
+        const double c = std::cos(w * i);
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        xs += x[i * ch] * s;
+        xc += x[i * ch] * c;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a   = (xs * cc - xc * sc) / det;
+    const double b   = (xc * ss - xs * sc) / det;
+    double signal = 0.0, noise = 0.0;
+    for (size_t i = from; i < to; ++i) {
+        const double fit = a * std::sin(w * i) + b * std::cos(w * i);
+        signal += fit * fit;
+        noise += (x[i * ch] - fit) * (x[i * ch] - fit);
+    }
+    *amplitude = std::sqrt(a * a + b * b);
+    *snr       = 10.0 * std::log10(signal / std::max(noise, 1e-9));
+}
+
+static void check_tone(uint32_t in_rate, uint32_t out_rate, Resampler::Quality quality, uint8_t ch)
+{
+    const auto q = static_cast<size_t>(quality);
+    Resampler src;
+    src.init(in_rate, out_rate, ch, quality, 512);
+    const auto out = convert(src, tone(in_rate, 1000.0, 16384.0, 1.0, ch), 160);
+
+    double amplitude = 0.0, snr = 0.0;
+    fit_sine(out, ch, out_rate, 1000.0, out_rate / 10, out.size() / ch - out_rate / 10, &amplitude, &snr);
+    char name[64];
+    std::snprintf(name, sizeof(name), "%u > %u %s %s, 1 kHz SNR", in_rate, out_rate, ch == 2 ? "stereo" : "mono",
+                  kQualityNames[q]);
+    check(name, snr, kMinSnr[q], 200.0, "dB");
+    std::snprintf(name, sizeof(name), "%u > %u %s %s, 1 kHz level", in_rate, out_rate, ch == 2 ? "stereo" : "mono",
+                  kQualityNames[q]);
+    check(name, 20.0 * std::log10(amplitude / 16384.0), -0.1, 0.1, "dB");
+}
+
+// A tone the output can't hold has to be filtered out, not folded back
+static void check_alias(uint32_t in_rate, uint32_t out_rate, Resampler::Quality quality, double min_db)
+{
+    Resampler src;
+    src.init(in_rate, out_rate, 1, quality, 512);
+    const double hz = out_rate * 0.6;
+    const auto out  = convert(src, tone(in_rate, hz, 16384.0, 0.5, 1), 160);
+    double energy   = 0.0;
+    for (size_t i = out_rate / 10; i < out.size(); ++i) {
+        energy += static_cast<double>(out[i]) * out[i];
+    }
+    const double rms = std::sqrt(energy / (out.size() - out_rate / 10));
+    char name[64];
+    std::snprintf(name, sizeof(name), "%u > %u %s, %.0f Hz rejected", in_rate, out_rate,
+                  kQualityNames[static_cast<size_t>(quality)], hz);
+    check(name, 20.0 * std::log10(16384.0 / std::sqrt(2.0) / std::max(rms, 1e-3)), min_db, 200.0, "dB");
+}
+
+static void check_sides()
+{
+    const auto in = tone(44100, 3000.0, 12000.0, 0.5, 2);
+    Resampler push, pulled;
+    push.init(44100, 48000, 2, Resampler::Quality::High, 512);
+    pulled.init(44100, 48000, 2, Resampler::Quality::High, 512);
+    const auto a = convert(push, in, 441);
+    const auto b = pull(pulled, in, 256, a.size() / 2 / 256 * 256);
+    int diff     = 0;
+    for (size_t i = 0; i < b.size(); ++i) {
+        diff = std::max(diff, std::abs(a[i] - b[i]));
+    }
+    check("pull and push sides agree", diff, 0, 0, "lsb");
+
+    Resampler same;
+    same.init(48000, 48000, 1, Resampler::Quality::High, 256);
+    const auto x = tone(48000, 1000.0, 16384.0, 0.1, 1);
+    check("equal rates pass through", convert(same, x, 100) == x ? 1 : 0, 1, 1, "");
+}
+
+static void bench(uint32_t in_rate, uint32_t out_rate, Resampler::Quality quality, uint8_t ch, float seconds)
+{
+    Resampler src;
+    src.init(in_rate, out_rate, ch, quality, 256);
+    const auto in       = tone(in_rate, 1000.0, 12000.0, 1.0, ch);
+    const size_t blocks = static_cast<size_t>(seconds * out_rate / 256);
+    std::vector<int16_t> out(256 * ch);
+    size_t at = 0;
+
+    const auto t0 = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const uint64_t c0 = __rdtsc();
+#endif
+    for (size_t b = 0; b < blocks; ++b) {
+        const size_t need = src.need(256);
+        const size_t n    = need * ch;
+        if (at + n > in.size()) {
+            at = 0;
+        }
+        std::memcpy(src.tail(), &in[at], n * sizeof(int16_t));
+        at += n;
+        src.commit(need);
+        src.render(out.data(), 256);
+    }
+    const double ns      = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    const double samples = static_cast<double>(blocks) * 256;
+    char name[64];
+    std::snprintf(name, sizeof(name), "%u > %u %s %s", in_rate, out_rate, ch == 2 ? "stereo" : "mono",
+                  kQualityNames[static_cast<size_t>(quality)]);
+#if defined(__x86_64__) || defined(__i386__)
+    const double cycles = static_cast<double>(__rdtsc() - c0);
+    std::printf("%-34s %8.2f ns/frame %8.2f cycles/frame\n", name, ns / samples, cycles / samples);
+#else
+    std::printf("%-34s %8.2f ns/frame\n", name, ns / samples);
+#endif
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -s <sec>   audio per benchmark (default 20)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds  = 20.0f;
+    bool benchmark = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    static const uint32_t kRates[] = {8000, 11025, 16000, 22050, 32000, 44100};
+    for (int q = 0; q < 3; ++q) {
+        const auto quality = static_cast<Resampler::Quality>(q);
+        for (uint32_t rate : kRates) {
+            check_tone(rate, 48000, quality, 1);
+        }
+        check_tone(44100, 48000, quality, 2);
+        check_tone(48000, 16000, quality, 1);
+        check_tone(48000, 8000, quality, 1);
+        check_tone(44100, 16000, quality, 1);
+    }
+    check_alias(48000, 16000, Resampler::Quality::Low, 25.0);
+    check_alias(48000, 16000, Resampler::Quality::Medium, 45.0);
+    check_alias(48000, 16000, Resampler::Quality::High, 65.0);
+    check_alias(44100, 8000, Resampler::Quality::High, 65.0);
+    check_sides();
+
+    if (benchmark) {
+        std::printf("\n");
+        for (int q = 0; q < 3; ++q) {
+            const auto quality = static_cast<Resampler::Quality>(q);
+            bench(44100, 48000, quality, 2, seconds);
+            bench(16000, 48000, quality, 1, seconds);
+            bench(48000, 16000, quality, 1, seconds);
+        }
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/image/rgb565_blend.h>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Host checks and benchmark of the slideshow transition kernels
+ *
+ * The crossfade has to stay within one step of each 565 field of an exact blend at every alpha, and the wipe has to
+ * take b left of the feather and a right of the edge. Then a 240 x 115 frame of the Pictures view is crossfaded,
+ * wiped and copied for -s seconds each, and the cost is printed per pixel, in ns and, on x86, in TSC cycles, and per
+ * frame. Fails when any check is off.
+ */
+static int failures = 0;
+
+static constexpr int kWidth  = 240;
+static constexpr int kHeight = 115;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+static void fields(uint16_t swapped, int f[3])
+{
+    const uint16_t c = __builtin_bswap16(swapped);
+    f[0]             = c >> 11;
+    f[1]             = (c >> 5) & 0x3F;
+    f[2]             = c & 0x1F;
+}
+
+/** Largest distance of any field from the exact blend, in steps of that field */
+static double max_blend_error(std::mt19937& rng, int samples)
+{
+    std::vector<uint16_t> a(samples), b(samples), out(samples);
+    for (int i = 0; i < samples; ++i) {
+        a[i] = static_cast<uint16_t>(rng());
+        b[i] = static_cast<uint16_t>(rng());
+    }
+    double worst = 0.0;
+    for (int alpha = 0; alpha <= rgb565::kBlendMax; ++alpha) {
+        rgb565::blend(out.data(), a.data(), b.data(), samples, static_cast<uint8_t>(alpha));
+        for (int i = 0; i < samples; ++i) {
+            int fa[3], fb[3], fo[3];
+            fields(a[i], fa);
+            fields(b[i], fb);
+            fields(out[i], fo);
+            for (int c = 0; c < 3; ++c) {
+                const double exact = fa[c] + (fb[c] - fa[c]) * alpha / static_cast<double>(rgb565::kBlendMax);
+                worst              = std::max(worst, std::fabs(fo[c] - exact));
+            }
+        }
+    }
+    return worst;
+}
+
+static double aliased_mismatches(std::mt19937& rng)
+{
+    std::vector<uint16_t> a(kWidth), b(kWidth), expect(kWidth);
+    for (int i = 0; i < kWidth; ++i) {
+        a[i] = static_cast<uint16_t>(rng());
+        b[i] = static_cast<uint16_t>(rng());
+    }
+    rgb565::blend(expect.data(), a.data(), b.data(), kWidth - 1, 11);
+    rgb565::blend(a.data(), a.data(), b.data(), kWidth - 1, 11);
+    return std::memcmp(a.data(), expect.data(), (kWidth - 1) * sizeof(uint16_t)) == 0 ? 0 : 1;
+}
+
+static double wipe_mismatches(std::mt19937& rng, int edge, int feather)
+{
+    const size_t count = static_cast<size_t>(kWidth) * kHeight;
+    std::vector<uint16_t> a(count), b(count), out(count);
+    for (size_t i = 0; i < count; ++i) {
+        a[i] = static_cast<uint16_t>(rng());
+        b[i] = static_cast<uint16_t>(rng());
+    }
+    rgb565::wipe(out.data(), a.data(), b.data(), kWidth, kHeight, kWidth, edge, feather);
+    int bad = 0;
+    for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+            const size_t i = static_cast<size_t>(y) * kWidth + x;
+            if (x < edge - feather) {
+                bad += out[i] != b[i];
+            } else if (x >= edge) {
+                bad += out[i] != a[i];
+            }
+        }
+    }
+    return bad;
+}
+
+template <typename Fn>
+static void bench(const char* name, float seconds, Fn&& fn)
+{
+    const double pixels_per_frame = static_cast<double>(kWidth) * kHeight;
+    long frames                   = 0;
+    const auto t0                 = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const uint64_t c0 = __rdtsc();
+#endif
+    double ns = 0.0;
+    do {
+        for (int i = 0; i < 64; ++i) {
+            fn(static_cast<int>(frames + i));
+        }
+        frames += 64;
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    } while (ns < seconds * 1e9);
+    const double pixels = frames * pixels_per_frame;
+#if defined(__x86_64__) || defined(__i386__)
+    const double cycles = static_cast<double>(__rdtsc() - c0);
+    std::printf("%-34s %8.2f ns/px %8.2f cycles/px %8.1f us/frame\n", name, ns / pixels, cycles / pixels,
+                ns / frames / 1000.0);
+#else
+    std::printf("%-34s %8.2f ns/px %8.1f us/frame\n", name, ns / pixels, ns / frames / 1000.0);
+#endif
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -s <sec>   frames per benchmark (default 2)\n"
+        "  -r <seed>  random seed (default 1)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds  = 2.0f;
+    uint32_t seed  = 1;
+    bool benchmark = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    // The shift by 5 floors, so a field can land up to one step below the exact blend
+    check("blend error at every alpha", max_blend_error(rng, 4096), 0, 1, "steps");
+    check("blend in place mismatches", aliased_mismatches(rng), 0, 0, "");
+    check("wipe outside the feather mismatches", wipe_mismatches(rng, 120, 24), 0, 0, "px");
+    check("wipe before the frame mismatches", wipe_mismatches(rng, 0, 24), 0, 0, "px");
+    check("wipe past the frame mismatches", wipe_mismatches(rng, kWidth + 24, 24), 0, 0, "px");
+
+    if (benchmark) {
+        const size_t count = static_cast<size_t>(kWidth) * kHeight;
+        std::vector<uint16_t> a(count), b(count), out(count);
+        for (size_t i = 0; i < count; ++i) {
+            a[i] = static_cast<uint16_t>(rng());
+            b[i] = static_cast<uint16_t>(rng());
+        }
+        std::printf("\n%d x %d frame\n", kWidth, kHeight);
+        bench("copy (no transition)", seconds,
+              [&](int) { std::memcpy(out.data(), a.data(), count * sizeof(uint16_t)); });
+        bench("crossfade", seconds, [&](int frame) {
+            rgb565::blend(out.data(), a.data(), b.data(), count, static_cast<uint8_t>(1 + frame % 31));
+        });
+        bench("wipe, 24 px feather", seconds, [&](int frame) {
+            rgb565::wipe(out.data(), a.data(), b.data(), kWidth, kHeight, kWidth, frame % (kWidth + 24), 24);
+        });
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/fs/sd_bench.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/**
+ * Host run of the SD benchmark suite against a file in a host folder, e.g. a card in a USB reader or a loop mounted
+ * FAT image. Prints the same CSV as the device app so runs can be compared.
+ */
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -d <dir>   folder to put the test file in (default .)\n"
+        "  -f <MiB>   test file size (default 4)\n"
+        "  -n <n>     max operations per test (default 2048)\n"
+        "  -r <seed>  random offset seed (default 1)\n"
+        "  -l <text>  label for the CSV rows (default host)\n"
+        "  -S         add the random write span sweep\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    std::string dir   = ".";
+    std::string label = "host";
+    bool span_sweep   = false;
+    sdbench::Config_t config;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-d") == 0 && has_value) {
+            dir = argv[++i];
+        } else if (std::strcmp(argv[i], "-f") == 0 && has_value) {
+            config.file_bytes = std::strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (std::strcmp(argv[i], "-n") == 0 && has_value) {
+            config.max_ops = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            config.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-l") == 0 && has_value) {
+            label = argv[++i];
+        } else if (std::strcmp(argv[i], "-S") == 0) {
+            span_sweep = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    config.path = dir + "/sdbench.tmp";
+
+    int failed = 0;
+    sdbench::writeCsvHeader(stdout);
+    for (const auto& c : sdbench::defaultCases(span_sweep)) {
+        config.block_bytes = c.block_bytes;
+        config.span_bytes  = c.span_bytes;
+        sdbench::Result_t result;
+        if (!sdbench::run(config, c.pattern, result)) {
+            failed++;
+        }
+        sdbench::writeCsv(stdout, label.c_str(), result);
+        std::fflush(stdout);
+    }
+    std::remove(config.path.c_str());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+// Plain malloc, sized like a Cardputer without PSRAM so the apps pick their internal heap paths
+static constexpr size_t kSimInternalHeap = 256 * 1024;
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? nullptr : std::malloc(size);
+}
+
+inline void heap_caps_free(void* ptr)
+{
+    std::free(ptr);
+}
+
+inline size_t heap_caps_get_total_size(uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? 0 : kSimInternalHeap;
+}
+
+inline size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return heap_caps_get_total_size(caps);
+}
+
+inline size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_total_size(caps);
+}
@@ -0,0 +1,15 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// Wall clock microseconds, the profiler measures real host time even though the Hal clock is virtual
+inline int64_t esp_timer_get_time()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
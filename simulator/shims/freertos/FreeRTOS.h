@@ -0,0 +1,24 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+#include <cstdint>
+
+// Just enough of the FreeRTOS API for the app worker tasks, backed by std::thread in freertos_shim.cpp. One tick is
+// one millisecond of wall time like CONFIG_FREERTOS_HZ=1000 on the device.
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE            ((BaseType_t)0)
+#define pdTRUE             ((BaseType_t)1)
+#define pdPASS             pdTRUE
+#define pdFAIL             pdFALSE
+#define portMAX_DELAY      ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
+
+struct QueueDefinition;
+typedef QueueDefinition* QueueHandle_t;
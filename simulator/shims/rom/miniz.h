@@ -0,0 +1,9 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#pragma once
+// The device inflates with the tinfl copy in the ESP32-S3 ROM, the host reuses the one M5GFX bundles for its PNG
+// decoder, already built into m5gfx_host
+#include <lgfx/utility/miniz.h>
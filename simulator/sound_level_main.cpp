@@ -0,0 +1,428 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/sound_level.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Host checks and benchmark of the sound level meter
+ *
+ * The A weighting is measured with sines and compared with the analog response of IEC 61672-1 Annex E, which is first
+ * checked against the nominal values of the standard's table. Levels come from tones of known RMS, the Fast time
+ * weighting from the standard's 4 kHz tone bursts and decay rate. The sliding window is fed random blocks, with loud
+ * spells that leave it again, and every push is compared with the statistics recomputed from scratch. The VAD has to
+ * find syllables of a voice like tone in noise, stay off in the pauses and get over a background that steps up. Then
+ * the meter runs for -s seconds of audio at 48 kHz and the cost is printed per sample, in ns and, on x86, in TSC
+ * cycles. Fails when any check is off.
+ */
+static constexpr float kRate = 48000.0f;
+static constexpr double kPi  = 3.14159265358979323846;
+static int failures          = 0;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-44s %9.3f %-5s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+// Analog A weighting in dB, IEC 61672-1 Annex E
+static double a_weighting_db(double f)
+{
+    const double f1 = 20.598997, f2 = 107.65265, f3 = 737.86223, f4 = 12194.217;
+    const double f_2 = f * f;
+    const double ra  =
+        f4 * f4 * f_2 * f_2 / ((f_2 + f1 * f1) * std::sqrt((f_2 + f2 * f2) * (f_2 + f3 * f3)) * (f_2 + f4 * f4));
+    return 20.0 * std::log10(ra) + 2.0;
+}
+
+static std::vector<float> sine(float hz, float rms_db, float seconds, float rate = kRate)
+{
+    std::vector<float> x(static_cast<size_t>(seconds * rate));
+    const double amp = std::sqrt(2.0) * std::pow(10.0, rms_db / 20.0);
+    for (size_t i = 0; i < x.size(); ++i) {
+        x[i] = static_cast<float>(amp * std::sin(2.0 * kPi * hz * i / rate));
+    }
+    return x;
+}
+
+static double rms_db(const float* x, size_t n)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += static_cast<double>(x[i]) * x[i];
+    }
+    return 10.0 * std::log10(sum / n);
+}
+
+// Runs x through a fresh meter, levels after the last block
+static slm::Levels_t measure(const std::vector<float>& x, float window_s, float rate = kRate)
+{
+    slm::Meter meter;
+    slm::Meter::Config_t config;
+    config.sample_rate = rate;
+    config.window_s    = window_s;
+    meter.init(config);
+    meter.process(x.data(), x.size());
+    return meter.levels();
+}
+
+static void check_weighting()
+{
+    std::printf("A weighting\n");
+
+    // The formula against IEC 61672-1 Table 3, at the exact base ten frequencies the table rounds to its labels
+    struct Nominal_t {
+        int band;  // 1000 * 10^(band / 10) Hz
+        double db;
+    };
+    static const Nominal_t kTable[] = {{-15, -39.4}, {-12, -26.2}, {-9, -16.1}, {-6, -8.6}, {-3, -3.2},
+                                       {0, 0.0},     {3, 1.2},     {6, 1.0},    {9, -1.1},  {12, -6.6}};
+    double worst = 0.0;
+    for (const auto& t : kTable) {
+        worst = std::max(worst, std::fabs(a_weighting_db(1000.0 * std::pow(10.0, t.band / 10.0)) - t.db));
+    }
+    check("formula against the table", worst, 0.0, 0.05, "dB");
+
+    // Measured through the filters, a second after a second to settle. At low and middle frequencies the bilinear
+    // transform is as good as exact, towards Nyquist it falls below the analog response and has to stay inside the
+    // class 1 limits of Table 3
+    struct Limit_t {
+        int band;
+        double hi;
+        double lo;
+    };
+    static const Limit_t kClass1[] = {{5, 1.0, -1.0},  {6, 1.0, -1.0},  {7, 1.5, -1.5},  {8, 1.5, -2.0},
+                                      {9, 1.5, -2.5},  {10, 2.0, -3.0}, {11, 2.0, -5.0}, {12, 2.5, -16.0}};
+    struct Rate_t {
+        float rate;
+        int close_band;  // Highest band within 0.1 dB of the formula
+        int last_band;   // Highest band inside the class 1 limits
+    };
+    static const Rate_t kRates[] = {{48000.0f, 6, 12}, {16000.0f, 4, 6}};
+    for (const auto& r : kRates) {
+        double close = 0.0;
+        int outside  = 0;
+        for (int band = -15; band <= r.last_band; ++band) {
+            const double hz = 1000.0 * std::pow(10.0, band / 10.0);
+            auto x          = sine(static_cast<float>(hz), -20.0f, 2.0f, r.rate);
+            slm::AWeighting weighting;
+            weighting.init(r.rate);
+            weighting.process(x.data(), x.size());
+            const size_t half  = x.size() / 2;
+            const double error = rms_db(&x[half], half) + 20.0 - a_weighting_db(hz);
+            if (band <= r.close_band) {
+                close = std::max(close, std::fabs(error));
+                continue;
+            }
+            for (const auto& limit : kClass1) {
+                outside += limit.band == band && (error > limit.hi || error < limit.lo) ? 1 : 0;
+            }
+        }
+        char name[64];
+        std::snprintf(name, sizeof(name), "%.0f kHz, 31.6 Hz to %.1f kHz", r.rate / 1000.0f,
+                      std::pow(10.0, r.close_band / 10.0));
+        check(name, close, 0.0, 0.1, "dB");
+        std::snprintf(name, sizeof(name), "%.0f kHz, bands outside class 1 to %.1f kHz", r.rate / 1000.0f,
+                      std::pow(10.0, r.last_band / 10.0));
+        check(name, outside, 0, 0, "");
+    }
+}
+
+static void check_levels()
+{
+    std::printf("\nLevels\n");
+
+    // 1 kHz is 0 dB in A, a sine's peak is 3 dB over its RMS
+    auto levels = measure(sine(1000.0f, -23.0f, 3.0f), 2.0f);
+    check("1 kHz at -23 dB, Leq", levels.leq, -23.05, -22.95, "dB");
+    check("1 kHz at -23 dB, LAFmax", levels.lmax, -23.1, -22.9, "dB");
+    check("1 kHz at -23 dB, L10 - L90", levels.l10 - levels.l90, 0.0, 0.2, "dB");
+    check("1 kHz at -23 dB, L50", levels.l50, -23.1, -22.9, "dB");
+    check("1 kHz at -23 dB, peak", levels.peak, -20.04, -19.94, "dB");
+
+    // Float round off in the weighting has to stay out of quiet readings
+    levels = measure(sine(1000.0f, -90.0f, 3.0f), 2.0f);
+    check("1 kHz at -90 dB, Leq", levels.leq, -90.1, -89.9, "dB");
+    levels = measure(sine(31.6f, -40.0f, 4.0f), 2.0f);
+    const double at_31 = -40.0 + a_weighting_db(31.6);
+    check("31.6 Hz at -40 dB, Leq", levels.leq, at_31 - 0.1, at_31 + 0.1, "dB");
+
+    // Half the window at -30 dB, half at -50: the energies average, the percentiles fall on either
+    auto x         = sine(1000.0f, -30.0f, 5.0f);
+    const auto low = sine(1000.0f, -50.0f, 5.0f);
+    x.insert(x.end(), low.begin(), low.end());
+    levels = measure(x, 10.0f);
+    const double mean = 10.0 * std::log10((1e-3 + 1e-5) / 2.0);
+    check("-30 then -50 dB, Leq", levels.leq, mean - 0.05, mean + 0.05, "dB");
+    check("-30 then -50 dB, L10", levels.l10, -30.1, -29.9, "dB");
+    check("-30 then -50 dB, L90", levels.l90, -50.1, -49.9, "dB");
+    check("-30 then -50 dB, LAFmax", levels.lmax, -30.1, -29.9, "dB");
+
+    // Fast time weighting, IEC 61672-1 Table 4: 4 kHz bursts against the steady tone, and the decay rate
+    struct Burst_t {
+        float ms;
+        double db;
+        double lo;
+        double hi;
+    };
+    static const Burst_t kBursts[] = {{200.0f, -1.0, -0.5, 0.5}, {2.0f, -18.0, -1.5, 1.0}, {0.25f, -27.0, -3.0, 1.0}};
+    const auto steady = measure(sine(4000.0f, -20.0f, 2.0f), 1.0f);
+    for (const auto& b : kBursts) {
+        auto burst = sine(4000.0f, -20.0f, 2.0f);
+        std::fill(burst.begin() + static_cast<size_t>(b.ms * kRate / 1000.0f), burst.end(), 0.0f);
+        const auto l = measure(burst, 2.0f);
+        char name[64];
+        std::snprintf(name, sizeof(name), "%g ms burst, LAFmax from %.1f", b.ms, b.db);
+        check(name, l.lmax - steady.lmax - b.db, b.lo, b.hi, "dB");
+        if (b.ms == 200.0f) {
+            // Leq of a burst in a longer window is its exposure spread over the window
+            check("200 ms burst, Leq in 2 s", l.leq - (steady.leq + 10.0 * std::log10(0.2 / 2.0)), -0.1, 0.1, "dB");
+        }
+    }
+
+    slm::Meter meter;
+    slm::Meter::Config_t config;
+    meter.init(config);
+    const auto tone = sine(1000.0f, -20.0f, 2.0f);
+    meter.process(tone.data(), tone.size());
+    const std::vector<float> silence(static_cast<size_t>(kRate * slm::kBlockMs / 1000));
+    meter.process(silence.data(), silence.size());
+    const float start = meter.levels().laf;
+    for (int i = 0; i < 4; ++i) {
+        meter.process(silence.data(), silence.size());
+    }
+    check("Fast decay rate", (start - meter.levels().laf) / 0.5, 34.7 - 3.7, 34.7 + 3.8, "dB/s");
+}
+
+static void check_window()
+{
+    std::printf("\nSliding window\n");
+
+    // Mostly quiet random blocks with loud spells, each push compared with the window recomputed from the blocks
+    constexpr size_t kLength = 80;
+    constexpr int kPushes    = 20000;
+    slm::LevelWindow window;
+    window.init(kLength * 2);
+    window.setLength(kLength);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> level(-90.0f, -40.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<slm::LevelWindow::Block_t> blocks;
+    double leq_error = 0.0, max_error = 0.0, peak_error = 0.0, ln_error = 0.0, voice_error = 0.0;
+    for (int i = 0; i < kPushes; ++i) {
+        const bool loud = (i / 500) % 4 == 1;
+        slm::LevelWindow::Block_t b;
+        b.energy = std::pow(10.0f, (loud ? 0.0f : level(rng)) / 10.0f);
+        b.laf    = std::pow(10.0f, (loud ? -3.0f : level(rng)) / 10.0f);
+        b.lmax   = b.laf * (1.0f + unit(rng));
+        b.peak   = std::sqrt(b.energy) * (1.0f + 2.0f * unit(rng));
+        b.voice  = unit(rng) < 0.3f ? unit(rng) : 0.0f;
+        window.push(b);
+        blocks.push_back(b);
+
+        const size_t n = std::min(blocks.size(), kLength);
+        double energy = 0.0, voice = 0.0;
+        float lmax = 0.0f, peak = 0.0f;
+        std::vector<int> bins;
+        for (size_t j = blocks.size() - n; j < blocks.size(); ++j) {
+            energy += blocks[j].energy;
+            voice += blocks[j].voice;
+            lmax = std::max(lmax, blocks[j].lmax);
+            peak = std::max(peak, blocks[j].peak);
+            bins.push_back(slm::LevelWindow::binOf(slm::toDb(blocks[j].laf)));
+        }
+        std::sort(bins.begin(), bins.end(), std::greater<int>());
+        leq_error   = std::max(leq_error, std::fabs(window.leqDb() - 10.0 * std::log10(energy / n)));
+        max_error   = std::max<double>(max_error, std::fabs(window.lmaxDb() - slm::toDb(lmax)));
+        peak_error  = std::max<double>(peak_error, std::fabs(window.peakDb() - slm::toDb(peak * peak)));
+        voice_error = std::max(voice_error, std::fabs(window.voiceRatio() - voice / n));
+        for (float percent : {10.0f, 50.0f, 90.0f}) {
+            const auto rank = std::min(static_cast<size_t>(percent / 100.0f * n), n - 1);
+            ln_error = std::max<double>(
+                ln_error, std::fabs(window.percentileDb(percent) - slm::LevelWindow::levelOf(bins[rank])));
+        }
+    }
+    check("Leq against a full sum", leq_error, 0.0, 0.001, "dB");
+    check("LAFmax against a full scan", max_error, 0.0, 0.0, "dB");
+    check("peak against a full scan", peak_error, 0.0, 0.0, "dB");
+    check("L10, L50, L90 against a sort", ln_error, 0.0, 0.0, "dB");
+    check("voice share against a full sum", voice_error, 0.0, 1e-6, "");
+}
+
+// Vowel like tone, a fundamental that wanders with its harmonics up to 3 kHz falling 6 dB an octave
+static void add_voice(std::vector<float>& x, size_t from, size_t to, float rms_db, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> f0(110.0f, 220.0f);
+    const double hz    = f0(rng);
+    const double level = std::pow(10.0, rms_db / 20.0) * 1.2;
+    const size_t ramp  = static_cast<size_t>(0.01f * kRate);
+    for (size_t i = from; i < to && i < x.size(); ++i) {
+        const double t   = static_cast<double>(i - from) / kRate;
+        const double f   = hz * (1.0 + 0.05 * std::sin(2.0 * kPi * 3.0 * t));
+        const double env = std::min({1.0, static_cast<double>(i - from) / ramp, static_cast<double>(to - i) / ramp});
+        double s         = 0.0;
+        for (int h = 1; h * hz < 3000.0; ++h) {
+            s += std::sin(2.0 * kPi * f * h * t) / h;
+        }
+        x[i] += static_cast<float>(level * env * s);
+    }
+}
+
+static void add_noise(std::vector<float>& x, size_t from, size_t to, float rms_db, std::mt19937& rng)
+{
+    std::normal_distribution<float> noise(0.0f, std::pow(10.0f, rms_db / 20.0f));
+    for (size_t i = from; i < to && i < x.size(); ++i) {
+        x[i] += noise(rng);
+    }
+}
+
+static void check_vad()
+{
+    std::printf("\nVoice activity\n");
+    std::mt19937 rng(11);
+
+    // Sentences of 150 ms syllables with 100 ms gaps, a second of pause between them, 15 dB over the noise
+    const size_t n = static_cast<size_t>(kRate * 30.0f);
+    std::vector<float> x(n, 0.0f);
+    std::vector<bool> speech(n, false);
+    add_noise(x, 0, n, -45.0f, rng);
+    size_t at = static_cast<size_t>(kRate * 2.0f);
+    while (at + kRate * 3.0f < n) {
+        for (int syllable = 0; syllable < 8; ++syllable) {
+            const size_t end = at + static_cast<size_t>(kRate * 0.15f);
+            add_voice(x, at, end, -30.0f, rng);
+            std::fill(speech.begin() + at, speech.begin() + end, true);
+            at = end + static_cast<size_t>(kRate * 0.1f);
+        }
+        at += static_cast<size_t>(kRate * 1.0f);
+    }
+
+    slm::Vad vad;
+    vad.configure(slm::Vad::Config_t());
+    slm::AWeighting weighting;
+    weighting.init(kRate);
+    std::vector<float> y = x;
+    weighting.process(y.data(), y.size());
+    const size_t frame = static_cast<size_t>(kRate * slm::Vad::kFrameMs / 1000);
+    const size_t hang  = static_cast<size_t>(kRate * 0.4f);
+    size_t syllable_frames = 0, found = 0, pause_frames = 0, false_frames = 0;
+    size_t since_speech = n;
+    for (size_t f = 0; f + frame <= n; f += frame) {
+        double e = 0.0;
+        bool any = false;
+        for (size_t i = f; i < f + frame; ++i) {
+            e += static_cast<double>(y[i]) * y[i];
+            any = any || speech[i];
+        }
+        const bool on = vad.update(static_cast<float>(e / frame));
+        since_speech  = any ? 0 : since_speech + frame;
+        if (any) {
+            ++syllable_frames;
+            found += on ? 1 : 0;
+        } else if (since_speech > hang && f > kRate) {
+            // Out of the hangover and past the first second, where the floor is still settling
+            ++pause_frames;
+            false_frames += on ? 1 : 0;
+        }
+    }
+    check("syllable frames found", 100.0 * found / syllable_frames, 90.0, 100.0, "%");
+    check("pause frames taken for voice", 100.0 * false_frames / pause_frames, 0.0, 5.0, "%");
+
+    // A fan switching on, 15 dB over the quiet before, has to stop reading as voice once the floor window passed
+    std::vector<float> fan(static_cast<size_t>(kRate * 12.0f), 0.0f);
+    add_noise(fan, 0, fan.size(), -60.0f, rng);
+    add_noise(fan, static_cast<size_t>(kRate * 4.0f), fan.size(), -45.0f, rng);
+    const auto levels = measure(fan, 8.0f);
+    check("voice after a 15 dB noise step", levels.voice * 8.0, 0.0, 2.0, "s");
+}
+
+static void bench(float seconds)
+{
+    slm::Meter meter;
+    slm::Meter::Config_t config;
+    config.sample_rate = kRate;
+    meter.init(config);
+
+    std::mt19937 rng(3);
+    std::vector<float> x(static_cast<size_t>(kRate));
+    add_noise(x, 0, x.size(), -30.0f, rng);
+    constexpr size_t kChunk = 256;
+    const size_t chunks     = static_cast<size_t>(seconds * kRate) / kChunk;
+    float sink              = 0.0f;
+
+    const auto t0 = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const uint64_t c0 = __rdtsc();
+#endif
+    for (size_t i = 0; i < chunks; ++i) {
+        if (meter.process(&x[(i * kChunk) % (x.size() - kChunk)], kChunk)) {
+            sink += meter.levels().l50;
+        }
+    }
+    const double ns      = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    const double samples = static_cast<double>(chunks * kChunk);
+    std::printf("%.0f s at %.0f Hz in chunks of %zu, levels every block (sum %.0f)\n", samples / kRate, kRate, kChunk,
+                sink);
+#if defined(__x86_64__) || defined(__i386__)
+    const double cycles = static_cast<double>(__rdtsc() - c0);
+    std::printf("%-34s %10.2f ns/sample %8.1f cycles/sample\n", "process", ns / samples, cycles / samples);
+#else
+    std::printf("%-34s %10.2f ns/sample\n", "process", ns / samples);
+#endif
+    std::printf("%-34s %10.3f %% of a core\n", "at the mic rate", ns / samples * kRate / 1e7);
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -s <sec>   audio to benchmark (default 60)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds  = 60.0f;
+    bool benchmark = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    check_weighting();
+    check_levels();
+    check_window();
+    check_vad();
+
+    if (benchmark) {
+        std::printf("\n");
+        bench(seconds);
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
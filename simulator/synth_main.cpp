@@ -0,0 +1,230 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/synth.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * Host checks and benchmark of the UI synth
+ *
+ * A held sine is fitted against an ideal one for its frequency and level, the envelope of a note is timed against its
+ * patch, a delayed note has to start on its frame, and the voice pool and command queue have to steal and drop what
+ * they can't hold. Then every voice plays for -s seconds of audio and the render cost is printed per voice per
+ * block, as the synth measures it and as the host clock does. Fails when any check is off.
+ */
+static uint32_t g_rate = 48000;
+static int failures    = 0;
+
+static void check(const char* name, double value, double lo, double hi, const char* unit)
+{
+    const bool ok = value >= lo && value <= hi;
+    std::printf("%-34s %10.2f %-6s [%g, %g]: %s\n", name, value, unit, lo, hi, ok ? "OK" : "FAIL");
+    failures += ok ? 0 : 1;
+}
+
+static std::vector<int16_t> render(Synth& synth, double seconds)
+{
+    std::vector<int16_t> out(static_cast<size_t>(seconds * g_rate));
+    synth.render(out.data(), out.size());
+    return out;
+}
+
+static size_t first_sound(const std::vector<int16_t>& x)
+{
+    for (size_t i = 0; i < x.size(); ++i) {
+        if (x[i] != 0) {
+            return i;
+        }
+    }
+    return x.size();
+}
+
+static size_t last_sound(const std::vector<int16_t>& x)
+{
+    for (size_t i = x.size(); i > 0; --i) {
+        if (x[i - 1] != 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// Least squares fit of a sine of hz over x, the residual is everything else: interpolation error, aliasing, rounding
+static void check_sine(float hz)
+{
+    Synth synth;
+    synth.begin(g_rate);
+    Synth::Patch_t patch;
+    patch.attack_ms = 0;
+    synth.noteOn(hz, 2000, 16384, patch);
+    const auto x = render(synth, 1.0);
+
+    const size_t from = g_rate / 10;
+    const double w    = 2.0 * M_PI * hz / g_rate;
+    double ss = 0.0, cc = 0.0, sc = 0.0, xs = 0.0, xc = 0.0;
+    for (size_t i = from; i < x.size(); ++i) {
+        const double s = std::sin(w * i);
+        const double c = std::cos(w * i);
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        xs += x[i] * s;
+        xc += x[i] * c;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a   = (xs * cc - xc * sc) / det;
+    const double b   = (xc * ss - xs * sc) / det;
+    double signal = 0.0, noise = 0.0;
+    for (size_t i = from; i < x.size(); ++i) {
+        const double fit = a * std::sin(w * i) + b * std::cos(w * i);
+        signal += fit * fit;
+        noise += (x[i] - fit) * (x[i] - fit);
+    }
+    char name[48];
+    std::snprintf(name, sizeof(name), "sine %.0f Hz level", hz);
+    check(name, std::sqrt(a * a + b * b), 16384 * 0.995, 16384 * 1.005, "");
+    std::snprintf(name, sizeof(name), "sine %.0f Hz SNR", hz);
+    check(name, 10.0 * std::log10(signal / std::max(noise, 1e-9)), 70.0, 200.0, "dB");
+}
+
+static void check_envelope()
+{
+    Synth synth;
+    synth.begin(g_rate);
+    Synth::Patch_t patch;
+    patch.attack_ms  = 10;
+    patch.decay_ms   = 20;
+    patch.sustain    = 16384;
+    patch.release_ms = 30;
+    synth.noteOn(1000.0f, 100, 32767, patch);
+    const auto x = render(synth, 0.25);
+
+    // Peak over each millisecond, the envelope seen through the tone
+    const size_t ms = g_rate / 1000;
+    std::vector<int> env(x.size() / ms);
+    for (size_t m = 0; m < env.size(); ++m) {
+        for (size_t i = 0; i < ms; ++i) {
+            env[m] = std::max(env[m], std::abs(static_cast<int>(x[m * ms + i])));
+        }
+    }
+    check("attack peak at 10 ms", env[10], 32767 * 0.97, 32767, "");
+    check("half way up at 5 ms", env[4], 32767 * 0.4, 32767 * 0.55, "");
+    check("sustain after the decay", env[60], 16384 * 0.97, 16384 * 1.03, "");
+    check("half way down the release", env[115], 16384 * 0.4, 16384 * 0.6, "");
+    check("silent after the release, ms", last_sound(x) / static_cast<double>(ms), 129.0, 130.5, "ms");
+    check("voice freed", synth.idle() ? 1 : 0, 1, 1, "");
+}
+
+static void check_schedule()
+{
+    Synth synth;
+    synth.begin(g_rate);
+    Synth::Patch_t patch;
+    patch.attack_ms = 0;
+    synth.noteOn(440.0f, 20, 10000, patch, 50);
+    synth.noteOn(440.0f, 20, 10000, patch, 333);
+    auto x = render(synth, 0.2);
+    // Phase 0 of a sine is 0, the first non zero sample is the one after the start
+    check("delayed note start, frames", static_cast<double>(first_sound(x)), g_rate / 20, g_rate / 20 + 1, "");
+
+    x              = render(synth, 0.2);
+    const size_t at = g_rate / 5 + first_sound(x);
+    check("second delayed note start, frames", static_cast<double>(at), g_rate * 333 / 1000,
+          g_rate * 333 / 1000 + 1, "");
+
+    // A full pool steals, a full queue drops
+    Synth pool;
+    pool.begin(g_rate);
+    for (size_t i = 0; i < Synth::kMaxVoices + 4; ++i) {
+        pool.noteOn(200.0f + 100.0f * i, 500, 2000, patch);
+    }
+    render(pool, 0.1);
+    auto s = pool.stats();
+    check("voices stolen", s.stolen, 4, 4, "");
+    check("peak voices", s.peak_voices, Synth::kMaxVoices, Synth::kMaxVoices, "");
+    for (size_t i = 0; i < Synth::kQueueDepth + 5; ++i) {
+        pool.noteOn(300.0f, 10, 2000, patch);
+    }
+    s = pool.stats();
+    check("commands dropped", s.dropped, 5, 5, "");
+    pool.allOff();
+    render(pool, 0.1);
+    check("idle after all off", pool.idle() ? 1 : 0, 1, 1, "");
+}
+
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -r <hz>    sample rate (default 48000)\n"
+        "  -s <sec>   audio for the benchmark (default 60)\n"
+        "  -c         checks only\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds  = 60.0f;
+    bool benchmark = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            g_rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            seconds = static_cast<float>(std::strtod(argv[++i], nullptr));
+        } else if (std::strcmp(argv[i], "-c") == 0) {
+            benchmark = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (g_rate < 8000) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    check_sine(440.0f);
+    check_sine(4186.0f);
+    check_envelope();
+    check_schedule();
+
+    if (benchmark) {
+        // Every voice held, one of each wave, for the whole run
+        Synth synth;
+        synth.begin(g_rate);
+        const uint32_t ms = static_cast<uint32_t>(seconds * 1000.0f) + 1000;
+        for (size_t v = 0; v < Synth::kMaxVoices; ++v) {
+            Synth::Patch_t patch;
+            patch.wave = static_cast<Synth::Wave>(v % 4);
+            synth.noteOn(110.0f * (v + 1), ms, 3000, patch);
+        }
+        std::vector<int16_t> block(Synth::kBlockFrames);
+        const size_t blocks = static_cast<size_t>(seconds * g_rate / Synth::kBlockFrames);
+        const auto t0       = std::chrono::steady_clock::now();
+        for (size_t b = 0; b < blocks; ++b) {
+            synth.render(block.data(), block.size());
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        const auto s    = synth.stats();
+        std::printf("\n%u voices, %zu frame blocks at %u Hz\n", s.peak_voices, Synth::kBlockFrames, g_rate);
+        std::printf("%-34s %10u ns/voice/block\n", "synth stats", s.voice_ns);
+        std::printf("%-34s %10.1f ns/voice/block %8.2f ns/sample\n", "host clock",
+                    ns / (static_cast<double>(blocks) * s.peak_voices),
+                    ns / (static_cast<double>(blocks) * s.peak_voices * Synth::kBlockFrames));
+        std::printf("%-34s %10u us\n", "slowest block", s.max_block_us);
+    }
+
+    std::fprintf(stderr, "%d checks failed: %s\n", failures, failures == 0 ? "OK" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
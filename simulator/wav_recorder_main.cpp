@@ -0,0 +1,276 @@
+/*
+ * SPDX-FileCopyrightText: 2025 M5Stack Technology CO LTD
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <apps/utils/audio/wav_recorder.h>
+#include <apps/utils/audio/ima_adpcm.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Host run of the WAV recorder, time lapsed
+ *
+ * A capture thread pushes a tone per channel in DMA sized periods, paced at -x times real time, while the writer
+ * task writes to a file in -d. Every -p th write stalls for -S ms of card time on top of the real write, the way a
+ * card does when FAT allocates a new cluster run. Afterwards the file is read back: the patched header has to match
+ * what was pushed, and without drops PCM has to match sample for sample and ADPCM has to decode to within -n dB SNR.
+ * Fails on any dropped frame unless -D.
+ */
+static void print_usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [options]\n"
+        "  -d <dir>   folder for the file, e.g. a card in a USB reader (default /tmp)\n"
+        "  -r <hz>    sample rate (default 48000)\n"
+        "  -c <n>     channels, 1 or 2 (default 2)\n"
+        "  -a         IMA ADPCM instead of PCM\n"
+        "  -t <sec>   audio length (default 600, 3600 for the hour)\n"
+        "  -x <n>     time lapse factor, 0 to push as fast as the writer takes it (default 40)\n"
+        "  -s <n>     slots of 16 KB, the hour at 48 kHz stereo PCM wants 8 (default 8)\n"
+        "  -S <ms>    card stall added to a write (default 150)\n"
+        "  -p <n>     stall every n writes, 0 for none (default 64)\n"
+        "  -n <dB>    least ADPCM SNR (default 30)\n"
+        "  -D         dropped frames don't fail the run\n"
+        "  -k         keep the file\n",
+        argv0);
+}
+
+static uint32_t g_stall_every = 64;
+static double g_stall_ms      = 150.0;
+static double g_speedup       = 40.0;
+static std::atomic<uint32_t> g_write_count{0};
+
+static ssize_t stalling_write(int fd, const void* data, size_t len)
+{
+    const uint32_t n = ++g_write_count;
+    if (g_stall_every > 0 && n % g_stall_every == 0 && g_stall_ms > 0.0) {
+        const double real_ms = g_speedup > 0.0 ? g_stall_ms / g_speedup : g_stall_ms;
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(real_ms * 1000.0)));
+    }
+    return ::write(fd, data, len);
+}
+
+// One period of the test tone per channel, channel c plays (c + 1) * 441 Hz at -12 dBFS
+struct Tone {
+    std::vector<int16_t> table;
+    uint32_t rate = 0;
+
+    explicit Tone(uint32_t sample_rate) : table(sample_rate), rate(sample_rate)
+    {
+        for (uint32_t i = 0; i < rate; ++i) {
+            table[i] = static_cast<int16_t>(std::lround(8192.0 * std::sin(2.0 * M_PI * i / rate)));
+        }
+    }
+    int16_t at(uint64_t frame, uint32_t channel) const
+    {
+        return table[(frame * 441 * (channel + 1)) % rate];
+    }
+};
+
+static uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+int main(int argc, char** argv)
+{
+    std::string dir  = "/tmp";
+    uint32_t rate    = 48000;
+    uint8_t channels = 2;
+    bool ima         = false;
+    double seconds   = 600.0;
+    size_t slots     = 8;
+    double min_snr   = 30.0;
+    bool allow_drops = false;
+    bool keep        = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-d") == 0 && has_value) {
+            dir = argv[++i];
+        } else if (std::strcmp(argv[i], "-r") == 0 && has_value) {
+            rate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-c") == 0 && has_value) {
+            channels = static_cast<uint8_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-a") == 0) {
+            ima = true;
+        } else if (std::strcmp(argv[i], "-t") == 0 && has_value) {
+            seconds = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-x") == 0 && has_value) {
+            g_speedup = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-s") == 0 && has_value) {
+            slots = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-S") == 0 && has_value) {
+            g_stall_ms = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-p") == 0 && has_value) {
+            g_stall_every = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "-n") == 0 && has_value) {
+            min_snr = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "-D") == 0) {
+            allow_drops = true;
+        } else if (std::strcmp(argv[i], "-k") == 0) {
+            keep = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rate == 0 || channels < 1 || channels > 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    WavRecorder::Config_t config;
+    config.path        = dir + "/wav_recorder_bench.wav";
+    config.sample_rate = rate;
+    config.channels    = channels;
+    config.codec       = ima ? WavRecorder::Codec::ImaAdpcm : WavRecorder::Codec::Pcm16;
+    config.slots       = slots;
+    config.write       = stalling_write;
+
+    WavRecorder recorder;
+    if (!recorder.start(config)) {
+        std::fprintf(stderr, "start failed: %s\n", std::strerror(recorder.stats().error));
+        return 1;
+    }
+    const uint32_t byte_rate = WavRecorder::byteRate(config);
+    const auto started       = recorder.stats();
+    std::fprintf(stderr, "%u Hz x%u %s, %.0f s, %u slots = %.0f ms of audio, stall %.0f ms every %u writes\n", rate,
+                 channels, ima ? "ADPCM" : "PCM", seconds, started.slots,
+                 started.slots * WavRecorder::kChunkBytes * 1000.0 / byte_rate, g_stall_ms, g_stall_every);
+
+    // 8 ms periods, what the I2S driver hands over per DMA descriptor at these rates
+    const Tone tone(rate);
+    const size_t period    = std::max<size_t>(1, rate / 125);
+    const uint64_t total   = static_cast<uint64_t>(seconds * rate);
+    const auto period_real = std::chrono::duration<double>(g_speedup > 0.0 ? 0.008 / g_speedup : 0.0);
+    const auto wall_start  = std::chrono::steady_clock::now();
+    auto next              = wall_start;
+    std::vector<int16_t> buf(period * channels);
+    for (uint64_t frame = 0; frame < total; frame += period) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(period, total - frame));
+        for (size_t i = 0; i < n; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                buf[i * channels + c] = tone.at(frame + i, c);
+            }
+        }
+        recorder.push(buf.data(), n);
+        if (g_speedup > 0.0) {
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period_real);
+            std::this_thread::sleep_until(next);
+        }
+    }
+    recorder.finish();
+    recorder.wait();
+    const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    const auto s          = recorder.stats();
+    const double card_max = s.max_write_us * (g_speedup > 0.0 ? g_speedup : 1.0) / 1000.0;
+    std::fprintf(stderr,
+                 "frames %u, dropped %u, %u writes, %.1f MB, max write %.1f ms card time, fewest free slots %u, "
+                 "%.1f s wall\n",
+                 s.frames, s.dropped, s.writes, s.bytes / 1e6, card_max, s.min_free, wall);
+    bool ok = s.error == 0;
+    if (!ok) {
+        std::fprintf(stderr, "recorder error: %s\n", std::strerror(s.error));
+    }
+    if (s.dropped > 0 && !allow_drops) {
+        ok = false;
+    }
+
+    // Read back
+    FILE* f = std::fopen(config.path.c_str(), "rb");
+    if (f == nullptr) {
+        std::fprintf(stderr, "can't open %s\n", config.path.c_str());
+        return 1;
+    }
+    const size_t header_bytes = ima ? 60 : 44;
+    uint8_t header[60];
+    if (std::fread(header, 1, header_bytes, f) != header_bytes) {
+        std::fprintf(stderr, "short header\n");
+        return 1;
+    }
+    std::fseek(f, 0, SEEK_END);
+    const uint64_t file_bytes = static_cast<uint64_t>(std::ftell(f));
+    std::fseek(f, static_cast<long>(header_bytes), SEEK_SET);
+    const uint32_t data_bytes = get32(header + header_bytes - 4);
+    const uint32_t riff_bytes = get32(header + 4);
+    if (std::memcmp(header, "RIFF", 4) != 0 || riff_bytes + 8 != file_bytes ||
+        data_bytes + header_bytes != file_bytes || s.bytes != file_bytes) {
+        std::fprintf(stderr, "header sizes: riff %u data %u, file %llu\n", riff_bytes, data_bytes,
+                     static_cast<unsigned long long>(file_bytes));
+        ok = false;
+    }
+
+    if (!ima) {
+        if (data_bytes != static_cast<uint64_t>(s.frames) * channels * 2) {
+            std::fprintf(stderr, "data holds %u bytes for %u frames\n", data_bytes, s.frames);
+            ok = false;
+        }
+        if (s.dropped == 0) {
+            std::vector<int16_t> chunk(64 * 1024);
+            uint64_t sample = 0;
+            size_t got      = 0;
+            while ((got = std::fread(chunk.data(), 2, chunk.size(), f)) > 0) {
+                for (size_t i = 0; i < got; ++i, ++sample) {
+                    if (chunk[i] != tone.at(sample / channels, sample % channels)) {
+                        std::fprintf(stderr, "sample %llu differs\n", static_cast<unsigned long long>(sample));
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+        }
+    } else {
+        const uint32_t fact = get32(header + 48);
+        const size_t block  = adpcm::blockBytes(channels);
+        if (fact != s.frames || data_bytes % block != 0 ||
+            data_bytes / block != (s.frames + adpcm::kFramesPerBlock - 1) / adpcm::kFramesPerBlock) {
+            std::fprintf(stderr, "fact %u frames, data %u bytes for %u frames\n", fact, data_bytes, s.frames);
+            ok = false;
+        }
+        if (s.dropped == 0) {
+            std::vector<uint8_t> in(block);
+            std::vector<int16_t> out(adpcm::kFramesPerBlock * channels);
+            double signal = 0.0;
+            double noise  = 0.0;
+            uint64_t at   = 0;
+            while (at < fact && std::fread(in.data(), 1, block, f) == block) {
+                adpcm::decodeBlock(in.data(), channels, out.data());
+                const uint64_t n = std::min<uint64_t>(adpcm::kFramesPerBlock, fact - at);
+                for (uint64_t i = 0; i < n; ++i) {
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        const double want = tone.at(at + i, c);
+                        const double err  = out[i * channels + c] - want;
+                        signal += want * want;
+                        noise += err * err;
+                    }
+                }
+                at += n;
+            }
+            const double snr = 10.0 * std::log10(signal / std::max(noise, 1.0));
+            std::fprintf(stderr, "ADPCM SNR %.1f dB\n", snr);
+            if (snr < min_snr) {
+                ok = false;
+            }
+        }
+    }
+    std::fclose(f);
+    if (!keep) {
+        std::remove(config.path.c_str());
+    }
+
+    std::fprintf(stderr, "%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}